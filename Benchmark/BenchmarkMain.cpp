@@ -0,0 +1,33 @@
+//**********************************************************************************************
+//
+// BenchmarkMain.cpp
+//
+// Runs the CPU benchmark suite (CpuBenchmarkSuite.h): its scenes and the subsystem benchmarks.
+// The readable summary is printed first, then the JSON report, and the exit code is 0 when
+// clean, 1 on regressions against -baseline and 2 on errors.
+//
+//   HonoursBenchmark [-report report.json] [-baseline baseline.json] [-threshold 0.1]
+//                    [-threads n] [-frames n] [-scenes-only | -subsystems-only]
+//
+//**********************************************************************************************
+
+#include "CpuBenchmarkSuite.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    Cpu::BenchmarkCommand command;
+    std::string error;
+    if (!Cpu::ParseBenchmarkCommand(args, command, &error)) {
+        std::fprintf(stderr, "HonoursBenchmark: %s\n", error.c_str());
+        return 2;
+    }
+    std::string log, json;
+    int exitCode = Cpu::RunBenchmarkCommand(command, log, json);
+    std::fputs(log.c_str(), stdout);
+    std::fputs(json.c_str(), stdout);
+    return exitCode;
+}
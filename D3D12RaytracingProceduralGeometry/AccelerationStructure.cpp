@@ -40,17 +40,17 @@ void AccelerationStructure::BuildGeometryDescsForBottomLevelAS(array<vector<D3D1
         aabbDescTemplate.AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
         aabbDescTemplate.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
 
-        // One AABB primitive per geometry.
+        // One geometry per primitive type, covering that type's run of procedural instances.
         geometryDescs[BottomLevelASType::AABB].resize(IntersectionShaderType::TotalPrimitiveCount, aabbDescTemplate);
-        // geometryDescs[BottomLevelASType::AABB].resize(scene->analyticalObjects.size(), aabbDescTemplate);
 
          // Create AABB geometries. 
          // Having separate geometries allows of separate shader record binding per geometry.
          // In this sample, this lets us specify custom hit groups per AABB geometry.
-        // for (UINT i = 0; i < IntersectionShaderType::TotalPrimitiveCount; i++)
+        const ProceduralInstanceTable& instances = scene->instances;
         for (UINT i = 0; i < IntersectionShaderType::TotalPrimitiveCount; i++) {
             auto& geometryDesc = geometryDescs[BottomLevelASType::AABB][i];
-            geometryDesc.AABBs.AABBs.StartAddress = scene->getAABB()->resource->GetGPUVirtualAddress() + i * sizeof(D3D12_RAYTRACING_AABB);
+            geometryDesc.AABBs.AABBCount = instances.SlotInstances(i);
+            geometryDesc.AABBs.AABBs.StartAddress = scene->getAABB()->resource->GetGPUVirtualAddress() + instances.SlotFirst(i) * sizeof(D3D12_RAYTRACING_AABB);
         }
     }
 }
@@ -107,11 +107,8 @@ AccelerationStructureBuffers AccelerationStructure::BuildBottomLevelAS(const vec
 }
 
 template <class InstanceDescType, class BLASPtrType>
-void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLevelASaddresses, ComPtr<ID3D12Resource>* instanceDescsResource, std::unique_ptr<DX::DeviceResources> &m_deviceResources)
+void AccelerationStructure::FillInstanceDescs(BLASPtrType* bottomLevelASaddresses, vector<InstanceDescType>& instanceDescs)
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    vector<InstanceDescType> instanceDescs;
     // instanceDescs.resize(scene->NUM_BLAS + 1);
     instanceDescs.resize(scene->NUM_BLAS);
 
@@ -131,6 +128,7 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
         if (!scene->triangleInstancing && !scene->albany) {
             auto& instanceDesc = instanceDescs[BottomLevelASType::Triangle];
             instanceDesc = {};
+            instanceDesc.InstanceID = scene->materials.InstanceMaterial(BottomLevelASType::Triangle);
             instanceDesc.InstanceMask = 1;
             instanceDesc.InstanceContributionToHitGroupIndex = 0;
             instanceDesc.AccelerationStructure = bottomLevelASaddresses[BottomLevelASType::Triangle];
@@ -164,6 +162,7 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
             for (int i = 0; i < scene->NUM_BLAS - 1; i++) {
                 auto& instanceDesc = instanceDescs[BottomLevelASType::Triangle + i];
                 instanceDesc = {};
+                instanceDesc.InstanceID = scene->materials.InstanceMaterial(BottomLevelASType::Triangle + i);
                 instanceDesc.InstanceMask = 1;
 
                 // Set hit group offset to beyond the shader records for the triangle AABB.
@@ -172,19 +171,13 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
                 /*float x = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));
                  float y = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));
                  float z = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));*/
-                float x;
-                float y;
-                float z;
+                // One instance per selected point or merged octree cell, already in world units.
+                const PointCloudLodInstance& point = scene->pointCloudInstances[i];
+                float scale = scene->pointCloudScale * point.scale;
+                XMMATRIX mScale = XMMatrixScaling(scale, scale, scale);
 
-                Vertex_Ply coord = scene->coordinates->getPointAt(i);
-
-                x = 5 * coord.location.x();
-                y = 5 * coord.location.y();
-                z = 5 * coord.location.z();
-                XMMATRIX mScale = XMMatrixScaling(0.1, 0.1, 0.1);
-
-                XMMATRIX mTranslation = XMMatrixTranslationFromVector(XMLoadFloat3(&XMFLOAT3(x, y, z)));
-                XMMATRIX mTransform = mScale + mTranslation;
+                XMMATRIX mTranslation = XMMatrixTranslation(point.position[0], point.position[1], point.position[2]);
+                XMMATRIX mTransform = mScale * mTranslation;
 
                 XMStoreFloat3x4(reinterpret_cast<XMFLOAT3X4*>(instanceDesc.Transform), mTransform);
             }
@@ -203,6 +196,7 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
             for (int i = 0; i < scene->NUM_BLAS - 1; i++) {
                 auto& instanceDesc = instanceDescs[BottomLevelASType::AABB + i];
                 instanceDesc = {};
+                instanceDesc.InstanceID = scene->materials.InstanceMaterial(BottomLevelASType::AABB + i);
                 instanceDesc.InstanceMask = 1;
 
                 // Set hit group offset to beyond the shader records for the triangle AABB.
@@ -212,12 +206,13 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
                float x;
                float y;
                float z;
+               float scale = 1;
                 if (scene->albany && scene->instancing) {
-                    Vertex_Ply coord = scene->coordinates->getPointAt(i);
-
-                    x = 10 * coord.location.x();
-                    y = 10 * coord.location.y();
-                    z = 10 * coord.location.z();
+                    const PointCloudLodInstance& point = scene->pointCloudInstances[i];
+                    x = point.position[0];
+                    y = point.position[1];
+                    z = point.position[2];
+                    scale = scene->pointCloudScale * point.scale;
                 }
                 else if(!scene->instancing) {
                     x = 0;
@@ -231,16 +226,27 @@ void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLe
                     y = scene->c_aabbWidth / 2  - 7;
 
                 }
-                XMMATRIX mScale = XMMatrixScaling(1, 1, 1);
+                XMMATRIX mScale = XMMatrixScaling(scale, scale, scale);
 
                 // Move all AABBS above the ground plane.
                 XMMATRIX mTranslation = XMMatrixTranslationFromVector(XMLoadFloat3(&XMFLOAT3(x, y, z)));
-                XMMATRIX mTransform = mScale + mTranslation;
+                // Point cloud instances scale by their LOD cell, so they compose the matrices
+                // properly; the others keep the summed form they were tuned with.
+                XMMATRIX mTransform = scene->albany ? mScale * mTranslation : mScale + mTranslation;
 
                 XMStoreFloat3x4(reinterpret_cast<XMFLOAT3X4*>(instanceDesc.Transform), mTransform);
             }
         }
     }
+}
+
+template <class InstanceDescType, class BLASPtrType>
+void AccelerationStructure::BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLevelASaddresses, ComPtr<ID3D12Resource>* instanceDescsResource, std::unique_ptr<DX::DeviceResources> &m_deviceResources)
+{
+    auto device = m_deviceResources->GetD3DDevice();
+
+    vector<InstanceDescType> instanceDescs;
+    FillInstanceDescs(bottomLevelASaddresses, instanceDescs);
     UINT64 bufferSize = static_cast<UINT64>(instanceDescs.size() * sizeof(instanceDescs[0]));
     AllocateUploadBuffer(device, instanceDescs.data(), bufferSize, &(*instanceDescsResource), L"InstanceDescs");
 };
@@ -308,6 +314,75 @@ AccelerationStructureBuffers AccelerationStructure::BuildTopLevelAS(Acceleration
     return topLevelASBuffers;
 }
 
+void AccelerationStructure::RebuildTopLevelAS(std::unique_ptr<DX::DeviceResources>& m_deviceResources, ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12GraphicsCommandList5> m_dxrCommandList)
+{
+    auto device = m_deviceResources->GetD3DDevice();
+    auto commandList = m_deviceResources->GetCommandList();
+
+    // Prepare() has waited for the slot's last frame, so what it retired then is unused now.
+    if (m_frameResources.size() < m_deviceResources->GetBackBufferCount())
+    {
+        m_frameResources.resize(m_deviceResources->GetBackBufferCount());
+    }
+    FrameResources& frame = m_frameResources[m_deviceResources->GetCurrentFrameIndex()];
+    frame.retired.clear();
+
+    vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs;
+    D3D12_GPU_VIRTUAL_ADDRESS bottomLevelASaddresses[BottomLevelASType::Count] =
+    {
+        m_bottomLevelAS[0]->GetGPUVirtualAddress(),
+        m_bottomLevelAS[1]->GetGPUVirtualAddress()
+    };
+    FillInstanceDescs(bottomLevelASaddresses, instanceDescs);
+    UINT64 descBytes = static_cast<UINT64>(instanceDescs.size() * sizeof(instanceDescs[0]));
+    if (!frame.instanceDescs || frame.instanceDescs->GetDesc().Width < descBytes)
+    {
+        AllocateUploadBuffer(device, instanceDescs.data(), descBytes, &frame.instanceDescs, L"InstanceDescs");
+    }
+    else
+    {
+        void* mappedData;
+        ThrowIfFailed(frame.instanceDescs->Map(0, nullptr, &mappedData));
+        memcpy(mappedData, instanceDescs.data(), descBytes);
+        frame.instanceDescs->Unmap(0, nullptr);
+    }
+
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelBuildDesc = {};
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& topLevelInputs = topLevelBuildDesc.Inputs;
+    topLevelInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+    topLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+    topLevelInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+    topLevelInputs.NumDescs = static_cast<UINT>(instanceDescs.size());
+    topLevelInputs.InstanceDescs = frame.instanceDescs->GetGPUVirtualAddress();
+
+    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO topLevelPrebuildInfo = {};
+    m_dxrDevice->GetRaytracingAccelerationStructurePrebuildInfo(&topLevelInputs, &topLevelPrebuildInfo);
+    ThrowIfFalse(topLevelPrebuildInfo.ResultDataMaxSizeInBytes > 0);
+
+    // Earlier frames on the queue are done with the buffers before this build runs, so they
+    // are reused in place unless they are too small.
+    if (m_topLevelAS->GetDesc().Width < topLevelPrebuildInfo.ResultDataMaxSizeInBytes)
+    {
+        frame.retired.push_back(m_topLevelAS);
+        AllocateUAVBuffer(device, topLevelPrebuildInfo.ResultDataMaxSizeInBytes, &m_topLevelAS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"TopLevelAccelerationStructure");
+    }
+    if (!m_topLevelScratch || m_topLevelScratch->GetDesc().Width < topLevelPrebuildInfo.ScratchDataSizeInBytes)
+    {
+        if (m_topLevelScratch)
+        {
+            frame.retired.push_back(m_topLevelScratch);
+        }
+        AllocateUAVBuffer(device, topLevelPrebuildInfo.ScratchDataSizeInBytes, &m_topLevelScratch, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
+    }
+
+    topLevelBuildDesc.DestAccelerationStructureData = m_topLevelAS->GetGPUVirtualAddress();
+    topLevelBuildDesc.ScratchAccelerationStructureData = m_topLevelScratch->GetGPUVirtualAddress();
+    m_dxrCommandList->BuildRaytracingAccelerationStructure(&topLevelBuildDesc, 0, nullptr);
+
+    D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_topLevelAS.Get());
+    commandList->ResourceBarrier(1, &barrier);
+}
+
 // Build acceleration structure needed for raytracing.
 void AccelerationStructure::BuildAccelerationStructures(std::unique_ptr<DX::DeviceResources> &m_deviceResources,  ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12GraphicsCommandList5> m_dxrCommandList)
 {
@@ -373,4 +448,6 @@ ComPtr<ID3D12Resource> AccelerationStructure::getTopLevel()
 void AccelerationStructure::Reset() {
     ResetComPtrArray(&m_bottomLevelAS);
     m_topLevelAS.Reset();
+    m_topLevelScratch.Reset();
+    m_frameResources.clear();
 }
\ No newline at end of file
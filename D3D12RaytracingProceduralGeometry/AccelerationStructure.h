@@ -10,6 +10,16 @@ private:
 
 	ComPtr<ID3D12Resource> m_bottomLevelAS[BottomLevelASType::Count];
 	ComPtr<ID3D12Resource> m_topLevelAS;
+	ComPtr<ID3D12Resource> m_topLevelScratch;
+
+	// Top-level rebuilds write their instance descs to the frame slot's own upload buffer. A
+	// TLAS or scratch buffer that had to grow is kept with the slot until it comes round again,
+	// since frames still in flight may trace against it.
+	struct FrameResources {
+		ComPtr<ID3D12Resource> instanceDescs;
+		vector<ComPtr<ID3D12Resource>> retired;
+	};
+	vector<FrameResources> m_frameResources;
 
 	void BuildGeometryDescsForBottomLevelAS(array<vector<D3D12_RAYTRACING_GEOMETRY_DESC>, BottomLevelASType::Count>& geometryDescs);
 	AccelerationStructureBuffers BuildBottomLevelAS(const vector<D3D12_RAYTRACING_GEOMETRY_DESC>& geometryDescs, std::unique_ptr<DX::DeviceResources>& m_deviceResources, ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12GraphicsCommandList5> m_dxrCommandList, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE);
@@ -28,8 +38,16 @@ public:
 	
 	ComPtr<ID3D12Resource> getTopLevel();
 
+	// Records a rebuild of the top level alone, from the scene's current instances, on the
+	// frame's command list after DeviceResources::Prepare(). Neither waits for the GPU nor
+	// touches the bottom levels.
+	void RebuildTopLevelAS(std::unique_ptr<DX::DeviceResources>& m_deviceResources, ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12GraphicsCommandList5> m_dxrCommandList);
+
 	void Reset();
 
+	template<class InstanceDescType, class BLASPtrType>
+	void FillInstanceDescs(BLASPtrType* bottomLevelASaddresses, vector<InstanceDescType>& instanceDescs);
+
 	template<class InstanceDescType, class BLASPtrType>
 	void BuildBotomLevelASInstanceDescs(BLASPtrType* bottomLevelASaddresses, ComPtr<ID3D12Resource>* instanceDescsResource, std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 
@@ -86,6 +86,9 @@ const wchar_t* Application::c_compositeHitGroup = L"HitCompositeTri";
 
 const wchar_t* Application::c_photon_rayGen = L"Photon_Ray_Gen";
 
+const char* Application::c_cameraPathFile = "camera.hcam";
+const double Application::c_cameraReplayTimestep = 1.0 / 60.0;
+
 const wchar_t* Application::c_photon_closestHit[] =
 {
     L"ClosestHit_Photon_Triangle",
@@ -100,12 +103,13 @@ const wchar_t* Application::c_photonMiss[] =
 
 Application::Application(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
-    m_raytracingOutputResourceUAVDescriptorHeapIndex(UINT_MAX),
     m_animateGeometryTime(0.0f),
     m_animateGeometry(true),
     m_animateLight(false),
-    m_descriptorsAllocated(0),
+    m_resourceDescriptorRange(0),
     m_descriptorSize(0),
+    m_photonCapacity(PHOTON_COUNT, c_maxPhotonCapacity),
+    m_photonBudget(PHOTON_COUNT),
     m_missShaderTableStrideInBytes(UINT_MAX),
     m_hitGroupShaderTableStrideInBytes(UINT_MAX)
 {
@@ -140,12 +144,33 @@ void Application::OnInit()
 
     //InitializeScene();
     scene = new Scene(m_deviceResources);
+    int length = WideCharToMultiByte(CP_ACP, 0, m_scenePath.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    std::string scenePath(length, '\0');
+    WideCharToMultiByte(CP_ACP, 0, m_scenePath.c_str(), -1, &scenePath[0], length, nullptr, nullptr);
+    scenePath.resize(length - 1);
+    scene->Load(scenePath);
     scene->Init(m_aspectRatio);
+    scene->SelectPointCloudInstances(m_height);
     CreateDeviceDependentResources();
     CreateWindowSizeDependentResources();
 
 }
 
+// -scene <path> picks the scene description; everything else is left to DXSample.
+_Use_decl_annotations_
+void Application::ParseCommandLineArgs(WCHAR* argv[], int argc)
+{
+    DXSample::ParseCommandLineArgs(argv, argc);
+    for (int i = 1; i < argc; ++i)
+    {
+        if (_wcsicmp(argv[i], L"-scene") == 0 || _wcsicmp(argv[i], L"/scene") == 0)
+        {
+            ThrowIfFalse(i + 1 < argc, L"Incorrect argument format passed in.");
+            m_scenePath = argv[++i];
+        }
+    }
+}
+
 
 
 
@@ -209,28 +234,16 @@ void Application::CreateDeviceDependentResources()
     // Create constant buffers for the geometry and the scene.
     //CreateConstantBuffers();
 
-    // Create AABB primitive attribute buffers.
+    // Per-frame constants and attributes are staged on the CPU and uploaded through the ring,
+    // which also has to fit every frame in flight's copy of the procedural instance attributes.
+    UINT attributeBytes = scene->instances.Count() * sizeof(PrimitiveInstancePerFrameBuffer);
+    m_uploadRing.Create(m_deviceResources->GetD3DDevice(), c_uploadRingSize + FrameCount * attributeBytes, L"Upload ring");
     scene->CreateAABBPrimitiveAttributesBuffers(m_deviceResources);
     scene->CreateCSGTree(m_deviceResources);
     scene->convertCSGToArray(10, m_deviceResources);
+    scene->CreateMaterialTable(m_deviceResources);
     // Build shader tables, which define shaders and their local root arguments.
-    BuildForwardPathShaderTables();
-
-    if (photonMapping) {
-        BuildShaderTables();
-
-        BuildCompositeTable();
-        BuildPhotonShaderTable();
-        if (mappingAndPathing) {
-            BuildLightPathShaderTable();
-            BuildSecondPassLightShaderTables();
-
-        }
-    }
-    else {
-        BuildLightPathShaderTable();
-        BuildSecondPassLightShaderTables();
-    }
+    BuildAllShaderTables();
 
     // Create an output 2D texture to store the raytracing result to.
     //CreateRaytracingOutputResource();
@@ -283,7 +296,8 @@ void Application::CreateLightBidirectionalRootSignatures()
     {
         namespace RootSignatureSlots = LocalRootSignature::Triangle::Slot;
         CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+        rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
 
         CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
         localRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
@@ -294,7 +308,8 @@ void Application::CreateLightBidirectionalRootSignatures()
     {
         namespace RootSignatureSlots = LocalRootSignature::AABB::Slot;
         CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+        rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
         rootParameters[RootSignatureSlots::GeometryIndex].InitAsConstants(SizeOfInUint32(PrimitiveInstanceConstantBuffer), 2);
 
         CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
@@ -339,7 +354,8 @@ void Application::CreateForwardBidirectionalRootSignatures() {
     {
         namespace RootSignatureSlots = LocalRootSignature::Triangle::Slot;
         CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+        rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
 
         CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
         localRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
@@ -350,7 +366,8 @@ void Application::CreateForwardBidirectionalRootSignatures() {
     {
         namespace RootSignatureSlots = LocalRootSignature::AABB::Slot;
         CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+        rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+        rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
         rootParameters[RootSignatureSlots::GeometryIndex].InitAsConstants(SizeOfInUint32(PrimitiveInstanceConstantBuffer), 2);
 
         CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
@@ -426,7 +443,8 @@ void Application::CreatePhotonMappingRootSignatures()
         {
             namespace RootSignatureSlots = LocalRootSignature::Triangle::Slot;
             CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+            rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
 
             CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
             localRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
@@ -437,7 +455,8 @@ void Application::CreatePhotonMappingRootSignatures()
         {
             namespace RootSignatureSlots = LocalRootSignature::AABB::Slot;
             CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+            rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
             rootParameters[RootSignatureSlots::GeometryIndex].InitAsConstants(SizeOfInUint32(PrimitiveInstanceConstantBuffer), 2);
 
             CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
@@ -525,9 +544,9 @@ void Application::CreateRasterRootSignatures() {
 
     ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
     ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
-    //vertex RW buffer
-    ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
-    ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 4);
+    //vertex RW buffer, then its counter
+    ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 2);
+    ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 4);
     ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 8);
 
   //  rootParameters[RasterisationRootSignature::Slot::Constant].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_VERTEX);
@@ -555,13 +574,16 @@ void Application::CreateRasterRootSignatures() {
 
 void Application::CreateCompositeRayRoot() {
     auto device = m_deviceResources->GetD3DDevice();
-    CD3DX12_DESCRIPTOR_RANGE ranges[2];
+    CD3DX12_DESCRIPTOR_RANGE ranges[3];
     ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
     ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
+    ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 1);
 
-    CD3DX12_ROOT_PARAMETER rootParams[2];
-    rootParams[0].InitAsDescriptorTable(1, &ranges[0]);
-    rootParams[1].InitAsDescriptorTable(1, &ranges[1]);
+    CD3DX12_ROOT_PARAMETER rootParams[ComputeCompositeRootSignature::Slot::Count];
+    rootParams[ComputeCompositeRootSignature::Slot::RayTracingView].InitAsDescriptorTable(1, &ranges[0]);
+    rootParams[ComputeCompositeRootSignature::Slot::RasterView].InitAsDescriptorTable(1, &ranges[1]);
+    rootParams[ComputeCompositeRootSignature::Slot::PhotonAccumulation].InitAsDescriptorTable(1, &ranges[2]);
+    rootParams[ComputeCompositeRootSignature::Slot::SceneConstant].InitAsConstantBufferView(0);
 
     CD3DX12_ROOT_SIGNATURE_DESC globalRootSignatureDesc(ARRAYSIZE(rootParams), rootParams);
 
@@ -614,7 +636,7 @@ void Application::CreateRootSignatures()
             ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
             ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
             ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 9);
-            ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 4);
+            ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 4);
             ranges[5].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 1);
             ranges[6].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 3);
 
@@ -643,7 +665,8 @@ void Application::CreateRootSignatures()
         {
             namespace RootSignatureSlots = LocalRootSignature::Triangle::Slot;
             CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+            rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
 
             CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
             localRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
@@ -654,7 +677,8 @@ void Application::CreateRootSignatures()
         {
             namespace RootSignatureSlots = LocalRootSignature::AABB::Slot;
             CD3DX12_ROOT_PARAMETER rootParameters[RootSignatureSlots::Count];
-            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(PrimitiveConstantBuffer), 1);
+            rootParameters[RootSignatureSlots::MaterialTable].InitAsShaderResourceView(5);
+            rootParameters[RootSignatureSlots::MaterialConstant].InitAsConstants(SizeOfInUint32(MaterialConstantBuffer), 1);
             rootParameters[RootSignatureSlots::GeometryIndex].InitAsConstants(SizeOfInUint32(PrimitiveInstanceConstantBuffer), 2);
 
             CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
@@ -1407,7 +1431,7 @@ void Application::CreateTiledPhotonMap() {
             ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&tiledPhotonMapBuffer)));
             NAME_D3D12_OBJECT(tiledPhotonMapBuffer);
 
-            tiledPhotonMapUAVDescriptorIndex = AllocateDescriptor(&tiledPhotonMapCPUDescriptor, tiledPhotonMapUAVDescriptorIndex);
+            tiledPhotonMapUAVDescriptor = AllocateDescriptor(&tiledPhotonMapCPUDescriptor, tiledPhotonMapUAVDescriptor);
             D3D12_UNORDERED_ACCESS_VIEW_DESC uavPhotonDesc = {};
             uavPhotonDesc.Buffer.NumElements = PHOTON_COUNT;
             uavPhotonDesc.Buffer.FirstElement = 0;
@@ -1416,31 +1440,10 @@ void Application::CreateTiledPhotonMap() {
             uavPhotonDesc.Format = DXGI_FORMAT_UNKNOWN;
             uavPhotonDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
             device->CreateUnorderedAccessView(tiledPhotonMapBuffer.Get(), nullptr, &uavPhotonDesc, tiledPhotonMapCPUDescriptor);
-            tiledPhotonUAVGpuDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), tiledPhotonMapUAVDescriptorIndex, m_descriptorSize);
+            tiledPhotonUAVGpuDescriptor = m_descriptors.GpuHandle(tiledPhotonMapUAVDescriptor);
         }
 
 }
-void Application::CreatePhotonCountTest() {
-    auto device = m_deviceResources->GetD3DDevice();
-    {
-        auto uavDesc = CD3DX12_RESOURCE_DESC::Buffer(1 * sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        auto defaultHeapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-        ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&photonCountBuffer)));
-
-        CD3DX12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        photonCountUavDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, photonCountUavDescriptorHeapIndex);
-        D3D12_UNORDERED_ACCESS_VIEW_DESC uavPhotonDesc = {};
-        uavPhotonDesc.Buffer.NumElements = 1;
-        uavPhotonDesc.Buffer.FirstElement = 0;
-        uavPhotonDesc.Buffer.StructureByteStride = sizeof(UINT);
-        uavPhotonDesc.Format = DXGI_FORMAT_UNKNOWN;
-        uavPhotonDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-
-        device->CreateUnorderedAccessView(photonCountBuffer.Get(), nullptr, &uavPhotonDesc, uavDescriptorHandle);
-        photonCountUavGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), photonCountUavDescriptorHeapIndex, m_descriptorSize);
-    }
-}
-
 void Application::CreateRaytracingOutputResource()
 {
     auto device = m_deviceResources->GetD3DDevice();
@@ -1456,11 +1459,11 @@ void Application::CreateRaytracingOutputResource()
 
 
     D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-    m_raytracingOutputResourceUAVDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, m_raytracingOutputResourceUAVDescriptorHeapIndex);
+    m_raytracingOutputResourceUAVDescriptor = AllocateDescriptor(&uavDescriptorHandle, m_raytracingOutputResourceUAVDescriptor);
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
     UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
     device->CreateUnorderedAccessView(m_raytracingOutput.Get(), nullptr, &UAVDesc, uavDescriptorHandle);
-    m_raytracingOutputResourceUAVGpuDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), m_raytracingOutputResourceUAVDescriptorHeapIndex, m_descriptorSize);
+    m_raytracingOutputResourceUAVGpuDescriptor = m_descriptors.GpuHandle(m_raytracingOutputResourceUAVDescriptor);
 }
 
 void Application::CreateRasterOutputResource()
@@ -1478,106 +1481,162 @@ void Application::CreateRasterOutputResource()
 
 
     D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-    //for some reason passing the descriptorheapindex uninitialised messes things up?
-    m_rasterOutputResourceUAVDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, 10);
+    m_rasterOutputResourceUAVDescriptor = AllocateDescriptor(&uavDescriptorHandle, m_rasterOutputResourceUAVDescriptor);
     D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
     UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
     device->CreateUnorderedAccessView(m_rasterOutput.Get(), nullptr, &UAVDesc, uavDescriptorHandle);
-    m_rasterOutputResourceUAVGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), m_rasterOutputResourceUAVDescriptorHeapIndex, m_descriptorSize);
+    m_rasterOutputResourceUAVGPUDescriptor = m_descriptors.GpuHandle(m_rasterOutputResourceUAVDescriptor);
+
+    // The running average of the splats needs more precision than the back buffer format.
+    auto accumulationDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R16G16B16A16_FLOAT, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &accumulationDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_photonAccumulation)));
+    NAME_D3D12_OBJECT(m_photonAccumulation);
+    m_photonAccumulationUAVDescriptor = AllocateDescriptor(&uavDescriptorHandle, m_photonAccumulationUAVDescriptor);
+    device->CreateUnorderedAccessView(m_photonAccumulation.Get(), nullptr, &UAVDesc, uavDescriptorHandle);
+    m_photonAccumulationUAVGpuDescriptor = m_descriptors.GpuHandle(m_photonAccumulationUAVDescriptor);
 }
 
 
-void Application::CreateCountBuffer() {
+// Both photon sets at the current capacity, plus the buffers their counters are cleared from
+// and read back to. Growing recreates the sets but keeps their descriptor slots.
+void Application::CreatePhotonBuffers() {
     auto device = m_deviceResources->GetD3DDevice();
+    auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    UINT capacity = m_photonCapacity.Capacity();
+
+    for (UINT i = 0; i < ARRAYSIZE(m_photonSets); i++) {
+        PhotonBufferSet& set = m_photonSets[i];
+        auto photonsDesc = CD3DX12_RESOURCE_DESC::Buffer(UINT64(capacity) * sizeof(Photon), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &photonsDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&set.photons)));
+        set.photons->SetName(i == 0 ? L"Photons[0]" : L"Photons[1]");
+        auto counterDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &counterDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&set.counter)));
+        set.counter->SetName(i == 0 ? L"PhotonCounter[0]" : L"PhotonCounter[1]");
+
+        D3D12_CPU_DESCRIPTOR_HANDLE photonsDescriptor;
+        set.descriptors = AllocateDescriptor(&photonsDescriptor, set.descriptors, 2);
+
+        D3D12_UNORDERED_ACCESS_VIEW_DESC photonsView = {};
+        photonsView.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+        photonsView.Format = DXGI_FORMAT_UNKNOWN;
+        photonsView.Buffer.NumElements = capacity;
+        photonsView.Buffer.StructureByteStride = sizeof(Photon);
+        photonsView.Buffer.CounterOffsetInBytes = 0;
+        device->CreateUnorderedAccessView(set.photons.Get(), set.counter.Get(), &photonsView, photonsDescriptor);
+
+        D3D12_UNORDERED_ACCESS_VIEW_DESC counterView = {};
+        counterView.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+        counterView.Format = DXGI_FORMAT_R32_TYPELESS;
+        counterView.Buffer.NumElements = 1;
+        counterView.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+        device->CreateUnorderedAccessView(set.counter.Get(), nullptr, &counterView, m_descriptors.CpuHandle(set.descriptors, 1));
+
+        set.photonsGpuDescriptor = m_descriptors.GpuHandle(set.descriptors);
+        set.counterGpuDescriptor = m_descriptors.GpuHandle(set.descriptors, 1);
+    }
+
+    if (!m_photonCounterZero) {
+        UINT zero = 0;
+        AllocateUploadBuffer(device, &zero, sizeof(zero), &m_photonCounterZero, L"PhotonCounterZero");
+
+        auto readbackHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+        auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(FrameCount * sizeof(UINT));
+        ThrowIfFailed(device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_photonCounterReadback)));
+        NAME_D3D12_OBJECT(m_photonCounterReadback);
+        void* mapped;
+        ThrowIfFailed(m_photonCounterReadback->Map(0, nullptr, &mapped));
+        m_photonCounterReadbackData = static_cast<const UINT*>(mapped);
+    }
+    for (auto& pending : m_photonCounterPending) {
+        pending = false;
+    }
+}
+
+void Application::ReleasePhotonBuffers() {
+    for (auto& set : m_photonSets) {
+        set.photons.Reset();
+        set.counter.Reset();
+        set.descriptors = DescriptorHandle();
+    }
+    if (m_photonCounterReadback) {
+        m_photonCounterReadback->Unmap(0, nullptr);
+    }
+    m_photonCounterReadback.Reset();
+    m_photonCounterReadbackData = nullptr;
+    m_photonCounterZero.Reset();
+}
+
+// Takes the counter the last frame in this slot ended with; that frame has finished by the time
+// its slot comes round again. Growing waits for the GPU, as the frames in flight still use the
+// old sets.
+void Application::UpdatePhotonCapacity() {
+    UINT frameIndex = m_deviceResources->GetCurrentFrameIndex();
+    if (m_photonCounterPending[frameIndex]) {
+        m_photonCounterPending[frameIndex] = false;
+        if (m_photonCapacity.Record(m_photonCounterReadbackData[frameIndex])) {
+            m_deviceResources->WaitForGpu();
+            CreatePhotonBuffers();
+        }
+    }
+    m_photonSet ^= 1;
+}
 
-    UINT size = 4;
-    D3D12_RESOURCE_DESC desc = {};
-    desc.Alignment = 0;
-    desc.DepthOrArraySize = 1;
-    desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-    desc.Format = DXGI_FORMAT_UNKNOWN;
-    desc.Height = 1;
-    desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-    desc.MipLevels = 1;
-    desc.SampleDesc.Count = 1;
-    desc.SampleDesc.Quality = 0;
-    desc.Width = (UINT64)size;
-
-    auto heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-
-    ThrowIfFailed(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&photonCountBuffer)));
-
-    photonCountBuffer->SetName(L"CountingPhotonsBuffer");
-
-    photonCounterDescriptorHeapIndex = AllocateDescriptor(&photonCountCPUDescriptor, photonCounterDescriptorHeapIndex);
-
-    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-    uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-    uavDesc.Buffer.NumElements = 1;
-    uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
-
-    device->CreateUnorderedAccessView(photonCountBuffer.Get(), nullptr, &uavDesc, photonCountCPUDescriptor);
-    photonCounterGpuDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), photonCountUavDescriptorHeapIndex, m_descriptorSize);
+// The scene has the one light, so it gets the whole budget; the split is there for when it has
+// more. The radius schedule restarts whenever the scene's accumulation does.
+void Application::UpdatePhotonBudget() {
+    SceneConstantBuffer& sceneCB = scene->getSceneBuffer()->staging;
+    XMFLOAT4 colour;
+    XMStoreFloat4(&colour, sceneCB.lightDiffuseColor);
+    float power = PhotonLightWeight(sceneCB.lightPower, colour.x, colour.y, colour.z);
+    m_photonBudget.Allocate(&power, 1);
+    sceneCB.photonPowerScale = m_photonBudget.Emitted() > 0 ? static_cast<float>(PHOTON_COUNT) / m_photonBudget.Emitted() : 0.0f;
 
+    if (sceneCB.accumulatedFrames == 0) {
+        m_photonRadius.Reset();
+    }
+    else {
+        m_photonRadius.Advance();
+    }
+    m_rasterConstantBuffer->photonRadiusScale = m_photonRadius.Scale();
 }
 
-void Application::CreatePhotonStructuredBuffer() {
-    
-    auto device = m_deviceResources->GetD3DDevice();
-    auto backBufferFormat = m_deviceResources->GetBackBufferFormat();
-    {
-        UINT64 size = sizeof(Photon);
-        UINT64 bufferSize = PHOTON_COUNT * size;
-        auto uavDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-        auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-
-        ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&photonStructBuffer)));
-        NAME_D3D12_OBJECT(photonStructBuffer);
-
-        photonStructGpuHeapIndex = AllocateDescriptor(&photonStructCPUDescriptor, photonStructGpuHeapIndex);
-        D3D12_UNORDERED_ACCESS_VIEW_DESC uavPhotonDesc = {};
-        uavPhotonDesc.Buffer.NumElements = PHOTON_COUNT;
-        uavPhotonDesc.Buffer.FirstElement = 0;
-        uavPhotonDesc.Buffer.StructureByteStride = size;
-        uavPhotonDesc.Buffer.CounterOffsetInBytes = 0;
-        uavPhotonDesc.Format = DXGI_FORMAT_UNKNOWN;
-        uavPhotonDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-        device->CreateUnorderedAccessView(photonStructBuffer.Get(),photonCountBuffer.Get(), &uavPhotonDesc, photonStructCPUDescriptor);
-        photonStructGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), photonStructGpuHeapIndex, m_descriptorSize);
+void Application::ClearPhotonCounter() {
+    auto commandList = m_deviceResources->GetCommandList();
+    commandList->CopyBufferRegion(m_photonSets[m_photonSet].counter.Get(), 0, m_photonCounterZero.Get(), 0, sizeof(UINT));
+}
 
-       
-    }
+void Application::ReadBackPhotonCounter() {
+    auto commandList = m_deviceResources->GetCommandList();
+    UINT frameIndex = m_deviceResources->GetCurrentFrameIndex();
+    commandList->CopyBufferRegion(m_photonCounterReadback.Get(), frameIndex * sizeof(UINT), m_photonSets[m_photonSet].counter.Get(), 0, sizeof(UINT));
+    m_photonCounterPending[frameIndex] = true;
 }
 
 
+// One texel of PackedGBuffer.h a pixel: 16 bytes where the BRDF, position and normal textures
+// it replaced took 48.
 void Application::CreateDeferredGBuffer() {
     auto device = m_deviceResources->GetD3DDevice();
-    auto backbufferFormat = m_deviceResources->GetBackBufferFormat();
-    // DXGI_FORMAT_R32G32B32A32_FLOAT
-    auto uavDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_FLOAT, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    auto uavDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32G32B32A32_UINT, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    IBuffer geometryBuffer = {};
+    if (!geometryBuffers.empty()) {
+        geometryBuffer.uavDescriptor = geometryBuffers[0].uavDescriptor;
+    }
     geometryBuffers.clear();
-    auto firstUav = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UINT, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
-    for (int i = 0; i < 3; i++) {
-        IBuffer geometryBuffer = {};
-   
-        ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&geometryBuffer.textureResource)));
-        NAME_D3D12_OBJECT(geometryBuffer.textureResource);
-        geometryBuffer.uavDescriptorHeapIndex = UINT_MAX;
-        
+    ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&geometryBuffer.textureResource)));
+    NAME_D3D12_OBJECT(geometryBuffer.textureResource);
 
-        D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        geometryBuffer.uavDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, geometryBuffer.uavDescriptorHeapIndex);
-        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-        device->CreateUnorderedAccessView(geometryBuffer.textureResource.Get(), nullptr, &uavDesc, uavDescriptorHandle);
-        geometryBuffer.uavGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), geometryBuffer.uavDescriptorHeapIndex, m_descriptorSize);
+    D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
+    geometryBuffer.uavDescriptor = AllocateDescriptor(&uavDescriptorHandle, geometryBuffer.uavDescriptor);
+    D3D12_UNORDERED_ACCESS_VIEW_DESC viewDesc = {};
+    viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+    device->CreateUnorderedAccessView(geometryBuffer.textureResource.Get(), nullptr, &viewDesc, uavDescriptorHandle);
+    geometryBuffer.uavGPUDescriptor = m_descriptors.GpuHandle(geometryBuffer.uavDescriptor);
 
-        geometryBuffers.push_back(geometryBuffer);
-    }
+    geometryBuffers.push_back(geometryBuffer);
 }
 
 void Application::CreateDiscreteStagingTargetBuffers() {
@@ -1593,13 +1652,12 @@ void Application::CreateDiscreteStagingTargetBuffers() {
         NAME_D3D12_OBJECT(stagingTarget.textureResource);
 
         D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        stagingTarget.uavDescriptorHeapIndex = UINT_MAX;
-        stagingTarget.uavDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, stagingTarget.uavDescriptorHeapIndex);
+        stagingTarget.uavDescriptor = AllocateDescriptor(&uavDescriptorHandle);
 
         D3D12_UNORDERED_ACCESS_VIEW_DESC stagingView = {};
         stagingView.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
         device->CreateUnorderedAccessView(stagingTarget.textureResource.Get(), nullptr, &stagingView, uavDescriptorHandle);
-        stagingTarget.uavGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), stagingTarget.uavDescriptorHeapIndex, m_descriptorSize);
+        stagingTarget.uavGPUDescriptor = m_descriptors.GpuHandle(stagingTarget.uavDescriptor);
 
         stages.push_back(stagingTarget);
     }
@@ -1614,15 +1672,14 @@ void Application::CreateStagingResource() {
 
     ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&stagingResource)));
     NAME_D3D12_OBJECT(stagingResource);
-    stagingCounterDescriptorHeapIndex = UINT_MAX;
 
     D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-    stagingCounterDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, stagingCounterDescriptorHeapIndex);
+    stagingDescriptor = AllocateDescriptor(&uavDescriptorHandle, stagingDescriptor);
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC uva = {};
     uva.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
     device->CreateUnorderedAccessView(stagingResource.Get(), nullptr, &uva, uavDescriptorHandle);
-    stagingGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), stagingCounterDescriptorHeapIndex, m_descriptorSize);
+    stagingGPUDescriptor = m_descriptors.GpuHandle(stagingDescriptor);
 }
 void Application::CreateLightBuffers() {
 
@@ -1662,6 +1719,10 @@ void Application::CreateLightBuffers() {
     LightNormals.clear();
     LightColours.clear();
     LightDirections.clear();
+
+    // The shaders bind all of them as one table, so they take one block of views.
+    D3D12_CPU_DESCRIPTOR_HANDLE firstLightDescriptor;
+    m_lightBufferDescriptors = AllocateDescriptor(&firstLightDescriptor, m_lightBufferDescriptors, 4 * MAX_RAY_RECURSION_DEPTH);
     //auto firstUav = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UINT, m_width, m_height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
     for (int i = 0; i < 4*MAX_RAY_RECURSION_DEPTH; i++) {
@@ -1671,16 +1732,12 @@ void Application::CreateLightBuffers() {
         std::wstring name;
      
         NAME_D3D12_OBJECT(lightBuffer.textureResource);
-        lightBuffer.uavDescriptorHeapIndex = UINT_MAX;
-
 
-        D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        lightBuffer.uavDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, lightBuffer.uavDescriptorHeapIndex);
         D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
         uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
       //  uavDesc.Texture2DArray.ArraySize = MAX_RAY_RECURSION_DEPTH;
-        device->CreateUnorderedAccessView(lightBuffer.textureResource.Get(), nullptr, &uavDesc, uavDescriptorHandle);
-        lightBuffer.uavGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), lightBuffer.uavDescriptorHeapIndex, m_descriptorSize);
+        device->CreateUnorderedAccessView(lightBuffer.textureResource.Get(), nullptr, &uavDesc, m_descriptors.CpuHandle(m_lightBufferDescriptors, i));
+        lightBuffer.uavGPUDescriptor = m_descriptors.GpuHandle(m_lightBufferDescriptors, i);
 
         LightBuffers.push_back(lightBuffer);
     }
@@ -1778,68 +1835,56 @@ void Application::CreateAccumulationBuffers() {
 
         ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&lightAccumulationResource)));
         NAME_D3D12_OBJECT(lightAccumulationResource);
-        lightAccumulationDescriptorHeapIndex = UINT_MAX;
 
         D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        lightAccumulationDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, lightAccumulationDescriptorHeapIndex);
+        lightAccumulationDescriptor = AllocateDescriptor(&uavDescriptorHandle, lightAccumulationDescriptor);
 
         D3D12_UNORDERED_ACCESS_VIEW_DESC uva = {};
         uva.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
         device->CreateUnorderedAccessView(lightAccumulationResource.Get(), nullptr, &uva, uavDescriptorHandle);
-        lightAccumulationGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), lightAccumulationDescriptorHeapIndex, m_descriptorSize);
+        lightAccumulationGPUDescriptor = m_descriptors.GpuHandle(lightAccumulationDescriptor);
     }
 
     //forward accumulation
     {
         ThrowIfFailed(device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &uavDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&forwardAccumulationResource)));
         NAME_D3D12_OBJECT(forwardAccumulationResource);
-        forwardAccumulationDescriptorHeapIndex = UINT_MAX;
 
         D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptorHandle;
-        forwardAccumulationDescriptorHeapIndex = AllocateDescriptor(&uavDescriptorHandle, forwardAccumulationDescriptorHeapIndex);
+        forwardAccumulationDescriptor = AllocateDescriptor(&uavDescriptorHandle, forwardAccumulationDescriptor);
 
         D3D12_UNORDERED_ACCESS_VIEW_DESC uva = {};
         uva.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
         device->CreateUnorderedAccessView(forwardAccumulationResource.Get(), nullptr, &uva, uavDescriptorHandle);
-        forwardAccumulationGPUDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), forwardAccumulationDescriptorHeapIndex, m_descriptorSize); }
+        forwardAccumulationGPUDescriptor = m_descriptors.GpuHandle(forwardAccumulationDescriptor); }
 }
 
-void Application::CreateDescriptorHeap()
+// The views the resources of the current mode declare; see CreateWindowSizeDependentResources.
+UINT Application::ResourceDescriptorCount() const
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
-    // Allocate a heap for (3* RAY_DEPTH) descriptors:
-    // 2 - vertex and index  buffer SRVs
-    // 1 - raytracing output texture SRV
-    // n - Interesection Buffers
-    // 1 flat gbuffer
-   // descriptorHeapDesc.NumDescriptors = 15 + MAX_RAY_RECURSION_DEPTH;
-    //2 index/vertex buffers, 1 photon structured buffer, 1 photon count buffer, 1 output buffer
-    //1 tiledPhotonMap
-    //2 v, i buffers, 1 output, 1
-    //+ 1 raster constant buffer view
-    // 1 pixel shader UAV for indirect illumination
-    //add 20 
-    UINT additionalCount = 0;
-    if(photonMapping){
-        additionalCount = 3 * MAX_RAY_RECURSION_DEPTH + 1 + 1 + 3 + 1 + 20;
+    UINT count = c_geometryViews + c_outputViews;
+    if (photonMapping) {
+        count += c_photonMappingViews;
         if (mappingAndPathing) {
-            additionalCount += 4 * MAX_RAY_RECURSION_DEPTH + 15 + 8;
+            count += c_pathTracingViews;
         }
     }
     else {
-        //3 accumulation buffers
-        additionalCount = 4*MAX_RAY_RECURSION_DEPTH + 15 + 4 + 4;
+        count += c_pathTracingViews;
     }
-    descriptorHeapDesc.NumDescriptors = 6 + additionalCount;
-    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    descriptorHeapDesc.NodeMask = 0;
-    device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&m_descriptorHeap));
-    NAME_D3D12_OBJECT(m_descriptorHeap);
+    return count;
+}
 
-    m_descriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+void Application::CreateDescriptorHeap()
+{
+    auto device = m_deviceResources->GetD3DDevice();
+
+    DescriptorAllocator layout;
+    m_resourceDescriptorRange = layout.AddRange(ResourceDescriptorCount());
+
+    m_descriptors.Create(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, layout, L"m_descriptorHeap");
+    m_descriptorHeap = m_descriptors.GetHeap();
+    m_descriptorSize = m_descriptors.DescriptorSize();
 }
 
  
@@ -1925,7 +1970,6 @@ void Application::CreateRasterisationBuffers() {
         nullptr,
         IID_PPV_ARGS(&rasterConstant)));
 
-    CreateRasterConstantBuffer();
    // auto device = m_deviceResources->GetD3DDevice();
   /*  D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
     //CD3DX12_RANGE readRange(0, 0);
@@ -1942,15 +1986,6 @@ void Application::CreateRasterisationBuffers() {
 
 }
 
-void Application::CreateRasterConstantBuffer() {
-    auto device = m_deviceResources->GetD3DDevice();
-    auto frameCount = m_deviceResources->GetBackBufferCount();
-
-    m_rasterConstantBuffer.Create(device, frameCount, L"RasterconstantBuffer");
-  //  OnUpdate();
-    //  m_rasterConstantBuffer->mvp = scene->GetMVP();
-}
-
 // Build geometry used in the sample.
 void Application::BuildGeometry()
 {
@@ -1958,9 +1993,9 @@ void Application::BuildGeometry()
     scene->BuildProceduralGeometryAABBs(m_deviceResources);
     scene->BuildMeshes(m_deviceResources);
 
-    UINT descriptorIndexIB = CreateBufferSRV(&scene->m_indexBuffer, scene->totalIndices.size(), 0);
-    UINT descriptorIndexVB = CreateBufferSRV(&scene->m_vertexBuffer, scene->totalVertices.size(), sizeof(scene->totalVertices[0]));
-    ThrowIfFalse(descriptorIndexVB == descriptorIndexIB + 1, L"Vertex Buffer descriptor index must follow that of Vertex_Index Buffer descriptor index");
+    DescriptorHandle indexBufferDescriptor = CreateBufferSRV(&scene->m_indexBuffer, scene->totalIndices.size(), 0);
+    DescriptorHandle vertexBufferDescriptor = CreateBufferSRV(&scene->m_vertexBuffer, scene->totalVertices.size(), sizeof(scene->totalVertices[0]));
+    ThrowIfFalse(vertexBufferDescriptor.index == indexBufferDescriptor.index + 1, L"Vertex Buffer descriptor index must follow that of Vertex_Index Buffer descriptor index");
 
 }
 
@@ -1968,679 +2003,152 @@ void Application::BuildGeometry()
 void Application::BuildCompositeTable() {
     auto device = m_deviceResources->GetD3DDevice();
 
-    void* rayGenShaderID;
-    void* missShaderID;
-    void* hitGroupOne;
-
-    unordered_map<void*, wstring> shaderIdToStringMap;
+    // A single miss shader and hit group, neither with root arguments.
+    ShaderTableLayoutDesc desc;
+    desc.rayGen = c_compositeRayGen;
+    desc.missShaders.push_back(c_compositeMiss);
 
+    HitGroupGeometryDesc composite;
+    composite.hitGroups.push_back(c_compositeHitGroup);
+    composite.primitiveRootArguments.push_back(std::vector<uint8_t>());
+    desc.geometries.push_back(composite);
 
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_compositeRayGen);
-        shaderIdToStringMap[rayGenShaderID] = c_compositeRayGen;
-
-        missShaderID = stateObjectProperties->GetShaderIdentifier(c_compositeMiss);
-        shaderIdToStringMap[missShaderID] = c_compositeMiss;
-
-        hitGroupOne = stateObjectProperties->GetShaderIdentifier(c_compositeHitGroup);
-        shaderIdToStringMap[hitGroupOne] = c_compositeHitGroup;
-       
-    };
-
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_rayCompositeStateObject.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    }
-
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
+    CreateShaderTables(device, m_rayCompositeStateObject.Get(), desc, L"Composite",
+        m_compositeRayGenShaderTable, m_missCompositeTable, m_missCompositeTableStrideInBytes,
+        m_compositeHitGroupShaderTable, m_compositeHitGroupStrideInBytes);
+}
 
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"CompositRayGenTable");
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_compositeRayGenShaderTable = rayGenShaderTable.GetResource();
-    }
+// Shader records shared by every scene pipeline: a hit group per ray type for the triangle
+// geometry, then for each AABB primitive, in the order of IntersectionShaderType.
+ShaderTableLayoutDesc Application::SceneShaderTableDesc(const wchar_t* rayGenShader, const wchar_t* const missShaders[RayType::Count])
+{
+    ShaderTableLayoutDesc desc;
+    desc.rayGen = rayGenShader;
+    desc.missShaders.assign(missShaders, missShaders + RayType::Count);
 
+    // Triangle geometry hit groups.
     {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
+        HitGroupGeometryDesc triangles;
+        triangles.hitGroups.assign(c_hitGroupNames_TriangleGeometry, c_hitGroupNames_TriangleGeometry + RayType::Count);
 
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissCompositTable");
-    
-        
-            missShaderTable.push_back(ShaderRecord(missShaderID, shaderIDSize, nullptr, 0));
-        
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-         m_missCompositeTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-         m_missCompositeTable = missShaderTable.GetResource();
+        LocalRootSignature::Triangle::RootArguments rootArgs;
+        rootArgs.materialTable = scene->getMaterialTable();
+        rootArgs.materialCb.materialIndex = scene->materials.Id(scene->m_planeMaterial);
+        triangles.AddPrimitive(rootArgs);
+        desc.geometries.push_back(triangles);
     }
 
-
+    // AABB geometry hit groups, one geometry per primitive type. Its record points the
+    // intersection shader at the type's first procedural instance.
+    for (UINT iShader = 0, slot = 0; iShader < IntersectionShaderType::Count; iShader++)
     {
+        HitGroupGeometryDesc aabbs;
+        aabbs.hitGroups.assign(c_hitGroupNames_AABBGeometry[iShader], c_hitGroupNames_AABBGeometry[iShader] + RayType::Count);
 
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize;
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"CompositHitGroupTable");
-
-
-        hitGroupShaderTable.push_back(ShaderRecord(hitGroupOne, shaderIDSize, nullptr, 0));
-
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_compositeHitGroupStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_compositeHitGroupShaderTable = hitGroupShaderTable.GetResource();
-      
-     
+        UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
+        for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, slot++)
+        {
+            LocalRootSignature::AABB::RootArguments rootArgs;
+            rootArgs.materialTable = scene->getMaterialTable();
+            rootArgs.materialCb.materialIndex = scene->materials.Id(scene->m_aabbMaterial[slot]);
+            rootArgs.aabbCB.instanceIndex = scene->instances.SlotFirst(slot);
+            rootArgs.aabbCB.primitiveType = primitiveIndex;
+            aabbs.AddPrimitive(rootArgs);
+        }
+        desc.geometries.push_back(aabbs);
     }
+    return desc;
 }
 
 void Application::BuildPhotonShaderTable() {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    void* rayGenShaderID;
-    void* missShaderIDs[RayType::Count];
-    void* hitGroupShaderIDs_Triangle[RayType::Count];
-    void* hitGroupShaderIDs_AABBGeometry[IntersectionShaderType::Count][RayType::Count];
+    CreateShaderTables(m_deviceResources->GetD3DDevice(), m_photonMapStateObject.Get(), SceneShaderTableDesc(c_photon_rayGen, c_photonMiss), L"Photon",
+        m_photonRayGenTable, m_missPhotonTable, m_missPhotonTableStrideInBytes,
+        m_hitgroupPhotonTable, m_hitgroupPhotonTableStrideInBytes);
+}
 
-    unordered_map<void*, wstring> shaderIdToStringMap;
+// Shader tables of every pipeline the current settings create.
+void Application::BuildAllShaderTables()
+{
+    BuildForwardPathShaderTables();
 
+    if (photonMapping) {
+        BuildShaderTables();
 
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_photon_rayGen);
-        shaderIdToStringMap[rayGenShaderID] = c_photon_rayGen;
+        BuildCompositeTable();
+        BuildPhotonShaderTable();
+        if (mappingAndPathing) {
+            BuildLightPathShaderTable();
+            BuildSecondPassLightShaderTables();
 
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderIDs[i] = stateObjectProperties->GetShaderIdentifier(c_photonMiss[i]);
-            shaderIdToStringMap[missShaderIDs[i]] = c_photonMiss[i];
-        }
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            hitGroupShaderIDs_Triangle[i] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_TriangleGeometry[i]);
-            shaderIdToStringMap[hitGroupShaderIDs_Triangle[i]] = c_hitGroupNames_TriangleGeometry[i];
         }
-        for (UINT r = 0; r < IntersectionShaderType::Count; r++)
-            for (UINT c = 0; c < RayType::Count; c++)
-            {
-                hitGroupShaderIDs_AABBGeometry[r][c] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_AABBGeometry[r][c]);
-                shaderIdToStringMap[hitGroupShaderIDs_AABBGeometry[r][c]] = c_hitGroupNames_AABBGeometry[r][c];
-            }
-    };
-
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_photonMapStateObject.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
     }
-
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"PhotonRayGenTable");
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_photonRayGenTable = rayGenShaderTable.GetResource();
+    else {
+        BuildLightPathShaderTable();
+        BuildSecondPassLightShaderTables();
     }
+}
 
-    // Miss shader table.
+// Applies material edits made to the scene file. New values are picked up by the shaders as
+// they are; new ids are baked into the shader records and, for instance overrides, into the
+// TLAS instance descs, so both are rebuilt. The scene has already waited for the GPU.
+void Application::ReloadMaterials()
+{
+    MaterialTableChange::Enum change = scene->ReloadMaterials(m_deviceResources);
+    if (change == MaterialTableChange::Ids)
     {
-        UINT numShaderRecords = RayType::Count;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissPhotonTable");
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderTable.push_back(ShaderRecord(missShaderIDs[i], shaderIDSize, nullptr, 0));
-        }
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-        m_missPhotonTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-        m_missPhotonTable = missShaderTable.GetResource();
+        RebuildAccelerationStructure();
+        BuildAllShaderTables();
     }
+}
 
-    // Hit group shader table.
+// Picks the point cloud's instances again from where the camera is now. The instance descs
+// are baked into the TLAS, so only a changed selection costs a rebuild, and only of the top
+// level; OnRender records it at the start of the next frame.
+void Application::UpdatePointCloudLod()
+{
+    if (scene->SelectPointCloudInstances(m_height))
     {
-        UINT numShaderRecords = RayType::Count + IntersectionShaderType::TotalPrimitiveCount * RayType::Count;
-        UINT shaderRecordSize = shaderIDSize + LocalRootSignature::MaxRootArgumentsSize();
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"PhotonHitGroupTable");
-
-        // Triangle geometry hit groups.
-        {
-            LocalRootSignature::Triangle::RootArguments rootArgs;
-            rootArgs.materialCb = scene->m_planeMaterialCB;
-
-            for (auto& hitGroupShaderID : hitGroupShaderIDs_Triangle)
-            {
-                hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-            }
-        }
-
-        // AABB geometry hit groups.
-        {
-            LocalRootSignature::AABB::RootArguments rootArgs;
-            UINT instanceIndex = 0;
-
-            // Create a shader record for each primitive.
-            for (UINT iShader = 0, instanceIndex = 0; iShader < IntersectionShaderType::Count; iShader++)
-            {
-                UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
-
-                // Primitives for each intersection shader.
-                for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, instanceIndex++)
-                {
-                    //    rootArgs.materialCb = m_aabbMaterialCB[instanceIndex];
-                    rootArgs.materialCb = scene->m_aabbMaterialCB[instanceIndex];
-                    rootArgs.aabbCB.instanceIndex = instanceIndex;
-                    rootArgs.aabbCB.primitiveType = primitiveIndex;
-
-                    // Ray types.
-                    for (UINT r = 0; r < RayType::Count; r++)
-                    {
-                        auto& hitGroupShaderID = hitGroupShaderIDs_AABBGeometry[iShader][r];
-                        hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-                    }
-                }
-            }
-        }
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_hitgroupPhotonTableStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_hitgroupPhotonTable = hitGroupShaderTable.GetResource();
+        m_topLevelASPending = true;
     }
+}
 
+void Application::RebuildAccelerationStructure()
+{
+    acclerationStruct->Reset();
+    delete acclerationStruct;
+    acclerationStruct = new AccelerationStructure(m_deviceResources, scene, m_dxrDevice, m_dxrCommandList);
 }
+
 // Build shader tables.
 // This encapsulates all shader records - shaders and the arguments for their local root signatures.
 void Application::BuildShaderTables()
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    void* rayGenShaderID;
-    void* missShaderIDs[RayType::Count];
-    void* hitGroupShaderIDs_TriangleGeometry[RayType::Count];
-    void* hitGroupShaderIDs_AABBGeometry[IntersectionShaderType::Count][RayType::Count];
-
-    // A shader name look-up table for shader table debug print out.
-    unordered_map<void*, wstring> shaderIdToStringMap;
-
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_raygenShaderName);
-        shaderIdToStringMap[rayGenShaderID] = c_raygenShaderName;
-
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderIDs[i] = stateObjectProperties->GetShaderIdentifier(c_missShaderNames[i]);
-            shaderIdToStringMap[missShaderIDs[i]] = c_missShaderNames[i];
-        }
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            hitGroupShaderIDs_TriangleGeometry[i] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_TriangleGeometry[i]);
-            shaderIdToStringMap[hitGroupShaderIDs_TriangleGeometry[i]] = c_hitGroupNames_TriangleGeometry[i];
-        }
-        for (UINT r = 0; r < IntersectionShaderType::Count; r++)
-            for (UINT c = 0; c < RayType::Count; c++)        
-            {
-                hitGroupShaderIDs_AABBGeometry[r][c] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_AABBGeometry[r][c]); 
-                shaderIdToStringMap[hitGroupShaderIDs_AABBGeometry[r][c]] = c_hitGroupNames_AABBGeometry[r][c];
-            }
-    };
-
-    // Get shader identifiers.
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_dxrStateObject.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    }
-
-     // RayGen shader table.
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-        
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"RayGenShaderTable" );
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_rayGenShaderTable = rayGenShaderTable.GetResource();
-    }
-    
-    // Miss shader table.
-    {
-        UINT numShaderRecords = RayType::Count;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissShaderTable");
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderTable.push_back(ShaderRecord(missShaderIDs[i], shaderIDSize, nullptr, 0));
-        }
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-        m_missShaderTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-        m_missShaderTable = missShaderTable.GetResource();
-    }
-
-    // Hit group shader table.
-    {
-        UINT numShaderRecords = RayType::Count + IntersectionShaderType::TotalPrimitiveCount * RayType::Count;
-        UINT shaderRecordSize = shaderIDSize + LocalRootSignature::MaxRootArgumentsSize();
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"HitGroupShaderTable");
-
-        // Triangle geometry hit groups.
-        {
-            LocalRootSignature::Triangle::RootArguments rootArgs;
-            rootArgs.materialCb = scene->m_planeMaterialCB;
-
-            for (auto& hitGroupShaderID : hitGroupShaderIDs_TriangleGeometry)
-            {
-                hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-            }
-        }
-      
-        // AABB geometry hit groups.
-        {
-            LocalRootSignature::AABB::RootArguments rootArgs;
-            UINT instanceIndex = 0;
-
-            // Create a shader record for each primitive.
-            for (UINT iShader = 0, instanceIndex = 0; iShader < IntersectionShaderType::Count; iShader++)
-            {
-                UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
-                
-                // Primitives for each intersection shader.
-                for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, instanceIndex++)
-                {
-                //    rootArgs.materialCb = m_aabbMaterialCB[instanceIndex];
-                    rootArgs.materialCb =  scene->m_aabbMaterialCB[instanceIndex];
-                    rootArgs.aabbCB.instanceIndex = instanceIndex;
-                    rootArgs.aabbCB.primitiveType = primitiveIndex;
-                    
-                    // Ray types.
-                    for (UINT r = 0; r < RayType::Count; r++)
-                    {
-                        auto& hitGroupShaderID = hitGroupShaderIDs_AABBGeometry[iShader][r];
-                        hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-                    }
-                }
-            }
-        }
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_hitGroupShaderTableStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_hitGroupShaderTable = hitGroupShaderTable.GetResource();
-    }
+    CreateShaderTables(m_deviceResources->GetD3DDevice(), m_dxrStateObject.Get(), SceneShaderTableDesc(c_raygenShaderName, c_missShaderNames), L"",
+        m_rayGenShaderTable, m_missShaderTable, m_missShaderTableStrideInBytes,
+        m_hitGroupShaderTable, m_hitGroupShaderTableStrideInBytes);
 }
 
-
-
-
 void Application::BuildForwardPathShaderTables()
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    void* rayGenShaderID;
-    void* missShaderIDs[RayType::Count];
-    void* hitGroupShaderIDs_TriangleGeometry[RayType::Count];
-    void* hitGroupShaderIDs_AABBGeometry[IntersectionShaderType::Count][RayType::Count];
-
-    // A shader name look-up table for shader table debug print out.
-    unordered_map<void*, wstring> shaderIdToStringMap;
-
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_forwardPathTracingRayGen);
-        shaderIdToStringMap[rayGenShaderID] = c_forwardPathTracingRayGen;
-
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderIDs[i] = stateObjectProperties->GetShaderIdentifier(c_missPathShaders[i]);
-            shaderIdToStringMap[missShaderIDs[i]] = c_missPathShaders[i];
-        }
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            hitGroupShaderIDs_TriangleGeometry[i] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_TriangleGeometry[i]);
-            shaderIdToStringMap[hitGroupShaderIDs_TriangleGeometry[i]] = c_hitGroupNames_TriangleGeometry[i];
-        }
-        for (UINT r = 0; r < IntersectionShaderType::Count; r++)
-            for (UINT c = 0; c < RayType::Count; c++)
-            {
-                hitGroupShaderIDs_AABBGeometry[r][c] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_AABBGeometry[r][c]);
-                shaderIdToStringMap[hitGroupShaderIDs_AABBGeometry[r][c]] = c_hitGroupNames_AABBGeometry[r][c];
-            }
-    };
-
-    // Get shader identifiers.
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_forwardPathState.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    }
-
-    // RayGen shader table.
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"RayGenShaderTable");
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_forwardPathRayGenShaderTable = rayGenShaderTable.GetResource();
-    }
-
-    // Miss shader table.
-    {
-        UINT numShaderRecords = RayType::Count;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissShaderTable");
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderTable.push_back(ShaderRecord(missShaderIDs[i], shaderIDSize, nullptr, 0));
-        }
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-        m_forwardPathRayMissShaderTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-        m_forwardPathMissShaderTable = missShaderTable.GetResource();
-    }
-
-    // Hit group shader table.
-    {
-        UINT numShaderRecords = RayType::Count + IntersectionShaderType::TotalPrimitiveCount * RayType::Count;
-        UINT shaderRecordSize = shaderIDSize + LocalRootSignature::MaxRootArgumentsSize();
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"HitGroupShaderTable");
-
-        // Triangle geometry hit groups.
-        {
-            LocalRootSignature::Triangle::RootArguments rootArgs;
-            rootArgs.materialCb = scene->m_planeMaterialCB;
-
-            for (auto& hitGroupShaderID : hitGroupShaderIDs_TriangleGeometry)
-            {
-                hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-            }
-        }
-
-        // AABB geometry hit groups.
-        {
-            LocalRootSignature::AABB::RootArguments rootArgs;
-            UINT instanceIndex = 0;
-
-            // Create a shader record for each primitive.
-            for (UINT iShader = 0, instanceIndex = 0; iShader < IntersectionShaderType::Count; iShader++)
-            {
-                UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
-
-                // Primitives for each intersection shader.
-                for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, instanceIndex++)
-                {
-                    //    rootArgs.materialCb = m_aabbMaterialCB[instanceIndex];
-                    rootArgs.materialCb = scene->m_aabbMaterialCB[instanceIndex];
-                    rootArgs.aabbCB.instanceIndex = instanceIndex;
-                    rootArgs.aabbCB.primitiveType = primitiveIndex;
-
-                    // Ray types.
-                    for (UINT r = 0; r < RayType::Count; r++)
-                    {
-                        auto& hitGroupShaderID = hitGroupShaderIDs_AABBGeometry[iShader][r];
-                        hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-                    }
-                }
-            }
-        }
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_forwardPathHitGroupShaderTableStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_forwardPathHitGroupShaderTable = hitGroupShaderTable.GetResource();
-    }
+    CreateShaderTables(m_deviceResources->GetD3DDevice(), m_forwardPathState.Get(), SceneShaderTableDesc(c_forwardPathTracingRayGen, c_missPathShaders), L"ForwardPath",
+        m_forwardPathRayGenShaderTable, m_forwardPathMissShaderTable, m_forwardPathRayMissShaderTableStrideInBytes,
+        m_forwardPathHitGroupShaderTable, m_forwardPathHitGroupShaderTableStrideInBytes);
 }
 
-
 void Application::BuildLightPathShaderTable()
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    void* rayGenShaderID;
-    void* missShaderIDs[RayType::Count];
-    void* hitGroupShaderIDs_TriangleGeometry[RayType::Count];
-    void* hitGroupShaderIDs_AABBGeometry[IntersectionShaderType::Count][RayType::Count];
-
-    // A shader name look-up table for shader table debug print out.
-    unordered_map<void*, wstring> shaderIdToStringMap;
-
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_lightPathTracingRayGen);
-        shaderIdToStringMap[rayGenShaderID] = c_lightPathTracingRayGen;
-
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderIDs[i] = stateObjectProperties->GetShaderIdentifier(c_missPathShaders[i]);
-            shaderIdToStringMap[missShaderIDs[i]] = c_missPathShaders[i];
-        }
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            hitGroupShaderIDs_TriangleGeometry[i] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_TriangleGeometry[i]);
-            shaderIdToStringMap[hitGroupShaderIDs_TriangleGeometry[i]] = c_hitGroupNames_TriangleGeometry[i];
-        }
-        for (UINT r = 0; r < IntersectionShaderType::Count; r++)
-            for (UINT c = 0; c < RayType::Count; c++)
-            {
-                hitGroupShaderIDs_AABBGeometry[r][c] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_AABBGeometry[r][c]);
-                shaderIdToStringMap[hitGroupShaderIDs_AABBGeometry[r][c]] = c_hitGroupNames_AABBGeometry[r][c];
-            }
-    };
-
-    // Get shader identifiers.
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_lightPathState.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    }
-
-    // RayGen shader table.
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"RayGenShaderTable");
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathRayGenShaderTable = rayGenShaderTable.GetResource();
-    }
-
-    // Miss shader table.
-    {
-        UINT numShaderRecords = RayType::Count;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissShaderTable");
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderTable.push_back(ShaderRecord(missShaderIDs[i], shaderIDSize, nullptr, 0));
-        }
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathRayMissShaderTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-        m_lightPathMissShaderTable = missShaderTable.GetResource();
-    }
-
-    // Hit group shader table.
-    {
-        UINT numShaderRecords = RayType::Count + IntersectionShaderType::TotalPrimitiveCount * RayType::Count;
-        UINT shaderRecordSize = shaderIDSize + LocalRootSignature::MaxRootArgumentsSize();
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"HitGroupShaderTable");
-
-        // Triangle geometry hit groups.
-        {
-            LocalRootSignature::Triangle::RootArguments rootArgs;
-            rootArgs.materialCb = scene->m_planeMaterialCB;
-
-            for (auto& hitGroupShaderID : hitGroupShaderIDs_TriangleGeometry)
-            {
-                hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-            }
-        }
-
-        // AABB geometry hit groups.
-        {
-            LocalRootSignature::AABB::RootArguments rootArgs;
-            UINT instanceIndex = 0;
-
-            // Create a shader record for each primitive.
-            for (UINT iShader = 0, instanceIndex = 0; iShader < IntersectionShaderType::Count; iShader++)
-            {
-                UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
-
-                // Primitives for each intersection shader.
-                for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, instanceIndex++)
-                {
-                    //    rootArgs.materialCb = m_aabbMaterialCB[instanceIndex];
-                    rootArgs.materialCb = scene->m_aabbMaterialCB[instanceIndex];
-                    rootArgs.aabbCB.instanceIndex = instanceIndex;
-                    rootArgs.aabbCB.primitiveType = primitiveIndex;
-
-                    // Ray types.
-                    for (UINT r = 0; r < RayType::Count; r++)
-                    {
-                        auto& hitGroupShaderID = hitGroupShaderIDs_AABBGeometry[iShader][r];
-                        hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-                    }
-                }
-            }
-        }
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathHitGroupShaderTableStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_lightPathHitGroupShaderTable = hitGroupShaderTable.GetResource();
-    }
+    CreateShaderTables(m_deviceResources->GetD3DDevice(), m_lightPathState.Get(), SceneShaderTableDesc(c_lightPathTracingRayGen, c_missPathShaders), L"LightPath",
+        m_lightPathRayGenShaderTable, m_lightPathMissShaderTable, m_lightPathRayMissShaderTableStrideInBytes,
+        m_lightPathHitGroupShaderTable, m_lightPathHitGroupShaderTableStrideInBytes);
 }
 
-
 void Application::BuildSecondPassLightShaderTables()
 {
-    auto device = m_deviceResources->GetD3DDevice();
-
-    void* rayGenShaderID;
-    void* missShaderIDs[RayType::Count];
-    void* hitGroupShaderIDs_TriangleGeometry[RayType::Count];
-    void* hitGroupShaderIDs_AABBGeometry[IntersectionShaderType::Count][RayType::Count];
-
-    // A shader name look-up table for shader table debug print out.
-    unordered_map<void*, wstring> shaderIdToStringMap;
-
-    auto GetShaderIDs = [&](auto* stateObjectProperties)
-    {
-        rayGenShaderID = stateObjectProperties->GetShaderIdentifier(c_lightTracingSecondPassRayGen);
-        shaderIdToStringMap[rayGenShaderID] = c_lightTracingSecondPassRayGen;
-
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderIDs[i] = stateObjectProperties->GetShaderIdentifier(c_missPathShaders[i]);
-            shaderIdToStringMap[missShaderIDs[i]] = c_missPathShaders[i];
-        }
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            hitGroupShaderIDs_TriangleGeometry[i] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_TriangleGeometry[i]);
-            shaderIdToStringMap[hitGroupShaderIDs_TriangleGeometry[i]] = c_hitGroupNames_TriangleGeometry[i];
-        }
-        for (UINT r = 0; r < IntersectionShaderType::Count; r++)
-            for (UINT c = 0; c < RayType::Count; c++)
-            {
-                hitGroupShaderIDs_AABBGeometry[r][c] = stateObjectProperties->GetShaderIdentifier(c_hitGroupNames_AABBGeometry[r][c]);
-                shaderIdToStringMap[hitGroupShaderIDs_AABBGeometry[r][c]] = c_hitGroupNames_AABBGeometry[r][c];
-            }
-    };
-
-    // Get shader identifiers.
-    UINT shaderIDSize;
-    {
-        ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
-        ThrowIfFailed(m_lightPathSecondPassState.As(&stateObjectProperties));
-        GetShaderIDs(stateObjectProperties.Get());
-        shaderIDSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-    }
-
-    // RayGen shader table.
-    {
-        UINT numShaderRecords = 1;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable rayGenShaderTable(device, numShaderRecords, shaderRecordSize, L"RayGenShaderTable");
-        rayGenShaderTable.push_back(ShaderRecord(rayGenShaderID, shaderRecordSize, nullptr, 0));
-        rayGenShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathSecondPassRayGenShaderTable = rayGenShaderTable.GetResource();
-    }
-
-    // Miss shader table.
-    {
-        UINT numShaderRecords = RayType::Count;
-        UINT shaderRecordSize = shaderIDSize; // No root arguments
-
-        ShaderTable missShaderTable(device, numShaderRecords, shaderRecordSize, L"MissShaderTable");
-        for (UINT i = 0; i < RayType::Count; i++)
-        {
-            missShaderTable.push_back(ShaderRecord(missShaderIDs[i], shaderIDSize, nullptr, 0));
-        }
-        missShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathSecondPassRayMissShaderTableStrideInBytes = missShaderTable.GetShaderRecordSize();
-        m_lightPathSecondPassMissShaderTable = missShaderTable.GetResource();
-    }
-
-    // Hit group shader table.
-    {
-        UINT numShaderRecords = RayType::Count + IntersectionShaderType::TotalPrimitiveCount * RayType::Count;
-        UINT shaderRecordSize = shaderIDSize + LocalRootSignature::MaxRootArgumentsSize();
-        ShaderTable hitGroupShaderTable(device, numShaderRecords, shaderRecordSize, L"HitGroupShaderTable");
-
-        // Triangle geometry hit groups.
-        {
-            LocalRootSignature::Triangle::RootArguments rootArgs;
-            rootArgs.materialCb = scene->m_planeMaterialCB;
-
-            for (auto& hitGroupShaderID : hitGroupShaderIDs_TriangleGeometry)
-            {
-                hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-            }
-        }
-
-        // AABB geometry hit groups.
-        {
-            LocalRootSignature::AABB::RootArguments rootArgs;
-            UINT instanceIndex = 0;
-
-            // Create a shader record for each primitive.
-            for (UINT iShader = 0, instanceIndex = 0; iShader < IntersectionShaderType::Count; iShader++)
-            {
-                UINT numPrimitiveTypes = IntersectionShaderType::PerPrimitiveTypeCount(static_cast<IntersectionShaderType::Enum>(iShader));
-
-                // Primitives for each intersection shader.
-                for (UINT primitiveIndex = 0; primitiveIndex < numPrimitiveTypes; primitiveIndex++, instanceIndex++)
-                {
-                    //    rootArgs.materialCb = m_aabbMaterialCB[instanceIndex];
-                    rootArgs.materialCb = scene->m_aabbMaterialCB[instanceIndex];
-                    rootArgs.aabbCB.instanceIndex = instanceIndex;
-                    rootArgs.aabbCB.primitiveType = primitiveIndex;
-
-                    // Ray types.
-                    for (UINT r = 0; r < RayType::Count; r++)
-                    {
-                        auto& hitGroupShaderID = hitGroupShaderIDs_AABBGeometry[iShader][r];
-                        hitGroupShaderTable.push_back(ShaderRecord(hitGroupShaderID, shaderIDSize, &rootArgs, sizeof(rootArgs)));
-                    }
-                }
-            }
-        }
-        hitGroupShaderTable.DebugPrint(shaderIdToStringMap);
-        m_lightPathSecondPassHitGroupShaderTableStrideInBytes = hitGroupShaderTable.GetShaderRecordSize();
-        m_lightPathSecondPassHitGroupShaderTable = hitGroupShaderTable.GetResource();
-    }
+    CreateShaderTables(m_deviceResources->GetD3DDevice(), m_lightPathSecondPassState.Get(), SceneShaderTableDesc(c_lightTracingSecondPassRayGen, c_missPathShaders), L"LightPathSecondPass",
+        m_lightPathSecondPassRayGenShaderTable, m_lightPathSecondPassMissShaderTable, m_lightPathSecondPassRayMissShaderTableStrideInBytes,
+        m_lightPathSecondPassHitGroupShaderTable, m_lightPathSecondPassHitGroupShaderTableStrideInBytes);
 }
+
 void Application::OnKeyDown(UINT8 key)
 {
     scene->keyPress(key);
@@ -2672,6 +2180,57 @@ void Application::OnKeyDown(UINT8 key)
     case '5':
         intersectionIndex = 5;
         break;
+    case 'R':
+        ToggleCameraRecording();
+        break;
+    case 'P':
+        ToggleCameraReplay();
+        break;
+    }
+}
+
+void Application::ToggleCameraRecording()
+{
+    if (!m_recordingCamera) {
+        m_replayingCamera = false;
+        m_cameraRecorder.Start(scene->getCameraFovY());
+        m_recordingCamera = true;
+        return;
+    }
+    m_recordingCamera = false;
+    std::string error;
+    if (!m_cameraRecorder.Save(c_cameraPathFile, &error)) {
+        OutputDebugStringA(("Camera path not saved: " + error + "\n").c_str());
+    }
+}
+
+void Application::ToggleCameraReplay()
+{
+    if (m_replayingCamera) {
+        m_replayingCamera = false;
+        return;
+    }
+    std::string error;
+    if (!m_cameraReplay.Load(c_cameraPathFile, &error)) {
+        OutputDebugStringA(("Camera path not loaded: " + error + "\n").c_str());
+        return;
+    }
+    m_recordingCamera = false;
+    m_cameraReplayFrame = 0;
+    m_replayingCamera = !m_cameraReplay.Empty();
+}
+
+// Records the camera as input left it, or moves it to the replay's next fixed step. Replay
+// time advances by frames, not by the timer, so each frame sees the same camera on every run.
+void Application::UpdateCameraPath()
+{
+    if (m_recordingCamera) {
+        m_cameraRecorder.Record(m_timer.GetTotalSeconds(), scene->getCameraState());
+    }
+    if (m_replayingCamera) {
+        scene->setCameraState(m_cameraReplay.Sample(m_cameraReplayFrame * c_cameraReplayTimestep));
+        m_cameraReplayFrame++;
+        m_replayingCamera = m_cameraReplayFrame < m_cameraReplay.FrameCount(c_cameraReplayTimestep);
     }
 }
 
@@ -2690,7 +2249,23 @@ void Application::OnUpdate()
     auto prevFrameIndex = m_deviceResources->GetPreviousFrameIndex();
     m_animateGeometryTime += elapsedTime;
 
+    // Checking the scene file for material edits once a second is plenty.
+    m_materialReloadTime += elapsedTime;
+    if (m_materialReloadTime >= 1.0f) {
+        m_materialReloadTime = 0.0f;
+        ReloadMaterials();
+    }
+
+    // A few selections a second keep up with the camera without rebuilding the TLAS every frame.
+    m_pointCloudLodTime += elapsedTime;
+    if (scene->albany && m_pointCloudLodTime >= 0.25f) {
+        m_pointCloudLodTime = 0.0f;
+        UpdatePointCloudLod();
+    }
+
+    UpdateCameraPath();
     scene->sceneUpdates(m_animateGeometryTime, m_deviceResources, m_rasterConstantBuffer, m_animateLight, elapsedTime);
+    UpdatePhotonBudget();
    //_rasterConstantBuffer->mvp = scene->GetMVP();
     //upload compute constants
    // m_computeConstantBuffer->cameraDirection = scene->getCameraDirection();
@@ -2719,7 +2294,6 @@ void Application::DoRasterisation() {
     auto scissorRect = m_deviceResources->GetScissorRect();
     auto rtv = m_deviceResources->GetRenderTargetView();
     auto renderTarget = m_deviceResources->GetRenderTarget();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     commandList->SetPipelineState(m_rasterState.Get());
     commandList->SetGraphicsRootSignature(m_rasterRootSignature.Get());
     
@@ -2730,12 +2304,10 @@ void Application::DoRasterisation() {
   //  commandList->SetGraphicsRootDescriptorTable(RasterisationRootSignature::Slot::Constant, m_descriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
     //NOTE THIS DOESN'T WORK?
-    commandList->SetGraphicsRootDescriptorTable(RasterisationRootSignature::Slot::PhotonBuffer, photonStructGPUDescriptor);
+    commandList->SetGraphicsRootDescriptorTable(RasterisationRootSignature::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
     commandList->SetGraphicsRootDescriptorTable(RasterisationRootSignature::Slot::GBuffer, geometryBuffers[0].uavGPUDescriptor);
     commandList->SetGraphicsRootDescriptorTable(RasterisationRootSignature::Slot::RasterTarget, m_raytracingOutputResourceUAVGpuDescriptor);
-    m_rasterConstantBuffer.CopyStagingToGpu(frameIndex);
-
-    commandList->SetGraphicsRootConstantBufferView(RasterisationRootSignature::Slot::Constant, m_rasterConstantBuffer.GpuVirtualAddress(frameIndex));
+    commandList->SetGraphicsRootConstantBufferView(RasterisationRootSignature::Slot::Constant, m_frameUploads.rasterConstants);
 
    // rasterConstantBuffer.mvp = scene->GetMVP();
     //memcpy(m_pCbvDataBegin, &rasterConstantBuffer, sizeof(rasterConstantBuffer));
@@ -2747,7 +2319,8 @@ void Application::DoRasterisation() {
 
    // CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIndex, m_rtvDescriptorSize);
     //commandList->OMSetRenderTargets(1, &rtv, FALSE, nullptr);
-    UINT photonCount = PHOTON_COUNT;
+    // Instances past what the photon pass stored cull themselves in VSMain.
+    UINT photonCount = m_photonCapacity.Capacity();
     m_deviceResources->SetRasterRenderTarget();
   const float clearColor[] = { 0.0f, 0.0f, 0.0f, 1.0f };
     commandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
@@ -2755,9 +2328,6 @@ void Application::DoRasterisation() {
     commandList->IASetVertexBuffers(0, 1, &rasterVertexView);
     //for now we don't use index buffers - 'cause lazy
     commandList->DrawInstanced(60, photonCount, 0, 0);
-    m_deviceResources->ExecuteCommandList();
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
     //commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
    // ThrowIfFailed(commandList->Close());
@@ -2766,7 +2336,6 @@ void Application::DoRasterisation() {
 void Application::DoScreenSpacePhotonMapping()
 {
     auto commandList = m_deviceResources->GetCommandList();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
     auto DispatchRays = [&](auto* raytracingCommandList, auto* stateObject, auto* dispatchDesc)
     {
@@ -2778,8 +2347,8 @@ void Application::DoScreenSpacePhotonMapping()
         dispatchDesc->MissShaderTable.StrideInBytes = m_missPhotonTableStrideInBytes;
         dispatchDesc->RayGenerationShaderRecord.StartAddress = m_photonRayGenTable->GetGPUVirtualAddress();
         dispatchDesc->RayGenerationShaderRecord.SizeInBytes = m_photonRayGenTable->GetDesc().Width;
-        dispatchDesc->Width = 800;
-        dispatchDesc->Height = 800;
+        dispatchDesc->Width = m_photonBudget.Emitted();
+        dispatchDesc->Height = 1;
         dispatchDesc->Depth = 1;
         raytracingCommandList->SetPipelineState1(stateObject);
         
@@ -2797,28 +2366,24 @@ void Application::DoScreenSpacePhotonMapping()
             commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::VertexBuffers, scene->m_indexBuffer.gpuDescriptorHandle);
             commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::OutputView, m_raytracingOutputResourceUAVGpuDescriptor);
             //commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonBuffer, photonUavGPUDescriptor);
-            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonCounter, photonCounterGpuDescriptor);
-            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonBuffer, photonStructGPUDescriptor);
+            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonCounter, m_photonSets[m_photonSet].counterGpuDescriptor);
+            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
             commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::ScreenSpaceMap, intersectionBuffers[0].uavGPUDescriptor);
         }
         else {
             commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::VertexBuffers, scene->m_indexBuffer.gpuDescriptorHandle);
             commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::OutputView, m_raytracingOutputResourceUAVGpuDescriptor);
             //commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot::Slot::PhotonBuffer, photonUavGPUDescriptor);
-            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::PhotonCounter, photonCounterGpuDescriptor);
-            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::PhotonBuffer, photonStructGPUDescriptor);
+            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::PhotonCounter, m_photonSets[m_photonSet].counterGpuDescriptor);
+            commandList->SetComputeRootDescriptorTable(PhotonGlobalRoot_NoScreenSpaceMap::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
         }
         //  commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::OutputView, m_raytracingOutputResourceUAVGpuDescriptor);
         
        // commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::PhotonCountBuffer, photonCountUavGPUDescriptor);
-         //  commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::PhotonBuffer, photonStructGPUDescriptor);
+         //  commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
         
     };
 
-    CreateCountBuffer();
-
-    CreatePhotonStructuredBuffer();
-
     const FLOAT f[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
     //const INT values[4] = { 0, 0, 0, 0 };
     //commandList->ClearUnorderedAccessViewUint(photonCounterGpuDescriptor, photonCountCPUDescriptor , photonCountBuffer.Get(), 0, 0, nullptr);
@@ -2826,28 +2391,22 @@ void Application::DoScreenSpacePhotonMapping()
 //commandList->
     commandList->SetComputeRootSignature(m_photonGlobalRootSignature.Get());
    
-    // Copy dynamic buffers to GPU.
+    // Bind the dynamic buffers uploaded by UploadFrameData.
     {
         if (screenSpaceMap) {
-            scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootConstantBufferView(PhotonGlobalRoot::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-            scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+            commandList->SetComputeRootConstantBufferView(PhotonGlobalRoot::Slot::SceneConstant, m_frameUploads.sceneConstants);
+            commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
             if (scene->CSG) {
-                scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-                commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+                commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot::Slot::CSGTree, m_frameUploads.csgNodes);
             }
         }
         else {
-            scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootConstantBufferView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-            scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+            commandList->SetComputeRootConstantBufferView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::SceneConstant, m_frameUploads.sceneConstants);
+            commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
             if (scene->CSG) {
-                scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-                commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+                commandList->SetComputeRootShaderResourceView(PhotonGlobalRoot_NoScreenSpaceMap::Slot::CSGTree, m_frameUploads.csgNodes);
             }
         }
     }
@@ -2864,9 +2423,6 @@ void Application::DoScreenSpacePhotonMapping()
     }
     DispatchRays(m_dxrCommandList.Get(), m_photonMapStateObject.Get(), &dispatchDesc);
 
-    m_deviceResources->ExecuteCommandList();
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 }
 
 void Application::CompositeIndirectAndDirectIllumination() {
@@ -2884,14 +2440,13 @@ void Application::CompositeIndirectAndDirectIllumination() {
 void Application::DoTiling(UINT tileX, UINT tileY, UINT tileDepth) {
     auto commandList = m_deviceResources->GetCommandList();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
 
     commandList->SetPipelineState(m_computeStateObject.Get());
     commandList->SetComputeRootSignature(m_computeRootSignature.Get());
 
     commandList->SetDescriptorHeaps(1, m_descriptorHeap.GetAddressOf());
     commandList->SetComputeRootDescriptorTable(ComputeRootSignatureParams::OutputViewSlot, m_raytracingOutputResourceUAVGpuDescriptor);
-    commandList->SetComputeRootDescriptorTable(ComputeRootSignatureParams::PhotonBuffer, photonStructGPUDescriptor);
+    commandList->SetComputeRootDescriptorTable(ComputeRootSignatureParams::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
     commandList->SetComputeRootDescriptorTable(ComputeRootSignatureParams::TiledPhotonMap, tiledPhotonUAVGpuDescriptor);
 
     
@@ -2901,22 +2456,20 @@ void Application::DoTiling(UINT tileX, UINT tileY, UINT tileDepth) {
     }
 
     commandList->Dispatch(tileX, tileY, tileDepth);
-    m_deviceResources->ExecuteCommandList();
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 
 }
 
 void Application::DoCompositing() {
 
     auto commandList = m_deviceResources->GetCommandList();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
 
     commandList->SetComputeRootSignature(m_rayCompositeSignature.Get());
 
     commandList->SetDescriptorHeaps(1, m_descriptorHeap.GetAddressOf());
     commandList->SetComputeRootDescriptorTable(ComputeCompositeRootSignature::Slot::RayTracingView, m_raytracingOutputResourceUAVGpuDescriptor);
    commandList->SetComputeRootDescriptorTable(ComputeCompositeRootSignature::Slot::RasterView, m_rasterOutputResourceUAVGPUDescriptor);
+    commandList->SetComputeRootDescriptorTable(ComputeCompositeRootSignature::Slot::PhotonAccumulation, m_photonAccumulationUAVGpuDescriptor);
+    commandList->SetComputeRootConstantBufferView(ComputeCompositeRootSignature::Slot::SceneConstant, m_frameUploads.sceneConstants);
 
     D3D12_DISPATCH_RAYS_DESC compositeDesc = {};
     compositeDesc.RayGenerationShaderRecord.StartAddress = m_compositeRayGenShaderTable->GetGPUVirtualAddress();
@@ -2932,17 +2485,12 @@ void Application::DoCompositing() {
     compositeDesc.Depth = 1;
     m_dxrCommandList->SetPipelineState1(m_rayCompositeStateObject.Get());
     m_dxrCommandList->DispatchRays(&compositeDesc);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 }
 
 void Application::DoForwardPathTracing()
 {
     auto commandList = m_deviceResources->GetCommandList();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     auto DispatchRays = [&](auto* raytracingCommandList, auto* stateObject, auto* dispatchDesc)
     {
         dispatchDesc->HitGroupTable.StartAddress = m_forwardPathHitGroupShaderTable->GetGPUVirtualAddress();
@@ -2978,14 +2526,11 @@ void Application::DoForwardPathTracing()
 
     commandList->SetComputeRootSignature(m_bidirectionalForwardRootSignature.Get());
 
-    scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_Bidirectional::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-    scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_Bidirectional::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_Bidirectional::Slot::SceneConstant, m_frameUploads.sceneConstants);
+    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_Bidirectional::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
     if (scene->CSG) {
-        scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_Bidirectional::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_Bidirectional::Slot::CSGTree, m_frameUploads.csgNodes);
     }
 
     D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
@@ -2996,17 +2541,12 @@ void Application::DoForwardPathTracing()
 
     
     DispatchRays(m_dxrCommandList.Get(), m_forwardPathState.Get(), &dispatchDesc);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 }
 
 void Application::DoLightPathTracing()
 {
     auto commandList = m_deviceResources->GetCommandList();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     auto DispatchRays = [&](auto* raytracingCommandList, auto* stateObject, auto* dispatchDesc)
     {
         dispatchDesc->HitGroupTable.StartAddress = m_lightPathHitGroupShaderTable->GetGPUVirtualAddress();
@@ -3041,14 +2581,11 @@ void Application::DoLightPathTracing()
 
     commandList->SetComputeRootSignature(m_bidirectionalLightRootSignature.Get());
 
-    scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_BidirectionalLight::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-    scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_BidirectionalLight::Slot::SceneConstant, m_frameUploads.sceneConstants);
+    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
     if (scene->CSG) {
-        scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::CSGTree, m_frameUploads.csgNodes);
     }
 
     D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
@@ -3059,10 +2596,6 @@ void Application::DoLightPathTracing()
 
 
     DispatchRays(m_dxrCommandList.Get(), m_lightPathState.Get(), &dispatchDesc);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 }
 
 
@@ -3070,7 +2603,6 @@ void Application::DoLightPathTracingSecondPass()
 {
     auto commandList = m_deviceResources->GetCommandList();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     auto DispatchRays = [&](auto* raytracingCommandList, auto* stateObject, auto* dispatchDesc)
     {
         dispatchDesc->HitGroupTable.StartAddress = m_lightPathSecondPassHitGroupShaderTable ->GetGPUVirtualAddress();
@@ -3105,14 +2637,11 @@ void Application::DoLightPathTracingSecondPass()
 
     commandList->SetComputeRootSignature(m_bidirectionalLightRootSignature.Get());
 
-    scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_BidirectionalLight::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-    scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+    commandList->SetComputeRootConstantBufferView(GlobalRootSignature_BidirectionalLight::Slot::SceneConstant, m_frameUploads.sceneConstants);
+    commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
     if (scene->CSG) {
-        scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+        commandList->SetComputeRootShaderResourceView(GlobalRootSignature_BidirectionalLight::Slot::CSGTree, m_frameUploads.csgNodes);
     }
 
     D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
@@ -3123,10 +2652,6 @@ void Application::DoLightPathTracingSecondPass()
 
 
     DispatchRays(m_dxrCommandList.Get(), m_lightPathSecondPassState.Get(), &dispatchDesc);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 }
 
 
@@ -3134,7 +2659,6 @@ void Application::DoRaytracing()
 {
     auto commandList = m_deviceResources->GetCommandList();
     auto frameIndex = m_deviceResources->GetCurrentFrameIndex();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
     auto DispatchRays = [&](auto* raytracingCommandList, auto* stateObject, auto* dispatchDesc)
     {
         dispatchDesc->HitGroupTable.StartAddress = m_hitGroupShaderTable->GetGPUVirtualAddress();
@@ -3163,15 +2687,15 @@ void Application::DoRaytracing()
         if (screenSpaceMap) {
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::VertexBuffers, scene->m_indexBuffer.gpuDescriptorHandle);
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::OutputView, m_raytracingOutputResourceUAVGpuDescriptor);
-            commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::PhotonBuffer, photonStructGPUDescriptor);
+            commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature::Slot::SceenSpaceMap, intersectionBuffers[0].uavGPUDescriptor);
         }
         else {
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::VertexBuffers, scene->m_indexBuffer.gpuDescriptorHandle);
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::OutputView, m_raytracingOutputResourceUAVGpuDescriptor);
             commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::GBuffer, geometryBuffers[0].uavGPUDescriptor);
-            commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::PhotonCounter, photonCounterGpuDescriptor);
-            commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::PhotonBuffer, photonStructGPUDescriptor);
+            commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::PhotonCounter, m_photonSets[m_photonSet].counterGpuDescriptor);
+            commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::PhotonBuffer, m_photonSets[m_photonSet].photonsGpuDescriptor);
            // commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::RasterView, m_rasterOutputResourceUAVGPUDescriptor);
             if (tiling) {
                 commandList->SetComputeRootDescriptorTable(GlobalRootSignature_NoScreenSpaceMap::Slot::TiledPhotonMap, tiledPhotonUAVGpuDescriptor);
@@ -3185,28 +2709,22 @@ void Application::DoRaytracing()
 
     commandList->SetComputeRootSignature(m_raytracingGlobalRootSignature.Get());
 
-    // Copy dynamic buffers to GPU.
+    // Bind the dynamic buffers uploaded by UploadFrameData.
     {
         if (screenSpaceMap) {
-            scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootConstantBufferView(GlobalRootSignature::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-            scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootShaderResourceView(GlobalRootSignature::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+            commandList->SetComputeRootConstantBufferView(GlobalRootSignature::Slot::SceneConstant, m_frameUploads.sceneConstants);
+            commandList->SetComputeRootShaderResourceView(GlobalRootSignature::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
             if (scene->CSG) {
-                scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-                commandList->SetComputeRootShaderResourceView(GlobalRootSignature::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+                commandList->SetComputeRootShaderResourceView(GlobalRootSignature::Slot::CSGTree, m_frameUploads.csgNodes);
             }
         }
         else {
-            scene->getSceneBuffer()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootConstantBufferView(GlobalRootSignature_NoScreenSpaceMap::Slot::SceneConstant, scene->getSceneBuffer()->GpuVirtualAddress(frameIndex));
-            scene->getPrimitiveAttributes()->CopyStagingToGpu(frameIndex);
-            commandList->SetComputeRootShaderResourceView(GlobalRootSignature_NoScreenSpaceMap::Slot::AABBattributeBuffer, scene->getPrimitiveAttributes()->GpuVirtualAddress(frameIndex));
+            commandList->SetComputeRootConstantBufferView(GlobalRootSignature_NoScreenSpaceMap::Slot::SceneConstant, m_frameUploads.sceneConstants);
+            commandList->SetComputeRootShaderResourceView(GlobalRootSignature_NoScreenSpaceMap::Slot::AABBattributeBuffer, m_frameUploads.primitiveAttributes);
 
             if (scene->CSG) {
-                scene->getCSGTree()->CopyStagingToGpu(frameIndex);
-                commandList->SetComputeRootShaderResourceView(GlobalRootSignature_NoScreenSpaceMap::Slot::CSGTree, scene->getCSGTree()->GpuVirtualAddress(frameIndex));
+                commandList->SetComputeRootShaderResourceView(GlobalRootSignature_NoScreenSpaceMap::Slot::CSGTree, m_frameUploads.csgNodes);
             }
 
         }
@@ -3224,10 +2742,6 @@ void Application::DoRaytracing()
 
     }
     DispatchRays(m_dxrCommandList.Get(), m_dxrStateObject.Get(), &dispatchDesc);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
 
 }
 
@@ -3238,79 +2752,12 @@ void Application::UpdateForSizeChange(UINT width, UINT height)
     DXSample::UpdateForSizeChange(width, height);
 }
 
-
-
-
-void Application::CopyIntersectionBufferToBackBuffer(UINT intersectionIndex) {
-
-
-    auto commandList = m_deviceResources->GetCommandList();
-    auto renderTarget = m_deviceResources->GetRenderTarget();
-
-
-    
-    D3D12_RESOURCE_BARRIER preCopyBarriers[2];
-    preCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-    preCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(intersectionBuffers[intersectionIndex].textureResource.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    commandList->ResourceBarrier(ARRAYSIZE(preCopyBarriers), preCopyBarriers);
-   
-
-
-    commandList->CopyResource(renderTarget, intersectionBuffers[intersectionIndex].textureResource.Get());
- 
-    D3D12_RESOURCE_BARRIER postCopyBarriers[2];
-    postCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
-    postCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(intersectionBuffers[intersectionIndex].textureResource.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-    commandList->ResourceBarrier(ARRAYSIZE(postCopyBarriers), postCopyBarriers);
-
-    
-  
-}
-void Application::CopyGBufferToBackBuffer()
-{
-    auto commandList = m_deviceResources->GetCommandList();
-    auto renderTarget = m_deviceResources->GetRenderTarget();
-
-    D3D12_RESOURCE_BARRIER preCopyBarriers[2];
-    preCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_DEST);
-    preCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(geometryBuffers[0].textureResource.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    commandList->ResourceBarrier(ARRAYSIZE(preCopyBarriers), preCopyBarriers);
-
-    commandList->CopyResource(renderTarget, geometryBuffers[0].textureResource.Get());
-
-    D3D12_RESOURCE_BARRIER postCopyBarriers[2];
-    postCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
-    postCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(geometryBuffers[0].textureResource.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-    commandList->ResourceBarrier(ARRAYSIZE(postCopyBarriers), postCopyBarriers);
-
-
-}
-
 // Copy the raytracing output to the backbuffer.
 void Application::CopyRaytracingOutputToBackbuffer()
 {
     auto commandList = m_deviceResources->GetCommandList();
     auto renderTarget = m_deviceResources->GetRenderTarget();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
-    D3D12_RESOURCE_BARRIER preCopyBarriers[2];
-    preCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_DEST);
-    preCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_raytracingOutput.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    commandList->ResourceBarrier(ARRAYSIZE(preCopyBarriers), preCopyBarriers);
-
     commandList->CopyResource(renderTarget, m_raytracingOutput.Get());
-
-    D3D12_RESOURCE_BARRIER postCopyBarriers[2];
-    postCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
-    postCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_raytracingOutput.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-    commandList->ResourceBarrier(ARRAYSIZE(postCopyBarriers), postCopyBarriers);
-    m_deviceResources->ExecuteCommandList();
-
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
-
 }
 
 // Create resources that are dependent on the size of the main window.
@@ -3321,13 +2768,15 @@ void Application::CreateWindowSizeDependentResources()
     if (photonMapping) {
         CreateRasterOutputResource();
 
-        CreateCountBuffer();
+        // The photon sets are not tied to the window; they survive a resize.
+        if (!m_photonSets[0].photons) {
+            CreatePhotonBuffers();
+        }
         if (mappingAndPathing) {
             CreateStagingResource();
             CreateAccumulationBuffers();
             CreateLightBuffers();
         }
-        CreatePhotonStructuredBuffer();
 
         CreateDeferredGBuffer();
 
@@ -3370,7 +2819,7 @@ void Application::ReleaseWindowSizeDependentResources()
     m_raytracingOutput.Reset();
     for (auto& I : intersectionBuffers) {
         I.textureResource.Reset();
-        I.uavDescriptorHeapIndex = UINT_MAX;
+        FreeDescriptor(I.uavDescriptor);
     }
 }
 
@@ -3400,29 +2849,38 @@ void Application::ReleaseDeviceDependentResources()
     ResetComPtrArray(&m_raytracingLocalRootSignature);
 
     m_descriptorHeap.Reset();
-    m_descriptorsAllocated = 0;
+    m_descriptors.Reset();
+    m_uploadRing.Release();
+    m_renderGraphBackend.Release();
     scene->releaseResources();
 
     acclerationStruct->Reset();
   
 
+    // The heap is gone, so every handle into it is dropped rather than left to alias the next one.
     m_raytracingOutput.Reset();
-    m_raytracingOutputResourceUAVDescriptorHeapIndex = UINT_MAX;
+    m_raytracingOutputResourceUAVDescriptor = DescriptorHandle();
 
     m_rasterOutput.Reset();
-    m_rasterOutputResourceUAVDescriptorHeapIndex = UINT_MAX;
+    m_rasterOutputResourceUAVDescriptor = DescriptorHandle();
+
+    m_photonAccumulation.Reset();
+    m_photonAccumulationUAVDescriptor = DescriptorHandle();
 
-    photonStructBuffer.Reset();
-    photonStructGpuHeapIndex = UINT_MAX;
-    photonCountBuffer.Reset();
-    photonCountUavDescriptorHeapIndex = UINT_MAX;
+    ReleasePhotonBuffers();
 
     tiledPhotonMapBuffer.Reset();
-    tiledPhotonMapUAVDescriptorIndex = UINT_MAX;
+    tiledPhotonMapUAVDescriptor = DescriptorHandle();
     for (auto& I : intersectionBuffers) {
         I.textureResource.Reset();
-        I.uavDescriptorHeapIndex = UINT_MAX;
+        I.uavDescriptor = DescriptorHandle();
     }
+    geometryBuffers.clear();
+    LightBuffers.clear();
+    m_lightBufferDescriptors = DescriptorHandle();
+    stagingDescriptor = DescriptorHandle();
+    lightAccumulationDescriptor = DescriptorHandle();
+    forwardAccumulationDescriptor = DescriptorHandle();
     m_rayGenShaderTable.Reset();
     m_missShaderTable.Reset();
     m_hitGroupShaderTable.Reset();
@@ -3447,27 +2905,140 @@ void Application::RecreateD3D()
 void Application::CopyBackBufferToRasterBuffer() {
     auto commandList = m_deviceResources->GetCommandList();
     auto renderTarget = m_deviceResources->GetRenderTarget();
-    auto commandAllocator = m_deviceResources->GetCommandAllocator();
-    D3D12_RESOURCE_BARRIER preCopyBarriers[2];
-    preCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    preCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_rasterOutput.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
-    commandList->ResourceBarrier(ARRAYSIZE(preCopyBarriers), preCopyBarriers);
-
     commandList->CopyResource(m_rasterOutput.Get(), renderTarget);
+}
 
-    D3D12_RESOURCE_BARRIER postCopyBarriers[2];
-    postCopyBarriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    postCopyBarriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_rasterOutput.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 
-    commandList->ResourceBarrier(ARRAYSIZE(postCopyBarriers), postCopyBarriers);
-    m_deviceResources->ExecuteCommandList();
+bool Application::PhotonMapsThisFrame() const
+{
+    return photonMapping && !(biDirectional && mappingAndPathing);
+}
 
-    m_deviceResources->WaitForGpu();
-    commandList->Reset(commandAllocator, nullptr);
+// Declares this frame's passes and what they touch. The graph works out the barriers between
+// them; the passes themselves only record work.
+void Application::BuildRenderGraph()
+{
+    RenderGraph& graph = m_renderGraph;
+    graph.Reset();
+    auto import = [&](const char* name, ID3D12Resource* resource, RenderGraphState::Enum initial, RenderGraphState::Enum final) {
+        RenderGraphResource handle = graph.Import(name, initial, final);
+        m_renderGraphBackend.Bind(handle, resource);
+        return handle;
+    };
+    const RenderGraphState::Enum uav = RenderGraphState::UnorderedAccess;
+    RenderGraphResource backBuffer = import("BackBuffer", m_deviceResources->GetRenderTarget(), RenderGraphState::RenderTarget, RenderGraphState::Present);
+    RenderGraphResource output = import("RaytracingOutput", m_raytracingOutput.Get(), uav, uav);
+
+    if (PhotonMapsThisFrame()) {
+        const PhotonBufferSet& photonSet = m_photonSets[m_photonSet];
+        RenderGraphResource photons = import("Photons", photonSet.photons.Get(), uav, uav);
+        RenderGraphResource photonCount = import("PhotonCount", photonSet.counter.Get(), uav, uav);
+        RenderGraphResource gBuffer = import("GBuffer", geometryBuffers[0].textureResource.Get(), uav, uav);
+        RenderGraphResource rasterOutput = import("RasterOutput", m_rasterOutput.Get(), uav, uav);
+        RenderGraphResource photonAccumulation = import("PhotonAccumulation", m_photonAccumulation.Get(), uav, uav);
+        RenderGraphResource screenSpaceMapBuffer = screenSpaceMap ? import("ScreenSpaceMap", intersectionBuffers[0].textureResource.Get(), uav, uav) : InvalidRenderGraphResource;
+
+        uint32_t pass = graph.AddPass("ClearPhotonCounter", [this] { ClearPhotonCounter(); });
+        graph.Write(pass, photonCount, RenderGraphState::CopyDest);
+
+        pass = graph.AddPass("PhotonMapping", [this] { DoScreenSpacePhotonMapping(); });
+        graph.Write(pass, photons, uav);
+        graph.Write(pass, photonCount, uav);
+        graph.Write(pass, output, uav);
+        if (screenSpaceMap) {
+            graph.Write(pass, screenSpaceMapBuffer, uav);
+        }
+
+        pass = graph.AddPass("Raytracing", [this] { DoRaytracing(); });
+        graph.Read(pass, photons, uav);
+        graph.Write(pass, output, uav);
+        if (screenSpaceMap) {
+            graph.Read(pass, screenSpaceMapBuffer, uav);
+        }
+        else {
+            graph.Write(pass, gBuffer, uav);
+            graph.Write(pass, photonCount, uav);
+        }
+
+        pass = graph.AddPass("ReadBackPhotonCounter", [this] { ReadBackPhotonCounter(); }, true);
+        graph.Read(pass, photonCount, RenderGraphState::CopySource);
+
+        pass = graph.AddPass("Rasterisation", [this] { DoRasterisation(); });
+        graph.Read(pass, photons, uav);
+        graph.Read(pass, photonCount, uav);
+        graph.Read(pass, gBuffer, uav);
+        graph.Write(pass, output, uav);
+        graph.Write(pass, backBuffer, RenderGraphState::RenderTarget);
+
+        pass = graph.AddPass("CopyBackBufferToRaster", [this] { CopyBackBufferToRasterBuffer(); });
+        graph.Read(pass, backBuffer, RenderGraphState::CopySource);
+        graph.Write(pass, rasterOutput, RenderGraphState::CopyDest);
+
+        pass = graph.AddPass("Compositing", [this] { DoCompositing(); });
+        graph.Read(pass, rasterOutput, uav);
+        graph.Write(pass, photonAccumulation, uav);
+        graph.Write(pass, output, uav);
+    }
+    else {
+        RenderGraphResource lightVertices = import("LightVertices", LightBuffers[0].textureResource.Get(), uav, uav);
+        RenderGraphResource staging = import("Staging", stagingResource.Get(), uav, uav);
+        RenderGraphResource lightAccumulation = import("LightAccumulation", lightAccumulationResource.Get(), uav, uav);
+        RenderGraphResource forwardAccumulation = import("ForwardAccumulation", forwardAccumulationResource.Get(), uav, uav);
+
+        uint32_t pass = graph.AddPass("LightPaths", [this] { DoLightPathTracing(); });
+        graph.Write(pass, lightVertices, uav);
+        graph.Write(pass, staging, uav);
+        graph.Write(pass, output, uav);
+
+        if (!photonMapping) {
+            pass = graph.AddPass("LightPathsSecondPass", [this] { DoLightPathTracingSecondPass(); });
+            graph.Write(pass, lightVertices, uav);
+            graph.Write(pass, staging, uav);
+            graph.Write(pass, output, uav);
+        }
+
+        pass = graph.AddPass("ForwardPaths", [this] { DoForwardPathTracing(); });
+        graph.Read(pass, lightVertices, uav);
+        graph.Read(pass, staging, uav);
+        graph.Write(pass, lightAccumulation, uav);
+        graph.Write(pass, forwardAccumulation, uav);
+        graph.Write(pass, output, uav);
+    }
+
+    uint32_t pass = graph.AddPass("CopyToBackBuffer", [this] { CopyRaytracingOutputToBackbuffer(); });
+    graph.Read(pass, output, RenderGraphState::CopySource);
+    graph.Write(pass, backBuffer, RenderGraphState::CopyDest);
+
+    std::string error;
+    ThrowIfFalse(graph.Compile(&error), std::wstring(error.begin(), error.end()).c_str());
 }
 
+// Packs everything the passes read from upload memory this frame into one ring allocation.
+// The CSG nodes are copied whether or not the scene uses them; there are only a handful.
+void Application::UploadFrameData()
+{
+    auto sceneConstants = scene->getSceneBuffer();
+    auto primitiveAttributes = scene->getPrimitiveAttributes();
+    auto csgNodes = scene->getCSGTree();
+
+    UploadFrameLayout layout;
+    UINT64 sceneOffset = layout.Add(sizeof(SceneConstantBuffer), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    UINT64 rasterOffset = layout.Add(sizeof(RasterSceneCB), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+    UINT64 attributesOffset = layout.Add(primitiveAttributes->InstanceSize(), 16);
+    UINT64 csgOffset = layout.Add(csgNodes->InstanceSize(), 16);
+
+    UploadRing::Block block = m_uploadRing.Allocate(layout);
+    memcpy(block.cpu + sceneOffset, &sceneConstants->staging, sizeof(SceneConstantBuffer));
+    memcpy(block.cpu + rasterOffset, &m_rasterConstantBuffer.staging, sizeof(RasterSceneCB));
+    memcpy(block.cpu + attributesOffset, primitiveAttributes->StagingData(), primitiveAttributes->InstanceSize());
+    memcpy(block.cpu + csgOffset, csgNodes->StagingData(), csgNodes->InstanceSize());
+
+    m_frameUploads.sceneConstants = block.gpu + sceneOffset;
+    m_frameUploads.rasterConstants = block.gpu + rasterOffset;
+    m_frameUploads.primitiveAttributes = block.gpu + attributesOffset;
+    m_frameUploads.csgNodes = block.gpu + csgOffset;
+}
 
-// Render the scene.
 void Application::OnRender()
 {
     if (!m_deviceResources->IsWindowVisible())
@@ -3478,52 +3049,29 @@ void Application::OnRender()
     auto device = m_deviceResources->GetD3DDevice();
     auto commandList = m_deviceResources->GetCommandList();
 
+    if (PhotonMapsThisFrame())
+    {
+        UpdatePhotonCapacity();
+    }
+
     // Begin frame.
     m_deviceResources->Prepare();
+    UploadFrameData();
+    if (m_topLevelASPending)
+    {
+        acclerationStruct->RebuildTopLevelAS(m_deviceResources, m_dxrDevice, m_dxrCommandList);
+        m_topLevelASPending = false;
+    }
    for (auto& gpuTimer : m_gpuTimers)
     {
         gpuTimer.BeginFrame(commandList);
     }
 
-   if (photonMapping) {
-       if (biDirectional && mappingAndPathing) {
-           DoLightPathTracing();
-         // DoLightPathTracingSecondPass();
-           DoForwardPathTracing();
-           CopyRaytracingOutputToBackbuffer();
-       }
-       else {
-
-
-           DoScreenSpacePhotonMapping();
-
-           //  DoTiling(1024, 720, 1);
-            //deferred rendering + direct lighting
-           DoRaytracing();
-           //DoForwardPathTracing();
-
-          
-
-           DoRasterisation();
-          CopyBackBufferToRasterBuffer();
-           DoCompositing();
-
-           CopyRaytracingOutputToBackbuffer();
-       }
-   }
-   else {
-       DoLightPathTracing();
-       DoLightPathTracingSecondPass();
-       DoForwardPathTracing();
-       CopyRaytracingOutputToBackbuffer();
-   }
+    // Every pass is recorded into the one command list, which Present() submits.
+    BuildRenderGraph();
+    m_renderGraphBackend.SetCommandList(commandList);
+    m_renderGraph.Execute(m_renderGraphBackend);
 
-    //DoCompositing();
-//
-
-   // DoRaytracing();
-    
-   
     // End frame.
     for (auto& gpuTimer : m_gpuTimers)
     {
@@ -3531,6 +3079,7 @@ void Application::OnRender()
     }
 
     m_deviceResources->Present(D3D12_RESOURCE_STATE_PRESENT);
+    m_uploadRing.EndFrame(m_deviceResources->GetCommandQueue());
 
 }
 
@@ -3611,22 +3160,32 @@ void Application::OnSizeChanged(UINT width, UINT height, bool minimized)
     CreateWindowSizeDependentResources();
 }
 
-// Allocate a descriptor and return its index. 
-// If the passed descriptorIndexToUse is valid, it will be used instead of allocating a new one.
-UINT Application::AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse)
+// Allocate count contiguous descriptors and return their handle, with the CPU handle of the first.
+// A resource recreated after a resize passes its previous handle back in and keeps its slots;
+// a stale or differently sized handle is replaced by a fresh allocation.
+DescriptorHandle Application::AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, const DescriptorHandle& previous, UINT count)
 {
-    auto descriptorHeapCpuBase = m_descriptorHeap->GetCPUDescriptorHandleForHeapStart();
-    if (descriptorIndexToUse >= m_descriptorHeap->GetDesc().NumDescriptors)
+    DescriptorAllocator& allocator = m_descriptors.Allocator();
+    DescriptorHandle handle = previous;
+    if (!allocator.IsValid(handle) || handle.count != count)
     {
-        ThrowIfFalse(m_descriptorsAllocated < m_descriptorHeap->GetDesc().NumDescriptors, L"Ran out of descriptors on the heap!" );
-        descriptorIndexToUse = m_descriptorsAllocated++;
+        allocator.Free(handle);
+        handle = allocator.Allocate(m_resourceDescriptorRange, count);
+        ThrowIfFalse(!handle.IsNull(), L"Ran out of descriptors on the heap!");
     }
-    *cpuDescriptor = CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptorHeapCpuBase, descriptorIndexToUse, m_descriptorSize);
-    return descriptorIndexToUse;
+    *cpuDescriptor = m_descriptors.CpuHandle(handle);
+    return handle;
+}
+
+// Return descriptors to the heap; the handle is reset so the next AllocateDescriptor takes fresh slots.
+void Application::FreeDescriptor(DescriptorHandle& handle)
+{
+    m_descriptors.Allocator().Free(handle);
+    handle = DescriptorHandle();
 }
 
 // Create a SRV for a buffer.
-UINT Application::CreateBufferSRV(D3DBuffer* buffer, uint32_t numElements, UINT elementSize)
+DescriptorHandle Application::CreateBufferSRV(D3DBuffer* buffer, uint32_t numElements, UINT elementSize)
 {
     auto device = m_deviceResources->GetD3DDevice();
 
@@ -3647,8 +3206,8 @@ UINT Application::CreateBufferSRV(D3DBuffer* buffer, uint32_t numElements, UINT
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
         srvDesc.Buffer.StructureByteStride = elementSize;
     }
-    UINT descriptorIndex = AllocateDescriptor(&buffer->cpuDescriptorHandle);
+    DescriptorHandle descriptor = AllocateDescriptor(&buffer->cpuDescriptorHandle);
     device->CreateShaderResourceView(buffer->resource.Get(), &srvDesc, buffer->cpuDescriptorHandle);
-    buffer->gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, m_descriptorSize);
-    return descriptorIndex;
+    buffer->gpuDescriptorHandle = m_descriptors.GpuHandle(descriptor);
+    return descriptor;
 }
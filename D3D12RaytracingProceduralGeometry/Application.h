@@ -14,7 +14,10 @@
 #include "DXSample.h"
 #include "StepTimer.h"
 #include "RaytracingSceneDefines.h"
+#include "PhotonBudget.h"
+#include "PhotonStorage.h"
 #include "DirectXRaytracingHelper.h"
+#include "DescriptorHeap.h"
 #include "PerformanceTimers.h"
 #include <dxcapi.h>
 #include <d3dcompiler.h>
@@ -34,7 +37,7 @@ struct IBuffer
 {
     ComPtr<ID3D12Resource> textureResource;
     D3D12_GPU_DESCRIPTOR_HANDLE uavGPUDescriptor;
-    UINT uavDescriptorHeapIndex;
+    DescriptorHandle uavDescriptor;
 
     
 };
@@ -43,7 +46,7 @@ struct IBuffer
 struct TiledBuffer {
     ComPtr<ID3D12Resource> resource;
     D3D12_GPU_DESCRIPTOR_HANDLE uavGPUDescriptor;
-    UINT uavDescriptorHeapIndex;
+    DescriptorHandle uavDescriptor;
     D3D12_CPU_DESCRIPTOR_HANDLE tiledBufferCPUDescriptor;
 
 
@@ -78,6 +81,7 @@ public:
     virtual void OnSizeChanged(UINT width, UINT height, bool minimized);
     virtual void OnDestroy();
     virtual void OnMouseMove(float x, float y);
+    virtual void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc) override;
     virtual IDXGISwapChain* GetSwapchain() { return m_deviceResources->GetSwapChain(); }
 
 private:
@@ -91,6 +95,7 @@ private:
     bool mapped = false;
 
     static const UINT FrameCount = 3;
+    std::wstring m_scenePath = L"Scenes/default.scene";
     std::vector<float> fpsAverages;
     bool testing = false;
     bool drawRays = false;
@@ -100,7 +105,6 @@ private:
     bool recordIntersections = true;
     bool biPathTracing = true;
     // Constants.
-    UINT photonCount = 1000;
     UINT NUM_BLAS = 100000;          // Triangle + AABB bottom-level AS.
     const float c_aabbWidth = 2;      // AABB width.
     const float c_aabbDistance = 2;   // Distance between AABBs.
@@ -160,14 +164,22 @@ private:
     //ComPtr<ID3D12Resource> tiledPhotonCounter;
    // D3D12_CPU_DESCRIPTOR_HANDLE tiledPhotonCountCPUDescriptor;
     D3D12_GPU_DESCRIPTOR_HANDLE tiledPhotonUAVGpuDescriptor;
-    UINT tiledPhotonMapUAVDescriptorIndex;
+    DescriptorHandle tiledPhotonMapUAVDescriptor;
 
 
     bool screenSpaceMap = false;
    // IBuffer stagingResource;
     // Descriptors
-    ComPtr<ID3D12DescriptorHeap> m_descriptorHeap;
-    UINT m_descriptorsAllocated;
+    // Views each group of resources declares in the resource range. The heap is sized by
+    // ResourceDescriptorCount from the groups the current mode creates; resources recreated
+    // on a resize pass their handles back to AllocateDescriptor and keep their slots.
+    static const UINT c_geometryViews = 2;                              // Index and vertex buffer SRVs.
+    static const UINT c_outputViews = 1;                                // m_raytracingOutput.
+    static const UINT c_photonMappingViews = 3 + 2 * 2;                 // Raster output, photon accumulation, G-buffer, two photon sets.
+    static const UINT c_pathTracingViews = 3 + 4 * MAX_RAY_RECURSION_DEPTH;    // Staging, light and forward accumulation, light buffers.
+    DescriptorHeap m_descriptors;
+    UINT m_resourceDescriptorRange;
+    ComPtr<ID3D12DescriptorHeap> m_descriptorHeap;      // m_descriptors.GetHeap().
     UINT m_descriptorSize;
 
 
@@ -175,39 +187,72 @@ private:
     IDxcBlob* m_rayGenLibrary;
     //std::vector<TiledBuffer> photonTiles;
 
-    D3D12_CPU_DESCRIPTOR_HANDLE photonCountCPUDescriptor;
-    ComPtr<ID3D12Resource> photonCountBuffer;
-    D3D12_GPU_DESCRIPTOR_HANDLE photonCountUavGPUDescriptor;
-    UINT photonCountUavDescriptorHeapIndex;
-
     ConstantBuffer<ComputeConstantBuffer> m_computeConstantBuffer;
-    ConstantBuffer<RasterSceneCB> m_rasterConstantBuffer;
-
-    ComPtr<ID3D12Resource> photonStructBuffer;
-    D3D12_GPU_DESCRIPTOR_HANDLE photonStructGPUDescriptor;
-    D3D12_CPU_DESCRIPTOR_HANDLE photonStructCPUDescriptor;
-    UINT photonStructGpuHeapIndex;
+    ConstantBuffer<RasterSceneCB> m_rasterConstantBuffer;       // Staging only; uploaded through m_uploadRing.
+
+    // Per-frame uploads. Besides the procedural instance attributes, which are added on top, a frame
+    // needs a few KB, so this holds every frame in flight with room to spare.
+    static const UINT c_uploadRingSize = 64 * 1024;
+    UploadRing m_uploadRing;
+    struct FrameUploads {
+        D3D12_GPU_VIRTUAL_ADDRESS sceneConstants;
+        D3D12_GPU_VIRTUAL_ADDRESS rasterConstants;
+        D3D12_GPU_VIRTUAL_ADDRESS primitiveAttributes;
+        D3D12_GPU_VIRTUAL_ADDRESS csgNodes;
+    } m_frameUploads = {};
+
+    // The frame's passes, rebuilt every frame from the current mode. The backend records the
+    // barriers the graph computes, so passes no longer manage resource states themselves.
+    RenderGraph m_renderGraph;
+    D3D12RenderGraphBackend m_renderGraphBackend;
+
+    // Photon buffers that persist across frames (see PhotonStorage.h). Frames alternate between
+    // the two sets, and the photon pass empties its set by copying zero into the counter. The
+    // counter's final value is read back to size the sets.
+    struct PhotonBufferSet {
+        ComPtr<ID3D12Resource> photons;
+        ComPtr<ID3D12Resource> counter;
+        DescriptorHandle descriptors;               // The photons' UAV, then the counter's raw UAV.
+        D3D12_GPU_DESCRIPTOR_HANDLE photonsGpuDescriptor;
+        D3D12_GPU_DESCRIPTOR_HANDLE counterGpuDescriptor;
+    };
+    static const UINT c_maxPhotonCapacity = 1 << 21;
+    PhotonBufferSet m_photonSets[2];
+    UINT m_photonSet = 0;                               // The set this frame writes.
+    PhotonCapacity m_photonCapacity;
+    ComPtr<ID3D12Resource> m_photonCounterZero;         // Upload heap, a single zero.
+    ComPtr<ID3D12Resource> m_photonCounterReadback;     // One counter per frame in flight.
+    const UINT* m_photonCounterReadbackData = nullptr;
+    bool m_photonCounterPending[FrameCount] = {};
+
+    // How many photons the photon pass emits (the dispatch width), and the radius schedule
+    // the splat kernels shrink by while the camera stays still. The composite pass averages
+    // the frames' splats into m_photonAccumulation.
+    PhotonBudget m_photonBudget;
+    ProgressiveRadius m_photonRadius;
+    ComPtr<ID3D12Resource> m_photonAccumulation;
+    D3D12_GPU_DESCRIPTOR_HANDLE m_photonAccumulationUAVGpuDescriptor;
+    DescriptorHandle m_photonAccumulationUAVDescriptor;
 
     ComPtr<ID3D12Resource> photonBuffer;
-    D3D12_GPU_DESCRIPTOR_HANDLE photonCounterGpuDescriptor;
-    UINT photonCounterDescriptorHeapIndex;
     
     ComPtr<ID3D12Resource> stagingResource;
     D3D12_GPU_DESCRIPTOR_HANDLE stagingGPUDescriptor;
-    UINT stagingCounterDescriptorHeapIndex;
+    DescriptorHandle stagingDescriptor;
 
     ComPtr<ID3D12Resource> lightAccumulationResource;
     D3D12_GPU_DESCRIPTOR_HANDLE lightAccumulationGPUDescriptor;
-    UINT lightAccumulationDescriptorHeapIndex;
+    DescriptorHandle lightAccumulationDescriptor;
 
     ComPtr<ID3D12Resource> forwardAccumulationResource;
     D3D12_GPU_DESCRIPTOR_HANDLE forwardAccumulationGPUDescriptor;
-    UINT forwardAccumulationDescriptorHeapIndex;
+    DescriptorHandle forwardAccumulationDescriptor;
 
     std::vector<IBuffer> intersectionBuffers;
     std::vector<IBuffer> geometryBuffers;
     std::vector<IBuffer> stages;
     std::vector<IBuffer> LightBuffers;
+    DescriptorHandle m_lightBufferDescriptors;         // One block, bound as the LightVertices table.
     std::vector<IBuffer> LightNormals;
     std::vector<IBuffer> LightColours;
     std::vector<IBuffer> LightDirections;
@@ -234,12 +279,12 @@ private:
     // Raytracing output
     ComPtr<ID3D12Resource> m_raytracingOutput;
     D3D12_GPU_DESCRIPTOR_HANDLE m_raytracingOutputResourceUAVGpuDescriptor;
-    UINT m_raytracingOutputResourceUAVDescriptorHeapIndex;
+    DescriptorHandle m_raytracingOutputResourceUAVDescriptor;
 
     //Raster output
     ComPtr<ID3D12Resource> m_rasterOutput;
     D3D12_GPU_DESCRIPTOR_HANDLE m_rasterOutputResourceUAVGPUDescriptor;
-    UINT m_rasterOutputResourceUAVDescriptorHeapIndex;
+    DescriptorHandle m_rasterOutputResourceUAVDescriptor;
     //collection of intersection buffers for writing intersections.
     UINT intersectionIndex = 1;
     // Shader tables
@@ -305,13 +350,28 @@ private:
     DX::GPUTimer m_gpuTimers[GpuTimers::Count];
     StepTimer m_timer;
     float m_animateGeometryTime;
+    float m_materialReloadTime = 0.0f;
+    float m_pointCloudLodTime = 0.0f;
+    bool m_topLevelASPending = false;      // The point cloud selection changed; see UpdatePointCloudLod.
     bool m_animateGeometry;
     bool m_animateLight;
 
+    // Fly-throughs (see CameraPath.h): R starts and stops recording the camera to
+    // c_cameraPathFile, P replays that file one c_cameraReplayTimestep a frame.
+    static const char* c_cameraPathFile;
+    static const double c_cameraReplayTimestep;
+    CameraPath::Recorder m_cameraRecorder;
+    CameraPath::Path m_cameraReplay;
+    bool m_recordingCamera = false;
+    bool m_replayingCamera = false;
+    UINT m_cameraReplayFrame = 0;
+
 	
     void RecreateD3D();
 	void CopyIntersectionToCPU();
     void CopyBackBufferToRasterBuffer();
+    void BuildRenderGraph();
+    bool PhotonMapsThisFrame() const;
     void DoScreenSpacePhotonMapping();
     void DoTiling();
     void CompositeIndirectAndDirectIllumination();
@@ -334,7 +394,6 @@ private:
     void CreateDeviceDependentResources();
     void CreateWindowSizeDependentResources();
 	void CreateTiledPhotonMap();
-	void CreatePhotonCountTest();
     void CreatePhotonCountBuffer();
     void ReleaseDeviceDependentResources();
     void ReleaseWindowSizeDependentResources();
@@ -373,13 +432,17 @@ private:
 	void CreateDescriptorHeap();
 	void CreateBufferForIntersectionData();
 	void CreateRasterisationBuffers();
-    void CreateRasterConstantBuffer();
     void CreateRaytracingOutputResource();
     void CreateRasterOutputResource();
-    void CreateCountBuffer();
-    void CreatePhotonStructuredBuffer();
+    void CreatePhotonBuffers();
+    void ReleasePhotonBuffers();
+    void UpdatePhotonCapacity();
+    void UpdatePhotonBudget();
+    void ClearPhotonCounter();
+    void ReadBackPhotonCounter();
     void CreateComputeConstantBuffer();
     void BuildGeometry();
+    void UploadFrameData();
     void DoRasterisation();
    
    
@@ -388,11 +451,19 @@ private:
     void BuildPhotonShaderTable();
 
     void BuildShaderTables();
+    void BuildAllShaderTables();
+    void ReloadMaterials();
+    void UpdatePointCloudLod();
+    void ToggleCameraRecording();
+    void ToggleCameraReplay();
+    void UpdateCameraPath();
+    void RebuildAccelerationStructure();
+    ShaderTableLayoutDesc SceneShaderTableDesc(const wchar_t* rayGenShader, const wchar_t* const missShaders[RayType::Count]);
     void UpdateForSizeChange(UINT clientWidth, UINT clientHeight);
-	void CopyIntersectionBufferToBackBuffer(UINT intersectionIndex);
-    void CopyGBufferToBackBuffer();
 	void CopyRaytracingOutputToBackbuffer();
     void CalculateFrameStats();
-    UINT AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse = UINT_MAX);
-    UINT CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize);
+    UINT ResourceDescriptorCount() const;
+    DescriptorHandle AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, const DescriptorHandle& previous = DescriptorHandle(), UINT count = 1);
+    void FreeDescriptor(DescriptorHandle& handle);
+    DescriptorHandle CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize);
 };
@@ -27,6 +27,14 @@ XMVECTOR Camera::getDirection() {
     return this->m_direction;
 }
 
+XMMATRIX Camera::getPreviousViewProjection() {
+    return m_previousViewProjection;
+}
+
+float Camera::getPixelsPerRadian(UINT viewportHeight) {
+    return viewportHeight / (2.0f * tanf(XMConvertToRadians(fovAngleY) / 2.0f));
+}
+
 
 void Camera::Update(ConstantBuffer<SceneConstantBuffer> &scene, ConstantBuffer<RasterSceneCB>& m_rasterConstantBuffer)
 {
@@ -36,7 +44,6 @@ void Camera::Update(ConstantBuffer<SceneConstantBuffer> &scene, ConstantBuffer<R
     m_direction = XMVector3Normalize(m_at - m_pos);
     scene->cameraPosition = m_pos;
     XMVECTOR lookAt = { 2.0f, -0.14, 2.0f , 0.0f };
-    float fovAngleY = 45.0f;
     XMMATRIX view = XMMatrixLookAtRH(m_pos, m_at, m_up);
     XMMATRIX proj = XMMatrixPerspectiveFovRH(XMConvertToRadians(fovAngleY), aspectRatio, 0.01f, 1000.0f);
     XMMATRIX viewProj = view * proj;
@@ -44,9 +51,14 @@ void Camera::Update(ConstantBuffer<SceneConstantBuffer> &scene, ConstantBuffer<R
     XMMATRIX viewInverse = XMMatrixInverse(&det, view);
     XMMATRIX projectionInverse = XMMatrixInverse(&det, proj);
     scene->projectionToWorld = XMMatrixInverse(&det, viewProj);
+    m_previousViewProjection = m_hasViewProjection ? m_viewProjection : viewProj;
+    m_viewProjection = viewProj;
+    m_hasViewProjection = true;
 
     m_rasterConstantBuffer->view = view;
     m_rasterConstantBuffer->projection = viewProj;
+    m_rasterConstantBuffer->projectionToWorld = scene->projectionToWorld;
+    m_rasterConstantBuffer->cameraPosition = m_pos;
     // m_rasterConstantBuffer->mvp = viewProj;
     scene->view = view;
     scene->viewInverse = viewInverse;
@@ -88,7 +100,6 @@ void Camera::OnKeyDown(UINT8 key) {
 }
 
 XMMATRIX Camera::getMVP() {
-    float fovAngleY = 45.0f;
 
     XMMATRIX view = XMMatrixLookAtRH(m_pos, m_at, m_up);
     XMMATRIX proj = XMMatrixPerspectiveFovRH(XMConvertToRadians(fovAngleY), aspectRatio, 0.01f, 125.0f);
@@ -124,9 +135,28 @@ void Camera::OnMouseMove(float dx, float dy) {
     if (pitch < -89.0f) {
         pitch = -89.0f;
     }
+    UpdateFront();
+    moving = true;
+}
+
+void Camera::UpdateFront() {
     float pitchRad = XMConvertToRadians(pitch);
     float yawRad = XMConvertToRadians(yaw);
     XMVECTOR new_Front = { cos(pitchRad) * cos(yawRad), sin(pitchRad), cos(pitchRad) * sin(yawRad) };
     m_front = XMVector3Normalize(new_Front);
+}
+
+CameraPath::State Camera::getPathState() {
+    XMFLOAT3 position;
+    XMStoreFloat3(&position, m_pos);
+    CameraPath::State state = { { position.x, position.y, position.z }, yaw, pitch };
+    return state;
+}
+
+void Camera::setPathState(const CameraPath::State& state) {
+    m_pos = XMVectorSet(state.position[0], state.position[1], state.position[2], 0.0f);
+    yaw = state.yaw;
+    pitch = state.pitch;
+    UpdateFront();
     moving = true;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 #include "stdafx.h"
 #include "RaytracingSceneDefines.h"
+#include "CameraPath.h"
 
 struct RasterSceneCB {
 	//XMMATRIX mvp;
 	XMMATRIX view;
 	XMMATRIX projection;
+	XMMATRIX projectionToWorld;	// With cameraPosition, rebuilds G-buffer positions from their depth.
+	XMVECTOR cameraPosition;
+	float photonRadiusScale;	// Progressive photon mapping shrinks the splat kernels by this each frame.
+	XMFLOAT3 padding;
 };
 class Camera
 {
@@ -21,6 +26,10 @@ private:
 	XMVECTOR m_cameraUp;
 
 	XMMATRIX view;
+	// The last two Update calls' view-projections, for reprojecting history (see CpuReprojection.h).
+	XMMATRIX m_viewProjection;
+	XMMATRIX m_previousViewProjection;
+	bool m_hasViewProjection = false;
 	//camera input variables
 	UINT lastX = 400;
 	UINT lastY = 300;
@@ -30,7 +39,10 @@ private:
 	float speed = 0.2f;
 
 	float aspectRatio;
+	const float fovAngleY = 45.0f;	// Vertical, in degrees.
 
+	// Points m_front along yaw and pitch.
+	void UpdateFront();
 
 public:
 	bool moving = false;
@@ -46,6 +58,14 @@ public:
 	XMVECTOR getPosition();
 
 	XMVECTOR getDirection();
+	// The view-projection of the frame before the last Update; the current one on the first.
+	XMMATRIX getPreviousViewProjection();
+	float getFovY() const { return fovAngleY; }
+	// What a camera path records and replays. Setting a state counts as moving.
+	CameraPath::State getPathState();
+	void setPathState(const CameraPath::State& state);
+	// Screen pixels covered by one radian at the centre of a viewport this tall.
+	float getPixelsPerRadian(UINT viewportHeight);
 	
 
 };
@@ -0,0 +1,184 @@
+#include "CameraPath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace CameraPath {
+
+    namespace {
+        const uint32_t Components = 5;     // Position, yaw and pitch.
+
+        bool Fail(std::string* error, const std::string& message)
+        {
+            if (error) {
+                *error = message;
+            }
+            return false;
+        }
+
+        float Component(const State& state, uint32_t c)
+        {
+            return c < 3 ? state.position[c] : (c == 3 ? state.yaw : state.pitch);
+        }
+
+        void SetComponent(State& state, uint32_t c, float value)
+        {
+            if (c < 3) {
+                state.position[c] = value;
+            }
+            else if (c == 3) {
+                state.yaw = value;
+            }
+            else {
+                state.pitch = value;
+            }
+        }
+    }
+
+    bool operator==(const State& a, const State& b)
+    {
+        return a.position[0] == b.position[0] && a.position[1] == b.position[1] && a.position[2] == b.position[2] &&
+            a.yaw == b.yaw && a.pitch == b.pitch;
+    }
+
+    void Recorder::Start(float fovY)
+    {
+        m_keys.clear();
+        m_fovY = fovY;
+        m_started = false;
+    }
+
+    void Recorder::Record(double time, const State& state)
+    {
+        if (!m_started) {
+            m_started = true;
+            m_start = time;
+            m_lastTime = time;
+            Key key = { 0.0f, state };
+            m_keys.push_back(key);
+            return;
+        }
+        if (state != m_keys.back().state) {
+            float still = static_cast<float>(m_lastTime - m_start);
+            if (still > m_keys.back().time) {
+                Key hold = { still, m_keys.back().state };
+                m_keys.push_back(hold);
+            }
+            Key key = { static_cast<float>(time - m_start), state };
+            m_keys.push_back(key);
+        }
+        m_lastTime = time;
+    }
+
+    bool Recorder::Save(const std::string& path, std::string* error) const
+    {
+        std::vector<Key> keys = m_keys;
+        // A recording that ends still keeps the pause, so the replay lasts as long.
+        float end = static_cast<float>(m_lastTime - m_start);
+        if (!keys.empty() && end > keys.back().time) {
+            Key hold = { end, keys.back().state };
+            keys.push_back(hold);
+        }
+
+        Header header = { Magic, Version, static_cast<uint32_t>(keys.size()), m_fovY };
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(Key));
+        return static_cast<bool>(out) || Fail(error, "can't write " + path);
+    }
+
+    bool Path::Load(const std::string& path, std::string* error)
+    {
+        m_keys.clear();
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            return Fail(error, "can't read " + path);
+        }
+        std::streamoff size = in.tellg();
+        in.seekg(0);
+        Header header;
+        if (size < static_cast<std::streamoff>(sizeof(Header)) || !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return Fail(error, path + " is truncated");
+        }
+        if (header.magic != Magic) {
+            return Fail(error, path + " is not a camera path");
+        }
+        if (header.version != Version) {
+            return Fail(error, "camera path is version " + std::to_string(header.version) + ", expected " + std::to_string(Version));
+        }
+        if (static_cast<uint64_t>(size) != sizeof(Header) + static_cast<uint64_t>(header.keyCount) * sizeof(Key)) {
+            return Fail(error, path + " is truncated");
+        }
+        std::vector<Key> keys(header.keyCount);
+        if (!keys.empty() && !in.read(reinterpret_cast<char*>(keys.data()), keys.size() * sizeof(Key))) {
+            return Fail(error, path + " is truncated");
+        }
+        for (size_t i = 1; i < keys.size(); i++) {
+            if (!(keys[i].time >= keys[i - 1].time)) {
+                return Fail(error, path + ": key " + std::to_string(i) + " is out of time order");
+            }
+        }
+        Assign(keys, header.fovY);
+        return true;
+    }
+
+    void Path::Assign(const std::vector<Key>& keys, float fovY)
+    {
+        m_keys = keys;
+        m_fovY = fovY;
+    }
+
+    uint32_t Path::FrameCount(double timestep) const
+    {
+        if (m_keys.empty() || timestep <= 0) {
+            return 0;
+        }
+        return static_cast<uint32_t>(std::ceil(Duration() / timestep)) + 1;
+    }
+
+    State Path::Sample(double time) const
+    {
+        if (m_keys.empty()) {
+            State still = {};
+            return still;
+        }
+        float t = static_cast<float>(time);
+        if (m_keys.size() == 1 || t <= m_keys.front().time) {
+            return m_keys.front().state;
+        }
+        if (t >= m_keys.back().time) {
+            return m_keys.back().state;
+        }
+
+        // Segment k to k + 1 contains t.
+        size_t k = std::upper_bound(m_keys.begin(), m_keys.end(), t, [](float value, const Key& key) { return value < key.time; }) - m_keys.begin() - 1;
+        const Key& k0 = m_keys[k];
+        const Key& k1 = m_keys[k + 1];
+        float h = k1.time - k0.time;
+        if (h <= 0) {
+            return k1.state;
+        }
+        float s = (t - k0.time) / h;
+        float s2 = s * s, s3 = s2 * s;
+        float h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s, h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+
+        State state;
+        for (uint32_t c = 0; c < Components; c++) {
+            // Tangents in units per second, from the neighbouring keys. A component that holds
+            // still across a key has a flat tangent there, so pauses don't overshoot.
+            float tangent[2];
+            for (uint32_t e = 0; e < 2; e++) {
+                size_t i = k + e;
+                size_t before = i > 0 ? i - 1 : i;
+                size_t after = i + 1 < m_keys.size() ? i + 1 : i;
+                float p = Component(m_keys[i].state, c);
+                float span = m_keys[after].time - m_keys[before].time;
+                bool held = (before != i && Component(m_keys[before].state, c) == p) || (after != i && Component(m_keys[after].state, c) == p);
+                tangent[e] = held || span <= 0 ? 0.0f : (Component(m_keys[after].state, c) - Component(m_keys[before].state, c)) / span;
+            }
+            SetComponent(state, c, h00 * Component(k0.state, c) + h10 * h * tangent[0] + h01 * Component(k1.state, c) + h11 * h * tangent[1]);
+        }
+        return state;
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CameraPath.h
+//
+// Recorded fly-throughs, so performance can be compared between builds on the same camera
+// motion. A path is the camera's state (position, yaw and pitch, as Camera keeps them) at
+// the times it changed while recording; a still camera adds nothing. Saved as a small header
+// and an array of 24-byte keys. Replay samples the path at fixed timesteps, never the wall
+// clock, with a cubic spline through the keys, so every replay of a file visits the same
+// camera states whatever the frame rate. Nothing here depends on D3D12: Camera reads and
+// writes states, and CpuCameraReplay.h turns them into CPU tracer cameras.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CameraPath {
+
+    static const uint32_t Magic = 0x4d414348;   // "HCAM"
+    static const uint32_t Version = 1;
+
+    struct State {
+        float position[3];
+        float yaw;              // Degrees, unwrapped, as Camera accumulates it.
+        float pitch;            // Degrees.
+    };
+
+    struct Key {
+        float time;             // Seconds from the start of the recording.
+        State state;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t keyCount;
+        float fovY;             // Degrees, vertical; the aspect ratio is the player's.
+    };
+
+    bool operator==(const State& a, const State& b);
+    inline bool operator!=(const State& a, const State& b) { return !(a == b); }
+
+    class Recorder
+    {
+    public:
+        // Forgets what was recorded; the next Record call is time zero.
+        void Start(float fovY);
+        // The camera's state at time seconds (any clock). Stores a key only when the state
+        // changed; when the camera moves again after standing still, the last state is keyed
+        // at the last still time too, so the spline holds still over the pause.
+        void Record(double time, const State& state);
+
+        bool Save(const std::string& path, std::string* error = nullptr) const;
+        const std::vector<Key>& Keys() const { return m_keys; }
+
+    private:
+        std::vector<Key> m_keys;
+        float m_fovY = 45.0f;
+        double m_start = 0;
+        double m_lastTime = 0;          // Of the last Record call.
+        bool m_started = false;
+    };
+
+    class Path
+    {
+    public:
+        bool Load(const std::string& path, std::string* error = nullptr);
+        // Takes keys already in memory, in time order.
+        void Assign(const std::vector<Key>& keys, float fovY);
+
+        bool Empty() const { return m_keys.empty(); }
+        float Duration() const { return m_keys.empty() ? 0.0f : m_keys.back().time; }
+        float FovY() const { return m_fovY; }
+        const std::vector<Key>& Keys() const { return m_keys; }
+
+        // Frames a replay at this timestep takes, the first at time zero and the last at or
+        // past the end.
+        uint32_t FrameCount(double timestep) const;
+        // The state at time seconds, clamped to the path. Each component follows a cubic
+        // Hermite spline through the keys, with Catmull-Rom tangents scaled by the uneven
+        // key spacing.
+        State Sample(double time) const;
+
+    private:
+        std::vector<Key> m_keys;
+        float m_fovY = 45.0f;
+    };
+}
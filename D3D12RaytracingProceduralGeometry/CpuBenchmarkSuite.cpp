@@ -0,0 +1,1062 @@
+#include "CpuBenchmarkSuite.h"
+#include "CpuBvh8.h"
+#include "CpuCameraReplay.h"
+#include "CpuDenoiser.h"
+#include "CpuDynamicBvh.h"
+#include "CpuGBuffer.h"
+#include "CpuPhotonEncoding.h"
+#include "CpuPhotonGrid.h"
+#include "CpuPhotons.h"
+#include "CpuProgressivePhotons.h"
+#include "CpuReprojection.h"
+#include "PointCloudLod.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const uint32_t ReportVersion = 2;
+        const float FovY = 45.0f;                  // Camera's.
+
+        const char* const sceneNames[BenchmarkScene::Count] = {
+            "analytic_quadrics", "cornell_box", "csg_mug", "quaternion_julia", "signed_distance",
+            "triangle_mesh", "instancing", "photon_mapping",
+        };
+
+        const char* const subsystemNames[BenchmarkSubsystem::Count] = {
+            "bvh_update", "bvh8", "point_cloud_lod", "photon_storage", "photon_encoding", "photon_grid",
+            "gbuffer", "denoiser", "reprojection", "execution_modes",
+        };
+
+        const char* const modeNames[ExecutionMode::Count] = { "recursive", "wavefront", "queued" };
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        uint64_t ProcessPeakBytes()
+        {
+#ifdef _WIN32
+            PROCESS_MEMORY_COUNTERS counters;
+            return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+            rusage usage;
+            return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<uint64_t>(usage.ru_maxrss) * 1024 : 0;    // Kilobytes on Linux.
+#endif
+        }
+
+        Material MakeMaterial(const float3& albedo, float reflectance, float refraction, float diffuse, float specular, float power)
+        {
+            Material m = { albedo, reflectance, refraction, diffuse, specular, power };
+            return m;
+        }
+
+        float4x4 Place(const float3& position, const float3& scale)
+        {
+            return mul(float4x4::Scaling(scale), float4x4::Translation(position));
+        }
+
+        void AddQuad(Scene& scene, const float3& a, const float3& b, const float3& c, const float3& d, uint32_t material)
+        {
+            const float3 positions[4] = { a, b, c, d };
+            const uint32_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+            scene.AddMesh(positions, indices, 6, material);
+        }
+
+        void AddFloor(Scene& scene, float height, float size, uint32_t material)
+        {
+            scene.AddProcedural(PrimitiveType::Plane, Place(float3(0, height, 0), float3(size, 1, size)), material);
+        }
+
+        void SetLight(Scene& scene, const float3& position, float power)
+        {
+            scene.light.position = position;
+            scene.light.power = power;
+            scene.light.colour = float3(1.0f);
+        }
+
+        CameraPath::State View(float x, float y, float z, float yaw, float pitch)
+        {
+            CameraPath::State state = { { x, y, z }, yaw, pitch };
+            return state;
+        }
+
+        // A 10-unit box open towards -z, red on the left and green on the right.
+        CameraPath::State BuildCornellBox(Scene& scene)
+        {
+            uint32_t white = scene.AddMaterial(MakeMaterial(float3(0.75f), 0, 0, 1, 0, 1));
+            uint32_t red = scene.AddMaterial(MakeMaterial(float3(0.75f, 0.1f, 0.1f), 0, 0, 1, 0, 1));
+            uint32_t green = scene.AddMaterial(MakeMaterial(float3(0.1f, 0.75f, 0.1f), 0, 0, 1, 0, 1));
+            uint32_t glass = scene.AddMaterial(MakeMaterial(float3(1.0f), 0, 1.5f, 0, 1, 50));
+            uint32_t box = scene.AddMaterial(MakeMaterial(float3(0.7f), 0, 0, 1, 0.4f, 50));
+            float3 p[8] = {
+                float3(-5, 0, -5), float3(5, 0, -5), float3(5, 0, 5), float3(-5, 0, 5),
+                float3(-5, 10, -5), float3(5, 10, -5), float3(5, 10, 5), float3(-5, 10, 5),
+            };
+            AddQuad(scene, p[0], p[1], p[2], p[3], white);         // Floor.
+            AddQuad(scene, p[4], p[7], p[6], p[5], white);         // Ceiling.
+            AddQuad(scene, p[3], p[2], p[6], p[7], white);         // Back.
+            AddQuad(scene, p[0], p[3], p[7], p[4], red);
+            AddQuad(scene, p[1], p[5], p[6], p[2], green);
+            scene.AddProcedural(PrimitiveType::Box, mul(mul(float4x4::Scaling(float3(1.4f, 2.8f, 1.4f)), float4x4::RotationY(0.4f)), float4x4::Translation(float3(-2, 2.8f, 1.5f))), box);
+            scene.AddProcedural(PrimitiveType::Sphere, Place(float3(2, 1.6f, -1), float3(1.6f)), glass);
+            SetLight(scene, float3(0, 9, 0), 150.0f);
+            return View(0, 5, -15, 90, 0);
+        }
+
+        CameraPath::State BuildScene(BenchmarkScene::Enum which, Scene& scene)
+        {
+            uint32_t seed = 0x5eed0000u + which;
+            switch (which) {
+            case BenchmarkScene::AnalyticQuadrics: {
+                const PrimitiveType::Enum types[] = {
+                    PrimitiveType::Sphere, PrimitiveType::Ellipsoid, PrimitiveType::Hyperboloid,
+                    PrimitiveType::Cylinder, PrimitiveType::Paraboloid, PrimitiveType::Cone,
+                };
+                uint32_t materials[3] = {
+                    scene.AddMaterial(MakeMaterial(float3(0.8f, 0.5f, 0.3f), 0, 0, 1, 0.5f, 20)),
+                    scene.AddMaterial(MakeMaterial(float3(0.9f), 0.8f, 0, 0, 1, 50)),
+                    scene.AddMaterial(MakeMaterial(float3(1.0f), 0, 1.5f, 0, 1, 50)),
+                };
+                for (int z = 0; z < 5; z++) {
+                    for (int x = 0; x < 5; x++) {
+                        int i = z * 5 + x;
+                        scene.AddProcedural(types[i % 6], Place(float3((x - 2) * 3.0f, 0.8f, (z - 2) * 3.0f), float3(0.7f)), materials[(x + z) % 3]);
+                    }
+                }
+                AddFloor(scene, -1.0f, 20.0f, scene.AddMaterial(MakeMaterial(float3(0.6f), 0, 0, 1, 0.2f, 10)));
+                SetLight(scene, float3(0, 12, -6), 500.0f);
+                return View(0, 7, -16, 90, -22);
+            }
+            case BenchmarkScene::CornellBox:
+                return BuildCornellBox(scene);
+            case BenchmarkScene::CsgMug: {
+                CsgTree mug = CsgTree::CoffeeMug();
+                Aabb bounds = mug.LocalBounds();
+                scene.AddCsg(mug, float4x4::Scaling(float3(1.5f)), scene.AddMaterial(MakeMaterial(float3(0.6f, 0, 0), 0, 1.7f, 0, 1, 50)));
+                AddFloor(scene, bounds.lower.y * 1.5f, 20.0f, scene.AddMaterial(MakeMaterial(float3(0.6f), 0, 0, 1, 0.4f, 50)));
+                SetLight(scene, float3(10, 10, -10), 600.0f);
+                return View(0, 4, -9, 90, -20);
+            }
+            case BenchmarkScene::QuaternionJulia: {
+                scene.AddProcedural(PrimitiveType::QuaternionJulia, Place(float3(0, 1, 0), float3(2.0f)), scene.AddMaterial(MakeMaterial(float3(0.3f, 0.6f, 0.9f), 0, 0, 1, 0.5f, 30)));
+                AddFloor(scene, -3.0f, 20.0f, scene.AddMaterial(MakeMaterial(float3(0.6f), 0, 0, 1, 0, 1)));
+                SetLight(scene, float3(5, 12, -8), 500.0f);
+                return View(0, 2, -12, 90, -8);
+            }
+            case BenchmarkScene::SignedDistance: {
+                uint32_t material = scene.AddMaterial(MakeMaterial(float3(0.9f, 0.7f, 0.2f), 0, 0, 1, 0.6f, 40));
+                for (int i = 0; i < 8; i++) {
+                    float angle = i * Pi / 4;
+                    scene.AddProcedural(PrimitiveType::Torus, Place(float3(4 * std::cos(angle), 4 * std::sin(angle), 0), float3(1.6f)), material);
+                }
+                AddFloor(scene, -6.5f, 20.0f, scene.AddMaterial(MakeMaterial(float3(0.6f), 0, 0, 1, 0, 1)));
+                SetLight(scene, float3(0, 10, -10), 600.0f);
+                return View(0, 0, -15, 90, 0);
+            }
+            case BenchmarkScene::TriangleMesh: {
+                // A sphere with ripples, 100 x 100 quads.
+                const uint32_t rings = 100, segments = 100;
+                std::vector<float3> positions;
+                for (uint32_t r = 0; r <= rings; r++) {
+                    float theta = Pi * r / rings;
+                    for (uint32_t s = 0; s <= segments; s++) {
+                        float phi = 2 * Pi * s / segments;
+                        float radius = 3.0f * (1.0f + 0.08f * std::sin(6 * theta) * std::sin(6 * phi));
+                        positions.push_back(float3(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi)));
+                    }
+                }
+                std::vector<uint32_t> indices;
+                for (uint32_t r = 0; r < rings; r++) {
+                    for (uint32_t s = 0; s < segments; s++) {
+                        uint32_t a = r * (segments + 1) + s, b = a + segments + 1;
+                        uint32_t quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+                        indices.insert(indices.end(), quad, quad + 6);
+                    }
+                }
+                scene.AddMesh(positions.data(), indices.data(), indices.size(), scene.AddMaterial(MakeMaterial(float3(0.8f, 0.8f, 0.8f), 0.3f, 0, 0.7f, 0.6f, 40)));
+                AddFloor(scene, -3.5f, 20.0f, scene.AddMaterial(MakeMaterial(float3(0.6f), 0, 0, 1, 0, 1)));
+                SetLight(scene, float3(6, 10, -8), 500.0f);
+                return View(0, 1, -10, 90, -5);
+            }
+            case BenchmarkScene::Instancing: {
+                // Spheres and boxes jittered over rolling ground, like albany's point cloud.
+                uint32_t materials[2] = {
+                    scene.AddMaterial(MakeMaterial(float3(0.7f, 0.6f, 0.5f), 0, 0, 1, 0.2f, 10)),
+                    scene.AddMaterial(MakeMaterial(float3(0.4f, 0.5f, 0.7f), 0, 0, 1, 0.2f, 10)),
+                };
+                const uint32_t side = 142;      // About 20,000 instances.
+                for (uint32_t z = 0; z < side; z++) {
+                    for (uint32_t x = 0; x < side; x++) {
+                        float px = (x + seed_xorshift(seed)) / side * 100.0f - 50.0f;
+                        float pz = (z + seed_xorshift(seed)) / side * 100.0f - 50.0f;
+                        float py = 3.0f * std::sin(px * 0.1f) * std::cos(pz * 0.13f) + seed_xorshift(seed);
+                        uint32_t kind = (x + z) & 1;
+                        scene.AddProcedural(kind ? PrimitiveType::Box : PrimitiveType::Sphere, Place(float3(px, py, pz), float3(0.25f + 0.1f * seed_xorshift(seed))), materials[kind]);
+                    }
+                }
+                AddFloor(scene, -4.0f, 60.0f, scene.AddMaterial(MakeMaterial(float3(0.5f), 0, 0, 1, 0, 1)));
+                SetLight(scene, float3(0, 40, -20), 8000.0f);
+                return View(0, 25, -65, 90, -25);
+            }
+            case BenchmarkScene::PhotonMapping:
+            default:
+                return BuildCornellBox(scene);
+            }
+        }
+
+        uint64_t SceneBytes(const Scene& scene)
+        {
+            uint64_t bytes = scene.materials.size() * sizeof(Material) + scene.primitives.size() * sizeof(Primitive) + scene.triangles.size() * sizeof(Triangle);
+            for (const CsgTree& tree : scene.csgTrees) {
+                bytes += sizeof(CsgTree) + tree.nodes.size() * sizeof(CsgNode);
+            }
+            return bytes;
+        }
+
+        double Median(std::vector<double> values)
+        {
+            if (values.empty()) {
+                return 0;
+            }
+            std::sort(values.begin(), values.end());
+            return values[values.size() / 2];
+        }
+
+        void RunScene(BenchmarkScene::Enum which, const BenchmarkSuiteSettings& settings, SceneBenchmark& result)
+        {
+            Scene scene;
+            CameraPath::State view = BuildScene(which, scene);
+            CameraParams camera = CameraFromPathState(view, FovY, static_cast<float>(settings.width) / settings.height);
+            result.name = sceneNames[which];
+            result.primitives = static_cast<uint32_t>(scene.primitives.size());
+
+            Clock::time_point start = Clock::now();
+            Bvh bvh;
+            bvh.Build(scene.PrimitiveBounds());
+            result.buildMs = SecondsSince(start) * 1000.0;
+
+            Framebuffer framebuffer;
+            framebuffer.Resize(settings.width, settings.height);
+            uint64_t photonBytes = 0;
+            std::vector<double> times;
+            uint64_t work = 0;
+            double seconds = 0;
+            if (which == BenchmarkScene::PhotonMapping) {
+                ProgressivePhotonSettings photonSettings;
+                photonSettings.width = settings.width;
+                photonSettings.height = settings.height;
+                photonSettings.photonsPerPass = settings.photonsPerPass;
+                photonSettings.threads = settings.threads;
+                ProgressivePhotonMapper mapper(scene, bvh, std::vector<Light>(1, scene.light), photonSettings);
+                mapper.Reset(camera);
+                ProgressivePhotonStats stats;
+                for (uint32_t pass = 0; pass < settings.warmupFrames + settings.frames; pass++) {
+                    double before = stats.emitSeconds + stats.gatherSeconds;
+                    uint64_t emitted = stats.emitted;
+                    mapper.RenderPass(stats);
+                    if (pass >= settings.warmupFrames) {
+                        double passSeconds = stats.emitSeconds + stats.gatherSeconds - before;
+                        times.push_back(passSeconds);
+                        seconds += passSeconds;
+                        work += stats.emitted - emitted;
+                    }
+                    photonBytes = (std::max)(photonBytes, static_cast<uint64_t>(stats.photonBytes));
+                }
+                mapper.Resolve(framebuffer);
+            }
+            else {
+                Tracer tracer(scene, bvh);
+                RenderSettings render;
+                render.mode = settings.mode;
+                render.spp = settings.spp;
+                render.threads = settings.threads;
+                for (uint32_t frame = 0; frame < settings.warmupFrames + settings.frames; frame++) {
+                    render.frameIndex = frame;
+                    RenderStats stats;
+                    tracer.Render(camera, render, framebuffer, stats);
+                    if (frame >= settings.warmupFrames) {
+                        times.push_back(stats.totalSeconds);
+                        seconds += stats.totalSeconds;
+                        for (uint32_t bounce = 0; bounce < MaxTrackedBounces; bounce++) {
+                            work += stats.rays[bounce];
+                        }
+                        work += stats.shadowRays;
+                    }
+                }
+            }
+
+            result.msPerFrame = Median(times) * 1000.0;
+            result.minMsPerFrame = times.empty() ? 0 : *std::min_element(times.begin(), times.end()) * 1000.0;
+            result.raysPerSecond = seconds > 0 ? work / seconds : 0;
+            result.raysPerFrame = times.empty() ? 0 : static_cast<double>(work) / times.size();
+            result.memoryBytes = SceneBytes(scene) + bvh.MemoryFootprint() + framebuffer.pixels.size() * sizeof(float3) + photonBytes;
+            result.checksum = FramebufferChecksum(framebuffer);
+        }
+
+        void AddMetric(SubsystemBenchmark& result, const char* name, double value, bool higherIsWorse)
+        {
+            BenchmarkMetric metric = { name, value, higherIsWorse };
+            result.metrics.push_back(metric);
+        }
+
+        // A scan-like cloud: points on rolling ground 40 units across, with a little noise.
+        std::vector<float> SyntheticPointCloud(uint32_t count, uint32_t seed)
+        {
+            std::vector<float> positions;
+            positions.reserve(3 * count);
+            for (uint32_t i = 0; i < count; i++) {
+                float x = seed_xorshift(seed) * 40.0f - 20.0f;
+                float z = seed_xorshift(seed) * 40.0f - 20.0f;
+                float y = 2.0f * std::sin(x * 0.3f) * std::cos(z * 0.2f) + 0.05f * seed_xorshift(seed);
+                positions.push_back(x);
+                positions.push_back(y);
+                positions.push_back(z);
+            }
+            return positions;
+        }
+
+        // Sizes are fixed so runs compare; the image-space ones follow the suite's resolution.
+        void RunSubsystem(BenchmarkSubsystem::Enum which, const BenchmarkSuiteSettings& settings, SubsystemBenchmark& result)
+        {
+            const double ms = 1000.0;
+            const uint32_t queries = 10000;
+            const float radius = 0.25f;         // A fortieth of the Cornell box.
+            result.name = subsystemNames[which];
+
+            if (which == BenchmarkSubsystem::BvhUpdate) {
+                BvhUpdateBenchmarkResult bvh = BenchmarkBvhUpdate(20000, 60, 0.1f);
+                AddMetric(result, "buildMs", bvh.buildSeconds * ms, true);
+                AddMetric(result, "averageUpdateMs", bvh.averageUpdateSeconds * ms, true);
+                AddMetric(result, "maxUpdateMs", bvh.maxUpdateSeconds * ms, true);
+                AddMetric(result, "rebuilds", bvh.rebuilds, true);
+                std::ostringstream out;
+                out << std::fixed << std::setprecision(3) << bvh.instanceCount << " instances, " << bvh.frames << " frames | build "
+                    << bvh.buildSeconds * ms << " ms | update " << bvh.averageUpdateSeconds * ms << " ms, max " << bvh.maxUpdateSeconds * ms
+                    << " ms | " << bvh.rebuilds << " rebuilds";
+                result.summary = out.str();
+                return;
+            }
+            if (which == BenchmarkSubsystem::PointCloudLod) {
+                std::vector<float> positions = SyntheticPointCloud(200000, 0x5eed1000u);
+                PointCloudLodSettings lodSettings;
+                lodSettings.pointSize = 0.05f;
+                PointCloudLodBenchmarkResult lod = BenchmarkPointCloudLod(positions.data(), positions.size() / 3, lodSettings, 1000.0f, 4.0f, 8, settings.threads);
+                AddMetric(result, "lodBuildMs", lod.lodBuildSeconds * ms, true);
+                AddMetric(result, "selectMs", lod.selectSeconds * ms, true);
+                AddMetric(result, "selectedBvhMs", lod.selectedBvhSeconds * ms, true);
+                AddMetric(result, "selectedInstances", lod.selectedInstances, true);
+                AddMetric(result, "lodBytes", static_cast<double>(lod.lodBytes), true);
+                result.summary = PointCloudLodBenchmarkSummary(lod);
+                return;
+            }
+
+            Scene scene;
+            CameraPath::State view = BuildScene(which == BenchmarkSubsystem::Bvh8 ? BenchmarkScene::Instancing : BenchmarkScene::CornellBox, scene);
+            CameraParams camera = CameraFromPathState(view, FovY, static_cast<float>(settings.width) / settings.height);
+            Bvh bvh;
+            bvh.Build(scene.PrimitiveBounds());
+
+            switch (which) {
+            case BenchmarkSubsystem::Bvh8: {
+                CompressedBvh8 bvh8;
+                bvh8.Build(bvh);
+                std::vector<Ray> rays;
+                rays.reserve(settings.width * settings.height);
+                for (uint32_t y = 0; y < settings.height; y++) {
+                    for (uint32_t x = 0; x < settings.width; x++) {
+                        rays.push_back(GenerateCameraRay(x, y, settings.width, settings.height, camera));
+                    }
+                }
+                Bvh8BenchmarkResult wide = BenchmarkBvh8(scene, bvh, bvh8, rays, settings.threads);
+                AddMetric(result, "binaryRaysPerSecond", wide.binaryRaysPerSecond, false);
+                AddMetric(result, "compressedRaysPerSecond", wide.compressedRaysPerSecond, false);
+                AddMetric(result, "compressedBytes", static_cast<double>(wide.compressedBytes), true);
+                AddMetric(result, "mismatches", wide.mismatches, true);
+                result.summary = Bvh8BenchmarkSummary(wide);
+                break;
+            }
+            case BenchmarkSubsystem::PhotonStorage: {
+                PhotonStorageBenchmarkResult storage = BenchmarkPhotonStorage(scene, bvh, settings.photonsPerPass, settings.frames, settings.threads);
+                AddMetric(result, "appendsPerSecond", storage.appendsPerSecond, false);
+                AddMetric(result, "batchedAppendsPerSecond", storage.batchedAppendsPerSecond, false);
+                AddMetric(result, "emittedPerSecond", storage.emittedPerSecond, false);
+                AddMetric(result, "storeBytes", static_cast<double>(storage.storeBytes), true);
+                result.summary = PhotonStorageBenchmarkSummary(storage);
+                break;
+            }
+            case BenchmarkSubsystem::PhotonEncoding: {
+                PhotonEncodingBenchmarkResult encoding = BenchmarkPhotonEncoding(scene, bvh, settings.photonsPerPass, queries, radius, settings.threads);
+                AddMetric(result, "encodedPerSecond", encoding.encodedPerSecond, false);
+                AddMetric(result, "fullGatherMs", encoding.fullGatherSeconds * ms, true);
+                AddMetric(result, "packedGatherMs", encoding.packedGatherSeconds * ms, true);
+                AddMetric(result, "estimateRelativeError", encoding.estimateRelativeError, true);
+                result.summary = PhotonEncodingBenchmarkSummary(encoding);
+                break;
+            }
+            case BenchmarkSubsystem::PhotonGrid: {
+                PhotonGridBenchmarkResult grid = BenchmarkPhotonGrid(scene, bvh, 10 * settings.photonsPerPass, queries, radius, settings.threads);
+                AddMetric(result, "gridBuildMs", grid.gridBuildSeconds * ms, true);
+                AddMetric(result, "gridQueryMs", grid.gridQuerySeconds * ms, true);
+                AddMetric(result, "treeBuildMs", grid.treeBuildSeconds * ms, true);
+                AddMetric(result, "treeQueryMs", grid.treeQuerySeconds * ms, true);
+                AddMetric(result, "gridBytes", static_cast<double>(grid.gridBytes), true);
+                AddMetric(result, "mismatches", grid.mismatches, true);
+                result.summary = PhotonGridBenchmarkSummary(grid);
+                break;
+            }
+            case BenchmarkSubsystem::GBuffer: {
+                GBufferBenchmarkResult gbuffer = BenchmarkGBuffer(scene, bvh, camera, settings.width, settings.height, 5, settings.threads);
+                AddMetric(result, "fullShadeMs", gbuffer.fullShadeSeconds * ms, true);
+                AddMetric(result, "packedShadeMs", gbuffer.packedShadeSeconds * ms, true);
+                AddMetric(result, "packedBytes", static_cast<double>(gbuffer.packedBytes), true);
+                AddMetric(result, "shadedRelativeError", gbuffer.shadedRelativeError, true);
+                result.summary = GBufferBenchmarkSummary(gbuffer);
+                break;
+            }
+            case BenchmarkSubsystem::Denoiser: {
+                DenoiserBenchmarkResult denoiser = BenchmarkDenoiser(scene, bvh, camera, settings.width, settings.height, 8, 0.05f, 32, settings.threads);
+                AddMetric(result, "denoiseMs", denoiser.denoiseSeconds * ms, true);
+                AddMetric(result, "denoisedRmse", denoiser.denoisedRmse, true);
+                result.summary = DenoiserBenchmarkSummary(denoiser);
+                break;
+            }
+            case BenchmarkSubsystem::ExecutionModes: {
+                // Every mode clocks its intersect stage, recursive mode a ray at a time, so the
+                // rates compare; bounce 2 on is where the modes differ in how they batch rays.
+                Tracer tracer(scene, bvh);
+                RenderSettings render;
+                render.spp = settings.spp;
+                render.threads = settings.threads;
+                render.timeRecursiveRays = true;
+                Framebuffer framebuffer;
+                framebuffer.Resize(settings.width, settings.height);
+                std::ostringstream out;
+                out << std::fixed << std::setprecision(2) << settings.frames << " frames, bounces 2 on";
+                for (uint32_t m = 0; m < ExecutionMode::Count; m++) {
+                    render.mode = static_cast<ExecutionMode::Enum>(m);
+                    RenderStats total;
+                    double seconds = 0;
+                    for (uint32_t frame = 0; frame < settings.warmupFrames + settings.frames; frame++) {
+                        render.frameIndex = frame;
+                        RenderStats stats;
+                        tracer.Render(camera, render, framebuffer, stats);
+                        if (frame >= settings.warmupFrames) {
+                            total.Merge(stats);
+                            seconds += stats.totalSeconds;
+                        }
+                    }
+                    double raysPerSecond = total.RaysPerSecondFrom(2);
+                    AddMetric(result, (std::string(modeNames[m]) + "RaysPerSecondFrom2").c_str(), raysPerSecond, false);
+                    out << " | " << modeNames[m] << " " << raysPerSecond / 1e6 << " Mrays/s, "
+                        << seconds * ms / settings.frames << " ms a frame";
+                }
+                result.summary = out.str();
+                break;
+            }
+            case BenchmarkSubsystem::Reprojection:
+            default: {
+                ReprojectionBenchmarkResult reprojection = BenchmarkReprojection(scene, bvh, camera, settings.width, settings.height, 16, 0.02f, 32, settings.threads);
+                AddMetric(result, "motionMs", reprojection.motionSeconds * ms, true);
+                AddMetric(result, "accumulateMs", reprojection.accumulateSeconds * ms, true);
+                AddMetric(result, "reprojectedRmse", reprojection.reprojectedRmse, true);
+                result.summary = ReprojectionBenchmarkSummary(reprojection);
+                break;
+            }
+            }
+        }
+
+        // Just enough JSON to read back what BenchmarkReportJson writes: objects, arrays,
+        // strings without escapes beyond \" and \\, numbers and literals.
+        class JsonReader
+        {
+        public:
+            explicit JsonReader(const std::string& text) : m_text(text) {}
+
+            bool Failed() const { return m_failed; }
+            const std::string& Error() const { return m_error; }
+
+            bool Peek(char c)
+            {
+                SkipSpace();
+                return m_pos < m_text.size() && m_text[m_pos] == c;
+            }
+
+            bool Expect(char c)
+            {
+                if (Peek(c)) {
+                    m_pos++;
+                    return true;
+                }
+                return Fail(std::string("expected '") + c + "'");
+            }
+
+            // Iterates members: call with first = true, then false until it returns false.
+            bool NextMember(bool first, std::string& key)
+            {
+                if (Peek('}')) {
+                    m_pos++;
+                    return false;
+                }
+                if (!first && !Expect(',')) {
+                    return false;
+                }
+                return String(key) && Expect(':');
+            }
+
+            bool NextItem(bool first)
+            {
+                if (Peek(']')) {
+                    m_pos++;
+                    return false;
+                }
+                return first || Expect(',');
+            }
+
+            bool String(std::string& out)
+            {
+                out.clear();
+                if (!Expect('"')) {
+                    return false;
+                }
+                while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+                    if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size()) {
+                        m_pos++;
+                    }
+                    out += m_text[m_pos++];
+                }
+                return Expect('"');
+            }
+
+            bool Number(double& out)
+            {
+                SkipSpace();
+                const char* begin = m_text.c_str() + m_pos;
+                char* end = nullptr;
+                out = std::strtod(begin, &end);
+                if (end == begin) {
+                    return Fail("expected a number");
+                }
+                m_pos += end - begin;
+                return true;
+            }
+
+            bool Skip()
+            {
+                SkipSpace();
+                if (m_pos >= m_text.size()) {
+                    return Fail("unexpected end");
+                }
+                char c = m_text[m_pos];
+                if (c == '{') {
+                    m_pos++;
+                    std::string key;
+                    for (bool first = true; NextMember(first, key); first = false) {
+                        if (!Skip()) {
+                            return false;
+                        }
+                    }
+                    return !m_failed;
+                }
+                if (c == '[') {
+                    m_pos++;
+                    for (bool first = true; NextItem(first); first = false) {
+                        if (!Skip()) {
+                            return false;
+                        }
+                    }
+                    return !m_failed;
+                }
+                if (c == '"') {
+                    std::string ignored;
+                    return String(ignored);
+                }
+                if (std::isalpha(static_cast<unsigned char>(c))) {
+                    while (m_pos < m_text.size() && std::isalpha(static_cast<unsigned char>(m_text[m_pos]))) {
+                        m_pos++;
+                    }
+                    return true;
+                }
+                double ignored;
+                return Number(ignored);
+            }
+
+        private:
+            const std::string& m_text;
+            size_t m_pos = 0;
+            bool m_failed = false;
+            std::string m_error;
+
+            void SkipSpace()
+            {
+                while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                    m_pos++;
+                }
+            }
+
+            bool Fail(const std::string& message)
+            {
+                if (!m_failed) {
+                    m_failed = true;
+                    m_error = message + " at offset " + std::to_string(m_pos);
+                }
+                return false;
+            }
+        };
+
+        bool ReadScene(JsonReader& in, SceneBenchmark& scene)
+        {
+            if (!in.Expect('{')) {
+                return false;
+            }
+            std::string key;
+            for (bool first = true; in.NextMember(first, key); first = false) {
+                double value = 0;
+                std::string text;
+                bool ok;
+                if (key == "name") {
+                    ok = in.String(scene.name);
+                }
+                else if (key == "checksum") {
+                    ok = in.String(text);
+                    scene.checksum = std::strtoull(text.c_str(), nullptr, 16);
+                }
+                else if (key == "primitives") {
+                    ok = in.Number(value);
+                    scene.primitives = static_cast<uint32_t>(value);
+                }
+                else if (key == "buildMs") ok = in.Number(scene.buildMs);
+                else if (key == "msPerFrame") ok = in.Number(scene.msPerFrame);
+                else if (key == "minMsPerFrame") ok = in.Number(scene.minMsPerFrame);
+                else if (key == "raysPerSecond") ok = in.Number(scene.raysPerSecond);
+                else if (key == "raysPerFrame") ok = in.Number(scene.raysPerFrame);
+                else if (key == "memoryBytes") {
+                    ok = in.Number(value);
+                    scene.memoryBytes = static_cast<uint64_t>(value);
+                }
+                else ok = in.Skip();
+                if (!ok) {
+                    return false;
+                }
+            }
+            return !in.Failed();
+        }
+
+        // Directions aren't saved; the comparison takes them from the current report.
+        bool ReadSubsystem(JsonReader& in, SubsystemBenchmark& subsystem)
+        {
+            if (!in.Expect('{')) {
+                return false;
+            }
+            std::string key;
+            for (bool first = true; in.NextMember(first, key); first = false) {
+                bool ok;
+                if (key == "name") {
+                    ok = in.String(subsystem.name);
+                }
+                else if (key == "metrics") {
+                    ok = in.Expect('{');
+                    std::string metric;
+                    for (bool firstMetric = true; ok && in.NextMember(firstMetric, metric); firstMetric = false) {
+                        BenchmarkMetric value = { metric, 0, true };
+                        ok = in.Number(value.value);
+                        subsystem.metrics.push_back(value);
+                    }
+                }
+                else {
+                    ok = in.Skip();
+                }
+                if (!ok || in.Failed()) {
+                    return false;
+                }
+            }
+            return !in.Failed();
+        }
+
+        bool ReadSettings(JsonReader& in, BenchmarkSuiteSettings& settings)
+        {
+            if (!in.Expect('{')) {
+                return false;
+            }
+            std::string key;
+            for (bool first = true; in.NextMember(first, key); first = false) {
+                double value = 0;
+                std::string text;
+                bool ok;
+                if (key == "mode") {
+                    ok = in.String(text);
+                    for (uint32_t m = 0; m < ExecutionMode::Count; m++) {
+                        if (text == modeNames[m]) {
+                            settings.mode = static_cast<ExecutionMode::Enum>(m);
+                        }
+                    }
+                }
+                else {
+                    ok = in.Number(value);
+                    uint32_t number = static_cast<uint32_t>(value);
+                    if (key == "width") settings.width = number;
+                    else if (key == "height") settings.height = number;
+                    else if (key == "warmupFrames") settings.warmupFrames = number;
+                    else if (key == "frames") settings.frames = number;
+                    else if (key == "spp") settings.spp = number;
+                    else if (key == "photonsPerPass") settings.photonsPerPass = number;
+                    else if (key == "threads") settings.threads = number;
+                }
+                if (!ok) {
+                    return false;
+                }
+            }
+            return !in.Failed();
+        }
+
+        bool SameWork(const BenchmarkSuiteSettings& a, const BenchmarkSuiteSettings& b)
+        {
+            return a.width == b.width && a.height == b.height && a.frames == b.frames && a.spp == b.spp &&
+                a.mode == b.mode && a.photonsPerPass == b.photonsPerPass && a.threads == b.threads;
+        }
+
+        void Flag(BenchmarkReport& report, const std::string& scene, const char* metric, double baseline, double current, bool higherIsWorse, double threshold)
+        {
+            if (baseline <= 0) {
+                return;
+            }
+            double change = (higherIsWorse ? current - baseline : baseline - current) / baseline;
+            if (change > threshold) {
+                BenchmarkRegression regression = { scene, metric, baseline, current, change };
+                report.regressions.push_back(regression);
+            }
+        }
+    }
+
+    const char* BenchmarkSceneName(BenchmarkScene::Enum scene)
+    {
+        return scene < BenchmarkScene::Count ? sceneNames[scene] : "unknown";
+    }
+
+    const char* BenchmarkSubsystemName(BenchmarkSubsystem::Enum subsystem)
+    {
+        return subsystem < BenchmarkSubsystem::Count ? subsystemNames[subsystem] : "unknown";
+    }
+
+    const BenchmarkMetric* SubsystemBenchmark::Find(const std::string& metric) const
+    {
+        for (const BenchmarkMetric& m : metrics) {
+            if (m.name == metric) {
+                return &m;
+            }
+        }
+        return nullptr;
+    }
+
+    const SubsystemBenchmark* BenchmarkReport::FindSubsystem(const std::string& name) const
+    {
+        for (const SubsystemBenchmark& subsystem : subsystems) {
+            if (subsystem.name == name) {
+                return &subsystem;
+            }
+        }
+        return nullptr;
+    }
+
+    const SceneBenchmark* BenchmarkReport::Find(const std::string& name) const
+    {
+        for (const SceneBenchmark& scene : scenes) {
+            if (scene.name == name) {
+                return &scene;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string BenchmarkReport::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << settings.width << "x" << settings.height << ", " << settings.frames << " frames, " << settings.spp << " spp, "
+            << modeNames[settings.mode] << ", " << (settings.threads ? std::to_string(settings.threads) : std::string("all")) << " threads\n";
+        for (const SceneBenchmark& scene : scenes) {
+            out << "  " << std::left << std::setw(18) << scene.name << std::right
+                << " | " << scene.msPerFrame << " ms a frame (best " << scene.minMsPerFrame << ")"
+                << " | " << scene.raysPerSecond / 1e6 << (scene.name == sceneNames[BenchmarkScene::PhotonMapping] ? " Mphotons/s" : " Mrays/s")
+                << " | " << scene.memoryBytes / (1024.0 * 1024.0) << " MB"
+                << " | " << std::hex << std::setw(16) << std::setfill('0') << scene.checksum << std::dec << std::setfill(' ') << "\n";
+        }
+        for (const SubsystemBenchmark& subsystem : subsystems) {
+            out << "  " << std::left << std::setw(18) << subsystem.name << std::right << " | " << subsystem.summary << "\n";
+        }
+        out << "  process peak " << processPeakBytes / (1024.0 * 1024.0) << " MB\n";
+        for (const BenchmarkRegression& regression : regressions) {
+            out << "  REGRESSION " << regression.scene << " " << regression.metric << ": " << regression.baseline << " -> " << regression.current
+                << " (" << regression.change * 100.0 << "% worse)\n";
+        }
+        for (const std::string& scene : changedImages) {
+            out << "  image changed: " << scene << "\n";
+        }
+        return out.str();
+    }
+
+    void RunBenchmarkSuite(const BenchmarkSuiteSettings& settings, BenchmarkReport& report)
+    {
+        report.settings = settings;
+        report.scenes.clear();
+        report.subsystems.clear();
+        report.regressions.clear();
+        report.changedImages.clear();
+        for (uint32_t s = 0; s < BenchmarkScene::Count; s++) {
+            if (settings.scenes & (1u << s)) {
+                SceneBenchmark result;
+                RunScene(static_cast<BenchmarkScene::Enum>(s), settings, result);
+                report.scenes.push_back(result);
+            }
+        }
+        for (uint32_t s = 0; s < BenchmarkSubsystem::Count; s++) {
+            if (settings.subsystems & (1u << s)) {
+                SubsystemBenchmark result;
+                RunSubsystem(static_cast<BenchmarkSubsystem::Enum>(s), settings, result);
+                report.subsystems.push_back(result);
+            }
+        }
+        report.processPeakBytes = ProcessPeakBytes();
+    }
+
+    size_t CompareToBaseline(BenchmarkReport& report, const BenchmarkReport& baseline, double threshold)
+    {
+        report.regressions.clear();
+        report.changedImages.clear();
+        for (const SceneBenchmark& scene : report.scenes) {
+            const SceneBenchmark* before = baseline.Find(scene.name);
+            if (!before) {
+                continue;
+            }
+            Flag(report, scene.name, "msPerFrame", before->msPerFrame, scene.msPerFrame, true, threshold);
+            Flag(report, scene.name, "raysPerSecond", before->raysPerSecond, scene.raysPerSecond, false, threshold);
+            Flag(report, scene.name, "memoryBytes", static_cast<double>(before->memoryBytes), static_cast<double>(scene.memoryBytes), true, threshold);
+            if (before->checksum != scene.checksum) {
+                report.changedImages.push_back(scene.name);
+            }
+        }
+        for (const SubsystemBenchmark& subsystem : report.subsystems) {
+            const SubsystemBenchmark* before = baseline.FindSubsystem(subsystem.name);
+            for (const BenchmarkMetric& metric : subsystem.metrics) {
+                const BenchmarkMetric* previous = before ? before->Find(metric.name) : nullptr;
+                if (previous) {
+                    Flag(report, subsystem.name, metric.name.c_str(), previous->value, metric.value, metric.higherIsWorse, threshold);
+                }
+            }
+        }
+        return report.regressions.size();
+    }
+
+    std::string BenchmarkReportJson(const BenchmarkReport& report)
+    {
+        const BenchmarkSuiteSettings& s = report.settings;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\n"
+            << "  \"version\": " << ReportVersion << ",\n"
+            << "  \"settings\": { \"width\": " << s.width << ", \"height\": " << s.height << ", \"warmupFrames\": " << s.warmupFrames
+            << ", \"frames\": " << s.frames << ", \"spp\": " << s.spp << ", \"mode\": \"" << modeNames[s.mode] << "\""
+            << ", \"photonsPerPass\": " << s.photonsPerPass << ", \"threads\": " << s.threads << " },\n"
+            << "  \"processPeakBytes\": " << report.processPeakBytes << ",\n"
+            << "  \"scenes\": [";
+        for (size_t i = 0; i < report.scenes.size(); i++) {
+            const SceneBenchmark& scene = report.scenes[i];
+            out << (i ? ",\n" : "\n")
+                << "    { \"name\": \"" << scene.name << "\", \"primitives\": " << scene.primitives
+                << ", \"buildMs\": " << scene.buildMs << ", \"msPerFrame\": " << scene.msPerFrame << ", \"minMsPerFrame\": " << scene.minMsPerFrame
+                << ", \"raysPerSecond\": " << std::setprecision(0) << scene.raysPerSecond << ", \"raysPerFrame\": " << scene.raysPerFrame << std::setprecision(3)
+                << ", \"memoryBytes\": " << scene.memoryBytes
+                << ", \"checksum\": \"" << std::hex << std::setw(16) << std::setfill('0') << scene.checksum << std::dec << std::setfill(' ') << "\" }";
+        }
+        out << "\n  ],\n  \"subsystems\": [";
+        // Rates run to hundreds of millions and errors to thousandths, so these aren't fixed-point.
+        out << std::defaultfloat << std::setprecision(9);
+        for (size_t i = 0; i < report.subsystems.size(); i++) {
+            const SubsystemBenchmark& subsystem = report.subsystems[i];
+            out << (i ? ",\n" : "\n") << "    { \"name\": \"" << subsystem.name << "\", \"metrics\": {";
+            for (size_t m = 0; m < subsystem.metrics.size(); m++) {
+                out << (m ? ", " : " ") << "\"" << subsystem.metrics[m].name << "\": " << subsystem.metrics[m].value;
+            }
+            out << " } }";
+        }
+        out << std::fixed << std::setprecision(3);
+        out << "\n  ],\n  \"regressions\": [";
+        for (size_t i = 0; i < report.regressions.size(); i++) {
+            const BenchmarkRegression& r = report.regressions[i];
+            out << (i ? ",\n" : "\n")
+                << "    { \"scene\": \"" << r.scene << "\", \"metric\": \"" << r.metric << "\", \"baseline\": " << r.baseline
+                << ", \"current\": " << r.current << ", \"change\": " << r.change << " }";
+        }
+        out << (report.regressions.empty() ? "" : "\n  ") << "],\n  \"changedImages\": [";
+        for (size_t i = 0; i < report.changedImages.size(); i++) {
+            out << (i ? ", " : "") << "\"" << report.changedImages[i] << "\"";
+        }
+        out << "]\n}\n";
+        return out.str();
+    }
+
+    bool WriteBenchmarkReport(const std::string& filename, const BenchmarkReport& report)
+    {
+        std::ofstream out(filename, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << BenchmarkReportJson(report);
+        return static_cast<bool>(out);
+    }
+
+    bool ReadBenchmarkReport(const std::string& filename, BenchmarkReport& report, std::string* error)
+    {
+        std::ifstream file(filename);
+        if (!file) {
+            if (error) {
+                *error = "can't read " + filename;
+            }
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+
+        report = BenchmarkReport();
+        JsonReader in(text);
+        bool ok = in.Expect('{');
+        std::string key;
+        for (bool first = true; ok && in.NextMember(first, key); first = false) {
+            if (key == "version") {
+                double version = 0;
+                ok = in.Number(version);
+                if (ok && static_cast<uint32_t>(version) != ReportVersion) {
+                    if (error) {
+                        *error = filename + " is report version " + std::to_string(static_cast<uint32_t>(version)) + ", expected " + std::to_string(ReportVersion);
+                    }
+                    return false;
+                }
+            }
+            else if (key == "settings") {
+                ok = ReadSettings(in, report.settings);
+            }
+            else if (key == "processPeakBytes") {
+                double value = 0;
+                ok = in.Number(value);
+                report.processPeakBytes = static_cast<uint64_t>(value);
+            }
+            else if (key == "scenes") {
+                ok = in.Expect('[');
+                for (bool firstScene = true; ok && in.NextItem(firstScene); firstScene = false) {
+                    SceneBenchmark scene;
+                    ok = ReadScene(in, scene);
+                    report.scenes.push_back(scene);
+                }
+            }
+            else if (key == "subsystems") {
+                ok = in.Expect('[');
+                for (bool firstSubsystem = true; ok && in.NextItem(firstSubsystem); firstSubsystem = false) {
+                    SubsystemBenchmark subsystem;
+                    ok = ReadSubsystem(in, subsystem);
+                    report.subsystems.push_back(subsystem);
+                }
+            }
+            else {
+                ok = in.Skip();
+            }
+        }
+        if (!ok || in.Failed()) {
+            if (error) {
+                *error = filename + ": " + (in.Error().empty() ? std::string("malformed report") : in.Error());
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseBenchmarkCommand(const std::vector<std::string>& args, BenchmarkCommand& command, std::string* error)
+    {
+        auto fail = [&](const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+            return false;
+        };
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            if (arg == "-scenes-only") {
+                command.settings.subsystems = 0;
+                continue;
+            }
+            if (arg == "-subsystems-only") {
+                command.settings.scenes = 0;
+                continue;
+            }
+            if (arg != "-report" && arg != "-baseline" && arg != "-threshold" && arg != "-threads" && arg != "-frames") {
+                return fail("unknown option " + arg);
+            }
+            if (i + 1 >= args.size()) {
+                return fail(arg + " needs a value");
+            }
+            const std::string& value = args[++i];
+            if (arg == "-report") command.reportPath = value;
+            else if (arg == "-baseline") command.baselinePath = value;
+            else if (arg == "-threshold") {
+                char* end = nullptr;
+                command.threshold = std::strtod(value.c_str(), &end);
+                if (value.empty() || *end != '\0' || !(command.threshold > 0)) {
+                    return fail("-threshold needs a positive number, not " + value);
+                }
+            }
+            else if (arg == "-threads") command.settings.threads = static_cast<unsigned>(std::atoi(value.c_str()));
+            else if (arg == "-frames") command.settings.frames = static_cast<uint32_t>((std::max)(1, std::atoi(value.c_str())));
+        }
+        return true;
+    }
+
+    int RunBenchmarkCommand(const BenchmarkCommand& command, std::string& log, std::string& json)
+    {
+        BenchmarkReport report;
+        RunBenchmarkSuite(command.settings, report);
+
+        std::ostringstream out;
+        int exitCode = 0;
+        if (!command.baselinePath.empty()) {
+            BenchmarkReport baseline;
+            std::string error;
+            if (ReadBenchmarkReport(command.baselinePath, baseline, &error)) {
+                if (!SameWork(report.settings, baseline.settings)) {
+                    out << "baseline was run with different settings; timings may not compare\n";
+                }
+                exitCode = CompareToBaseline(report, baseline, command.threshold) > 0 ? 1 : 0;
+            }
+            else {
+                out << "baseline: " << error << "\n";
+                exitCode = 2;
+            }
+        }
+        out << report.Summary();
+        json = BenchmarkReportJson(report);
+        if (!command.reportPath.empty() && !WriteBenchmarkReport(command.reportPath, report)) {
+            out << "can't write " << command.reportPath << "\n";
+            exitCode = 2;
+        }
+        log = out.str();
+        return exitCode;
+    }
+}
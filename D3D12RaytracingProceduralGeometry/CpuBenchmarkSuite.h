@@ -0,0 +1,153 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuBenchmarkSuite.h
+//
+// A fixed set of scenes, one for each intersection and shading path, timed on the CPU tracer
+// so builds can be compared without reading frame rates off the window title. Every scene is
+// built from a fixed seed and every frame is seeded by its number, so two runs do the same
+// work and, unless the tracer's output changed, produce the same image checksum.
+//
+// A report holds, for each scene, the median milliseconds a frame, rays a second and the
+// bytes of the scene, BVH, framebuffer and photon maps, and, once for the run, the process's
+// peak memory. It is written as JSON; a report read back as a baseline is compared metric by
+// metric, and any that got worse by more than a threshold is flagged as a regression.
+// Benchmark/baseline.json is the baseline for the machine it was recorded on; see README.md.
+//
+// Alongside the scenes, each subsystem benchmark (BVH refit, the 8-wide BVH, point cloud
+// LOD, photon storage, encoding and lookup, the packed G-buffer, the denoiser, reprojection
+// and the three execution modes) runs at a fixed size and reports its own metrics, compared
+// the same way.
+//
+// The CPU tracer has no metaballs, so the signed-distance scene uses the sphere-traced torus
+// to cover that path.
+//
+//**********************************************************************************************
+
+#include "CpuTracer.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    namespace BenchmarkScene {
+        enum Enum {
+            AnalyticQuadrics = 0,   // A grid of every quadric, diffuse, mirror and glass.
+            CornellBox,             // Triangle walls with a box and a glass sphere.
+            CsgMug,                 // CsgTree::CoffeeMug on a plane.
+            QuaternionJulia,
+            SignedDistance,         // A ring of tori.
+            TriangleMesh,           // A displaced sphere of about 20,000 triangles.
+            Instancing,             // 20,000 small primitives over a height field, as albany places them.
+            PhotonMapping,          // The Cornell box, by progressive photon mapping.
+            Count
+        };
+    }
+
+    const char* BenchmarkSceneName(BenchmarkScene::Enum scene);
+
+    namespace BenchmarkSubsystem {
+        enum Enum {
+            BvhUpdate = 0,          // BenchmarkBvhUpdate, 20,000 boxes with a tenth moving.
+            Bvh8,                   // BenchmarkBvh8, camera rays into the instancing scene.
+            PointCloudLod,          // BenchmarkPointCloudLod, a synthetic 200,000-point scan.
+            PhotonStorage,          // The rest run on the Cornell box.
+            PhotonEncoding,
+            PhotonGrid,
+            GBuffer,
+            Denoiser,
+            Reprojection,
+            ExecutionModes,         // Recursive, wavefront and queued tracing of the same frames.
+            Count
+        };
+    }
+
+    const char* BenchmarkSubsystemName(BenchmarkSubsystem::Enum subsystem);
+
+    struct BenchmarkSuiteSettings {
+        uint32_t width = 320;
+        uint32_t height = 180;
+        uint32_t warmupFrames = 1;
+        uint32_t frames = 8;                // Timed; passes for the photon mapping scene.
+        uint32_t spp = 1;
+        ExecutionMode::Enum mode = ExecutionMode::Recursive;
+        uint32_t photonsPerPass = 100000;
+        unsigned threads = 0;
+        uint32_t scenes = (1u << BenchmarkScene::Count) - 1;    // Bit mask of BenchmarkScene.
+        uint32_t subsystems = (1u << BenchmarkSubsystem::Count) - 1;
+    };
+
+    struct SceneBenchmark {
+        std::string name;
+        uint32_t primitives = 0;
+        double buildMs = 0;                 // BVH build.
+        double msPerFrame = 0;              // Median over the timed frames.
+        double minMsPerFrame = 0;
+        double raysPerSecond = 0;           // Extension and shadow rays; photons for photon mapping.
+        double raysPerFrame = 0;
+        uint64_t memoryBytes = 0;           // Scene, BVH, framebuffer and photon maps.
+        uint64_t checksum = 0;              // Of the last frame, see FramebufferChecksum.
+    };
+
+    struct BenchmarkMetric {
+        std::string name;
+        double value;
+        bool higherIsWorse;                 // Times, bytes and errors; false for rates.
+    };
+
+    struct SubsystemBenchmark {
+        std::string name;
+        std::vector<BenchmarkMetric> metrics;
+        std::string summary;                // The subsystem's own, for the log; not saved.
+
+        const BenchmarkMetric* Find(const std::string& metric) const;
+    };
+
+    struct BenchmarkRegression {
+        std::string scene;
+        std::string metric;
+        double baseline;
+        double current;
+        double change;                      // Fraction worse than the baseline.
+    };
+
+    struct BenchmarkReport {
+        BenchmarkSuiteSettings settings;
+        std::vector<SceneBenchmark> scenes;
+        std::vector<SubsystemBenchmark> subsystems;
+        std::vector<BenchmarkRegression> regressions;   // Filled by CompareToBaseline.
+        std::vector<std::string> changedImages;         // Scenes whose checksum differs from the baseline's.
+        uint64_t processPeakBytes = 0;      // Peak working set of the process over the whole run.
+
+        const SceneBenchmark* Find(const std::string& name) const;
+        const SubsystemBenchmark* FindSubsystem(const std::string& name) const;
+        std::string Summary() const;
+    };
+
+    void RunBenchmarkSuite(const BenchmarkSuiteSettings& settings, BenchmarkReport& report);
+
+    // Flags milliseconds a frame and memory that rose, and rays a second that fell, by more
+    // than threshold (0.1 is 10%), and subsystem metrics that moved the wrong way by as much.
+    // Entries missing from either report are skipped. The process peak is only reported: it
+    // depends on which scenes and subsystems ran. Returns how many regressions were found.
+    size_t CompareToBaseline(BenchmarkReport& report, const BenchmarkReport& baseline, double threshold = 0.1);
+
+    std::string BenchmarkReportJson(const BenchmarkReport& report);
+    bool WriteBenchmarkReport(const std::string& filename, const BenchmarkReport& report);
+    // Reads a report written by WriteBenchmarkReport, for use as a baseline.
+    bool ReadBenchmarkReport(const std::string& filename, BenchmarkReport& report, std::string* error = nullptr);
+
+    // The options of the HonoursBenchmark tool: "[-report report.json] [-baseline baseline.json]
+    // [-threshold 0.1] [-threads n] [-frames n] [-scenes-only | -subsystems-only]".
+    struct BenchmarkCommand {
+        std::string reportPath;             // Also written here if set.
+        std::string baselinePath;
+        double threshold = 0.1;
+        BenchmarkSuiteSettings settings;
+    };
+    bool ParseBenchmarkCommand(const std::vector<std::string>& args, BenchmarkCommand& command, std::string* error = nullptr);
+    // Runs the suite and compares it with the baseline. Returns the process exit code: 0, 1 on
+    // regressions, 2 on errors. log receives a readable summary and json the report.
+    int RunBenchmarkCommand(const BenchmarkCommand& command, std::string& log, std::string& json);
+}
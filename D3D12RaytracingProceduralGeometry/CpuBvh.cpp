@@ -0,0 +1,445 @@
+#include "CpuBvh.h"
+
+namespace Cpu {
+
+    namespace {
+        const uint32_t SahBins = 12;
+        const uint32_t StackSize = 64;
+    }
+
+    void Bvh::Build(const std::vector<Aabb>& primitiveBounds)
+    {
+        nodes.clear();
+        primitiveIndices.resize(primitiveBounds.size());
+        for (uint32_t i = 0; i < primitiveIndices.size(); i++) {
+            primitiveIndices[i] = i;
+        }
+
+        std::vector<float3> centroids(primitiveBounds.size());
+        for (size_t i = 0; i < primitiveBounds.size(); i++) {
+            centroids[i] = primitiveBounds[i].centroid();
+        }
+
+        nodes.reserve(primitiveBounds.size() * 2 + 1);
+        BvhNode root;
+        root.leftFirst = 0;
+        root.count = static_cast<uint32_t>(primitiveBounds.size());
+        for (const Aabb& b : primitiveBounds) {
+            root.bounds.grow(b);
+        }
+        nodes.push_back(root);
+        if (primitiveBounds.empty()) {
+            LinkNodes();
+            return;
+        }
+
+        std::vector<uint32_t> pending(1, 0);
+        while (!pending.empty()) {
+            uint32_t nodeIndex = pending.back();
+            pending.pop_back();
+            uint32_t left = Subdivide(nodeIndex, primitiveBounds, centroids);
+            if (left != 0) {
+                pending.push_back(left);
+                pending.push_back(left + 1);
+            }
+        }
+        LinkNodes();
+    }
+
+    // Fills parents/primitiveLeaf and the SAH sum after a build.
+    void Bvh::LinkNodes()
+    {
+        parents.assign(nodes.size(), 0);
+        primitiveLeaf.assign(primitiveIndices.size(), 0);
+        m_refitMarks.assign(nodes.size(), 0);
+        m_sahSum = 0;
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            const BvhNode& node = nodes[i];
+            m_sahSum += node.bounds.surfaceArea() * NodeSahWeight(node);
+            if (node.isLeaf()) {
+                for (uint32_t k = 0; k < node.count; k++) {
+                    primitiveLeaf[primitiveIndices[node.leftFirst + k]] = i;
+                }
+            }
+            else {
+                parents[node.leftFirst] = i;
+                parents[node.leftFirst + 1] = i;
+            }
+        }
+    }
+
+    // Children are always created after their parent, so a reverse sweep over the node
+    // array visits every child before its parent.
+    void Bvh::Refit(const std::vector<Aabb>& primitiveBounds)
+    {
+        m_sahSum = 0;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BvhNode& node = nodes[i];
+            Aabb bounds;
+            if (node.isLeaf()) {
+                for (uint32_t k = 0; k < node.count; k++) {
+                    bounds.grow(primitiveBounds[primitiveIndices[node.leftFirst + k]]);
+                }
+            }
+            else {
+                bounds = nodes[node.leftFirst].bounds;
+                bounds.grow(nodes[node.leftFirst + 1].bounds);
+            }
+            node.bounds = bounds;
+            m_sahSum += bounds.surfaceArea() * NodeSahWeight(node);
+        }
+    }
+
+    void Bvh::Refit(const std::vector<Aabb>& primitiveBounds, const std::vector<uint32_t>& dirtyPrimitives)
+    {
+        if (nodes.empty() || dirtyPrimitives.empty()) {
+            return;
+        }
+
+        // Mark the dirty leaves and their ancestors, stopping at the first marked node.
+        std::vector<uint32_t> marked;
+        for (uint32_t prim : dirtyPrimitives) {
+            uint32_t nodeIndex = primitiveLeaf[prim];
+            while (!m_refitMarks[nodeIndex]) {
+                m_refitMarks[nodeIndex] = 1;
+                marked.push_back(nodeIndex);
+                if (nodeIndex == 0) {
+                    break;
+                }
+                nodeIndex = parents[nodeIndex];
+            }
+        }
+
+        std::sort(marked.begin(), marked.end());
+        for (size_t i = marked.size(); i-- > 0;) {
+            uint32_t nodeIndex = marked[i];
+            BvhNode& node = nodes[nodeIndex];
+            Aabb bounds;
+            if (node.isLeaf()) {
+                for (uint32_t k = 0; k < node.count; k++) {
+                    bounds.grow(primitiveBounds[primitiveIndices[node.leftFirst + k]]);
+                }
+            }
+            else {
+                bounds = nodes[node.leftFirst].bounds;
+                bounds.grow(nodes[node.leftFirst + 1].bounds);
+            }
+            double weight = NodeSahWeight(node);
+            m_sahSum += (bounds.surfaceArea() - node.bounds.surfaceArea()) * weight;
+            node.bounds = bounds;
+            m_refitMarks[nodeIndex] = 0;
+        }
+    }
+
+    float Bvh::SahCost() const
+    {
+        if (nodes.empty()) {
+            return 0;
+        }
+        float rootArea = nodes[0].bounds.surfaceArea();
+        return rootArea > 0 ? static_cast<float>(m_sahSum / rootArea) : 0;
+    }
+
+    // Splits a leaf with a binned SAH sweep. Returns the left child index, or 0 if it stays a leaf.
+    uint32_t Bvh::Subdivide(uint32_t nodeIndex, const std::vector<Aabb>& primitiveBounds, const std::vector<float3>& centroids)
+    {
+        BvhNode node = nodes[nodeIndex];
+        if (node.count <= MaxLeafSize) {
+            return 0;
+        }
+
+        Aabb centroidBounds;
+        for (uint32_t i = 0; i < node.count; i++) {
+            centroidBounds.grow(centroids[primitiveIndices[node.leftFirst + i]]);
+        }
+
+        float bestCost = Infinity;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centroidBounds.lower[axis], hi = centroidBounds.upper[axis];
+            if (hi <= lo) {
+                continue;
+            }
+            Aabb binBounds[SahBins];
+            uint32_t binCounts[SahBins] = {};
+            float scale = SahBins / (hi - lo);
+            for (uint32_t i = 0; i < node.count; i++) {
+                uint32_t prim = primitiveIndices[node.leftFirst + i];
+                uint32_t bin = (std::min)(SahBins - 1, static_cast<uint32_t>((centroids[prim][axis] - lo) * scale));
+                binCounts[bin]++;
+                binBounds[bin].grow(primitiveBounds[prim]);
+            }
+
+            float leftArea[SahBins - 1], rightArea[SahBins - 1];
+            uint32_t leftCount[SahBins - 1], rightCount[SahBins - 1];
+            Aabb leftBox, rightBox;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (uint32_t i = 0; i < SahBins - 1; i++) {
+                leftSum += binCounts[i];
+                leftCount[i] = leftSum;
+                leftBox.grow(binBounds[i]);
+                leftArea[i] = leftBox.surfaceArea();
+                rightSum += binCounts[SahBins - 1 - i];
+                rightCount[SahBins - 2 - i] = rightSum;
+                rightBox.grow(binBounds[SahBins - 1 - i]);
+                rightArea[SahBins - 2 - i] = rightBox.surfaceArea();
+            }
+            for (uint32_t i = 0; i < SahBins - 1; i++) {
+                if (leftCount[i] == 0 || rightCount[i] == 0) {
+                    continue;
+                }
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i + 1;
+                }
+            }
+        }
+
+        float leafCost = node.count * node.bounds.surfaceArea();
+        uint32_t first = node.leftFirst;
+        uint32_t mid;
+        if (bestAxis < 0 || bestCost >= leafCost) {
+            if (node.count <= MaxLeafSize * 4 && bestAxis >= 0) {
+                return 0;
+            }
+            // Degenerate centroids or a poor SAH split on a big leaf: fall back to a median split.
+            mid = first + node.count / 2;
+        }
+        else {
+            float lo = centroidBounds.lower[bestAxis];
+            float scale = SahBins / (centroidBounds.upper[bestAxis] - lo);
+            uint32_t* begin = primitiveIndices.data() + first;
+            uint32_t* split = std::partition(begin, begin + node.count, [&](uint32_t prim) {
+                uint32_t bin = (std::min)(SahBins - 1, static_cast<uint32_t>((centroids[prim][bestAxis] - lo) * scale));
+                return bin < bestSplit;
+            });
+            mid = static_cast<uint32_t>(split - primitiveIndices.data());
+        }
+
+        uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+        BvhNode left, right;
+        left.leftFirst = first;
+        left.count = mid - first;
+        right.leftFirst = mid;
+        right.count = first + node.count - mid;
+        for (uint32_t i = 0; i < left.count; i++) {
+            left.bounds.grow(primitiveBounds[primitiveIndices[left.leftFirst + i]]);
+        }
+        for (uint32_t i = 0; i < right.count; i++) {
+            right.bounds.grow(primitiveBounds[primitiveIndices[right.leftFirst + i]]);
+        }
+        nodes.push_back(left);
+        nodes.push_back(right);
+
+        nodes[nodeIndex].leftFirst = leftIndex;
+        nodes[nodeIndex].count = 0;
+        return leftIndex;
+    }
+
+    bool Bvh::Intersect(const Scene& scene, const Ray& ray, float tMin, Hit& hit, RayCounters* counters) const
+    {
+        if (nodes.empty()) {
+            return false;
+        }
+        float3 invDir = SafeInverse(ray.direction);
+        uint32_t stack[StackSize];
+        uint32_t stackPtr = 0;
+        uint32_t nodeIndex = 0;
+        float tNear;
+        if (!RayAabb(ray.origin, invDir, nodes[0].bounds, hit.t, tNear)) {
+            return false;
+        }
+
+        bool found = false;
+        for (;;) {
+            const BvhNode& node = nodes[nodeIndex];
+            if (counters) counters->value[RayCounter::NodeVisits]++;
+            if (node.isLeaf()) {
+                if (counters) counters->value[RayCounter::LeafTests] += node.count;
+                for (uint32_t i = 0; i < node.count; i++) {
+                    uint32_t prim = primitiveIndices[node.leftFirst + i];
+                    float t;
+                    float3 n;
+                    if (scene.IntersectPrimitive(prim, ray, tMin, hit.t, t, n, counters)) {
+                        hit.t = t;
+                        hit.normal = n;
+                        hit.primitive = prim;
+                        found = true;
+                    }
+                }
+                if (stackPtr == 0) break;
+                nodeIndex = stack[--stackPtr];
+                continue;
+            }
+
+            // Visit the nearer child first.
+            uint32_t a = node.leftFirst, b = node.leftFirst + 1;
+            float tA, tB;
+            bool hitA = RayAabb(ray.origin, invDir, nodes[a].bounds, hit.t, tA);
+            bool hitB = RayAabb(ray.origin, invDir, nodes[b].bounds, hit.t, tB);
+            if (hitA && hitB) {
+                if (tB < tA) std::swap(a, b);
+                stack[stackPtr++] = b;
+                nodeIndex = a;
+            }
+            else if (hitA) {
+                nodeIndex = a;
+            }
+            else if (hitB) {
+                nodeIndex = b;
+            }
+            else {
+                if (stackPtr == 0) break;
+                nodeIndex = stack[--stackPtr];
+            }
+        }
+        return found;
+    }
+
+    bool Bvh::Occluded(const Scene& scene, const Ray& ray, float tMin, float tMax, RayCounters* counters) const
+    {
+        if (nodes.empty()) {
+            return false;
+        }
+        float3 invDir = SafeInverse(ray.direction);
+        uint32_t stack[StackSize];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = 0;
+        while (stackPtr > 0) {
+            const BvhNode& node = nodes[stack[--stackPtr]];
+            if (counters) counters->value[RayCounter::NodeVisits]++;
+            float tNear;
+            if (!RayAabb(ray.origin, invDir, node.bounds, tMax, tNear)) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < node.count; i++) {
+                    float t;
+                    float3 n;
+                    if (counters) counters->value[RayCounter::LeafTests]++;
+                    if (scene.IntersectPrimitive(primitiveIndices[node.leftFirst + i], ray, tMin, tMax, t, n, counters)) {
+                        return true;
+                    }
+                }
+            }
+            else {
+                stack[stackPtr++] = node.leftFirst + 1;
+                stack[stackPtr++] = node.leftFirst;
+            }
+        }
+        return false;
+    }
+
+    // Shared-stack packet traversal: a node is entered if any active ray overlaps it, and node
+    // bounds are fetched once per packet rather than once per ray. Works best on rays sorted by
+    // direction octant and origin, which is what the wavefront tracer feeds it.
+    void Bvh::IntersectPacket(const Scene& scene, const Ray* rays, uint32_t count, float tMin, Hit* hits) const
+    {
+        if (nodes.empty() || count == 0) {
+            return;
+        }
+        float3 invDir[PacketSize];
+        for (uint32_t r = 0; r < count; r++) {
+            invDir[r] = SafeInverse(rays[r].direction);
+        }
+        const float3& leadDir = rays[0].direction;
+
+        uint32_t stack[StackSize];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = 0;
+        while (stackPtr > 0) {
+            const BvhNode& node = nodes[stack[--stackPtr]];
+            bool active[PacketSize];
+            bool any = false;
+            for (uint32_t r = 0; r < count; r++) {
+                float tNear;
+                active[r] = RayAabb(rays[r].origin, invDir[r], node.bounds, hits[r].t, tNear);
+                any |= active[r];
+            }
+            if (!any) {
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < node.count; i++) {
+                    uint32_t prim = primitiveIndices[node.leftFirst + i];
+                    for (uint32_t r = 0; r < count; r++) {
+                        if (!active[r]) continue;
+                        float t;
+                        float3 n;
+                        if (scene.IntersectPrimitive(prim, rays[r], tMin, hits[r].t, t, n)) {
+                            hits[r].t = t;
+                            hits[r].normal = n;
+                            hits[r].primitive = prim;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // Order children for the lead ray; the packet shares its direction octant.
+            uint32_t a = node.leftFirst, b = node.leftFirst + 1;
+            float3 ca = nodes[a].bounds.centroid(), cb = nodes[b].bounds.centroid();
+            if (dot(cb - ca, leadDir) < 0) std::swap(a, b);
+            stack[stackPtr++] = b;
+            stack[stackPtr++] = a;
+        }
+    }
+
+    void Bvh::OccludedPacket(const Scene& scene, const Ray* rays, const float* tMax, uint32_t count, float tMin, bool* occluded) const
+    {
+        for (uint32_t r = 0; r < count; r++) {
+            occluded[r] = false;
+        }
+        if (nodes.empty() || count == 0) {
+            return;
+        }
+        float3 invDir[PacketSize];
+        for (uint32_t r = 0; r < count; r++) {
+            invDir[r] = SafeInverse(rays[r].direction);
+        }
+
+        uint32_t remaining = count;
+        uint32_t stack[StackSize];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = 0;
+        while (stackPtr > 0 && remaining > 0) {
+            const BvhNode& node = nodes[stack[--stackPtr]];
+            bool active[PacketSize];
+            bool any = false;
+            for (uint32_t r = 0; r < count; r++) {
+                float tNear;
+                active[r] = !occluded[r] && RayAabb(rays[r].origin, invDir[r], node.bounds, tMax[r], tNear);
+                any |= active[r];
+            }
+            if (!any) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                for (uint32_t i = 0; i < node.count; i++) {
+                    uint32_t prim = primitiveIndices[node.leftFirst + i];
+                    for (uint32_t r = 0; r < count; r++) {
+                        if (!active[r] || occluded[r]) continue;
+                        float t;
+                        float3 n;
+                        if (scene.IntersectPrimitive(prim, rays[r], tMin, tMax[r], t, n)) {
+                            occluded[r] = true;
+                            remaining--;
+                        }
+                    }
+                }
+                continue;
+            }
+            stack[stackPtr++] = node.leftFirst + 1;
+            stack[stackPtr++] = node.leftFirst;
+        }
+    }
+
+    size_t Bvh::MemoryFootprint() const
+    {
+        return nodes.size() * sizeof(BvhNode) + primitiveIndices.size() * sizeof(uint32_t);
+    }
+}
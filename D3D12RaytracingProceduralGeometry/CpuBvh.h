@@ -0,0 +1,67 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuBvh.h
+//
+// Binary SAH bounding volume hierarchy over Cpu::Scene primitives. Plays the role of the
+// DXR acceleration structure for the CPU tracer. Interior nodes store their children next to
+// each other, so a node only needs the index of its left child.
+//
+//**********************************************************************************************
+
+#include "CpuScene.h"
+#include <vector>
+
+namespace Cpu {
+
+    struct BvhNode {
+        Aabb bounds;
+        uint32_t leftFirst;     // Left child index for interior nodes, first primitive for leaves.
+        uint32_t count;         // Primitive count; 0 for interior nodes.
+
+        bool isLeaf() const { return count > 0; }
+    };
+
+    class Bvh
+    {
+    public:
+        static const uint32_t MaxLeafSize = 4;
+        static const uint32_t PacketSize = 16;
+
+        std::vector<BvhNode> nodes;
+        std::vector<uint32_t> primitiveIndices;
+        std::vector<uint32_t> parents;          // Parent of each node; the root points at itself.
+        std::vector<uint32_t> primitiveLeaf;    // Leaf holding each primitive.
+
+        void Build(const std::vector<Aabb>& primitiveBounds);
+
+        // Bottom-up bounds refit, keeping the topology. The partial form only visits the
+        // ancestors of the given primitives.
+        void Refit(const std::vector<Aabb>& primitiveBounds);
+        void Refit(const std::vector<Aabb>& primitiveBounds, const std::vector<uint32_t>& dirtyPrimitives);
+
+        // SAH cost (traversal and intersection both weighted 1) relative to the root area.
+        // Maintained incrementally by Refit.
+        float SahCost() const;
+
+        // Closest hit; hit.t is used as the initial tMax. Work is added to counters if given.
+        bool Intersect(const Scene& scene, const Ray& ray, float tMin, Hit& hit, RayCounters* counters = nullptr) const;
+        bool Occluded(const Scene& scene, const Ray& ray, float tMin, float tMax, RayCounters* counters = nullptr) const;
+
+        // Packet variants for coherent (sorted) ray batches. count <= PacketSize.
+        void IntersectPacket(const Scene& scene, const Ray* rays, uint32_t count, float tMin, Hit* hits) const;
+        void OccludedPacket(const Scene& scene, const Ray* rays, const float* tMax, uint32_t count, float tMin, bool* occluded) const;
+
+        // Bytes of traversal data (nodes and primitive indices).
+        size_t MemoryFootprint() const;
+
+    private:
+        double m_sahSum = 0;                    // Sum of area * weight over all nodes.
+        std::vector<uint8_t> m_refitMarks;
+
+        void LinkNodes();
+        double NodeSahWeight(const BvhNode& node) const { return node.isLeaf() ? node.count : 1.0; }
+        uint32_t Subdivide(uint32_t nodeIndex, const std::vector<Aabb>& primitiveBounds, const std::vector<float3>& centroids);
+    };
+}
@@ -0,0 +1,370 @@
+#include "CpuBvh8.h"
+#include "CpuParallel.h"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CPU_BVH8_SSE 1
+#endif
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const uint32_t StackSize = 512;
+
+        struct StackEntry {
+            uint32_t index;     // Node index, or first primitive slot for a leaf.
+            uint32_t count;     // 0 for interior nodes.
+            float tNear;
+        };
+
+        // 2^exponent, built directly from the float exponent bits.
+        float ExponentScale(int8_t exponent)
+        {
+            uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+            float scale;
+            std::memcpy(&scale, &bits, sizeof(scale));
+            return scale;
+        }
+
+        void Quantise(Bvh8Node& node, const Aabb& parent, const Aabb* children, uint32_t childCount)
+        {
+            node.origin = parent.lower;
+            for (int axis = 0; axis < 3; axis++) {
+                float extent = parent.upper[axis] - parent.lower[axis];
+                int exponent = 0;
+                std::frexp(extent / 255.0f, &exponent);
+                exponent = (std::max)(-126, (std::min)(127, exponent));
+                node.exponents[axis] = static_cast<int8_t>(exponent);
+                float invScale = 1.0f / ExponentScale(node.exponents[axis]);
+
+                for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                    if (i >= childCount) {
+                        node.lower[axis][i] = 0;
+                        node.upper[axis][i] = 0;
+                        continue;
+                    }
+                    float lo = std::floor((children[i].lower[axis] - node.origin[axis]) * invScale);
+                    float hi = std::ceil((children[i].upper[axis] - node.origin[axis]) * invScale);
+                    node.lower[axis][i] = static_cast<uint8_t>((std::max)(0.0f, (std::min)(255.0f, lo)));
+                    node.upper[axis][i] = static_cast<uint8_t>((std::max)(0.0f, (std::min)(255.0f, hi)));
+                }
+            }
+        }
+
+        struct RayContext {
+            float3 origin;
+            float3 invDir;
+            bool negative[3];
+        };
+
+        RayContext MakeRayContext(const Ray& ray)
+        {
+            RayContext ctx;
+            ctx.origin = ray.origin;
+            ctx.invDir = SafeInverse(ray.direction);
+            for (int axis = 0; axis < 3; axis++) {
+                ctx.negative[axis] = ctx.invDir[axis] < 0;
+            }
+            return ctx;
+        }
+
+#ifdef CPU_BVH8_SSE
+        inline void LoadQuantised(const uint8_t* q, __m128& lo4, __m128& hi4)
+        {
+            __m128i zero = _mm_setzero_si128();
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(q));
+            __m128i words = _mm_unpacklo_epi8(bytes, zero);
+            lo4 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+            hi4 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+        }
+#endif
+
+        // Slab test of the ray against all eight child boxes. Returns a hit mask and fills tNear.
+        uint32_t IntersectChildren(const Bvh8Node& node, const RayContext& ctx, float tMax, float* tNear)
+        {
+#ifdef CPU_BVH8_SSE
+            __m128 nearA = _mm_setzero_ps(), nearB = _mm_setzero_ps();
+            __m128 farA = _mm_set1_ps(tMax), farB = _mm_set1_ps(tMax);
+            for (int axis = 0; axis < 3; axis++) {
+                float b = ExponentScale(node.exponents[axis]) * ctx.invDir[axis];
+                float a = (node.origin[axis] - ctx.origin[axis]) * ctx.invDir[axis];
+                __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+                const uint8_t* nearQ = ctx.negative[axis] ? node.upper[axis] : node.lower[axis];
+                const uint8_t* farQ = ctx.negative[axis] ? node.lower[axis] : node.upper[axis];
+                __m128 qa, qb;
+                LoadQuantised(nearQ, qa, qb);
+                nearA = _mm_max_ps(nearA, _mm_add_ps(va, _mm_mul_ps(qa, vb)));
+                nearB = _mm_max_ps(nearB, _mm_add_ps(va, _mm_mul_ps(qb, vb)));
+                LoadQuantised(farQ, qa, qb);
+                farA = _mm_min_ps(farA, _mm_add_ps(va, _mm_mul_ps(qa, vb)));
+                farB = _mm_min_ps(farB, _mm_add_ps(va, _mm_mul_ps(qb, vb)));
+            }
+            _mm_storeu_ps(tNear, nearA);
+            _mm_storeu_ps(tNear + 4, nearB);
+            return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(nearA, farA)))
+                | (static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(nearB, farB))) << 4);
+#else
+            float tFar[CompressedBvh8::Width];
+            for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                tNear[i] = 0;
+                tFar[i] = tMax;
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                float b = ExponentScale(node.exponents[axis]) * ctx.invDir[axis];
+                float a = (node.origin[axis] - ctx.origin[axis]) * ctx.invDir[axis];
+                const uint8_t* nearQ = ctx.negative[axis] ? node.upper[axis] : node.lower[axis];
+                const uint8_t* farQ = ctx.negative[axis] ? node.lower[axis] : node.upper[axis];
+                for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                    tNear[i] = (std::max)(tNear[i], a + nearQ[i] * b);
+                    tFar[i] = (std::min)(tFar[i], a + farQ[i] * b);
+                }
+            }
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                mask |= (tNear[i] <= tFar[i] ? 1u : 0u) << i;
+            }
+            return mask;
+#endif
+        }
+
+        uint32_t OccupiedMask(const Bvh8Node& node)
+        {
+            uint32_t mask = node.internalMask;
+            for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                mask |= (node.primitiveCount[i] != 0 ? 1u : 0u) << i;
+            }
+            return mask;
+        }
+
+        // Pushes the hit children of a node so that the nearest is popped first.
+        void PushChildren(const Bvh8Node& node, uint32_t mask, const float* tNear, StackEntry* stack, uint32_t& stackPtr)
+        {
+            StackEntry hits[CompressedBvh8::Width];
+            uint32_t hitCount = 0;
+            uint32_t interior = 0, primitive = node.primitiveBase;
+            for (uint32_t i = 0; i < CompressedBvh8::Width; i++) {
+                bool isInterior = (node.internalMask >> i) & 1;
+                StackEntry entry;
+                entry.index = isInterior ? node.childBase + interior : primitive;
+                entry.count = isInterior ? 0 : node.primitiveCount[i];
+                entry.tNear = tNear[i];
+                interior += isInterior ? 1 : 0;
+                primitive += node.primitiveCount[i];
+                if (!((mask >> i) & 1)) {
+                    continue;
+                }
+                // Insertion sort, farthest first.
+                uint32_t j = hitCount++;
+                while (j > 0 && hits[j - 1].tNear < entry.tNear) {
+                    hits[j] = hits[j - 1];
+                    j--;
+                }
+                hits[j] = entry;
+            }
+            for (uint32_t i = 0; i < hitCount; i++) {
+                stack[stackPtr++] = hits[i];
+            }
+        }
+    }
+
+    void CompressedBvh8::Build(const Bvh& bvh)
+    {
+        nodes.clear();
+        primitiveIndices.clear();
+        bounds = Aabb();
+        if (bvh.nodes.empty()) {
+            return;
+        }
+        bounds = bvh.nodes[0].bounds;
+        nodes.reserve(bvh.nodes.size() / 4 + 1);
+        primitiveIndices.reserve(bvh.primitiveIndices.size());
+
+        // Pairs of (binary node, compressed node) still to be converted, breadth first so the
+        // interior children of each compressed node end up contiguous.
+        std::vector<std::pair<uint32_t, uint32_t>> pending;
+        nodes.push_back(Bvh8Node());
+        pending.push_back(std::make_pair(0u, 0u));
+
+        for (size_t p = 0; p < pending.size(); p++) {
+            uint32_t binaryIndex = pending[p].first;
+            uint32_t nodeIndex = pending[p].second;
+            const BvhNode& binary = bvh.nodes[binaryIndex];
+
+            // Collapse: keep opening the largest interior child until there are eight.
+            uint32_t children[Width];
+            uint32_t childCount = 0;
+            if (binary.isLeaf()) {
+                children[childCount++] = binaryIndex;
+            }
+            else {
+                children[childCount++] = binary.leftFirst;
+                children[childCount++] = binary.leftFirst + 1;
+            }
+            while (childCount < Width) {
+                int largest = -1;
+                float largestArea = -1;
+                for (uint32_t i = 0; i < childCount; i++) {
+                    const BvhNode& child = bvh.nodes[children[i]];
+                    if (!child.isLeaf() && child.bounds.surfaceArea() > largestArea) {
+                        largest = static_cast<int>(i);
+                        largestArea = child.bounds.surfaceArea();
+                    }
+                }
+                if (largest < 0) {
+                    break;
+                }
+                uint32_t opened = children[largest];
+                children[largest] = bvh.nodes[opened].leftFirst;
+                children[childCount++] = bvh.nodes[opened].leftFirst + 1;
+            }
+
+            Bvh8Node node = {};
+            Aabb childBounds[Width];
+            for (uint32_t i = 0; i < childCount; i++) {
+                childBounds[i] = bvh.nodes[children[i]].bounds;
+            }
+            Quantise(node, binary.bounds, childBounds, childCount);
+
+            node.childBase = static_cast<uint32_t>(nodes.size());
+            node.primitiveBase = static_cast<uint32_t>(primitiveIndices.size());
+            uint32_t interior = 0;
+            for (uint32_t i = 0; i < childCount; i++) {
+                const BvhNode& child = bvh.nodes[children[i]];
+                if (child.isLeaf()) {
+                    node.primitiveCount[i] = static_cast<uint8_t>(child.count);
+                    for (uint32_t k = 0; k < child.count; k++) {
+                        primitiveIndices.push_back(bvh.primitiveIndices[child.leftFirst + k]);
+                    }
+                }
+                else {
+                    node.internalMask |= static_cast<uint8_t>(1u << i);
+                    pending.push_back(std::make_pair(children[i], node.childBase + interior));
+                    interior++;
+                }
+            }
+            nodes.resize(nodes.size() + interior);
+            nodes[nodeIndex] = node;
+        }
+    }
+
+    bool CompressedBvh8::Intersect(const Scene& scene, const Ray& ray, float tMin, Hit& hit) const
+    {
+        if (nodes.empty()) {
+            return false;
+        }
+        RayContext ctx = MakeRayContext(ray);
+        StackEntry stack[StackSize];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = { 0, 0, 0.0f };
+
+        bool found = false;
+        float tNear[Width];
+        while (stackPtr > 0) {
+            StackEntry entry = stack[--stackPtr];
+            if (entry.tNear > hit.t) {
+                continue;
+            }
+            if (entry.count > 0) {
+                for (uint32_t i = 0; i < entry.count; i++) {
+                    uint32_t prim = primitiveIndices[entry.index + i];
+                    float t;
+                    float3 n;
+                    if (scene.IntersectPrimitive(prim, ray, tMin, hit.t, t, n)) {
+                        hit.t = t;
+                        hit.normal = n;
+                        hit.primitive = prim;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            const Bvh8Node& node = nodes[entry.index];
+            uint32_t mask = IntersectChildren(node, ctx, hit.t, tNear) & OccupiedMask(node);
+            PushChildren(node, mask, tNear, stack, stackPtr);
+        }
+        return found;
+    }
+
+    bool CompressedBvh8::Occluded(const Scene& scene, const Ray& ray, float tMin, float tMax) const
+    {
+        if (nodes.empty()) {
+            return false;
+        }
+        RayContext ctx = MakeRayContext(ray);
+        StackEntry stack[StackSize];
+        uint32_t stackPtr = 0;
+        stack[stackPtr++] = { 0, 0, 0.0f };
+
+        float tNear[Width];
+        while (stackPtr > 0) {
+            StackEntry entry = stack[--stackPtr];
+            if (entry.count > 0) {
+                for (uint32_t i = 0; i < entry.count; i++) {
+                    float t;
+                    float3 n;
+                    if (scene.IntersectPrimitive(primitiveIndices[entry.index + i], ray, tMin, tMax, t, n)) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+            const Bvh8Node& node = nodes[entry.index];
+            uint32_t mask = IntersectChildren(node, ctx, tMax, tNear) & OccupiedMask(node);
+            PushChildren(node, mask, tNear, stack, stackPtr);
+        }
+        return false;
+    }
+
+    size_t CompressedBvh8::MemoryFootprint() const
+    {
+        return nodes.size() * sizeof(Bvh8Node) + primitiveIndices.size() * sizeof(uint32_t);
+    }
+
+    Bvh8BenchmarkResult BenchmarkBvh8(const Scene& scene, const Bvh& bvh, const CompressedBvh8& bvh8, const std::vector<Ray>& rays, unsigned threads)
+    {
+        Bvh8BenchmarkResult result;
+        result.binaryBytes = bvh.MemoryFootprint();
+        result.compressedBytes = bvh8.MemoryFootprint();
+
+        std::vector<uint32_t> binaryHits(rays.size()), compressedHits(rays.size());
+
+        Clock::time_point start = Clock::now();
+        ParallelFor(rays.size(), [&](size_t i, unsigned) {
+            Hit hit;
+            bvh.Intersect(scene, rays[i], 0.001f, hit);
+            binaryHits[i] = hit.primitive;
+        }, threads, 256);
+        double binarySeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        ParallelFor(rays.size(), [&](size_t i, unsigned) {
+            Hit hit;
+            bvh8.Intersect(scene, rays[i], 0.001f, hit);
+            compressedHits[i] = hit.primitive;
+        }, threads, 256);
+        double compressedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.binaryRaysPerSecond = binarySeconds > 0 ? rays.size() / binarySeconds : 0;
+        result.compressedRaysPerSecond = compressedSeconds > 0 ? rays.size() / compressedSeconds : 0;
+        result.mismatches = 0;
+        for (size_t i = 0; i < rays.size(); i++) {
+            result.mismatches += binaryHits[i] != compressedHits[i] ? 1 : 0;
+        }
+        return result;
+    }
+
+    std::string Bvh8BenchmarkSummary(const Bvh8BenchmarkResult& result)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << "binary: " << result.binaryBytes / (1024.0 * 1024.0) << " MB, " << result.binaryRaysPerSecond / 1e6 << " Mrays/s"
+            << " | 8-wide compressed: " << result.compressedBytes / (1024.0 * 1024.0) << " MB, " << result.compressedRaysPerSecond / 1e6 << " Mrays/s"
+            << " | mismatches: " << result.mismatches;
+        return out.str();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuBvh8.h
+//
+// Compressed 8-wide BVH, converted from the binary Bvh. Each node stores the bounds of its
+// children quantised to 8 bits per plane relative to the node's own box, which brings a node
+// holding 8 children down to 80 bytes (against 8 x 32 bytes for the binary layout). Child
+// boxes are tested eight at a time with SSE.
+//
+//**********************************************************************************************
+
+#include "CpuBvh.h"
+#include <string>
+
+namespace Cpu {
+
+    struct Bvh8Node {
+        float3 origin;              // Lower corner of the node box.
+        int8_t exponents[3];        // Child planes are at origin + q * 2^exponent.
+        uint8_t internalMask;       // Bit i set if child i is an interior node.
+        uint32_t childBase;         // First interior child; interior children are contiguous.
+        uint32_t primitiveBase;     // First primitive of the leaf children, in slot order.
+        uint8_t primitiveCount[8];  // Primitive count of leaf children, 0 for interior or empty slots.
+        uint8_t lower[3][8];
+        uint8_t upper[3][8];
+    };
+    static_assert(sizeof(Bvh8Node) == 80, "Bvh8Node is meant to be 80 bytes");
+
+    class CompressedBvh8
+    {
+    public:
+        static const uint32_t Width = 8;
+
+        std::vector<Bvh8Node> nodes;
+        std::vector<uint32_t> primitiveIndices;
+        Aabb bounds;
+
+        void Build(const Bvh& bvh);
+
+        bool Intersect(const Scene& scene, const Ray& ray, float tMin, Hit& hit) const;
+        bool Occluded(const Scene& scene, const Ray& ray, float tMin, float tMax) const;
+
+        size_t MemoryFootprint() const;
+    };
+
+    struct Bvh8BenchmarkResult {
+        size_t binaryBytes;
+        size_t compressedBytes;
+        double binaryRaysPerSecond;
+        double compressedRaysPerSecond;
+        uint32_t mismatches;        // Rays whose closest hit differs between the two layouts.
+    };
+
+    // Traces the same closest-hit rays through both layouts on all threads.
+    Bvh8BenchmarkResult BenchmarkBvh8(const Scene& scene, const Bvh& bvh, const CompressedBvh8& bvh8, const std::vector<Ray>& rays, unsigned threads = 0);
+    std::string Bvh8BenchmarkSummary(const Bvh8BenchmarkResult& result);
+}
@@ -0,0 +1,157 @@
+#include "CpuCameraReplay.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        // Camera::Update's clip planes.
+        const float NearPlane = 0.01f;
+        const float FarPlane = 1000.0f;
+
+        // XMMatrixLookAtRH, row-vector convention.
+        float4x4 LookAtRH(const float3& eye, const float3& at, const float3& up)
+        {
+            float3 z = normalize(eye - at);
+            float3 x = normalize(cross(up, z));
+            float3 y = cross(z, x);
+            float4x4 m = float4x4::Identity();
+            for (int i = 0; i < 3; i++) {
+                m.m[i][0] = x[i];
+                m.m[i][1] = y[i];
+                m.m[i][2] = z[i];
+            }
+            m.m[3][0] = -dot(x, eye);
+            m.m[3][1] = -dot(y, eye);
+            m.m[3][2] = -dot(z, eye);
+            return m;
+        }
+
+        // XMMatrixPerspectiveFovRH.
+        float4x4 PerspectiveFovRH(float fovY, float aspectRatio, float nearZ, float farZ)
+        {
+            float height = 1.0f / std::tan(fovY * 0.5f);
+            float range = farZ / (nearZ - farZ);
+            float4x4 m;
+            std::memset(&m, 0, sizeof(m));
+            m.m[0][0] = height / aspectRatio;
+            m.m[1][1] = height;
+            m.m[2][2] = range;
+            m.m[2][3] = -1.0f;
+            m.m[3][2] = range * nearZ;
+            return m;
+        }
+    }
+
+    CameraParams CameraFromPathState(const CameraPath::State& state, float fovY, float aspectRatio)
+    {
+        float pitch = state.pitch * Pi / 180.0f;
+        float yaw = state.yaw * Pi / 180.0f;
+        float3 position(state.position[0], state.position[1], state.position[2]);
+        float3 front = normalize(float3(std::cos(pitch) * std::cos(yaw), std::sin(pitch), std::cos(pitch) * std::sin(yaw)));
+
+        float4x4 view = LookAtRH(position, position + front, float3(0, 1, 0));
+        float4x4 projection = PerspectiveFovRH(fovY * Pi / 180.0f, aspectRatio, NearPlane, FarPlane);
+        CameraParams camera;
+        camera.position = position;
+        camera.projectionToWorld = inverse(mul(view, projection));
+        return camera;
+    }
+
+    uint64_t FramebufferChecksum(const Framebuffer& framebuffer)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(framebuffer.pixels.data());
+        size_t size = framebuffer.pixels.size() * sizeof(float3);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    double ReplayResult::TotalSeconds() const
+    {
+        double total = 0;
+        for (const ReplayFrame& frame : frames) {
+            total += frame.seconds;
+        }
+        return total;
+    }
+
+    std::string ReplayResult::Summary() const
+    {
+        std::vector<double> times;
+        uint64_t rays = 0;
+        for (const ReplayFrame& frame : frames) {
+            times.push_back(frame.seconds);
+            rays += frame.rays + frame.shadowRays;
+        }
+        std::sort(times.begin(), times.end());
+        size_t percentile95 = times.empty() ? 0 : (std::min)(times.size() - 1, times.size() * 95 / 100);
+        double total = TotalSeconds();
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << frames.size() << " frames";
+        if (!times.empty()) {
+            out << " | mean " << total * 1000.0 / times.size() << " ms"
+                << ", median " << times[times.size() / 2] * 1000.0 << " ms"
+                << ", 95th percentile " << times[percentile95] * 1000.0 << " ms"
+                << ", worst " << times.back() * 1000.0 << " ms"
+                << " | " << (total > 0 ? rays / total / 1e6 : 0) << " Mrays/s";
+        }
+        return out.str();
+    }
+
+    void ReplayCameraPath(const Scene& scene, const Bvh& bvh, const CameraPath::Path& path, const ReplaySettings& settings, ReplayResult& result)
+    {
+        result.frames.clear();
+        uint32_t frames = (std::min)(path.FrameCount(settings.timestep), settings.maxFrames);
+        float aspectRatio = static_cast<float>(settings.width) / settings.height;
+        Tracer tracer(scene, bvh);
+        RenderSettings render = settings.render;
+        Framebuffer framebuffer;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            ReplayFrame record;
+            record.frame = frame;
+            record.time = frame * settings.timestep;
+            record.state = path.Sample(record.time);
+            CameraParams camera = CameraFromPathState(record.state, path.FovY(), aspectRatio);
+
+            render.frameIndex = frame;
+            framebuffer.Resize(settings.width, settings.height);
+            RenderStats stats;
+            tracer.Render(camera, render, framebuffer, stats);
+
+            record.seconds = stats.totalSeconds;
+            record.rays = 0;
+            for (uint32_t bounce = 0; bounce < MaxTrackedBounces; bounce++) {
+                record.rays += stats.rays[bounce];
+            }
+            record.shadowRays = stats.shadowRays;
+            record.checksum = FramebufferChecksum(framebuffer);
+            result.frames.push_back(record);
+        }
+    }
+
+    bool WriteReplayCsv(const std::string& filename, const ReplayResult& result)
+    {
+        std::ofstream out(filename);
+        if (!out) {
+            return false;
+        }
+        out << "frame,time,x,y,z,yaw,pitch,ms,rays,shadow_rays,mrays_per_second,checksum\n";
+        for (const ReplayFrame& frame : result.frames) {
+            double mrays = frame.seconds > 0 ? (frame.rays + frame.shadowRays) / frame.seconds / 1e6 : 0;
+            out << frame.frame << "," << std::setprecision(6) << frame.time << ","
+                << frame.state.position[0] << "," << frame.state.position[1] << "," << frame.state.position[2] << ","
+                << frame.state.yaw << "," << frame.state.pitch << ","
+                << std::fixed << std::setprecision(3) << frame.seconds * 1000.0 << "," << std::defaultfloat
+                << frame.rays << "," << frame.shadowRays << "," << std::setprecision(4) << mrays << ","
+                << std::hex << std::setw(16) << std::setfill('0') << frame.checksum << std::dec << std::setfill(' ') << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+}
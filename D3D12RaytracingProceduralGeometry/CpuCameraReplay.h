@@ -0,0 +1,57 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuCameraReplay.h
+//
+// Plays a recorded camera path (CameraPath.h) through the CPU tracer and times every frame.
+// Frames are sampled from the path at a fixed timestep and seeded by their frame number, so
+// a replay renders the same images whatever the machine or thread count; each frame's row in
+// the CSV carries a checksum of its pixels to show it. Comparing two builds' CSVs then
+// compares their speed on identical work.
+//
+//**********************************************************************************************
+
+#include "CameraPath.h"
+#include "CpuTracer.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    // The camera Camera::Update builds for a path state: a right-handed look-at along yaw and
+    // pitch, and a right-handed perspective of fovY degrees with the same clip planes.
+    CameraParams CameraFromPathState(const CameraPath::State& state, float fovY, float aspectRatio);
+
+    // FNV-1a of the framebuffer's bits, to tell whether two renders are bit-identical.
+    uint64_t FramebufferChecksum(const Framebuffer& framebuffer);
+
+    struct ReplaySettings {
+        uint32_t width = 640;
+        uint32_t height = 360;
+        double timestep = 1.0 / 60.0;       // Path seconds a frame.
+        uint32_t maxFrames = UINT32_MAX;
+        RenderSettings render;              // frameIndex is set per frame.
+    };
+
+    struct ReplayFrame {
+        uint32_t frame;
+        double time;                        // Path seconds.
+        CameraPath::State state;
+        double seconds;                     // Render wall clock.
+        uint64_t rays;                      // Extension rays over all bounces.
+        uint64_t shadowRays;
+        uint64_t checksum;                  // FramebufferChecksum of the frame.
+    };
+
+    struct ReplayResult {
+        std::vector<ReplayFrame> frames;
+
+        double TotalSeconds() const;
+        std::string Summary() const;
+    };
+
+    void ReplayCameraPath(const Scene& scene, const Bvh& bvh, const CameraPath::Path& path, const ReplaySettings& settings, ReplayResult& result);
+    // One row a frame: frame, time, camera state, milliseconds, rays, Mrays/s and checksum.
+    bool WriteReplayCsv(const std::string& filename, const ReplayResult& result);
+}
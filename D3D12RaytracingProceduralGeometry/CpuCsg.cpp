@@ -0,0 +1,335 @@
+#include "CpuCsg.h"
+#include "CpuSdf.h"
+
+namespace Cpu {
+
+    namespace {
+        const uint32_t MaxSpans = 8;
+        const uint32_t MaxStackDepth = 16;
+
+        // Part of the ray inside a solid, with the outward normals at both ends.
+        struct Span {
+            float t0, t1;
+            float3 n0, n1;
+        };
+
+        // Sorted, disjoint spans. Spans beyond MaxSpans are dropped.
+        struct SpanList {
+            Span spans[MaxSpans];
+            uint32_t count;
+
+            SpanList() : count(0) {}
+            void Push(const Span& s)
+            {
+                if (count < MaxSpans && s.t1 > s.t0) {
+                    spans[count++] = s;
+                }
+            }
+        };
+
+        Span MakeSpan(float t0, float t1, const float3& n0, const float3& n1)
+        {
+            Span s;
+            s.t0 = t0; s.t1 = t1; s.n0 = n0; s.n1 = n1;
+            return s;
+        }
+
+        Aabb ShapeBounds(CsgShape::Enum shape)
+        {
+            if (shape == CsgShape::Torus) {
+                float r = TorusRadii.x + TorusRadii.y;
+                return Aabb(float3(-r, -r, -TorusRadii.y), float3(r, r, TorusRadii.y));
+            }
+            return Aabb(float3(-1.0f), float3(1.0f));
+        }
+
+        // Entry and exit of the [-1, 1] slab along one axis.
+        bool Slab(float o, float d, float& t0, float& t1)
+        {
+            if (d == 0) {
+                t0 = -Infinity;
+                t1 = Infinity;
+                return std::fabs(o) <= 1;
+            }
+            float a = (-1 - o) / d, b = (1 - o) / d;
+            t0 = (std::min)(a, b);
+            t1 = (std::max)(a, b);
+            return true;
+        }
+
+        SpanList ShapeSpans(CsgShape::Enum shape, const Ray& r, RayCounters* counters)
+        {
+            SpanList list;
+            switch (shape) {
+            case CsgShape::Sphere: {
+                if (counters) counters->value[RayCounter::QuadricSolves]++;
+                float a = dot(r.direction, r.direction);
+                float b = 2 * dot(r.origin, r.direction);
+                float c = dot(r.origin, r.origin) - 1;
+                float discr = b * b - 4 * a * c;
+                if (discr <= 0) break;
+                float sq = std::sqrt(discr);
+                float t0 = (-b - sq) / (2 * a), t1 = (-b + sq) / (2 * a);
+                list.Push(MakeSpan(t0, t1, r.origin + t0 * r.direction, r.origin + t1 * r.direction));
+                break;
+            }
+            case CsgShape::Box: {
+                float t0 = -Infinity, t1 = Infinity;
+                int axis0 = 0, axis1 = 0;
+                for (int axis = 0; axis < 3; axis++) {
+                    float a, b;
+                    if (!Slab(r.origin[axis], r.direction[axis], a, b)) return list;
+                    if (a > t0) { t0 = a; axis0 = axis; }
+                    if (b < t1) { t1 = b; axis1 = axis; }
+                }
+                float3 n0(0.0f), n1(0.0f);
+                n0[axis0] = r.direction[axis0] > 0 ? -1.0f : 1.0f;
+                n1[axis1] = r.direction[axis1] > 0 ? 1.0f : -1.0f;
+                list.Push(MakeSpan(t0, t1, n0, n1));
+                break;
+            }
+            case CsgShape::Cylinder: {
+                // Infinite x^2 + z^2 = 1 cylinder clipped by the y slab.
+                if (counters) counters->value[RayCounter::QuadricSolves]++;
+                float a = r.direction.x * r.direction.x + r.direction.z * r.direction.z;
+                float b = 2 * (r.origin.x * r.direction.x + r.origin.z * r.direction.z);
+                float c = r.origin.x * r.origin.x + r.origin.z * r.origin.z - 1;
+                float t0, t1;
+                if (a == 0) {
+                    if (c > 0) break;
+                    t0 = -Infinity;
+                    t1 = Infinity;
+                }
+                else {
+                    float discr = b * b - 4 * a * c;
+                    if (discr <= 0) break;
+                    float sq = std::sqrt(discr);
+                    t0 = (-b - sq) / (2 * a);
+                    t1 = (-b + sq) / (2 * a);
+                }
+                float3 p0 = r.origin + t0 * r.direction, p1 = r.origin + t1 * r.direction;
+                float3 n0(p0.x, 0, p0.z), n1(p1.x, 0, p1.z);
+                float y0, y1;
+                if (!Slab(r.origin.y, r.direction.y, y0, y1)) break;
+                if (y0 > t0) { t0 = y0; n0 = float3(0, r.direction.y > 0 ? -1.0f : 1.0f, 0); }
+                if (y1 < t1) { t1 = y1; n1 = float3(0, r.direction.y > 0 ? 1.0f : -1.0f, 0); }
+                list.Push(MakeSpan(t0, t1, n0, n1));
+                break;
+            }
+            case CsgShape::Torus: {
+                // Clip to the torus box over the whole line (spans behind the origin still matter
+                // for the operators), then alternate tracing to the next entry and marching out.
+                float3 invDir = SafeInverse(r.direction);
+                Aabb box = ShapeBounds(shape);
+                float t0 = -Infinity, t1 = Infinity;
+                for (int axis = 0; axis < 3; axis++) {
+                    if (r.direction[axis] == 0) {
+                        if (r.origin[axis] < box.lower[axis] || r.origin[axis] > box.upper[axis]) return list;
+                        continue;
+                    }
+                    float a = (box.lower[axis] - r.origin[axis]) * invDir[axis];
+                    float b = (box.upper[axis] - r.origin[axis]) * invDir[axis];
+                    t0 = (std::max)(t0, (std::min)(a, b));
+                    t1 = (std::min)(t1, (std::max)(a, b));
+                }
+                auto torus = [](const float3& p) { return sdTorus(p, TorusRadii); };
+                float t = t0;
+                while (t < t1 && list.count < MaxSpans) {
+                    float enter, exit;
+                    if (torus(r.origin + t * r.direction) >= SdfThreshold) {
+                        if (!SphereTrace(r, t, t1, torus, enter, counters)) break;
+                    }
+                    else {
+                        enter = t;
+                    }
+                    float step = 2 * SdfThreshold / length(r.direction);
+                    SphereTraceExit(r, enter + step, t1, torus, exit, counters);
+                    list.Push(MakeSpan(enter, exit, SdfNormal(r.origin + enter * r.direction, torus), SdfNormal(r.origin + exit * r.direction, torus)));
+                    t = exit + step;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            return list;
+        }
+
+        SpanList Union(const SpanList& a, const SpanList& b)
+        {
+            SpanList out;
+            uint32_t i = 0, j = 0;
+            while (i < a.count || j < b.count) {
+                Span next = (j >= b.count || (i < a.count && a.spans[i].t0 <= b.spans[j].t0)) ? a.spans[i++] : b.spans[j++];
+                if (out.count > 0 && next.t0 <= out.spans[out.count - 1].t1) {
+                    Span& last = out.spans[out.count - 1];
+                    if (next.t1 > last.t1) {
+                        last.t1 = next.t1;
+                        last.n1 = next.n1;
+                    }
+                }
+                else {
+                    out.Push(next);
+                }
+            }
+            return out;
+        }
+
+        SpanList Intersection(const SpanList& a, const SpanList& b)
+        {
+            SpanList out;
+            uint32_t i = 0, j = 0;
+            while (i < a.count && j < b.count) {
+                const Span& x = a.spans[i];
+                const Span& y = b.spans[j];
+                Span s;
+                if (x.t0 > y.t0) { s.t0 = x.t0; s.n0 = x.n0; } else { s.t0 = y.t0; s.n0 = y.n0; }
+                if (x.t1 < y.t1) { s.t1 = x.t1; s.n1 = x.n1; i++; } else { s.t1 = y.t1; s.n1 = y.n1; j++; }
+                out.Push(s);
+            }
+            return out;
+        }
+
+        // Where the right operand cuts into the left, the surface is the inside of the right
+        // solid, so its normals are flipped.
+        SpanList Difference(const SpanList& a, const SpanList& b)
+        {
+            SpanList out;
+            for (uint32_t i = 0; i < a.count; i++) {
+                Span current = a.spans[i];
+                bool empty = false;
+                for (uint32_t j = 0; j < b.count && !empty; j++) {
+                    const Span& cut = b.spans[j];
+                    if (cut.t1 <= current.t0) continue;
+                    if (cut.t0 >= current.t1) break;
+                    if (cut.t0 > current.t0) {
+                        out.Push(MakeSpan(current.t0, cut.t0, current.n0, -cut.n0));
+                    }
+                    current.t0 = cut.t1;
+                    current.n0 = -cut.n1;
+                    empty = current.t0 >= current.t1;
+                }
+                if (!empty) {
+                    out.Push(current);
+                }
+            }
+            return out;
+        }
+    }
+
+    CsgNode CsgNode::Solid(CsgShape::Enum shape, const float3& translation, const float3& scale)
+    {
+        CsgNode node;
+        node.op = CsgOp::Leaf;
+        node.shape = shape;
+        node.translation = translation;
+        node.scale = scale;
+        return node;
+    }
+
+    CsgNode CsgNode::Operator(CsgOp::Enum op)
+    {
+        CsgNode node;
+        node.op = op;
+        node.shape = CsgShape::Count;
+        node.translation = float3(0.0f);
+        node.scale = float3(1.0f);
+        return node;
+    }
+
+    Aabb CsgTree::LocalBounds() const
+    {
+        Aabb stack[MaxStackDepth];
+        uint32_t depth = 0;
+        for (const CsgNode& node : nodes) {
+            if (node.op == CsgOp::Leaf) {
+                Aabb b = ShapeBounds(node.shape);
+                stack[depth++] = Aabb(b.lower * node.scale + node.translation, b.upper * node.scale + node.translation);
+                continue;
+            }
+            Aabb right = stack[--depth];
+            Aabb& left = stack[depth - 1];
+            if (node.op == CsgOp::Union) {
+                left.grow(right);
+            }
+            else if (node.op == CsgOp::Intersection) {
+                left = Aabb(max3(left.lower, right.lower), min3(left.upper, right.upper));
+            }
+        }
+        return depth > 0 ? stack[0] : Aabb();
+    }
+
+    CsgTree CsgTree::CoffeeMug()
+    {
+        // Dimensions follow the BigCylinder/SmallCylinder quadrics and the torus handle of the
+        // GPU mug; the handle's box only cuts away the half of the torus inside the cup.
+        CsgTree tree;
+        tree.nodes.push_back(CsgNode::Solid(CsgShape::Cylinder, float3(0.0f), float3(std::sqrt(1.5f), 1.0f, std::sqrt(1.5f))));
+        tree.nodes.push_back(CsgNode::Solid(CsgShape::Cylinder, float3(0.0f, 0.175f, 0.0f), float3(1.0f, 1.125f, 1.0f)));
+        tree.nodes.push_back(CsgNode::Operator(CsgOp::Difference));
+        tree.nodes.push_back(CsgNode::Solid(CsgShape::Torus, float3(1.1f, 0.0f, 0.0f)));
+        tree.nodes.push_back(CsgNode::Solid(CsgShape::Box, float3(0.1f, 0.0f, 0.0f)));
+        tree.nodes.push_back(CsgNode::Operator(CsgOp::Difference));
+        tree.nodes.push_back(CsgNode::Operator(CsgOp::Union));
+        return tree;
+    }
+
+    bool IntersectCsg(const CsgTree& tree, const Ray& ray, float tMin, float tMax, float& tHit, float3& normal, RayCounters* counters)
+    {
+        SpanList stack[MaxStackDepth];
+        uint32_t depth = 0;
+        for (const CsgNode& node : tree.nodes) {
+            if (node.op == CsgOp::Leaf) {
+                if (depth >= MaxStackDepth) {
+                    return false;
+                }
+                Ray local;
+                local.origin = (ray.origin - node.translation) / node.scale;
+                local.direction = ray.direction / node.scale;
+                stack[depth] = ShapeSpans(node.shape, local, counters);
+                // Back to tree space: inverse transpose of the scale.
+                for (uint32_t i = 0; i < stack[depth].count; i++) {
+                    stack[depth].spans[i].n0 = stack[depth].spans[i].n0 / node.scale;
+                    stack[depth].spans[i].n1 = stack[depth].spans[i].n1 / node.scale;
+                }
+                depth++;
+            }
+            else {
+                if (depth < 2) {
+                    return false;
+                }
+                const SpanList& right = stack[depth - 1];
+                SpanList& left = stack[depth - 2];
+                switch (node.op) {
+                case CsgOp::Union: left = Union(left, right); break;
+                case CsgOp::Intersection: left = Intersection(left, right); break;
+                case CsgOp::Difference: left = Difference(left, right); break;
+                default: break;
+                }
+                depth--;
+            }
+            if (counters) {
+                counters->value[RayCounter::CsgStackDepth] = (std::max)(counters->value[RayCounter::CsgStackDepth], depth);
+            }
+        }
+        if (depth == 0) {
+            return false;
+        }
+
+        const SpanList& result = stack[0];
+        for (uint32_t i = 0; i < result.count; i++) {
+            const Span& s = result.spans[i];
+            if (s.t0 >= tMin && s.t0 <= tMax) {
+                tHit = s.t0;
+                normal = normalize(s.n0);
+                return true;
+            }
+            if (s.t0 < tMin && s.t1 >= tMin && s.t1 <= tMax) {
+                tHit = s.t1;
+                normal = normalize(s.n1);
+                return true;
+            }
+        }
+        return false;
+    }
+}
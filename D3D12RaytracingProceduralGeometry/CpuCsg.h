@@ -0,0 +1,62 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuCsg.h
+//
+// CSG trees for the CPU tracer. Like the csgTree buffer built in Scene::convertCSGToArray,
+// a tree is a post-order array of leaves and boolean operators. Each leaf yields the spans
+// of the ray that lie inside it, and the operators combine span lists on a small stack.
+//
+//**********************************************************************************************
+
+#include "CpuMath.h"
+#include <vector>
+
+namespace Cpu {
+
+    struct RayCounters;
+
+    namespace CsgOp {
+        enum Enum {
+            Leaf = 0,
+            Union,
+            Intersection,
+            Difference,         // Left minus right.
+            Count
+        };
+    }
+
+    // Closed solids usable as leaves, all in a [-1, 1] local box.
+    namespace CsgShape {
+        enum Enum {
+            Sphere = 0,
+            Box,
+            Cylinder,           // Capped, along y.
+            Torus,              // Sphere traced, same radii as PrimitiveType::Torus.
+            Count
+        };
+    }
+
+    struct CsgNode {
+        CsgOp::Enum op;
+        CsgShape::Enum shape;
+        float3 translation;     // Leaf placement: p = shape * scale + translation.
+        float3 scale;
+
+        static CsgNode Solid(CsgShape::Enum shape, const float3& translation, const float3& scale = float3(1.0f));
+        static CsgNode Operator(CsgOp::Enum op);
+    };
+
+    struct CsgTree {
+        std::vector<CsgNode> nodes;     // Post-order.
+
+        Aabb LocalBounds() const;
+
+        // The coffee mug from Scene::convertCSGToArray: (big cylinder - small cylinder) + (torus - box).
+        static CsgTree CoffeeMug();
+    };
+
+    // Ray in tree space; may be unnormalised. The normal faces out of the solid.
+    bool IntersectCsg(const CsgTree& tree, const Ray& ray, float tMin, float tMax, float& tHit, float3& normal, RayCounters* counters = nullptr);
+}
@@ -0,0 +1,504 @@
+#include "CpuDenoiser.h"
+#include "CpuGBuffer.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CPU_DENOISER_SSE 1
+#endif
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        // B3-spline taps of the a-trous kernel.
+        const float AtrousKernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+        // History shorter than this gets its variance from the neighbourhood.
+        const float MinimumMomentsHistory = 4.0f;
+        const float MinimumAlbedo = 1e-3f;
+        const float MinimumNormalCosine = 0.9f;
+        const float DepthTolerance = 0.02f;         // Of the depth, on top of the gradient.
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        float3 Demodulate(const float3& colour, const float3& albedo)
+        {
+            return float3(colour.x / (std::max)(albedo.x, MinimumAlbedo), colour.y / (std::max)(albedo.y, MinimumAlbedo), colour.z / (std::max)(albedo.z, MinimumAlbedo));
+        }
+
+        float3 Remodulate(const float3& illumination, const float3& albedo)
+        {
+            return float3(illumination.x * (std::max)(albedo.x, MinimumAlbedo), illumination.y * (std::max)(albedo.y, MinimumAlbedo), illumination.z * (std::max)(albedo.z, MinimumAlbedo));
+        }
+
+        // cosine^power by squaring; the power is an integer so this is a handful of multiplies
+        // rather than a pow per tap.
+        float NormalWeight(float cosine, uint32_t power)
+        {
+            float base = (std::max)(cosine, 0.0f);
+            float result = 1.0f;
+            while (power > 0) {
+                if (power & 1) {
+                    result *= base;
+                }
+                base *= base;
+                power >>= 1;
+            }
+            return result;
+        }
+
+        CameraParams TranslateCamera(const CameraParams& camera, const float3& offset)
+        {
+            CameraParams moved;
+            moved.position = camera.position + offset;
+            moved.projectionToWorld = mul(camera.projectionToWorld, float4x4::Translation(offset));
+            return moved;
+        }
+
+        double Rmse(const Framebuffer& image, const Framebuffer& reference)
+        {
+            double sum = 0;
+            for (size_t i = 0; i < reference.pixels.size(); i++) {
+                float3 d = image.pixels[i] - reference.pixels[i];
+                sum += dot(d, d) / 3.0;
+            }
+            return reference.pixels.empty() ? 0 : std::sqrt(sum / reference.pixels.size());
+        }
+    }
+
+    std::string DenoiserStats::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << frames << " frames"
+            << " | temporal " << (frames > 0 ? temporalSeconds * 1000.0 / frames : 0) << " ms, filter " << (frames > 0 ? filterSeconds * 1000.0 / frames : 0) << " ms a frame"
+            << " | " << PixelsPerSecond() / 1e6 << " Mpixels/s"
+            << " | " << (pixels > 0 ? 100.0 * disoccluded / pixels : 0) << "% disoccluded";
+        return out.str();
+    }
+
+    Denoiser::Denoiser(const DenoiserSettings& settings) :
+        m_settings(settings)
+    {
+    }
+
+    void Denoiser::Reset()
+    {
+        m_hasHistory = false;
+    }
+
+    void Denoiser::Resize(uint32_t width, uint32_t height)
+    {
+        m_width = width;
+        m_height = height;
+        size_t pixels = static_cast<size_t>(width) * height;
+        m_surfaces.assign(pixels, Surface());
+        m_previousSurfaces.assign(pixels, Surface());
+        m_illumination.assign(pixels, float3(0.0f));
+        m_history.assign(pixels, float3(0.0f));
+        m_nextHistory.assign(pixels, float3(0.0f));
+        m_moments.assign(pixels, float2());
+        m_previousMoments.assign(pixels, float2());
+        m_historyLength.assign(pixels, 0.0f);
+        m_previousHistoryLength.assign(pixels, 0.0f);
+        m_filter[0].assign(pixels, float4());
+        m_filter[1].assign(pixels, float4());
+        m_hasHistory = false;
+    }
+
+    void Denoiser::Denoise(const CameraParams& camera, const Framebuffer& colour, const std::vector<PackedGBufferTexel>& gbuffer, Framebuffer& output, DenoiserStats& stats)
+    {
+        if (colour.width != m_width || colour.height != m_height) {
+            Resize(colour.width, colour.height);
+        }
+        size_t pixels = static_cast<size_t>(m_width) * m_height;
+        Clock::time_point start = Clock::now();
+
+        DecodeSurfaces(camera, colour, gbuffer);
+
+        std::vector<uint64_t> disoccluded(WorkerCount(m_settings.threads), 0);
+        ParallelFor(m_height, [&](size_t y, unsigned worker) {
+            disoccluded[worker] += Reproject(static_cast<uint32_t>(y));
+        }, m_settings.threads, 4);
+
+        ParallelFor(pixels, [&](size_t i, unsigned) {
+            float variance = 0;
+            if (m_surfaces[i].depth > 0) {
+                variance = m_historyLength[i] < MinimumMomentsHistory
+                    ? SpatialVariance(static_cast<uint32_t>(i % m_width), static_cast<uint32_t>(i / m_width))
+                    : (std::max)(0.0f, m_moments[i].y - m_moments[i].x * m_moments[i].x);
+            }
+            m_filter[0][i].w = variance;
+        }, m_settings.threads, 1024);
+        stats.temporalSeconds += SecondsSince(start);
+
+        start = Clock::now();
+        uint32_t current = 0;
+        for (uint32_t pass = 0; pass < m_settings.atrousIterations; pass++) {
+            ParallelFor(m_height, [&](size_t y, unsigned) {
+                Atrous(m_filter[current], m_filter[current ^ 1], 1u << pass, static_cast<uint32_t>(y));
+            }, m_settings.threads, 4);
+            current ^= 1;
+            if (pass == 0) {
+                for (size_t i = 0; i < pixels; i++) {
+                    m_nextHistory[i] = m_filter[current][i].xyz();
+                }
+            }
+        }
+        if (m_settings.atrousIterations == 0) {
+            for (size_t i = 0; i < pixels; i++) {
+                m_nextHistory[i] = m_filter[0][i].xyz();
+            }
+        }
+
+        output.Resize(m_width, m_height);
+        ParallelFor(pixels, [&](size_t i, unsigned) {
+            output.pixels[i] = m_surfaces[i].depth > 0 ? Remodulate(m_filter[current][i].xyz(), m_surfaces[i].albedo) : colour.pixels[i];
+        }, m_settings.threads, 1024);
+        stats.filterSeconds += SecondsSince(start);
+
+        std::swap(m_surfaces, m_previousSurfaces);
+        std::swap(m_moments, m_previousMoments);
+        std::swap(m_historyLength, m_previousHistoryLength);
+        std::swap(m_history, m_nextHistory);
+        m_previousCamera = camera;
+        m_hasHistory = true;
+
+        stats.frames++;
+        stats.pixels += pixels;
+        stats.disoccluded += std::accumulate(disoccluded.begin(), disoccluded.end(), uint64_t(0));
+    }
+
+    void Denoiser::DecodeSurfaces(const CameraParams& camera, const Framebuffer& colour, const std::vector<PackedGBufferTexel>& gbuffer)
+    {
+        ParallelFor(m_height, [&](size_t y, unsigned) {
+            for (uint32_t x = 0; x < m_width; x++) {
+                size_t i = y * m_width + x;
+                Surface& surface = m_surfaces[i];
+                const PackedGBufferTexel& texel = gbuffer[i];
+                if (!GBufferHit(texel)) {
+                    surface = Surface();
+                    m_illumination[i] = colour.pixels[i];
+                    continue;
+                }
+                Ray ray = GenerateCameraRay(x, static_cast<uint32_t>(y), m_width, m_height, camera);
+                PackedPhotonFloat3 normal = DecodeGBufferNormal(texel.y);
+                PackedPhotonFloat3 albedo = DecodeGBufferColour(texel);
+                surface.depth = DecodeGBufferDepth(texel);
+                surface.position = ray.origin + surface.depth * ray.direction;
+                surface.normal = float3(normal.x, normal.y, normal.z);
+                surface.albedo = float3(albedo.x, albedo.y, albedo.z);
+                surface.material = DecodeGBufferMaterial(texel);
+                m_illumination[i] = Demodulate(colour.pixels[i], surface.albedo);
+            }
+        }, m_settings.threads, 4);
+
+        ParallelFor(m_height, [&](size_t y, unsigned) {
+            for (uint32_t x = 0; x < m_width; x++) {
+                size_t i = y * m_width + x;
+                Surface& surface = m_surfaces[i];
+                float gradient = 0;
+                if (x + 1 < m_width && m_surfaces[i + 1].depth > 0) {
+                    gradient = std::fabs(m_surfaces[i + 1].depth - surface.depth);
+                }
+                if (y + 1 < m_height && m_surfaces[i + m_width].depth > 0) {
+                    gradient = (std::max)(gradient, std::fabs(m_surfaces[i + m_width].depth - surface.depth));
+                }
+                surface.depthGradient = gradient;
+            }
+        }, m_settings.threads, 4);
+    }
+
+    // The previous pixel holds the same surface if its depth, seen from the previous camera,
+    // matches where this one's position lands, and its normal and material agree.
+    bool Denoiser::Consistent(const Surface& surface, size_t previous) const
+    {
+        const Surface& other = m_previousSurfaces[previous];
+        if (other.depth <= 0 || other.material != surface.material || dot(other.normal, surface.normal) < MinimumNormalCosine) {
+            return false;
+        }
+        float expected = length(surface.position - m_previousCamera.position);
+        return std::fabs(expected - other.depth) <= DepthTolerance * expected + 2.0f * other.depthGradient;
+    }
+
+    // Bilinear reprojection: the four previous pixels around where this one lands, each kept
+    // if it passes Consistent, reweighted over the ones kept. Returns the pixels of row y
+    // that found no history.
+    uint64_t Denoiser::Reproject(uint32_t y)
+    {
+        float4x4 worldToProjection = inverse(m_previousCamera.projectionToWorld);
+        uint64_t disoccluded = 0;
+        for (uint32_t x = 0; x < m_width; x++) {
+            size_t i = static_cast<size_t>(y) * m_width + x;
+            const Surface& surface = m_surfaces[i];
+            float3 illumination = m_illumination[i];
+            if (surface.depth <= 0) {
+                m_filter[0][i] = float4(illumination, 0.0f);
+                m_moments[i] = float2();
+                m_historyLength[i] = 0;
+                continue;
+            }
+
+            float3 history(0.0f);
+            float2 moments;
+            float length = 0;
+            float weightSum = 0;
+            if (m_hasHistory) {
+                float4 clip = mul(float4(surface.position, 1.0f), worldToProjection);
+                if (clip.w > 0) {
+                    float px = (clip.x / clip.w * 0.5f + 0.5f) * m_width - 0.5f;
+                    float py = (0.5f - clip.y / clip.w * 0.5f) * m_height - 0.5f;
+                    float fx = std::floor(px), fy = std::floor(py);
+                    float tx = px - fx, ty = py - fy;
+                    for (int tap = 0; tap < 4; tap++) {
+                        int sx = static_cast<int>(fx) + (tap & 1);
+                        int sy = static_cast<int>(fy) + (tap >> 1);
+                        if (sx < 0 || sy < 0 || sx >= static_cast<int>(m_width) || sy >= static_cast<int>(m_height)) {
+                            continue;
+                        }
+                        size_t previous = static_cast<size_t>(sy) * m_width + sx;
+                        if (!Consistent(surface, previous)) {
+                            continue;
+                        }
+                        float weight = ((tap & 1) ? tx : 1.0f - tx) * ((tap >> 1) ? ty : 1.0f - ty);
+                        history += m_history[previous] * weight;
+                        moments.x += m_previousMoments[previous].x * weight;
+                        moments.y += m_previousMoments[previous].y * weight;
+                        length += m_previousHistoryLength[previous] * weight;
+                        weightSum += weight;
+                    }
+                }
+            }
+
+            float luma = luminance(illumination);
+            if (weightSum > 0.01f) {
+                float inverseWeight = 1.0f / weightSum;
+                history = history * inverseWeight;
+                moments = float2(moments.x * inverseWeight, moments.y * inverseWeight);
+                length = (std::min)(length * inverseWeight + 1.0f, static_cast<float>(m_settings.maxHistory));
+            }
+            else {
+                history = illumination;
+                moments = float2(luma, luma * luma);
+                length = 1.0f;
+                disoccluded++;
+            }
+
+            // A short history is averaged evenly; a long one decays by the alphas.
+            float alpha = (std::max)(m_settings.colourAlpha, 1.0f / length);
+            float momentsAlpha = (std::max)(m_settings.momentsAlpha, 1.0f / length);
+            float3 integrated = history + (illumination - history) * alpha;
+            m_moments[i] = float2(moments.x + (luma - moments.x) * momentsAlpha, moments.y + (luma * luma - moments.y) * momentsAlpha);
+            m_historyLength[i] = length;
+            m_filter[0][i] = float4(integrated, 0.0f);
+        }
+        return disoccluded;
+    }
+
+    // Luminance variance over a 7x7 neighbourhood of the same surface, for pixels whose
+    // moments have too little history to be trusted.
+    float Denoiser::SpatialVariance(uint32_t x, uint32_t y) const
+    {
+        size_t centre = static_cast<size_t>(y) * m_width + x;
+        const Surface& surface = m_surfaces[centre];
+        float sum = 0, sumSquares = 0, weightSum = 0;
+        for (int dy = -3; dy <= 3; dy++) {
+            for (int dx = -3; dx <= 3; dx++) {
+                int sx = static_cast<int>(x) + dx;
+                int sy = static_cast<int>(y) + dy;
+                if (sx < 0 || sy < 0 || sx >= static_cast<int>(m_width) || sy >= static_cast<int>(m_height)) {
+                    continue;
+                }
+                size_t j = static_cast<size_t>(sy) * m_width + sx;
+                const Surface& other = m_surfaces[j];
+                if (other.depth <= 0) {
+                    continue;
+                }
+                float offset = static_cast<float>((std::max)(std::abs(dx), std::abs(dy)));
+                float depthWeight = std::fabs(other.depth - surface.depth) / (m_settings.phiDepth * surface.depthGradient * offset + 1e-4f);
+                float weight = NormalWeight(dot(other.normal, surface.normal), m_settings.phiNormal) * std::exp(-depthWeight);
+                float luma = luminance(m_illumination[j]);
+                sum += luma * weight;
+                sumSquares += luma * luma * weight;
+                weightSum += weight;
+            }
+        }
+        if (weightSum <= 0) {
+            return 0;
+        }
+        float mean = sum / weightSum;
+        // Few frames of history: boost the estimate, as the pixel is still converging.
+        return (std::max)(0.0f, sumSquares / weightSum - mean * mean) * (MinimumMomentsHistory / (std::max)(m_historyLength[centre], 1.0f));
+    }
+
+    // One a-trous pass over row y, taps step pixels apart. Colour is weighted by w and variance
+    // by w squared, so the variance stays that of the filtered colour.
+    void Denoiser::Atrous(const std::vector<float4>& in, std::vector<float4>& out, uint32_t step, uint32_t y) const
+    {
+        int width = static_cast<int>(m_width);
+        int height = static_cast<int>(m_height);
+        for (int x = 0; x < width; x++) {
+            size_t i = static_cast<size_t>(y) * m_width + x;
+            const Surface& surface = m_surfaces[i];
+            if (surface.depth <= 0) {
+                out[i] = in[i];
+                continue;
+            }
+
+            // The luminance weight is scaled by the variance blurred over 3x3, which is steadier
+            // than the pixel's own.
+            float variance = 0, varianceWeight = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int sx = x + dx, sy = static_cast<int>(y) + dy;
+                    if (sx >= 0 && sy >= 0 && sx < width && sy < height) {
+                        float k = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                        variance += in[static_cast<size_t>(sy) * m_width + sx].w * k;
+                        varianceWeight += k;
+                    }
+                }
+            }
+            float luminanceScale = 1.0f / (m_settings.phiColour * std::sqrt((std::max)(variance / varianceWeight, 0.0f)) + 1e-6f);
+            float centreLuma = luminance(in[i].xyz());
+            // Depth tolerance grows with the distance to the tap: one or two steps out.
+            float depthScale[3] = {
+                0.0f,
+                1.0f / (m_settings.phiDepth * surface.depthGradient * step + 1e-4f),
+                1.0f / (m_settings.phiDepth * surface.depthGradient * step * 2.0f + 1e-4f) };
+
+#ifdef CPU_DENOISER_SSE
+            __m128 sum = _mm_setzero_ps();
+#else
+            float4 sum;
+#endif
+            float weightSum = 0;
+            for (int ky = -2; ky <= 2; ky++) {
+                int sy = static_cast<int>(y) + ky * static_cast<int>(step);
+                if (sy < 0 || sy >= height) {
+                    continue;
+                }
+                for (int kx = -2; kx <= 2; kx++) {
+                    int sx = x + kx * static_cast<int>(step);
+                    if (sx < 0 || sx >= width) {
+                        continue;
+                    }
+                    size_t j = static_cast<size_t>(sy) * m_width + sx;
+                    const Surface& other = m_surfaces[j];
+                    if (other.depth <= 0) {
+                        continue;
+                    }
+                    const float4& tap = in[j];
+                    float kernel = AtrousKernel[std::abs(kx)] * AtrousKernel[std::abs(ky)];
+                    float depthTerm = std::fabs(other.depth - surface.depth) * depthScale[(std::max)(std::abs(kx), std::abs(ky))];
+                    float lumaTerm = std::fabs(luminance(tap.xyz()) - centreLuma) * luminanceScale;
+                    float weight = j == i ? kernel : kernel * NormalWeight(dot(other.normal, surface.normal), m_settings.phiNormal) * std::exp(-depthTerm - lumaTerm);
+#ifdef CPU_DENOISER_SSE
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&tap.x), _mm_set_ps(weight * weight, weight, weight, weight)));
+#else
+                    sum.x += tap.x * weight;
+                    sum.y += tap.y * weight;
+                    sum.z += tap.z * weight;
+                    sum.w += tap.w * weight * weight;
+#endif
+                    weightSum += weight;
+                }
+            }
+            float inverse = 1.0f / weightSum;
+#ifdef CPU_DENOISER_SSE
+            _mm_storeu_ps(&out[i].x, _mm_mul_ps(sum, _mm_set_ps(inverse * inverse, inverse, inverse, inverse)));
+#else
+            out[i] = float4(sum.x * inverse, sum.y * inverse, sum.z * inverse, sum.w * inverse * inverse);
+#endif
+        }
+    }
+
+    DenoiserBenchmarkResult BenchmarkDenoiser(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        uint32_t frames, float step, uint32_t referenceSpp, unsigned threads)
+    {
+        DenoiserBenchmarkResult result = {};
+        result.width = width;
+        result.height = height;
+        result.frames = frames;
+        result.step = step;
+
+        // The camera's x axis in world space: where the unprojected screen centre moves when
+        // the screen x coordinate does.
+        float4 centre = mul(float4(0, 0, 0, 1), camera.projectionToWorld);
+        float4 right = mul(float4(1, 0, 0, 1), camera.projectionToWorld);
+        float3 axis = normalize(right.xyz() / right.w - centre.xyz() / centre.w);
+
+        Tracer tracer(scene, bvh);
+        RenderSettings settings;
+        settings.spp = 1;
+        settings.threads = threads;
+        DenoiserSettings denoiserSettings;
+        denoiserSettings.threads = threads;
+        Denoiser denoiser(denoiserSettings);
+
+        Framebuffer noisy, denoised;
+        std::vector<GBufferTexel> full;
+        std::vector<PackedGBufferTexel> packed;
+        CameraParams frameCamera = camera;
+        uint64_t firstDisoccluded = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            frameCamera = TranslateCamera(camera, axis * (step * frame));
+            settings.frameIndex = frame;
+            RenderStats renderStats;
+            noisy.Resize(width, height);
+            Clock::time_point start = Clock::now();
+            tracer.Render(frameCamera, settings, noisy, renderStats);
+            RenderGBuffer(scene, bvh, frameCamera, width, height, full, packed, threads);
+            result.traceSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            denoiser.Denoise(frameCamera, noisy, packed, denoised, result.stats);
+            result.denoiseSeconds += SecondsSince(start);
+            if (frame == 0) {
+                firstDisoccluded = result.stats.disoccluded;
+            }
+        }
+        if (frames > 0) {
+            result.traceSeconds /= frames;
+            result.denoiseSeconds /= frames;
+        }
+        // The first frame has nothing to reproject; the rest show how much motion costs.
+        uint64_t movingPixels = result.stats.pixels - static_cast<uint64_t>(width) * height;
+        result.disoccludedFraction = movingPixels > 0 ? static_cast<double>(result.stats.disoccluded - firstDisoccluded) / movingPixels : 0;
+
+        Framebuffer reference;
+        reference.Resize(width, height);
+        settings.spp = referenceSpp;
+        settings.frameIndex = frames + 1;
+        RenderStats referenceStats;
+        tracer.Render(frameCamera, settings, reference, referenceStats);
+        result.noisyRmse = Rmse(noisy, reference);
+        result.denoisedRmse = Rmse(denoised, reference);
+        return result;
+    }
+
+    // Not DenoiserStats::Summary(): its disocclusion counts frame 0, where every hit pixel is new.
+    std::string DenoiserBenchmarkSummary(const DenoiserBenchmarkResult& result)
+    {
+        double frames = (std::max)(result.stats.frames, 1u);
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.width << "x" << result.height << ", " << result.frames << " frames moving " << result.step << " a frame"
+            << " | trace " << result.traceSeconds * 1000.0 << " ms, denoise " << result.denoiseSeconds * 1000.0 << " ms a frame"
+            << std::setprecision(4)
+            << " | rmse 1 spp " << result.noisyRmse << ", denoised " << result.denoisedRmse
+            << std::setprecision(2)
+            << " | " << result.disoccludedFraction * 100.0 << "% disoccluded while moving"
+            << " | temporal " << result.stats.temporalSeconds * 1000.0 / frames << " ms, filter " << result.stats.filterSeconds * 1000.0 / frames << " ms a frame"
+            << " | " << result.stats.PixelsPerSecond() / 1e6 << " Mpixels/s";
+        return out.str();
+    }
+}
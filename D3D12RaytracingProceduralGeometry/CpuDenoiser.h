@@ -0,0 +1,125 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuDenoiser.h
+//
+// Spatiotemporal variance-guided filtering (Schied et al., "Spatiotemporal Variance-Guided
+// Filtering", HPG 2017) of path-traced frames, so a moving camera shows a filtered image
+// instead of the raw few-sample frames accumulation restarts from. Each frame:
+//
+//  1. Colour is divided by the G-buffer's albedo, so texture is not blurred with the lighting.
+//  2. Temporal: every pixel is reprojected into the previous frame through the previous
+//     camera's world-to-projection matrix (the inverse of projectionToWorld, which is
+//     SceneConstantBuffer::projection). It blends with the history where depth, normal and
+//     material agree, and restarts where they do not (disocclusion). Luminance moments are
+//     blended the same way.
+//  3. Variance comes from the moments, or from a spatial 7x7 estimate while a pixel's history
+//     is under four frames.
+//  4. A few passes of a 5x5 a-trous wavelet, with gaps doubling every pass. Edges are kept by
+//     depth, normal and luminance weights, the luminance weight scaled by the variance. The
+//     first pass's output is the next frame's history.
+//  5. The albedo is multiplied back in.
+//
+// The a-trous taps accumulate colour and variance in one SSE register where SSE2 is available.
+//
+//**********************************************************************************************
+
+#include "CpuTracer.h"
+#include "PackedGBuffer.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    struct DenoiserSettings {
+        uint32_t atrousIterations = 5;
+        float colourAlpha = 0.2f;           // Weight of the new frame once the history is long.
+        float momentsAlpha = 0.2f;
+        uint32_t maxHistory = 32;           // Frames; older history is weighted as this many.
+        float phiColour = 4.0f;             // Luminance edge-stopping, in standard deviations.
+        uint32_t phiNormal = 128;           // Power of the normals' cosine.
+        float phiDepth = 1.0f;              // Depth edge-stopping, in steps of the depth gradient.
+        unsigned threads = 0;
+    };
+
+    struct DenoiserStats {
+        uint32_t frames = 0;
+        uint64_t pixels = 0;
+        uint64_t disoccluded = 0;           // Hit pixels with no usable history.
+        double temporalSeconds = 0;         // G-buffer decode, reprojection and variance.
+        double filterSeconds = 0;           // A-trous passes and remodulation.
+
+        double PixelsPerSecond() const { return temporalSeconds + filterSeconds > 0 ? pixels / (temporalSeconds + filterSeconds) : 0; }
+        std::string Summary() const;
+    };
+
+    class Denoiser
+    {
+    public:
+        explicit Denoiser(const DenoiserSettings& settings = DenoiserSettings());
+
+        // Drops the history; the next frame is filtered spatially only.
+        void Reset();
+        // Filters colour, a frame traced from camera, into output. gbuffer is the frame's primary
+        // hits from RenderGBuffer with the same camera and size.
+        void Denoise(const CameraParams& camera, const Framebuffer& colour, const std::vector<PackedGBufferTexel>& gbuffer, Framebuffer& output, DenoiserStats& stats);
+
+        const DenoiserSettings& Settings() const { return m_settings; }
+
+    private:
+        // What the filters need of a pixel's primary hit.
+        struct Surface {
+            float3 position;
+            float3 normal;
+            float3 albedo;
+            float depth;                    // Along the primary ray; 0 for a miss.
+            float depthGradient;            // Largest change in depth to a neighbouring pixel.
+            uint32_t material;
+        };
+
+        DenoiserSettings m_settings;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        bool m_hasHistory = false;
+        CameraParams m_previousCamera;
+
+        std::vector<Surface> m_surfaces;
+        std::vector<Surface> m_previousSurfaces;
+        std::vector<float3> m_illumination;         // Demodulated input.
+        std::vector<float3> m_history;              // Filtered illumination of the last frame.
+        std::vector<float3> m_nextHistory;
+        std::vector<float2> m_moments;              // Luminance and its square, integrated.
+        std::vector<float2> m_previousMoments;
+        std::vector<float> m_historyLength;
+        std::vector<float> m_previousHistoryLength;
+        std::vector<float4> m_filter[2];            // Illumination and variance, ping-ponged by the passes.
+
+        void Resize(uint32_t width, uint32_t height);
+        void DecodeSurfaces(const CameraParams& camera, const Framebuffer& colour, const std::vector<PackedGBufferTexel>& gbuffer);
+        uint64_t Reproject(uint32_t y);
+        bool Consistent(const Surface& surface, size_t previous) const;
+        float SpatialVariance(uint32_t x, uint32_t y) const;
+        void Atrous(const std::vector<float4>& in, std::vector<float4>& out, uint32_t step, uint32_t y) const;
+    };
+
+    struct DenoiserBenchmarkResult {
+        uint32_t width;
+        uint32_t height;
+        uint32_t frames;
+        float step;                         // Camera movement a frame, world units.
+        double traceSeconds;                // Per frame.
+        double denoiseSeconds;
+        double noisyRmse;                   // Of the last frame against the reference.
+        double denoisedRmse;
+        double disoccludedFraction;         // Over the moving frames.
+        DenoiserStats stats;
+    };
+
+    // Moves the camera by step along its x axis for frames frames, tracing one sample a pixel
+    // and denoising each frame, then compares the last noisy and denoised frames against a
+    // referenceSpp-sample render from the final camera.
+    DenoiserBenchmarkResult BenchmarkDenoiser(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        uint32_t frames = 16, float step = 0.05f, uint32_t referenceSpp = 256, unsigned threads = 0);
+    std::string DenoiserBenchmarkSummary(const DenoiserBenchmarkResult& result);
+}
@@ -0,0 +1,157 @@
+#include "CpuDynamicBvh.h"
+#include <chrono>
+#include <fstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    void DynamicBvh::Build(const std::vector<Aabb>& primitiveBounds)
+    {
+        m_bvh.Build(primitiveBounds);
+        m_builtCost = m_bvh.SahCost();
+        m_isDirty.assign(primitiveBounds.size(), 0);
+        m_dirty.clear();
+        m_allDirty = false;
+    }
+
+    void DynamicBvh::MarkDirty(uint32_t primitiveIndex)
+    {
+        // A primitive added since Build has no leaf to refit; Update rebuilds for it anyway
+        // because the primitive count changed.
+        if (primitiveIndex >= m_isDirty.size()) {
+            return;
+        }
+        if (!m_isDirty[primitiveIndex]) {
+            m_isDirty[primitiveIndex] = 1;
+            m_dirty.push_back(primitiveIndex);
+        }
+    }
+
+    void DynamicBvh::MarkAllDirty()
+    {
+        m_allDirty = true;
+    }
+
+    BvhUpdateTiming DynamicBvh::Update(const std::vector<Aabb>& primitiveBounds)
+    {
+        BvhUpdateTiming timing;
+        timing.frame = m_frame++;
+        timing.dirtyCount = m_allDirty ? static_cast<uint32_t>(primitiveBounds.size()) : static_cast<uint32_t>(m_dirty.size());
+        timing.rebuilt = false;
+
+        Clock::time_point start = Clock::now();
+        if (primitiveBounds.size() != m_isDirty.size()) {
+            // Instances were added or removed; the topology is stale.
+            Build(primitiveBounds);
+            timing.rebuilt = true;
+        }
+        else {
+            // Refitting everything is cheaper as a single linear sweep once most instances move.
+            if (m_allDirty || m_dirty.size() * 4 > primitiveBounds.size()) {
+                m_bvh.Refit(primitiveBounds);
+            }
+            else {
+                m_bvh.Refit(primitiveBounds, m_dirty);
+            }
+            if (m_bvh.SahCost() > m_builtCost * rebuildThreshold) {
+                Build(primitiveBounds);
+                timing.rebuilt = true;
+            }
+        }
+        timing.seconds = SecondsSince(start);
+
+        for (uint32_t prim : m_dirty) {
+            m_isDirty[prim] = 0;
+        }
+        m_dirty.clear();
+        m_allDirty = false;
+
+        timing.sahCost = m_bvh.SahCost();
+        timing.sahRatio = m_builtCost > 0 ? timing.sahCost / m_builtCost : 1.0f;
+        return timing;
+    }
+
+    BvhUpdateBenchmarkResult BenchmarkBvhUpdate(uint32_t instanceCount, uint32_t frames, float movingFraction, float rebuildThreshold, uint32_t seed)
+    {
+        const float timeStep = 1.0f / 60.0f;
+
+        // Scatter instances through a volume that keeps the density roughly constant across counts.
+        float extent = 10.0f * std::cbrt(instanceCount / 10000.0f);
+        Aabb local(float3(-0.5f, -0.25f, -0.5f), float3(0.5f, 0.25f, 0.5f));
+
+        struct Instance {
+            float3 position;
+            float3 velocity;
+            float angle;
+            bool moving;
+        };
+        std::vector<Instance> instances(instanceCount);
+        std::vector<Aabb> bounds(instanceCount);
+        uint32_t state = wang_hash_original(seed) | 1u;
+        for (uint32_t i = 0; i < instanceCount; i++) {
+            Instance& instance = instances[i];
+            instance.position = float3(seed_xorshift(state), seed_xorshift(state), seed_xorshift(state)) * (2 * extent) - float3(extent);
+            instance.velocity = float3(seed_xorshift(state), seed_xorshift(state), seed_xorshift(state)) * 2.0f - float3(1.0f);
+            instance.angle = seed_xorshift(state) * 2.0f * Pi;
+            instance.moving = seed_xorshift(state) < movingFraction;
+            bounds[i] = TransformAabb(local, mul(float4x4::RotationY(instance.angle), float4x4::Translation(instance.position)));
+        }
+
+        BvhUpdateBenchmarkResult result;
+        result.instanceCount = instanceCount;
+        result.frames = frames;
+        result.rebuilds = 0;
+        result.maxUpdateSeconds = 0;
+        double totalSeconds = 0;
+
+        DynamicBvh dynamicBvh;
+        dynamicBvh.rebuildThreshold = rebuildThreshold;
+        Clock::time_point buildStart = Clock::now();
+        dynamicBvh.Build(bounds);
+        result.buildSeconds = SecondsSince(buildStart);
+
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            // Same idea as UpdateAABBPrimitiveAttributes: a spin about Y plus a translation.
+            for (uint32_t i = 0; i < instanceCount; i++) {
+                Instance& instance = instances[i];
+                if (!instance.moving) {
+                    continue;
+                }
+                instance.position += instance.velocity * timeStep;
+                instance.angle += timeStep;
+                bounds[i] = TransformAabb(local, mul(float4x4::RotationY(instance.angle), float4x4::Translation(instance.position)));
+                dynamicBvh.MarkDirty(i);
+            }
+
+            BvhUpdateTiming timing = dynamicBvh.Update(bounds);
+            totalSeconds += timing.seconds;
+            result.maxUpdateSeconds = (std::max)(result.maxUpdateSeconds, timing.seconds);
+            result.rebuilds += timing.rebuilt ? 1 : 0;
+            result.timings.push_back(timing);
+        }
+        result.averageUpdateSeconds = frames > 0 ? totalSeconds / frames : 0;
+        return result;
+    }
+
+    bool WriteBvhUpdateCsv(const std::string& filename, const BvhUpdateBenchmarkResult& result)
+    {
+        std::ofstream out(filename);
+        if (!out) {
+            return false;
+        }
+        out << "frame,dirty,update_ms,rebuilt,sah_cost,sah_ratio\n";
+        for (const BvhUpdateTiming& t : result.timings) {
+            out << t.frame << "," << t.dirtyCount << "," << t.seconds * 1000.0 << "," << (t.rebuilt ? 1 : 0) << ","
+                << t.sahCost << "," << t.sahRatio << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+}
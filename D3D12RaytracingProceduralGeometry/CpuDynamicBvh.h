@@ -0,0 +1,67 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuDynamicBvh.h
+//
+// Incremental update path for animated instances. Instances that moved are marked dirty and
+// refit bottom-up each frame; when the refit hierarchy's SAH cost has drifted too far above
+// the cost measured right after the last build, the hierarchy is rebuilt instead.
+//
+//**********************************************************************************************
+
+#include "CpuBvh.h"
+#include <string>
+
+namespace Cpu {
+
+    struct BvhUpdateTiming {
+        uint32_t frame;
+        uint32_t dirtyCount;
+        double seconds;
+        bool rebuilt;
+        float sahCost;
+        float sahRatio;         // sahCost relative to the cost after the last build.
+    };
+
+    class DynamicBvh
+    {
+    public:
+        // Rebuild once the SAH cost exceeds this multiple of the freshly built cost.
+        float rebuildThreshold = 1.5f;
+
+        const Bvh& GetBvh() const { return m_bvh; }
+
+        void Build(const std::vector<Aabb>& primitiveBounds);
+        void MarkDirty(uint32_t primitiveIndex);
+        void MarkAllDirty();
+
+        // Refits (or rebuilds) with the current bounds and clears the dirty set.
+        BvhUpdateTiming Update(const std::vector<Aabb>& primitiveBounds);
+
+    private:
+        Bvh m_bvh;
+        float m_builtCost = 0;
+        uint32_t m_frame = 0;
+        bool m_allDirty = false;
+        std::vector<uint32_t> m_dirty;
+        std::vector<uint8_t> m_isDirty;
+    };
+
+    struct BvhUpdateBenchmarkResult {
+        uint32_t instanceCount;
+        uint32_t frames;
+        double buildSeconds;            // Initial full build, the cost every rebuild pays.
+        double averageUpdateSeconds;
+        double maxUpdateSeconds;
+        uint32_t rebuilds;
+        std::vector<BvhUpdateTiming> timings;
+    };
+
+    // Animates instanceCount boxes for the given number of 60 Hz frames, moving and spinning
+    // movingFraction of them, and times the per-frame update.
+    BvhUpdateBenchmarkResult BenchmarkBvhUpdate(uint32_t instanceCount, uint32_t frames, float movingFraction, float rebuildThreshold = 1.5f, uint32_t seed = 1);
+
+    // One row per frame: frame, dirty, update_ms, rebuilt, sah_cost, sah_ratio.
+    bool WriteBvhUpdateCsv(const std::string& filename, const BvhUpdateBenchmarkResult& result);
+}
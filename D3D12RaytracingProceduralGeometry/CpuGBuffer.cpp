@@ -0,0 +1,263 @@
+#include "CpuGBuffer.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const float RayTMin = 0.001f;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        PackedPhotonFloat3 ToPacked(const float3& v)
+        {
+            return PackedPhotonMakeFloat3(v.x, v.y, v.z);
+        }
+
+        float3 FromPacked(const PackedPhotonFloat3& v)
+        {
+            return float3(v.x, v.y, v.z);
+        }
+
+        float MaxChannel(const float3& c)
+        {
+            return (std::max)(c.x, (std::max)(c.y, c.z));
+        }
+
+        // What shading reads from a texel of either layout.
+        struct Surface {
+            float3 position;
+            float3 normal;
+            float3 colour;
+            uint32_t material;
+            uint32_t brdf;
+        };
+
+        // GenerateCameraRay's directions along a row of pixels. The unprojected point is affine
+        // in x, so it is stepped instead of transformed, and normalising the offset scaled by w
+        // gives the direction without dividing by w first.
+        struct RowRays {
+            float4 start;
+            float4 step;
+            float3 origin;
+
+            RowRays(const CameraParams& camera, uint32_t y, uint32_t width, uint32_t height) : origin(camera.position)
+            {
+                float sx = 0.5f / width * 2.0f - 1.0f;
+                float sy = -((y + 0.5f) / height * 2.0f - 1.0f);
+                start = mul(float4(sx, sy, 0, 1), camera.projectionToWorld);
+                float4 end = mul(float4(sx + 2.0f, sy, 0, 1), camera.projectionToWorld);
+                for (int c = 0; c < 4; c++) {
+                    step[c] = (end[c] - start[c]) / width;
+                }
+            }
+
+            float3 Direction(uint32_t x) const
+            {
+                float4 world(start.x + x * step.x, start.y + x * step.y, start.z + x * step.z, start.w + x * step.w);
+                float3 offset = world.xyz() - origin * world.w;
+                float scale = (world.w < 0 ? -1.0f : 1.0f) / std::sqrt(dot(offset, offset));
+                return offset * scale;
+            }
+        };
+
+        bool Fetch(const GBufferTexel& texel, const RowRays&, uint32_t, Surface& surface)
+        {
+            if (texel.position.w == 0) {
+                return false;
+            }
+            surface.position = texel.position.xyz();
+            surface.normal = texel.normal.xyz();
+            surface.colour = texel.colour.xyz();
+            surface.material = static_cast<uint32_t>(texel.normal.w);
+            surface.brdf = static_cast<uint32_t>(texel.colour.w);
+            return true;
+        }
+
+        bool Fetch(const PackedGBufferTexel& texel, const RowRays& rays, uint32_t x, Surface& surface)
+        {
+            if (!GBufferHit(texel)) {
+                return false;
+            }
+            surface.position = FromPacked(ReconstructGBufferPosition(ToPacked(rays.origin), ToPacked(rays.Direction(x)), texel));
+            surface.normal = FromPacked(DecodeGBufferNormal(texel.y));
+            surface.colour = FromPacked(DecodeGBufferColour(texel));
+            surface.material = DecodeGBufferMaterial(texel);
+            surface.brdf = DecodeGBufferBRDF(texel);
+            return true;
+        }
+
+        // PhongLighting's diffuse and specular terms from Raytracing.hlsl, lit by a point light
+        // with inverse-square falloff.
+        template <typename Texel>
+        void Shade(const Scene& scene, const Light& light, const CameraParams& camera, const std::vector<Texel>& gbuffer,
+            uint32_t width, uint32_t height, Framebuffer& framebuffer, unsigned threads)
+        {
+            framebuffer.Resize(width, height);
+            ParallelFor(height, [&](size_t y, unsigned) {
+                RowRays rays(camera, static_cast<uint32_t>(y), width, height);
+                for (uint32_t x = 0; x < width; x++) {
+                    size_t i = y * width + x;
+                    Surface surface;
+                    if (!Fetch(gbuffer[i], rays, x, surface) || surface.brdf != BRDF::Diffuse || surface.material >= scene.materials.size()) {
+                        framebuffer.pixels[i] = float3(0.0f);
+                        continue;
+                    }
+                    const Material& material = scene.materials[surface.material];
+                    float3 toLight = light.position - surface.position;
+                    float distanceSquared = (std::max)(dot(toLight, toLight), 1e-8f);
+                    float3 l = toLight * (1.0f / std::sqrt(distanceSquared));
+                    float3 v = normalize(camera.position - surface.position);
+                    float diffuse = material.diffuseCoef * (std::max)(0.0f, dot(surface.normal, l));
+                    float specular = material.specularCoef * std::pow((std::max)(0.0f, dot(reflect(-l, surface.normal), v)), material.specularPower);
+                    framebuffer.pixels[i] = (surface.colour * diffuse + float3(specular)) * light.colour * (light.power / (4.0f * Pi * distanceSquared));
+                }
+            }, threads, 4);
+        }
+
+        template <typename Texel>
+        double BestShadeSeconds(const Scene& scene, const CameraParams& camera, const std::vector<Texel>& gbuffer,
+            uint32_t width, uint32_t height, uint32_t repeats, Framebuffer& framebuffer, unsigned threads)
+        {
+            double best = 0;
+            for (uint32_t r = 0; r < (std::max)(repeats, 1u); r++) {
+                Clock::time_point start = Clock::now();
+                Shade(scene, scene.light, camera, gbuffer, width, height, framebuffer, threads);
+                double seconds = SecondsSince(start);
+                best = r == 0 ? seconds : (std::min)(best, seconds);
+            }
+            return best;
+        }
+    }
+
+    void RenderGBuffer(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        std::vector<GBufferTexel>& full, std::vector<PackedGBufferTexel>& packed, unsigned threads)
+    {
+        size_t pixels = static_cast<size_t>(width) * height;
+        full.resize(pixels);
+        packed.resize(pixels);
+        ParallelForChunks(pixels, 256, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                Ray ray = GenerateCameraRay(static_cast<uint32_t>(i % width), static_cast<uint32_t>(i / width), width, height, camera);
+                Hit hit;
+                if (!bvh.Intersect(scene, ray, RayTMin, hit)) {
+                    full[i] = GBufferTexel();
+                    packed[i] = PackedGBufferTexel();
+                    continue;
+                }
+                uint32_t materialIndex = scene.primitives[hit.primitive].materialIndex;
+                const Material& material = scene.materials[materialIndex];
+                BRDF::Enum brdf = LabelBRDF(material);
+                float3 position = ray.origin + hit.t * ray.direction;
+                full[i].colour = float4(material.albedo, static_cast<float>(brdf));
+                full[i].position = float4(position, 1.0f);
+                full[i].normal = float4(hit.normal, static_cast<float>(materialIndex));
+                packed[i] = EncodeGBuffer(hit.t, ToPacked(hit.normal), materialIndex, brdf, ToPacked(material.albedo));
+            }
+        }, threads);
+    }
+
+    void ShadeGBuffer(const Scene& scene, const Light& light, const CameraParams& camera, const std::vector<GBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, Framebuffer& framebuffer, unsigned threads)
+    {
+        Shade(scene, light, camera, gbuffer, width, height, framebuffer, threads);
+    }
+
+    void ShadeGBuffer(const Scene& scene, const Light& light, const CameraParams& camera, const std::vector<PackedGBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, Framebuffer& framebuffer, unsigned threads)
+    {
+        Shade(scene, light, camera, gbuffer, width, height, framebuffer, threads);
+    }
+
+    GBufferBenchmarkResult BenchmarkGBuffer(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height, uint32_t repeats, unsigned threads)
+    {
+        GBufferBenchmarkResult result = {};
+        result.width = width;
+        result.height = height;
+
+        std::vector<GBufferTexel> full;
+        std::vector<PackedGBufferTexel> packed;
+        RenderGBuffer(scene, bvh, camera, width, height, full, packed, threads);
+        result.fullBytes = full.size() * sizeof(GBufferTexel);
+        result.packedBytes = packed.size() * sizeof(PackedGBufferTexel);
+
+        // Field by field error over the hits, decoding the packed texels as shading would.
+        for (size_t i = 0; i < full.size(); i++) {
+            Surface reference, decoded;
+            uint32_t x = static_cast<uint32_t>(i % width);
+            RowRays rays(camera, static_cast<uint32_t>(i / width), width, height);
+            if (!Fetch(full[i], rays, x, reference) || !Fetch(packed[i], rays, x, decoded)) {
+                continue;
+            }
+            result.hits++;
+            double position = length(decoded.position - reference.position);
+            result.positionRms += position * position;
+            result.positionMax = (std::max)(result.positionMax, position);
+            double normal = std::acos((std::min)(1.0f, (std::max)(-1.0f, dot(decoded.normal, reference.normal)))) * (180.0 / Pi);
+            result.normalMeanDegrees += normal;
+            result.normalMaxDegrees = (std::max)(result.normalMaxDegrees, normal);
+            float colour = MaxChannel(reference.colour);
+            if (colour > 0) {
+                result.colourRelativeMax = (std::max)(result.colourRelativeMax, std::fabs(MaxChannel(decoded.colour) - colour) / static_cast<double>(colour));
+            }
+            result.labelMismatches += decoded.material != reference.material || decoded.brdf != reference.brdf ? 1 : 0;
+        }
+        if (result.hits > 0) {
+            result.positionRms = std::sqrt(result.positionRms / result.hits);
+            result.normalMeanDegrees /= result.hits;
+        }
+
+        Framebuffer fullImage, packedImage;
+        result.fullShadeSeconds = BestShadeSeconds(scene, camera, full, width, height, repeats, fullImage, threads);
+        result.packedShadeSeconds = BestShadeSeconds(scene, camera, packed, width, height, repeats, packedImage, threads);
+        result.fullBytesPerSecond = result.fullShadeSeconds > 0 ? result.fullBytes / result.fullShadeSeconds : 0;
+        result.packedBytesPerSecond = result.packedShadeSeconds > 0 ? result.packedBytes / result.packedShadeSeconds : 0;
+
+        // Relative to the mean lit luminance rather than each pixel's own: pixels at the edge of
+        // the light, where the reference is near zero, would otherwise dominate.
+        double referenceSum = 0, errorSum = 0, errorMax = 0;
+        uint32_t lit = 0;
+        for (size_t i = 0; i < fullImage.pixels.size(); i++) {
+            float reference = luminance(fullImage.pixels[i]);
+            if (reference > 0) {
+                double error = std::fabs(luminance(packedImage.pixels[i]) - reference);
+                referenceSum += reference;
+                errorSum += error;
+                errorMax = (std::max)(errorMax, error);
+                lit++;
+            }
+        }
+        if (referenceSum > 0) {
+            result.shadedRelativeError = errorSum / referenceSum;
+            result.shadedRelativeMax = errorMax / (referenceSum / lit);
+        }
+        return result;
+    }
+
+    std::string GBufferBenchmarkSummary(const GBufferBenchmarkResult& result)
+    {
+        const double megabyte = 1024.0 * 1024.0;
+        const double gigabyte = 1024.0 * megabyte;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.width << "x" << result.height << ", " << result.hits << " hits"
+            << " | " << sizeof(GBufferTexel) << " B/pixel " << result.fullBytes / megabyte << " MB, shade " << result.fullShadeSeconds * 1000.0 << " ms (" << result.fullBytesPerSecond / gigabyte << " GB/s)"
+            << " | " << sizeof(PackedGBufferTexel) << " B/pixel " << result.packedBytes / megabyte << " MB, shade " << result.packedShadeSeconds * 1000.0 << " ms (" << result.packedBytesPerSecond / gigabyte << " GB/s)"
+            << std::setprecision(4)
+            << " | shaded error " << result.shadedRelativeError * 100.0 << "% / max " << result.shadedRelativeMax * 100.0 << "%"
+            << " | position rms " << result.positionRms << " / max " << result.positionMax
+            << " | normal " << result.normalMeanDegrees << " / " << result.normalMaxDegrees << " deg"
+            << " | colour max " << result.colourRelativeMax * 100.0 << "%"
+            << " | " << result.labelMismatches << " label mismatches";
+        return out.str();
+    }
+}
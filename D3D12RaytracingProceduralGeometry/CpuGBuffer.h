@@ -0,0 +1,64 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuGBuffer.h
+//
+// A deferred-shading reference for PackedGBuffer.h. The primary hits of a view are written both
+// as the three float4s a pixel the ray tracer used to write (BRDF colour, position, normal) and
+// as one packed texel, then shaded from each: diffuse plus Phong specular from one point light,
+// with the material's coefficients looked up by id. Shading reads the G-buffer once a pixel and
+// does little arithmetic, so it runs at the speed the texels stream in, which is what the
+// packed layout is for. Comparing the two images gives what its quantisation costs.
+//
+//**********************************************************************************************
+
+#include "CpuTracer.h"
+#include "PackedGBuffer.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    struct GBufferTexel {
+        float4 colour;          // BRDF colour; w unused.
+        float4 position;        // w: 1 on a hit, 0 where the ray missed.
+        float4 normal;          // w: material id.
+    };
+
+    // Traces each pixel's primary ray and writes its hit in both layouts. The colour is the
+    // material's albedo and the BRDF label is LabelBRDF's.
+    void RenderGBuffer(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        std::vector<GBufferTexel>& full, std::vector<PackedGBufferTexel>& packed, unsigned threads = 0);
+
+    // Shades the diffuse pixels of a G-buffer; the others, and misses, come out black. The
+    // packed one needs the camera to rebuild positions from depth.
+    void ShadeGBuffer(const Scene& scene, const Light& light, const CameraParams& camera, const std::vector<GBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, Framebuffer& framebuffer, unsigned threads = 0);
+    void ShadeGBuffer(const Scene& scene, const Light& light, const CameraParams& camera, const std::vector<PackedGBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, Framebuffer& framebuffer, unsigned threads = 0);
+
+    struct GBufferBenchmarkResult {
+        uint32_t width;
+        uint32_t height;
+        uint32_t hits;
+        size_t fullBytes;                   // Of the whole G-buffer.
+        size_t packedBytes;
+        double fullShadeSeconds;            // Per pass, the best of the repeats.
+        double packedShadeSeconds;
+        double fullBytesPerSecond;          // G-buffer bytes a pass read over its time.
+        double packedBytesPerSecond;
+        double positionRms;                 // World units, over hits.
+        double positionMax;
+        double normalMeanDegrees;
+        double normalMaxDegrees;
+        double colourRelativeMax;           // Of the brightest channel.
+        uint32_t labelMismatches;           // Pixels whose material id or BRDF label changed.
+        double shadedRelativeError;         // Luminance error over lit pixels, over their mean luminance.
+        double shadedRelativeMax;           // The largest pixel's, over the same mean.
+    };
+
+    // Renders width x height G-buffers of the scene from camera and shades each repeats times.
+    GBufferBenchmarkResult BenchmarkGBuffer(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height, uint32_t repeats = 5, unsigned threads = 0);
+    std::string GBufferBenchmarkSummary(const GBufferBenchmarkResult& result);
+}
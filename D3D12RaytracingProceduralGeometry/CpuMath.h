@@ -0,0 +1,304 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuMath.h
+//
+// Small HLSL-flavoured vector library used by the CPU tracer, so code ported from the
+// shaders (AnalyticPrimitives.hlsli, Raytracing.hlsl) reads the same on both sides.
+// Matrices follow the DirectXMath row-vector convention: mul(float4(p, 1), M).
+//
+//**********************************************************************************************
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace Cpu {
+
+    static const float Pi = 3.14159265358979323846f;
+    static const float InvPi = 0.318309886f;
+    static const float Infinity = 1e30f;
+
+    struct float2 {
+        float x, y;
+        float2() : x(0), y(0) {}
+        float2(float x, float y) : x(x), y(y) {}
+    };
+
+    struct float3 {
+        float x, y, z;
+        float3() : x(0), y(0), z(0) {}
+        explicit float3(float s) : x(s), y(s), z(s) {}
+        float3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+        float operator[](int i) const { return (&x)[i]; }
+        float& operator[](int i) { return (&x)[i]; }
+
+        float3& operator+=(const float3& b) { x += b.x; y += b.y; z += b.z; return *this; }
+        float3& operator-=(const float3& b) { x -= b.x; y -= b.y; z -= b.z; return *this; }
+        float3& operator*=(const float3& b) { x *= b.x; y *= b.y; z *= b.z; return *this; }
+        float3& operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+    };
+
+    struct float4 {
+        float x, y, z, w;
+        float4() : x(0), y(0), z(0), w(0) {}
+        float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+        float4(const float3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+        float3 xyz() const { return float3(x, y, z); }
+        float operator[](int i) const { return (&x)[i]; }
+        float& operator[](int i) { return (&x)[i]; }
+    };
+
+    inline float3 operator+(const float3& a, const float3& b) { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    inline float3 operator-(const float3& a, const float3& b) { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    inline float3 operator*(const float3& a, const float3& b) { return float3(a.x * b.x, a.y * b.y, a.z * b.z); }
+    inline float3 operator/(const float3& a, const float3& b) { return float3(a.x / b.x, a.y / b.y, a.z / b.z); }
+    inline float3 operator*(const float3& a, float s) { return float3(a.x * s, a.y * s, a.z * s); }
+    inline float3 operator*(float s, const float3& a) { return float3(a.x * s, a.y * s, a.z * s); }
+    inline float3 operator/(const float3& a, float s) { return a * (1.0f / s); }
+    inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+
+    inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float dot(const float4& a, const float4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+    inline float3 cross(const float3& a, const float3& b)
+    {
+        return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+    inline float length(const float3& a) { return std::sqrt(dot(a, a)); }
+    inline float3 normalize(const float3& a)
+    {
+        float len = length(a);
+        return len > 0 ? a / len : a;
+    }
+    inline float3 reflect(const float3& i, const float3& n) { return i - 2.0f * dot(n, i) * n; }
+    inline float3 lerp(const float3& a, const float3& b, float t) { return a + (b - a) * t; }
+    inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+    inline float saturate(float v) { return (std::min)(1.0f, (std::max)(0.0f, v)); }
+    inline float3 min3(const float3& a, const float3& b)
+    {
+        return float3((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z));
+    }
+    inline float3 max3(const float3& a, const float3& b)
+    {
+        return float3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z));
+    }
+    inline float maxComponent(const float3& a) { return (std::max)(a.x, (std::max)(a.y, a.z)); }
+    inline float luminance(const float3& c) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
+    // Row-major 4x4, laid out like XMFLOAT4X4 so an XMMATRIX can be stored straight into it.
+    struct float4x4 {
+        float m[4][4];
+
+        static float4x4 Identity()
+        {
+            float4x4 r = {};
+            r.m[0][0] = r.m[1][1] = r.m[2][2] = r.m[3][3] = 1.0f;
+            return r;
+        }
+        static float4x4 Translation(const float3& t)
+        {
+            float4x4 r = Identity();
+            r.m[3][0] = t.x; r.m[3][1] = t.y; r.m[3][2] = t.z;
+            return r;
+        }
+        static float4x4 Scaling(const float3& s)
+        {
+            float4x4 r = Identity();
+            r.m[0][0] = s.x; r.m[1][1] = s.y; r.m[2][2] = s.z;
+            return r;
+        }
+        static float4x4 RotationY(float angle)
+        {
+            float4x4 r = Identity();
+            float c = std::cos(angle), s = std::sin(angle);
+            r.m[0][0] = c; r.m[0][2] = -s;
+            r.m[2][0] = s; r.m[2][2] = c;
+            return r;
+        }
+    };
+
+    // HLSL mul(v, M): v treated as a row vector.
+    inline float4 mul(const float4& v, const float4x4& M)
+    {
+        float4 r;
+        for (int c = 0; c < 4; c++) {
+            r[c] = v.x * M.m[0][c] + v.y * M.m[1][c] + v.z * M.m[2][c] + v.w * M.m[3][c];
+        }
+        return r;
+    }
+
+    // HLSL mul(M, v): v treated as a column vector (used by the quadric tests).
+    inline float4 mul(const float4x4& M, const float4& v)
+    {
+        float4 r;
+        for (int rIdx = 0; rIdx < 4; rIdx++) {
+            r[rIdx] = M.m[rIdx][0] * v.x + M.m[rIdx][1] * v.y + M.m[rIdx][2] * v.z + M.m[rIdx][3] * v.w;
+        }
+        return r;
+    }
+
+    inline float4x4 mul(const float4x4& a, const float4x4& b)
+    {
+        float4x4 r;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+            }
+        }
+        return r;
+    }
+
+    inline float3 TransformPoint(const float3& p, const float4x4& M) { return mul(float4(p, 1.0f), M).xyz(); }
+    inline float3 TransformVector(const float3& v, const float4x4& M) { return mul(float4(v, 0.0f), M).xyz(); }
+
+    inline float4x4 transpose(const float4x4& a)
+    {
+        float4x4 r;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                r.m[i][j] = a.m[j][i];
+            }
+        }
+        return r;
+    }
+
+    // General 4x4 inverse (cofactor expansion). Returns identity for singular input.
+    inline float4x4 inverse(const float4x4& M)
+    {
+        const float* a = &M.m[0][0];
+        float inv[16];
+        inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+        inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+        inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+        inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+        inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+        inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+        inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+        inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+        inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+        inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+        inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+        inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+        inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+        inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+        inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+        inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+        float det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+        if (det == 0) {
+            return float4x4::Identity();
+        }
+        float4x4 r;
+        float invDet = 1.0f / det;
+        for (int i = 0; i < 16; i++) {
+            (&r.m[0][0])[i] = inv[i] * invDet;
+        }
+        return r;
+    }
+
+    struct Ray {
+        float3 origin;
+        float3 direction;
+    };
+
+    struct Aabb {
+        float3 lower;
+        float3 upper;
+
+        Aabb() : lower(Infinity), upper(-Infinity) {}
+        Aabb(const float3& lo, const float3& hi) : lower(lo), upper(hi) {}
+
+        void grow(const float3& p) { lower = min3(lower, p); upper = max3(upper, p); }
+        void grow(const Aabb& b) { lower = min3(lower, b.lower); upper = max3(upper, b.upper); }
+        bool valid() const { return lower.x <= upper.x && lower.y <= upper.y && lower.z <= upper.z; }
+        float3 centroid() const { return (lower + upper) * 0.5f; }
+        float3 extent() const { return upper - lower; }
+        float surfaceArea() const
+        {
+            if (!valid()) return 0.0f;
+            float3 e = extent();
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+        int longestAxis() const
+        {
+            float3 e = extent();
+            return (e.x > e.y && e.x > e.z) ? 0 : (e.y > e.z ? 1 : 2);
+        }
+    };
+
+    // Bounds of a local-space box after an affine transform.
+    inline Aabb TransformAabb(const Aabb& local, const float4x4& M)
+    {
+        Aabb r;
+        for (int i = 0; i < 8; i++) {
+            float3 corner((i & 1) ? local.upper.x : local.lower.x,
+                          (i & 2) ? local.upper.y : local.lower.y,
+                          (i & 4) ? local.upper.z : local.lower.z);
+            r.grow(TransformPoint(corner, M));
+        }
+        return r;
+    }
+
+    // Slab test; returns the entry distance in tNear.
+    inline bool RayAabb(const float3& origin, const float3& invDir, const Aabb& b, float tMax, float& tNear)
+    {
+        float tx1 = (b.lower.x - origin.x) * invDir.x, tx2 = (b.upper.x - origin.x) * invDir.x;
+        float t0 = (std::min)(tx1, tx2), t1 = (std::max)(tx1, tx2);
+        float ty1 = (b.lower.y - origin.y) * invDir.y, ty2 = (b.upper.y - origin.y) * invDir.y;
+        t0 = (std::max)(t0, (std::min)(ty1, ty2)); t1 = (std::min)(t1, (std::max)(ty1, ty2));
+        float tz1 = (b.lower.z - origin.z) * invDir.z, tz2 = (b.upper.z - origin.z) * invDir.z;
+        t0 = (std::max)(t0, (std::min)(tz1, tz2)); t1 = (std::min)(t1, (std::max)(tz1, tz2));
+        tNear = t0;
+        return t1 >= (std::max)(t0, 0.0f) && t0 < tMax;
+    }
+
+    inline float3 SafeInverse(const float3& d)
+    {
+        return float3(d.x != 0 ? 1.0f / d.x : Infinity,
+                      d.y != 0 ? 1.0f / d.y : Infinity,
+                      d.z != 0 ? 1.0f / d.z : Infinity);
+    }
+
+    // Random numbers, same generators as Raytracing.hlsl.
+    inline uint32_t wang_hash_original(uint32_t seed)
+    {
+        seed = (seed ^ 61u) ^ (seed >> 16);
+        seed *= 9u;
+        seed = seed ^ (seed >> 4);
+        seed *= 0x27d4eb2du;
+        seed = seed ^ (seed >> 15);
+        return seed;
+    }
+
+    inline float seed_xorshift(uint32_t& seed)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed * (1.0f / 4294967296.0f);
+    }
+
+    // Spread the low 10 bits of v so there are two zero bits between each.
+    inline uint32_t ExpandBits10(uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // 30-bit Morton code of a point normalised to [0, 1]^3.
+    inline uint32_t Morton3D(const float3& unit)
+    {
+        uint32_t x = static_cast<uint32_t>((std::min)((std::max)(unit.x * 1024.0f, 0.0f), 1023.0f));
+        uint32_t y = static_cast<uint32_t>((std::min)((std::max)(unit.y * 1024.0f, 0.0f), 1023.0f));
+        uint32_t z = static_cast<uint32_t>((std::min)((std::max)(unit.z * 1024.0f, 0.0f), 1023.0f));
+        return (ExpandBits10(x) << 2) | (ExpandBits10(y) << 1) | ExpandBits10(z);
+    }
+}
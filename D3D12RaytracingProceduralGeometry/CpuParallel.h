@@ -0,0 +1,82 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuParallel.h
+//
+// Minimal fork/join helper for the CPU backend. Work is handed out in chunks from an atomic
+// counter so uneven items (tiles with lots of geometry, dense point-cloud cells) balance out.
+//
+//**********************************************************************************************
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace Cpu {
+
+    inline unsigned WorkerCount(unsigned requested = 0)
+    {
+        if (requested > 0) {
+            return requested;
+        }
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw > 0 ? hw : 1;
+    }
+
+    // Calls fn(begin, end, workerIndex) over [0, count) in chunks of chunkSize.
+    template<typename Fn>
+    void ParallelForChunks(size_t count, size_t chunkSize, Fn fn, unsigned threads = 0)
+    {
+        if (count == 0) {
+            return;
+        }
+        if (chunkSize == 0) {
+            chunkSize = 1;
+        }
+        unsigned workers = WorkerCount(threads);
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+        if (workers > chunks) {
+            workers = static_cast<unsigned>(chunks);
+        }
+
+        std::atomic<size_t> next(0);
+        auto worker = [&](unsigned workerIndex) {
+            for (;;) {
+                size_t chunk = next.fetch_add(1);
+                if (chunk >= chunks) {
+                    break;
+                }
+                size_t begin = chunk * chunkSize;
+                size_t end = begin + chunkSize < count ? begin + chunkSize : count;
+                fn(begin, end, workerIndex);
+            }
+        };
+
+        if (workers <= 1) {
+            worker(0);
+            return;
+        }
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (unsigned i = 1; i < workers; i++) {
+            pool.emplace_back(worker, i);
+        }
+        worker(0);
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+
+    // Calls fn(index, workerIndex) for every index in [0, count).
+    template<typename Fn>
+    void ParallelFor(size_t count, Fn fn, unsigned threads = 0, size_t chunkSize = 64)
+    {
+        ParallelForChunks(count, chunkSize, [&](size_t begin, size_t end, unsigned workerIndex) {
+            for (size_t i = begin; i < end; i++) {
+                fn(i, workerIndex);
+            }
+        }, threads);
+    }
+}
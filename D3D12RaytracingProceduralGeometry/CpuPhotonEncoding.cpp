@@ -0,0 +1,270 @@
+#include "CpuPhotonEncoding.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        PackedPhotonFloat3 ToPacked(const float4& v)
+        {
+            return PackedPhotonMakeFloat3(v.x, v.y, v.z);
+        }
+
+        float3 FromPacked(const PackedPhotonFloat3& v)
+        {
+            return float3(v.x, v.y, v.z);
+        }
+
+        float3 Xyz(const float4& v)
+        {
+            return float3(v.x, v.y, v.z);
+        }
+
+        float MaxChannel(const float3& c)
+        {
+            return (std::max)(c.x, (std::max)(c.y, c.z));
+        }
+
+        double AngleDegrees(const float3& a, const float3& b)
+        {
+            float cosine = (std::min)(1.0f, (std::max)(-1.0f, dot(a, b)));
+            return std::acos(cosine) * (180.0 / Pi);
+        }
+
+        // What a gather reads from either layout. The packed one decodes each field only
+        // once the photon has passed the tests on the previous ones, its position as an offset
+        // from the corner of the cell being searched, which is decoded once per cell, and its
+        // direction without normalising, as the gather only tests its sign against the normal.
+        float3 GatherPosition(const PhotonGridFrame&, const Photon& photon, const float3&) { return Xyz(photon.position); }
+        float3 GatherDirection(const Photon& photon) { return Xyz(photon.direction); }
+        float3 GatherPower(const PhotonGridFrame&, const Photon& photon) { return Xyz(photon.colour); }
+
+        float3 GatherPosition(const PhotonGridFrame& frame, const PackedPhoton& photon, const float3& cellOrigin) { return cellOrigin + FromPacked(DecodePhotonCellOffset(frame, photon.offset)); }
+        float3 GatherDirection(const PackedPhoton& photon) { return FromPacked(DecodeOctahedralUnnormalised(photon.directionNormal & 0xFFFF)); }
+        float3 GatherPower(const PhotonGridFrame& frame, const PackedPhoton& photon) { return FromPacked(DecodePhotonPower(frame, photon)); }
+
+        struct GatherQuery {
+            float3 position;
+            float3 normal;
+        };
+
+        // Flux of the photons within radius of each query that arrived on its side, searching
+        // the 27 cells around it. cells holds each record's cell index, sorted.
+        template <typename Record>
+        double Gather(const PhotonGridFrame& frame, const std::vector<Record>& records, const std::vector<uint32_t>& cells,
+            const std::vector<GatherQuery>& queries, float radius, std::vector<float3>& estimates, uint64_t& visited, unsigned threads)
+        {
+            Clock::time_point start = Clock::now();
+            std::vector<uint64_t> visitedPerWorker(WorkerCount(threads), 0);
+            float radiusSquared = radius * radius;
+            ParallelForChunks(queries.size(), 64, [&](size_t begin, size_t end, unsigned worker) {
+                for (size_t q = begin; q < end; q++) {
+                    const GatherQuery& query = queries[q];
+                    int cx = static_cast<int>(PackedPhotonCellCoordinate((query.position.x - frame.originX) / frame.cellSize));
+                    int cy = static_cast<int>(PackedPhotonCellCoordinate((query.position.y - frame.originY) / frame.cellSize));
+                    int cz = static_cast<int>(PackedPhotonCellCoordinate((query.position.z - frame.originZ) / frame.cellSize));
+                    float3 flux(0.0f);
+                    for (int z = cz - 1; z <= cz + 1; z++) {
+                        for (int y = cy - 1; y <= cy + 1; y++) {
+                            for (int x = cx - 1; x <= cx + 1; x++) {
+                                if (x < 0 || y < 0 || z < 0 || x >= PACKED_PHOTON_MAX_CELLS || y >= PACKED_PHOTON_MAX_CELLS || z >= PACKED_PHOTON_MAX_CELLS) {
+                                    continue;
+                                }
+                                uint32_t cell = PackedPhotonCellIndex(x, y, z);
+                                auto range = std::equal_range(cells.begin(), cells.end(), cell);
+                                size_t first = range.first - cells.begin();
+                                size_t last = range.second - cells.begin();
+                                visitedPerWorker[worker] += last - first;
+                                float3 cellOrigin = FromPacked(DecodePhotonCellOrigin(frame, cell));
+                                for (size_t i = first; i < last; i++) {
+                                    float3 offset = GatherPosition(frame, records[i], cellOrigin) - query.position;
+                                    if (dot(offset, offset) < radiusSquared && dot(GatherDirection(records[i]), query.normal) < 0) {
+                                        flux += GatherPower(frame, records[i]);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    estimates[q] = flux;
+                }
+            }, threads);
+            visited = std::accumulate(visitedPerWorker.begin(), visitedPerWorker.end(), uint64_t(0));
+            return SecondsSince(start);
+        }
+    }
+
+    PhotonGridFrame MakePhotonGridFrame(const Aabb& bounds, float minimumCellSize, float powerScale)
+    {
+        float3 extent = bounds.valid() ? bounds.extent() : float3(0.0f);
+        float widest = (std::max)(extent.x, (std::max)(extent.y, extent.z));
+        // A little over the strict minimum keeps the upper bound inside the last cell.
+        float cellSize = (std::max)(minimumCellSize, widest * 1.0001f / PACKED_PHOTON_MAX_CELLS);
+
+        PhotonGridFrame frame = {};
+        frame.originX = bounds.valid() ? bounds.lower.x : 0.0f;
+        frame.originY = bounds.valid() ? bounds.lower.y : 0.0f;
+        frame.originZ = bounds.valid() ? bounds.lower.z : 0.0f;
+        frame.cellSize = cellSize > 0 ? cellSize : 1.0f;
+        frame.powerScale = powerScale > 0 ? powerScale : 1.0f;
+        frame.inversePowerScale = 1.0f / frame.powerScale;
+        return frame;
+    }
+
+    PackedPhoton PackPhoton(const PhotonGridFrame& frame, const Photon& photon)
+    {
+        return EncodePhoton(frame, ToPacked(photon.position), ToPacked(photon.direction), ToPacked(photon.normal), ToPacked(photon.colour));
+    }
+
+    Photon UnpackPhoton(const PhotonGridFrame& frame, const PackedPhoton& photon)
+    {
+        Photon out;
+        out.position = float4(FromPacked(DecodePhotonPosition(frame, photon)), 1.0f);
+        out.direction = float4(FromPacked(DecodePhotonDirection(photon)), 1.0f);
+        out.colour = float4(FromPacked(DecodePhotonPower(frame, photon)), 1.0f);
+        out.normal = float4(FromPacked(DecodePhotonNormal(photon)), 1.0f);
+        return out;
+    }
+
+    PhotonEncodingError MeasurePhotonEncodingError(const PhotonGridFrame& frame, const std::vector<Photon>& photons)
+    {
+        PhotonEncodingError error;
+        uint64_t lit = 0;
+        for (const Photon& photon : photons) {
+            Photon decoded = UnpackPhoton(frame, PackPhoton(frame, photon));
+
+            double position = length(Xyz(decoded.position) - Xyz(photon.position)) / frame.cellSize;
+            error.positionRms += position * position;
+            error.positionMax = (std::max)(error.positionMax, position);
+
+            double direction = AngleDegrees(Xyz(decoded.direction), Xyz(photon.direction));
+            error.directionMeanDegrees += direction;
+            error.directionMaxDegrees = (std::max)(error.directionMaxDegrees, direction);
+            double normal = AngleDegrees(Xyz(decoded.normal), Xyz(photon.normal));
+            error.normalMeanDegrees += normal;
+            error.normalMaxDegrees = (std::max)(error.normalMaxDegrees, normal);
+
+            float power = MaxChannel(Xyz(photon.colour));
+            if (power > 0) {
+                double relative = std::fabs(MaxChannel(Xyz(decoded.colour)) - power) / power;
+                error.powerRelativeRms += relative * relative;
+                error.powerRelativeMax = (std::max)(error.powerRelativeMax, relative);
+                lit++;
+            }
+        }
+        if (!photons.empty()) {
+            error.positionRms = std::sqrt(error.positionRms / photons.size());
+            error.directionMeanDegrees /= photons.size();
+            error.normalMeanDegrees /= photons.size();
+        }
+        if (lit > 0) {
+            error.powerRelativeRms = std::sqrt(error.powerRelativeRms / lit);
+        }
+        return error;
+    }
+
+    PhotonEncodingBenchmarkResult BenchmarkPhotonEncoding(const Scene& scene, const Bvh& bvh, uint32_t photons, uint32_t queries, float radius, unsigned threads)
+    {
+        PhotonEncodingBenchmarkResult result = {};
+        result.radius = radius;
+
+        PhotonEmitSettings settings;
+        settings.photons = photons;
+        settings.threads = threads;
+        PhotonBuffers store(photons * settings.maxDepth, UINT32_MAX);
+        PhotonEmitStats emitStats;
+        store.BeginFrame();
+        PhotonEmitter(scene, bvh).Emit(settings, store, emitStats);
+        store.EndFrame();
+        std::vector<Photon> full(store.Read(), store.Read() + store.ReadCount());
+        result.photons = static_cast<uint32_t>(full.size());
+
+        Aabb bounds;
+        double meanPower = 0;
+        for (const Photon& photon : full) {
+            bounds.grow(Xyz(photon.position));
+            meanPower += MaxChannel(Xyz(photon.colour));
+        }
+        meanPower = full.empty() ? 1.0 : meanPower / full.size();
+        PhotonGridFrame frame = MakePhotonGridFrame(bounds, radius, static_cast<float>(meanPower));
+        result.error = MeasurePhotonEncodingError(frame, full);
+
+        // Encode, then put both layouts in cell order so a gather reads each cell contiguously.
+        std::vector<PackedPhoton> packed(full.size());
+        Clock::time_point start = Clock::now();
+        ParallelFor(full.size(), [&](size_t i, unsigned) { packed[i] = PackPhoton(frame, full[i]); }, threads);
+        double encodeSeconds = SecondsSince(start);
+        result.encodedPerSecond = encodeSeconds > 0 ? full.size() / encodeSeconds : 0;
+
+        std::vector<uint32_t> order(full.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return packed[a].cell < packed[b].cell; });
+        std::vector<Photon> sortedFull(full.size());
+        std::vector<PackedPhoton> sortedPacked(full.size());
+        std::vector<uint32_t> cells(full.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            sortedFull[i] = full[order[i]];
+            sortedPacked[i] = packed[order[i]];
+            cells[i] = packed[order[i]].cell;
+        }
+
+        // Queries sit on the surfaces photons landed on, a little off a stored photon.
+        std::vector<GatherQuery> gatherQueries;
+        uint32_t seed = 0x2545F491u;
+        for (uint32_t q = 0; q < queries && !full.empty(); q++) {
+            const Photon& photon = full[static_cast<size_t>(seed_xorshift(seed) * (full.size() - 1))];
+            float3 jitter(seed_xorshift(seed) - 0.5f, seed_xorshift(seed) - 0.5f, seed_xorshift(seed) - 0.5f);
+            GatherQuery query = { Xyz(photon.position) + jitter * radius, Xyz(photon.normal) };
+            gatherQueries.push_back(query);
+        }
+        result.queries = static_cast<uint32_t>(gatherQueries.size());
+
+        std::vector<float3> fullEstimates(gatherQueries.size()), packedEstimates(gatherQueries.size());
+        uint64_t visited = 0;
+        result.fullGatherSeconds = Gather(frame, sortedFull, cells, gatherQueries, radius, fullEstimates, visited, threads);
+        result.packedGatherSeconds = Gather(frame, sortedPacked, cells, gatherQueries, radius, packedEstimates, visited, threads);
+        result.recordsVisited = visited;
+        result.fullBytesPerSecond = result.fullGatherSeconds > 0 ? visited * sizeof(Photon) / result.fullGatherSeconds : 0;
+        result.packedBytesPerSecond = result.packedGatherSeconds > 0 ? visited * sizeof(PackedPhoton) / result.packedGatherSeconds : 0;
+
+        double relative = 0;
+        uint32_t lit = 0;
+        for (size_t q = 0; q < gatherQueries.size(); q++) {
+            float reference = MaxChannel(fullEstimates[q]);
+            if (reference > 0) {
+                relative += std::fabs(MaxChannel(packedEstimates[q]) - reference) / reference;
+                lit++;
+            }
+        }
+        result.estimateRelativeError = lit > 0 ? relative / lit : 0;
+        return result;
+    }
+
+    std::string PhotonEncodingBenchmarkSummary(const PhotonEncodingBenchmarkResult& result)
+    {
+        const double gigabyte = 1024.0 * 1024.0 * 1024.0;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.photons << " photons, " << result.queries << " queries, radius " << result.radius
+            << " | encode " << result.encodedPerSecond / 1e6 << " M/s"
+            << " | gather " << sizeof(Photon) << " B " << result.fullGatherSeconds * 1000.0 << " ms (" << result.fullBytesPerSecond / gigabyte << " GB/s)"
+            << ", " << sizeof(PackedPhoton) << " B " << result.packedGatherSeconds * 1000.0 << " ms (" << result.packedBytesPerSecond / gigabyte << " GB/s)"
+            << " | estimate error " << result.estimateRelativeError * 100.0 << "%"
+            << std::setprecision(4)
+            << " | position rms " << result.error.positionRms << " / max " << result.error.positionMax << " cells"
+            << " | direction " << result.error.directionMeanDegrees << " / " << result.error.directionMaxDegrees << " deg"
+            << ", normal " << result.error.normalMeanDegrees << " / " << result.error.normalMaxDegrees << " deg"
+            << " | power rms " << result.error.powerRelativeRms * 100.0 << "% / max " << result.error.powerRelativeMax * 100.0 << "%";
+        return out.str();
+    }
+}
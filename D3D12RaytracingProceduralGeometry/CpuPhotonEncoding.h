@@ -0,0 +1,61 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuPhotonEncoding.h
+//
+// The CPU side of PackedPhoton.h: conversion between Cpu::Photon and the 16-byte record, and
+// a benchmark that gathers the same photons in both layouts. The two gathers visit the same
+// photons in the same order, so the difference in time is what the smaller records save in
+// bandwidth, net of decoding, and the difference in the estimates is what quantisation costs.
+//
+//**********************************************************************************************
+
+#include "CpuPhotons.h"
+#include "PackedPhoton.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    // A frame whose cells are at least minimumCellSize wide and cover bounds within the
+    // PACKED_PHOTON_MAX_CELLS cells per axis. powerScale should be about a photon's flux.
+    PhotonGridFrame MakePhotonGridFrame(const Aabb& bounds, float minimumCellSize, float powerScale);
+
+    PackedPhoton PackPhoton(const PhotonGridFrame& frame, const Photon& photon);
+    // Segment length and probability come back as 1.
+    Photon UnpackPhoton(const PhotonGridFrame& frame, const PackedPhoton& photon);
+
+    struct PhotonEncodingError {
+        double positionRms = 0;         // In cells.
+        double positionMax = 0;
+        double directionMeanDegrees = 0;
+        double directionMaxDegrees = 0;
+        double normalMeanDegrees = 0;
+        double normalMaxDegrees = 0;
+        double powerRelativeRms = 0;    // Of the brightest channel.
+        double powerRelativeMax = 0;
+    };
+
+    // Round-trip error of every photon in photons through the frame.
+    PhotonEncodingError MeasurePhotonEncodingError(const PhotonGridFrame& frame, const std::vector<Photon>& photons);
+
+    struct PhotonEncodingBenchmarkResult {
+        uint32_t photons;
+        uint32_t queries;
+        float radius;
+        double encodedPerSecond;
+        double fullGatherSeconds;           // 64-byte records.
+        double packedGatherSeconds;         // 16-byte records, decoded as they are read.
+        double fullBytesPerSecond;          // Record bytes the gather read over its time.
+        double packedBytesPerSecond;
+        uint64_t recordsVisited;            // Per gather; the same for both layouts.
+        double estimateRelativeError;       // Mean over queries with light, packed against full.
+        PhotonEncodingError error;
+    };
+
+    // Emits photons photons through the scene, encodes them against a grid of radius-wide
+    // cells, and gathers around queries of the stored photons in both layouts.
+    PhotonEncodingBenchmarkResult BenchmarkPhotonEncoding(const Scene& scene, const Bvh& bvh, uint32_t photons, uint32_t queries, float radius, unsigned threads = 0);
+    std::string PhotonEncodingBenchmarkSummary(const PhotonEncodingBenchmarkResult& result);
+}
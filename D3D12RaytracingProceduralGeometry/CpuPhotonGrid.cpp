@@ -0,0 +1,312 @@
+#include "CpuPhotonGrid.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        // Photons or buckets a worker takes at a time in the build's passes.
+        const size_t BuildChunk = 4096;
+        // Buckets one worker prefix-sums; the block totals are summed serially in between.
+        const size_t ScanBlock = 1 << 16;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        struct TreeEntry {
+            float3 position;
+            uint32_t index;
+        };
+
+        // Makes the median of entries[begin..end) its node: splits the range on its widest axis
+        // and returns the node.
+        uint32_t SplitRange(std::vector<TreeEntry>& entries, std::vector<uint8_t>& axes, uint32_t begin, uint32_t end)
+        {
+            Aabb bounds;
+            for (uint32_t i = begin; i < end; i++) {
+                bounds.grow(entries[i].position);
+            }
+            int axis = bounds.longestAxis();
+            uint32_t node = begin + (end - begin) / 2;
+            std::nth_element(entries.begin() + begin, entries.begin() + node, entries.begin() + end,
+                [axis](const TreeEntry& a, const TreeEntry& b) { return a.position[axis] < b.position[axis]; });
+            axes[node] = static_cast<uint8_t>(axis);
+            return node;
+        }
+
+        void BuildRange(std::vector<TreeEntry>& entries, std::vector<uint8_t>& axes, uint32_t begin, uint32_t end)
+        {
+            if (end - begin <= 1) {
+                return;
+            }
+            uint32_t node = SplitRange(entries, axes, begin, end);
+            BuildRange(entries, axes, begin, node);
+            BuildRange(entries, axes, node + 1, end);
+        }
+
+        struct Range {
+            uint32_t begin;
+            uint32_t end;
+        };
+    }
+
+    void PhotonHashGrid::Build(const Photon* photons, uint32_t count, float cellSize, unsigned threads)
+    {
+        BuildFrom([photons](uint32_t i) {
+            const float4& p = photons[i].position;
+            return float3(p.x, p.y, p.z);
+        }, count, cellSize, threads);
+    }
+
+    void PhotonHashGrid::Build(const float3* positions, uint32_t count, float cellSize, unsigned threads)
+    {
+        BuildFrom([positions](uint32_t i) { return positions[i]; }, count, cellSize, threads);
+    }
+
+    template<typename Position>
+    void PhotonHashGrid::BuildFrom(Position position, uint32_t count, float cellSize, unsigned threads)
+    {
+        uint32_t buckets = 1;
+        while (buckets < count) {
+            buckets <<= 1;
+        }
+        m_constants.cellSize = cellSize > 0 ? cellSize : 1.0f;
+        m_constants.inverseCellSize = 1.0f / m_constants.cellSize;
+        m_constants.bucketMask = buckets - 1;
+        m_constants.photonCount = count;
+
+        // Atomics cannot be moved, so the counters are only replaced when they have to grow.
+        if (m_counters.size() < buckets) {
+            m_counters = std::vector<std::atomic<uint32_t>>(buckets);
+        }
+        m_cellStart.resize(static_cast<size_t>(buckets) + 1);
+        m_buckets.resize(count);
+        m_order.resize(count);
+        m_positions.resize(count);
+
+        ParallelForChunks(buckets, BuildChunk, [&](size_t begin, size_t end, unsigned) {
+            for (size_t b = begin; b < end; b++) {
+                m_counters[b].store(0, std::memory_order_relaxed);
+            }
+        }, threads);
+
+        // Count.
+        ParallelForChunks(count, BuildChunk, [&](size_t begin, size_t end, unsigned) {
+            float inverseCellSize = m_constants.inverseCellSize;
+            for (size_t i = begin; i < end; i++) {
+                float3 p = position(static_cast<uint32_t>(i));
+                uint32_t bucket = PhotonHashGridBucket(PhotonHashGridCoordinate(p.x, inverseCellSize),
+                    PhotonHashGridCoordinate(p.y, inverseCellSize), PhotonHashGridCoordinate(p.z, inverseCellSize), m_constants.bucketMask);
+                m_buckets[i] = bucket;
+                m_counters[bucket].fetch_add(1, std::memory_order_relaxed);
+            }
+        }, threads);
+
+        // Prefix sum: each block's total, the totals summed into block starts, then each block's
+        // buckets from its start. The counters become the scatter cursors on the way.
+        size_t blocks = (buckets + ScanBlock - 1) / ScanBlock;
+        std::vector<uint32_t> blockStart(blocks + 1, 0);
+        std::vector<uint32_t> blockOccupied(blocks, 0);
+        ParallelFor(blocks, [&](size_t k, unsigned) {
+            size_t end = (std::min)((k + 1) * ScanBlock, static_cast<size_t>(buckets));
+            uint32_t total = 0;
+            for (size_t b = k * ScanBlock; b < end; b++) {
+                total += m_counters[b].load(std::memory_order_relaxed);
+            }
+            blockStart[k + 1] = total;
+        }, threads, 1);
+        for (size_t k = 0; k < blocks; k++) {
+            blockStart[k + 1] += blockStart[k];
+        }
+        ParallelFor(blocks, [&](size_t k, unsigned) {
+            size_t end = (std::min)((k + 1) * ScanBlock, static_cast<size_t>(buckets));
+            uint32_t running = blockStart[k];
+            for (size_t b = k * ScanBlock; b < end; b++) {
+                uint32_t bucketCount = m_counters[b].load(std::memory_order_relaxed);
+                m_cellStart[b] = running;
+                m_counters[b].store(running, std::memory_order_relaxed);
+                running += bucketCount;
+                blockOccupied[k] += bucketCount > 0 ? 1 : 0;
+            }
+        }, threads, 1);
+        m_cellStart[buckets] = count;
+        m_occupied = std::accumulate(blockOccupied.begin(), blockOccupied.end(), 0u);
+
+        // Scatter.
+        ParallelForChunks(count, BuildChunk, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t slot = m_counters[m_buckets[i]].fetch_add(1, std::memory_order_relaxed);
+                m_order[slot] = static_cast<uint32_t>(i);
+            }
+        }, threads);
+
+        // Put each bucket's photons back in index order and copy their positions next to them.
+        ParallelForChunks(buckets, BuildChunk, [&](size_t begin, size_t end, unsigned) {
+            for (size_t b = begin; b < end; b++) {
+                uint32_t first = m_cellStart[b];
+                uint32_t last = m_cellStart[b + 1];
+                if (last - first > 1) {
+                    std::sort(m_order.begin() + first, m_order.begin() + last);
+                }
+                for (uint32_t i = first; i < last; i++) {
+                    m_positions[i] = position(m_order[i]);
+                }
+            }
+        }, threads);
+    }
+
+    size_t PhotonHashGrid::Bytes() const
+    {
+        return (m_cellStart.capacity() + m_order.capacity() + m_buckets.capacity()) * sizeof(uint32_t)
+            + m_positions.capacity() * sizeof(float3) + m_counters.size() * sizeof(std::atomic<uint32_t>);
+    }
+
+    // The first levels split their ranges level by level, each range on a worker; once there
+    // are a few ranges per worker, every worker builds whole subtrees.
+    void PhotonKdTree::Build(const float3* positions, uint32_t count, unsigned threads)
+    {
+        std::vector<TreeEntry> entries(count);
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i].position = positions[i];
+            entries[i].index = i;
+        }
+        m_axes.assign(count, 0);
+
+        size_t target = 4 * static_cast<size_t>(WorkerCount(threads));
+        std::vector<Range> ranges(1, Range{ 0, count });
+        while (ranges.size() < target && count > target) {
+            std::vector<Range> next(2 * ranges.size());
+            ParallelFor(ranges.size(), [&](size_t r, unsigned) {
+                Range range = ranges[r];
+                uint32_t node = range.end - range.begin > 1 ? SplitRange(entries, m_axes, range.begin, range.end) : range.begin;
+                next[2 * r] = Range{ range.begin, (std::max)(range.begin, node) };
+                next[2 * r + 1] = Range{ (std::min)(node + 1, range.end), range.end };
+            }, threads, 1);
+            ranges.swap(next);
+        }
+        ParallelFor(ranges.size(), [&](size_t r, unsigned) {
+            BuildRange(entries, m_axes, ranges[r].begin, ranges[r].end);
+        }, threads, 1);
+
+        m_positions.resize(count);
+        m_indices.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            m_positions[i] = entries[i].position;
+            m_indices[i] = entries[i].index;
+        }
+    }
+
+    size_t PhotonKdTree::Bytes() const
+    {
+        return m_positions.capacity() * sizeof(float3) + m_indices.capacity() * sizeof(uint32_t) + m_axes.capacity();
+    }
+
+    PhotonGridBenchmarkResult BenchmarkPhotonGrid(const Scene& scene, const Bvh& bvh, uint32_t photons, uint32_t queries, float radius, unsigned threads)
+    {
+        PhotonGridBenchmarkResult result = {};
+        result.radius = radius;
+        result.threads = WorkerCount(threads);
+
+        // A store big enough for a million emitted photons' bounces, refilled until enough
+        // positions have been kept.
+        std::vector<float3> positions;
+        positions.reserve(photons);
+        PhotonEmitSettings settings;
+        settings.photons = (std::min)(photons, 1u << 20);
+        settings.threads = threads;
+        PhotonBuffers store((std::max)(settings.photons, 1u) * settings.maxDepth, UINT32_MAX);
+        PhotonEmitter emitter(scene, bvh);
+        while (positions.size() < photons) {
+            PhotonEmitStats emitStats;
+            store.BeginFrame();
+            emitter.Emit(settings, store, emitStats);
+            store.EndFrame();
+            if (store.ReadCount() == 0) {
+                break;
+            }
+            const Photon* stored = store.Read();
+            for (uint32_t i = 0; i < store.ReadCount() && positions.size() < photons; i++) {
+                positions.push_back(float3(stored[i].position.x, stored[i].position.y, stored[i].position.z));
+            }
+            settings.frameIndex++;
+        }
+        result.photons = static_cast<uint32_t>(positions.size());
+
+        std::vector<float3> queryPositions;
+        uint32_t seed = 0x2545F491u;
+        for (uint32_t q = 0; q < queries && !positions.empty(); q++) {
+            const float3& photon = positions[static_cast<size_t>(seed_xorshift(seed) * (positions.size() - 1))];
+            float3 jitter(seed_xorshift(seed) - 0.5f, seed_xorshift(seed) - 0.5f, seed_xorshift(seed) - 0.5f);
+            queryPositions.push_back(photon + jitter * radius);
+        }
+        result.queries = static_cast<uint32_t>(queryPositions.size());
+
+        PhotonHashGrid grid;
+        Clock::time_point start = Clock::now();
+        grid.Build(positions.data(), result.photons, radius, threads);
+        result.gridBuildSeconds = SecondsSince(start);
+        result.gridBytes = grid.Bytes();
+        result.occupiedBuckets = grid.OccupiedBuckets();
+
+        PhotonKdTree tree;
+        start = Clock::now();
+        tree.Build(positions.data(), result.photons, threads);
+        result.treeBuildSeconds = SecondsSince(start);
+        result.treeBytes = tree.Bytes();
+
+        std::vector<uint32_t> gridFound(queryPositions.size(), 0), treeFound(queryPositions.size(), 0);
+        start = Clock::now();
+        ParallelForChunks(queryPositions.size(), 64, [&](size_t begin, size_t end, unsigned) {
+            for (size_t q = begin; q < end; q++) {
+                uint32_t found = 0;
+                grid.ForEachInRadius(queryPositions[q], radius, [&found](uint32_t, float) { found++; });
+                gridFound[q] = found;
+            }
+        }, threads);
+        result.gridQuerySeconds = SecondsSince(start);
+
+        start = Clock::now();
+        ParallelForChunks(queryPositions.size(), 64, [&](size_t begin, size_t end, unsigned) {
+            for (size_t q = begin; q < end; q++) {
+                uint32_t found = 0;
+                tree.ForEachInRadius(queryPositions[q], radius, [&found](uint32_t, float) { found++; });
+                treeFound[q] = found;
+            }
+        }, threads);
+        result.treeQuerySeconds = SecondsSince(start);
+
+        for (size_t q = 0; q < queryPositions.size(); q++) {
+            result.neighbours += gridFound[q];
+            result.mismatches += gridFound[q] != treeFound[q] ? 1 : 0;
+        }
+        return result;
+    }
+
+    std::string PhotonGridBenchmarkSummary(const PhotonGridBenchmarkResult& result)
+    {
+        double photons = result.photons;
+        double queries = result.queries;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.photons << " photons, " << result.queries << " queries, radius " << result.radius
+            << ", " << result.threads << " threads"
+            << " | hash grid build " << result.gridBuildSeconds * 1000.0 << " ms (" << (result.gridBuildSeconds > 0 ? photons / result.gridBuildSeconds / 1e6 : 0) << " Mphotons/s)"
+            << ", query " << (result.gridQuerySeconds > 0 ? queries / result.gridQuerySeconds / 1e6 : 0) << " Mqueries/s"
+            << ", " << (photons > 0 ? result.gridBytes / photons : 0) << " B/photon"
+            << ", " << result.occupiedBuckets << " buckets occupied"
+            << " | kd-tree build " << result.treeBuildSeconds * 1000.0 << " ms (" << (result.treeBuildSeconds > 0 ? photons / result.treeBuildSeconds / 1e6 : 0) << " Mphotons/s)"
+            << ", query " << (result.treeQuerySeconds > 0 ? queries / result.treeQuerySeconds / 1e6 : 0) << " Mqueries/s"
+            << ", " << (photons > 0 ? result.treeBytes / photons : 0) << " B/photon"
+            << " | " << (queries > 0 ? result.neighbours / queries : 0) << " neighbours per query, "
+            << result.mismatches << " mismatches";
+        return out.str();
+    }
+}
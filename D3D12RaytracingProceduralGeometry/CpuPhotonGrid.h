@@ -0,0 +1,184 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuPhotonGrid.h
+//
+// Photon lookups for the CPU backend: PhotonHashGrid builds the layout of PhotonHashGrid.h the
+// way a compute shader would, and PhotonKdTree is the balanced kd-tree it is measured against.
+// Both answer the same fixed-radius queries from any number of threads once built.
+//
+// The grid is a counting sort. Every photon's bucket is counted with an atomic add, the counts
+// are prefix-summed into cellStart, and every photon is scattered to the next free slot of its
+// bucket, again with an atomic. Each pass is one parallel loop over photons or buckets, like
+// the dispatches it would be on the GPU. Scattering with atomics leaves each bucket's photons
+// in whatever order the threads got to them, so the build finishes by sorting each bucket's
+// (short) run, which makes gathers sum in the same order on every run.
+//
+//**********************************************************************************************
+
+#include "CpuPhotons.h"
+#include "PhotonHashGrid.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    class PhotonHashGrid
+    {
+    public:
+        // Grids photons[0..count) in cells cellSize wide, the largest radius it will be asked
+        // to gather. The table has the first power-of-two number of buckets at least count.
+        void Build(const Photon* photons, uint32_t count, float cellSize, unsigned threads = 0);
+        void Build(const float3* positions, uint32_t count, float cellSize, unsigned threads = 0);
+
+        // Calls fn(index, distanceSquared) for every photon within radius of position, which
+        // must not be more than the cell size.
+        template<typename Fn>
+        void ForEachInRadius(const float3& position, float radius, Fn fn) const;
+
+        // What a compute shader needs besides the photons themselves; see PhotonHashGrid.h.
+        const PhotonHashGridConstants& Constants() const { return m_constants; }
+        const std::vector<uint32_t>& CellStart() const { return m_cellStart; }
+        const std::vector<uint32_t>& Order() const { return m_order; }
+
+        uint32_t OccupiedBuckets() const { return m_occupied; }
+        size_t Bytes() const;
+
+    private:
+        PhotonHashGridConstants m_constants = {};
+        std::vector<uint32_t> m_cellStart;
+        std::vector<uint32_t> m_order;
+        std::vector<float3> m_positions;                // In order; the gather reads these, not the photons.
+        std::vector<uint32_t> m_buckets;                // Of each photon, kept between builds.
+        std::vector<std::atomic<uint32_t>> m_counters;  // Counts, then scatter cursors.
+        uint32_t m_occupied = 0;
+
+        template<typename Position>
+        void BuildFrom(Position position, uint32_t count, float cellSize, unsigned threads);
+    };
+
+    // A balanced kd-tree over photon positions in one array: the median of each range is its
+    // node, split on the range's widest axis, and the halves either side are its subtrees.
+    class PhotonKdTree
+    {
+    public:
+        void Build(const float3* positions, uint32_t count, unsigned threads = 0);
+
+        template<typename Fn>
+        void ForEachInRadius(const float3& position, float radius, Fn fn) const;
+
+        size_t Bytes() const;
+
+    private:
+        std::vector<float3> m_positions;    // Tree order.
+        std::vector<uint32_t> m_indices;    // Of each node's photon.
+        std::vector<uint8_t> m_axes;        // Of each node's split.
+    };
+
+    struct PhotonGridBenchmarkResult {
+        uint32_t photons;
+        uint32_t queries;
+        float radius;
+        unsigned threads;
+        double gridBuildSeconds;
+        double gridQuerySeconds;
+        double treeBuildSeconds;
+        double treeQuerySeconds;
+        size_t gridBytes;
+        size_t treeBytes;
+        uint32_t occupiedBuckets;
+        uint64_t neighbours;                // Found by the grid over all queries.
+        uint32_t mismatches;                // Queries whose neighbour count the tree disagrees on.
+    };
+
+    // Emits photons through the scene until photons have been stored (in batches, keeping only
+    // positions, so tens of millions fit), then builds both structures over them and gathers
+    // radius around queries near stored photons.
+    PhotonGridBenchmarkResult BenchmarkPhotonGrid(const Scene& scene, const Bvh& bvh, uint32_t photons, uint32_t queries, float radius, unsigned threads = 0);
+    std::string PhotonGridBenchmarkSummary(const PhotonGridBenchmarkResult& result);
+
+    template<typename Fn>
+    void PhotonHashGrid::ForEachInRadius(const float3& position, float radius, Fn fn) const
+    {
+        if (m_order.empty()) {
+            return;
+        }
+        float radiusSquared = radius * radius;
+        int cx = PhotonHashGridCoordinate(position.x, m_constants.inverseCellSize);
+        int cy = PhotonHashGridCoordinate(position.y, m_constants.inverseCellSize);
+        int cz = PhotonHashGridCoordinate(position.z, m_constants.inverseCellSize);
+
+        // Distinct cells can hash to one bucket; each bucket is only searched once.
+        uint32_t visited[27];
+        uint32_t visitedCount = 0;
+        for (int z = cz - 1; z <= cz + 1; z++) {
+            for (int y = cy - 1; y <= cy + 1; y++) {
+                for (int x = cx - 1; x <= cx + 1; x++) {
+                    uint32_t bucket = PhotonHashGridBucket(x, y, z, m_constants.bucketMask);
+                    uint32_t first = m_cellStart[bucket];
+                    uint32_t end = m_cellStart[bucket + 1];
+                    if (first == end) {
+                        continue;
+                    }
+                    bool seen = false;
+                    for (uint32_t v = 0; v < visitedCount && !seen; v++) {
+                        seen = visited[v] == bucket;
+                    }
+                    if (seen) {
+                        continue;
+                    }
+                    visited[visitedCount++] = bucket;
+                    for (uint32_t i = first; i < end; i++) {
+                        float3 offset = m_positions[i] - position;
+                        float distanceSquared = dot(offset, offset);
+                        if (distanceSquared < radiusSquared) {
+                            fn(m_order[i], distanceSquared);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename Fn>
+    void PhotonKdTree::ForEachInRadius(const float3& position, float radius, Fn fn) const
+    {
+        if (m_positions.empty()) {
+            return;
+        }
+        float radiusSquared = radius * radius;
+        // Ranges still to visit; a balanced tree over 2^32 photons is 32 deep, and each level
+        // leaves at most one range behind.
+        uint32_t stack[2 * 33];
+        uint32_t depth = 0;
+        stack[depth++] = 0;
+        stack[depth++] = static_cast<uint32_t>(m_positions.size());
+        while (depth > 0) {
+            uint32_t end = stack[--depth];
+            uint32_t begin = stack[--depth];
+            while (begin < end) {
+                uint32_t node = begin + (end - begin) / 2;
+                const float3& point = m_positions[node];
+                float3 offset = point - position;
+                float distanceSquared = dot(offset, offset);
+                if (distanceSquared < radiusSquared) {
+                    fn(m_indices[node], distanceSquared);
+                }
+                int axis = m_axes[node];
+                float along = position[axis] - point[axis];
+                // Descend into the near side now and come back for the far one only if the
+                // sphere crosses the split.
+                uint32_t nearBegin = along < 0 ? begin : node + 1;
+                uint32_t nearEnd = along < 0 ? node : end;
+                if (along * along < radiusSquared) {
+                    stack[depth++] = along < 0 ? node + 1 : begin;
+                    stack[depth++] = along < 0 ? end : node;
+                }
+                begin = nearBegin;
+                end = nearEnd;
+            }
+        }
+    }
+}
@@ -0,0 +1,216 @@
+#include "CpuPhotons.h"
+#include "CpuParallel.h"
+#include "CpuShading.h"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const float RayTMin = 0.001f;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // Hands a worker's photons to the store, one atomic per photon or per batch.
+        void Flush(std::vector<Photon>& photons, bool batched, PhotonBuffers& store)
+        {
+            if (batched) {
+                uint32_t first;
+                uint32_t fit = store.Reserve(static_cast<uint32_t>(photons.size()), first);
+                std::copy(photons.begin(), photons.begin() + fit, store.WriteSlots() + first);
+            }
+            else {
+                for (const Photon& photon : photons) {
+                    store.Append(photon);
+                }
+            }
+            photons.clear();
+        }
+    }
+
+    std::string PhotonEmitStats::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << emitted << " photons, " << appended << " appended, " << segments << " segments in " << seconds * 1000.0 << " ms"
+            << " | " << PhotonsPerSecond() / 1e6 << " Mphotons/s";
+        return out.str();
+    }
+
+    PhotonEmitter::PhotonEmitter(const Scene& scene, const Bvh& bvh) : m_scene(scene), m_bvh(bvh)
+    {
+    }
+
+    void PhotonEmitter::Emit(const PhotonEmitSettings& settings, PhotonBuffers& store, PhotonEmitStats& stats) const
+    {
+        Emit(settings, std::vector<Light>(1, m_scene.light), store, stats);
+    }
+
+    void PhotonEmitter::Emit(const PhotonEmitSettings& settings, const std::vector<Light>& lights, PhotonBuffers& store, PhotonEmitStats& stats) const
+    {
+        Clock::time_point start = Clock::now();
+        PhotonBudget budget(settings.photons);
+        std::vector<float> powers;
+        for (const Light& light : lights) {
+            powers.push_back(PhotonLightWeight(light.power, light.colour.x, light.colour.y, light.colour.z));
+        }
+        const std::vector<PhotonLightShare>& shares = budget.Allocate(powers.data(), static_cast<uint32_t>(lights.size()));
+        std::vector<float3> flux;
+        for (size_t l = 0; l < lights.size(); l++) {
+            flux.push_back(lights[l].colour * (lights[l].power * shares[l].fluxScale));
+        }
+        uint32_t batch = (std::max)(settings.appendBatch, 1u);
+
+        std::vector<std::vector<Photon>> pending(WorkerCount(settings.threads));
+        std::vector<uint64_t> appended(pending.size(), 0), segments(pending.size(), 0);
+        ParallelForChunks(budget.Emitted(), 256, [&](size_t begin, size_t end, unsigned worker) {
+            std::vector<Photon>& photons = pending[worker];
+            for (size_t i = begin; i < end; i++) {
+                uint32_t light = budget.LightOf(static_cast<uint32_t>(i));
+                segments[worker] += TracePhoton(static_cast<uint32_t>(i), settings, lights[light], flux[light], photons);
+                if (photons.size() >= batch) {
+                    appended[worker] += photons.size();
+                    Flush(photons, batch > 1, store);
+                }
+            }
+        }, settings.threads);
+        for (size_t w = 0; w < pending.size(); w++) {
+            appended[w] += pending[w].size();
+            Flush(pending[w], batch > 1, store);
+            stats.appended += appended[w];
+            stats.segments += segments[w];
+        }
+        stats.emitted += budget.Emitted();
+        stats.seconds += SecondsSince(start);
+    }
+
+    uint32_t PhotonEmitter::TracePhoton(uint32_t index, const PhotonEmitSettings& settings, const Light& light, float3 flux, std::vector<Photon>& out) const
+    {
+        uint32_t seed = wang_hash_original(index + settings.frameIndex * 0x9E3779B9u) | 1u;
+        Ray ray;
+        ray.origin = light.position;
+        ray.direction = UniformSphereDirection(seed);
+
+        uint32_t depth = 0;
+        while (depth < settings.maxDepth) {
+            depth++;
+            Hit hit;
+            if (!m_bvh.Intersect(m_scene, ray, RayTMin, hit)) {
+                break;
+            }
+            const Material& material = m_scene.materials[m_scene.primitives[hit.primitive].materialIndex];
+            float3 position = ray.origin + hit.t * ray.direction;
+            bool frontFace = dot(hit.normal, ray.direction) < 0;
+            float3 normal = frontFace ? hit.normal : -hit.normal;
+            flux *= material.albedo;
+
+            switch (LabelBRDF(material)) {
+            case BRDF::Diffuse: {
+                Photon photon;
+                photon.position = float4(position, hit.t);
+                photon.direction = float4(ray.direction, 1.0f);
+                photon.colour = float4(flux, 1.0f);
+                photon.normal = float4(normal, 1.0f);
+                out.push_back(photon);
+                ray.direction = RandomDirectionInHemisphere(normal, seed);
+                break;
+            }
+            case BRDF::Reflective:
+                flux *= material.reflectanceCoef;
+                ray.direction = reflect(ray.direction, normal);
+                break;
+            case BRDF::Refractive: {
+                float fresnel = Fresnel(ray.direction, hit.normal, material.refractiveCoef);
+                float eta = frontFace ? 1.0f / material.refractiveCoef : material.refractiveCoef;
+                float3 refracted;
+                if (seed_xorshift(seed) >= fresnel && Refract(ray.direction, normal, eta, refracted)) {
+                    ray.origin = position - 0.001f * normal;
+                    ray.direction = normalize(refracted);
+                    continue;
+                }
+                ray.direction = reflect(ray.direction, normal);
+                break;
+            }
+            default:
+                break;
+            }
+            ray.origin = position + 0.001f * normal;
+        }
+        return depth;
+    }
+
+    PhotonStorageBenchmarkResult BenchmarkPhotonStorage(const Scene& scene, const Bvh& bvh, uint32_t photonsPerFrame, uint32_t frames, unsigned threads)
+    {
+        PhotonStorageBenchmarkResult result;
+        result.photonsPerFrame = photonsPerFrame;
+        result.frames = frames;
+        uint32_t initial = (std::max)(photonsPerFrame / 4, 1u);
+
+        // Appends alone: every worker writes the same record, so only the counter and the
+        // stores are measured.
+        for (int batched = 0; batched < 2; batched++) {
+            PhotonBuffers store(initial, UINT32_MAX);
+            Photon photon = {};
+            double seconds = 0;
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                store.BeginFrame();
+                Clock::time_point start = Clock::now();
+                ParallelForChunks(photonsPerFrame, 4096, [&](size_t begin, size_t end, unsigned) {
+                    if (batched) {
+                        for (size_t i = begin; i < end; i += 64) {
+                            uint32_t count = static_cast<uint32_t>((std::min)(end - i, size_t(64)));
+                            uint32_t first;
+                            uint32_t fit = store.Reserve(count, first);
+                            std::fill(store.WriteSlots() + first, store.WriteSlots() + first + fit, photon);
+                        }
+                    }
+                    else {
+                        for (size_t i = begin; i < end; i++) {
+                            store.Append(photon);
+                        }
+                    }
+                }, threads);
+                seconds += SecondsSince(start);
+                store.EndFrame();
+            }
+            double rate = seconds > 0 ? static_cast<double>(photonsPerFrame) * frames / seconds : 0;
+            (batched ? result.batchedAppendsPerSecond : result.appendsPerSecond) = rate;
+        }
+
+        PhotonBuffers store(initial, UINT32_MAX);
+        PhotonEmitter emitter(scene, bvh);
+        PhotonEmitSettings settings;
+        settings.photons = photonsPerFrame;
+        settings.threads = threads;
+        PhotonEmitStats stats;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            settings.frameIndex = frame;
+            store.BeginFrame();
+            emitter.Emit(settings, store, stats);
+            store.EndFrame();
+        }
+        result.emittedPerSecond = stats.PhotonsPerSecond();
+        result.storage = store.Stats();
+        result.finalCapacity = store.Capacity();
+        result.storeBytes = store.Bytes();
+        return result;
+    }
+
+    std::string PhotonStorageBenchmarkSummary(const PhotonStorageBenchmarkResult& result)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.photonsPerFrame << " photons x " << result.frames << " frames"
+            << " | append " << result.appendsPerSecond / 1e6 << " M/s, batched " << result.batchedAppendsPerSecond / 1e6 << " M/s"
+            << " | emit " << result.emittedPerSecond / 1e6 << " Mphotons/s"
+            << " | capacity " << result.finalCapacity << ", " << result.storeBytes / (1024.0 * 1024.0) << " MB"
+            << " | " << result.storage.Summary();
+        return out.str();
+    }
+}
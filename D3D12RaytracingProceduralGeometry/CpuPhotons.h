@@ -0,0 +1,85 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuPhotons.h
+//
+// CPU photon emission, mirroring Photon_Ray_Gen and the photon closest-hit shaders: photons
+// leave the point lights, split between them by a PhotonBudget, are stored at every diffuse surface they reach, and carry on by a
+// cosine-weighted bounce, a mirror reflection or a Fresnel-chosen refraction until
+// MAX_RAY_RECURSION_DEPTH segments. They are appended to a Cpu::PhotonStore, the same
+// persistent, counter-cleared scheme the GPU photon buffers use (see PhotonStorage.h).
+//
+//**********************************************************************************************
+
+#include "CpuBvh.h"
+#include "CpuTracer.h"
+#include "PhotonBudget.h"
+#include "PhotonStorage.h"
+#include <string>
+
+namespace Cpu {
+
+    // Mirrors Photon in RayTracingHlslCompat.h, 64 bytes.
+    struct Photon {
+        float4 position;        // w: length of the segment that reached it.
+        float4 direction;       // Incoming, normalised; w = 1.
+        float4 colour;          // Flux carried; w = 1.
+        float4 normal;          // Of the surface; w: path probability.
+    };
+
+    typedef PhotonStore<Photon> PhotonBuffers;
+
+    struct PhotonEmitSettings {
+        uint32_t photons = 100000;      // Per frame, over all lights.
+        uint32_t maxDepth = CPU_MAX_RAY_RECURSION_DEPTH;
+        uint32_t frameIndex = 0;        // Seeds the RNG.
+        uint32_t appendBatch = 64;      // Photons a worker gathers before claiming slots; 1 appends one by one.
+        unsigned threads = 0;
+    };
+
+    struct PhotonEmitStats {
+        uint64_t emitted = 0;
+        uint64_t appended = 0;          // Store attempts, including ones that found it full.
+        uint64_t segments = 0;          // Rays traced.
+        double seconds = 0;
+
+        double PhotonsPerSecond() const { return seconds > 0 ? emitted / seconds : 0; }
+        std::string Summary() const;
+    };
+
+    class PhotonEmitter
+    {
+    public:
+        PhotonEmitter(const Scene& scene, const Bvh& bvh);
+
+        // Emits one frame's photons into the store's write set. The caller brackets it with
+        // the store's BeginFrame() and EndFrame().
+        void Emit(const PhotonEmitSettings& settings, PhotonBuffers& store, PhotonEmitStats& stats) const;
+        // The same from several lights; each gets a share of settings.photons by its power.
+        void Emit(const PhotonEmitSettings& settings, const std::vector<Light>& lights, PhotonBuffers& store, PhotonEmitStats& stats) const;
+
+    private:
+        const Scene& m_scene;
+        const Bvh& m_bvh;
+
+        // Traces photon index, appending what it stores to out. Returns the segments traced.
+        uint32_t TracePhoton(uint32_t index, const PhotonEmitSettings& settings, const Light& light, float3 flux, std::vector<Photon>& out) const;
+    };
+
+    struct PhotonStorageBenchmarkResult {
+        uint32_t photonsPerFrame;
+        uint32_t frames;
+        double appendsPerSecond;            // Synthetic records, one atomic per photon.
+        double batchedAppendsPerSecond;     // Synthetic records, one atomic per appendBatch photons.
+        double emittedPerSecond;            // Traced through the scene and appended.
+        PhotonStorageStats storage;         // Of the emission run.
+        uint32_t finalCapacity;
+        size_t storeBytes;
+    };
+
+    // Runs frames frames of each mode against one persistent store that starts at a quarter of
+    // photonsPerFrame, so the first frames overflow and it has to grow.
+    PhotonStorageBenchmarkResult BenchmarkPhotonStorage(const Scene& scene, const Bvh& bvh, uint32_t photonsPerFrame, uint32_t frames, unsigned threads = 0);
+    std::string PhotonStorageBenchmarkSummary(const PhotonStorageBenchmarkResult& result);
+}
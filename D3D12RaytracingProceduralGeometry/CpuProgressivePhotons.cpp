@@ -0,0 +1,176 @@
+#include "CpuProgressivePhotons.h"
+#include "CpuParallel.h"
+#include "CpuShading.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const float RayTMin = 0.001f;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    std::string ProgressivePhotonStats::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << passes << " passes, " << emitted << " photons emitted, " << stored << " stored"
+            << " | emit " << emitSeconds * 1000.0 << " ms, gather " << gatherSeconds * 1000.0 << " ms"
+            << " | " << PhotonsPerSecond() / 1e6 << " Mphotons/s"
+            << " | radius " << std::setprecision(4) << radius << std::setprecision(2)
+            << " | " << BytesPerPhoton() << " B/photon";
+        return out.str();
+    }
+
+    ProgressivePhotonMapper::ProgressivePhotonMapper(const Scene& scene, const Bvh& bvh, const std::vector<Light>& lights, const ProgressivePhotonSettings& settings) :
+        m_scene(scene),
+        m_bvh(bvh),
+        m_lights(lights),
+        m_settings(settings),
+        m_radius(settings.alpha),
+        m_store((std::max)(settings.photonsPerPass, 1u), UINT32_MAX)
+    {
+        m_initialRadius = settings.initialRadius;
+        if (m_initialRadius <= 0) {
+            Aabb bounds = scene.Bounds();
+            m_initialRadius = bounds.valid() ? 0.01f * length(bounds.extent()) : 1.0f;
+        }
+        m_camera.position = float3(0.0f);
+        m_sum.assign(static_cast<size_t>(settings.width) * settings.height, float3(0.0f));
+    }
+
+    void ProgressivePhotonMapper::Reset(const CameraParams& camera)
+    {
+        m_camera = camera;
+        m_radius.Reset();
+        m_passes = 0;
+        std::fill(m_sum.begin(), m_sum.end(), float3(0.0f));
+    }
+
+    void ProgressivePhotonMapper::RenderPass(ProgressivePhotonStats& stats)
+    {
+        PhotonEmitter emitter(m_scene, m_bvh);
+        PhotonEmitSettings emit;
+        emit.photons = m_settings.photonsPerPass;
+        emit.maxDepth = m_settings.maxDepth;
+        emit.frameIndex = m_passes;
+        emit.threads = m_settings.threads;
+        PhotonEmitStats emitStats;
+        m_store.BeginFrame();
+        emitter.Emit(emit, m_lights, m_store, emitStats);
+        m_store.EndFrame();
+
+        Clock::time_point start = Clock::now();
+        float radius = Radius();
+        m_grid.Build(m_store.Read(), m_store.ReadCount(), radius, m_settings.threads);
+        uint32_t pass = m_passes;
+        ParallelForChunks(m_sum.size(), 64, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t x = static_cast<uint32_t>(i % m_settings.width);
+                uint32_t y = static_cast<uint32_t>(i / m_settings.width);
+                VisiblePoint point = TraceVisiblePoint(x, y, pass);
+                m_sum[i] += point.valid ? Gather(point, radius) : m_scene.background;
+            }
+        }, m_settings.threads);
+
+        stats.passes++;
+        stats.emitted += emitStats.emitted;
+        stats.stored += m_store.ReadCount();
+        stats.emitSeconds += emitStats.seconds;
+        stats.gatherSeconds += SecondsSince(start);
+        stats.radius = radius;
+        stats.lastStored = m_store.ReadCount();
+        stats.photonBytes = m_store.Bytes() + m_grid.Bytes();
+
+        m_passes++;
+        m_radius.Advance();
+    }
+
+    void ProgressivePhotonMapper::Resolve(Framebuffer& framebuffer) const
+    {
+        framebuffer.Resize(m_settings.width, m_settings.height);
+        float scale = m_passes > 0 ? 1.0f / m_passes : 0.0f;
+        for (size_t i = 0; i < m_sum.size(); i++) {
+            framebuffer.pixels[i] = m_sum[i] * scale;
+        }
+    }
+
+    // Follows mirrors deterministically and picks glass's branch by its Fresnel term, as the
+    // photons do, until the path reaches a diffuse surface.
+    ProgressivePhotonMapper::VisiblePoint ProgressivePhotonMapper::TraceVisiblePoint(uint32_t x, uint32_t y, uint32_t pass) const
+    {
+        uint32_t seed = PixelSeed(x, y, m_settings.width, pass, 0);
+        float2 jitter(seed_xorshift(seed), seed_xorshift(seed));
+        Ray ray = GenerateCameraRay(x, y, m_settings.width, m_settings.height, m_camera, jitter);
+
+        VisiblePoint point;
+        point.valid = false;
+        float3 throughput(1.0f);
+        for (uint32_t depth = 0; depth < m_settings.maxDepth; depth++) {
+            Hit hit;
+            if (!m_bvh.Intersect(m_scene, ray, RayTMin, hit)) {
+                break;
+            }
+            const Material& material = m_scene.materials[m_scene.primitives[hit.primitive].materialIndex];
+            float3 position = ray.origin + hit.t * ray.direction;
+            bool frontFace = dot(hit.normal, ray.direction) < 0;
+            float3 normal = frontFace ? hit.normal : -hit.normal;
+
+            switch (LabelBRDF(material)) {
+            case BRDF::Diffuse:
+                point.position = position;
+                point.normal = normal;
+                point.weight = throughput * (1.0f / Pi);
+                point.valid = true;
+                return point;
+            case BRDF::Reflective:
+                throughput *= material.albedo * material.reflectanceCoef;
+                ray.direction = reflect(ray.direction, normal);
+                break;
+            case BRDF::Refractive: {
+                throughput *= material.albedo;
+                float fresnel = Fresnel(ray.direction, hit.normal, material.refractiveCoef);
+                float eta = frontFace ? 1.0f / material.refractiveCoef : material.refractiveCoef;
+                float3 refracted;
+                if (seed_xorshift(seed) >= fresnel && Refract(ray.direction, normal, eta, refracted)) {
+                    ray.origin = position - 0.001f * normal;
+                    ray.direction = normalize(refracted);
+                    continue;
+                }
+                ray.direction = reflect(ray.direction, normal);
+                break;
+            }
+            default:
+                return point;
+            }
+            ray.origin = position + 0.001f * normal;
+        }
+        return point;
+    }
+
+    // Density estimate with a constant kernel: the flux of the photons within radius that
+    // arrived from the point's side of the surface, over the disc they landed on.
+    float3 ProgressivePhotonMapper::Gather(const VisiblePoint& point, float radius) const
+    {
+        const Photon* photons = m_store.Read();
+        float radiusSquared = radius * radius;
+        float3 flux(0.0f);
+        m_grid.ForEachInRadius(point.position, radius, [&](uint32_t index, float) {
+            const Photon& photon = photons[index];
+            float3 direction(photon.direction.x, photon.direction.y, photon.direction.z);
+            if (dot(direction, point.normal) < 0) {
+                flux += float3(photon.colour.x, photon.colour.y, photon.colour.z);
+            }
+        });
+        return point.weight * flux * (1.0f / (Pi * radiusSquared));
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuProgressivePhotons.h
+//
+// Progressive photon mapping on the CPU. Every pass emits a fixed photon budget through
+// PhotonEmitter, finds each pixel's first diffuse surface (through mirrors and glass), and
+// estimates the radiance there from the photons within the pass's gather radius. The radius
+// shrinks from pass to pass by ProgressiveRadius, and the image is the average of the passes.
+// Only photons reach the image, so it holds all the light, direct included.
+//
+// The stats report photon throughput and what each stored photon costs in memory, the store
+// plus the grid the gather searches.
+//
+//**********************************************************************************************
+
+#include "CpuPhotonGrid.h"
+#include "PhotonBudget.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    struct ProgressivePhotonSettings {
+        uint32_t width = 256;
+        uint32_t height = 256;
+        uint32_t photonsPerPass = 200000;
+        float initialRadius = 0;        // World units; 0 takes a hundredth of the scene's diagonal.
+        float alpha = 2.0f / 3.0f;      // See ProgressiveRadius.
+        uint32_t maxDepth = CPU_MAX_RAY_RECURSION_DEPTH;
+        unsigned threads = 0;
+    };
+
+    struct ProgressivePhotonStats {
+        uint32_t passes = 0;
+        uint64_t emitted = 0;
+        uint64_t stored = 0;
+        double emitSeconds = 0;
+        double gatherSeconds = 0;       // Grid build and density estimates.
+        float radius = 0;               // Of the last pass.
+        uint32_t lastStored = 0;        // Photons the last pass stored.
+        size_t photonBytes = 0;         // Store and gather grid, at the last pass.
+
+        double PhotonsPerSecond() const { return emitSeconds + gatherSeconds > 0 ? emitted / (emitSeconds + gatherSeconds) : 0; }
+        double BytesPerPhoton() const { return lastStored > 0 ? static_cast<double>(photonBytes) / lastStored : 0; }
+        std::string Summary() const;
+    };
+
+    class ProgressivePhotonMapper
+    {
+    public:
+        ProgressivePhotonMapper(const Scene& scene, const Bvh& bvh, const std::vector<Light>& lights, const ProgressivePhotonSettings& settings);
+
+        // Starts the average over, from a new camera.
+        void Reset(const CameraParams& camera);
+        // Emits one pass of photons and adds its estimate to the average.
+        void RenderPass(ProgressivePhotonStats& stats);
+        // The average of the passes so far.
+        void Resolve(Framebuffer& framebuffer) const;
+
+        float Radius() const { return m_initialRadius * m_radius.Scale(); }
+
+    private:
+        struct VisiblePoint {
+            float3 position;
+            float3 normal;
+            float3 weight;              // Throughput of the camera path, over pi for the BRDF.
+            bool valid;
+        };
+
+        const Scene& m_scene;
+        const Bvh& m_bvh;
+        std::vector<Light> m_lights;
+        ProgressivePhotonSettings m_settings;
+        CameraParams m_camera;
+        float m_initialRadius;
+        ProgressiveRadius m_radius;
+        PhotonBuffers m_store;
+        std::vector<float3> m_sum;
+        uint32_t m_passes = 0;
+
+        PhotonHashGrid m_grid;
+
+        VisiblePoint TraceVisiblePoint(uint32_t x, uint32_t y, uint32_t pass) const;
+        float3 Gather(const VisiblePoint& point, float radius) const;
+    };
+}
@@ -0,0 +1,200 @@
+#include "CpuRayStats.h"
+#include <fstream>
+
+namespace Cpu {
+
+    namespace {
+        uint32_t HistogramBin(uint32_t v)
+        {
+            uint32_t bin = 0;
+            while (v > 0) {
+                v >>= 1;
+                bin++;
+            }
+            return bin;
+        }
+
+        // Black - blue - magenta - orange - yellow - white.
+        void Ramp(float t, uint8_t rgb[3])
+        {
+            static const float stops[6][3] = {
+                { 0.0f, 0.0f, 0.0f },
+                { 0.1f, 0.1f, 0.6f },
+                { 0.7f, 0.1f, 0.6f },
+                { 1.0f, 0.5f, 0.1f },
+                { 1.0f, 0.9f, 0.2f },
+                { 1.0f, 1.0f, 1.0f },
+            };
+            float x = saturate(t) * 5.0f;
+            int i = (std::min)(static_cast<int>(x), 4);
+            float f = x - i;
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = static_cast<uint8_t>(255.0f * lerp(stops[i][c], stops[i + 1][c], f) + 0.5f);
+            }
+        }
+
+        void Put16(std::ofstream& out, uint16_t v) { out.put(static_cast<char>(v & 0xff)); out.put(static_cast<char>(v >> 8)); }
+        void Put32(std::ofstream& out, uint32_t v) { Put16(out, static_cast<uint16_t>(v & 0xffff)); Put16(out, static_cast<uint16_t>(v >> 16)); }
+    }
+
+    const char* RayCounterName(RayCounter::Enum counter)
+    {
+        switch (counter) {
+        case RayCounter::NodeVisits: return "node_visits";
+        case RayCounter::LeafTests: return "leaf_tests";
+        case RayCounter::QuadricSolves: return "quadric_solves";
+        case RayCounter::SdfSteps: return "sdf_steps";
+        case RayCounter::CsgStackDepth: return "csg_stack_depth";
+        default: return "unknown";
+        }
+    }
+
+    const char* PrimitiveTypeName(PrimitiveType::Enum type)
+    {
+        switch (type) {
+        case PrimitiveType::Sphere: return "sphere";
+        case PrimitiveType::Ellipsoid: return "ellipsoid";
+        case PrimitiveType::Hyperboloid: return "hyperboloid";
+        case PrimitiveType::Cylinder: return "cylinder";
+        case PrimitiveType::Paraboloid: return "paraboloid";
+        case PrimitiveType::Cone: return "cone";
+        case PrimitiveType::Box: return "box";
+        case PrimitiveType::Plane: return "plane";
+        case PrimitiveType::Torus: return "torus";
+        case PrimitiveType::QuaternionJulia: return "quaternion_julia";
+        case PrimitiveType::Csg: return "csg";
+        case PrimitiveType::Triangle: return "triangle";
+        default: return "unknown";
+        }
+    }
+
+    void RayStatsImage::Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        for (uint32_t i = 0; i < RayCounter::Count; i++) {
+            pixels[i].assign(static_cast<size_t>(w) * h, 0u);
+        }
+    }
+
+    void RayStatsImage::Clear()
+    {
+        for (uint32_t i = 0; i < RayCounter::Count; i++) {
+            std::fill(pixels[i].begin(), pixels[i].end(), 0u);
+        }
+    }
+
+    std::vector<uint64_t> RayStatsImage::Histogram(RayCounter::Enum counter) const
+    {
+        std::vector<uint64_t> bins(HistogramBins, 0);
+        for (uint32_t v : pixels[counter]) {
+            bins[HistogramBin(v)]++;
+        }
+        return bins;
+    }
+
+    uint64_t RayStatsImage::Total(RayCounter::Enum counter) const
+    {
+        uint64_t total = 0;
+        for (uint32_t v : pixels[counter]) {
+            total += v;
+        }
+        return total;
+    }
+
+    bool RayStatsImage::WriteHeatmapBmp(RayCounter::Enum counter, const std::string& filename) const
+    {
+        const std::vector<uint32_t>& values = pixels[counter];
+        if (values.empty()) {
+            return false;
+        }
+        std::vector<uint32_t> sorted(values);
+        size_t percentile = (sorted.size() - 1) * 99 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + percentile, sorted.end());
+        float scale = 1.0f / (std::max)(1u, sorted[percentile]);
+
+        std::ofstream out(filename, std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        uint32_t rowBytes = (width * 3 + 3) & ~3u;
+        uint32_t imageBytes = rowBytes * height;
+        out.put('B');
+        out.put('M');
+        Put32(out, 54 + imageBytes);
+        Put32(out, 0);
+        Put32(out, 54);
+        Put32(out, 40);
+        Put32(out, width);
+        Put32(out, height);
+        Put16(out, 1);
+        Put16(out, 24);
+        Put32(out, 0);
+        Put32(out, imageBytes);
+        Put32(out, 2835);
+        Put32(out, 2835);
+        Put32(out, 0);
+        Put32(out, 0);
+
+        // Rows are stored bottom-up, pixels as BGR.
+        std::vector<char> row(rowBytes, 0);
+        for (uint32_t y = height; y-- > 0;) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t rgb[3];
+                Ramp(values[static_cast<size_t>(y) * width + x] * scale, rgb);
+                row[x * 3 + 0] = static_cast<char>(rgb[2]);
+                row[x * 3 + 1] = static_cast<char>(rgb[1]);
+                row[x * 3 + 2] = static_cast<char>(rgb[0]);
+            }
+            out.write(row.data(), rowBytes);
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool RayStatsImage::WriteHistogramCsv(const std::string& filename, uint32_t frameIndex, bool append) const
+    {
+        bool writeHeader = true;
+        if (append) {
+            std::ifstream existing(filename);
+            writeHeader = !existing || existing.peek() == std::ifstream::traits_type::eof();
+        }
+        std::ofstream out(filename, append ? std::ios::app : std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        if (writeHeader) {
+            out << "frame,counter,bin_lower,bin_upper,pixels\n";
+        }
+        for (uint32_t c = 0; c < RayCounter::Count; c++) {
+            std::vector<uint64_t> bins = Histogram(static_cast<RayCounter::Enum>(c));
+            for (uint32_t b = 0; b < HistogramBins; b++) {
+                if (bins[b] == 0) {
+                    continue;
+                }
+                uint64_t lower = b == 0 ? 0 : (1ull << (b - 1));
+                uint64_t upper = b == 0 ? 0 : (1ull << b) - 1;
+                out << frameIndex << "," << RayCounterName(static_cast<RayCounter::Enum>(c)) << "," << lower << "," << upper << "," << bins[b] << "\n";
+            }
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool WritePrimitiveCostCsv(const std::string& filename, const RayCounters& totals)
+    {
+        std::ofstream out(filename);
+        if (!out) {
+            return false;
+        }
+        uint64_t totalWork = 0;
+        for (uint32_t i = 0; i < PrimitiveType::Count; i++) {
+            totalWork += totals.primitiveWork[i];
+        }
+        out << "type,tests,work,work_share\n";
+        for (uint32_t i = 0; i < PrimitiveType::Count; i++) {
+            double share = totalWork > 0 ? static_cast<double>(totals.primitiveWork[i]) / totalWork : 0.0;
+            out << PrimitiveTypeName(static_cast<PrimitiveType::Enum>(i)) << "," << totals.primitiveTests[i] << ","
+                << totals.primitiveWork[i] << "," << share << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+}
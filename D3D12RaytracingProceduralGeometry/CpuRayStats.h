@@ -0,0 +1,58 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuRayStats.h
+//
+// Per-pixel ray statistics for the CPU tracer. With RenderSettings::rayStats set, every ray
+// of a pixel adds its RayCounters to that pixel, which can then be written out as heatmaps
+// and per-frame histograms. The per-primitive-type totals in RenderStats::rayCounters show
+// which kind of geometry the frame time goes to.
+//
+//**********************************************************************************************
+
+#include "CpuScene.h"
+#include <string>
+
+namespace Cpu {
+
+    const char* RayCounterName(RayCounter::Enum counter);
+    const char* PrimitiveTypeName(PrimitiveType::Enum type);
+
+    class RayStatsImage
+    {
+    public:
+        // Bin 0 holds zero; bin b > 0 holds values in [2^(b-1), 2^b).
+        static const uint32_t HistogramBins = 33;
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint32_t> pixels[RayCounter::Count];
+
+        void Resize(uint32_t w, uint32_t h);
+        void Clear();
+
+        // Pixels are owned by a single tile or row, so no synchronisation is needed.
+        void Record(uint32_t pixel, const RayCounters& counters)
+        {
+            for (uint32_t i = 0; i < RayCounter::Count; i++) {
+                uint32_t& v = pixels[i][pixel];
+                v = i == RayCounter::CsgStackDepth ? (std::max)(v, counters.value[i]) : v + counters.value[i];
+            }
+        }
+
+        std::vector<uint64_t> Histogram(RayCounter::Enum counter) const;
+        uint64_t Total(RayCounter::Enum counter) const;
+
+        // 24-bit BMP, normalised to the 99th percentile so a few outliers don't wash it out.
+        bool WriteHeatmapBmp(RayCounter::Enum counter, const std::string& filename) const;
+
+        // One row per counter and non-empty bin: frame, counter, bin_lower, bin_upper, pixels.
+        // With append set, rows are added to an existing file so frames can be collected.
+        bool WriteHistogramCsv(const std::string& filename, uint32_t frameIndex, bool append) const;
+    };
+
+    // One row per primitive type: type, tests, work, work_share. Work is quadric solves plus
+    // SDF steps.
+    bool WritePrimitiveCostCsv(const std::string& filename, const RayCounters& totals);
+}
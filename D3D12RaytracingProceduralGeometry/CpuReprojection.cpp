@@ -0,0 +1,351 @@
+#include "CpuReprojection.h"
+#include "CpuGBuffer.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        // Below this much bilinear weight on consistent taps, the history is dropped.
+        const float MinimumHistoryWeight = 0.01f;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        // Where a point (w = 1) or direction (w = 0) falls in the previous frame, in the same
+        // pixel units as x + 0.5, y + 0.5 are the centre of pixel x, y. False behind the camera.
+        bool PreviousPixel(const float4x4& worldToProjection, const float3& point, float w, uint32_t width, uint32_t height, float2& pixel)
+        {
+            float4 clip = mul(float4(point, w), worldToProjection);
+            if (clip.w <= 0) {
+                return false;
+            }
+            pixel = float2((clip.x / clip.w * 0.5f + 0.5f) * width, (0.5f - clip.y / clip.w * 0.5f) * height);
+            return true;
+        }
+
+        float2 PixelMotion(const float4x4& worldToProjection, const float3& point, float w, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+        {
+            float2 pixel;
+            if (!PreviousPixel(worldToProjection, point, w, width, height, pixel)) {
+                return float2(Infinity, Infinity);
+            }
+            return float2(pixel.x - (x + 0.5f), pixel.y - (y + 0.5f));
+        }
+
+        CameraParams TranslateCamera(const CameraParams& camera, const float3& offset)
+        {
+            CameraParams moved;
+            moved.position = camera.position + offset;
+            moved.projectionToWorld = mul(camera.projectionToWorld, float4x4::Translation(offset));
+            return moved;
+        }
+
+        double Rmse(const std::vector<float3>& image, const Framebuffer& reference)
+        {
+            double sum = 0;
+            for (size_t i = 0; i < reference.pixels.size(); i++) {
+                float3 d = image[i] - reference.pixels[i];
+                sum += dot(d, d) / 3.0;
+            }
+            return reference.pixels.empty() ? 0 : std::sqrt(sum / reference.pixels.size());
+        }
+    }
+
+    void ComputeMotionVectors(const CameraParams& camera, const CameraParams& previous, const std::vector<PackedGBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, std::vector<float2>& motion, unsigned threads)
+    {
+        float4x4 worldToProjection = inverse(previous.projectionToWorld);
+        motion.resize(static_cast<size_t>(width) * height);
+        ParallelFor(height, [&](size_t y, unsigned) {
+            for (uint32_t x = 0; x < width; x++) {
+                size_t i = y * width + x;
+                Ray ray = GenerateCameraRay(x, static_cast<uint32_t>(y), width, height, camera);
+                motion[i] = GBufferHit(gbuffer[i])
+                    ? PixelMotion(worldToProjection, ray.origin + DecodeGBufferDepth(gbuffer[i]) * ray.direction, 1.0f, x, static_cast<uint32_t>(y), width, height)
+                    : PixelMotion(worldToProjection, ray.direction, 0.0f, x, static_cast<uint32_t>(y), width, height);
+            }
+        }, threads, 4);
+    }
+
+    std::string ReprojectionStats::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << frames << " frames"
+            << " | motion " << (frames > 0 ? motionSeconds * 1000.0 / frames : 0) << " ms, resolve " << (frames > 0 ? resolveSeconds * 1000.0 / frames : 0) << " ms a frame"
+            << " | " << (pixels > 0 ? 100.0 * disoccluded / pixels : 0) << "% disoccluded"
+            << " | " << MeanHistory() << " frames of history a pixel";
+        return out.str();
+    }
+
+    TemporalAccumulator::TemporalAccumulator(const ReprojectionSettings& settings) :
+        m_settings(settings)
+    {
+    }
+
+    void TemporalAccumulator::Reset()
+    {
+        m_hasHistory = false;
+    }
+
+    void TemporalAccumulator::Resize(uint32_t width, uint32_t height)
+    {
+        m_width = width;
+        m_height = height;
+        size_t pixels = static_cast<size_t>(width) * height;
+        m_surfaces.assign(pixels, Surface());
+        m_previousSurfaces.assign(pixels, Surface());
+        m_motion.assign(pixels, float2());
+        m_disoccluded.assign(pixels, 0);
+        m_history.assign(pixels, float3(0.0f));
+        m_previousHistory.assign(pixels, float3(0.0f));
+        m_historyLength.assign(pixels, 0.0f);
+        m_previousHistoryLength.assign(pixels, 0.0f);
+        m_hasHistory = false;
+    }
+
+    void TemporalAccumulator::Accumulate(const CameraParams& camera, const Framebuffer& frame, const std::vector<PackedGBufferTexel>& gbuffer, Framebuffer& output, ReprojectionStats& stats)
+    {
+        if (frame.width != m_width || frame.height != m_height) {
+            Resize(frame.width, frame.height);
+        }
+        size_t pixels = static_cast<size_t>(m_width) * m_height;
+        // The last frame's buffers become the history; the accessors keep describing the
+        // newest frame.
+        std::swap(m_surfaces, m_previousSurfaces);
+        m_history.swap(m_previousHistory);
+        m_historyLength.swap(m_previousHistoryLength);
+
+        Clock::time_point start = Clock::now();
+        DecodeSurfaces(camera, gbuffer);
+        stats.motionSeconds += SecondsSince(start);
+
+        start = Clock::now();
+        std::vector<uint64_t> disoccluded(WorkerCount(m_settings.threads), 0);
+        ParallelFor(m_height, [&](size_t y, unsigned worker) {
+            disoccluded[worker] += Resolve(frame, static_cast<uint32_t>(y));
+        }, m_settings.threads, 4);
+        output.Resize(m_width, m_height);
+        std::copy(m_history.begin(), m_history.end(), output.pixels.begin());
+        stats.resolveSeconds += SecondsSince(start);
+
+        m_previousCamera = camera;
+        m_hasHistory = true;
+
+        stats.frames++;
+        stats.pixels += pixels;
+        stats.disoccluded += std::accumulate(disoccluded.begin(), disoccluded.end(), uint64_t(0));
+        stats.historyFrames += std::accumulate(m_historyLength.begin(), m_historyLength.end(), 0.0);
+    }
+
+    // Positions, normals and depth gradients of the frame's primary hits, and their motion
+    // since the previous frame.
+    void TemporalAccumulator::DecodeSurfaces(const CameraParams& camera, const std::vector<PackedGBufferTexel>& gbuffer)
+    {
+        float4x4 worldToProjection = inverse(m_previousCamera.projectionToWorld);
+        ParallelFor(m_height, [&](size_t y, unsigned) {
+            for (uint32_t x = 0; x < m_width; x++) {
+                size_t i = y * m_width + x;
+                Surface& surface = m_surfaces[i];
+                const PackedGBufferTexel& texel = gbuffer[i];
+                Ray ray = GenerateCameraRay(x, static_cast<uint32_t>(y), m_width, m_height, camera);
+                if (!GBufferHit(texel)) {
+                    surface = Surface();
+                    surface.position = ray.direction;
+                }
+                else {
+                    PackedPhotonFloat3 normal = DecodeGBufferNormal(texel.y);
+                    surface.depth = DecodeGBufferDepth(texel);
+                    surface.position = ray.origin + surface.depth * ray.direction;
+                    surface.normal = float3(normal.x, normal.y, normal.z);
+                    surface.material = DecodeGBufferMaterial(texel);
+                }
+                if (m_hasHistory) {
+                    m_motion[i] = PixelMotion(worldToProjection, surface.position, surface.depth > 0 ? 1.0f : 0.0f, x, static_cast<uint32_t>(y), m_width, m_height);
+                }
+            }
+        }, m_settings.threads, 4);
+
+        ParallelFor(m_height, [&](size_t y, unsigned) {
+            for (uint32_t x = 0; x < m_width; x++) {
+                size_t i = y * m_width + x;
+                Surface& surface = m_surfaces[i];
+                float gradient = 0;
+                if (surface.depth > 0 && x + 1 < m_width && m_surfaces[i + 1].depth > 0) {
+                    gradient = std::fabs(m_surfaces[i + 1].depth - surface.depth);
+                }
+                if (surface.depth > 0 && y + 1 < m_height && m_surfaces[i + m_width].depth > 0) {
+                    gradient = (std::max)(gradient, std::fabs(m_surfaces[i + m_width].depth - surface.depth));
+                }
+                surface.depthGradient = gradient;
+            }
+        }, m_settings.threads, 4);
+    }
+
+    // A previous pixel holds the same surface if, seen from the previous camera, it lies where
+    // this one's hit does, facing the same way and of the same material. Misses match misses.
+    bool TemporalAccumulator::Consistent(const Surface& surface, size_t previous) const
+    {
+        const Surface& other = m_previousSurfaces[previous];
+        if (surface.depth <= 0 || other.depth <= 0) {
+            return surface.depth <= 0 && other.depth <= 0;
+        }
+        if (other.material != surface.material || dot(other.normal, surface.normal) < m_settings.normalThreshold) {
+            return false;
+        }
+        float expected = length(surface.position - m_previousCamera.position);
+        return std::fabs(expected - other.depth) <= m_settings.depthTolerance * expected + 2.0f * other.depthGradient;
+    }
+
+    // Reprojects and blends row y. Returns how many of its pixels lost their history.
+    uint64_t TemporalAccumulator::Resolve(const Framebuffer& frame, uint32_t y)
+    {
+        uint64_t disoccluded = 0;
+        for (uint32_t x = 0; x < m_width; x++) {
+            size_t i = static_cast<size_t>(y) * m_width + x;
+            const Surface& surface = m_surfaces[i];
+            float3 history(0.0f);
+            float length = 0;
+            float weightSum = 0;
+            if (m_hasHistory && m_motion[i].x != Infinity) {
+                // Bilinear taps around the previous position, in pixel-index coordinates.
+                float px = x + m_motion[i].x;
+                float py = y + m_motion[i].y;
+                float fx = std::floor(px), fy = std::floor(py);
+                float tx = px - fx, ty = py - fy;
+                for (int tap = 0; tap < 4; tap++) {
+                    int sx = static_cast<int>(fx) + (tap & 1);
+                    int sy = static_cast<int>(fy) + (tap >> 1);
+                    if (sx < 0 || sy < 0 || sx >= static_cast<int>(m_width) || sy >= static_cast<int>(m_height)) {
+                        continue;
+                    }
+                    size_t previous = static_cast<size_t>(sy) * m_width + sx;
+                    if (!Consistent(surface, previous)) {
+                        continue;
+                    }
+                    float weight = ((tap & 1) ? tx : 1.0f - tx) * ((tap >> 1) ? ty : 1.0f - ty);
+                    history += m_previousHistory[previous] * weight;
+                    length += m_previousHistoryLength[previous] * weight;
+                    weightSum += weight;
+                }
+            }
+
+            if (weightSum > MinimumHistoryWeight) {
+                float frames = (std::min)(length / weightSum, static_cast<float>(m_settings.maxFrames));
+                float3 mean = history * (1.0f / weightSum);
+                m_history[i] = (mean * frames + frame.pixels[i]) * (1.0f / (frames + 1.0f));
+                m_historyLength[i] = frames + 1.0f;
+                m_disoccluded[i] = 0;
+            }
+            else {
+                m_history[i] = frame.pixels[i];
+                m_historyLength[i] = 1.0f;
+                m_disoccluded[i] = 1;
+                disoccluded++;
+            }
+        }
+        return disoccluded;
+    }
+
+    ReprojectionBenchmarkResult BenchmarkReprojection(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        uint32_t frames, float step, uint32_t referenceSpp, unsigned threads)
+    {
+        ReprojectionBenchmarkResult result = {};
+        result.width = width;
+        result.height = height;
+        result.frames = frames;
+        result.step = step;
+
+        // The camera's x axis in world space, from how the unprojected screen centre moves.
+        float4 centre = mul(float4(0, 0, 0, 1), camera.projectionToWorld);
+        float4 right = mul(float4(1, 0, 0, 1), camera.projectionToWorld);
+        float3 axis = normalize(right.xyz() / right.w - centre.xyz() / centre.w);
+
+        Tracer tracer(scene, bvh);
+        RenderSettings settings;
+        settings.spp = 1;
+        settings.threads = threads;
+        ReprojectionSettings reprojectionSettings;
+        reprojectionSettings.threads = threads;
+        TemporalAccumulator accumulator(reprojectionSettings);
+
+        size_t pixels = static_cast<size_t>(width) * height;
+        Framebuffer noisy, reprojected;
+        std::vector<float3> kept(pixels, float3(0.0f));
+        std::vector<GBufferTexel> full;
+        std::vector<PackedGBufferTexel> packed;
+        std::vector<float2> motion;
+        CameraParams frameCamera = camera;
+        CameraParams previousCamera = camera;
+        uint64_t firstDisoccluded = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            previousCamera = frameCamera;
+            frameCamera = TranslateCamera(camera, axis * (step * frame));
+            settings.frameIndex = frame;
+            RenderStats renderStats;
+            noisy.Resize(width, height);
+            Clock::time_point start = Clock::now();
+            tracer.Render(frameCamera, settings, noisy, renderStats);
+            RenderGBuffer(scene, bvh, frameCamera, width, height, full, packed, threads);
+            result.traceSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            ComputeMotionVectors(frameCamera, previousCamera, packed, width, height, motion, threads);
+            result.motionSeconds += SecondsSince(start);
+
+            start = Clock::now();
+            accumulator.Accumulate(frameCamera, noisy, packed, reprojected, result.stats);
+            result.accumulateSeconds += SecondsSince(start);
+            if (frame == 0) {
+                firstDisoccluded = result.stats.disoccluded;
+            }
+
+            for (size_t i = 0; i < pixels; i++) {
+                kept[i] = (kept[i] * static_cast<float>(frame) + noisy.pixels[i]) * (1.0f / (frame + 1));
+            }
+        }
+        if (frames > 0) {
+            result.traceSeconds /= frames;
+            result.motionSeconds /= frames;
+            result.accumulateSeconds /= frames;
+        }
+        uint64_t movingPixels = result.stats.pixels - pixels;
+        result.disoccludedFraction = movingPixels > 0 ? static_cast<double>(result.stats.disoccluded - firstDisoccluded) / movingPixels : 0;
+        const std::vector<float>& lengths = accumulator.HistoryLength();
+        result.meanHistory = pixels > 0 ? std::accumulate(lengths.begin(), lengths.end(), 0.0) / pixels : 0;
+
+        Framebuffer reference;
+        reference.Resize(width, height);
+        settings.spp = referenceSpp;
+        settings.frameIndex = frames + 1;
+        RenderStats referenceStats;
+        tracer.Render(frameCamera, settings, reference, referenceStats);
+        result.resetRmse = Rmse(noisy.pixels, reference);
+        result.keptRmse = Rmse(kept, reference);
+        result.reprojectedRmse = Rmse(reprojected.pixels, reference);
+        return result;
+    }
+
+    std::string ReprojectionBenchmarkSummary(const ReprojectionBenchmarkResult& result)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2)
+            << result.width << "x" << result.height << ", " << result.frames << " frames moving " << result.step << " a frame"
+            << " | trace " << result.traceSeconds * 1000.0 << " ms, motion " << result.motionSeconds * 1000.0 << " ms, accumulate " << result.accumulateSeconds * 1000.0 << " ms a frame"
+            << std::setprecision(4)
+            << " | rmse reset " << result.resetRmse << ", kept " << result.keptRmse << ", reprojected " << result.reprojectedRmse
+            << std::setprecision(2)
+            << " | " << result.meanHistory << " frames of history, " << result.disoccludedFraction * 100.0 << "% disoccluded while moving";
+        return out.str();
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuReprojection.h
+//
+// Progressive accumulation that survives camera motion. The app keeps its accumulation while
+// the camera is still and throws it away the moment it moves; here the history follows the
+// camera instead. Each frame:
+//
+//  1. Motion vectors: every pixel's primary hit, rebuilt from the G-buffer depth, is projected
+//     through the previous frame's view-projection (the inverse of its projectionToWorld).
+//     Misses are projected as directions, so the background moves with rotation only.
+//  2. Disocclusion: of the four previous pixels around where a pixel lands, those whose
+//     surface disagrees in depth, normal or material are dropped. A pixel with none left
+//     restarts its history.
+//  3. The surviving history is resampled bilinearly and averaged with the new frame by sample
+//     count, as accumulation does. The count is capped, so what resampling blurs into the
+//     history fades out instead of building up.
+//
+//**********************************************************************************************
+
+#include "CpuTracer.h"
+#include "PackedGBuffer.h"
+#include <string>
+#include <vector>
+
+namespace Cpu {
+
+    // Pixel offsets from each pixel to where its primary hit was in the previous frame, the
+    // previous camera's pixel coordinate minus this one's. Needs cameras whose projectionToWorld
+    // is the inverse of a perspective view-projection, as Camera::Update writes it.
+    void ComputeMotionVectors(const CameraParams& camera, const CameraParams& previous, const std::vector<PackedGBufferTexel>& gbuffer,
+        uint32_t width, uint32_t height, std::vector<float2>& motion, unsigned threads = 0);
+
+    struct ReprojectionSettings {
+        float normalThreshold = 0.9f;       // Least cosine between a pixel's normal and its history's.
+        float depthTolerance = 0.02f;       // Of the depth, on top of the previous depth gradient.
+        uint32_t maxFrames = 64;            // History is weighted as at most this many frames.
+        unsigned threads = 0;
+    };
+
+    struct ReprojectionStats {
+        uint32_t frames = 0;
+        uint64_t pixels = 0;
+        uint64_t disoccluded = 0;           // Pixels whose history was dropped.
+        double historyFrames = 0;           // Summed over pixels, after the new frame is added.
+        double motionSeconds = 0;           // G-buffer decode and motion vectors.
+        double resolveSeconds = 0;          // Disocclusion tests, resampling and blending.
+
+        double MeanHistory() const { return pixels > 0 ? historyFrames / pixels : 0; }
+        std::string Summary() const;
+    };
+
+    class TemporalAccumulator
+    {
+    public:
+        explicit TemporalAccumulator(const ReprojectionSettings& settings = ReprojectionSettings());
+
+        void Reset();
+        // Adds frame, traced from camera, to the history reprojected from the previous frames and
+        // writes the running mean to output. gbuffer is the frame's primary hits from
+        // RenderGBuffer with the same camera and size.
+        void Accumulate(const CameraParams& camera, const Framebuffer& frame, const std::vector<PackedGBufferTexel>& gbuffer, Framebuffer& output, ReprojectionStats& stats);
+
+        // Of the last frame accumulated.
+        const std::vector<float2>& Motion() const { return m_motion; }
+        const std::vector<uint8_t>& Disoccluded() const { return m_disoccluded; }
+        const std::vector<float>& HistoryLength() const { return m_historyLength; }
+        const ReprojectionSettings& Settings() const { return m_settings; }
+
+    private:
+        struct Surface {
+            float3 position;                // The primary ray's direction for a miss.
+            float3 normal;
+            float depth;                    // Along the primary ray; 0 for a miss.
+            float depthGradient;            // Largest change in depth to a neighbouring pixel.
+            uint32_t material;
+        };
+
+        ReprojectionSettings m_settings;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        bool m_hasHistory = false;
+        CameraParams m_previousCamera;
+
+        std::vector<Surface> m_surfaces;
+        std::vector<Surface> m_previousSurfaces;
+        std::vector<float2> m_motion;
+        std::vector<uint8_t> m_disoccluded;
+        std::vector<float3> m_history;              // Accumulated mean colour.
+        std::vector<float3> m_previousHistory;
+        std::vector<float> m_historyLength;         // Frames in the mean.
+        std::vector<float> m_previousHistoryLength;
+
+        void Resize(uint32_t width, uint32_t height);
+        void DecodeSurfaces(const CameraParams& camera, const std::vector<PackedGBufferTexel>& gbuffer);
+        bool Consistent(const Surface& surface, size_t previous) const;
+        uint64_t Resolve(const Framebuffer& frame, uint32_t y);
+    };
+
+    struct ReprojectionBenchmarkResult {
+        uint32_t width;
+        uint32_t height;
+        uint32_t frames;
+        float step;                         // Camera movement a frame, world units.
+        double traceSeconds;                // Per frame.
+        double motionSeconds;               // Per frame, motion vectors alone.
+        double accumulateSeconds;           // Per frame, the whole of Accumulate.
+        double resetRmse;                   // Accumulation restarted on every move: the last frame.
+        double keptRmse;                    // Accumulation kept in place as the camera moves.
+        double reprojectedRmse;
+        double meanHistory;                 // Frames behind a pixel of the last frame.
+        double disoccludedFraction;         // Over the frames after the first.
+        ReprojectionStats stats;
+    };
+
+    // Moves the camera by step along its x axis for frames frames of one sample a pixel, and
+    // compares the last frame of each accumulation strategy against a referenceSpp-sample
+    // render from the final camera.
+    ReprojectionBenchmarkResult BenchmarkReprojection(const Scene& scene, const Bvh& bvh, const CameraParams& camera, uint32_t width, uint32_t height,
+        uint32_t frames = 32, float step = 0.02f, uint32_t referenceSpp = 256, unsigned threads = 0);
+    std::string ReprojectionBenchmarkSummary(const ReprojectionBenchmarkResult& result);
+}
@@ -0,0 +1,335 @@
+#include "CpuScene.h"
+#include "CpuSdf.h"
+
+namespace Cpu {
+
+    float4x4 QuadricCoefficients(PrimitiveType::Enum type)
+    {
+        float4x4 Q = {};
+        auto SetDiagonal = [&](float a, float b, float c, float d) {
+            Q.m[0][0] = a; Q.m[1][1] = b; Q.m[2][2] = c; Q.m[3][3] = d;
+        };
+
+        switch (type) {
+        case PrimitiveType::Hyperboloid: SetDiagonal(-1.0f, 1.0f, 1.0f, -1.0f); break;
+        case PrimitiveType::Ellipsoid: SetDiagonal(1.0f / 1.5f, 1.0f, 1.0f / 2.0f, -1.0f); break;
+        case PrimitiveType::Cylinder: SetDiagonal(1.0f, 0.0f, 1.0f, -3.0f); break;
+        case PrimitiveType::Cone: SetDiagonal(-1.0f, 1.0f, -1.0f, 0.0f); break;
+        case PrimitiveType::Sphere: SetDiagonal(1.0f, 1.0f, 1.0f, -1.0f); break;
+        case PrimitiveType::Paraboloid:
+            SetDiagonal(1.0f / 2.0f, 0.0f, 1.0f / 1.5f, 0.0f);
+            Q.m[1][3] = -0.1f;
+            Q.m[3][1] = -0.1f;
+            break;
+        default:
+            break;
+        }
+        return Q;
+    }
+
+    namespace {
+
+        // Ref: SolveQuadraticEqn in AnalyticPrimitives.hlsli.
+        bool SolveQuadraticEqn(float a, float b, float c, float& x0, float& x1)
+        {
+            float discr = b * b - 4 * a * c;
+            if (discr < 0) return false;
+            else if (discr == 0) x0 = x1 = -0.5f * b / a;
+            else {
+                float q = (b > 0) ?
+                    -0.5f * (b + std::sqrt(discr)) :
+                    -0.5f * (b - std::sqrt(discr));
+                x0 = q / a;
+                x1 = c / q;
+            }
+            if (x0 > x1) std::swap(x0, x1);
+            return true;
+        }
+
+        // Clip region applied after the quadric solve, as in QuadricRayIntersectionTest.
+        bool InsideQuadricBounds(PrimitiveType::Enum type, const float3& p)
+        {
+            if (std::fabs(p.x) > 2) return false;
+            switch (type) {
+            case PrimitiveType::Cylinder: return std::fabs(p.y) <= 0.5f && std::fabs(p.z) <= 2;
+            case PrimitiveType::Cone: return std::fabs(p.y) <= 2 && std::fabs(p.z) <= 2;
+            case PrimitiveType::Paraboloid: return std::fabs(p.y) <= 2 && std::fabs(p.z) <= 2;
+            default: return std::fabs(p.y) <= 2 && std::fabs(p.z) <= 2;
+            }
+        }
+
+        bool RayQuadric(PrimitiveType::Enum type, const Ray& r, float tMin, float tMax, float& tHit, float3& normal, RayCounters* counters)
+        {
+            if (counters) counters->value[RayCounter::QuadricSolves]++;
+            float4x4 Q = QuadricCoefficients(type);
+            float4 AD = mul(Q, float4(r.direction, 0));
+            float4 AC = mul(Q, float4(r.origin, 1));
+
+            float a = dot(float4(r.direction, 0), AD);
+            float b = dot(float4(r.origin, 1), AD) + dot(float4(r.direction, 0), AC);
+            float c = dot(float4(r.origin, 1), AC);
+
+            float t[2];
+            if (a == 0) {
+                if (b == 0) return false;
+                t[0] = t[1] = -c / b;
+            }
+            else if (!SolveQuadraticEqn(a, b, c, t[0], t[1])) {
+                return false;
+            }
+
+            for (int i = 0; i < 2; i++) {
+                if (t[i] < tMin || t[i] > tMax) {
+                    continue;
+                }
+                float3 p = r.origin + t[i] * r.direction;
+                if (!InsideQuadricBounds(type, p)) {
+                    continue;
+                }
+                // Gradient of x^T Q x, as in CalculateNormalForARayQuadricHit.
+                float4 QX = mul(Q, float4(p, 1));
+                normal = normalize(float3(2 * QX.x, 2 * QX.y, 2 * QX.z));
+                tHit = t[i];
+                return true;
+            }
+            return false;
+        }
+
+        bool RayBox(const Ray& r, float tMin, float tMax, float& tHit, float3& normal)
+        {
+            Aabb box(float3(-1.0f), float3(1.0f));
+            float3 invDir = SafeInverse(r.direction);
+            float t0 = -Infinity, t1 = Infinity;
+            for (int axis = 0; axis < 3; axis++) {
+                float a = (box.lower[axis] - r.origin[axis]) * invDir[axis];
+                float b = (box.upper[axis] - r.origin[axis]) * invDir[axis];
+                t0 = (std::max)(t0, (std::min)(a, b));
+                t1 = (std::min)(t1, (std::max)(a, b));
+            }
+            if (t1 < t0) return false;
+
+            float t = t0 >= tMin ? t0 : t1;
+            if (t < tMin || t > tMax) return false;
+
+            // Face normal from the dominant axis of the hit position.
+            float3 p = r.origin + t * r.direction;
+            float3 ap(std::fabs(p.x), std::fabs(p.y), std::fabs(p.z));
+            int axis = (ap.x > ap.y && ap.x > ap.z) ? 0 : (ap.y > ap.z ? 1 : 2);
+            normal = float3(0.0f);
+            normal[axis] = p[axis] > 0 ? 1.0f : -1.0f;
+            tHit = t;
+            return true;
+        }
+
+        // Unit quad in the local xz plane.
+        bool RayPlane(const Ray& r, float tMin, float tMax, float& tHit, float3& normal)
+        {
+            if (std::fabs(r.direction.y) < 1e-8f) return false;
+            float t = -r.origin.y / r.direction.y;
+            if (t < tMin || t > tMax) return false;
+            float3 p = r.origin + t * r.direction;
+            if (std::fabs(p.x) > 1 || std::fabs(p.z) > 1) return false;
+            normal = float3(0, 1, 0);
+            tHit = t;
+            return true;
+        }
+
+        // Moller-Trumbore.
+        bool RayTriangle(const Triangle& tri, const Ray& r, float tMin, float tMax, float& tHit)
+        {
+            float3 p = cross(r.direction, tri.e2);
+            float det = dot(tri.e1, p);
+            if (std::fabs(det) < 1e-10f) return false;
+            float invDet = 1.0f / det;
+            float3 s = r.origin - tri.v0;
+            float u = dot(s, p) * invDet;
+            if (u < 0 || u > 1) return false;
+            float3 q = cross(s, tri.e1);
+            float v = dot(r.direction, q) * invDet;
+            if (v < 0 || u + v > 1) return false;
+            float t = dot(tri.e2, q) * invDet;
+            if (t < tMin || t > tMax) return false;
+            tHit = t;
+            return true;
+        }
+
+        // Sphere traces the part of the ray inside the primitive's local box, as the SDF
+        // intersection shaders do after the AABB test.
+        template<typename Sdf>
+        bool RaySdf(const Ray& r, const Aabb& box, float tMin, float tMax, Sdf sdf, float& tHit, float3& normal, RayCounters* counters)
+        {
+            float3 invDir = SafeInverse(r.direction);
+            float t0 = tMin, t1 = tMax;
+            for (int axis = 0; axis < 3; axis++) {
+                float a = (box.lower[axis] - r.origin[axis]) * invDir[axis];
+                float b = (box.upper[axis] - r.origin[axis]) * invDir[axis];
+                t0 = (std::max)(t0, (std::min)(a, b));
+                t1 = (std::min)(t1, (std::max)(a, b));
+            }
+            if (t1 < t0 || !SphereTrace(r, t0, t1, sdf, tHit, counters)) {
+                return false;
+            }
+            normal = SdfNormal(r.origin + tHit * r.direction, sdf);
+            return true;
+        }
+    }
+
+    Scene::Scene()
+    {
+        light.position = float3(4.07625f, 5.90386f, 1.00545f);
+        light.power = 1.0f;
+        light.colour = float3(1.0f);
+        // Matches MissPathTracing.
+        background = float3(0.6f);
+    }
+
+    Aabb Scene::LocalBounds(PrimitiveType::Enum type)
+    {
+        switch (type) {
+        case PrimitiveType::Sphere: return Aabb(float3(-1.0f), float3(1.0f));
+        case PrimitiveType::Box: return Aabb(float3(-1.0f), float3(1.0f));
+        case PrimitiveType::Plane: return Aabb(float3(-1, 0, -1), float3(1, 0, 1));
+        case PrimitiveType::Ellipsoid: return Aabb(float3(-1.23f, -1.0f, -1.42f), float3(1.23f, 1.0f, 1.42f));
+        case PrimitiveType::Cylinder: return Aabb(float3(-1.74f, -0.5f, -1.74f), float3(1.74f, 0.5f, 1.74f));
+        case PrimitiveType::Torus: {
+            float r = TorusRadii.x + TorusRadii.y;
+            return Aabb(float3(-r, -r, -TorusRadii.y), float3(r, r, TorusRadii.y));
+        }
+        default: return Aabb(float3(-2.0f), float3(2.0f));
+        }
+    }
+
+    uint32_t Scene::AddMaterial(const Material& material)
+    {
+        materials.push_back(material);
+        return static_cast<uint32_t>(materials.size() - 1);
+    }
+
+    uint32_t Scene::AddProcedural(PrimitiveType::Enum type, const float4x4& localToWorld, uint32_t materialIndex)
+    {
+        Primitive p;
+        p.type = type;
+        p.materialIndex = materialIndex;
+        p.dataIndex = UINT32_MAX;
+        primitives.push_back(p);
+        uint32_t index = static_cast<uint32_t>(primitives.size() - 1);
+        SetTransform(index, localToWorld);
+        return index;
+    }
+
+    void Scene::AddMesh(const float3* positions, const uint32_t* indices, size_t indexCount, uint32_t materialIndex)
+    {
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            Triangle tri;
+            tri.v0 = positions[indices[i]];
+            tri.e1 = positions[indices[i + 1]] - tri.v0;
+            tri.e2 = positions[indices[i + 2]] - tri.v0;
+            tri.normal = normalize(cross(tri.e1, tri.e2));
+            triangles.push_back(tri);
+
+            Primitive p;
+            p.type = PrimitiveType::Triangle;
+            p.materialIndex = materialIndex;
+            p.dataIndex = static_cast<uint32_t>(triangles.size() - 1);
+            p.localToWorld = float4x4::Identity();
+            p.worldToLocal = float4x4::Identity();
+            p.bounds = Aabb();
+            p.bounds.grow(tri.v0);
+            p.bounds.grow(tri.v0 + tri.e1);
+            p.bounds.grow(tri.v0 + tri.e2);
+            primitives.push_back(p);
+        }
+    }
+
+    uint32_t Scene::AddCsg(const CsgTree& tree, const float4x4& localToWorld, uint32_t materialIndex)
+    {
+        csgTrees.push_back(tree);
+
+        Primitive p;
+        p.type = PrimitiveType::Csg;
+        p.materialIndex = materialIndex;
+        p.dataIndex = static_cast<uint32_t>(csgTrees.size() - 1);
+        primitives.push_back(p);
+        uint32_t index = static_cast<uint32_t>(primitives.size() - 1);
+        SetTransform(index, localToWorld);
+        return index;
+    }
+
+    void Scene::SetTransform(uint32_t primitiveIndex, const float4x4& localToWorld)
+    {
+        Primitive& p = primitives[primitiveIndex];
+        if (p.type == PrimitiveType::Triangle) {
+            return;
+        }
+        p.localToWorld = localToWorld;
+        p.worldToLocal = inverse(localToWorld);
+        Aabb local = p.type == PrimitiveType::Csg ? csgTrees[p.dataIndex].LocalBounds() : LocalBounds(p.type);
+        p.bounds = TransformAabb(local, localToWorld);
+    }
+
+    bool Scene::IntersectPrimitive(uint32_t primitiveIndex, const Ray& ray, float tMin, float tMax, float& tHit, float3& normal, RayCounters* counters) const
+    {
+        const Primitive& p = primitives[primitiveIndex];
+        uint32_t workBefore = 0;
+        if (counters) {
+            counters->primitiveTests[p.type]++;
+            workBefore = counters->value[RayCounter::QuadricSolves] + counters->value[RayCounter::SdfSteps];
+        }
+        if (p.type == PrimitiveType::Triangle) {
+            const Triangle& tri = triangles[p.dataIndex];
+            if (!RayTriangle(tri, ray, tMin, tMax, tHit)) {
+                return false;
+            }
+            normal = tri.normal;
+            return true;
+        }
+
+        // The local direction is left unnormalised so t is shared between spaces.
+        Ray local;
+        local.origin = TransformPoint(ray.origin, p.worldToLocal);
+        local.direction = TransformVector(ray.direction, p.worldToLocal);
+
+        float3 localNormal;
+        bool hit = false;
+        switch (p.type) {
+        case PrimitiveType::Box: hit = RayBox(local, tMin, tMax, tHit, localNormal); break;
+        case PrimitiveType::Plane: hit = RayPlane(local, tMin, tMax, tHit, localNormal); break;
+        case PrimitiveType::Torus:
+            hit = RaySdf(local, LocalBounds(p.type), tMin, tMax, [](const float3& q) { return sdTorus(q, TorusRadii); }, tHit, localNormal, counters);
+            break;
+        case PrimitiveType::QuaternionJulia:
+            hit = RaySdf(local, LocalBounds(p.type), tMin, tMax, [](const float3& q) { return sdQuaternionJulia(q, JuliaConstant); }, tHit, localNormal, counters);
+            break;
+        case PrimitiveType::Csg: hit = IntersectCsg(csgTrees[p.dataIndex], local, tMin, tMax, tHit, localNormal, counters); break;
+        default: hit = RayQuadric(p.type, local, tMin, tMax, tHit, localNormal, counters); break;
+        }
+        if (counters) {
+            counters->primitiveWork[p.type] += counters->value[RayCounter::QuadricSolves] + counters->value[RayCounter::SdfSteps] - workBefore;
+        }
+        if (!hit) {
+            return false;
+        }
+
+        // Inverse transpose of localToWorld, i.e. mul(worldToLocal, n) in column form.
+        normal = normalize(mul(p.worldToLocal, float4(localNormal, 0)).xyz());
+        return true;
+    }
+
+    std::vector<Aabb> Scene::PrimitiveBounds() const
+    {
+        std::vector<Aabb> bounds(primitives.size());
+        for (size_t i = 0; i < primitives.size(); i++) {
+            bounds[i] = primitives[i].bounds;
+        }
+        return bounds;
+    }
+
+    Aabb Scene::Bounds() const
+    {
+        Aabb b;
+        for (const Primitive& p : primitives) {
+            b.grow(p.bounds);
+        }
+        return b;
+    }
+}
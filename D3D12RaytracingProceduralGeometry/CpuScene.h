@@ -0,0 +1,167 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuScene.h
+//
+// Scene representation for the CPU tracer. Procedural primitives live in the same local
+// space as the intersection shaders (AnalyticPrimitives.hlsli) and carry the same
+// localSpaceToBottomLevelAS style transform, so a scene can be mirrored from Scene.cpp.
+//
+//**********************************************************************************************
+
+#include "CpuMath.h"
+#include "CpuCsg.h"
+#include <vector>
+
+namespace Cpu {
+
+    // Subset of AnalyticPrimitive::Enum and SignedDistancePrimitive::Enum the CPU tracer can
+    // intersect, plus CSG trees and triangles.
+    namespace PrimitiveType {
+        enum Enum {
+            Sphere = 0,
+            Ellipsoid,
+            Hyperboloid,
+            Cylinder,
+            Paraboloid,
+            Cone,
+            Box,
+            Plane,
+            Torus,              // Sphere traced, sdTorus(p, float2(0.75, 0.175)).
+            QuaternionJulia,    // Sphere traced, map() with c = (0.6, 0.6, 0.6, 0).
+            Csg,
+            Triangle,
+            Count
+        };
+    }
+
+    // Per-ray work counters. Traversal and intersection functions take an optional pointer
+    // to one and add to it.
+    namespace RayCounter {
+        enum Enum {
+            NodeVisits = 0,
+            LeafTests,          // Primitive tests run from BVH leaves.
+            QuadricSolves,
+            SdfSteps,
+            CsgStackDepth,      // Deepest interval stack; combined with max rather than summed.
+            Count
+        };
+    }
+
+    struct RayCounters {
+        uint32_t value[RayCounter::Count];
+        uint64_t primitiveTests[PrimitiveType::Count];
+        uint64_t primitiveWork[PrimitiveType::Count];      // Quadric solves plus SDF steps, by type.
+
+        RayCounters() { Reset(); }
+        void Reset()
+        {
+            std::memset(this, 0, sizeof(*this));
+        }
+        void Add(const RayCounters& other)
+        {
+            for (uint32_t i = 0; i < RayCounter::Count; i++) {
+                value[i] = i == RayCounter::CsgStackDepth ? (std::max)(value[i], other.value[i]) : value[i] + other.value[i];
+            }
+            for (uint32_t i = 0; i < PrimitiveType::Count; i++) {
+                primitiveTests[i] += other.primitiveTests[i];
+                primitiveWork[i] += other.primitiveWork[i];
+            }
+        }
+    };
+
+    // Mirrors PrimitiveConstantBuffer.
+    struct Material {
+        float3 albedo;
+        float reflectanceCoef;
+        float refractiveCoef;
+        float diffuseCoef;
+        float specularCoef;
+        float specularPower;
+    };
+
+    namespace BRDF {
+        enum Enum {
+            Diffuse = 0,
+            Reflective,
+            Refractive,
+            Count
+        };
+    }
+
+    // Same classification as labelBRDF() in Raytracing.hlsl.
+    inline BRDF::Enum LabelBRDF(const Material& m)
+    {
+        if (m.reflectanceCoef <= 0.0f && m.refractiveCoef <= 0.0f) {
+            return BRDF::Diffuse;
+        }
+        else if (m.refractiveCoef <= 0.0f) {
+            return BRDF::Reflective;
+        }
+        return BRDF::Refractive;
+    }
+
+    struct Primitive {
+        PrimitiveType::Enum type;
+        uint32_t materialIndex;
+        uint32_t dataIndex;         // Index into Scene::triangles or Scene::csgTrees.
+        float4x4 localToWorld;
+        float4x4 worldToLocal;
+        Aabb bounds;                // World space.
+    };
+
+    struct Triangle {
+        float3 v0;
+        float3 e1;
+        float3 e2;
+        float3 normal;
+    };
+
+    // Mirrors lightSphere / lightPower / lightDiffuseColor in SceneConstantBuffer.
+    struct Light {
+        float3 position;
+        float power;
+        float3 colour;
+    };
+
+    struct Hit {
+        float t;
+        float3 normal;          // Outward (geometric) normal; not flipped towards the ray.
+        uint32_t primitive;
+
+        Hit() : t(Infinity), primitive(UINT32_MAX) {}
+        bool valid() const { return primitive != UINT32_MAX; }
+    };
+
+    class Scene
+    {
+    public:
+        std::vector<Material> materials;
+        std::vector<Primitive> primitives;
+        std::vector<Triangle> triangles;
+        std::vector<CsgTree> csgTrees;
+        Light light;
+        float3 background;
+
+        Scene();
+
+        uint32_t AddMaterial(const Material& material);
+        uint32_t AddProcedural(PrimitiveType::Enum type, const float4x4& localToWorld, uint32_t materialIndex);
+        void AddMesh(const float3* positions, const uint32_t* indices, size_t indexCount, uint32_t materialIndex);
+        uint32_t AddCsg(const CsgTree& tree, const float4x4& localToWorld, uint32_t materialIndex);
+
+        void SetTransform(uint32_t primitiveIndex, const float4x4& localToWorld);
+
+        bool IntersectPrimitive(uint32_t primitiveIndex, const Ray& ray, float tMin, float tMax, float& tHit, float3& normal, RayCounters* counters = nullptr) const;
+
+        std::vector<Aabb> PrimitiveBounds() const;
+        Aabb Bounds() const;
+
+        // Local-space bounds of a procedural type; CSG trees use CsgTree::LocalBounds().
+        static Aabb LocalBounds(PrimitiveType::Enum type);
+    };
+
+    // Quadric coefficients from RayQuadric() in AnalyticPrimitives.hlsli.
+    float4x4 QuadricCoefficients(PrimitiveType::Enum type);
+}
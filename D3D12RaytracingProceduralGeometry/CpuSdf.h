@@ -0,0 +1,99 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuSdf.h
+//
+// Signed distance functions from SignedDistancePrimitives.hlsli and a sphere tracer for the
+// CPU tracer. Rays are in the primitive's local space and may be unnormalised, so steps are
+// scaled by 1/|direction| to keep t in the caller's units.
+//
+//**********************************************************************************************
+
+#include "CpuScene.h"
+
+namespace Cpu {
+
+    static const float2 TorusRadii = float2(0.75f, 0.175f);    // As in RaySignedDistancePrimitiveTestCSG.
+    static const float4 JuliaConstant = float4(0.6f, 0.6f, 0.6f, 0.0f);
+
+    // t: {radius, tube radius}. The ring lies in the xy plane.
+    inline float sdTorus(const float3& p, const float2& t)
+    {
+        float qx = std::sqrt(p.x * p.x + p.y * p.y) - t.x;
+        return std::sqrt(qx * qx + p.z * p.z) - t.y;
+    }
+
+    inline float4 qsqr(const float4& a)
+    {
+        return float4(a.x * a.x - a.y * a.y - a.z * a.z - a.w * a.w,
+            2.0f * a.x * a.y,
+            2.0f * a.x * a.z,
+            2.0f * a.x * a.w);
+    }
+
+    // map() from SignedDistancePrimitives.hlsli, without the orbit trap.
+    inline float sdQuaternionJulia(const float3& p, const float4& c)
+    {
+        float4 z(p, 0.0f);
+        float md2 = 1.0f;
+        float mz2 = dot(z, z);
+        for (int i = 0; i < 11; i++) {
+            md2 *= 4.0f * mz2;
+            float4 sq = qsqr(z);
+            z = float4(sq.x + c.x, sq.y + c.y, sq.z + c.z, sq.w + c.w);
+            mz2 = dot(z, z);
+            if (mz2 > 4.0f) break;
+        }
+        return 0.25f * std::sqrt(mz2 / md2) * std::log(mz2);
+    }
+
+    // Tetrahedral gradient estimate, as in sdCalculateNormal.
+    template<typename Sdf>
+    float3 SdfNormal(const float3& p, Sdf sdf)
+    {
+        const float e = 0.5773f * 0.0001f;
+        float3 xyy(e, -e, -e), yyx(-e, -e, e), yxy(-e, e, -e), xxx(e, e, e);
+        return normalize(xyy * sdf(p + xyy) + yyx * sdf(p + yyx) + yxy * sdf(p + yxy) + xxx * sdf(p + xxx));
+    }
+
+    static const uint32_t SdfMaxSteps = 300;
+    static const float SdfThreshold = 0.0001f;
+
+    // Sphere traces [t0, t1]. Each distance evaluation counts as one step.
+    template<typename Sdf>
+    bool SphereTrace(const Ray& ray, float t0, float t1, Sdf sdf, float& tHit, RayCounters* counters)
+    {
+        float invLength = 1.0f / length(ray.direction);
+        float t = t0;
+        for (uint32_t i = 0; i < SdfMaxSteps && t <= t1; i++) {
+            float distance = sdf(ray.origin + t * ray.direction);
+            if (counters) counters->value[RayCounter::SdfSteps]++;
+            if (distance < SdfThreshold) {
+                tHit = t;
+                return true;
+            }
+            t += distance * invLength;
+        }
+        return false;
+    }
+
+    // Marches out of the solid from a point inside it; the exit is where the distance turns positive.
+    template<typename Sdf>
+    bool SphereTraceExit(const Ray& ray, float t0, float t1, Sdf sdf, float& tExit, RayCounters* counters)
+    {
+        float invLength = 1.0f / length(ray.direction);
+        float t = t0;
+        for (uint32_t i = 0; i < SdfMaxSteps && t <= t1; i++) {
+            float distance = sdf(ray.origin + t * ray.direction);
+            if (counters) counters->value[RayCounter::SdfSteps]++;
+            if (distance > -SdfThreshold) {
+                tExit = t;
+                return true;
+            }
+            t += (std::max)(-distance, SdfThreshold) * invLength;
+        }
+        tExit = t1;
+        return true;
+    }
+}
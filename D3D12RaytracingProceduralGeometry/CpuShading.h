@@ -0,0 +1,80 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuShading.h
+//
+// Sampling and Fresnel helpers ported from Raytracing.hlsl, shared by the CPU path tracer
+// and the CPU photon emitter so both bounce light the same way.
+//
+//**********************************************************************************************
+
+#include "CpuMath.h"
+
+namespace Cpu {
+
+    static const float SqrtOfOneThird = 0.5773502691896257645f;
+
+    // calculateRandomDirectionInHemisphereSeedShift from Raytracing.hlsl (cosine weighted).
+    inline float3 RandomDirectionInHemisphere(const float3& normal, uint32_t& seed)
+    {
+        float up = std::sqrt(seed_xorshift(seed));
+        float over = std::sqrt(1 - up * up);
+        float around = seed_xorshift(seed) * 2.0f * Pi;
+
+        float3 directionNotNormal;
+        if (std::fabs(normal.x) < SqrtOfOneThird) {
+            directionNotNormal = float3(1, 0, 0);
+        }
+        else if (std::fabs(normal.y) < SqrtOfOneThird) {
+            directionNotNormal = float3(0, 1, 0);
+        }
+        else {
+            directionNotNormal = float3(0, 0, 1);
+        }
+        float3 perpendicular1 = normalize(cross(normal, directionNotNormal));
+        float3 perpendicular2 = normalize(cross(normal, perpendicular1));
+
+        return up * normal + std::cos(around) * over * perpendicular1 + std::sin(around) * over * perpendicular2;
+    }
+
+    // Fresnel() from Raytracing.hlsl.
+    inline float Fresnel(const float3& wi, const float3& normal, float eta)
+    {
+        float cosIncident = (std::max)(-1.0f, (std::min)(1.0f, dot(wi, normal)));
+        float etaI = 1, etaT = eta;
+        if (cosIncident > 0) {
+            std::swap(etaI, etaT);
+        }
+        float sinT = etaI / etaT * std::sqrt((std::max)(0.0f, 1 - cosIncident * cosIncident));
+        if (sinT >= 1) {
+            return 1;
+        }
+        float cosT = std::sqrt((std::max)(0.0f, 1 - sinT * sinT));
+        float cosI = std::fabs(cosIncident);
+        float Rs = ((etaT * cosI) - (etaI * cosT)) / ((etaT * cosI) + (etaI * cosT));
+        float Rp = ((etaI * cosI) - (etaT * cosT)) / ((etaI * cosI) + (etaT * cosT));
+        return (Rs * Rs + Rp * Rp) / 2;
+    }
+
+    // refractTest() from Raytracing.hlsl.
+    inline bool Refract(const float3& v, const float3& normal, float index, float3& refracted)
+    {
+        float dt = dot(v, normal);
+        float discriminant = 1.0f - index * index * (1 - dt * dt);
+        if (discriminant > 0) {
+            refracted = index * (v - normal * dt) - normal * std::sqrt(discriminant);
+            return true;
+        }
+        return false;
+    }
+
+    // Uniform over the sphere about the y axis, as SquareToSphereUniform in Raytracing.hlsl.
+    inline float3 UniformSphereDirection(uint32_t& seed)
+    {
+        float z = 1.0f - 2.0f * seed_xorshift(seed);
+        float around = seed_xorshift(seed) * 2.0f * Pi;
+        float radius = std::sqrt((std::max)(0.0f, 1.0f - z * z));
+        return float3(radius * std::cos(around), z, radius * std::sin(around));
+    }
+}
@@ -0,0 +1,692 @@
+#include "CpuTracer.h"
+#include "CpuParallel.h"
+#include "CpuRayStats.h"
+#include "CpuShading.h"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+namespace Cpu {
+
+    namespace {
+        typedef std::chrono::steady_clock Clock;
+
+        const float RayTMin = 0.001f;
+        const float RayTMax = 10000.0f;
+
+        double SecondsSince(const Clock::time_point& start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+    }
+
+    namespace {
+        // Packets only pay off while their rays stay within a narrow cone; sorted diffuse
+        // bounces often don't, and are then traced one by one in their sorted order.
+        bool CoherentPacket(const Ray* rays, uint32_t count)
+        {
+            for (uint32_t r = 1; r < count; r++) {
+                if (dot(rays[0].direction, rays[r].direction) < 0.9f) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    Ray GenerateCameraRay(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const CameraParams& camera, float2 offset)
+    {
+        float sx = (x + offset.x) / width * 2.0f - 1.0f;
+        float sy = (y + offset.y) / height * 2.0f - 1.0f;
+        // Invert Y for DirectX-style coordinates.
+        sy = -sy;
+
+        float4 world = mul(float4(sx, sy, 0, 1), camera.projectionToWorld);
+        float3 target = world.xyz() / world.w;
+
+        Ray ray;
+        ray.origin = camera.position;
+        ray.direction = normalize(target - ray.origin);
+        return ray;
+    }
+
+    void RenderStats::Reset()
+    {
+        for (uint32_t i = 0; i < MaxTrackedBounces; i++) {
+            rays[i] = 0;
+            intersectSeconds[i] = 0;
+        }
+        shadowRays = 0;
+        shadowSeconds = 0;
+        shadeSeconds = 0;
+        sortSeconds = 0;
+        totalSeconds = 0;
+        generateSeconds = 0;
+        for (uint32_t i = 0; i < BRDF::Count; i++) {
+            shadeSecondsPerBrdf[i] = 0;
+        }
+        accumulateSeconds = 0;
+        rouletteTerminated = 0;
+        deepestBounce = 0;
+        rayCounters.Reset();
+    }
+
+    void RenderStats::Merge(const RenderStats& other)
+    {
+        for (uint32_t i = 0; i < MaxTrackedBounces; i++) {
+            rays[i] += other.rays[i];
+            intersectSeconds[i] += other.intersectSeconds[i];
+        }
+        shadowRays += other.shadowRays;
+        shadowSeconds += other.shadowSeconds;
+        shadeSeconds += other.shadeSeconds;
+        sortSeconds += other.sortSeconds;
+        generateSeconds += other.generateSeconds;
+        for (uint32_t i = 0; i < BRDF::Count; i++) {
+            shadeSecondsPerBrdf[i] += other.shadeSecondsPerBrdf[i];
+        }
+        accumulateSeconds += other.accumulateSeconds;
+        rouletteTerminated += other.rouletteTerminated;
+        deepestBounce = (std::max)(deepestBounce, other.deepestBounce);
+        rayCounters.Add(other.rayCounters);
+    }
+
+    double RenderStats::RaysPerSecond(uint32_t bounce) const
+    {
+        if (bounce >= MaxTrackedBounces || intersectSeconds[bounce] <= 0) {
+            return 0;
+        }
+        return rays[bounce] / intersectSeconds[bounce];
+    }
+
+    double RenderStats::RaysPerSecondFrom(uint32_t firstBounce) const
+    {
+        uint64_t count = 0;
+        double seconds = 0;
+        for (uint32_t i = firstBounce; i < MaxTrackedBounces; i++) {
+            count += rays[i];
+            seconds += intersectSeconds[i];
+        }
+        return seconds > 0 ? count / seconds : 0;
+    }
+
+    std::string RenderStats::Summary() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2);
+        out << "total " << totalSeconds * 1000.0 << " ms";
+        for (uint32_t i = 0; i < MaxTrackedBounces && rays[i] > 0; i++) {
+            out << " | bounce " << i << ": " << rays[i] << " rays";
+            if (intersectSeconds[i] > 0) {
+                out << ", " << RaysPerSecond(i) / 1e6 << " Mrays/s";
+            }
+        }
+        out << " | shadow: " << shadowRays << " rays";
+        if (sortSeconds > 0) {
+            out << " | sort " << sortSeconds * 1000.0 << " ms";
+        }
+        if (generateSeconds > 0) {
+            // Stage times are summed over workers.
+            out << " | generate " << generateSeconds * 1000.0 << " ms"
+                << ", shade diffuse/reflective/refractive " << shadeSecondsPerBrdf[BRDF::Diffuse] * 1000.0
+                << "/" << shadeSecondsPerBrdf[BRDF::Reflective] * 1000.0
+                << "/" << shadeSecondsPerBrdf[BRDF::Refractive] * 1000.0 << " ms"
+                << ", shadow " << shadowSeconds * 1000.0 << " ms"
+                << ", accumulate " << accumulateSeconds * 1000.0 << " ms"
+                << " | roulette terminated " << rouletteTerminated << " paths, deepest bounce " << deepestBounce;
+        }
+        uint64_t totalWork = 0;
+        for (uint32_t i = 0; i < PrimitiveType::Count; i++) {
+            totalWork += rayCounters.primitiveWork[i];
+        }
+        if (totalWork > 0) {
+            out << " | work";
+            for (uint32_t i = 0; i < PrimitiveType::Count; i++) {
+                if (rayCounters.primitiveWork[i] > 0) {
+                    out << " " << PrimitiveTypeName(static_cast<PrimitiveType::Enum>(i)) << " " << 100.0 * rayCounters.primitiveWork[i] / totalWork << "%";
+                }
+            }
+        }
+        return out.str();
+    }
+
+    Tracer::Tracer(const Scene& scene, const Bvh& bvh) : m_scene(scene), m_bvh(bvh), m_sceneBounds(scene.Bounds())
+    {
+    }
+
+    void Tracer::Render(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats)
+    {
+        Clock::time_point start = Clock::now();
+        if (settings.rayStats) {
+            if (settings.rayStats->width != framebuffer.width || settings.rayStats->height != framebuffer.height) {
+                settings.rayStats->Resize(framebuffer.width, framebuffer.height);
+            }
+            else {
+                settings.rayStats->Clear();
+            }
+        }
+        if (settings.mode == ExecutionMode::Wavefront) {
+            RenderWavefront(camera, settings, framebuffer, stats);
+        }
+        else if (settings.mode == ExecutionMode::Queued) {
+            RenderQueued(camera, settings, framebuffer, stats);
+        }
+        else {
+            RenderRecursive(camera, settings, framebuffer, stats);
+        }
+        stats.totalSeconds = SecondsSince(start);
+    }
+
+    Tracer::SurfaceSample Tracer::ShadeHit(const Ray& ray, const Hit& hit, uint32_t& seed) const
+    {
+        const Material& material = m_scene.materials[m_scene.primitives[hit.primitive].materialIndex];
+        switch (LabelBRDF(material)) {
+        case BRDF::Reflective: return Shade<BRDF::Reflective>(ray, hit, seed);
+        case BRDF::Refractive: return Shade<BRDF::Refractive>(ray, hit, seed);
+        default: return Shade<BRDF::Diffuse>(ray, hit, seed);
+        }
+    }
+
+    // The BRDF is a template argument so each shade queue runs a single, branch-free path.
+    template <BRDF::Enum Kind>
+    Tracer::SurfaceSample Tracer::Shade(const Ray& ray, const Hit& hit, uint32_t& seed) const
+    {
+        const Primitive& primitive = m_scene.primitives[hit.primitive];
+        const Material& material = m_scene.materials[primitive.materialIndex];
+        float3 pos = ray.origin + hit.t * ray.direction;
+        bool frontFace = dot(hit.normal, ray.direction) < 0;
+        float3 normal = frontFace ? hit.normal : -hit.normal;
+
+        SurfaceSample s;
+        s.direct = float3(0.0f);
+        s.castShadow = false;
+        s.shadowDistance = 0;
+        s.continuePath = true;
+        s.attenuation = material.albedo;
+        s.next.origin = pos;
+
+        switch (Kind) {
+        case BRDF::Diffuse: {
+            // lambertian() plus a shadow ray towards the light, as in the closest-hit shaders.
+            float3 toLight = m_scene.light.position - pos;
+            float distance = length(toLight);
+            float3 lightDir = toLight / distance;
+            float cosine = dot(normal, lightDir);
+            if (cosine > 0) {
+                s.direct = material.albedo * m_scene.light.colour * (m_scene.light.power * InvPi * cosine);
+                s.shadowRay.origin = pos + 0.001f * normal;
+                s.shadowRay.direction = lightDir;
+                s.shadowDistance = distance;
+                s.castShadow = true;
+            }
+            s.next.direction = RandomDirectionInHemisphere(normal, seed);
+            break;
+        }
+        case BRDF::Reflective: {
+            float3 diffuseDir = RandomDirectionInHemisphere(normal, seed);
+            float3 specularDir = reflect(ray.direction, normal);
+            s.next.direction = normalize(lerp(specularDir, diffuseDir, material.diffuseCoef * material.diffuseCoef));
+            break;
+        }
+        case BRDF::Refractive: {
+            // Pick reflection or refraction stochastically instead of tracing both branches.
+            float3 dir = ray.direction;
+            float fresnel = Fresnel(dir, hit.normal, material.refractiveCoef);
+            float index = frontFace ? 1.0f / material.refractiveCoef : material.refractiveCoef;
+            float3 refracted;
+            if (seed_xorshift(seed) >= fresnel && Refract(dir, normal, index, refracted)) {
+                s.next.direction = normalize(refracted);
+                s.next.origin = pos - 0.001f * normal;
+                return s;
+            }
+            s.next.direction = reflect(dir, normal);
+            break;
+        }
+        }
+        s.next.origin = pos + 0.001f * normal;
+        return s;
+    }
+
+    bool Tracer::TraceClosest(const Ray& ray, Hit& hit, const RenderSettings& settings, uint32_t pixel, RenderStats& stats) const
+    {
+        if (!settings.rayStats) {
+            return m_bvh.Intersect(m_scene, ray, RayTMin, hit);
+        }
+        RayCounters counters;
+        bool found = m_bvh.Intersect(m_scene, ray, RayTMin, hit, &counters);
+        settings.rayStats->Record(pixel, counters);
+        stats.rayCounters.Add(counters);
+        return found;
+    }
+
+    bool Tracer::TraceOccluded(const Ray& ray, float distance, const RenderSettings& settings, uint32_t pixel, RenderStats& stats) const
+    {
+        if (!settings.rayStats) {
+            return m_bvh.Occluded(m_scene, ray, RayTMin, distance);
+        }
+        RayCounters counters;
+        bool occluded = m_bvh.Occluded(m_scene, ray, RayTMin, distance, &counters);
+        settings.rayStats->Record(pixel, counters);
+        stats.rayCounters.Add(counters);
+        return occluded;
+    }
+
+    float3 Tracer::TracePath(const Ray& ray, uint32_t depth, const RenderSettings& settings, uint32_t pixel, uint32_t& seed, RenderStats& stats) const
+    {
+        if (depth >= settings.maxDepth) {
+            return float3(0.0f);
+        }
+
+        Hit hit;
+        hit.t = RayTMax;
+        uint32_t bounce = (std::min)(depth, MaxTrackedBounces - 1);
+        bool found;
+        if (settings.timeRecursiveRays) {
+            Clock::time_point start = Clock::now();
+            found = TraceClosest(ray, hit, settings, pixel, stats);
+            stats.intersectSeconds[bounce] += SecondsSince(start);
+        }
+        else {
+            found = TraceClosest(ray, hit, settings, pixel, stats);
+        }
+        stats.rays[bounce]++;
+
+        if (!found) {
+            return m_scene.background;
+        }
+
+        SurfaceSample s = ShadeHit(ray, hit, seed);
+        float3 radiance(0.0f);
+        if (s.castShadow) {
+            stats.shadowRays++;
+            if (!TraceOccluded(s.shadowRay, s.shadowDistance, settings, pixel, stats)) {
+                radiance += s.direct;
+            }
+        }
+        if (s.continuePath) {
+            radiance += s.attenuation * TracePath(s.next, depth + 1, settings, pixel, seed, stats);
+        }
+        return radiance;
+    }
+
+    void Tracer::RenderRecursive(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats) const
+    {
+        uint32_t width = framebuffer.width, height = framebuffer.height;
+        unsigned workers = WorkerCount(settings.threads);
+        std::vector<RenderStats> workerStats(workers);
+
+        ParallelFor(height, [&](size_t y, unsigned worker) {
+            RenderStats& local = workerStats[worker];
+            for (uint32_t x = 0; x < width; x++) {
+                float3 radiance(0.0f);
+                for (uint32_t s = 0; s < settings.spp; s++) {
+                    uint32_t seed = PixelSeed(x, static_cast<uint32_t>(y), width, settings.frameIndex, s);
+                    float2 jitter = settings.spp > 1 ? float2(seed_xorshift(seed), seed_xorshift(seed)) : float2(0.5f, 0.5f);
+                    Ray ray = GenerateCameraRay(x, static_cast<uint32_t>(y), width, height, camera, jitter);
+                    radiance += TracePath(ray, 0, settings, static_cast<uint32_t>(y) * width + x, seed, local);
+                }
+                framebuffer.pixels[y * width + x] = radiance / static_cast<float>(settings.spp);
+            }
+        }, workers, 1);
+
+        for (const RenderStats& w : workerStats) {
+            stats.Merge(w);
+        }
+    }
+
+    // Octant in the top bits keeps same-signed directions together so packets traverse the
+    // BVH in a shared order; the origin Morton code groups rays that start near each other.
+    uint64_t Tracer::SortKey(const Ray& ray) const
+    {
+        uint64_t octant = (ray.direction.x < 0 ? 1u : 0u) | (ray.direction.y < 0 ? 2u : 0u) | (ray.direction.z < 0 ? 4u : 0u);
+        float3 extent = m_sceneBounds.extent();
+        float3 unit = (ray.origin - m_sceneBounds.lower) / max3(extent, float3(1e-6f));
+        return (octant << 30) | Morton3D(unit);
+    }
+
+    void Tracer::SortPaths(std::vector<PathState>& paths, std::vector<PathState>& scratch, std::vector<std::pair<uint64_t, uint32_t>>& keys) const
+    {
+        keys.resize(paths.size());
+        for (uint32_t i = 0; i < paths.size(); i++) {
+            keys[i] = std::make_pair(SortKey(paths[i].ray), i);
+        }
+        std::sort(keys.begin(), keys.end());
+        scratch.resize(paths.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            scratch[i] = paths[keys[i].second];
+        }
+        paths.swap(scratch);
+    }
+
+    void Tracer::RenderWavefront(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats) const
+    {
+        uint32_t width = framebuffer.width, height = framebuffer.height;
+        uint32_t tileSize = (std::max)(1u, settings.tileSize);
+        uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (height + tileSize - 1) / tileSize;
+        unsigned workers = WorkerCount(settings.threads);
+        std::vector<RenderStats> workerStats(workers);
+
+        for (float3& p : framebuffer.pixels) {
+            p = float3(0.0f);
+        }
+
+        ParallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t tile, unsigned worker) {
+            RenderStats& local = workerStats[worker];
+            uint32_t x0 = static_cast<uint32_t>(tile % tilesX) * tileSize;
+            uint32_t y0 = static_cast<uint32_t>(tile / tilesX) * tileSize;
+            uint32_t x1 = (std::min)(x0 + tileSize, width);
+            uint32_t y1 = (std::min)(y0 + tileSize, height);
+
+            std::vector<PathState> paths, nextPaths, scratch;
+            std::vector<Hit> hits;
+            std::vector<ShadowRay> shadowRays;
+            std::vector<std::pair<uint64_t, uint32_t>> keys;
+            paths.reserve(static_cast<size_t>(x1 - x0) * (y1 - y0) * settings.spp);
+
+            // Generate: every camera ray of the tile in one go.
+            for (uint32_t y = y0; y < y1; y++) {
+                for (uint32_t x = x0; x < x1; x++) {
+                    for (uint32_t s = 0; s < settings.spp; s++) {
+                        PathState path;
+                        path.seed = PixelSeed(x, y, width, settings.frameIndex, s);
+                        float2 jitter = settings.spp > 1 ? float2(seed_xorshift(path.seed), seed_xorshift(path.seed)) : float2(0.5f, 0.5f);
+                        path.ray = GenerateCameraRay(x, y, width, height, camera, jitter);
+                        path.throughput = float3(1.0f / settings.spp);
+                        path.pixel = y * width + x;
+                        paths.push_back(path);
+                    }
+                }
+            }
+
+            for (uint32_t depth = 0; depth < settings.maxDepth && !paths.empty(); depth++) {
+                uint32_t bounce = (std::min)(depth, MaxTrackedBounces - 1);
+
+                // Camera rays are already coherent in scanline order.
+                if (depth > 0 && settings.sortSecondaryRays) {
+                    Clock::time_point sortStart = Clock::now();
+                    SortPaths(paths, scratch, keys);
+                    local.sortSeconds += SecondsSince(sortStart);
+                }
+
+                // Intersect.
+                Clock::time_point intersectStart = Clock::now();
+                hits.assign(paths.size(), Hit());
+                Ray packet[Bvh::PacketSize];
+                for (size_t i = 0; i < paths.size(); i += Bvh::PacketSize) {
+                    uint32_t count = static_cast<uint32_t>((std::min)(paths.size() - i, static_cast<size_t>(Bvh::PacketSize)));
+                    for (uint32_t r = 0; r < count; r++) {
+                        packet[r] = paths[i + r].ray;
+                        hits[i + r].t = RayTMax;
+                    }
+                    if (!settings.rayStats && CoherentPacket(packet, count)) {
+                        m_bvh.IntersectPacket(m_scene, packet, count, RayTMin, &hits[i]);
+                    }
+                    else {
+                        for (uint32_t r = 0; r < count; r++) {
+                            TraceClosest(packet[r], hits[i + r], settings, paths[i + r].pixel, local);
+                        }
+                    }
+                }
+                local.intersectSeconds[bounce] += SecondsSince(intersectStart);
+                local.rays[bounce] += paths.size();
+
+                // Shade: misses resolve against the background, hits queue a shadow ray and an extension ray.
+                Clock::time_point shadeStart = Clock::now();
+                nextPaths.clear();
+                shadowRays.clear();
+                for (size_t i = 0; i < paths.size(); i++) {
+                    PathState& path = paths[i];
+                    if (!hits[i].valid()) {
+                        framebuffer.pixels[path.pixel] += path.throughput * m_scene.background;
+                        continue;
+                    }
+                    SurfaceSample s = ShadeHit(path.ray, hits[i], path.seed);
+                    if (s.castShadow) {
+                        ShadowRay shadow;
+                        shadow.ray = s.shadowRay;
+                        shadow.distance = s.shadowDistance;
+                        shadow.contribution = path.throughput * s.direct;
+                        shadow.pixel = path.pixel;
+                        shadowRays.push_back(shadow);
+                    }
+                    if (s.continuePath) {
+                        PathState next;
+                        next.ray = s.next;
+                        next.throughput = path.throughput * s.attenuation;
+                        next.pixel = path.pixel;
+                        next.seed = path.seed;
+                        nextPaths.push_back(next);
+                    }
+                }
+                local.shadeSeconds += SecondsSince(shadeStart);
+
+                Clock::time_point shadowStart = Clock::now();
+                Ray shadowPacket[Bvh::PacketSize];
+                float shadowDistance[Bvh::PacketSize];
+                bool occluded[Bvh::PacketSize];
+                for (size_t i = 0; i < shadowRays.size(); i += Bvh::PacketSize) {
+                    uint32_t count = static_cast<uint32_t>((std::min)(shadowRays.size() - i, static_cast<size_t>(Bvh::PacketSize)));
+                    for (uint32_t r = 0; r < count; r++) {
+                        shadowPacket[r] = shadowRays[i + r].ray;
+                        shadowDistance[r] = shadowRays[i + r].distance;
+                    }
+                    if (!settings.rayStats && CoherentPacket(shadowPacket, count)) {
+                        m_bvh.OccludedPacket(m_scene, shadowPacket, shadowDistance, count, RayTMin, occluded);
+                    }
+                    else {
+                        for (uint32_t r = 0; r < count; r++) {
+                            occluded[r] = TraceOccluded(shadowPacket[r], shadowDistance[r], settings, shadowRays[i + r].pixel, local);
+                        }
+                    }
+                    for (uint32_t r = 0; r < count; r++) {
+                        if (!occluded[r]) {
+                            framebuffer.pixels[shadowRays[i + r].pixel] += shadowRays[i + r].contribution;
+                        }
+                    }
+                }
+                local.shadowSeconds += SecondsSince(shadowStart);
+                local.shadowRays += shadowRays.size();
+
+                // Generate next: the surviving paths form the next, already compacted, wave.
+                paths.swap(nextPaths);
+            }
+        }, workers, 1);
+
+        for (const RenderStats& w : workerStats) {
+            stats.Merge(w);
+        }
+    }
+
+    template <BRDF::Enum Kind>
+    void Tracer::ShadeQueue(WavefrontQueues& queues, const RenderSettings& settings, uint32_t depth, RenderStats& stats) const
+    {
+        Clock::time_point start = Clock::now();
+        for (uint32_t index : queues.shade[Kind]) {
+            PathState& path = queues.extend[index];
+            SurfaceSample s = Shade<Kind>(path.ray, queues.hits[index], path.seed);
+            if (s.castShadow) {
+                ShadowRay shadow;
+                shadow.ray = s.shadowRay;
+                shadow.distance = s.shadowDistance;
+                shadow.contribution = path.throughput * s.direct;
+                shadow.pixel = path.pixel;
+                queues.shadow.push_back(shadow);
+            }
+            if (!s.continuePath) {
+                continue;
+            }
+
+            PathState next;
+            next.ray = s.next;
+            next.throughput = path.throughput * s.attenuation;
+            next.pixel = path.pixel;
+            next.seed = path.seed;
+
+            // Russian roulette on the path throughput keeps the estimator unbiased at any depth.
+            if (depth + 1 >= settings.rouletteDepth) {
+                float survival = (std::min)(0.95f, maxComponent(next.throughput));
+                if (seed_xorshift(next.seed) >= survival) {
+                    stats.rouletteTerminated++;
+                    continue;
+                }
+                next.throughput = next.throughput / survival;
+            }
+            queues.next.push_back(next);
+        }
+        stats.shadeSecondsPerBrdf[Kind] += SecondsSince(start);
+    }
+
+    void Tracer::RunQueuedTile(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const CameraParams& camera, const RenderSettings& settings,
+        WavefrontQueues& queues, Framebuffer& framebuffer, RenderStats& stats) const
+    {
+        uint32_t width = framebuffer.width, height = framebuffer.height;
+        float sampleWeight = 1.0f / settings.spp;
+
+        // Generate.
+        Clock::time_point generateStart = Clock::now();
+        queues.extend.clear();
+        for (uint32_t y = y0; y < y1; y++) {
+            for (uint32_t x = x0; x < x1; x++) {
+                for (uint32_t s = 0; s < settings.spp; s++) {
+                    PathState path;
+                    path.seed = PixelSeed(x, y, width, settings.frameIndex, s);
+                    float2 jitter = settings.spp > 1 ? float2(seed_xorshift(path.seed), seed_xorshift(path.seed)) : float2(0.5f, 0.5f);
+                    path.ray = GenerateCameraRay(x, y, width, height, camera, jitter);
+                    path.throughput = float3(1.0f);
+                    path.pixel = y * width + x;
+                    queues.extend.push_back(path);
+                }
+            }
+        }
+        stats.generateSeconds += SecondsSince(generateStart);
+
+        for (uint32_t depth = 0; depth < settings.maxDepth && !queues.extend.empty(); depth++) {
+            uint32_t bounce = (std::min)(depth, MaxTrackedBounces - 1);
+            stats.deepestBounce = (std::max)(stats.deepestBounce, depth);
+
+            if (depth > 0 && settings.sortSecondaryRays) {
+                Clock::time_point sortStart = Clock::now();
+                SortPaths(queues.extend, queues.scratch, queues.keys);
+                stats.sortSeconds += SecondsSince(sortStart);
+            }
+
+            // Extend: intersect the whole queue, then route misses to accumulation and hits
+            // to the shade queue of their BRDF.
+            Clock::time_point extendStart = Clock::now();
+            std::vector<PathState>& extend = queues.extend;
+            queues.hits.assign(extend.size(), Hit());
+            Ray packet[Bvh::PacketSize];
+            for (size_t i = 0; i < extend.size(); i += Bvh::PacketSize) {
+                uint32_t count = static_cast<uint32_t>((std::min)(extend.size() - i, static_cast<size_t>(Bvh::PacketSize)));
+                for (uint32_t r = 0; r < count; r++) {
+                    packet[r] = extend[i + r].ray;
+                    queues.hits[i + r].t = RayTMax;
+                }
+                if (!settings.rayStats && CoherentPacket(packet, count)) {
+                    m_bvh.IntersectPacket(m_scene, packet, count, RayTMin, &queues.hits[i]);
+                }
+                else {
+                    for (uint32_t r = 0; r < count; r++) {
+                        TraceClosest(packet[r], queues.hits[i + r], settings, extend[i + r].pixel, stats);
+                    }
+                }
+            }
+            stats.intersectSeconds[bounce] += SecondsSince(extendStart);
+            stats.rays[bounce] += extend.size();
+
+            queues.accumulate.clear();
+            for (uint32_t k = 0; k < BRDF::Count; k++) {
+                queues.shade[k].clear();
+            }
+            for (uint32_t i = 0; i < extend.size(); i++) {
+                const Hit& hit = queues.hits[i];
+                if (!hit.valid()) {
+                    Accumulation a;
+                    a.radiance = extend[i].throughput * m_scene.background;
+                    a.pixel = extend[i].pixel;
+                    queues.accumulate.push_back(a);
+                    continue;
+                }
+                const Material& material = m_scene.materials[m_scene.primitives[hit.primitive].materialIndex];
+                queues.shade[LabelBRDF(material)].push_back(i);
+            }
+
+            // Shade, one queue per BRDF.
+            queues.shadow.clear();
+            queues.next.clear();
+            ShadeQueue<BRDF::Diffuse>(queues, settings, depth, stats);
+            ShadeQueue<BRDF::Reflective>(queues, settings, depth, stats);
+            ShadeQueue<BRDF::Refractive>(queues, settings, depth, stats);
+
+            // Shadow.
+            Clock::time_point shadowStart = Clock::now();
+            Ray shadowPacket[Bvh::PacketSize];
+            float shadowDistance[Bvh::PacketSize];
+            bool occluded[Bvh::PacketSize];
+            for (size_t i = 0; i < queues.shadow.size(); i += Bvh::PacketSize) {
+                uint32_t count = static_cast<uint32_t>((std::min)(queues.shadow.size() - i, static_cast<size_t>(Bvh::PacketSize)));
+                for (uint32_t r = 0; r < count; r++) {
+                    shadowPacket[r] = queues.shadow[i + r].ray;
+                    shadowDistance[r] = queues.shadow[i + r].distance;
+                }
+                if (!settings.rayStats && CoherentPacket(shadowPacket, count)) {
+                    m_bvh.OccludedPacket(m_scene, shadowPacket, shadowDistance, count, RayTMin, occluded);
+                }
+                else {
+                    for (uint32_t r = 0; r < count; r++) {
+                        occluded[r] = TraceOccluded(shadowPacket[r], shadowDistance[r], settings, queues.shadow[i + r].pixel, stats);
+                    }
+                }
+                for (uint32_t r = 0; r < count; r++) {
+                    if (!occluded[r]) {
+                        Accumulation a;
+                        a.radiance = queues.shadow[i + r].contribution;
+                        a.pixel = queues.shadow[i + r].pixel;
+                        queues.accumulate.push_back(a);
+                    }
+                }
+            }
+            stats.shadowSeconds += SecondsSince(shadowStart);
+            stats.shadowRays += queues.shadow.size();
+
+            // Accumulate.
+            Clock::time_point accumulateStart = Clock::now();
+            for (const Accumulation& a : queues.accumulate) {
+                framebuffer.pixels[a.pixel] += a.radiance * sampleWeight;
+            }
+            stats.accumulateSeconds += SecondsSince(accumulateStart);
+
+            // Compact: only surviving paths move on to the next bounce.
+            queues.extend.swap(queues.next);
+        }
+    }
+
+    void Tracer::RenderQueued(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats)
+    {
+        uint32_t width = framebuffer.width, height = framebuffer.height;
+        uint32_t tileSize = (std::max)(1u, settings.tileSize);
+        uint32_t tilesX = (width + tileSize - 1) / tileSize;
+        uint32_t tilesY = (height + tileSize - 1) / tileSize;
+        unsigned workers = WorkerCount(settings.threads);
+        std::vector<RenderStats> workerStats(workers);
+        if (m_queues.size() < workers) {
+            m_queues.resize(workers);
+        }
+
+        for (float3& p : framebuffer.pixels) {
+            p = float3(0.0f);
+        }
+
+        ParallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t tile, unsigned worker) {
+            uint32_t x0 = static_cast<uint32_t>(tile % tilesX) * tileSize;
+            uint32_t y0 = static_cast<uint32_t>(tile / tilesX) * tileSize;
+            RunQueuedTile(x0, y0, (std::min)(x0 + tileSize, width), (std::min)(y0 + tileSize, height), camera, settings,
+                m_queues[worker], framebuffer, workerStats[worker]);
+        }, workers, 1);
+
+        for (const RenderStats& w : workerStats) {
+            stats.Merge(w);
+        }
+    }
+}
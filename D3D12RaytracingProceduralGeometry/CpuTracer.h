@@ -0,0 +1,197 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// CpuTracer.h
+//
+// Reference CPU path tracer. Mirrors ForwardPathTracingRayGen / TraceForwardPath so results
+// can be compared against the DXR path without a GPU, and runs in one of two modes:
+//
+//  Recursive - one path per pixel sample, traced depth first like the closest-hit shaders.
+//  Wavefront - rays for a whole tile are generated up front, and every bounce runs as separate
+//              intersect, shade and generate-next stages. Secondary rays are sorted by
+//              direction octant and origin Morton code before being traced in packets.
+//  Queued    - wavefront split into persistent per-stage queues (extend, shade per BRDF,
+//              shadow, accumulate) that are compacted between bounces. Paths are terminated
+//              by Russian roulette, so the depth can be left unbounded.
+//
+// Any mode can record per-ray work counters into a RayStatsImage (see CpuRayStats.h). Rays
+// are then traced one at a time, since packet traversal shares its work between rays.
+//
+//**********************************************************************************************
+
+#include "CpuBvh.h"
+#include <string>
+
+// Keep in step with MAX_RAY_RECURSION_DEPTH in RayTracingHlslCompat.h.
+#define CPU_MAX_RAY_RECURSION_DEPTH 4
+
+namespace Cpu {
+
+    class RayStatsImage;
+
+    // Mirrors the camera part of SceneConstantBuffer.
+    struct CameraParams {
+        float3 position;
+        float4x4 projectionToWorld;
+    };
+
+    // GenerateCameraRay from RaytracingShaderHelper.hlsli, with an optional sub-pixel offset.
+    Ray GenerateCameraRay(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const CameraParams& camera, float2 offset = float2(0.5f, 0.5f));
+
+    struct Framebuffer {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<float3> pixels;
+
+        void Resize(uint32_t w, uint32_t h)
+        {
+            width = w;
+            height = h;
+            pixels.assign(static_cast<size_t>(w) * h, float3(0.0f));
+        }
+    };
+
+    namespace ExecutionMode {
+        enum Enum {
+            Recursive = 0,
+            Wavefront,
+            Queued,
+            Count
+        };
+    }
+
+    // maxDepth value for Queued mode that leaves termination to Russian roulette alone.
+    static const uint32_t UnboundedDepth = UINT32_MAX;
+
+    struct RenderSettings {
+        ExecutionMode::Enum mode = ExecutionMode::Recursive;
+        uint32_t maxDepth = CPU_MAX_RAY_RECURSION_DEPTH;
+        uint32_t rouletteDepth = 3;     // Queued mode: first bounce at which Russian roulette applies.
+        uint32_t spp = 1;
+        uint32_t tileSize = 64;
+        uint32_t frameIndex = 0;        // Seeds the RNG like accumulatedFrames does on the GPU.
+        unsigned threads = 0;           // 0 = hardware concurrency.
+        bool sortSecondaryRays = true;
+        RayStatsImage* rayStats = nullptr;  // Resized to the framebuffer and cleared every frame.
+        // Recursive mode: clock every closest-hit query so intersectSeconds is filled per
+        // bounce. It costs two clock reads a ray, so it is off when comparing modes; the
+        // other modes time whole batches and always fill it.
+        bool timeRecursiveRays = false;
+    };
+
+    static const uint32_t MaxTrackedBounces = 16;
+
+    struct RenderStats {
+        uint64_t rays[MaxTrackedBounces];               // Extension rays traced per bounce.
+        double intersectSeconds[MaxTrackedBounces];     // Summed over worker threads; see timeRecursiveRays.
+        uint64_t shadowRays;
+        double shadowSeconds;
+        double shadeSeconds;
+        double sortSeconds;
+        double totalSeconds;                            // Wall clock.
+
+        // Queued mode stage timings.
+        double generateSeconds;
+        double shadeSecondsPerBrdf[BRDF::Count];
+        double accumulateSeconds;
+        uint64_t rouletteTerminated;
+        uint32_t deepestBounce;
+
+        // Per-primitive-type work, only gathered with RenderSettings::rayStats.
+        RayCounters rayCounters;
+
+        RenderStats() { Reset(); }
+        void Reset();
+        void Merge(const RenderStats& other);
+
+        // Per-thread throughput of the intersect stage for one bounce.
+        double RaysPerSecond(uint32_t bounce) const;
+        // Aggregate throughput for bounces >= firstBounce.
+        double RaysPerSecondFrom(uint32_t firstBounce) const;
+        std::string Summary() const;
+    };
+
+    class Tracer
+    {
+    public:
+        Tracer(const Scene& scene, const Bvh& bvh);
+
+        // Not re-entrant: Queued mode reuses per-worker queues between frames.
+        void Render(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats);
+
+    private:
+        // Result of shading one hit, shared by both execution modes.
+        struct SurfaceSample {
+            float3 direct;          // Unoccluded light contribution.
+            Ray shadowRay;
+            float shadowDistance;
+            bool castShadow;
+            Ray next;
+            float3 attenuation;
+            bool continuePath;
+        };
+
+        struct PathState {
+            Ray ray;
+            float3 throughput;
+            uint32_t pixel;
+            uint32_t seed;
+        };
+
+        struct ShadowRay {
+            Ray ray;
+            float distance;
+            float3 contribution;
+            uint32_t pixel;
+        };
+
+        struct Accumulation {
+            float3 radiance;
+            uint32_t pixel;
+        };
+
+        // One worker's queues. They keep their capacity between tiles and frames.
+        struct WavefrontQueues {
+            std::vector<PathState> extend;                  // Paths waiting for their next intersection.
+            std::vector<PathState> next;                    // Survivors of the current bounce.
+            std::vector<Hit> hits;                          // Parallel to extend.
+            std::vector<uint32_t> shade[BRDF::Count];       // Indices into extend, bucketed by BRDF.
+            std::vector<ShadowRay> shadow;
+            std::vector<Accumulation> accumulate;
+            std::vector<PathState> scratch;
+            std::vector<std::pair<uint64_t, uint32_t>> keys;
+        };
+
+        const Scene& m_scene;
+        const Bvh& m_bvh;
+        Aabb m_sceneBounds;
+        std::vector<WavefrontQueues> m_queues;
+
+        void RenderRecursive(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats) const;
+        void RenderWavefront(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats) const;
+        void RenderQueued(const CameraParams& camera, const RenderSettings& settings, Framebuffer& framebuffer, RenderStats& stats);
+        void RunQueuedTile(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, const CameraParams& camera, const RenderSettings& settings,
+            WavefrontQueues& queues, Framebuffer& framebuffer, RenderStats& stats) const;
+
+        // Single-ray traversal, counted into settings.rayStats when it is set.
+        bool TraceClosest(const Ray& ray, Hit& hit, const RenderSettings& settings, uint32_t pixel, RenderStats& stats) const;
+        bool TraceOccluded(const Ray& ray, float distance, const RenderSettings& settings, uint32_t pixel, RenderStats& stats) const;
+
+        float3 TracePath(const Ray& ray, uint32_t depth, const RenderSettings& settings, uint32_t pixel, uint32_t& seed, RenderStats& stats) const;
+        SurfaceSample ShadeHit(const Ray& ray, const Hit& hit, uint32_t& seed) const;
+        template <BRDF::Enum Kind>
+        SurfaceSample Shade(const Ray& ray, const Hit& hit, uint32_t& seed) const;
+        template <BRDF::Enum Kind>
+        void ShadeQueue(WavefrontQueues& queues, const RenderSettings& settings, uint32_t depth, RenderStats& stats) const;
+
+        uint64_t SortKey(const Ray& ray) const;
+        void SortPaths(std::vector<PathState>& paths, std::vector<PathState>& scratch, std::vector<std::pair<uint64_t, uint32_t>>& keys) const;
+    };
+
+    // Pixel seed, as in ForwardPathTracingRayGen.
+    inline uint32_t PixelSeed(uint32_t x, uint32_t y, uint32_t width, uint32_t frameIndex, uint32_t sample)
+    {
+        return wang_hash_original(x + width * y + frameIndex * 100000u + sample * 7919u) | 1u;
+    }
+}
@@ -0,0 +1,186 @@
+#include "DescriptorAllocator.h"
+
+uint32_t DescriptorAllocator::AddRange(uint32_t capacity)
+{
+    Range range;
+    range.offset = RangeEnd();
+    range.capacity = capacity;
+    range.allocated = 0;
+    if (capacity > 0) {
+        Block all = { range.offset, capacity };
+        range.free.push_back(all);
+    }
+    m_ranges.push_back(range);
+    Resize();
+    return static_cast<uint32_t>(m_ranges.size() - 1);
+}
+
+void DescriptorAllocator::SetTransientRing(uint32_t descriptorsPerFrame, uint32_t frameCount)
+{
+    m_transientPerFrame = descriptorsPerFrame;
+    m_frameCount = frameCount;
+    m_transientSegment = 0;
+    m_transientUsed = 0;
+    Resize();
+}
+
+uint32_t DescriptorAllocator::RangeEnd() const
+{
+    return m_ranges.empty() ? 0 : m_ranges.back().offset + m_ranges.back().capacity;
+}
+
+uint32_t DescriptorAllocator::Capacity() const
+{
+    return RangeEnd() + m_transientPerFrame * m_frameCount;
+}
+
+void DescriptorAllocator::Resize()
+{
+    m_generations.resize(Capacity(), 0);
+    m_allocationCount.resize(Capacity(), 0);
+    m_used.resize(Capacity(), 0);
+}
+
+DescriptorHandle DescriptorAllocator::Take(Range& range, size_t block, uint32_t start, uint32_t count)
+{
+    Block b = range.free[block];
+    range.free.erase(range.free.begin() + block);
+    uint32_t end = start + count, blockEnd = b.start + b.count;
+    if (end < blockEnd) {
+        Block after = { end, blockEnd - end };
+        range.free.insert(range.free.begin() + block, after);
+    }
+    if (b.start < start) {
+        Block before = { b.start, start - b.start };
+        range.free.insert(range.free.begin() + block, before);
+    }
+    for (uint32_t i = start; i < end; i++) {
+        m_used[i] = 1;
+    }
+    m_allocationCount[start] = count;
+    range.allocated += count;
+
+    DescriptorHandle handle;
+    handle.index = start;
+    handle.count = count;
+    handle.generation = m_generations[start];
+    return handle;
+}
+
+DescriptorHandle DescriptorAllocator::Allocate(uint32_t range, uint32_t count)
+{
+    Range& r = m_ranges[range];
+    for (size_t i = 0; i < r.free.size(); i++) {
+        if (r.free[i].count >= count && count > 0) {
+            return Take(r, i, r.free[i].start, count);
+        }
+    }
+    return DescriptorHandle();
+}
+
+DescriptorHandle DescriptorAllocator::AllocateAt(uint32_t range, uint32_t index, uint32_t count)
+{
+    Range& r = m_ranges[range];
+    for (size_t i = 0; i < r.free.size(); i++) {
+        const Block& b = r.free[i];
+        if (count > 0 && index >= b.start && index + count <= b.start + b.count) {
+            return Take(r, i, index, count);
+        }
+    }
+    return DescriptorHandle();
+}
+
+void DescriptorAllocator::Release(Range& range, uint32_t start, uint32_t count)
+{
+    for (uint32_t i = start; i < start + count; i++) {
+        m_generations[i]++;
+        m_used[i] = 0;
+    }
+    m_allocationCount[start] = 0;
+    range.allocated -= count;
+
+    // Insert in order and merge with the neighbours.
+    size_t i = 0;
+    while (i < range.free.size() && range.free[i].start < start) {
+        i++;
+    }
+    Block freed = { start, count };
+    range.free.insert(range.free.begin() + i, freed);
+    if (i + 1 < range.free.size() && range.free[i].start + range.free[i].count == range.free[i + 1].start) {
+        range.free[i].count += range.free[i + 1].count;
+        range.free.erase(range.free.begin() + i + 1);
+    }
+    if (i > 0 && range.free[i - 1].start + range.free[i - 1].count == range.free[i].start) {
+        range.free[i - 1].count += range.free[i].count;
+        range.free.erase(range.free.begin() + i);
+    }
+}
+
+void DescriptorAllocator::Free(const DescriptorHandle& handle)
+{
+    if (!IsValid(handle)) {
+        return;
+    }
+    for (Range& r : m_ranges) {
+        if (handle.index >= r.offset && handle.index < r.offset + r.capacity) {
+            Release(r, handle.index, handle.count);
+            return;
+        }
+    }
+}
+
+void DescriptorAllocator::ResetRange(uint32_t range)
+{
+    Range& r = m_ranges[range];
+    for (uint32_t i = r.offset; i < r.offset + r.capacity; i++) {
+        if (m_used[i]) {
+            m_generations[i]++;
+        }
+        m_used[i] = 0;
+        m_allocationCount[i] = 0;
+    }
+    r.allocated = 0;
+    r.free.clear();
+    if (r.capacity > 0) {
+        Block all = { r.offset, r.capacity };
+        r.free.push_back(all);
+    }
+}
+
+bool DescriptorAllocator::IsValid(const DescriptorHandle& handle) const
+{
+    return !handle.IsNull() && handle.index < RangeEnd() && m_allocationCount[handle.index] == handle.count &&
+        m_generations[handle.index] == handle.generation;
+}
+
+bool DescriptorAllocator::IsAllocated(uint32_t index) const
+{
+    return index < RangeEnd() && m_used[index] != 0;
+}
+
+DescriptorHandle DescriptorAllocator::HandleAt(uint32_t index) const
+{
+    DescriptorHandle handle;
+    if (index < RangeEnd() && m_allocationCount[index] > 0) {
+        handle.index = index;
+        handle.count = m_allocationCount[index];
+        handle.generation = m_generations[index];
+    }
+    return handle;
+}
+
+void DescriptorAllocator::BeginFrame(uint64_t frameIndex)
+{
+    m_transientSegment = m_frameCount > 0 ? static_cast<uint32_t>(frameIndex % m_frameCount) : 0;
+    m_transientUsed = 0;
+}
+
+uint32_t DescriptorAllocator::AllocateTransient(uint32_t count)
+{
+    if (count == 0 || m_transientUsed + count > m_transientPerFrame) {
+        return DescriptorHandle::InvalidIndex;
+    }
+    uint32_t index = RangeEnd() + m_transientSegment * m_transientPerFrame + m_transientUsed;
+    m_transientUsed += count;
+    return index;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// DescriptorAllocator.h
+//
+// Backend-agnostic bookkeeping for a descriptor heap. The heap is split into typed ranges,
+// each with a free list of contiguous blocks, followed by a transient ring with one segment
+// per frame in flight. Allocations are returned as handles that carry the generation of
+// their first slot, so a handle kept past Free() or ResetRange() is detected as stale
+// instead of silently aliasing whatever reused the slot. DescriptorHeap wraps it for D3D12.
+//
+//**********************************************************************************************
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DescriptorHandle {
+    static const uint32_t InvalidIndex = UINT32_MAX;
+
+    uint32_t index = InvalidIndex;
+    uint32_t count = 0;
+    uint32_t generation = 0;
+
+    bool IsNull() const { return index == InvalidIndex; }
+};
+
+class DescriptorAllocator
+{
+public:
+    // Ranges are laid out in the order they are added; add them all before allocating.
+    uint32_t AddRange(uint32_t capacity);
+    // frameCount segments of descriptorsPerFrame slots, placed after the last range.
+    void SetTransientRing(uint32_t descriptorsPerFrame, uint32_t frameCount);
+
+    uint32_t Capacity() const;
+    uint32_t RangeCount() const { return static_cast<uint32_t>(m_ranges.size()); }
+    uint32_t RangeOffset(uint32_t range) const { return m_ranges[range].offset; }
+    uint32_t RangeCapacity(uint32_t range) const { return m_ranges[range].capacity; }
+    uint32_t AllocatedCount(uint32_t range) const { return m_ranges[range].allocated; }
+
+    // count contiguous slots from the range, first fit. Null if the range is full.
+    DescriptorHandle Allocate(uint32_t range, uint32_t count = 1);
+    // Claims specific heap indices. Null if they fall outside the range or any of them is taken.
+    DescriptorHandle AllocateAt(uint32_t range, uint32_t index, uint32_t count = 1);
+    // Returns the slots to their range. Stale or null handles are ignored.
+    void Free(const DescriptorHandle& handle);
+    // Frees every allocation in the range; outstanding handles become stale.
+    void ResetRange(uint32_t range);
+
+    bool IsValid(const DescriptorHandle& handle) const;
+    bool IsAllocated(uint32_t index) const;
+    // Handle of the allocation starting at index, or a null handle.
+    DescriptorHandle HandleAt(uint32_t index) const;
+
+    // Starts a frame's segment of the transient ring. The caller must have waited for the GPU
+    // to finish the frame that last used it, i.e. frameIndex - frameCount.
+    void BeginFrame(uint64_t frameIndex);
+    // count contiguous slots valid until the segment comes around again, or
+    // DescriptorHandle::InvalidIndex if the segment is full.
+    uint32_t AllocateTransient(uint32_t count = 1);
+    uint32_t TransientUsed() const { return m_transientUsed; }
+
+private:
+    struct Block {
+        uint32_t start;
+        uint32_t count;
+    };
+    struct Range {
+        uint32_t offset;
+        uint32_t capacity;
+        uint32_t allocated;
+        std::vector<Block> free;        // Sorted by start, coalesced.
+    };
+
+    std::vector<Range> m_ranges;
+    std::vector<uint32_t> m_generations;        // Per slot, bumped on every free.
+    std::vector<uint32_t> m_allocationCount;    // Per slot: size of the allocation starting there, else 0.
+    std::vector<uint8_t> m_used;
+
+    uint32_t m_transientPerFrame = 0;
+    uint32_t m_frameCount = 0;
+    uint32_t m_transientSegment = 0;
+    uint32_t m_transientUsed = 0;
+
+    uint32_t RangeEnd() const;
+    void Resize();
+    DescriptorHandle Take(Range& range, size_t block, uint32_t start, uint32_t count);
+    void Release(Range& range, uint32_t start, uint32_t count);
+};
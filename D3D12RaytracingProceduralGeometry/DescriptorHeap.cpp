@@ -1,2 +1,49 @@
 #include "stdafx.h"
 #include "DescriptorHeap.h"
+
+void DescriptorHeap::Create(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, D3D12_DESCRIPTOR_HEAP_FLAGS flags, const DescriptorAllocator& layout, LPCWSTR name)
+{
+	m_allocator = layout;
+
+	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+	desc.NumDescriptors = m_allocator.Capacity();
+	desc.Type = type;
+	desc.Flags = flags;
+	desc.NodeMask = 0;
+	ThrowIfFailed(device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&m_heap)));
+	if (name)
+	{
+		m_heap->SetName(name);
+	}
+	m_descriptorSize = device->GetDescriptorHandleIncrementSize(type);
+}
+
+void DescriptorHeap::Reset()
+{
+	m_heap.Reset();
+	m_allocator = DescriptorAllocator();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorHeap::CpuHandle(UINT index) const
+{
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(m_heap->GetCPUDescriptorHandleForHeapStart(), index, m_descriptorSize);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorHeap::GpuHandle(UINT index) const
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(m_heap->GetGPUDescriptorHandleForHeapStart(), index, m_descriptorSize);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorHeap::CpuHandle(const DescriptorHandle& handle, UINT offset) const
+{
+	ThrowIfFalse(m_allocator.IsValid(handle), L"Stale descriptor handle");
+	ThrowIfFalse(offset < handle.count, L"Descriptor offset past the allocation");
+	return CpuHandle(handle.index + offset);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorHeap::GpuHandle(const DescriptorHandle& handle, UINT offset) const
+{
+	ThrowIfFalse(m_allocator.IsValid(handle), L"Stale descriptor handle");
+	ThrowIfFalse(offset < handle.count, L"Descriptor offset past the allocation");
+	return GpuHandle(handle.index + offset);
+}
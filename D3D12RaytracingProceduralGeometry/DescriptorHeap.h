@@ -1,5 +1,29 @@
 #pragma once
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+
+// A D3D12 descriptor heap sized and sub-allocated by a DescriptorAllocator.
 class DescriptorHeap
 {
-};
+public:
+	// Creates the heap with room for every range and the transient ring of layout.
+	void Create(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, D3D12_DESCRIPTOR_HEAP_FLAGS flags, const DescriptorAllocator& layout, LPCWSTR name = nullptr);
+	void Reset();
+
+	ID3D12DescriptorHeap* GetHeap() const { return m_heap.Get(); }
+	DescriptorAllocator& Allocator() { return m_allocator; }
+	UINT DescriptorSize() const { return m_descriptorSize; }
 
+	D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle(UINT index) const;
+	D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle(UINT index) const;
+
+	// The offset-th view of the allocation. Throws if the handle has been freed, so a stale
+	// handle can't alias a newer view, or if offset is past the allocation.
+	D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle(const DescriptorHandle& handle, UINT offset = 0) const;
+	D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle(const DescriptorHandle& handle, UINT offset = 0) const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_heap;
+	DescriptorAllocator m_allocator;
+	UINT m_descriptorSize = 0;
+};
@@ -11,6 +11,10 @@
 
 #pragma once
 
+#include "ShaderTableLayout.h"
+#include "RenderGraph.h"
+#include "UploadRing.h"
+
 #define SizeOfInUint32(obj) ((sizeof(obj) - 1) / sizeof(UINT32) + 1)
 
 struct AccelerationStructureBuffers
@@ -110,6 +114,228 @@ public:
     }
 };
 
+static_assert(ShaderIdentifierSize == D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, "ShaderTableLayout identifier size");
+static_assert(ShaderRecordAlignment == D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, "ShaderTableLayout record alignment");
+static_assert(ShaderTableAlignment == D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, "ShaderTableLayout table alignment");
+
+// Shader identifiers of a DXR state object, for ShaderTableLayout.
+class D3D12ShaderIdentifierProvider : public ShaderIdentifierProvider
+{
+    ComPtr<ID3D12StateObjectProperties> m_properties;
+public:
+    D3D12ShaderIdentifierProvider(ID3D12StateObject* stateObject)
+    {
+        ThrowIfFailed(stateObject->QueryInterface(IID_PPV_ARGS(&m_properties)));
+    }
+
+    const void* GetShaderIdentifier(const wchar_t* exportName) override
+    {
+        return m_properties->GetShaderIdentifier(exportName);
+    }
+};
+
+// Upload buffer holding one table of a ShaderTableLayout image.
+class ShaderTableUpload : public GpuUploadBuffer
+{
+public:
+    ShaderTableUpload(ID3D12Device* device, const ShaderTableLayout& layout, ShaderTableType::Enum table, LPCWSTR resourceName = nullptr)
+    {
+        const ShaderTableRange& range = layout.tables[table];
+        UINT bufferSize = static_cast<UINT>((std::max)(range.size, static_cast<uint64_t>(ShaderTableAlignment)));
+        Allocate(device, bufferSize, resourceName);
+        memcpy(MapCpuWriteOnly(), layout.image.data() + range.offset, static_cast<size_t>(range.size));
+    }
+};
+
+// Lays out the tables described by desc against stateObject's identifiers and uploads each
+// one to its own buffer, so they can be bound exactly like the hand-built ShaderTables.
+inline void CreateShaderTables(ID3D12Device* device, ID3D12StateObject* stateObject, const ShaderTableLayoutDesc& desc, const std::wstring& name,
+    ComPtr<ID3D12Resource>& rayGenTable, ComPtr<ID3D12Resource>& missTable, UINT& missStrideInBytes, ComPtr<ID3D12Resource>& hitGroupTable, UINT& hitGroupStrideInBytes)
+{
+    D3D12ShaderIdentifierProvider identifiers(stateObject);
+    ShaderTableLayout layout;
+    std::string error;
+    if (!layout.Build(desc, identifiers, &error))
+    {
+        std::wstring message = name + L": " + std::wstring(error.begin(), error.end());
+        ThrowIfFalse(false, message.c_str());
+    }
+    OutputDebugStringW((L"|Shader tables - " + name + L"\n" + layout.Describe()).c_str());
+
+    rayGenTable = ShaderTableUpload(device, layout, ShaderTableType::RayGen, (name + L"RayGenTable").c_str()).GetResource();
+    missTable = ShaderTableUpload(device, layout, ShaderTableType::Miss, (name + L"MissTable").c_str()).GetResource();
+    hitGroupTable = ShaderTableUpload(device, layout, ShaderTableType::HitGroup, (name + L"HitGroupTable").c_str()).GetResource();
+    missStrideInBytes = layout.tables[ShaderTableType::Miss].stride;
+    hitGroupStrideInBytes = layout.tables[ShaderTableType::HitGroup].stride;
+}
+
+class D3D12FrameFence : public FrameFence
+{
+public:
+    void Create(ID3D12Device* device)
+    {
+        ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+        m_event.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+        ThrowIfFalse(m_event.IsValid(), L"CreateEvent failed.");
+    }
+    void Release() { m_fence.Reset(); }
+    ID3D12Fence* Get() const { return m_fence.Get(); }
+
+    uint64_t CompletedValue() const override { return m_fence->GetCompletedValue(); }
+    void Wait(uint64_t value) override
+    {
+        if (m_fence->GetCompletedValue() < value)
+        {
+            ThrowIfFailed(m_fence->SetEventOnCompletion(value, m_event.Get()));
+            WaitForSingleObjectEx(m_event.Get(), INFINITE, FALSE);
+        }
+    }
+
+private:
+    ComPtr<ID3D12Fence> m_fence;
+    Microsoft::WRL::Wrappers::Event m_event;
+};
+
+// Per-frame uploads sub-allocated from one persistently mapped buffer.
+// Usage:
+//    ring.Create(...);
+//    UploadRing::Block block = ring.Allocate(layout);   // Once per frame.
+//    memcpy(block.cpu + offset, ...); Set...View(..., block.gpu + offset);
+//    ring.EndFrame(commandQueue);                       // After the frame's command lists are submitted.
+class UploadRing : public GpuUploadBuffer
+{
+public:
+    struct Block {
+        uint8_t* cpu;
+        D3D12_GPU_VIRTUAL_ADDRESS gpu;
+    };
+
+    void Create(ID3D12Device* device, UINT capacity, LPCWSTR resourceName = nullptr)
+    {
+        GpuUploadBuffer::Allocate(device, capacity, resourceName);
+        m_mappedData = MapCpuWriteOnly();
+        m_allocator.Init(capacity);
+        m_fence.Create(device);
+        m_fenceValue = 0;
+    }
+
+    void Release() override
+    {
+        GpuUploadBuffer::Release();
+        m_fence.Release();
+        m_mappedData = nullptr;
+    }
+
+    Block Allocate(const UploadFrameLayout& layout)
+    {
+        uint64_t offset = m_allocator.Allocate(layout.Size(), layout.Alignment(), m_fence);
+        ThrowIfFalse(offset != UploadRingAllocator::InvalidOffset, L"Upload ring is too small for the frame's uploads.");
+        Block block = { m_mappedData + offset, m_resource->GetGPUVirtualAddress() + offset };
+        return block;
+    }
+
+    void EndFrame(ID3D12CommandQueue* commandQueue)
+    {
+        if (!m_fence.Get())
+        {
+            return;     // Released by a device loss during Present.
+        }
+        ThrowIfFailed(commandQueue->Signal(m_fence.Get(), ++m_fenceValue));
+        m_allocator.EndFrame(m_fenceValue);
+    }
+
+    const UploadRingAllocator& Allocator() const { return m_allocator; }
+
+private:
+    UploadRingAllocator m_allocator;
+    D3D12FrameFence m_fence;
+    UINT64 m_fenceValue = 0;
+    uint8_t* m_mappedData = nullptr;
+};
+
+// Replays a compiled RenderGraph on a command list. Imported resources are bound each frame
+// with Bind(). The application's passes only use resources it owns, so the graph's transients
+// and their aliasing are not placed here; a plan that needs them is rejected in Begin().
+class D3D12RenderGraphBackend : public RenderGraphBackend
+{
+public:
+    static D3D12_RESOURCE_STATES State(RenderGraphState::Enum state)
+    {
+        switch (state)
+        {
+        case RenderGraphState::UnorderedAccess: return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        case RenderGraphState::ShaderResource: return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+        case RenderGraphState::RenderTarget: return D3D12_RESOURCE_STATE_RENDER_TARGET;
+        case RenderGraphState::CopySource: return D3D12_RESOURCE_STATE_COPY_SOURCE;
+        case RenderGraphState::CopyDest: return D3D12_RESOURCE_STATE_COPY_DEST;
+        case RenderGraphState::Present: return D3D12_RESOURCE_STATE_PRESENT;
+        default: return D3D12_RESOURCE_STATE_COMMON;
+        }
+    }
+
+    void SetCommandList(ID3D12GraphicsCommandList* commandList) { m_commandList = commandList; }
+
+    void Bind(RenderGraphResource resource, ID3D12Resource* d3dResource)
+    {
+        if (resource >= m_resources.size())
+        {
+            m_resources.resize(resource + 1, nullptr);
+        }
+        m_resources[resource] = d3dResource;
+    }
+
+    ID3D12Resource* Resource(RenderGraphResource resource) const
+    {
+        return resource < m_resources.size() ? m_resources[resource] : nullptr;
+    }
+
+    // Imports are only borrowed.
+    void Release()
+    {
+        m_resources.clear();
+    }
+
+    void Begin(const RenderGraph& graph) override
+    {
+        ThrowIfFalse(graph.Plan().heapBytes == 0, L"The D3D12 render graph backend does not place transient resources");
+        for (RenderGraphResource r = 0; r < graph.ResourceCount(); r++)
+        {
+            ThrowIfFalse(Resource(r) != nullptr, L"Render graph resource was not bound");
+        }
+    }
+
+    void Barriers(const RenderGraphBarrier* barriers, uint32_t count) override
+    {
+        m_barriers.clear();
+        for (uint32_t b = 0; b < count; b++)
+        {
+            const RenderGraphBarrier& barrier = barriers[b];
+            ID3D12Resource* resource = Resource(barrier.resource);
+            if (barrier.type == RenderGraphBarrierType::UnorderedAccess)
+            {
+                m_barriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+            }
+            // Present and Common are the same D3D12 state.
+            else if (State(barrier.before) != State(barrier.after))
+            {
+                m_barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, State(barrier.before), State(barrier.after)));
+            }
+        }
+        if (!m_barriers.empty())
+        {
+            m_commandList->ResourceBarrier(static_cast<UINT>(m_barriers.size()), m_barriers.data());
+        }
+    }
+
+    // DeviceResources::Present() closes and executes the frame's one command list.
+    void Submit() override {}
+
+private:
+    ID3D12GraphicsCommandList* m_commandList = nullptr;
+    std::vector<ID3D12Resource*> m_resources;
+    std::vector<D3D12_RESOURCE_BARRIER> m_barriers;
+};
+
 inline void AllocateUAVBuffer(ID3D12Device* pDevice, UINT64 bufferSize, ID3D12Resource **ppResource, D3D12_RESOURCE_STATES initialResourceState = D3D12_RESOURCE_STATE_COMMON, const wchar_t* resourceName = nullptr)
 {
     auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
@@ -0,0 +1,84 @@
+#include "MaterialTable.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint32_t NoSource = UINT32_MAX;
+}
+
+// Materials are compared bit for bit: the table only needs to merge what was written twice.
+size_t MaterialTable::KeyHash::operator()(const Material& material) const
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&material);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(Material); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+bool MaterialTable::KeyEqual::operator()(const Material& a, const Material& b) const
+{
+    return memcmp(&a, &b, sizeof(Material)) == 0;
+}
+
+MaterialTableChange::Enum MaterialTable::Assign(const Material* sources, size_t count)
+{
+    std::vector<Material> previous;
+    std::vector<uint32_t> previousIds;
+    previous.swap(m_materials);
+    previousIds.swap(m_sourceIds);
+    m_ids.clear();
+
+    m_sourceIds.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        Add(sources[i]);
+    }
+
+    if (m_sourceIds != previousIds) {
+        return MaterialTableChange::Ids;
+    }
+    // Same ids means the same number of entries.
+    if (!m_materials.empty() && memcmp(m_materials.data(), previous.data(), Bytes()) != 0) {
+        return MaterialTableChange::Values;
+    }
+    return MaterialTableChange::None;
+}
+
+uint32_t MaterialTable::Add(const Material& material)
+{
+    uint32_t id;
+    auto found = m_ids.find(material);
+    if (found != m_ids.end()) {
+        id = found->second;
+    }
+    else {
+        id = static_cast<uint32_t>(m_materials.size());
+        m_materials.push_back(material);
+        m_ids.emplace(material, id);
+    }
+    m_sourceIds.push_back(id);
+    return id;
+}
+
+void MaterialTable::SetInstanceMaterial(uint32_t instance, uint32_t source)
+{
+    SetInstanceMaterials(instance, 1, source);
+}
+
+void MaterialTable::SetInstanceMaterials(uint32_t firstInstance, uint32_t count, uint32_t source)
+{
+    if (m_instanceSources.size() < static_cast<size_t>(firstInstance) + count) {
+        m_instanceSources.resize(static_cast<size_t>(firstInstance) + count, NoSource);
+    }
+    std::fill(m_instanceSources.begin() + firstInstance, m_instanceSources.begin() + firstInstance + count, source);
+}
+
+uint32_t MaterialTable::InstanceMaterial(uint32_t instance) const
+{
+    if (instance >= m_instanceSources.size()) {
+        return NoMaterial;
+    }
+    uint32_t source = m_instanceSources[instance];
+    return source < m_sourceIds.size() ? m_sourceIds[source] : NoMaterial;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// MaterialTable.h
+//
+// The materials hit shaders read, kept as one dense array indexed by material id. Hit group
+// records hold an id rather than a copy of the material, and TLAS instances can override
+// that id through their InstanceID, so the table grows with the number of distinct materials
+// rather than with primitive types, records or instances. Entries are SceneFile::Material,
+// which has the layout of PrimitiveConstantBuffer, so the array is uploaded as it is.
+//
+//**********************************************************************************************
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "SceneFile.h"
+
+// What a call to MaterialTable::Assign() invalidated.
+namespace MaterialTableChange {
+    enum Enum {
+        None = 0,
+        Values,             // Same ids, new contents: upload the table again.
+        Ids,                // Sources map to different ids: rebuild anything that stored one.
+        Count
+    };
+}
+
+class MaterialTable
+{
+public:
+    typedef SceneFile::Material Material;
+
+    // InstanceID that leaves the hit group record's material in place. InstanceID has 24 bits,
+    // which also caps the number of materials an instance can name.
+    static const uint32_t NoMaterial = 0xFFFFFF;
+
+    // Replaces the table with the given source materials, merging identical ones. Sources are
+    // referred to by their position in this array, as the scene file's records do.
+    MaterialTableChange::Enum Assign(const Material* sources, size_t count);
+    // Adds one more source material and returns its id, shared with an identical one if any.
+    uint32_t Add(const Material& material);
+
+    // Table id of a source material.
+    uint32_t Id(uint32_t source) const { return m_sourceIds[source]; }
+    uint32_t SourceCount() const { return static_cast<uint32_t>(m_sourceIds.size()); }
+
+    // Instance overrides are kept by source, so they survive Assign() with new ids.
+    void SetInstanceMaterial(uint32_t instance, uint32_t source);
+    void SetInstanceMaterials(uint32_t firstInstance, uint32_t count, uint32_t source);
+    void ClearInstanceMaterials() { m_instanceSources.clear(); }
+    // The id an instance should carry in its InstanceID, NoMaterial if it has no override.
+    uint32_t InstanceMaterial(uint32_t instance) const;
+
+    const Material* Data() const { return m_materials.data(); }
+    uint32_t Size() const { return static_cast<uint32_t>(m_materials.size()); }
+    size_t Bytes() const { return m_materials.size() * sizeof(Material); }
+
+private:
+    struct KeyHash {
+        size_t operator()(const Material& material) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Material& a, const Material& b) const;
+    };
+
+    std::vector<Material> m_materials;
+    std::vector<uint32_t> m_sourceIds;
+    std::vector<uint32_t> m_instanceSources;
+    std::unordered_map<Material, uint32_t, KeyHash, KeyEqual> m_ids;
+};
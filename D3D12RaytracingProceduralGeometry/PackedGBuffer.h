@@ -0,0 +1,123 @@
+#ifndef PACKEDGBUFFER_H
+#define PACKEDGBUFFER_H
+
+//**********************************************************************************************
+//
+// PackedGBuffer.h
+//
+// The deferred G-buffer as one 16-byte texel (DXGI_FORMAT_R32G32B32A32_UINT), for C++ and HLSL
+// source files, in place of three float4 textures of BRDF colour, position and normal:
+//
+//   x   distance from the camera along the pixel's primary ray, as float bits; 0 is no hit
+//   y   surface normal, octahedral, 16 + 16 bits
+//   z   material id (bits 0-7) and BRDF label from labelBRDF (bits 8-15); 16 bits spare
+//   w   BRDF colour, RGB9E5
+//
+// The position is rebuilt from the distance and the primary ray, which every reader of the
+// G-buffer can regenerate from the camera, so it costs no bandwidth. Material ids past 255
+// alias; the scenes here have far fewer materials.
+//
+//**********************************************************************************************
+
+#include "PackedPhoton.h"
+
+#ifdef HLSL
+typedef uint4 PackedGBufferTexel;
+#define PackedGBufferAsUint(x) asuint(x)
+#define PackedGBufferAsFloat(x) asfloat(x)
+#else
+#include <cstring>
+
+struct PackedGBufferTexel {
+    PackedPhotonUint x, y, z, w;
+};
+
+inline PackedPhotonUint PackedGBufferAsUint(float value)
+{
+    PackedPhotonUint bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float PackedGBufferAsFloat(PackedPhotonUint bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+#endif
+
+// Octahedral mapping as in EncodeOctahedral, at 16 bits a component: under a hundredth of a
+// degree of error, where 8 bits gives about a degree and shows as banding in smooth shading.
+PACKED_PHOTON_FUNCTION PackedPhotonUint EncodeGBufferNormal(PackedPhotonFloat3 v)
+{
+    float l1 = PackedPhotonAbs(v.x) + PackedPhotonAbs(v.y) + PackedPhotonAbs(v.z);
+    float u = l1 > 0.0f ? v.x / l1 : 0.0f;
+    float w = l1 > 0.0f ? v.y / l1 : 0.0f;
+    if (v.z < 0.0f) {
+        float foldedU = (1.0f - PackedPhotonAbs(w)) * PackedPhotonSignNotZero(u);
+        float foldedW = (1.0f - PackedPhotonAbs(u)) * PackedPhotonSignNotZero(w);
+        u = foldedU;
+        w = foldedW;
+    }
+    return PackedPhotonQuantise(u * 0.5f + 0.5f, 65535.0f) | (PackedPhotonQuantise(w * 0.5f + 0.5f, 65535.0f) << 16);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodeGBufferNormal(PackedPhotonUint bits)
+{
+    float u = (bits & 65535) * (2.0f / 65535.0f) - 1.0f;
+    float w = (bits >> 16) * (2.0f / 65535.0f) - 1.0f;
+    float z = 1.0f - PackedPhotonAbs(u) - PackedPhotonAbs(w);
+    if (z < 0.0f) {
+        float foldedU = (1.0f - PackedPhotonAbs(w)) * PackedPhotonSignNotZero(u);
+        float foldedW = (1.0f - PackedPhotonAbs(u)) * PackedPhotonSignNotZero(w);
+        u = foldedU;
+        w = foldedW;
+    }
+    float norm = PackedPhotonSqrt(u * u + w * w + z * z);
+    return PackedPhotonMakeFloat3(u / norm, w / norm, z / norm);
+}
+
+PACKED_PHOTON_FUNCTION PackedGBufferTexel EncodeGBuffer(float depth, PackedPhotonFloat3 normal, PackedPhotonUint materialId, PackedPhotonUint brdf, PackedPhotonFloat3 colour)
+{
+    PackedGBufferTexel texel;
+    texel.x = PackedGBufferAsUint(depth);
+    texel.y = EncodeGBufferNormal(normal);
+    texel.z = (materialId & 255) | ((brdf & 255) << 8);
+    texel.w = EncodeRGB9E5(colour);
+    return texel;
+}
+
+PACKED_PHOTON_FUNCTION bool GBufferHit(PackedGBufferTexel texel)
+{
+    return texel.x != 0;
+}
+
+PACKED_PHOTON_FUNCTION float DecodeGBufferDepth(PackedGBufferTexel texel)
+{
+    return PackedGBufferAsFloat(texel.x);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonUint DecodeGBufferMaterial(PackedGBufferTexel texel)
+{
+    return texel.z & 255;
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonUint DecodeGBufferBRDF(PackedGBufferTexel texel)
+{
+    return (texel.z >> 8) & 255;
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodeGBufferColour(PackedGBufferTexel texel)
+{
+    return DecodeRGB9E5(texel.w);
+}
+
+// rayDirection is the normalised direction of the pixel's primary ray, as it was traced.
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 ReconstructGBufferPosition(PackedPhotonFloat3 cameraPosition, PackedPhotonFloat3 rayDirection, PackedGBufferTexel texel)
+{
+    float depth = DecodeGBufferDepth(texel);
+    return PackedPhotonMakeFloat3(cameraPosition.x + depth * rayDirection.x, cameraPosition.y + depth * rayDirection.y, cameraPosition.z + depth * rayDirection.z);
+}
+
+#endif // PACKEDGBUFFER_H
@@ -0,0 +1,231 @@
+
+#ifndef PACKEDPHOTON_H
+#define PACKEDPHOTON_H
+
+//**********************************************************************************************
+//
+// PackedPhoton.h
+//
+// A 16-byte photon record for C++ and HLSL source files, against the 64 bytes of Photon:
+//
+//   cell              x, y, z index of the photon's grid cell, 10 bits each
+//   offset            position within the cell, 11, 11 and 10 bits
+//   directionNormal   incoming direction and surface normal, octahedral, 8 + 8 bits each
+//   power             flux over the frame's power scale, RGB9E5 (shared exponent)
+//
+// Positions are only meaningful with the PhotonGridFrame they were encoded against: the grid's
+// origin and cell size, normally the gather grid's, so a photon's cell is also where a gather
+// looks it up. Segment length and path probability, which the splatting shaders read from
+// Photon, are not kept.
+//
+//**********************************************************************************************
+
+#ifdef HLSL
+typedef uint PackedPhotonUint;
+typedef float3 PackedPhotonFloat3;
+#define PACKED_PHOTON_FUNCTION
+#define PackedPhotonMakeFloat3(x, y, z) float3(x, y, z)
+#define PackedPhotonFloor(x) floor(x)
+#define PackedPhotonAbs(x) abs(x)
+#define PackedPhotonLog2(x) log2(x)
+#define PackedPhotonExp2(x) exp2(x)
+#define PackedPhotonSqrt(x) sqrt(x)
+#else
+#include <cmath>
+#include <cstdint>
+
+typedef uint32_t PackedPhotonUint;
+struct PackedPhotonFloat3 {
+    float x, y, z;
+};
+#define PACKED_PHOTON_FUNCTION inline
+inline PackedPhotonFloat3 PackedPhotonMakeFloat3(float x, float y, float z)
+{
+    PackedPhotonFloat3 v = { x, y, z };
+    return v;
+}
+#define PackedPhotonFloor(x) std::floor(x)
+#define PackedPhotonAbs(x) std::fabs(x)
+#define PackedPhotonLog2(x) std::log2(x)
+// Only ever raised to whole powers, which ldexp does exactly and without a libm call.
+#define PackedPhotonExp2(x) std::ldexp(1.0f, static_cast<int>(x))
+#define PackedPhotonSqrt(x) std::sqrt(x)
+#endif
+
+#define PACKED_PHOTON_CELL_BITS 10
+#define PACKED_PHOTON_MAX_CELLS (1 << PACKED_PHOTON_CELL_BITS)    // Per axis.
+
+struct PackedPhoton {
+    PackedPhotonUint cell;
+    PackedPhotonUint offset;
+    PackedPhotonUint directionNormal;
+    PackedPhotonUint power;
+};
+
+struct PhotonGridFrame {
+    float originX;
+    float originY;
+    float originZ;
+    float cellSize;
+    float powerScale;           // Decoded power is the RGB9E5 value times this.
+    float inversePowerScale;
+    float padding0;             // Keeps the frame two float4s in a constant buffer.
+    float padding1;
+};
+
+PACKED_PHOTON_FUNCTION float PackedPhotonSaturate(float x)
+{
+    return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+}
+
+PACKED_PHOTON_FUNCTION float PackedPhotonSignNotZero(float x)
+{
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonUint PackedPhotonQuantise(float unit, float steps)
+{
+    return (PackedPhotonUint)PackedPhotonFloor(PackedPhotonSaturate(unit) * steps + 0.5f);
+}
+
+// Octahedral mapping of a unit vector to 8 + 8 bits (Cigolle et al., "A Survey of Efficient
+// Representations for Independent Unit Vectors").
+PACKED_PHOTON_FUNCTION PackedPhotonUint EncodeOctahedral(PackedPhotonFloat3 v)
+{
+    float l1 = PackedPhotonAbs(v.x) + PackedPhotonAbs(v.y) + PackedPhotonAbs(v.z);
+    float u = l1 > 0.0f ? v.x / l1 : 0.0f;
+    float w = l1 > 0.0f ? v.y / l1 : 0.0f;
+    if (v.z < 0.0f) {
+        float foldedU = (1.0f - PackedPhotonAbs(w)) * PackedPhotonSignNotZero(u);
+        float foldedW = (1.0f - PackedPhotonAbs(u)) * PackedPhotonSignNotZero(w);
+        u = foldedU;
+        w = foldedW;
+    }
+    return PackedPhotonQuantise(u * 0.5f + 0.5f, 255.0f) | (PackedPhotonQuantise(w * 0.5f + 0.5f, 255.0f) << 8);
+}
+
+// The unfolded point on the octahedron: the decoded direction, but not of unit length. Enough
+// for sign tests such as whether a photon arrived from the front of a surface.
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodeOctahedralUnnormalised(PackedPhotonUint bits)
+{
+    float u = (bits & 255) * (2.0f / 255.0f) - 1.0f;
+    float w = ((bits >> 8) & 255) * (2.0f / 255.0f) - 1.0f;
+    float z = 1.0f - PackedPhotonAbs(u) - PackedPhotonAbs(w);
+    if (z < 0.0f) {
+        float foldedU = (1.0f - PackedPhotonAbs(w)) * PackedPhotonSignNotZero(u);
+        float foldedW = (1.0f - PackedPhotonAbs(u)) * PackedPhotonSignNotZero(w);
+        u = foldedU;
+        w = foldedW;
+    }
+    return PackedPhotonMakeFloat3(u, w, z);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodeOctahedral(PackedPhotonUint bits)
+{
+    PackedPhotonFloat3 v = DecodeOctahedralUnnormalised(bits);
+    float norm = PackedPhotonSqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    return PackedPhotonMakeFloat3(v.x / norm, v.y / norm, v.z / norm);
+}
+
+// DXGI_FORMAT_R9G9B9E5_SHAREDEXP: 9-bit mantissas under one 5-bit exponent with a bias of 15.
+// Negative components encode as zero, and anything over 65408 clamps.
+PACKED_PHOTON_FUNCTION PackedPhotonUint EncodeRGB9E5(PackedPhotonFloat3 rgb)
+{
+    const float largest = 65408.0f;
+    float r = rgb.x > 0.0f ? (rgb.x < largest ? rgb.x : largest) : 0.0f;
+    float g = rgb.y > 0.0f ? (rgb.y < largest ? rgb.y : largest) : 0.0f;
+    float b = rgb.z > 0.0f ? (rgb.z < largest ? rgb.z : largest) : 0.0f;
+    float brightest = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    if (brightest <= 0.0f) {
+        return 0;
+    }
+
+    float exponent = PackedPhotonFloor(PackedPhotonLog2(brightest));
+    exponent = (exponent > -16.0f ? exponent : -16.0f) + 16.0f;
+    float step = PackedPhotonExp2(exponent - 24.0f);
+    if (PackedPhotonFloor(brightest / step + 0.5f) >= 512.0f) {
+        step *= 2.0f;
+        exponent += 1.0f;
+    }
+    PackedPhotonUint red = (PackedPhotonUint)PackedPhotonFloor(r / step + 0.5f);
+    PackedPhotonUint green = (PackedPhotonUint)PackedPhotonFloor(g / step + 0.5f);
+    PackedPhotonUint blue = (PackedPhotonUint)PackedPhotonFloor(b / step + 0.5f);
+    return red | (green << 9) | (blue << 18) | ((PackedPhotonUint)exponent << 27);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodeRGB9E5(PackedPhotonUint bits)
+{
+    float step = PackedPhotonExp2((float)(bits >> 27) - 24.0f);
+    return PackedPhotonMakeFloat3((bits & 511) * step, ((bits >> 9) & 511) * step, ((bits >> 18) & 511) * step);
+}
+
+// Cell coordinates past the grid clamp to its edge cells; their offsets clamp with them.
+PACKED_PHOTON_FUNCTION PackedPhotonUint PackedPhotonCellCoordinate(float gridPosition)
+{
+    float cell = PackedPhotonFloor(gridPosition);
+    return (PackedPhotonUint)(cell < 0.0f ? 0.0f : (cell > PACKED_PHOTON_MAX_CELLS - 1 ? PACKED_PHOTON_MAX_CELLS - 1 : cell));
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonUint PackedPhotonCellIndex(PackedPhotonUint x, PackedPhotonUint y, PackedPhotonUint z)
+{
+    return x | (y << PACKED_PHOTON_CELL_BITS) | (z << (2 * PACKED_PHOTON_CELL_BITS));
+}
+
+PACKED_PHOTON_FUNCTION PackedPhoton EncodePhoton(PhotonGridFrame frame, PackedPhotonFloat3 position, PackedPhotonFloat3 direction, PackedPhotonFloat3 normal, PackedPhotonFloat3 power)
+{
+    float gx = (position.x - frame.originX) / frame.cellSize;
+    float gy = (position.y - frame.originY) / frame.cellSize;
+    float gz = (position.z - frame.originZ) / frame.cellSize;
+    PackedPhotonUint cx = PackedPhotonCellCoordinate(gx);
+    PackedPhotonUint cy = PackedPhotonCellCoordinate(gy);
+    PackedPhotonUint cz = PackedPhotonCellCoordinate(gz);
+
+    PackedPhoton photon;
+    photon.cell = PackedPhotonCellIndex(cx, cy, cz);
+    photon.offset = PackedPhotonQuantise(gx - cx, 2047.0f)
+        | (PackedPhotonQuantise(gy - cy, 2047.0f) << 11)
+        | (PackedPhotonQuantise(gz - cz, 1023.0f) << 22);
+    photon.directionNormal = EncodeOctahedral(direction) | (EncodeOctahedral(normal) << 16);
+    photon.power = EncodeRGB9E5(PackedPhotonMakeFloat3(power.x * frame.inversePowerScale, power.y * frame.inversePowerScale, power.z * frame.inversePowerScale));
+    return photon;
+}
+
+// A gather over one cell's photons decodes the cell's corner once and then only the offsets.
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonCellOrigin(PhotonGridFrame frame, PackedPhotonUint cell)
+{
+    float gx = (float)(cell & (PACKED_PHOTON_MAX_CELLS - 1));
+    float gy = (float)((cell >> PACKED_PHOTON_CELL_BITS) & (PACKED_PHOTON_MAX_CELLS - 1));
+    float gz = (float)(cell >> (2 * PACKED_PHOTON_CELL_BITS));
+    return PackedPhotonMakeFloat3(frame.originX + gx * frame.cellSize, frame.originY + gy * frame.cellSize, frame.originZ + gz * frame.cellSize);
+}
+
+// The photon's position relative to its cell's corner, in world units.
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonCellOffset(PhotonGridFrame frame, PackedPhotonUint offset)
+{
+    return PackedPhotonMakeFloat3((offset & 2047) * (frame.cellSize / 2047.0f), ((offset >> 11) & 2047) * (frame.cellSize / 2047.0f), (offset >> 22) * (frame.cellSize / 1023.0f));
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonPosition(PhotonGridFrame frame, PackedPhoton photon)
+{
+    PackedPhotonFloat3 origin = DecodePhotonCellOrigin(frame, photon.cell);
+    PackedPhotonFloat3 offset = DecodePhotonCellOffset(frame, photon.offset);
+    return PackedPhotonMakeFloat3(origin.x + offset.x, origin.y + offset.y, origin.z + offset.z);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonDirection(PackedPhoton photon)
+{
+    return DecodeOctahedral(photon.directionNormal & 0xFFFF);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonNormal(PackedPhoton photon)
+{
+    return DecodeOctahedral(photon.directionNormal >> 16);
+}
+
+PACKED_PHOTON_FUNCTION PackedPhotonFloat3 DecodePhotonPower(PhotonGridFrame frame, PackedPhoton photon)
+{
+    PackedPhotonFloat3 power = DecodeRGB9E5(photon.power);
+    return PackedPhotonMakeFloat3(power.x * frame.powerScale, power.y * frame.powerScale, power.z * frame.powerScale);
+}
+
+#endif // PACKEDPHOTON_H
@@ -0,0 +1,100 @@
+#include "PhotonBudget.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+PhotonBudget::PhotonBudget(uint32_t photonsPerFrame, uint32_t minimumPerLight) : m_photonsPerFrame(photonsPerFrame), m_minimumPerLight(minimumPerLight)
+{
+}
+
+const std::vector<PhotonLightShare>& PhotonBudget::Allocate(const float* powers, uint32_t lightCount)
+{
+    m_shares.assign(lightCount, PhotonLightShare());
+    m_emitted = 0;
+
+    double total = 0;
+    uint32_t lit = 0;
+    for (uint32_t i = 0; i < lightCount; i++) {
+        if (powers[i] > 0) {
+            total += powers[i];
+            lit++;
+        }
+    }
+    if (lit == 0 || m_photonsPerFrame == 0) {
+        return m_shares;
+    }
+
+    // The minimum comes off the top; what is left goes by power. When the budget cannot cover
+    // the minimum everywhere, the lights share it evenly instead.
+    uint32_t minimum = (std::min)(m_minimumPerLight, m_photonsPerFrame / lit);
+    uint32_t proportional = m_photonsPerFrame - minimum * lit;
+    std::vector<std::pair<double, uint32_t>> remainders;
+    uint32_t handedOut = 0;
+    for (uint32_t i = 0; i < lightCount; i++) {
+        if (powers[i] <= 0) {
+            continue;
+        }
+        double exact = proportional * (powers[i] / total);
+        uint32_t whole = static_cast<uint32_t>(exact);
+        m_shares[i].count = minimum + whole;
+        handedOut += whole;
+        remainders.push_back(std::make_pair(exact - whole, i));
+    }
+    std::sort(remainders.begin(), remainders.end(), [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    for (size_t i = 0; handedOut < proportional; i++, handedOut++) {
+        m_shares[remainders[i % remainders.size()].second].count++;
+    }
+
+    for (uint32_t i = 0; i < lightCount; i++) {
+        m_shares[i].first = m_emitted;
+        m_shares[i].fluxScale = m_shares[i].count > 0 ? 1.0f / m_shares[i].count : 0.0f;
+        m_emitted += m_shares[i].count;
+    }
+    return m_shares;
+}
+
+uint32_t PhotonBudget::LightOf(uint32_t photon) const
+{
+    auto after = std::upper_bound(m_shares.begin(), m_shares.end(), photon, [](uint32_t index, const PhotonLightShare& share) {
+        return index < share.first;
+    });
+    // Lights without photons share their first with the next one; step back past them.
+    uint32_t light = static_cast<uint32_t>(after - m_shares.begin()) - 1;
+    while (light > 0 && m_shares[light].count == 0) {
+        light--;
+    }
+    return light;
+}
+
+std::string PhotonBudget::Summary() const
+{
+    std::ostringstream out;
+    out << m_emitted << " of " << m_photonsPerFrame << " photons over " << m_shares.size() << " lights |";
+    for (const PhotonLightShare& share : m_shares) {
+        out << " " << share.count;
+    }
+    return out.str();
+}
+
+ProgressiveRadius::ProgressiveRadius(float alpha, float minimumScale) : m_alpha(alpha), m_minimumScale(minimumScale)
+{
+    Reset();
+}
+
+void ProgressiveRadius::Reset()
+{
+    m_radiusSquared = 1.0;
+    m_scale = 1.0f;
+    m_pass = 0;
+}
+
+// r(i+1)^2 = r(i)^2 (i + alpha) / (i + 1), counting passes from 1.
+float ProgressiveRadius::Advance()
+{
+    m_pass++;
+    m_radiusSquared *= (m_pass + static_cast<double>(m_alpha)) / (m_pass + 1.0);
+    m_scale = (std::max)(static_cast<float>(std::sqrt(m_radiusSquared)), m_minimumScale);
+    return m_scale;
+}
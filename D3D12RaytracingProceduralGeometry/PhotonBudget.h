@@ -0,0 +1,85 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PhotonBudget.h
+//
+// How many photons a frame emits, and from which light. The budget is a photon count chosen
+// independently of the render target; it is split across the lights in proportion to their
+// power, so every photon carries roughly the same flux whichever light it left.
+//
+// ProgressiveRadius is the gather-radius schedule of progressive photon mapping (Knaus and
+// Zwicker): each pass shrinks the radius so that averaging the passes converges on the
+// unbiased image while the noise of each pass stays bounded. Both the GPU path in Application
+// and Cpu::ProgressivePhotonMapper use them.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PhotonLightShare {
+    uint32_t first = 0;         // The light's photons are first..first + count of the frame's.
+    uint32_t count = 0;
+    float fluxScale = 0;        // Multiplies the light's power to give each of its photons' flux.
+};
+
+class PhotonBudget
+{
+public:
+    explicit PhotonBudget(uint32_t photonsPerFrame, uint32_t minimumPerLight = 64);
+
+    uint32_t PhotonsPerFrame() const { return m_photonsPerFrame; }
+    void SetPhotonsPerFrame(uint32_t photons) { m_photonsPerFrame = photons; }
+
+    // Splits the budget across lightCount lights with the given powers, largest remainder
+    // first. Every light with any power gets at least the minimum, budget permitting; a light
+    // with none gets no photons.
+    const std::vector<PhotonLightShare>& Allocate(const float* powers, uint32_t lightCount);
+    const std::vector<PhotonLightShare>& Shares() const { return m_shares; }
+    // Photons the last Allocate() handed out; equal to the budget unless no light had power.
+    uint32_t Emitted() const { return m_emitted; }
+    // The light photon index belongs to, from the last Allocate().
+    uint32_t LightOf(uint32_t photon) const;
+
+    std::string Summary() const;
+
+private:
+    uint32_t m_photonsPerFrame;
+    uint32_t m_minimumPerLight;
+    uint32_t m_emitted = 0;
+    std::vector<PhotonLightShare> m_shares;
+};
+
+// Weight of a light in the split: its power times the luminance of its colour.
+inline float PhotonLightWeight(float power, float r, float g, float b)
+{
+    return power * (0.2126f * r + 0.7152f * g + 0.0722f * b);
+}
+
+class ProgressiveRadius
+{
+public:
+    // alpha in (0, 1) trades how fast the radius shrinks (small) against how fast the noise
+    // falls (large). The scale never drops below minimumScale, so GPU kernels keep covering
+    // at least a pixel or so.
+    explicit ProgressiveRadius(float alpha = 2.0f / 3.0f, float minimumScale = 0.05f);
+
+    // Back to the first pass, e.g. when the camera moves and the average starts over.
+    void Reset();
+    // Moves to the next pass and returns its radius scale.
+    float Advance();
+
+    // Radius of the current pass relative to the first one's.
+    float Scale() const { return m_scale; }
+    uint32_t Pass() const { return m_pass; }
+    float Alpha() const { return m_alpha; }
+
+private:
+    float m_alpha;
+    float m_minimumScale;
+    double m_radiusSquared;
+    float m_scale;
+    uint32_t m_pass;
+};
@@ -0,0 +1,51 @@
+#ifndef PHOTONHASHGRID_H
+#define PHOTONHASHGRID_H
+
+//**********************************************************************************************
+//
+// PhotonHashGrid.h
+//
+// The layout of the hashed photon grid, for C++ and HLSL source files. Space is cut into cells
+// one gather radius wide and each cell is hashed to one of a power-of-two number of buckets, so
+// the table does not depend on the scene's extent. The grid is two uint buffers:
+//
+//   cellStart   bucketMask + 2 entries; bucket b's photons are order[cellStart[b]] up to
+//               order[cellStart[b + 1]]
+//   order       photonCount indices into the photon buffer, grouped by bucket
+//
+// A gather hashes the 27 cells around its point and walks each bucket once; distinct cells
+// can share a bucket, so it must still test each photon's distance.
+//
+//**********************************************************************************************
+
+#ifdef HLSL
+typedef uint PhotonHashGridUint;
+#define PHOTON_HASH_GRID_FUNCTION
+#define PhotonHashGridFloor(x) floor(x)
+#else
+#include <cmath>
+#include <cstdint>
+
+typedef uint32_t PhotonHashGridUint;
+#define PHOTON_HASH_GRID_FUNCTION inline
+#define PhotonHashGridFloor(x) std::floor(x)
+#endif
+
+struct PhotonHashGridConstants {
+    float cellSize;
+    float inverseCellSize;          // Cells are found by multiplying by this on both sides.
+    PhotonHashGridUint bucketMask;  // Buckets - 1.
+    PhotonHashGridUint photonCount;
+};
+
+PHOTON_HASH_GRID_FUNCTION int PhotonHashGridCoordinate(float value, float inverseCellSize)
+{
+    return (int)PhotonHashGridFloor(value * inverseCellSize);
+}
+
+PHOTON_HASH_GRID_FUNCTION PhotonHashGridUint PhotonHashGridBucket(int x, int y, int z, PhotonHashGridUint bucketMask)
+{
+    return ((PhotonHashGridUint)x * 73856093u ^ (PhotonHashGridUint)y * 19349663u ^ (PhotonHashGridUint)z * 83492791u) & bucketMask;
+}
+
+#endif // PHOTONHASHGRID_H
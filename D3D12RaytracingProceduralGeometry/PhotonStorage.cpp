@@ -0,0 +1,36 @@
+#include "PhotonStorage.h"
+#include <sstream>
+
+PhotonCapacity::PhotonCapacity(uint32_t initial, uint32_t maximum) : m_capacity(initial > 0 ? initial : 1), m_maximum((std::max)(maximum, initial))
+{
+}
+
+// Growing doubles the capacity, or more if the demand needs it, plus a quarter on top so a
+// frame that only just overflowed does not do so again straight away.
+bool PhotonCapacity::Record(uint32_t requested)
+{
+    m_stats.frames++;
+    m_stats.requested += requested;
+    m_stats.lastRequested = requested;
+    m_stats.peakRequested = (std::max)(m_stats.peakRequested, requested);
+    if (requested <= m_capacity) {
+        return false;
+    }
+    m_stats.dropped += requested - m_capacity;
+    m_stats.overflowFrames++;
+    if (m_capacity >= m_maximum) {
+        return false;
+    }
+    uint64_t wanted = (std::max)(static_cast<uint64_t>(m_capacity) * 2, static_cast<uint64_t>(requested) + requested / 4);
+    m_capacity = static_cast<uint32_t>((std::min)(wanted, static_cast<uint64_t>(m_maximum)));
+    m_stats.grows++;
+    return true;
+}
+
+std::string PhotonStorageStats::Summary() const
+{
+    std::ostringstream out;
+    out << frames << " frames, " << requested << " photons requested, " << dropped << " dropped in "
+        << overflowFrames << " overflowing frames, " << grows << " grows | last " << lastRequested << ", peak " << peakRequested;
+    return out.str();
+}
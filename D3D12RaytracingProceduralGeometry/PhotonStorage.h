@@ -0,0 +1,124 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PhotonStorage.h
+//
+// Bookkeeping for photon buffers that live across frames. Photons are appended through an
+// atomic counter into fixed-capacity arrays; a frame starts by clearing the counter instead of
+// reallocating anything. The counter is allowed to run past the capacity, so a frame that
+// overflows still reports how many photons it tried to store, and the capacity grows only
+// then. Two sets of arrays alternate between frames, so the previous frame's photons stay
+// readable while the next frame's are emitted.
+//
+// PhotonCapacity is the sizing policy shared by the GPU buffers in Application and by
+// Cpu::PhotonStore, the same scheme over system memory for benchmarking without a GPU.
+//
+//**********************************************************************************************
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PhotonStorageStats {
+    uint64_t frames = 0;
+    uint64_t requested = 0;         // Appends attempted, over all frames.
+    uint64_t dropped = 0;           // Appends that found the arrays full.
+    uint32_t overflowFrames = 0;
+    uint32_t grows = 0;
+    uint32_t lastRequested = 0;
+    uint32_t peakRequested = 0;
+
+    std::string Summary() const;
+};
+
+class PhotonCapacity
+{
+public:
+    PhotonCapacity(uint32_t initial, uint32_t maximum);
+
+    uint32_t Capacity() const { return m_capacity; }
+    uint32_t Maximum() const { return m_maximum; }
+    // Records where a frame's append counter ended. Returns true if the capacity grew, in
+    // which case the arrays must be reallocated before the next frame appends to them.
+    bool Record(uint32_t requested);
+    // How many records a frame that requested this many actually stored.
+    uint32_t Stored(uint32_t requested) const { return requested < m_capacity ? requested : m_capacity; }
+
+    const PhotonStorageStats& Stats() const { return m_stats; }
+    void ResetStats() { m_stats = PhotonStorageStats(); }
+
+private:
+    uint32_t m_capacity;
+    uint32_t m_maximum;
+    PhotonStorageStats m_stats;
+};
+
+namespace Cpu {
+
+    // Double-buffered append store for any photon record type.
+    template <typename Record>
+    class PhotonStore
+    {
+    public:
+        PhotonStore(uint32_t capacity, uint32_t maximum) : m_capacity(capacity, maximum), m_counter(0)
+        {
+            m_sets[0].resize(m_capacity.Capacity());
+            m_sets[1].resize(m_capacity.Capacity());
+        }
+
+        // Clears the append counter of the set this frame writes.
+        void BeginFrame() { m_counter.store(0, std::memory_order_relaxed); }
+
+        // Safe from any number of threads. A photon past the capacity is counted and dropped.
+        bool Append(const Record& record)
+        {
+            uint32_t index = m_counter.fetch_add(1, std::memory_order_relaxed);
+            if (index >= m_capacity.Capacity()) {
+                return false;
+            }
+            m_sets[m_write][index] = record;
+            return true;
+        }
+
+        // Claims count consecutive slots with one atomic, for emitters that batch per thread.
+        // Returns how many of them fit; those start at first in WriteSlots().
+        uint32_t Reserve(uint32_t count, uint32_t& first)
+        {
+            first = m_counter.fetch_add(count, std::memory_order_relaxed);
+            uint32_t capacity = m_capacity.Capacity();
+            return first >= capacity ? 0 : (std::min)(count, capacity - first);
+        }
+        Record* WriteSlots() { return m_sets[m_write].data(); }
+
+        // Records the frame's counter, grows both sets if it overflowed, and makes what was
+        // just written the readable set. Growing keeps the contents of both.
+        void EndFrame()
+        {
+            uint32_t requested = m_counter.load(std::memory_order_relaxed);
+            m_readCount = m_capacity.Stored(requested);
+            if (m_capacity.Record(requested)) {
+                m_sets[0].resize(m_capacity.Capacity());
+                m_sets[1].resize(m_capacity.Capacity());
+            }
+            m_write ^= 1;
+        }
+
+        const Record* Read() const { return m_sets[m_write ^ 1].data(); }
+        uint32_t ReadCount() const { return m_readCount; }
+
+        uint32_t Capacity() const { return m_capacity.Capacity(); }
+        const PhotonStorageStats& Stats() const { return m_capacity.Stats(); }
+        size_t Bytes() const { return (m_sets[0].capacity() + m_sets[1].capacity()) * sizeof(Record); }
+
+    private:
+        PhotonCapacity m_capacity;
+        std::vector<Record> m_sets[2];
+        std::atomic<uint32_t> m_counter;
+        uint32_t m_write = 0;
+        uint32_t m_readCount = 0;
+    };
+}
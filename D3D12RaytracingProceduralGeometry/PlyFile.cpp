@@ -7,6 +7,8 @@
 #include "stdafx.h"
 
 #include "PlyFile.h"
+#include "PointCloudFilters.h"
+#include "PointCloudNormals.h"
 
 
 
@@ -68,6 +70,49 @@ int vertexHandler(p_ply_argument argument) {
 	return 1;
 }
 
+// Vertices of one chunk; rply reports indices across the whole file.
+struct ChunkReader {
+	std::vector<Vertex_Ply> chunk;
+	long first;
+	long total;
+	const std::function<void(const std::vector<Vertex_Ply>&)>* sink;
+
+	void start(long index) {
+		chunk.resize(std::min<long>(static_cast<long>(chunk.capacity()), total - index));
+		for (Vertex_Ply& vertex : chunk) {
+			vertex.location.setZero();
+			vertex.colour.setZero();
+			vertex.normal.setZero();
+			vertex.curvature = 0;
+		}
+		first = index;
+	}
+};
+
+int chunkHandler(p_ply_argument argument) {
+	long elemIx, vertIx;
+	ChunkReader* reader;
+	ply_get_argument_element(argument, NULL, &vertIx);
+	ply_get_argument_user_data(argument, (void**)(&reader), &elemIx);
+
+	if (vertIx >= reader->first + static_cast<long>(reader->chunk.size())) {
+		(*reader->sink)(reader->chunk);
+		reader->start(vertIx);
+	}
+	Vertex_Ply& vertex = reader->chunk[vertIx - reader->first];
+	double value = ply_get_argument_value(argument);
+	if (elemIx < 3) {
+		vertex.location(elemIx) = value;
+	}
+	else if (elemIx < 6) {
+		vertex.colour(elemIx - 3) = static_cast<int>(value);
+	}
+	else {
+		vertex.normal(elemIx - 6) = value;
+	}
+	return 1;
+}
+
 
 void PlyFile::translateCloud(Eigen::Vector3d trans){
 	Eigen::Vector3d cent = centroid();
@@ -206,18 +251,58 @@ bool PlyFile::read(const std::string& filename){
 	ply_set_read_cb(ply, "vertex", "g", vertexHandler, &points_, 4);
 	ply_set_read_cb(ply, "vertex", "b", vertexHandler, &points_, 5);
 	ply_set_read_cb(ply, "vertex", "red", vertexHandler, &points_, 3);
-	ply_set_read_cb(ply, "vertex", "blue", vertexHandler, &points_, 4);
-	ply_set_read_cb(ply, "vertex", "green", vertexHandler, &points_, 5);
+	ply_set_read_cb(ply, "vertex", "green", vertexHandler, &points_, 4);
+	ply_set_read_cb(ply, "vertex", "blue", vertexHandler, &points_, 5);
 	ply_set_read_cb(ply, "vertex", "nx", vertexHandler, &points_, 6);
 	ply_set_read_cb(ply, "vertex", "ny", vertexHandler, &points_, 7);
 	ply_set_read_cb(ply, "vertex", "nz", vertexHandler, &points_, 8);
+	// Files without normals leave them unset; so does every file for curvature.
 	points_.resize(nVertexs);
+	for(Vertex_Ply& vertex : points_){
+		vertex.normal.setZero();
+		vertex.curvature = 0;
+	}
 
 	ply_read(ply);
 
 	return true;
 }
 
+bool PlyFile::readChunks(const std::string& filename, size_t chunkSize,
+	const std::function<void(const std::vector<Vertex_Ply>&)>& sink){
+	p_ply ply = ply_open(filename.c_str(), NULL, 0, NULL);
+	if(!ply){
+		std::cerr << "Failed to open PLY file" << std::endl;
+		return false;
+	}
+	if(!ply_read_header(ply)){
+		std::cerr << "Failed to open PLY header" << std::endl;
+		ply_close(ply);
+		return false;
+	}
+
+	ChunkReader reader;
+	reader.chunk.reserve(chunkSize > 0 ? chunkSize : 1);
+	reader.sink = &sink;
+	const char* properties[] = { "x", "y", "z", "red", "green", "blue", "nx", "ny", "nz" };
+	const char* shortColours[] = { "r", "g", "b" };
+	reader.total = ply_set_read_cb(ply, "vertex", properties[0], chunkHandler, &reader, 0);
+	for(long i = 1; i < 9; i++){
+		ply_set_read_cb(ply, "vertex", properties[i], chunkHandler, &reader, i);
+	}
+	for(long i = 0; i < 3; i++){
+		ply_set_read_cb(ply, "vertex", shortColours[i], chunkHandler, &reader, 3 + i);
+	}
+	reader.start(0);
+
+	bool read = ply_read(ply) != 0;
+	if(read && !reader.chunk.empty()){
+		sink(reader.chunk);
+	}
+	ply_close(ply);
+	return read;
+}
+
 void PlyFile::sortAlongAxis(int axis, int low, int high){
 	if (low < high){
 		//std::cout << low;
@@ -252,125 +337,67 @@ void PlyFile::swap(int i, int j){
 
 	points_[j] = v;
 }
-bool PlyFile::write(const std::string& filename){
-
-	std::ofstream fout(filename);
-	    if (!fout) {
-	        std::cerr << "Failed to open PLY file " << filename << " for writing" << std::endl;
-	        return false;
-	    }
-
-	    fout << "ply\n"
-	    << "format ascii 1.0\n"
-	    << "element vertex " << size() << "\n"
-	    << "property float x\n"
-	    << "property float y\n"
-	    << "property float z\n"
-	    << "property float nx\n"
-	    << "property float ny\n"
-	    << "property float nz\n"
-	    << "property uchar red\n"
-	    << "property uchar green\n"
-	    << "property uchar blue\n"
-	    << "end_header\n";
-
-	    for (size_t ix = 0; ix < size(); ++ix) {
-	        fout << points_[ix].location(0) << " " << points_[ix].location(1)<< " " << points_[ix].location(2) << " " << points_[ix].normal(0) << " " << points_[ix].normal(1) << " " << points_[ix].normal(2) << " "  << points_[ix].colour(0) << " " << points_[ix].colour(1) << " "<< points_[ix].colour(2) << "\n";
-	      // std::cout << "Points: " << points_[ix].location << " normals : " << points_[ix].normal << " " << 255 <<  " " << 0 << " " << 0 << "\n";
-	    }
-
-	    fout.close();
-
-	    return true;
-
-}
-
-bool PlyFile::writeBlue(const std::string& filename){
-
-	std::ofstream fout(filename);
-	    if (!fout) {
-	        std::cerr << "Failed to open PLY file " << filename << " for writing" << std::endl;
-	        return false;
-	    }
-
-	    fout << "ply\n"
-	    << "format ascii 1.0\n"
-	    << "element vertex " << size() << "\n"
-	    << "property float x\n"
-	    << "property float y\n"
-	    << "property float z\n"
-	    << "property float nx\n"
-	    << "property float ny\n"
-	    << "property float nz\n"
-	    << "property uchar red\n"
-	    << "property uchar green\n"
-	    << "property uchar blue\n"
-	    << "end_header\n";
-
-	    for (size_t ix = 0; ix < size(); ++ix) {
-	        fout << points_[ix].location << " " << points_[ix].normal << " " << 0 <<  " " << 0 << " " << 255 << "\n";
-	    }
-	    fout.close();
-	    return true;
-
-}
-
-bool PlyFile::writeRed(const std::string& filename){
-
-	std::ofstream fout(filename);
-	    if (!fout) {
-	        std::cerr << "Failed to open PLY file " << filename << " for writing" << std::endl;
-	        return false;
-	    }
-
-	    fout << "ply\n"
-	    << "format ascii 1.0\n"
-	    << "element vertex " << size() << "\n"
-	    << "property float x\n"
-	    << "property float y\n"
-	    << "property float z\n"
-	    << "property float nx\n"
-	    << "property float ny\n"
-	    << "property float nz\n"
-	    << "property uchar red\n"
-	    << "property uchar green\n"
-	    << "property uchar blue\n"
-	    << "end_header\n";
-
-	    for (size_t ix = 0; ix < size(); ++ix) {
-	        fout << points_[ix].location << " " << points_[ix].normal << " " << 255 <<  " " << 0 << " " << 0 << "\n";
-	    }
-	    fout.close();
-	    return true;
-}
-
+bool PlyFile::writeColoured(const std::string& filename, PlyFormat::Enum format, const uint8_t* colour, size_t colourStride){
+	// Channels read the fields of points_ in place; nothing is read when it is empty.
+	PlyWriter writer(points_.size());
+	Vertex_Ply none;
+	const Vertex_Ply& first = points_.empty() ? none : points_[0];
+	const char* locations[] = { "x", "y", "z" };
+	const char* normals[] = { "nx", "ny", "nz" };
+	const char* colours[] = { "red", "green", "blue" };
+	for(int axis = 0; axis < 3; axis++){
+		writer.AddChannel(locations[axis], PlyType::Float, &first.location(axis), PlyType::Double, sizeof(Vertex_Ply));
+	}
+	for(int axis = 0; axis < 3; axis++){
+		writer.AddChannel(normals[axis], PlyType::Float, &first.normal(axis), PlyType::Double, sizeof(Vertex_Ply));
+	}
+	for(int channel = 0; channel < 3; channel++){
+		if(colour){
+			writer.AddChannel(colours[channel], &colour[channel], colourStride);
+		}
+		else{
+			writer.AddChannel(colours[channel], PlyType::UChar, &first.colour(channel), PlyType::Int, sizeof(Vertex_Ply));
+		}
+	}
+	writer.AddChannel("curvature", PlyType::Float, &first.curvature, PlyType::Double, sizeof(Vertex_Ply));
 
-int PlyFile::size(){
-	return points_.size();
+	std::string error;
+	if(!writer.Write(filename, format, &error)){
+		std::cerr << "Failed to write PLY file: " << error << std::endl;
+		return false;
+	}
+	return true;
 }
 
+bool PlyFile::write(const std::string& filename, PlyFormat::Enum format){
+	return writeColoured(filename, format, nullptr, 0);
+}
 
-double PlyFile::curvatureAtPoint(int index){
-	int previousIndex = index -1;
-	int afterIndex = index + 1;
+bool PlyFile::writeBlue(const std::string& filename, PlyFormat::Enum format){
+	const uint8_t blue[] = { 0, 0, 255 };
+	return writeColoured(filename, format, blue, 0);
+}
 
-	if(index == 0){
-		previousIndex = points_.size();
-	}
-	else if(index == points_.size()){
-		afterIndex = 0;
-	}
+bool PlyFile::writeRed(const std::string& filename, PlyFormat::Enum format){
+	const uint8_t red[] = { 255, 0, 0 };
+	return writeColoured(filename, format, red, 0);
+}
 
-	Eigen::Vector3d previous = points_[index].location - points_[previousIndex].location;
-	Eigen::Vector3d next = points_[index].location - points_[afterIndex].location;
 
-	double previousMag = previous.norm();
-	double nextMag = next.norm();
+int PlyFile::size(){
+	return points_.size();
+}
 
-	double cos = previous.dot(next)/(previousMag*nextMag);
-	return acos(cos);
 
+void PlyFile::estimateNormals(int neighbours){
+	PointCloudNormalSettings settings;
+	settings.neighbours = neighbours;
+	PointCloudNormals::Estimate(points_, settings);
+}
 
+double PlyFile::curvatureAtPoint(int index){
+	assert(index >= 0 && index < size());
+	return points_[index].curvature;
 }
 
 
@@ -491,28 +518,9 @@ void PlyFile::orientateAroundYAxis(){
 
 
 PlyFile PlyFile::colourThreshold(Eigen::Vector3i colour, double threshold, std::string filename ){
-	PlyFile colourFiltered;
-	PlyFile otherColours;
-	int count = 0;
-	//d::cout << "in here\n";
-	for(int i = 0; i < points_.size(); i++){
-		//d::cout << "Within the for loo\n";
-		Eigen::Vector3i colourDifference(0,0,0);
-	//td::cout << "Our point : \n" << points_[i].colour << std::endl;
-		colourDifference = (points_[i].colour - colour);
-	//td::cout << colourDifference << std::endl;
-        float distance = (fabs(colourDifference[0]/255.0) + fabs(colourDifference[1]/255.0) + fabs(colourDifference[2]/255.0)) * 100.0 /3.0;
-		//d::cout << "Our distance:\n" << distance;
-		if(distance < threshold){
-			//d::cout << "distance: \n" << distance << "\n" << "threshold: \n" << threshold << std::endl;
-			colourFiltered.push_back(points_[i]);
-
-
-			count++;
-		}else{
-			otherColours.push_back(points_[i]);
-		}
-	}
+	std::vector<Vertex_Ply> rejected;
+	PlyFile colourFiltered(PointCloudFilters::ColourRange(points_, colour, threshold, &rejected));
+	PlyFile otherColours(rejected);
 
 	std::cout << "Writing new ply filtered by colour\n";
 	colourFiltered.write(filename + ".ply");
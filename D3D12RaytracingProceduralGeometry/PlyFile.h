@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdio>
 #include <rply/rply.h>
 #include <rply/rplyfile.h>
 #include <Eigen/Core>
@@ -7,6 +8,8 @@
 #include <iostream>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
+#include "PlyWriter.h"
 #define M_PI 3.14159265358979323846
 
 using namespace Eigen;
@@ -44,6 +47,7 @@ private:
 
 		std::vector<Vertex_Ply> points_;
 		Eigen::Vector3d closestPoint(Vertex_Ply x);
+		bool writeColoured(const std::string& filename, PlyFormat::Enum format, const uint8_t* colour, size_t colourStride);
 
 public:
 
@@ -60,11 +64,18 @@ public:
 
 		bool read(const std::string& filename);
 
-		bool write(const std::string& filename);
+		// Reads the vertices of filename chunkSize at a time, handing each chunk to sink instead
+		// of keeping them, so a scan larger than memory can be filtered as it loads.
+		static bool readChunks(const std::string& filename, size_t chunkSize,
+			const std::function<void(const std::vector<Vertex_Ply>&)>& sink);
 
-		bool writeBlue(const std::string& filename);
+		// Position, normal, colour and curvature of every point; see PlyWriter.
+		bool write(const std::string& filename, PlyFormat::Enum format = PlyFormat::BinaryLittleEndian);
 
-		bool writeRed(const std::string& filename);
+		// As write(), with every point coloured blue or red.
+		bool writeBlue(const std::string& filename, PlyFormat::Enum format = PlyFormat::BinaryLittleEndian);
+
+		bool writeRed(const std::string& filename, PlyFormat::Enum format = PlyFormat::BinaryLittleEndian);
 
 		std::vector<Vertex_Ply> getPoints();
 
@@ -78,8 +89,15 @@ public:
 
 		void reColour(int r, int g, int b);
 
+		// Also writes the kept and rejected points to <filename>.ply and <filename>plane.ply;
+		// PointCloudFilters::ColourRange does the same selection without writing.
 		PlyFile colourThreshold(Eigen::Vector3i colour, double threshold, std::string filename);
 
+		// Fills every point's normal and curvature from its k nearest neighbours; see
+		// PointCloudNormals for the orientation and the other settings.
+		void estimateNormals(int neighbours = 16);
+
+		// Surface variation at index, as estimateNormals() left it.
 		double curvatureAtPoint(int index);
 
 		void order();
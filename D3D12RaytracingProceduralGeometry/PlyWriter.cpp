@@ -0,0 +1,239 @@
+#include "PlyWriter.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+	const char* const TypeNames[PlyType::Count] = { "char", "uchar", "short", "ushort", "int", "uint", "float", "double" };
+	const size_t TypeBytes[PlyType::Count] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+	const size_t RowsPerChunk = 1 << 14;
+	// Rows formatted before each write. Large enough that the write is a handful of syscalls
+	// per hundred megabytes, small enough that a huge cloud is not held twice in memory.
+	const size_t BatchBytes = 64 << 20;
+	// Longest an ASCII value can be: a %.17g double.
+	const size_t MaxAsciiValue = 32;
+
+	template<typename T>
+	T Load(const uint8_t* p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	double LoadAsDouble(const uint8_t* p, PlyType::Enum source)
+	{
+		switch (source) {
+		case PlyType::Char: return Load<int8_t>(p);
+		case PlyType::UChar: return Load<uint8_t>(p);
+		case PlyType::Short: return Load<int16_t>(p);
+		case PlyType::UShort: return Load<uint16_t>(p);
+		case PlyType::Int: return Load<int32_t>(p);
+		case PlyType::UInt: return Load<uint32_t>(p);
+		case PlyType::Float: return Load<float>(p);
+		default: return Load<double>(p);
+		}
+	}
+
+	template<typename T>
+	uint8_t* Store(uint8_t* out, T value)
+	{
+		memcpy(out, &value, sizeof(T));
+		return out + sizeof(T);
+	}
+
+	// Integer conversions saturate, so a colour of 256 becomes 255 rather than 0.
+	template<typename T>
+	T Saturate(double value)
+	{
+		double low = static_cast<double>((std::numeric_limits<T>::min)());
+		double high = static_cast<double>((std::numeric_limits<T>::max)());
+		return static_cast<T>((std::min)((std::max)(value, low), high));
+	}
+
+	// Same-type channels are copied; others go through double. Assumes a little-endian host.
+	uint8_t* StoreBinary(uint8_t* out, const uint8_t* p, PlyType::Enum source, PlyType::Enum type)
+	{
+		if (source == type) {
+			memcpy(out, p, TypeBytes[type]);
+			return out + TypeBytes[type];
+		}
+		double value = LoadAsDouble(p, source);
+		switch (type) {
+		case PlyType::Char: return Store(out, Saturate<int8_t>(value));
+		case PlyType::UChar: return Store(out, Saturate<uint8_t>(value));
+		case PlyType::Short: return Store(out, Saturate<int16_t>(value));
+		case PlyType::UShort: return Store(out, Saturate<uint16_t>(value));
+		case PlyType::Int: return Store(out, Saturate<int32_t>(value));
+		case PlyType::UInt: return Store(out, Saturate<uint32_t>(value));
+		case PlyType::Float: return Store(out, static_cast<float>(value));
+		default: return Store(out, value);
+		}
+	}
+
+	char* StoreInteger(char* out, int64_t integer)
+	{
+		char digits[24];
+		int count = 0;
+		bool negative = integer < 0;
+		uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(integer) : static_cast<uint64_t>(integer);
+		do {
+			digits[count++] = static_cast<char>('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude > 0);
+		if (negative) {
+			*out++ = '-';
+		}
+		while (count > 0) {
+			*out++ = digits[--count];
+		}
+		return out;
+	}
+
+	// Nine significant digits, enough to read a float back exactly, in plain decimal with
+	// trailing zeros dropped. Values too large or small for that fall back to snprintf.
+	char* StoreFloat(char* out, double value)
+	{
+		const int Digits = 9;
+		double magnitude = std::abs(value);
+		if (magnitude == 0.0) {
+			*out++ = '0';
+			return out;
+		}
+		if (!(magnitude >= 1e-4 && magnitude < 1e9)) {
+			return out + snprintf(out, MaxAsciiValue, "%.9g", static_cast<float>(value));
+		}
+		int decimals = (std::max)(Digits - 1 - static_cast<int>(std::floor(std::log10(magnitude))), 0);
+		uint64_t scale = 1;
+		for (int d = 0; d < decimals; d++) {
+			scale *= 10;
+		}
+		uint64_t scaled = static_cast<uint64_t>(std::llround(magnitude * static_cast<double>(scale)));
+		if (value < 0.0) {
+			*out++ = '-';
+		}
+		out = StoreInteger(out, static_cast<int64_t>(scaled / scale));
+		uint64_t fraction = scaled % scale;
+		if (fraction == 0) {
+			return out;
+		}
+		*out++ = '.';
+		for (int d = decimals - 1; d >= 0 && fraction > 0; d--) {
+			scale /= 10;
+			*out++ = static_cast<char>('0' + fraction / scale);
+			fraction %= scale;
+		}
+		return out;
+	}
+
+	char* StoreAscii(char* out, const uint8_t* p, PlyType::Enum source, PlyType::Enum type)
+	{
+		double value = LoadAsDouble(p, source);
+		switch (type) {
+		case PlyType::Char: return StoreInteger(out, Saturate<int8_t>(value));
+		case PlyType::UChar: return StoreInteger(out, Saturate<uint8_t>(value));
+		case PlyType::Short: return StoreInteger(out, Saturate<int16_t>(value));
+		case PlyType::UShort: return StoreInteger(out, Saturate<uint16_t>(value));
+		case PlyType::Int: return StoreInteger(out, Saturate<int32_t>(value));
+		case PlyType::UInt: return StoreInteger(out, Saturate<uint32_t>(value));
+		case PlyType::Float: return StoreFloat(out, static_cast<float>(value));
+		default: return out + snprintf(out, MaxAsciiValue, "%.17g", value);
+		}
+	}
+}
+
+void PlyWriter::AddChannel(const std::string& name, PlyType::Enum type, const void* data, PlyType::Enum source, size_t stride)
+{
+	Channel channel = { name, type, source, static_cast<const uint8_t*>(data), stride };
+	m_channels.push_back(channel);
+}
+
+size_t PlyWriter::RowBytes() const
+{
+	size_t bytes = 0;
+	for (const Channel& channel : m_channels) {
+		bytes += TypeBytes[channel.type];
+	}
+	return bytes;
+}
+
+std::string PlyWriter::Header(PlyFormat::Enum format) const
+{
+	std::string header = "ply\nformat ";
+	header += format == PlyFormat::Ascii ? "ascii 1.0\n" : "binary_little_endian 1.0\n";
+	header += "element vertex " + std::to_string(m_count) + "\n";
+	for (const Channel& channel : m_channels) {
+		header += std::string("property ") + TypeNames[channel.type] + " " + channel.name + "\n";
+	}
+	header += "end_header\n";
+	return header;
+}
+
+bool PlyWriter::Write(const std::string& filename, PlyFormat::Enum format, std::string* error, unsigned threads) const
+{
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		if (error) {
+			*error = "cannot open " + filename + " for writing";
+		}
+		return false;
+	}
+	std::string header = Header(format);
+	out.write(header.data(), header.size());
+
+	// Binary rows have a fixed size, so chunks are formatted in place in the batch. ASCII rows
+	// do not; each chunk gets a worst-case slice and the slices are packed before writing.
+	bool ascii = format == PlyFormat::Ascii;
+	size_t rowBytes = ascii ? m_channels.size() * (MaxAsciiValue + 1) : RowBytes();
+	size_t chunkBytes = (std::max)(rowBytes, size_t(1)) * RowsPerChunk;
+	size_t chunksPerBatch = (std::max)(BatchBytes / chunkBytes, size_t(1));
+	size_t totalChunks = (m_count + RowsPerChunk - 1) / RowsPerChunk;
+	std::vector<uint8_t> batch((std::min)(chunksPerBatch, totalChunks) * chunkBytes);
+	std::vector<size_t> written(chunksPerBatch);
+
+	for (size_t firstChunk = 0; firstChunk < totalChunks; firstChunk += chunksPerBatch) {
+		size_t firstRow = firstChunk * RowsPerChunk;
+		size_t rows = (std::min)(chunksPerBatch * RowsPerChunk, m_count - firstRow);
+		Cpu::ParallelForChunks(rows, RowsPerChunk, [&](size_t begin, size_t end, unsigned) {
+			size_t chunk = begin / RowsPerChunk;
+			uint8_t* start = &batch[chunk * chunkBytes];
+			uint8_t* cursor = start;
+			for (size_t row = firstRow + begin; row < firstRow + end; row++) {
+				for (size_t c = 0; c < m_channels.size(); c++) {
+					const Channel& channel = m_channels[c];
+					const uint8_t* p = channel.data + row * channel.stride;
+					if (ascii) {
+						char* text = StoreAscii(reinterpret_cast<char*>(cursor), p, channel.source, channel.type);
+						*text++ = c + 1 < m_channels.size() ? ' ' : '\n';
+						cursor = reinterpret_cast<uint8_t*>(text);
+					}
+					else {
+						cursor = StoreBinary(cursor, p, channel.source, channel.type);
+					}
+				}
+			}
+			written[chunk] = cursor - start;
+		}, threads);
+
+		size_t chunks = (rows + RowsPerChunk - 1) / RowsPerChunk;
+		size_t bytes = written[0];
+		for (size_t chunk = 1; chunk < chunks; chunk++) {
+			memmove(&batch[bytes], &batch[chunk * chunkBytes], written[chunk]);
+			bytes += written[chunk];
+		}
+		out.write(reinterpret_cast<const char*>(batch.data()), bytes);
+	}
+
+	if (!out) {
+		if (error) {
+			*error = "failed writing " + filename;
+		}
+		return false;
+	}
+	return true;
+}
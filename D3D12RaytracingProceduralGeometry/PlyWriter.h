@@ -0,0 +1,76 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PlyWriter.h
+//
+// Writes per-point channels to a PLY file. A channel is a named property read from caller
+// memory with a stride, so points can be written straight from Vertex_Ply arrays, parallel
+// float arrays or anything else without copying them into a row type first, and any number
+// of extra attributes can be carried along. Rows are formatted by chunk on all cores into a
+// batch buffer that goes to the file in one write, so output runs near disk speed instead of
+// one stream insertion per value.
+//
+//**********************************************************************************************
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PlyFormat {
+	enum Enum {
+		BinaryLittleEndian = 0,
+		Ascii,
+		Count
+	};
+}
+
+// PLY scalar types, in the spec's order. Used both for what a channel is stored as in memory
+// and for what it is written as.
+namespace PlyType {
+	enum Enum {
+		Char = 0,
+		UChar,
+		Short,
+		UShort,
+		Int,
+		UInt,
+		Float,
+		Double,
+		Count
+	};
+}
+
+class PlyWriter
+{
+public:
+	explicit PlyWriter(size_t count) : m_count(count) {}
+
+	// Element i of the channel is the source value at data + i * stride, converted to type.
+	// A stride of 0 repeats one value for every point.
+	void AddChannel(const std::string& name, PlyType::Enum type, const void* data, PlyType::Enum source, size_t stride);
+
+	void AddChannel(const std::string& name, const float* data, size_t stride = sizeof(float)) { AddChannel(name, PlyType::Float, data, PlyType::Float, stride); }
+	void AddChannel(const std::string& name, const uint8_t* data, size_t stride = sizeof(uint8_t)) { AddChannel(name, PlyType::UChar, data, PlyType::UChar, stride); }
+
+	bool Write(const std::string& filename, PlyFormat::Enum format = PlyFormat::BinaryLittleEndian, std::string* error = nullptr, unsigned threads = 0) const;
+
+	// The header Write() puts before the rows.
+	std::string Header(PlyFormat::Enum format) const;
+
+	size_t Count() const { return m_count; }
+	size_t RowBytes() const;        // Of a binary row.
+
+private:
+	struct Channel {
+		std::string name;
+		PlyType::Enum type;
+		PlyType::Enum source;
+		const uint8_t* data;
+		size_t stride;
+	};
+
+	size_t m_count;
+	std::vector<Channel> m_channels;
+};
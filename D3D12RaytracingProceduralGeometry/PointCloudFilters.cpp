@@ -0,0 +1,294 @@
+#include "PointCloudFilters.h"
+#include "PointGrid.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+	const size_t ChunkSize = 1 << 14;
+
+	// Voxel coordinates are packed 21 bits an axis around zero, so a grid spans about two
+	// million voxels each way.
+	const int64_t VoxelBias = 1 << 20;
+
+	uint64_t VoxelKey(const Eigen::Vector3d& position, double inverseSize)
+	{
+		uint64_t key = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			int64_t cell = static_cast<int64_t>(std::floor(position(axis) * inverseSize)) + VoxelBias;
+			cell = (std::min)((std::max)(cell, int64_t(0)), 2 * VoxelBias - 1);
+			key |= static_cast<uint64_t>(cell) << (21 * axis);
+		}
+		return key;
+	}
+}
+
+// Per-voxel sums, one map per worker so accumulation needs no locking. Maps are merged only
+// when the result is taken.
+struct PointCloudFilterPipeline::VoxelAccumulator {
+	struct Sum {
+		Eigen::Vector3d location = Eigen::Vector3d::Zero();
+		Eigen::Vector3d colour = Eigen::Vector3d::Zero();
+		Eigen::Vector3d normal = Eigen::Vector3d::Zero();
+		double curvature = 0.0;
+		uint64_t count = 0;
+
+		void Add(const Sum& other)
+		{
+			location += other.location;
+			colour += other.colour;
+			normal += other.normal;
+			curvature += other.curvature;
+			count += other.count;
+		}
+	};
+	typedef std::unordered_map<uint64_t, Sum> Map;
+
+	double inverseSize;
+	std::vector<Map> workers;
+
+	VoxelAccumulator(double voxelSize, unsigned threads) : inverseSize(1.0 / voxelSize), workers(Cpu::WorkerCount(threads)) {}
+
+	void Add(const std::vector<Vertex_Ply>& points, unsigned threads)
+	{
+		Cpu::ParallelForChunks(points.size(), ChunkSize, [&](size_t begin, size_t end, unsigned workerIndex) {
+			Map& map = workers[workerIndex];
+			for (size_t i = begin; i < end; i++) {
+				const Vertex_Ply& point = points[i];
+				Sum& sum = map[VoxelKey(point.location, inverseSize)];
+				sum.location += point.location;
+				sum.colour += point.colour.cast<double>();
+				sum.normal += point.normal;
+				sum.curvature += point.curvature;
+				sum.count++;
+			}
+		}, threads);
+	}
+
+	// Points in voxel key order, so the output does not depend on how work was split.
+	std::vector<Vertex_Ply> Result(unsigned threads)
+	{
+		Map& merged = workers[0];
+		for (size_t w = 1; w < workers.size(); w++) {
+			for (const auto& entry : workers[w]) {
+				merged[entry.first].Add(entry.second);
+			}
+			Map().swap(workers[w]);
+		}
+		std::vector<std::pair<uint64_t, const Sum*>> voxels;
+		voxels.reserve(merged.size());
+		for (const auto& entry : merged) {
+			voxels.push_back(std::make_pair(entry.first, &entry.second));
+		}
+		std::sort(voxels.begin(), voxels.end(), [](const std::pair<uint64_t, const Sum*>& a, const std::pair<uint64_t, const Sum*>& b) {
+			return a.first < b.first;
+		});
+
+		std::vector<Vertex_Ply> points(voxels.size());
+		Cpu::ParallelFor(voxels.size(), [&](size_t i, unsigned) {
+			const Sum& sum = *voxels[i].second;
+			double inverseCount = 1.0 / static_cast<double>(sum.count);
+			Vertex_Ply& point = points[i];
+			point.location = sum.location * inverseCount;
+			point.colour = (sum.colour * inverseCount).array().round().cast<int>().matrix();
+			double length = sum.normal.norm();
+			point.normal = length > 0.0 ? Eigen::Vector3d(sum.normal / length) : Eigen::Vector3d::Zero();
+			point.curvature = sum.curvature * inverseCount;
+		}, threads, 1024);
+		Map().swap(merged);
+		return points;
+	}
+};
+
+namespace PointCloudFilters {
+
+	std::vector<Vertex_Ply> Compact(const std::vector<Vertex_Ply>& points, const std::vector<uint8_t>& keep, unsigned threads)
+	{
+		size_t chunks = (points.size() + ChunkSize - 1) / ChunkSize;
+		std::vector<size_t> offsets(chunks + 1, 0);
+		Cpu::ParallelForChunks(points.size(), ChunkSize, [&](size_t begin, size_t end, unsigned) {
+			size_t kept = 0;
+			for (size_t i = begin; i < end; i++) {
+				kept += keep[i] ? 1 : 0;
+			}
+			offsets[begin / ChunkSize + 1] = kept;
+		}, threads);
+		for (size_t c = 0; c < chunks; c++) {
+			offsets[c + 1] += offsets[c];
+		}
+
+		std::vector<Vertex_Ply> result(offsets[chunks]);
+		Cpu::ParallelForChunks(points.size(), ChunkSize, [&](size_t begin, size_t end, unsigned) {
+			size_t out = offsets[begin / ChunkSize];
+			for (size_t i = begin; i < end; i++) {
+				if (keep[i]) {
+					result[out++] = points[i];
+				}
+			}
+		}, threads);
+		return result;
+	}
+
+	std::vector<Vertex_Ply> VoxelDownsample(const std::vector<Vertex_Ply>& points, double voxelSize, unsigned threads)
+	{
+		if (voxelSize <= 0.0) {
+			return points;
+		}
+		PointCloudFilterPipeline::VoxelAccumulator voxels(voxelSize, threads);
+		voxels.Add(points, threads);
+		return voxels.Result(threads);
+	}
+
+	std::vector<Vertex_Ply> RemoveRadiusOutliers(const std::vector<Vertex_Ply>& points, double radius, uint32_t minNeighbours, unsigned threads)
+	{
+		PointGrid grid;
+		grid.Build(points, radius, 0.0, threads);
+		std::vector<uint8_t> keep(points.size());
+		const std::vector<uint32_t>& order = grid.Order();
+		Cpu::ParallelFor(points.size(), [&](size_t n, unsigned) {
+			uint32_t i = order[n];
+			uint32_t neighbours = 0;
+			grid.ForEachInRadius(points[i].location, radius, [&](uint32_t index, double) {
+				neighbours += index != i ? 1 : 0;
+			});
+			keep[i] = neighbours >= minNeighbours ? 1 : 0;
+		}, threads, 1024);
+		return Compact(points, keep, threads);
+	}
+
+	std::vector<Vertex_Ply> RemoveStatisticalOutliers(const std::vector<Vertex_Ply>& points, uint32_t k, double stdDevs, unsigned threads)
+	{
+		if (points.size() <= k) {
+			return points;
+		}
+		PointGrid grid;
+		grid.Build(points, 0.0, static_cast<double>(k), threads);
+
+		std::vector<double> meanDistance(points.size());
+		std::vector<std::vector<PointNeighbour>> scratch(Cpu::WorkerCount(threads));
+		const std::vector<uint32_t>& order = grid.Order();
+		Cpu::ParallelFor(points.size(), [&](size_t n, unsigned workerIndex) {
+			uint32_t i = order[n];
+			std::vector<PointNeighbour>& neighbours = scratch[workerIndex];
+			grid.Nearest(points[i].location, k + 1, neighbours);
+			double sum = 0.0;
+			uint32_t counted = 0;
+			for (const PointNeighbour& neighbour : neighbours) {
+				if (neighbour.index != i && counted < k) {
+					sum += std::sqrt(neighbour.distanceSquared);
+					counted++;
+				}
+			}
+			meanDistance[i] = counted > 0 ? sum / counted : 0.0;
+		}, threads, 256);
+
+		double mean = 0.0;
+		for (double d : meanDistance) {
+			mean += d;
+		}
+		mean /= points.size();
+		double variance = 0.0;
+		for (double d : meanDistance) {
+			variance += (d - mean) * (d - mean);
+		}
+		double limit = mean + stdDevs * std::sqrt(variance / (points.size() - 1));
+
+		std::vector<uint8_t> keep(points.size());
+		Cpu::ParallelFor(points.size(), [&](size_t i, unsigned) {
+			keep[i] = meanDistance[i] <= limit ? 1 : 0;
+		}, threads, 4096);
+		return Compact(points, keep, threads);
+	}
+
+	std::vector<Vertex_Ply> ColourRange(const std::vector<Vertex_Ply>& points, const Eigen::Vector3i& colour, double threshold,
+		std::vector<Vertex_Ply>* rejected, unsigned threads)
+	{
+		std::vector<uint8_t> keep(points.size());
+		Cpu::ParallelFor(points.size(), [&](size_t i, unsigned) {
+			Eigen::Vector3i difference = points[i].colour - colour;
+			double distance = difference.cast<double>().cwiseAbs().sum() / 255.0 * 100.0 / 3.0;
+			keep[i] = distance < threshold ? 1 : 0;
+		}, threads, 4096);
+		if (rejected) {
+			std::vector<uint8_t> reject(keep.size());
+			for (size_t i = 0; i < keep.size(); i++) {
+				reject[i] = keep[i] ? 0 : 1;
+			}
+			*rejected = Compact(points, reject, threads);
+		}
+		return Compact(points, keep, threads);
+	}
+}
+
+PointCloudFilterPipeline::PointCloudFilterPipeline(unsigned threads) : m_threads(threads), m_colour(Eigen::Vector3i::Zero())
+{
+}
+
+PointCloudFilterPipeline::~PointCloudFilterPipeline()
+{
+}
+
+void PointCloudFilterPipeline::SetColourRange(const Eigen::Vector3i& colour, double threshold)
+{
+	m_colourRange = true;
+	m_colour = colour;
+	m_colourThreshold = threshold;
+}
+
+void PointCloudFilterPipeline::SetVoxelSize(double voxelSize)
+{
+	m_voxelSize = voxelSize;
+	m_voxels.reset(voxelSize > 0.0 ? new VoxelAccumulator(voxelSize, m_threads) : nullptr);
+}
+
+void PointCloudFilterPipeline::SetRadiusOutliers(double radius, uint32_t minNeighbours)
+{
+	m_outlierRadius = radius;
+	m_outlierNeighbours = minNeighbours;
+}
+
+void PointCloudFilterPipeline::SetStatisticalOutliers(uint32_t k, double stdDevs)
+{
+	m_statisticalK = k;
+	m_statisticalStdDevs = stdDevs;
+}
+
+void PointCloudFilterPipeline::Push(const std::vector<Vertex_Ply>& chunk)
+{
+	m_pointsIn += chunk.size();
+	std::vector<Vertex_Ply> selected;
+	const std::vector<Vertex_Ply>* points = &chunk;
+	if (m_colourRange) {
+		selected = PointCloudFilters::ColourRange(chunk, m_colour, m_colourThreshold, nullptr, m_threads);
+		points = &selected;
+	}
+	if (m_voxels) {
+		m_voxels->Add(*points, m_threads);
+	}
+	else {
+		m_kept.insert(m_kept.end(), points->begin(), points->end());
+	}
+}
+
+// The neighbourhood passes need the whole cloud, so they run here, on what the voxel grid
+// left of it. The pipeline is empty again afterwards.
+std::vector<Vertex_Ply> PointCloudFilterPipeline::Finish()
+{
+	std::vector<Vertex_Ply> points;
+	if (m_voxels) {
+		points = m_voxels->Result(m_threads);
+		m_voxels.reset(new VoxelAccumulator(m_voxelSize, m_threads));
+	}
+	else {
+		points.swap(m_kept);
+	}
+	if (m_outlierRadius > 0.0) {
+		points = PointCloudFilters::RemoveRadiusOutliers(points, m_outlierRadius, m_outlierNeighbours, m_threads);
+	}
+	if (m_statisticalK > 0) {
+		points = PointCloudFilters::RemoveStatisticalOutliers(points, m_statisticalK, m_statisticalStdDevs, m_threads);
+	}
+	m_pointsIn = 0;
+	return points;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PointCloudFilters.h
+//
+// Clean-up passes for scanned point clouds: voxel-grid downsampling, radius and statistical
+// outlier removal, and colour-range selection. Each runs on all cores and returns the points
+// it keeps; none of them write files. PointCloudFilterPipeline chains them over a cloud that
+// arrives in chunks (see PlyFile::readChunks), so a scan far larger than memory can be reduced
+// as it is read: colour ranges are applied per chunk, the voxel grid accumulates across
+// chunks, and the outlier passes run once on the downsampled result.
+//
+//**********************************************************************************************
+
+#include "PlyFile.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace PointCloudFilters {
+
+	// Replaces the points in each occupied cell of a voxelSize grid with their mean position,
+	// colour and normal.
+	std::vector<Vertex_Ply> VoxelDownsample(const std::vector<Vertex_Ply>& points, double voxelSize, unsigned threads = 0);
+
+	// Keeps points with at least minNeighbours others within radius.
+	std::vector<Vertex_Ply> RemoveRadiusOutliers(const std::vector<Vertex_Ply>& points, double radius, uint32_t minNeighbours, unsigned threads = 0);
+
+	// Keeps points whose mean distance to their k nearest neighbours is within stdDevs
+	// standard deviations of the cloud's mean.
+	std::vector<Vertex_Ply> RemoveStatisticalOutliers(const std::vector<Vertex_Ply>& points, uint32_t k, double stdDevs, unsigned threads = 0);
+
+	// Keeps points whose colour is within threshold of colour, measured as in
+	// PlyFile::colourThreshold: mean absolute channel difference, in percent. The others go to
+	// rejected if given.
+	std::vector<Vertex_Ply> ColourRange(const std::vector<Vertex_Ply>& points, const Eigen::Vector3i& colour, double threshold,
+		std::vector<Vertex_Ply>* rejected = nullptr, unsigned threads = 0);
+
+	// The points whose keep flag is set, in their original order.
+	std::vector<Vertex_Ply> Compact(const std::vector<Vertex_Ply>& points, const std::vector<uint8_t>& keep, unsigned threads = 0);
+}
+
+// Filters applied to a cloud fed in chunks. Configure, Push() every chunk, then Finish().
+class PointCloudFilterPipeline
+{
+public:
+	explicit PointCloudFilterPipeline(unsigned threads = 0);
+	~PointCloudFilterPipeline();
+
+	// Stages run in the order below whatever order they are set in; each is off until set.
+	void SetColourRange(const Eigen::Vector3i& colour, double threshold);
+	void SetVoxelSize(double voxelSize);
+	void SetRadiusOutliers(double radius, uint32_t minNeighbours);
+	void SetStatisticalOutliers(uint32_t k, double stdDevs);
+
+	void Push(const std::vector<Vertex_Ply>& chunk);
+	std::vector<Vertex_Ply> Finish();
+
+	uint64_t PointsIn() const { return m_pointsIn; }
+
+	// Voxel sums across chunks; also what VoxelDownsample() uses.
+	struct VoxelAccumulator;
+
+private:
+	unsigned m_threads;
+	bool m_colourRange = false;
+	Eigen::Vector3i m_colour;
+	double m_colourThreshold = 0.0;
+	double m_voxelSize = 0.0;
+	double m_outlierRadius = 0.0;
+	uint32_t m_outlierNeighbours = 0;
+	uint32_t m_statisticalK = 0;
+	double m_statisticalStdDevs = 0.0;
+
+	uint64_t m_pointsIn = 0;
+	std::vector<Vertex_Ply> m_kept;                 // Chunks that passed, when not voxelising.
+	std::unique_ptr<VoxelAccumulator> m_voxels;
+};
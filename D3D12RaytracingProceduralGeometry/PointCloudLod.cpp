@@ -0,0 +1,327 @@
+#include "PointCloudLod.h"
+#include "CpuBvh.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    double SecondsSince(const Clock::time_point& start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Spreads the low 21 bits of v out to every third bit.
+    uint64_t SplitBy3(uint32_t v)
+    {
+        uint64_t x = v & 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffffull;
+        x = (x | x << 16) & 0x1f0000ff0000ffull;
+        x = (x | x << 8) & 0x100f00f00f00f00full;
+        x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    // LSD radix sort of (code, index) pairs, 16 bits a pass. Stable, so equal codes keep
+    // their file order.
+    void SortByCode(std::vector<uint64_t>& codes, std::vector<uint32_t>& order)
+    {
+        const uint32_t Radix = 1 << 16;
+        std::vector<uint64_t> codesOut(codes.size());
+        std::vector<uint32_t> orderOut(order.size());
+        std::vector<uint32_t> offsets(Radix);
+        for (uint32_t shift = 0; shift < 3 * PointCloudLod::MortonBits; shift += 16) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (uint64_t code : codes) {
+                offsets[(code >> shift) & (Radix - 1)]++;
+            }
+            uint32_t sum = 0;
+            for (uint32_t& offset : offsets) {
+                uint32_t n = offset;
+                offset = sum;
+                sum += n;
+            }
+            for (size_t i = 0; i < codes.size(); i++) {
+                uint32_t slot = offsets[(codes[i] >> shift) & (Radix - 1)]++;
+                codesOut[slot] = codes[i];
+                orderOut[slot] = order[i];
+            }
+            codes.swap(codesOut);
+            order.swap(orderOut);
+        }
+    }
+
+    float Distance(const float* a, const float* b)
+    {
+        float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    Cpu::Aabb InstanceBounds(const PointCloudLodInstance& instance, float pointSize)
+    {
+        Cpu::float3 centre(instance.position[0], instance.position[1], instance.position[2]);
+        Cpu::float3 half(0.5f * pointSize * instance.scale);
+        return Cpu::Aabb(centre - half, centre + half);
+    }
+}
+
+uint64_t PointCloudLod::MortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return SplitBy3(x) | SplitBy3(y) << 1 | SplitBy3(z) << 2;
+}
+
+void PointCloudLod::Build(const float* positions, size_t count, const PointCloudLodSettings& settings, unsigned threads)
+{
+    m_settings = settings;
+    m_settings.leafPoints = (std::max)(m_settings.leafPoints, 1u);
+    m_nodes.clear();
+    m_selected.clear();
+    m_order.resize(count);
+    m_positions.resize(3 * count);
+    if (count == 0) {
+        return;
+    }
+
+    // Quantise over the bounding cube, so cells are cubes at every level.
+    float lower[3] = { positions[0], positions[1], positions[2] };
+    float extent = 0.0f;
+    {
+        float upper[3] = { lower[0], lower[1], lower[2] };
+        for (size_t i = 0; i < count; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                lower[axis] = (std::min)(lower[axis], positions[3 * i + axis]);
+                upper[axis] = (std::max)(upper[axis], positions[3 * i + axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            extent = (std::max)(extent, upper[axis] - lower[axis]);
+        }
+    }
+    const float cells = static_cast<float>((1u << MortonBits) - 1);
+    const float quantise = extent > 0.0f ? cells / extent : 0.0f;
+
+    std::vector<uint64_t> codes(count);
+    Cpu::ParallelFor(count, [&](size_t i, unsigned) {
+        uint32_t q[3];
+        for (int axis = 0; axis < 3; axis++) {
+            q[axis] = static_cast<uint32_t>((std::min)(cells, (positions[3 * i + axis] - lower[axis]) * quantise));
+        }
+        codes[i] = MortonCode(q[0], q[1], q[2]);
+        m_order[i] = static_cast<uint32_t>(i);
+    }, threads, 4096);
+    SortByCode(codes, m_order);
+    Cpu::ParallelFor(count, [&](size_t i, unsigned) {
+        for (int axis = 0; axis < 3; axis++) {
+            m_positions[3 * i + axis] = positions[3 * static_cast<size_t>(m_order[i]) + axis];
+        }
+    }, threads, 4096);
+
+    // Breadth first, so each node's children are appended together. A cell's children split
+    // its run of codes by the next three bits.
+    std::vector<uint32_t> depths;
+    PointCloudLodNode root = { { 0.0f, 0.0f, 0.0f }, extent, 0, static_cast<uint32_t>(count), 0, 0 };
+    m_nodes.push_back(root);
+    depths.push_back(0);
+    for (size_t n = 0; n < m_nodes.size(); n++) {
+        PointCloudLodNode node = m_nodes[n];
+        uint32_t depth = depths[n];
+        if (node.pointCount <= m_settings.leafPoints || depth == MortonBits) {
+            continue;
+        }
+        uint32_t shift = 3 * (MortonBits - 1 - depth);
+        auto begin = codes.begin() + node.firstPoint;
+        auto end = begin + node.pointCount;
+        m_nodes[n].firstChild = static_cast<uint32_t>(m_nodes.size());
+        for (uint64_t octant = 0; octant < 8 && begin != end; octant++) {
+            auto split = std::partition_point(begin, end, [&](uint64_t code) { return ((code >> shift) & 7) <= octant; });
+            if (split != begin) {
+                PointCloudLodNode child = { { 0.0f, 0.0f, 0.0f }, node.size * 0.5f,
+                    static_cast<uint32_t>(begin - codes.begin()), static_cast<uint32_t>(split - begin), 0, 0 };
+                m_nodes.push_back(child);
+                depths.push_back(depth + 1);
+                m_nodes[n].childCount++;
+            }
+            begin = split;
+        }
+    }
+
+    // Means bottom up: leaves from their points, parents from their children.
+    for (size_t n = m_nodes.size(); n-- > 0;) {
+        PointCloudLodNode& node = m_nodes[n];
+        double sum[3] = { 0.0, 0.0, 0.0 };
+        if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < node.firstPoint + node.pointCount; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    sum[axis] += m_positions[3 * static_cast<size_t>(i) + axis];
+                }
+            }
+        }
+        else {
+            for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    sum[axis] += static_cast<double>(m_nodes[c].centre[axis]) * m_nodes[c].pointCount;
+                }
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            node.centre[axis] = static_cast<float>(sum[axis] / node.pointCount);
+        }
+    }
+}
+
+bool PointCloudLod::Select(const PointCloudView& view, std::vector<PointCloudLodInstance>& instances)
+{
+    // High bit marks a leaf whose points were emitted one by one.
+    const uint32_t ExpandedLeaf = 0x80000000u;
+
+    std::vector<uint32_t> selected;
+    selected.reserve(m_selected.size());
+    instances.clear();
+    m_stack.clear();
+    if (!m_nodes.empty()) {
+        m_stack.push_back(0);
+    }
+    while (!m_stack.empty()) {
+        uint32_t n = m_stack.back();
+        m_stack.pop_back();
+        const PointCloudLodNode& node = m_nodes[n];
+
+        if (node.pointCount == 1) {
+            const float* p = SortedPosition(node.firstPoint);
+            PointCloudLodInstance instance = { { p[0], p[1], p[2] }, 1.0f };
+            instances.push_back(instance);
+            selected.push_back(n);
+            continue;
+        }
+
+        // The mean can sit anywhere in the cell, so allow a whole diagonal around it.
+        float distance = Distance(node.centre, view.position) - 1.7320508f * node.size;
+        bool small = distance > 0.0f && node.size * view.pixelsPerRadian <= view.pixelThreshold * distance;
+        if (small) {
+            float scale = (std::max)(1.0f, node.size / m_settings.pointSize);
+            PointCloudLodInstance instance = { { node.centre[0], node.centre[1], node.centre[2] }, scale };
+            instances.push_back(instance);
+            selected.push_back(n);
+        }
+        else if (node.childCount == 0) {
+            for (uint32_t i = node.firstPoint; i < node.firstPoint + node.pointCount; i++) {
+                const float* p = SortedPosition(i);
+                PointCloudLodInstance instance = { { p[0], p[1], p[2] }, 1.0f };
+                instances.push_back(instance);
+            }
+            selected.push_back(n | ExpandedLeaf);
+        }
+        else {
+            // Reversed, so children come off the stack in Morton order.
+            for (uint32_t c = node.firstChild + node.childCount; c-- > node.firstChild;) {
+                m_stack.push_back(c);
+            }
+        }
+    }
+
+    bool changed = selected != m_selected;
+    m_selected.swap(selected);
+    return changed;
+}
+
+size_t PointCloudLod::Bytes() const
+{
+    return m_order.capacity() * sizeof(uint32_t) + m_positions.capacity() * sizeof(float) +
+        m_nodes.capacity() * sizeof(PointCloudLodNode);
+}
+
+PointCloudLodBenchmarkResult BenchmarkPointCloudLod(const float* positions, size_t count, const PointCloudLodSettings& settings,
+    float pixelsPerRadian, float pixelThreshold, uint32_t viewsPerDistance, unsigned threads)
+{
+    PointCloudLodBenchmarkResult result = {};
+    result.points = count;
+    if (count == 0) {
+        return result;
+    }
+
+    // Before: one instance per point, in file order.
+    std::vector<PointCloudLodInstance> instances(count);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        PointCloudLodInstance instance = { { positions[3 * i], positions[3 * i + 1], positions[3 * i + 2] }, 1.0f };
+        instances[i] = instance;
+    }
+    result.fileOrderSeconds = SecondsSince(start);
+
+    std::vector<Cpu::Aabb> bounds(count);
+    for (size_t i = 0; i < count; i++) {
+        bounds[i] = InstanceBounds(instances[i], settings.pointSize);
+    }
+    {
+        Cpu::Bvh bvh;
+        start = Clock::now();
+        bvh.Build(bounds);
+        result.fileOrderBvhSeconds = SecondsSince(start);
+    }
+    double sum = 0.0;
+    for (size_t i = 1; i < count; i++) {
+        sum += Distance(&positions[3 * (i - 1)], &positions[3 * i]);
+    }
+    result.fileOrderNeighbourDistance = count > 1 ? sum / (count - 1) : 0.0;
+
+    // After: Morton order and LOD selection.
+    PointCloudLod lod;
+    start = Clock::now();
+    lod.Build(positions, count, settings, threads);
+    result.lodBuildSeconds = SecondsSince(start);
+    result.lodBytes = lod.Bytes();
+    sum = 0.0;
+    for (size_t i = 1; i < count; i++) {
+        sum += Distance(lod.SortedPosition(i - 1), lod.SortedPosition(i));
+    }
+    result.mortonNeighbourDistance = count > 1 ? sum / (count - 1) : 0.0;
+
+    const PointCloudLodNode& root = lod.Nodes()[0];
+    float radius = 0.866f * root.size;
+    const float distances[] = { 1.0f, 2.0f, 4.0f };
+    for (float d : distances) {
+        for (uint32_t v = 0; v < viewsPerDistance; v++) {
+            float angle = 6.2831853f * v / viewsPerDistance;
+            PointCloudView view = { { root.centre[0] + d * radius * std::cos(angle), root.centre[1], root.centre[2] + d * radius * std::sin(angle) },
+                pixelsPerRadian, pixelThreshold };
+            start = Clock::now();
+            lod.Select(view, instances);
+            result.selectSeconds += SecondsSince(start);
+            result.selectedInstances += static_cast<double>(instances.size());
+
+            bounds.resize(instances.size());
+            for (size_t i = 0; i < instances.size(); i++) {
+                bounds[i] = InstanceBounds(instances[i], settings.pointSize);
+            }
+            Cpu::Bvh bvh;
+            start = Clock::now();
+            bvh.Build(bounds);
+            result.selectedBvhSeconds += SecondsSince(start);
+            result.views++;
+        }
+    }
+    if (result.views > 0) {
+        result.selectSeconds /= result.views;
+        result.selectedInstances /= result.views;
+        result.selectedBvhSeconds /= result.views;
+    }
+    return result;
+}
+
+std::string PointCloudLodBenchmarkSummary(const PointCloudLodBenchmarkResult& result)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "file order: " << result.points << " instances, " << 1000.0 * result.fileOrderSeconds << " ms + BVH "
+        << 1000.0 * result.fileOrderBvhSeconds << " ms, neighbour distance " << result.fileOrderNeighbourDistance
+        << " | LOD: build " << 1000.0 * result.lodBuildSeconds << " ms, " << result.lodBytes / (1024.0 * 1024.0) << " MB"
+        << ", " << std::setprecision(0) << result.selectedInstances << std::setprecision(3) << " instances, select "
+        << 1000.0 * result.selectSeconds << " ms + BVH " << 1000.0 * result.selectedBvhSeconds << " ms, neighbour distance "
+        << result.mortonNeighbourDistance << " (mean of " << result.views << " views)";
+    return out.str();
+}
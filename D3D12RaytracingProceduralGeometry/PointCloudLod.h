@@ -0,0 +1,97 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PointCloudLod.h
+//
+// Level of detail for point-instanced scenes. Points are sorted by Morton code, which makes
+// every octree cell a contiguous run of them, and the octree is built over the sorted runs.
+// Each cell carries a representative: one instance at the mean of its points, sized to the
+// cell. Select() walks the tree from a view point and stops at cells that would cover fewer
+// than the given number of pixels, so distant parts of the cloud collapse into a handful of
+// instances while close ones keep one per point. Output follows Morton order, so instances
+// that are close in the list are close in space.
+//
+//**********************************************************************************************
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PointCloudLodSettings {
+    float pointSize = 1.0f;         // World size of the instance placed on one point.
+    uint32_t leafPoints = 1;        // Cells with at most this many points are not split.
+};
+
+struct PointCloudView {
+    float position[3];
+    float pixelsPerRadian;          // Viewport height / (2 tan(fovY / 2)).
+    float pixelThreshold;           // Cells smaller than this on screen become one instance.
+};
+
+struct PointCloudLodNode {
+    float centre[3];                // Mean of the cell's points; where its representative goes.
+    float size;                     // Edge of the octree cell.
+    uint32_t firstPoint;            // Run of points in Morton order.
+    uint32_t pointCount;
+    uint32_t firstChild;            // Children are contiguous; childCount is 0 for leaves.
+    uint32_t childCount;
+};
+
+struct PointCloudLodInstance {
+    float position[3];
+    float scale;                    // Relative to a single point's instance.
+};
+
+class PointCloudLod
+{
+public:
+    // Bits of each axis in a Morton code, and so the deepest the octree can go.
+    static const uint32_t MortonBits = 21;
+
+    // positions holds count xyz triples.
+    void Build(const float* positions, size_t count, const PointCloudLodSettings& settings = PointCloudLodSettings(), unsigned threads = 0);
+
+    // Replaces instances with the selection for view; returns false if it is the same as the
+    // one the previous call made, so callers can skip rebuilding their instance descs.
+    bool Select(const PointCloudView& view, std::vector<PointCloudLodInstance>& instances);
+
+    size_t PointCount() const { return m_order.size(); }
+    // Index of the i-th point, in Morton order, in the array passed to Build().
+    uint32_t SourceIndex(size_t i) const { return m_order[i]; }
+    const float* SortedPosition(size_t i) const { return &m_positions[3 * i]; }
+    const std::vector<PointCloudLodNode>& Nodes() const { return m_nodes; }
+    size_t Bytes() const;
+
+    static uint64_t MortonCode(uint32_t x, uint32_t y, uint32_t z);
+
+private:
+    PointCloudLodSettings m_settings;
+    std::vector<uint32_t> m_order;
+    std::vector<float> m_positions;
+    std::vector<PointCloudLodNode> m_nodes;
+    std::vector<uint32_t> m_selected;      // Nodes picked by the last Select(), to detect changes.
+    std::vector<uint32_t> m_stack;
+};
+
+struct PointCloudLodBenchmarkResult {
+    size_t points;
+    size_t views;
+    double fileOrderSeconds;            // Instance list straight from the file, as before.
+    double fileOrderBvhSeconds;         // CPU BVH over those instances, standing in for the TLAS build.
+    double fileOrderNeighbourDistance;  // Mean distance between consecutive instances.
+    double lodBuildSeconds;             // Morton sort and octree, once per cloud.
+    double selectSeconds;               // Mean per view.
+    double selectedInstances;           // Mean per view.
+    double selectedBvhSeconds;          // Mean per view.
+    double mortonNeighbourDistance;
+    size_t lodBytes;
+};
+
+// Compares one instance per point in file order against Morton-ordered LOD selection, from
+// views orbiting the cloud at 1, 2 and 4 times its radius. Load a scan such as
+// Main_Room_Dense_Filtered_100_thousand.ply with PlyFile and pass its scaled positions.
+PointCloudLodBenchmarkResult BenchmarkPointCloudLod(const float* positions, size_t count, const PointCloudLodSettings& settings,
+    float pixelsPerRadian = 1000.0f, float pixelThreshold = 4.0f, uint32_t viewsPerDistance = 8, unsigned threads = 0);
+std::string PointCloudLodBenchmarkSummary(const PointCloudLodBenchmarkResult& result);
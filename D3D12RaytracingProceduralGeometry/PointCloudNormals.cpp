@@ -0,0 +1,130 @@
+#include "PointCloudNormals.h"
+#include "PointGrid.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+	struct Edge {
+		float weight;
+		uint32_t from;
+		uint32_t to;
+
+		bool operator<(const Edge& other) const { return weight > other.weight; }
+	};
+
+	// Prim's algorithm over the neighbour graph, weighted 1 - |ni . nj| so that the tree
+	// follows the flattest path and only flips normals across gentle turns.
+	void Propagate(std::vector<Vertex_Ply>& points, const std::vector<uint32_t>& graph, uint32_t edges)
+	{
+		Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+		for (const Vertex_Ply& point : points) {
+			centroid += point.location;
+		}
+		centroid /= static_cast<double>(points.size());
+
+		std::vector<uint8_t> visited(points.size(), 0);
+		std::priority_queue<Edge> frontier;
+		auto visit = [&](uint32_t index) {
+			visited[index] = 1;
+			const uint32_t* neighbours = &graph[static_cast<size_t>(index) * edges];
+			for (uint32_t e = 0; e < edges && neighbours[e] != UINT32_MAX; e++) {
+				if (!visited[neighbours[e]]) {
+					float agreement = static_cast<float>(std::abs(points[index].normal.dot(points[neighbours[e]].normal)));
+					Edge edge = { 1.0f - agreement, index, neighbours[e] };
+					frontier.push(edge);
+				}
+			}
+		};
+
+		for (uint32_t seed = 0; seed < points.size(); seed++) {
+			if (visited[seed]) {
+				continue;
+			}
+			Vertex_Ply& root = points[seed];
+			if (root.normal.dot(root.location - centroid) < 0.0) {
+				root.normal = -root.normal;
+			}
+			visit(seed);
+			while (!frontier.empty()) {
+				Edge edge = frontier.top();
+				frontier.pop();
+				if (visited[edge.to]) {
+					continue;
+				}
+				Vertex_Ply& point = points[edge.to];
+				if (point.normal.dot(points[edge.from].normal) < 0.0) {
+					point.normal = -point.normal;
+				}
+				visit(edge.to);
+			}
+		}
+	}
+}
+
+namespace PointCloudNormals {
+
+	void Estimate(std::vector<Vertex_Ply>& points, const PointCloudNormalSettings& settings, unsigned threads)
+	{
+		if (points.empty()) {
+			return;
+		}
+		uint32_t k = (std::max)(settings.neighbours, 3u);
+		bool propagate = settings.orientation == NormalOrientation::Propagate;
+		uint32_t edges = propagate ? (std::min)(settings.orientationNeighbours, k) : 0;
+
+		PointGrid grid;
+		grid.Build(points, 0.0, static_cast<double>(k), threads);
+
+		// The nearest few neighbours of each point are kept for propagation; UINT32_MAX marks
+		// the end of a short list.
+		std::vector<uint32_t> graph(static_cast<size_t>(edges) * points.size(), UINT32_MAX);
+		std::vector<std::vector<PointNeighbour>> scratch(Cpu::WorkerCount(threads));
+		const std::vector<uint32_t>& order = grid.Order();
+		Cpu::ParallelFor(points.size(), [&](size_t n, unsigned workerIndex) {
+			uint32_t i = order[n];
+			std::vector<PointNeighbour>& neighbours = scratch[workerIndex];
+			grid.Nearest(points[i].location, k + 1, neighbours);
+			Vertex_Ply& point = points[i];
+			if (neighbours.size() < 3) {
+				point.normal.setZero();
+				point.curvature = 0.0;
+				return;
+			}
+
+			// Covariance about the neighbourhood mean, accumulated relative to the point itself
+			// to keep precision on scans far from the origin.
+			Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+			Eigen::Matrix3d products = Eigen::Matrix3d::Zero();
+			uint32_t* edge = edges > 0 ? &graph[static_cast<size_t>(i) * edges] : nullptr;
+			uint32_t edgeCount = 0;
+			for (const PointNeighbour& neighbour : neighbours) {
+				Eigen::Vector3d offset = points[neighbour.index].location - point.location;
+				sum += offset;
+				products += offset * offset.transpose();
+				if (neighbour.index != i && edgeCount < edges) {
+					edge[edgeCount++] = neighbour.index;
+				}
+			}
+			double count = static_cast<double>(neighbours.size());
+			Eigen::Vector3d mean = sum / count;
+			Eigen::Matrix3d covariance = products / count - mean * mean.transpose();
+
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+			solver.computeDirect(covariance);
+			Eigen::Vector3d eigenvalues = solver.eigenvalues().cwiseMax(0.0);
+			double total = eigenvalues.sum();
+			point.normal = solver.eigenvectors().col(0).normalized();
+			point.curvature = total > 0.0 ? eigenvalues(0) / total : 0.0;
+
+			if (settings.orientation == NormalOrientation::Viewpoint && point.normal.dot(settings.viewpoint - point.location) < 0.0) {
+				point.normal = -point.normal;
+			}
+		}, threads, 256);
+
+		if (propagate) {
+			Propagate(points, graph, edges);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PointCloudNormals.h
+//
+// Normals and curvature for scans that come without them. Each point's normal is the least
+// principal axis of its k nearest neighbours, and its curvature is the surface variation
+// lambda0 / (lambda0 + lambda1 + lambda2) of the same neighbourhood: 0 on a plane, up to 1/3
+// for isotropic noise. PCA leaves the sign of a normal arbitrary, so a second pass orients
+// them, either towards the scanner or by propagating along a minimum spanning tree of the
+// neighbour graph so that neighbours on a smooth surface agree.
+//
+//**********************************************************************************************
+
+#include "PlyFile.h"
+#include <cstdint>
+#include <vector>
+
+namespace NormalOrientation {
+	enum Enum {
+		None = 0,       // Leave the signs PCA produced.
+		Viewpoint,      // Face the viewpoint, as a scanner at one position saw them.
+		Propagate,      // Agree with neighbours; each connected piece faces away from the centroid.
+		Count
+	};
+}
+
+struct PointCloudNormalSettings {
+	uint32_t neighbours = 16;           // k of the PCA neighbourhood.
+	NormalOrientation::Enum orientation = NormalOrientation::Propagate;
+	Eigen::Vector3d viewpoint = Eigen::Vector3d::Zero();
+	uint32_t orientationNeighbours = 6; // Edges per point in the propagation graph.
+};
+
+namespace PointCloudNormals {
+
+	// Fills normal and curvature of every point. Points with fewer than three neighbours get a
+	// zero normal and zero curvature.
+	void Estimate(std::vector<Vertex_Ply>& points, const PointCloudNormalSettings& settings = PointCloudNormalSettings(), unsigned threads = 0);
+}
@@ -0,0 +1,177 @@
+#include "PointGrid.h"
+#include "CpuParallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	const int32_t MaxCellsPerAxis = 1 << 21;
+}
+
+void PointGrid::Build(const std::vector<Vertex_Ply>& points, double cellSize, double pointsPerCell, unsigned threads)
+{
+	m_cellKeys.clear();
+	m_cellFirst.clear();
+	m_sorted.clear();
+	m_positions.clear();
+	m_origin = Eigen::Vector3d::Zero();
+	if (points.empty()) {
+		return;
+	}
+
+	Eigen::Vector3d lower = points[0].location;
+	Eigen::Vector3d upper = lower;
+	for (const Vertex_Ply& point : points) {
+		lower = lower.cwiseMin(point.location);
+		upper = upper.cwiseMax(point.location);
+	}
+	Eigen::Vector3d extent = upper - lower;
+
+	// Without a size, assume a scan of surfaces about as large as the biggest face of the
+	// bounding box, and size cells to hold pointsPerCell points of it. Points along a line
+	// have no such face, so they are spread over its length instead.
+	double largest = extent.maxCoeff();
+	if (cellSize <= 0.0) {
+		double area = (std::max)({ extent.x() * extent.y(), extent.y() * extent.z(), extent.z() * extent.x() });
+		cellSize = area > 1e-6 * largest * largest ? std::sqrt(area * pointsPerCell / points.size()) : largest * pointsPerCell / points.size();
+	}
+	// Keys pack 21 bits per axis, so very fine grids over large clouds are coarsened.
+	cellSize = (std::max)(cellSize, largest / (MaxCellsPerAxis - 1));
+	if (cellSize <= 0.0) {
+		cellSize = 1.0;
+	}
+	m_cellSize = cellSize;
+	m_origin = lower;
+	for (int axis = 0; axis < 3; axis++) {
+		m_cellCount[axis] = static_cast<int32_t>(extent(axis) / cellSize) + 1;
+	}
+
+	std::vector<std::pair<uint64_t, uint32_t>> keyed(points.size());
+	Cpu::ParallelFor(points.size(), [&](size_t i, unsigned) {
+		int32_t cell[3];
+		Cell(points[i].location, cell);
+		keyed[i] = std::make_pair(Key(cell[0], cell[1], cell[2]), static_cast<uint32_t>(i));
+	}, threads, 4096);
+	std::sort(keyed.begin(), keyed.end());
+
+	m_sorted.resize(points.size());
+	m_positions.resize(points.size());
+	Cpu::ParallelFor(points.size(), [&](size_t i, unsigned) {
+		m_sorted[i] = keyed[i].second;
+		m_positions[i] = points[keyed[i].second].location;
+	}, threads, 4096);
+	for (size_t i = 0; i < keyed.size(); i++) {
+		if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+			m_cellKeys.push_back(keyed[i].first);
+			m_cellFirst.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	m_cellFirst.push_back(static_cast<uint32_t>(keyed.size()));
+}
+
+void PointGrid::Nearest(const Eigen::Vector3d& position, uint32_t k, std::vector<PointNeighbour>& neighbours) const
+{
+	neighbours.clear();
+	if (m_sorted.empty() || k == 0) {
+		return;
+	}
+	k = (std::min)(k, static_cast<uint32_t>(m_sorted.size()));
+	auto farther = [](const PointNeighbour& a, const PointNeighbour& b) { return a.distanceSquared < b.distanceSquared; };
+
+	auto consider = [&](uint32_t first, uint32_t end) {
+		for (uint32_t i = first; i < end; i++) {
+			PointNeighbour candidate = { m_sorted[i], (m_positions[i] - position).squaredNorm() };
+			if (neighbours.size() < k) {
+				neighbours.push_back(candidate);
+				std::push_heap(neighbours.begin(), neighbours.end(), farther);
+			}
+			else if (candidate.distanceSquared < neighbours.front().distanceSquared) {
+				std::pop_heap(neighbours.begin(), neighbours.end(), farther);
+				neighbours.back() = candidate;
+				std::push_heap(neighbours.begin(), neighbours.end(), farther);
+			}
+		}
+	};
+
+	// Cells are visited in shells of growing Chebyshev distance from the query's cell, a row
+	// at a time, skipping rows outside the grid. Anything outside the cube searched so far is
+	// at least as far as its nearest face, so once k points are that close we stop.
+	int32_t centre[3];
+	Cell(position, centre);
+	int32_t maxRing = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		maxRing = (std::max)({ maxRing, centre[axis] + 1, m_cellCount[axis] - centre[axis] });
+	}
+	for (int32_t ring = 0; ring <= maxRing; ring++) {
+		int32_t dzEnd = (std::min)(ring, m_cellCount[2] - 1 - centre[2]);
+		int32_t dyEnd = (std::min)(ring, m_cellCount[1] - 1 - centre[1]);
+		for (int32_t dz = (std::max)(-ring, -centre[2]); dz <= dzEnd; dz++) {
+			for (int32_t dy = (std::max)(-ring, -centre[1]); dy <= dyEnd; dy++) {
+				uint32_t first, end;
+				int32_t y = centre[1] + dy, z = centre[2] + dz;
+				if (dz == -ring || dz == ring || dy == -ring || dy == ring) {
+					if (Row(centre[0] - ring, centre[0] + ring, y, z, first, end)) {
+						consider(first, end);
+					}
+					continue;
+				}
+				if (Row(centre[0] - ring, centre[0] - ring, y, z, first, end)) {
+					consider(first, end);
+				}
+				if (Row(centre[0] + ring, centre[0] + ring, y, z, first, end)) {
+					consider(first, end);
+				}
+			}
+		}
+		if (neighbours.size() == k) {
+			double reach = std::numeric_limits<double>::max();
+			for (int axis = 0; axis < 3; axis++) {
+				double low = m_origin(axis) + (centre[axis] - ring) * m_cellSize;
+				double high = m_origin(axis) + (centre[axis] + ring + 1) * m_cellSize;
+				reach = (std::min)({ reach, position(axis) - low, high - position(axis) });
+			}
+			if (neighbours.front().distanceSquared <= reach * reach) {
+				break;
+			}
+		}
+	}
+	std::sort_heap(neighbours.begin(), neighbours.end(), farther);
+}
+
+size_t PointGrid::Bytes() const
+{
+	return m_cellKeys.capacity() * sizeof(uint64_t) + (m_cellFirst.capacity() + m_sorted.capacity()) * sizeof(uint32_t) +
+		m_positions.capacity() * sizeof(Eigen::Vector3d);
+}
+
+bool PointGrid::Cell(const Eigen::Vector3d& position, int32_t cell[3]) const
+{
+	bool inside = true;
+	for (int axis = 0; axis < 3; axis++) {
+		cell[axis] = static_cast<int32_t>(std::floor((position(axis) - m_origin(axis)) / m_cellSize));
+		inside = inside && cell[axis] >= 0 && cell[axis] < m_cellCount[axis];
+	}
+	return inside;
+}
+
+uint64_t PointGrid::Key(int32_t x, int32_t y, int32_t z) const
+{
+	return static_cast<uint64_t>(x) | static_cast<uint64_t>(y) << 21 | static_cast<uint64_t>(z) << 42;
+}
+
+bool PointGrid::Row(int32_t x0, int32_t x1, int32_t y, int32_t z, uint32_t& first, uint32_t& end) const
+{
+	if (y < 0 || z < 0 || y >= m_cellCount[1] || z >= m_cellCount[2]) {
+		return false;
+	}
+	x0 = (std::max)(x0, 0);
+	x1 = (std::min)(x1, m_cellCount[0] - 1);
+	if (x0 > x1) {
+		return false;
+	}
+	auto begin = std::lower_bound(m_cellKeys.begin(), m_cellKeys.end(), Key(x0, y, z));
+	auto last = std::upper_bound(begin, m_cellKeys.end(), Key(x1, y, z));
+	first = m_cellFirst[begin - m_cellKeys.begin()];
+	end = m_cellFirst[last - m_cellKeys.begin()];
+	return first < end;
+}
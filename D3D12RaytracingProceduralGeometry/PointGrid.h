@@ -0,0 +1,88 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// PointGrid.h
+//
+// Uniform grid over a point cloud for neighbourhood queries. Points are bucketed by cell and
+// stored sorted by cell key, so a cell is one contiguous run and a query touches a few runs
+// instead of the whole cloud. Only occupied cells are stored, which keeps sparse scans of
+// large rooms small. Queries are const and can run from any number of threads.
+//
+//**********************************************************************************************
+
+#include "PlyFile.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct PointNeighbour {
+	uint32_t index;         // Into the points passed to Build().
+	double distanceSquared;
+};
+
+class PointGrid
+{
+public:
+	// cellSize of 0 picks one that puts about pointsPerCell points in each occupied cell.
+	void Build(const std::vector<Vertex_Ply>& points, double cellSize = 0.0, double pointsPerCell = 8.0, unsigned threads = 0);
+
+	// Calls fn(index, distanceSquared) for every point within radius of position.
+	template<typename Fn>
+	void ForEachInRadius(const Eigen::Vector3d& position, double radius, Fn fn) const;
+
+	// The k points closest to position, nearest first. A point at position itself is included,
+	// so pass k + 1 and skip the first to get a point's neighbours.
+	void Nearest(const Eigen::Vector3d& position, uint32_t k, std::vector<PointNeighbour>& neighbours) const;
+
+	// Point indices in cell order. Running per-point queries in this order keeps consecutive
+	// ones in the same cells, which is about twice as fast as input order on shuffled scans.
+	const std::vector<uint32_t>& Order() const { return m_sorted; }
+
+	double CellSize() const { return m_cellSize; }
+	size_t CellCount() const { return m_cellKeys.size(); }
+	size_t Bytes() const;
+
+private:
+	double m_cellSize = 1.0;
+	Eigen::Vector3d m_origin;
+	int32_t m_cellCount[3];
+	std::vector<uint64_t> m_cellKeys;       // Sorted, one per occupied cell.
+	std::vector<uint32_t> m_cellFirst;      // Run of each cell in m_sorted, plus an end marker.
+	std::vector<uint32_t> m_sorted;         // Point indices in cell order.
+	std::vector<Eigen::Vector3d> m_positions;   // Positions in the same order, for locality.
+
+	bool Cell(const Eigen::Vector3d& position, int32_t cell[3]) const;
+	uint64_t Key(int32_t x, int32_t y, int32_t z) const;
+	// Points of cells x0..x1 of a row. Keys put x in the low bits, so they are one run in
+	// m_sorted; false if the row is outside the grid or the run is empty.
+	bool Row(int32_t x0, int32_t x1, int32_t y, int32_t z, uint32_t& first, uint32_t& end) const;
+};
+
+template<typename Fn>
+void PointGrid::ForEachInRadius(const Eigen::Vector3d& position, double radius, Fn fn) const
+{
+	if (m_sorted.empty()) {
+		return;
+	}
+	int32_t lower[3], upper[3];
+	for (int axis = 0; axis < 3; axis++) {
+		lower[axis] = static_cast<int32_t>(std::floor((position(axis) - radius - m_origin(axis)) / m_cellSize));
+		upper[axis] = static_cast<int32_t>(std::floor((position(axis) + radius - m_origin(axis)) / m_cellSize));
+	}
+	double radiusSquared = radius * radius;
+	for (int32_t z = lower[2]; z <= upper[2]; z++) {
+		for (int32_t y = lower[1]; y <= upper[1]; y++) {
+			uint32_t first, end;
+			if (!Row(lower[0], upper[0], y, z, first, end)) {
+				continue;
+			}
+			for (uint32_t i = first; i < end; i++) {
+				double d = (m_positions[i] - position).squaredNorm();
+				if (d <= radiusSquared) {
+					fn(m_sorted[i], d);
+				}
+			}
+		}
+	}
+}
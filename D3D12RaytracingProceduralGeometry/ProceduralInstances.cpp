@@ -0,0 +1,86 @@
+#include "ProceduralInstances.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void ProceduralInstanceTable::Reset(uint32_t slotCount)
+{
+    m_instances.clear();
+    m_aabbs.clear();
+    m_animated.clear();
+    m_slotFirst.assign(slotCount + 1, 0);
+}
+
+void ProceduralInstanceTable::Add(const ProceduralInstance& instance)
+{
+    m_instances.push_back(instance);
+}
+
+bool ProceduralInstanceTable::IsPlaceholder(uint32_t index) const
+{
+    // DXR skips AABBs whose MinX is NaN.
+    return std::isnan(m_aabbs[index].min[0]);
+}
+
+void ProceduralInstanceTable::Build()
+{
+    uint32_t slotCount = SlotCount();
+
+    // Counting sort by slot, with one placeholder in each empty slot.
+    std::vector<uint32_t> counts(slotCount, 0);
+    for (const ProceduralInstance& instance : m_instances) {
+        counts[instance.slot]++;
+    }
+    std::vector<bool> placeholder(slotCount, false);
+    for (uint32_t slot = 0; slot < slotCount; slot++) {
+        placeholder[slot] = counts[slot] == 0;
+        m_slotFirst[slot + 1] = m_slotFirst[slot] + (std::max)(counts[slot], 1u);
+    }
+
+    std::vector<ProceduralInstance> sorted(m_slotFirst[slotCount]);
+    std::vector<uint32_t> next(m_slotFirst.begin(), m_slotFirst.end() - 1);
+    for (const ProceduralInstance& instance : m_instances) {
+        sorted[next[instance.slot]++] = instance;
+    }
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (uint32_t slot = 0; slot < slotCount; slot++) {
+        if (placeholder[slot]) {
+            sorted[m_slotFirst[slot]] = { slot, 0, 0, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, 0.0f };
+        }
+    }
+    m_instances.swap(sorted);
+
+    m_aabbs.resize(m_instances.size());
+    m_animated.clear();
+    for (uint32_t i = 0; i < Count(); i++) {
+        if (placeholder[m_instances[i].slot]) {
+            m_aabbs[i] = { { nan, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+            continue;
+        }
+        m_aabbs[i] = Bounds(m_instances[i]);
+        if (m_instances[i].spin != 0.0f) {
+            m_animated.push_back(i);
+        }
+    }
+}
+
+size_t ProceduralInstanceTable::Bytes() const
+{
+    return m_instances.capacity() * sizeof(ProceduralInstance) + m_aabbs.capacity() * sizeof(ProceduralAabb) +
+        (m_slotFirst.capacity() + m_animated.capacity()) * sizeof(uint32_t);
+}
+
+ProceduralAabb ProceduralInstanceTable::Bounds(const ProceduralInstance& instance)
+{
+    float extent[3] = { instance.extent[0], instance.extent[1], instance.extent[2] };
+    if (instance.spin != 0.0f) {
+        float radius = std::sqrt(extent[0] * extent[0] + extent[2] * extent[2]);
+        extent[0] = extent[2] = radius;
+    }
+    ProceduralAabb aabb;
+    for (int axis = 0; axis < 3; axis++) {
+        aabb.min[axis] = instance.position[axis] - extent[axis];
+        aabb.max[axis] = instance.position[axis] + extent[axis];
+    }
+    return aabb;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// ProceduralInstances.h
+//
+// The procedural geometry of a scene as a flat table of instances: the primitive slot (which
+// intersection shader and primitive type) each one uses, where it sits, how it is scaled and
+// spun, and its material. Build() orders the table by slot so each AABB geometry desc covers
+// one contiguous run; an intersection shader finds its instance as the run's first index plus
+// PrimitiveIndex(). Build() also generates the AABBs. Memory is one record and one AABB per
+// instance, so a scene can hold as many instances as it likes of any type.
+//
+//**********************************************************************************************
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ProceduralInstance {
+    uint32_t slot;          // In IntersectionShaderType order: analytic, volumetric, sdf, csg.
+    uint32_t material;      // Material table source.
+    uint32_t primitive;     // Scene file primitive that placed it.
+    float position[3];      // Centre, in bottom-level AS space.
+    float extent[3];        // Half size of the AABB when not spinning.
+    float scale[3];
+    float spin;             // Radians about Y per unit of animation time.
+};
+
+// Same layout as D3D12_RAYTRACING_AABB.
+struct ProceduralAabb {
+    float min[3];
+    float max[3];
+};
+
+class ProceduralInstanceTable
+{
+public:
+    void Reset(uint32_t slotCount);
+    void Add(const ProceduralInstance& instance);
+    // Sorts by slot, keeping the order of Add() within a slot, and generates the AABBs. A slot
+    // without instances gets an inactive placeholder, so every geometry desc has an AABB.
+    void Build();
+
+    uint32_t Count() const { return static_cast<uint32_t>(m_instances.size()); }
+    const ProceduralInstance& operator[](uint32_t index) const { return m_instances[index]; }
+    bool IsPlaceholder(uint32_t index) const;
+    void SetMaterial(uint32_t index, uint32_t material) { m_instances[index].material = material; }
+
+    uint32_t SlotCount() const { return static_cast<uint32_t>(m_slotFirst.size()) - 1; }
+    uint32_t SlotFirst(uint32_t slot) const { return m_slotFirst[slot]; }
+    uint32_t SlotInstances(uint32_t slot) const { return m_slotFirst[slot + 1] - m_slotFirst[slot]; }
+
+    const ProceduralAabb* Aabbs() const { return m_aabbs.data(); }
+    // Instances that spin, i.e. whose transform changes with animation time.
+    const std::vector<uint32_t>& Animated() const { return m_animated; }
+    size_t Bytes() const;
+
+    // Animation only rotates about Y, so a spinning instance gets a box around the cylinder
+    // its corners sweep rather than one that has to be rebuilt every frame.
+    static ProceduralAabb Bounds(const ProceduralInstance& instance);
+
+private:
+    std::vector<ProceduralInstance> m_instances;
+    std::vector<ProceduralAabb> m_aabbs;
+    std::vector<uint32_t> m_slotFirst;
+    std::vector<uint32_t> m_animated;
+};
@@ -40,11 +40,12 @@ typedef UINT32 Vertex_Index;
 // PERFORMANCE TIP: Set max recursion depth as low as needed
 // as drivers may apply optimization strategies for low recursion depths.
 #define MAX_RAY_RECURSION_DEPTH 4    // ~ primary rays + reflections + shadow rays from reflected geometry.
-#define PHOTON_COUNT 10000
+#define PHOTON_COUNT 10000           // Default photon budget per frame; the exposure photon power is calibrated to.
 
 struct ProceduralPrimitiveAttributes
 {
     XMFLOAT3 normal;
+    UINT materialIndex;     // Material table id of the procedural instance that was hit.
 };
 
 struct RayPayload
@@ -117,6 +118,7 @@ struct SceneConstantBuffer
     float    reflectance;
     float    elapsedTime;
     // Elapsed application time.
+    float    photonPowerScale;      // PHOTON_COUNT over the photons emitted, so the budget does not change the exposure.
 };
 
 struct ComputeConstantBuffer {
@@ -125,7 +127,8 @@ struct ComputeConstantBuffer {
     XMVECTOR cameraDirection;
     XMMATRIX projectionToWorld;
 };
-// Attributes per primitive type.
+// A material table entry. The table is a structured buffer indexed by material id, so the
+// entries are packed without cbuffer padding; SceneFile::Material has the same layout.
 struct PrimitiveConstantBuffer
 {
     XMFLOAT4 albedo;
@@ -137,7 +140,15 @@ struct PrimitiveConstantBuffer
     float stepScale;                      // Step scale for ray marching of signed distance primitives. 
                                           // - Some object transformations don't preserve the distances and 
                                           //   thus require shorter steps.
-    XMFLOAT3 padding;
+};
+
+// InstanceID of a TLAS instance that keeps the material of the hit group record.
+#define NO_INSTANCE_MATERIAL 0xFFFFFF
+
+// Material of a hit group record, as an index into the material table.
+struct MaterialConstantBuffer
+{
+    UINT materialIndex;
 };
 
 // Attributes per primitive instance.
@@ -152,6 +163,8 @@ struct PrimitiveInstancePerFrameBuffer
 {
     XMMATRIX localSpaceToBottomLevelAS;   // Matrix from local primitive space to bottom-level object space.
     XMMATRIX bottomLevelASToLocalSpace;   // Matrix from bottom-level object space to local primitive space.
+    UINT materialIndex;                   // Material table id.
+    XMFLOAT3 padding;
 };
 
 struct CSGNode {
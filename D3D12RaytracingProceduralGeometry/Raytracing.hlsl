@@ -4,6 +4,8 @@
 
 #define HLSL
 #include "RaytracingHlslCompat.h"
+#include "PackedPhoton.h"
+#include "PackedGBuffer.h"
 #include "ProceduralPrimitivesLibrary.hlsli"
 #include "RaytracingShaderHelper.hlsli"
 
@@ -22,9 +24,8 @@ RWStructuredBuffer<Photon> photonBuffer : register(u2);
 RWByteAddressBuffer photonBufferCounter : register(u3);
 //RWStructuredBuffer<uint> tiledPhotonMap : register(u9);
 
-RWTexture2D<float4> GBufferBRDF : register(u4);
-RWTexture2D<float4> GBufferPosition : register(u5);
-RWTexture2D<float4> GBufferNormal : register(u6);
+// Primary hits for the splatting pass, one PackedGBuffer.h texel a pixel.
+RWTexture2D<uint4> GBuffer : register(u4);
 RWTexture2D<float4> staging : register(u7);
 RWTexture2D<uint> stagingTarget_R : register(u8);
 RWTexture2D<uint> stagingTarget_G : register(u9);
@@ -33,6 +34,8 @@ RWTexture2D<uint> stagingTarget_B : register(u10);
 RWTexture2D<float4> accumulationLight : register(u11);
 RWTexture2D<float4> accumulationForward : register(u12);
 RWTexture2D<float4> lightTracingPhotons [MAX_RAY_RECURSION_DEPTH*4]: register(u13);
+// Running average of the photon splats since the camera last moved; only CompositeRayGen binds it.
+RWTexture2D<float4> g_photonAccumulation : register(u0, space1);
 
 
 
@@ -48,9 +51,33 @@ StructuredBuffer<Vertex> g_vertices : register(t2, space0);
 StructuredBuffer<PrimitiveInstancePerFrameBuffer> g_AABBPrimitiveAttributes : register(t3, space0);
 StructuredBuffer<CSGNode> csgTree : register(t4, space0);
 
-ConstantBuffer<PrimitiveConstantBuffer> l_materialCB : register(b1);
+// Materials live in one table. A record names its material by index, a procedural instance
+// brings its own, and a TLAS instance can override either with its InstanceID.
+StructuredBuffer<PrimitiveConstantBuffer> l_materials : register(t5, space0);
+ConstantBuffer<MaterialConstantBuffer> l_materialCB : register(b1);
 ConstantBuffer<PrimitiveInstanceConstantBuffer> l_aabbCB: register(b2);
 
+// Set from the hit attributes by the procedural closest and any hit shaders.
+static uint s_hitMaterial = NO_INSTANCE_MATERIAL;
+
+uint MaterialIndex()
+{
+    uint materialIndex = s_hitMaterial == NO_INSTANCE_MATERIAL ? l_materialCB.materialIndex : s_hitMaterial;
+    return InstanceID() == NO_INSTANCE_MATERIAL ? materialIndex : InstanceID();
+}
+
+PrimitiveConstantBuffer Material()
+{
+    return l_materials[MaterialIndex()];
+}
+
+// A geometry desc's AABBs are a run of the procedural instance table starting at the record's
+// instanceIndex.
+uint ProceduralInstanceIndex()
+{
+    return l_aabbCB.instanceIndex + PrimitiveIndex();
+}
+
 groupshared uint photonSharedIndex = 0;
 
 // Functions for PRNG
@@ -206,17 +233,19 @@ float3 SampleHemisphereSeedShift(float3 normal, inout float seed)
 
 
 
+// The polar cosine, not the angle, is uniform; a uniform angle bunches directions at the poles.
 inline float3 SquareToSphereUniform(float2 samplePoint)
 {
     float radius = 1.f;
 
-    float phi = samplePoint.y * PI;
+    float cosPhi = 1.f - 2.f * samplePoint.y;
+    float sinPhi = sqrt(max(0.f, 1.f - cosPhi * cosPhi));
     float theta = samplePoint.x * TWO_PI;
 
     float3 result;
-    result.x = radius * cos(theta) * sin(phi);
-    result.y = radius * cos(phi);
-    result.z = radius * sin(theta) * sin(phi);
+    result.x = radius * cos(theta) * sinPhi;
+    result.y = radius * cosPhi;
+    result.z = radius * sin(theta) * sinPhi;
     return result;
 }
 
@@ -421,7 +450,7 @@ float FresnelAmount(float n1, float n2, float3 normal, float3 incident) {
     }
     float x = 1.0 - cosx;
     float ret = r0 + (1.0f - r0) * x * x * x * x * x;
-    ret = (l_materialCB.reflectanceCoef + (1.0 - l_materialCB.reflectanceCoef) * ret);
+    ret = (Material().reflectanceCoef + (1.0 - Material().reflectanceCoef) * ret);
     return ret;
 }
 
@@ -432,13 +461,13 @@ float PhongLighting(float3 normal, bool shadowHit) {
     float3 viewDir = normalize(-WorldRayDirection());
     float3 refl = normalize(reflect(normal, lightDir));
     float illum;
-    if (l_materialCB.refractiveCoef == 0) {
-         illum = l_materialCB.diffuseCoef * saturate(dot(lightDir, normal));
+    if (Material().refractiveCoef == 0) {
+         illum = Material().diffuseCoef * saturate(dot(lightDir, normal));
 
-        illum += l_materialCB.specularCoef * pow(saturate(dot(refl,viewDir)), l_materialCB.specularPower);
+        illum += Material().specularCoef * pow(saturate(dot(refl,viewDir)), Material().specularPower);
     }
     else {
-        illum = l_materialCB.specularCoef * pow(saturate(dot(refl, viewDir)), l_materialCB.specularPower);
+        illum = Material().specularCoef * pow(saturate(dot(refl, viewDir)), Material().specularPower);
 
     }
     if (!shadowHit) {
@@ -463,6 +492,20 @@ bool refractTest(float3 v, float3 normal, float index, inout float3 refracted) {
     }
 }
 
+// Writes a photon to the slot the counter handed out. Past the end of the buffer the photon is
+// dropped, but the counter is left as it is: its final value tells the application how many
+// photons the frame wanted, and it grows the buffer to match. Callers carry on tracing the
+// path either way, so the later bounces are counted too.
+bool StorePhoton(uint index, Photon p) {
+    uint capacity, stride;
+    photonBuffer.GetDimensions(capacity, stride);
+    if (index >= capacity) {
+        return false;
+    }
+    photonBuffer[index] = p;
+    return true;
+}
+
 PhotonPayload TracePhotonRay(in Ray ray, in PhotonPayload payload) {
     if (payload.recursionDepth >= MAX_RAY_RECURSION_DEPTH) {
         return payload;
@@ -729,7 +772,14 @@ inline void GetTileIndex(float3 rayHitPosition, out uint tileIndex) {
 void CompositeRayGen() {
     //add corresponding RTVs together.
     uint2 index = DispatchRaysIndex().xy;
-    g_renderTarget[index] += g_rasterTarget[index];
+    // Progressive photon mapping: every frame's splats are an estimate with a smaller radius
+    // than the last, and the image is their average.
+    float4 indirect = g_rasterTarget[index];
+    if (g_sceneCB.accumulatedFrames > 0) {
+        indirect = lerp(g_photonAccumulation[index], indirect, 1.0f / (g_sceneCB.accumulatedFrames + 1.0f));
+    }
+    g_photonAccumulation[index] = indirect;
+    g_renderTarget[index] += indirect;
    /* for (int dx = -1; dx <= 1; dx++) {
         for (int dy = -1; dy <= 1; dy++) {
             uint2 i = uint2(dx, dy);
@@ -784,16 +834,17 @@ void Photon_Ray_Gen() {
     g_renderTarget.GetDimensions(width, height);
     float2 screenDims = float2(width, height);
 
-    float power = 1/(width * height); //number of photons to be emitted
+    // One photon per dispatch index; the dispatch is as wide as the photon budget.
+    float power = g_sceneCB.photonPowerScale;
 
-    PhotonPayload payload = { float4(0,0,0,0), g_sceneCB.lightDiffuseColor*2*INV_PI,
+    PhotonPayload payload = { float4(0,0,0,0), g_sceneCB.lightDiffuseColor*2*INV_PI*power,
      power, 1, 0 };
 
 
     for (int i = 0; i < 1; i++) {
        // float3 direction = randomDirection(DispatchRaysIndex().xy + i);
         // = uint(wang_hash_original(samplePoint.x + i + DispatchRaysDimensions().x * samplePoint.y));
-        rng_state = uint(wang_hash_original(DispatchRaysIndex().x + DispatchRaysDimensions().x * DispatchRaysIndex().y) );
+        rng_state = uint(wang_hash_original(DispatchRaysIndex().x + g_sceneCB.frameNumber * 0x9E3779B9));
 
     //    float2 rany = float2(rand_ik(rng_state), rand_ik(rng_state));
         payload.seed = rng_state;
@@ -898,27 +949,19 @@ void ClosestHit_Photon_Triangle(inout PhotonPayload payload, in BuiltInTriangleI
 
 
     //compute cosine 
-    float3 colour = payload.colour * l_materialCB.albedo;
+    float3 colour = payload.colour * Material().albedo;
     payload.colour = float4(colour, 1);
     float3 dir = normalize(WorldRayDirection());
 
     //compute path probability
     
-    //if diffuse surface, store photon//(l_materialCB.reflectanceCoef <= 0.0f && l_materialCB.refractiveCoef <= 0 && payload.recursionDepth > 1
-    if (l_materialCB.reflectanceCoef <= 0.0f && l_materialCB.refractiveCoef <= 0.0f && payload.recursionDepth > 1) {
+    //if diffuse surface, store photon//(Material().reflectanceCoef <= 0.0f && Material().refractiveCoef <= 0 && payload.recursionDepth > 1
+    if (Material().reflectanceCoef <= 0.0f && Material().refractiveCoef <= 0.0f && payload.recursionDepth > 1) {
 
     
         uint dstIndex = photonBuffer.IncrementCounter();
         Photon p = { float4(pos, raySize), float4(dir, 1), float4(colour, 1), float4(0, 1, 0, payload.probability)};
-
-        if (dstIndex < PHOTON_COUNT) {
-            photonBuffer[dstIndex] = p;
-        }
-        else {
-           uint decr =  photonBuffer.DecrementCounter();
-           return;
-
-        }
+        StorePhoton(dstIndex, p);
 
     }
 
@@ -929,10 +972,10 @@ void ClosestHit_Photon_Triangle(inout PhotonPayload payload, in BuiltInTriangleI
   //  if (rand_xorshift() < (1.f - maximumPower)) {
     //    return;
     //}
-    if (l_materialCB.refractiveCoef > 0) {
+    if (Material().refractiveCoef > 0) {
         //assume refractive glass
         float n1 = 1;
-        float n2 = l_materialCB.refractiveCoef;
+        float n2 = Material().refractiveCoef;
         float3 outwardNormal;
         float index;
         float3 refracted;
@@ -957,10 +1000,10 @@ void ClosestHit_Photon_Triangle(inout PhotonPayload payload, in BuiltInTriangleI
     }
 
 
-    if (l_materialCB.reflectanceCoef > 0.1f) {
+    if (Material().reflectanceCoef > 0.1f) {
         Ray r = { pos, reflect(dir, normal) };
         //power of reflected photon should be scaled by the reflective property.
-        payload.colour *= l_materialCB.reflectanceCoef;
+        payload.colour *= Material().reflectanceCoef;
         reflectPos = TracePhotonRay(r, payload).position;
     }
     else {
@@ -981,31 +1024,25 @@ void ClosestHit_Photon_Triangle(inout PhotonPayload payload, in BuiltInTriangleI
 //don't need to define custom interesctions, since we will use the same as backward ray-tracing
 [shader("closesthit")]
 void ClosestHit_Photon_Procedural(inout PhotonPayload payload, in ProceduralPrimitiveAttributes attr) {
-    //payload.colour = l_materialCB.albedo;
+    s_hitMaterial = attr.materialIndex;
+    //payload.colour = Material().albedo;
 
     float3 pos = HitWorldPosition();
 
     float3 dir = normalize(WorldRayDirection());
     float3 refractPos;
     float3 reflectPos;
-    //payload.colour = l_materialCB.albedo;
-    float3 colour = l_materialCB.albedo.xyz*payload.colour.xyz;
+    //payload.colour = Material().albedo;
+    float3 colour = Material().albedo.xyz*payload.colour.xyz;
     payload.colour = float4(colour, 1);
 
-    if (l_materialCB.reflectanceCoef <= 0.0f && l_materialCB.refractiveCoef <= 0 && payload.recursionDepth >= 1) {
+    if (Material().reflectanceCoef <= 0.0f && Material().refractiveCoef <= 0 && payload.recursionDepth >= 1) {
 
         uint dstIndex = photonBuffer.IncrementCounter();
         float raySize = sqrt(dot(pos - WorldRayOrigin(), pos - WorldRayOrigin()));
 
         Photon p = { float4(pos, raySize), float4(dir, 1), float4(colour, 1), float4(attr.normal, payload.probability) };
-        if (dstIndex < PHOTON_COUNT) {
-            photonBuffer[dstIndex] = p;
-        }
-        else {
-            uint decr = photonBuffer.DecrementCounter();
-            return;
-
-        }
+        StorePhoton(dstIndex, p);
     }
 
     //russian roulette
@@ -1014,15 +1051,15 @@ void ClosestHit_Photon_Procedural(inout PhotonPayload payload, in ProceduralPrim
       //    return;
       //}
 
-    if (l_materialCB.reflectanceCoef > 0.0f && l_materialCB.refractiveCoef <= 0.0f) {
+    if (Material().reflectanceCoef > 0.0f && Material().refractiveCoef <= 0.0f) {
         Ray r = { pos, reflect(dir, attr.normal) };
         reflectPos = TracePhotonRay(r, payload).position;
     }
-    else if (l_materialCB.refractiveCoef > 0.0f) {
-        float fresnel = Fresnel(dir, attr.normal, l_materialCB.refractiveCoef);
+    else if (Material().refractiveCoef > 0.0f) {
+        float fresnel = Fresnel(dir, attr.normal, Material().refractiveCoef);
         bool outside = dot(dir, attr.normal) < 0 ? false : true;
         float n1 = 1;
-        float n2 = l_materialCB.refractiveCoef;
+        float n2 = Material().refractiveCoef;
         float3 outwardNormal;
         float index;
         float3 refracted;
@@ -1402,15 +1439,15 @@ void ForwardPathTracingRayGen() {
 
 
 uint labelBRDF() {
-    if (l_materialCB.reflectanceCoef <= 0.0f && l_materialCB.refractiveCoef <= 0.0f) {
+    if (Material().reflectanceCoef <= 0.0f && Material().refractiveCoef <= 0.0f) {
         return 0;
         //diffuse
     }
-    else if (l_materialCB.reflectanceCoef >= 0.0f && l_materialCB.refractiveCoef <= 0.0f) {
+    else if (Material().reflectanceCoef >= 0.0f && Material().refractiveCoef <= 0.0f) {
         return 1;
         //reflective
     }
-    else if (l_materialCB.refractiveCoef >= 0.0f) {
+    else if (Material().refractiveCoef >= 0.0f) {
         return 2;
     }
     return 0;
@@ -1461,10 +1498,10 @@ float3 directionFromBRDF(float3 normal, inout uint seed) {
     }
     else {
         //sample refraction
-        float fresnel = Fresnel(WorldRayDirection(), normal, l_materialCB.refractiveCoef);
+        float fresnel = Fresnel(WorldRayDirection(), normal, Material().refractiveCoef);
         bool outside = dot(dir, normal) < 0 ? false : true;
         float n1 = 1;
-        float n2 = l_materialCB.refractiveCoef;
+        float n2 = Material().refractiveCoef;
         float3 outwardNormal;
         float index;
         float3 refracted;
@@ -1627,6 +1664,7 @@ void ForwardPathTracingClosestHitTriangle(inout PathTracingPayload rayPayload, i
 [shader("closesthit")]
 
 void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload, in ProceduralPrimitiveAttributes attr) {
+    s_hitMaterial = attr.materialIndex;
     //want to connect this path to the light, evaluate radiance
     float3 pos = HitWorldPosition();
     float3 normal = attr.normal;
@@ -1663,14 +1701,14 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
     //float3 c = float3(0.1, 0.01, 0.3)*s;
     //lambertf is the light value here
     float s = chessSides(pos);
-    float3 c = float3(l_materialCB.albedo.xyz);
+    float3 c = float3(Material().albedo.xyz);
    // lambert = lambertian(normal, pos, c);
 
     //uint seed = rayPayload.seed
     //float3 n_direction = SampleHemisphere()
     if (brdf == 0) {
         //sample light source
-       // lambert = lambertian(normal, pos, l_materialCB.albedo);
+       // lambert = lambertian(normal, pos, Material().albedo);
         lambert = lambertian(normal, pos, c);
 
         uint seed = rayPayload.randomSeed;
@@ -1686,7 +1724,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
         Ray r = { pos, dir };
        // rayPayload.randomSeed = seed;
         rayPayload.pdf = 0;
-        rayPayload.energy *= 2 * l_materialCB.albedo * sdot(normal, dir);
+        rayPayload.energy *= 2 * Material().albedo * sdot(normal, dir);
         monte_sample = TraceForwardPath(r, rayPayload).colour;
     }
     else if (brdf == 1) {
@@ -1695,7 +1733,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
         float roulette = seed_xorshift(seed);
         rayPayload.randomSeed = seed;
         rayPayload.pdf = 1;
-        float doSpecular = (roulette < l_materialCB.specularCoef) ? 1.0f : 0.0f;
+        float doSpecular = (roulette < Material().specularCoef) ? 1.0f : 0.0f;
         seed = rayPayload.randomSeed;
         // float3 random = float3(seed_xorshift(seed), seed_xorshift(seed), seed_xorshift(seed));
         float3 dir = calculateRandomDirectionInHemisphereSeedShift(normal, seed);
@@ -1704,7 +1742,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
 
         float3 specularDirection = reflect(WorldRayDirection(), attr.normal);
        
-        specularDirection = normalize(lerp(specularDirection, dir, l_materialCB.diffuseCoef * l_materialCB.diffuseCoef));
+        specularDirection = normalize(lerp(specularDirection, dir, Material().diffuseCoef * Material().diffuseCoef));
         float3 lightDir = normalize(g_sceneCB.lightSphere.xyz - pos);
         float3 lightReflected = normalize(reflect(lightDir, attr.normal));
         float specHighlight = 0.0f;
@@ -1713,7 +1751,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
 
         }       
         
-        rayPayload.energy *= l_materialCB.albedo;
+        rayPayload.energy *= Material().albedo;
         Ray r = { pos, specularDirection };
         reflectiveColour = TraceForwardPath(r, rayPayload).colour;
         reflectiveColour += specHighlight*6;
@@ -1722,7 +1760,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
         
        /* float alpha = 300;
         float3 specular = 0.4f;
-        float3 s = min(1.0f - specular, l_materialCB.albedo);
+        float3 s = min(1.0f - specular, Material().albedo);
         float specChance = energy(specular);
         float diffChance = energy(s);
 
@@ -1746,7 +1784,7 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
             rayPayload.energy *= (1.0f / diffChance) * s * sdot(normal, dir);
             Ray r = { pos, dir };
             reflectiveColour = TraceForwardPath(r, rayPayload).colour;
-            reflectiveColour *= l_materialCB.albedo;
+            reflectiveColour *= Material().albedo;
         }*/
      
     }else if(brdf == 2){
@@ -1755,10 +1793,10 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
             float4 refractColour;
             float4 reflectionColour;
             //sample refraction
-            float fresnel = Fresnel(dir, attr.normal, l_materialCB.refractiveCoef);
+            float fresnel = Fresnel(dir, attr.normal, Material().refractiveCoef);
             bool outside = dot(dir, attr.normal) < 0 ? false : true;
             float n1 = 1;
-            float n2 = l_materialCB.refractiveCoef;
+            float n2 = Material().refractiveCoef;
             float3 outwardNormal;
             float index;
             float3 refracted;
@@ -1792,11 +1830,11 @@ void ForwardPathTracingClosestHitProcedural(inout PathTracingPayload rayPayload,
             //reflectionColour += specHighlight;
             if (rayPayload.pdf == 1) {
                 hitColour += reflectionColour * fresnel + refractColour * (1 - fresnel);
-                hitColour *= l_materialCB.albedo + float4(specHighlight, specHighlight, specHighlight, 0) * 6;
+                hitColour *= Material().albedo + float4(specHighlight, specHighlight, specHighlight, 0) * 6;
             }
             //rayPayload.pdf = 1;
 
-            //hitColour += l_materialCB.albedo;
+            //hitColour += Material().albedo;
 
     }
     if (shadowHit) {
@@ -1998,6 +2036,7 @@ void LightTracingClosestHitTriangle(inout PathTracingPayload rayPayload, in Buil
 
 [shader("closesthit")]
 void LightTracingClosestHitProcedural(inout PathTracingPayload rayPayload, in ProceduralPrimitiveAttributes attr) {
+    s_hitMaterial = attr.materialIndex;
     float3 normal = attr.normal;
     float3 pos = HitWorldPosition().xyz;
     float3 dir = normalize(WorldRayDirection());
@@ -2006,7 +2045,7 @@ void LightTracingClosestHitProcedural(inout PathTracingPayload rayPayload, in Pr
     float4 colour = rayPayload.colour;
     uint brdfType = labelBRDF();
     uint2 index = DispatchRaysIndex().xy;
-    colour *=  l_materialCB.albedo;
+    colour *=  Material().albedo;
 
     if (rayPayload.recursionDepth >= 1) {
         lightTracingPhotons[c][index] = float4(pos, float(brdfType));
@@ -2015,7 +2054,7 @@ void LightTracingClosestHitProcedural(inout PathTracingPayload rayPayload, in Pr
         lightTracingPhotons[c + 3][index] = float4(-WorldRayDirection(), 0);
     }
 
-    if (l_materialCB.reflectanceCoef == 0.0f && l_materialCB.refractiveCoef == 0.0f) {
+    if (Material().reflectanceCoef == 0.0f && Material().refractiveCoef == 0.0f) {
        
         uint seed = rayPayload.randomSeed;
         float2 randomSample = float2(seed_xorshift(seed), seed_xorshift(seed));
@@ -2035,30 +2074,30 @@ void LightTracingClosestHitProcedural(inout PathTracingPayload rayPayload, in Pr
         rayPayload.pos = pos;
         rayPayload.colour = colour;
     }
-    if (l_materialCB.reflectanceCoef > 0.0f && l_materialCB.refractiveCoef <= 0.0f) {
+    if (Material().reflectanceCoef > 0.0f && Material().refractiveCoef <= 0.0f) {
         uint seed = rayPayload.randomSeed;
         float roulette = seed_xorshift(seed);
         //rayPayload.randomSeed = seed;
-        float doSpecular = (roulette < l_materialCB.specularCoef) ? 1.0f : 0.0f;
+        float doSpecular = (roulette < Material().specularCoef) ? 1.0f : 0.0f;
         float d = calculateRandomDirectionInHemisphereSeedShift(normal, seed);
         rayPayload.randomSeed = seed;
 
        
 
         float3 specularDirection = reflect(WorldRayDirection(), attr.normal);
-        specularDirection = normalize(lerp(specularDirection, dir, l_materialCB.diffuseCoef * l_materialCB.diffuseCoef));
+        specularDirection = normalize(lerp(specularDirection, dir, Material().diffuseCoef * Material().diffuseCoef));
         rayPayload.colour = colour;
         rayPayload.pos = pos;
         rayPayload.dir = specularDirection;
 
         
     }
-    else if (l_materialCB.refractiveCoef > 0.0f) {
+    else if (Material().refractiveCoef > 0.0f) {
         //float3 d;
-        float fresnel = Fresnel(dir, attr.normal, l_materialCB.refractiveCoef);
+        float fresnel = Fresnel(dir, attr.normal, Material().refractiveCoef);
         bool outside = dot(dir, attr.normal) < 0 ? false : true;
         float n1 = 1;
-        float n2 = l_materialCB.refractiveCoef;
+        float n2 = Material().refractiveCoef;
         float3 outwardNormal;
         float index;
         float3 refracted;
@@ -2127,9 +2166,7 @@ void MyRaygenShader()
     g_renderTarget.GetDimensions(width, height);
     float2 screenDims = float2(width, height);
 
-    GBufferBRDF[DispatchRaysIndex().xy] = float4(0,0,0, 0);
-    GBufferPosition[DispatchRaysIndex().xy] = float4(0, 0, 0, 0);
-    GBufferNormal[DispatchRaysIndex().xy] = float4(0, 0, 0, 0);
+    GBuffer[DispatchRaysIndex().xy] = uint4(0, 0, 0, 0);
 
 
     /*  for (int i = 0; i < 100; i++) {
@@ -2189,7 +2226,7 @@ void MyClosestHitShader_Triangle(inout RayPayload rayPayload, in BuiltInTriangle
     };
 
     float3 triangleNormal = HitAttribute(triangleNormals, attr.barycentrics);
-    float4 ambient = l_materialCB.albedo;
+    float4 ambient = Material().albedo;
     float3 hitPos = HitWorldPosition();
     float3 pos = HitWorldPosition();
     float3 dir = normalize(g_sceneCB.lightSphere.xyz - pos);
@@ -2217,9 +2254,7 @@ void MyClosestHitShader_Triangle(inout RayPayload rayPayload, in BuiltInTriangle
         //store normal, and other elements in relevant GBuffer
 
         //for some reason the triangle normal is not working??! - for now just suppose n = (0, -1, 0)
-        GBufferBRDF[DispatchRaysIndex().xy] = float4(diffuseColour, 1);
-        GBufferPosition[DispatchRaysIndex().xy] = float4(pos, 0);
-        GBufferNormal[DispatchRaysIndex().xy] = float4(0, 1, 0, 0);
+        GBuffer[DispatchRaysIndex().xy] = EncodeGBuffer(RayTCurrent(), float3(0, 1, 0), MaterialIndex(), labelBRDF(), diffuseColour);
     }
 
     if (shadowHit) {
@@ -2231,7 +2266,7 @@ void MyClosestHitShader_Triangle(inout RayPayload rayPayload, in BuiltInTriangle
 
 
     
-      if(l_materialCB.reflectanceCoef > 0){
+      if(Material().reflectanceCoef > 0){
         Ray r = { HitWorldPosition(), reflect(WorldRayDirection(), triangleNormal) };
         reflectionColour = TraceRadianceRay(r, rayPayload).color;
 
@@ -2261,6 +2296,7 @@ void MyClosestHitShader_Triangle(inout RayPayload rayPayload, in BuiltInTriangle
 [shader("closesthit")]
 void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitiveAttributes attr)
 {
+    s_hitMaterial = attr.materialIndex;
 
     float3 pos = HitWorldPosition();
     float3 pos_n = normalize(HitWorldPosition());
@@ -2280,10 +2316,8 @@ void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitive
 
     if (rayPayload.recursionDepth == 1) {
         //store normal, and other elements in relevant GBuffer
-        float3 l = lambertian(attr.normal, pos, l_materialCB.albedo);
-        GBufferBRDF[DispatchRaysIndex().xy] = float4(l, 0);
-        GBufferPosition[DispatchRaysIndex().xy] = float4(pos, 0);
-        GBufferNormal[DispatchRaysIndex().xy] = float4(attr.normal, 0);
+        float3 l = lambertian(attr.normal, pos, Material().albedo);
+        GBuffer[DispatchRaysIndex().xy] = EncodeGBuffer(RayTCurrent(), attr.normal, MaterialIndex(), labelBRDF(), l);
     }
     bool diffuse = false;
     float3 hitColour = float3(0, 0, 0);
@@ -2292,7 +2326,7 @@ void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitive
     }
     float3 dir = normalize(WorldRayDirection());
     float4 refractColour = float4(0, 0, 0, 0);
-    if (l_materialCB.reflectanceCoef > 0.0f && l_materialCB.refractiveCoef <= 0.0f) {
+    if (Material().reflectanceCoef > 0.0f && Material().refractiveCoef <= 0.0f) {
         Ray r = { pos, reflect(dir, attr.normal) };
         reflectionColour = TraceRadianceRay(r, rayPayload).color;
         hitColour += reflectionColour;
@@ -2301,11 +2335,11 @@ void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitive
 
 
     }
-    else if (l_materialCB.refractiveCoef > 0.0f) {
-        float fresnel = Fresnel(dir, attr.normal, l_materialCB.refractiveCoef);
+    else if (Material().refractiveCoef > 0.0f) {
+        float fresnel = Fresnel(dir, attr.normal, Material().refractiveCoef);
         bool outside = dot(dir, attr.normal) < 0 ? false : true;
         float n1 = 1;
-        float n2 = l_materialCB.refractiveCoef;
+        float n2 = Material().refractiveCoef;
         float3 outwardNormal;
         float index;
         float3 refracted;
@@ -2334,8 +2368,8 @@ void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitive
     }
     else {
         diffuse = true;
-        hitColour += lambertian(attr.normal, pos, l_materialCB.albedo);//orenNayar(normalize(WorldRayDirection()), attr.normal, normalize(l_dir), 1);
-       // hitColour =   lambertian(attr.normal, pos, l_materialCB.albedo);
+        hitColour += lambertian(attr.normal, pos, Material().albedo);//orenNayar(normalize(WorldRayDirection()), attr.normal, normalize(l_dir), 1);
+       // hitColour =   lambertian(attr.normal, pos, Material().albedo);
         if (shadowHit) {
             hitColour *= 0.5;
         }
@@ -2356,10 +2390,10 @@ void MyClosestHitShader_AABB(inout RayPayload rayPayload, in ProceduralPrimitive
         }
 
         hitColour += specHighlight*6;
-        colour = float4(l_materialCB.albedo * hitColour.xyz, 0);
+        colour = float4(Material().albedo * hitColour.xyz, 0);
     }
     else {
-        colour = float4(hitColour.xyz + l_materialCB.albedo, 0);
+        colour = float4(hitColour.xyz + Material().albedo, 0);
     }
 
 //ray
@@ -2412,9 +2446,10 @@ void MyMissShader_ShadowRay(inout ShadowRayPayload rayPayload)
 //***************************************************************************
 [shader("anyhit")]
 void AnyHit_AnalyticPrimitive(inout RayPayload payload, in ProceduralPrimitiveAttributes attr) {
+    s_hitMaterial = attr.materialIndex;
     //IgnoreHit();
     float3 pos = HitWorldPosition();
-    if (l_materialCB.refractiveCoef > 0) {
+    if (Material().refractiveCoef > 0) {
         //  if(ShadowRay(payload)){}
          // payload.color = float4(1, 1, 0, 1);
          //IgnoreHit();
@@ -2439,7 +2474,7 @@ void ClosestHit_CSG( inout RayPayload payload, in ProceduralPrimitiveAttributes
 // Get ray in AABB's local space.
 Ray GetRayInAABBPrimitiveLocalSpace()
 {
-    PrimitiveInstancePerFrameBuffer attr = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+    PrimitiveInstancePerFrameBuffer attr = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
 
     // Retrieve a ray origin position and direction in bottom level AS space 
     // and transform them into the AABB primitive's local space.
@@ -2459,9 +2494,10 @@ void MyIntersectionShader_AnalyticPrimitive()
     ProceduralPrimitiveAttributes attr;
     if (RayAnalyticGeometryIntersectionTest(localRay, primitiveType, thit, attr))
     {
-        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
         attr.normal = mul(attr.normal, (float3x3) aabbAttribute.localSpaceToBottomLevelAS);
         attr.normal = normalize(mul((float3x3) ObjectToWorld3x4(), attr.normal));
+        attr.materialIndex = aabbAttribute.materialIndex;
 
         ReportHit(thit, /*hitKind*/ 0, attr);
     }
@@ -2478,9 +2514,10 @@ void MyIntersectionShader_VolumetricPrimitive()
   
   /*  if (RayVolumetricGeometryIntersectionTest(localRay, primitiveType, thit, attr, 0))
     {
-        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
         attr.normal = mul(attr.normal, (float3x3) aabbAttribute.localSpaceToBottomLevelAS);
         attr.normal = normalize(mul((float3x3) ObjectToWorld3x4(), attr.normal));
+        attr.materialIndex = aabbAttribute.materialIndex;
 
         ReportHit(thit, /*hitKind*/ //0, attr);
    // }
@@ -2496,17 +2533,20 @@ void MyIntersectionShader_SignedDistancePrimitive()
     ProceduralPrimitiveAttributes attr;
 
     /*if (RaySignedDistanceQuatTest(localRay, thit, attr)) {
-        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
         attr.normal = mul(attr.normal, (float3x3) aabbAttribute.localSpaceToBottomLevelAS);
         attr.normal = normalize(mul((float3x3) ObjectToWorld3x4(), attr.normal));
+        attr.materialIndex = aabbAttribute.materialIndex;
 
         ReportHit(thit, 0, attr);
     }*/
-    if (RaySignedDistanceTest(localRay, primitiveType, thit, attr, g_sceneCB.elapsedTime, l_materialCB.stepScale))
+    uint materialIndex = InstanceID() == NO_INSTANCE_MATERIAL ? g_AABBPrimitiveAttributes[ProceduralInstanceIndex()].materialIndex : InstanceID();
+    if (RaySignedDistanceTest(localRay, primitiveType, thit, attr, g_sceneCB.elapsedTime, l_materials[materialIndex].stepScale))
     {
-        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+        PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
         attr.normal = mul(attr.normal, (float3x3) aabbAttribute.localSpaceToBottomLevelAS);
         attr.normal = normalize(mul((float3x3) ObjectToWorld3x4(), attr.normal));
+        attr.materialIndex = aabbAttribute.materialIndex;
 
         ReportHit(thit,  0, attr);
     }
@@ -3329,9 +3369,10 @@ void CSG_Intersection() {
     ProceduralPrimitiveAttributes attr;
    // if (RayCSGIntersectionTest(localRay, primitiveType, thit, attr)) {
     if (latestCSG(localRay, thit, attr)) {
-    PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[l_aabbCB.instanceIndex];
+    PrimitiveInstancePerFrameBuffer aabbAttribute = g_AABBPrimitiveAttributes[ProceduralInstanceIndex()];
         attr.normal = mul(attr.normal, (float3x3) aabbAttribute.localSpaceToBottomLevelAS);
         attr.normal = normalize(mul((float3x3) ObjectToWorld3x4(), attr.normal));
+        attr.materialIndex = aabbAttribute.materialIndex;
 
         ReportHit(thit, 0, attr);
     }
@@ -88,6 +88,8 @@ namespace ComputeCompositeRootSignature {
         enum Enum {
             RayTracingView = 0,
             RasterView = 1,
+            PhotonAccumulation,
+            SceneConstant,
             Count
         };
     }
@@ -171,12 +173,14 @@ namespace LocalRootSignature {
     namespace Triangle {
         namespace Slot {
             enum Enum {
-                MaterialConstant = 0,
+                MaterialTable = 0,
+                MaterialConstant,
                 Count
             };
         }
         struct RootArguments {
-            PrimitiveConstantBuffer materialCb;
+            D3D12_GPU_VIRTUAL_ADDRESS materialTable;
+            MaterialConstantBuffer materialCb;
         };
     }
 }
@@ -185,13 +189,15 @@ namespace LocalRootSignature {
     namespace AABB {
         namespace Slot {
             enum Enum {
-                MaterialConstant = 0,
+                MaterialTable = 0,
+                MaterialConstant,
                 GeometryIndex,
                 Count
             };
         }
         struct RootArguments {
-            PrimitiveConstantBuffer materialCb;
+            D3D12_GPU_VIRTUAL_ADDRESS materialTable;
+            MaterialConstantBuffer materialCb;
             PrimitiveInstanceConstantBuffer aabbCB;
         };
     }
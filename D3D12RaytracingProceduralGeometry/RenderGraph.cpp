@@ -0,0 +1,372 @@
+#include "RenderGraph.h"
+#include <algorithm>
+
+namespace {
+    const char* const StateNames[RenderGraphState::Count] = {
+        "Common", "UnorderedAccess", "ShaderResource", "RenderTarget", "CopySource", "CopyDest", "Present"
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + (alignment - 1)) / alignment * alignment;
+    }
+
+    bool Fail(std::string* error, const std::string& message)
+    {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+}
+
+const uint64_t RenderGraphPlan::NotPlaced;
+
+const char* RenderGraphStateName(RenderGraphState::Enum state)
+{
+    return state < RenderGraphState::Count ? StateNames[state] : "Unknown";
+}
+
+void RenderGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_plan = RenderGraphPlan();
+}
+
+RenderGraphResource RenderGraph::Import(const std::string& name, RenderGraphState::Enum initial, RenderGraphState::Enum final)
+{
+    Resource resource = { name, false, initial, final, 0, 1 };
+    m_resources.push_back(resource);
+    return static_cast<RenderGraphResource>(m_resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateTransient(const std::string& name, uint64_t bytes, uint64_t alignment)
+{
+    // The state is that of the first use, filled in by Compile().
+    Resource resource = { name, true, RenderGraphState::Common, RenderGraphState::Common, bytes, (std::max)(alignment, uint64_t(1)) };
+    m_resources.push_back(resource);
+    return static_cast<RenderGraphResource>(m_resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, PassFunction execute, bool sideEffects)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = execute;
+    pass.sideEffects = sideEffects;
+    m_passes.push_back(pass);
+    return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void RenderGraph::Read(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state)
+{
+    AddAccess(pass, resource, state, false);
+}
+
+void RenderGraph::Write(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state)
+{
+    AddAccess(pass, resource, state, true);
+}
+
+// Declaring the same resource twice in one pass merges the declarations; Compile() rejects
+// two different states.
+void RenderGraph::AddAccess(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state, bool write)
+{
+    for (Access& access : m_passes[pass].accesses) {
+        if (access.resource == resource && access.state == state) {
+            access.write = access.write || write;
+            return;
+        }
+    }
+    Access access = { resource, state, write };
+    m_passes[pass].accesses.push_back(access);
+}
+
+// Walks back from the end of the frame. A pass is live if it has side effects, writes an
+// imported resource, or writes something a later live pass reads.
+bool RenderGraph::Cull(std::vector<uint8_t>& live, std::string* error) const
+{
+    live.assign(m_passes.size(), 0);
+    std::vector<uint8_t> needed(m_resources.size(), 0);
+    for (size_t p = m_passes.size(); p-- > 0;) {
+        const Pass& pass = m_passes[p];
+        bool keep = pass.sideEffects;
+        for (const Access& access : pass.accesses) {
+            if (access.resource >= m_resources.size()) {
+                return Fail(error, "pass " + pass.name + " uses an unknown resource");
+            }
+            if (access.write && (!m_resources[access.resource].transient || needed[access.resource])) {
+                keep = true;
+            }
+        }
+        if (!keep) {
+            continue;
+        }
+        live[p] = 1;
+        for (const Access& access : pass.accesses) {
+            // A UAV write may only touch part of the resource, so what was there before
+            // still matters.
+            if (!access.write || access.state == RenderGraphState::UnorderedAccess) {
+                needed[access.resource] = 1;
+            }
+        }
+    }
+    return true;
+}
+
+// Largest transients first, each at the lowest offset that does not overlap a transient
+// already placed whose lifetime overlaps its own. previous gets, for each transient, the one
+// that last used its memory before it in the frame.
+void RenderGraph::PlaceTransients(const std::vector<uint32_t>& first, const std::vector<uint32_t>& last, std::vector<RenderGraphResource>& previous)
+{
+    std::vector<RenderGraphResource> order;
+    for (RenderGraphResource r = 0; r < m_resources.size(); r++) {
+        if (m_resources[r].transient && first[r] != UINT32_MAX) {
+            order.push_back(r);
+            m_plan.unaliasedBytes += m_resources[r].bytes;
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](RenderGraphResource a, RenderGraphResource b) {
+        return m_resources[a].bytes > m_resources[b].bytes;
+    });
+
+    std::vector<RenderGraphResource> placed;
+    for (RenderGraphResource r : order) {
+        const Resource& resource = m_resources[r];
+        auto overlapsInTime = [&](RenderGraphResource other) {
+            return first[other] <= last[r] && first[r] <= last[other];
+        };
+        // Candidate offsets are the heap start and the end of every resource live alongside.
+        std::vector<uint64_t> candidates(1, 0);
+        for (RenderGraphResource other : placed) {
+            if (overlapsInTime(other)) {
+                candidates.push_back(AlignUp(m_plan.offsets[other] + m_resources[other].bytes, resource.alignment));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        uint64_t offset = 0;
+        for (uint64_t candidate : candidates) {
+            bool fits = true;
+            for (RenderGraphResource other : placed) {
+                uint64_t otherOffset = m_plan.offsets[other];
+                if (overlapsInTime(other) && candidate < otherOffset + m_resources[other].bytes && otherOffset < candidate + resource.bytes) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) {
+                offset = candidate;
+                break;
+            }
+        }
+        m_plan.offsets[r] = offset;
+        m_plan.heapBytes = (std::max)(m_plan.heapBytes, offset + resource.bytes);
+        placed.push_back(r);
+    }
+
+    for (RenderGraphResource r : order) {
+        for (RenderGraphResource other : order) {
+            bool sharesMemory = other != r && m_plan.offsets[r] < m_plan.offsets[other] + m_resources[other].bytes &&
+                m_plan.offsets[other] < m_plan.offsets[r] + m_resources[r].bytes;
+            if (sharesMemory && last[other] < first[r] && (previous[r] == InvalidRenderGraphResource || last[other] > last[previous[r]])) {
+                previous[r] = other;
+            }
+        }
+    }
+}
+
+bool RenderGraph::Compile(std::string* error)
+{
+    m_plan = RenderGraphPlan();
+    std::vector<uint8_t> live;
+    if (!Cull(live, error)) {
+        return false;
+    }
+    for (uint32_t p = 0; p < m_passes.size(); p++) {
+        if (live[p]) {
+            m_plan.passes.push_back(p);
+        }
+        else {
+            m_plan.culledPasses++;
+        }
+    }
+
+    // Lifetimes, in scheduled pass positions, and the state each transient starts in.
+    std::vector<uint32_t> first(m_resources.size(), UINT32_MAX), last(m_resources.size(), 0);
+    for (uint32_t s = 0; s < m_plan.passes.size(); s++) {
+        const Pass& pass = m_passes[m_plan.passes[s]];
+        for (size_t a = 0; a < pass.accesses.size(); a++) {
+            const Access& access = pass.accesses[a];
+            for (size_t b = a + 1; b < pass.accesses.size(); b++) {
+                if (pass.accesses[b].resource == access.resource) {
+                    return Fail(error, "pass " + pass.name + " uses " + m_resources[access.resource].name + " in two states");
+                }
+            }
+            Resource& resource = m_resources[access.resource];
+            if (first[access.resource] == UINT32_MAX) {
+                if (resource.transient && !access.write) {
+                    return Fail(error, "pass " + pass.name + " reads transient " + resource.name + " before anything writes it");
+                }
+                first[access.resource] = s;
+                if (resource.transient) {
+                    resource.initial = resource.final = access.state;
+                }
+            }
+            last[access.resource] = s;
+        }
+    }
+
+    m_plan.offsets.assign(m_resources.size(), RenderGraphPlan::NotPlaced);
+    std::vector<RenderGraphResource> previous(m_resources.size(), InvalidRenderGraphResource);
+    PlaceTransients(first, last, previous);
+
+    std::vector<RenderGraphState::Enum> state(m_resources.size());
+    // Whether the last pass to use each resource this frame did so as a UAV, and wrote it. The
+    // previous frame's accesses are ordered by the submission boundary.
+    std::vector<uint8_t> unordered(m_resources.size(), 0), written(m_resources.size(), 0);
+    for (RenderGraphResource r = 0; r < m_resources.size(); r++) {
+        state[r] = m_resources[r].initial;
+    }
+    // A transient goes back to its starting state right after its last use, while its memory
+    // is still its own.
+    auto retire = [&](uint32_t s) {
+        for (RenderGraphResource r = 0; r < m_resources.size(); r++) {
+            if (m_resources[r].transient && first[r] != UINT32_MAX && last[r] + 1 == s && state[r] != m_resources[r].initial) {
+                RenderGraphBarrier barrier = { RenderGraphBarrierType::Transition, r, state[r], m_resources[r].initial, InvalidRenderGraphResource };
+                m_plan.barriers.push_back(barrier);
+                state[r] = m_resources[r].initial;
+            }
+        }
+    };
+    for (uint32_t s = 0; s < m_plan.passes.size(); s++) {
+        m_plan.barrierFirst.push_back(static_cast<uint32_t>(m_plan.barriers.size()));
+        retire(s);
+        const Pass& pass = m_passes[m_plan.passes[s]];
+        for (const Access& access : pass.accesses) {
+            RenderGraphResource r = access.resource;
+            RenderGraphBarrier barrier = { RenderGraphBarrierType::Transition, r, state[r], access.state, InvalidRenderGraphResource };
+            if (first[r] == s && m_resources[r].transient) {
+                if (previous[r] != InvalidRenderGraphResource) {
+                    RenderGraphBarrier aliasing = { RenderGraphBarrierType::Aliasing, r, access.state, access.state, previous[r] };
+                    m_plan.barriers.push_back(aliasing);
+                }
+            }
+            else if (state[r] != access.state) {
+                m_plan.barriers.push_back(barrier);
+            }
+            else if (access.state == RenderGraphState::UnorderedAccess && (written[r] || (access.write && unordered[r]))) {
+                barrier.type = RenderGraphBarrierType::UnorderedAccess;
+                m_plan.barriers.push_back(barrier);
+            }
+            state[r] = access.state;
+            unordered[r] = access.state == RenderGraphState::UnorderedAccess;
+            written[r] = access.write && unordered[r];
+        }
+    }
+
+    m_plan.barrierFirst.push_back(static_cast<uint32_t>(m_plan.barriers.size()));
+    retire(static_cast<uint32_t>(m_plan.passes.size()));
+    for (RenderGraphResource r = 0; r < m_resources.size(); r++) {
+        if (state[r] != m_resources[r].final) {
+            RenderGraphBarrier barrier = { RenderGraphBarrierType::Transition, r, state[r], m_resources[r].final, InvalidRenderGraphResource };
+            m_plan.barriers.push_back(barrier);
+        }
+    }
+    m_plan.barrierFirst.push_back(static_cast<uint32_t>(m_plan.barriers.size()));
+    return true;
+}
+
+void RenderGraph::Execute(RenderGraphBackend& backend) const
+{
+    backend.Begin(*this);
+    for (size_t s = 0; s <= m_plan.passes.size(); s++) {
+        uint32_t begin = m_plan.barrierFirst[s], end = m_plan.barrierFirst[s + 1];
+        if (end > begin) {
+            backend.Barriers(&m_plan.barriers[begin], end - begin);
+        }
+        if (s < m_plan.passes.size()) {
+            const Pass& pass = m_passes[m_plan.passes[s]];
+            backend.BeginPass(m_plan.passes[s]);
+            if (pass.execute) {
+                pass.execute();
+            }
+        }
+    }
+    backend.Submit();
+}
+
+std::string RenderGraph::Describe() const
+{
+    std::string text;
+    auto describeBarriers = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t b = begin; b < end; b++) {
+            const RenderGraphBarrier& barrier = m_plan.barriers[b];
+            const std::string& name = m_resources[barrier.resource].name;
+            switch (barrier.type) {
+            case RenderGraphBarrierType::Transition:
+                text += "  transition " + name + " " + RenderGraphStateName(barrier.before) + " -> " + RenderGraphStateName(barrier.after) + "\n";
+                break;
+            case RenderGraphBarrierType::UnorderedAccess:
+                text += "  uav " + name + "\n";
+                break;
+            default:
+                text += "  alias " + m_resources[barrier.previous].name + " -> " + name + "\n";
+                break;
+            }
+        }
+    };
+    for (size_t s = 0; s < m_plan.passes.size(); s++) {
+        describeBarriers(m_plan.barrierFirst[s], m_plan.barrierFirst[s + 1]);
+        text += "pass " + m_passes[m_plan.passes[s]].name + "\n";
+    }
+    describeBarriers(m_plan.barrierFirst[m_plan.passes.size()], m_plan.barrierFirst[m_plan.passes.size() + 1]);
+    for (RenderGraphResource r = 0; r < m_resources.size(); r++) {
+        if (m_plan.offsets[r] != RenderGraphPlan::NotPlaced) {
+            text += "place " + m_resources[r].name + " at " + std::to_string(m_plan.offsets[r]) + "\n";
+        }
+    }
+    text += "heap " + std::to_string(m_plan.heapBytes) + " of " + std::to_string(m_plan.unaliasedBytes) + " bytes, " +
+        std::to_string(m_plan.culledPasses) + " passes culled\n";
+    return text;
+}
+
+void MockRenderGraphBackend::Begin(const RenderGraph& graph)
+{
+    m_graph = &graph;
+    const RenderGraphPlan& plan = graph.Plan();
+    for (RenderGraphResource r = 0; r < graph.ResourceCount(); r++) {
+        if (plan.offsets[r] != RenderGraphPlan::NotPlaced) {
+            log.push_back("place " + graph.ResourceName(r) + " " + std::to_string(plan.offsets[r]));
+        }
+    }
+}
+
+void MockRenderGraphBackend::Barriers(const RenderGraphBarrier* barriers, uint32_t count)
+{
+    barrierCalls++;
+    for (uint32_t b = 0; b < count; b++) {
+        const RenderGraphBarrier& barrier = barriers[b];
+        const std::string& name = m_graph->ResourceName(barrier.resource);
+        if (barrier.type == RenderGraphBarrierType::Transition) {
+            log.push_back("transition " + name + " " + RenderGraphStateName(barrier.before) + " " + RenderGraphStateName(barrier.after));
+        }
+        else if (barrier.type == RenderGraphBarrierType::UnorderedAccess) {
+            log.push_back("uav " + name);
+        }
+        else {
+            log.push_back("alias " + m_graph->ResourceName(barrier.previous) + " " + name);
+        }
+    }
+}
+
+void MockRenderGraphBackend::BeginPass(uint32_t pass)
+{
+    log.push_back("pass " + m_graph->PassName(pass));
+}
+
+void MockRenderGraphBackend::Submit()
+{
+    submits++;
+    log.push_back("submit");
+}
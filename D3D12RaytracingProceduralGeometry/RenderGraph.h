@@ -0,0 +1,169 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// RenderGraph.h
+//
+// A frame as a list of passes that declare which resources they read and write, and in what
+// state. Compile() turns the declarations into a schedule: passes whose results nothing uses
+// are dropped, each pass is preceded by exactly the transitions and UAV barriers it needs,
+// and transient resources whose lifetimes do not overlap share memory. Execute() records the
+// whole frame through a backend and submits it once, so the GPU is never drained between
+// passes. Nothing here touches D3D12; MockRenderGraphBackend records the plan as text, and
+// D3D12RenderGraphBackend in DirectXRaytracingHelper.h replays it on a command list for
+// graphs made only of imported resources.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace RenderGraphState {
+    enum Enum {
+        Common = 0,
+        UnorderedAccess,
+        ShaderResource,
+        RenderTarget,
+        CopySource,
+        CopyDest,
+        Present,
+        Count
+    };
+}
+
+namespace RenderGraphBarrierType {
+    enum Enum {
+        Transition = 0,
+        UnorderedAccess,    // Orders UAV accesses of two passes that stay in the same state.
+        Aliasing,           // A transient takes over memory another one used earlier in the frame.
+        Count
+    };
+}
+
+typedef uint32_t RenderGraphResource;
+static const RenderGraphResource InvalidRenderGraphResource = UINT32_MAX;
+
+struct RenderGraphBarrier {
+    RenderGraphBarrierType::Enum type;
+    RenderGraphResource resource;
+    RenderGraphState::Enum before;      // Transitions only.
+    RenderGraphState::Enum after;
+    RenderGraphResource previous;       // Aliasing only: the last user of the memory, if any.
+};
+
+// What Compile() produced. Pass and barrier indices refer to the graph it came from.
+struct RenderGraphPlan {
+    static const uint64_t NotPlaced = UINT64_MAX;
+
+    std::vector<uint32_t> passes;               // Passes to run, in order.
+    std::vector<uint32_t> barrierFirst;         // Barriers before passes[i] are barrierFirst[i]..[i + 1];
+    std::vector<RenderGraphBarrier> barriers;   // the last run is the end-of-frame transitions.
+    std::vector<uint64_t> offsets;              // Heap offset of each resource; NotPlaced for imports.
+    uint64_t heapBytes = 0;                     // Of the transient heap.
+    uint64_t unaliasedBytes = 0;                // What the transients would take without aliasing.
+    uint32_t culledPasses = 0;
+};
+
+class RenderGraph;
+
+class RenderGraphBackend
+{
+public:
+    virtual ~RenderGraphBackend() {}
+
+    // Called once per Execute() before any pass; the backend places transients per the plan.
+    virtual void Begin(const RenderGraph& graph) = 0;
+    virtual void Barriers(const RenderGraphBarrier* barriers, uint32_t count) = 0;
+    virtual void BeginPass(uint32_t pass) { (void)pass; }
+    virtual void Submit() = 0;
+};
+
+class RenderGraph
+{
+public:
+    typedef std::function<void()> PassFunction;
+
+    // Clears passes and resources so the next frame's graph can be declared.
+    void Reset();
+
+    // A resource the graph does not own. It is in initial when the frame starts and is left
+    // in final when it ends.
+    RenderGraphResource Import(const std::string& name, RenderGraphState::Enum initial, RenderGraphState::Enum final);
+    // A resource that only lives within the frame. Its contents do not survive from one frame
+    // to the next, so its first use must write it.
+    RenderGraphResource CreateTransient(const std::string& name, uint64_t bytes, uint64_t alignment);
+
+    // Passes run in the order they are added. One with side effects is never culled, even if
+    // nothing reads what it writes.
+    uint32_t AddPass(const std::string& name, PassFunction execute, bool sideEffects = false);
+    void Read(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state);
+    void Write(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state);
+
+    bool Compile(std::string* error = nullptr);
+    // Records every scheduled pass with its barriers, then submits once.
+    void Execute(RenderGraphBackend& backend) const;
+
+    const RenderGraphPlan& Plan() const { return m_plan; }
+    uint32_t PassCount() const { return static_cast<uint32_t>(m_passes.size()); }
+    uint32_t ResourceCount() const { return static_cast<uint32_t>(m_resources.size()); }
+    const std::string& PassName(uint32_t pass) const { return m_passes[pass].name; }
+    const std::string& ResourceName(RenderGraphResource resource) const { return m_resources[resource].name; }
+    bool IsTransient(RenderGraphResource resource) const { return m_resources[resource].transient; }
+    uint64_t TransientBytes(RenderGraphResource resource) const { return m_resources[resource].bytes; }
+    // The state a transient is created in and returned to at the end of each frame.
+    RenderGraphState::Enum TransientState(RenderGraphResource resource) const { return m_resources[resource].initial; }
+
+    // The plan as text, one pass or barrier per line.
+    std::string Describe() const;
+
+private:
+    struct Resource {
+        std::string name;
+        bool transient;
+        RenderGraphState::Enum initial;
+        RenderGraphState::Enum final;
+        uint64_t bytes;
+        uint64_t alignment;
+    };
+    struct Access {
+        RenderGraphResource resource;
+        RenderGraphState::Enum state;
+        bool write;
+    };
+    struct Pass {
+        std::string name;
+        PassFunction execute;
+        bool sideEffects;
+        std::vector<Access> accesses;
+    };
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    RenderGraphPlan m_plan;
+
+    void AddAccess(uint32_t pass, RenderGraphResource resource, RenderGraphState::Enum state, bool write);
+    bool Cull(std::vector<uint8_t>& live, std::string* error) const;
+    void PlaceTransients(const std::vector<uint32_t>& first, const std::vector<uint32_t>& last, std::vector<RenderGraphResource>& previous);
+};
+
+// Records what it is asked to do, one line per call, so a schedule can be checked without a
+// GPU.
+class MockRenderGraphBackend : public RenderGraphBackend
+{
+public:
+    std::vector<std::string> log;
+    uint32_t submits = 0;
+    uint32_t barrierCalls = 0;
+
+    void Begin(const RenderGraph& graph) override;
+    void Barriers(const RenderGraphBarrier* barriers, uint32_t count) override;
+    void BeginPass(uint32_t pass) override;
+    void Submit() override;
+
+private:
+    const RenderGraph* m_graph = nullptr;
+};
+
+const char* RenderGraphStateName(RenderGraphState::Enum state);
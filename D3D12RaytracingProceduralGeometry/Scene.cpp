@@ -42,11 +42,9 @@ void Scene::mouseMove(float dx, float dy)
 
 Scene::Scene(std::unique_ptr<DX::DeviceResources> &m_deviceResources)
 {
-    //initialise the scene constant buffer
-    auto device = m_deviceResources->GetD3DDevice();
+    //initialise the scene constants; they're uploaded each frame through the application's upload ring
     auto frameCount = m_deviceResources->GetBackBufferCount();
 
-    m_sceneCB.Create(device, frameCount, L"Scene Constant Buffer");
     m_sceneCB->accumulatedFrames = 0;
     m_sceneCB->spp = 12;
     m_sceneCB->frameNumber = frameCount;
@@ -64,105 +62,111 @@ XMMATRIX Scene::GetMVP() {
     return camera->getMVP();
 }
 
-void Scene::Init(float m_aspectRatio)
-{
-  
-    if (!instancing) {
-        CreateGeometry();
-        //NUM_BLAS = 2;
-        NUM_BLAS = 2;
-    }
-    else {
-
-        if (!triangleInstancing && !albany) {
-            CreateGeometry();
-           // CreateSpheres();
-        }
-         //CreateSpheres();
-        
-        // coordinates->translateCloud(Eigen::Vector3d(0.0, 0.0, 0.0));
-          //because triangle geometry can't be stored in the procedural geometry BLAS, we add +1
-         if (albany) {
-             CreateSpheres();
-
-             coordinates = new PlyFile("/Models/Main_Room_Dense_Filtered_100_thousand.ply");
-             coordinates->translateToOrigin(coordinates->centroid());
-             NUM_BLAS = coordinates->size() + 1;
-         }
-         else {
-             NUM_BLAS = 10;
-         }
-    }
-        auto SetAttributes = [&](
-            UINT primitiveIndex,
-            const XMFLOAT4& albedo,
-            float reflectanceCoef = 0.0f,
-            float refractiveCoef = 0.0f,
-            float diffuseCoef = 0.9f,
-            float specularCoef = 0.7f,
-            float specularPower = 50.0f,
-            float stepScale = 1.0f
-            )
-        {
-            auto& attributes = m_aabbMaterialCB[primitiveIndex];
-            attributes.albedo = albedo;
-            attributes.reflectanceCoef = reflectanceCoef;
-            attributes.refractiveCoef = refractiveCoef;
-            attributes.diffuseCoef = diffuseCoef;
-            attributes.specularCoef = specularCoef;
-            attributes.specularPower = specularPower;
-            attributes.stepScale = stepScale;
-        };
-
-    
-
-    
-    // Albedos
-    XMFLOAT4 green = XMFLOAT4(0.1f, 1.0f, 0.5f, 1.0f);
-    XMFLOAT4 grey = XMFLOAT4(0.6, 0.6, 0.6, 0);
-    XMFLOAT4 yellow = XMFLOAT4(1.0f, 1.0f, 0.5f, 1.0f);
-    m_planeMaterialCB = {grey, 0, 0,  1, 0.4f, 50, 1 };
-
-    UINT offset = 0;
-    // Analytic primitives.
+namespace {
+    // Index of a primitive's AABB, per-frame attributes and material: the analytic types
+    // first, then the volumetric, signed distance and CSG ones, as in IntersectionShaderType.
+    UINT PrimitiveSlot(const SceneFile::Primitive& p)
     {
-        float X = 1.0f;
-        using namespace AnalyticPrimitive;
-        for (Primitive& p : analyticalObjects) {
-            PrimitiveConstantBuffer material = p.getMaterial();
-            SetAttributes(offset + p.getType(), material.albedo, material.reflectanceCoef, material.refractiveCoef, material.diffuseCoef, material.specularCoef, material.specularPower, material.stepScale);
+        switch (p.kind) {
+        case SceneFile::PrimitiveKind::Analytic:
+            return p.type;
+        case SceneFile::PrimitiveKind::SignedDistance:
+            return AnalyticPrimitive::Count + VolumetricPrimitive::Count + p.type;
+        default:
+            return AnalyticPrimitive::Count + VolumetricPrimitive::Count + SignedDistancePrimitive::Count + p.type;
         }
-        offset += AnalyticPrimitive::Count + 1;
     }
 
-    
-       
+    // Scale, spin about Y, then move to the instance's place in the BLAS. The intersection
+    // shaders work in local space, so they get the inverse as well.
+    void WriteInstanceTransform(PrimitiveInstancePerFrameBuffer& attributes, const ProceduralInstance& instance, float animationTime)
     {
-            using namespace SignedDistancePrimitive;
+        XMMATRIX mScale = XMMatrixScaling(instance.scale[0], instance.scale[1], instance.scale[2]);
+        XMMATRIX mRotation = XMMatrixRotationY(instance.spin * animationTime);
+        XMMATRIX mTranslation = XMMatrixTranslation(instance.position[0], instance.position[1], instance.position[2]);
+        XMMATRIX mTransform = mScale * mRotation * mTranslation;
+        attributes.localSpaceToBottomLevelAS = mTransform;
+        attributes.bottomLevelASToLocalSpace = XMMatrixInverse(nullptr, mTransform);
+    }
+}
 
-        if (quatJulia) {
-            SetAttributes(offset + QuaternionJulia, XMFLOAT4(0.9f, 0.5f , 0.5f, 0), 0, 1.7f, 0.1f, 1.0f, 50, 1.0f);
+static_assert(SceneFile::CsgOp::Count == 3, "CSGCombine handles union, intersection and difference");
+static_assert(sizeof(SceneFile::Material) == sizeof(PrimitiveConstantBuffer), "the material table is uploaded as it is");
+static_assert(MaterialTable::NoMaterial == NO_INSTANCE_MATERIAL, "Material() in Raytracing.hlsl tests for this InstanceID");
+static_assert(sizeof(ProceduralAabb) == sizeof(D3D12_RAYTRACING_AABB), "the instance table's AABBs are uploaded as they are");
 
-        }
-        if (bloobs) {
-            SetAttributes(offset + MetaBalls, XMFLOAT4(0.8, 0.0, 0, 0), 0, 1.7f, 0.0f, 1, 50, 1.0f);
+// Reads the compiled scene, rebuilding it from sceneSource if that has changed. The image
+// sits next to the source with the extension swapped for .hscene.
+void Scene::Load(const std::string& sceneSource)
+{
+    m_sceneSource = sceneSource;
+    m_sceneImage = sceneSource.substr(0, sceneSource.find_last_of('.')) + ".hscene";
+    SceneFile::ModifiedTime(m_sceneSource, m_sceneTime);
+    std::string error;
+    if (!SceneFile::LoadOrCompile(m_sceneSource, m_sceneImage, description, &error))
+    {
+        std::wstring message = L"Failed to load the scene: " + std::wstring(error.begin(), error.end());
+        ThrowIfFalse(false, message.c_str());
+    }
+}
 
+void Scene::Init(float m_aspectRatio)
+{
+    ThrowIfFalse(SceneFile::TypeCount(SceneFile::PrimitiveKind::Analytic) == AnalyticPrimitive::Count &&
+        SceneFile::TypeCount(SceneFile::PrimitiveKind::SignedDistance) == SignedDistancePrimitive::Count &&
+        SceneFile::TypeCount(SceneFile::PrimitiveKind::Csg) == CSGPrimitive::Count,
+        L"SceneFile's primitive type names are out of step with RayTracingHlslCompat.h");
+
+    const SceneFile::Primitive* primitives = description.Primitives();
+    UINT primitiveCount = description.Count(SceneFile::Section::Primitives);
+    materials.Assign(description.Materials(), description.Count(SceneFile::Section::Materials));
+
+    // The flags the rest of the renderer switches on follow from what the scene contains.
+    // Slots without a primitive are never hit; they keep the first material.
+    CSG = quatJulia = bloobs = false;
+    std::fill(std::begin(m_aabbMaterial), std::end(m_aabbMaterial), 0);
+    for (UINT i = 0; i < primitiveCount; i++) {
+        const SceneFile::Primitive& p = primitives[i];
+        m_aabbMaterial[PrimitiveSlot(p)] = p.material;
+        CSG = CSG || p.kind == SceneFile::PrimitiveKind::Csg;
+        if (p.kind == SceneFile::PrimitiveKind::SignedDistance) {
+            quatJulia = quatJulia || p.type == SignedDistancePrimitive::QuaternionJulia;
+            bloobs = bloobs || p.type == SignedDistancePrimitive::MetaBalls;
         }
-        offset += SignedDistancePrimitive::Count;
-
     }
-  //  XMFLOAT4(0.94901960784
-    //    , 0.75294117647
-      //  , 0.81960784314, 0),
 
-    {
-
-        if (CSG) {
-            using namespace CSGPrimitive;
-            SetAttributes(offset + CSGPrimitive::CSG, XMFLOAT4(0.6f
-                , 0.0f
-                , 0.0f, 0), 0, 1.7f, 0.0f, 1.0f, 50, 1.0f);
+    UINT scatterCount = description.GetSettings().scatterCount;
+    albany = description.Count(SceneFile::Section::PointClouds) > 0;
+    instancing = albany || scatterCount > 0;
+    triangleInstancing = false;
+    if (albany) {
+        const SceneFile::PointCloud& cloud = description.PointClouds()[0];
+        triangleInstancing = cloud.instance == SceneFile::PointCloudInstance::Mesh;
+        pointCloudSpacing = cloud.spacing;
+        pointCloudScale = cloud.scale;
+
+        coordinates = new PlyFile(description.String(cloud.path));
+        coordinates->translateToOrigin(coordinates->centroid());
+
+        // Instances are placed from the LOD octree; SelectPointCloudInstances() picks them.
+        std::vector<float> positions(3 * static_cast<size_t>(coordinates->size()));
+        for (int i = 0; i < coordinates->size(); i++) {
+            const Vertex_Ply& point = (*coordinates)[i];
+            for (int axis = 0; axis < 3; axis++) {
+                positions[3 * i + axis] = static_cast<float>(pointCloudSpacing * point.location(axis));
+            }
         }
+        PointCloudLodSettings settings;
+        settings.pointSize = pointCloudScale * c_aabbWidth;
+        pointCloudLod.Build(positions.data(), coordinates->size(), settings);
+        pointCloudInstances.clear();
+        NUM_BLAS = 1;
+    }
+    else if (instancing) {
+        NUM_BLAS = scatterCount + 1;
+    }
+    else {
+        NUM_BLAS = 2;
     }
 
     // Setup camera.
@@ -170,145 +174,125 @@ void Scene::Init(float m_aspectRatio)
         camera = new Camera(m_aspectRatio);
     }
 
-    {
-        Geometry torus;
-        torus.LoadModel("/Models/sub_1.obj");
-        Geometry plane;
-        plane.initPlane();
-        this->plane = false;
-        if (triangleInstancing) {
-            meshes = { torus };
-        }
-        else{
-            this->plane = true;
+    BuildProceduralInstances();
 
-           meshes = { plane };
+    // Triangle meshes share one BLAS; the first one's material is used for all of them.
+    {
+        const SceneFile::Mesh* sceneMeshes = description.Meshes();
+        meshes.clear();
+        for (UINT i = 0; i < description.Count(SceneFile::Section::Meshes); i++) {
+            Geometry mesh;
+            if (sceneMeshes[i].kind == SceneFile::MeshKind::Plane) {
+                mesh.initPlane();
+            }
+            else {
+                mesh.LoadModel(description.String(sceneMeshes[i].path));
+            }
+            meshes.push_back(mesh);
         }
-
+        plane = sceneMeshes[0].kind == SceneFile::MeshKind::Plane;
+        m_planeMaterial = sceneMeshes[0].material;
     }
 
 // Setup lights.
     {
-        // Initialize the lighting parameters.
-        XMFLOAT4 lightPosition;
-        XMFLOAT4 lightAmbientColor;
-        XMFLOAT4 lightDiffuseColor;
-        XMFLOAT4 lightSphere;
-        //2.0f, -0.36, 0
-        //10, 18, 5
-      //  -1, -0.4f, 2.0f
-        //lightSphere = XMFLOAT4(0.0f, 18.0f, -20.0f, 0.5f);
-       //lightSphere = XMFLOAT4(10, 18, -0.0f, 0.5);
-      // lightSphere = XMFLOAT4()1.00545
-       lightSphere = XMFLOAT4(4.07625, 5.90386, 1.00545, 0.0f);
-       // lightSphere = XMFLOAT4(6.0f, 10, 12, 0.0f);
-        lightPosition = XMFLOAT4(10, 10, -10, 0.0f);
+        SceneFile::Light light = { { 10, 10, -10 }, { 4.07625f, 5.90386f, 1.00545f, 0 }, { 0, 1, 1, 1 }, { 1, 1, 1, 1 }, 1 };
+        if (description.Count(SceneFile::Section::Lights) > 0) {
+            light = description.Lights()[0];
+        }
+        XMFLOAT4 lightPosition(light.position[0], light.position[1], light.position[2], 0.0f);
+        XMFLOAT4 lightSphere(light.sphere);
+        XMFLOAT4 lightAmbientColor(light.ambient);
+        XMFLOAT4 lightDiffuseColor(light.diffuse);
         m_sceneCB->lightPosition = XMLoadFloat4(&lightPosition);
         m_sceneCB->lightSphere = XMLoadFloat4(&lightSphere);
-        m_sceneCB->lightPower = 1;
-        lightAmbientColor = XMFLOAT4(0, 1, 1, 1.0f);
+        m_sceneCB->lightPower = light.power;
         m_sceneCB->lightAmbientColor = XMLoadFloat4(&lightAmbientColor);
-         
-        float d = 1;
-        lightDiffuseColor = XMFLOAT4(d, d, d, d);
         m_sceneCB->lightDiffuseColor = XMLoadFloat4(&lightDiffuseColor);
     }
 }
 
-
 void Scene::convertCSGToArray(int numberOfNodes, std::unique_ptr<DX::DeviceResources>& m_deviceResources) {
-  //  auto device = m_deviceResources->GetD3DDevice();
-    auto SetNodeValues = [&](int index, int leftNode, int rightNode, int boolValue, int parentIndex, int geometry, XMFLOAT3 translation) {
-        csgTree[index].boolValue = boolValue;
-        csgTree[index].leftNodeIndex = leftNode;
-        csgTree[index].rightNodeIndex = rightNode;
-        csgTree[index].geometry = geometry;
-        csgTree[index].parentIndex = parentIndex;
+    const SceneFile::CsgNode* nodes = description.CsgNodes();
+    UINT nodeCount = description.Count(SceneFile::Section::CsgNodes);
+    for (UINT index = 0; index < nodeCount; index++) {
+        const SceneFile::CsgNode& node = nodes[index];
+        csgTree[index].boolValue = node.op;
+        csgTree[index].leftNodeIndex = node.left;
+        csgTree[index].rightNodeIndex = node.right;
+        csgTree[index].geometry = node.geometry;
+        csgTree[index].parentIndex = node.parent;
         csgTree[index].myIndex = index;
-        csgTree[index].translation = translation;
-    };
-   
-    /*SetNodeValues(0, -1, -1, -1, -1, 6, XMFLOAT3(0, 0, 0));
-    SetNodeValues(1, -1, -1, -1, -1, 3, XMFLOAT3(0,0, 0));
-    SetNodeValues(2, -1, -1, 1, -1, -1, XMFLOAT3(0, 0, 0));
-    SetNodeValues(4, -1, -1, -1, -1 ,21, XMFLOAT3(0, 2, 0));
-    SetNodeValues(5, -1, -1, 0, -1 ,-1, XMFLOAT3(0, 0, 0));
-
-    m_sceneCB->csgNodes = 6;
-   // SetNodeValues(0, -1, -1, -1, -1, 3, XMFLOAT3(0, 0, 0));
-    //SetNodeValues(1, -1, -1, -1, 1, 3, XMFLOAT3(0.5, 0.5, 0));
-    //SetNodeValues(2, 0, 1,1, 1, -1, XMFLOAT3(0, 0, 0));
-    //COFFEE MUG
-   */
-    SetNodeValues(0, -1, -1, -1, 1, 17, XMFLOAT3(0, 0, 0));
-    SetNodeValues(1, -1, -1, -1, 1, 18, XMFLOAT3(0, 0.2, 0));
-    SetNodeValues(2, -1, -1, 2, -1, -1, XMFLOAT3(0, 0, 0));
-    SetNodeValues(3, -1, -1, -1, 1, 9, XMFLOAT3(1.1, 0, 0));
-    SetNodeValues(4, -1, -1, -1, 1, 0, XMFLOAT3(1.1, 0.0, 0));
-    SetNodeValues(5, -1, -1, 2, -1, -1, XMFLOAT3(0, 0, 0));
-    SetNodeValues(6, -1, -1, 0, -1, -1, XMFLOAT3(0, 0, 0));
-    m_sceneCB->csgNodes = 7;
-
-   
-
+        csgTree[index].translation = XMFLOAT3(node.translation);
+    }
+    m_sceneCB->csgNodes = nodeCount;
+}
 
-    //SetNodeValues(3, -1, -1, -1, 1, 0, XMFLOAT3(0.05, 0, 0));
-   // SetNodeValues(4, -1, -1, -1, 1, 9, XMFLOAT3(0.05, 0, 0));
-   // SetNodeValues(5, -1, -1, -1, 2, -1, XMFLOAT3(0, 0, 0));
-   // SetNodeValues(6, -1, -1, -1, 0, -1, XMFLOAT3(0, 0, 0));
-
- //   SetNodeValues(3, -1, -1, -1, -1, 3, XMFLOAT3(0, 0, 0));
-  //  SetNodeValues(4, -1, -1, -1, -1, 8, XMFLOAT3(0, 0, 0));
-   // SetNodeValues(5, -1, -1, 1, -1, -1, XMFLOAT3(0, 0, 0));
-    //SetNodeValues(6, -1, -1, 0, -1, -1, XMFLOAT3(0, 0, 0));
-
-   // SetNodeValues(5, -1, -1, -1, -1, 5, XMFLOAT3(0, 0, 0));
-    //SetNodeValues(6, -1, -1, 1, -1, -1, XMFLOAT3(0, 0, 0));
-
-   /* SetNodeValues(0, -1, -1, -1, 1, 3, XMFLOAT3(1, 0, 0));
-    SetNodeValues(1, -1, -1, -1, 1, 3, XMFLOAT3(2, 3, 0));
-    SetNodeValues(2, -1, -1, 0, 1, 3, XMFLOAT3(1, 2, 0));
-    SetNodeValues(3, -1, -1, -1, 1, 3, XMFLOAT3(1, 4, 0));
-    SetNodeValues(4, -1, -1, 0, 1, 3, XMFLOAT3(2, 1, 3));
-    SetNodeValues(5, -1, -1, -1, 1, 0, XMFLOAT3(0.1, 0.5, 0));
-    SetNodeValues(6, -1, -1, 1, 0, -1, XMFLOAT3(0.3, 0.4, 0));
-    */
-    //m_sceneCB->csgNodes = 7;
-   // U(HyperBoloid, Sphere) Intersection U(Cone, Ellipsoid)
-    /**
-     int boolValue;
-    //pertains to the geometry described by the AABB encodings
-    int geometry;
-    int parentIndex;
-    int leftNodeIndex;
-    int rightNodeIndex;
-    UINT myIndex;*/
-
-   /* SetNodeValues(0, 1, 2, 1, -1, -1, XMFLOAT3(0,0,0));
-    SetNodeValues(1, 3, 4, 1, 0, -1, XMFLOAT3(0, 0, 0));
-    SetNodeValues(2, 5, 6, 1, 0, -1, XMFLOAT3(0, 0, 0));
-    SetNodeValues(3, -1, -1, -1, 1, 2, XMFLOAT3(0, 0, 0));
-    SetNodeValues(4, -1, -1, -1, 1, 7, XMFLOAT3(0, 0, 0));
-    SetNodeValues(5, -1, -1, -1, 2, 5, XMFLOAT3(0, 0, 0));
-    SetNodeValues(6, -1, -1, -1, 2, 4, XMFLOAT3(0, 0, 0));
-    /**
-    
-    SetNodeValues(0, 1, 2, 1, -1, -1);
-    SetNodeValues(2, -1, -1, -1, 0, 5);
-    SetNodeValues(1, 3, 4, 2, 0, -1);
-    SetNodeValues(3, -1, -1, -1, 1, 2);
-    SetNodeValues(4, -1, -1, -1, 1, 3);
-
-  /*  SetNodeValues(0, 1, 2, 1, -1, -1);
-    SetNodeValues(1, 3, 4, 0, 0, -1);
-    SetNodeValues(2, -1, -1, -1, 0, 7);
-    SetNodeValues(3, -1, -1, -1, 1, 2);
-    SetNodeValues(4, -1, -1, -1, 1, 3);*/
-   
-   // AllocateUploadBuffer(device, csgTree.data(), csgTree.size() * sizeof(csgTree[0]), &csgTree.resource);
+// Picks the point cloud's instances for the camera's current position. Returns true if they
+// changed, in which case the instance descs, and so the acceleration structure, are stale.
+bool Scene::SelectPointCloudInstances(UINT viewportHeight)
+{
+    if (!albany) {
+        return false;
+    }
+    const SceneFile::PointCloud& cloud = description.PointClouds()[0];
+    XMFLOAT3 eye;
+    XMStoreFloat3(&eye, camera->getPosition());
+    PointCloudView view = { { eye.x, eye.y, eye.z }, camera->getPixelsPerRadian(viewportHeight), cloud.lodPixels };
+    if (!pointCloudLod.Select(view, pointCloudInstances)) {
+        return false;
+    }
+    //because triangle geometry can't be stored in the procedural geometry BLAS, we add +1
+    NUM_BLAS = static_cast<uint32_t>(pointCloudInstances.size()) + 1;
+
+    // Instances are numbered as in AccelerationStructure: one per selected instance, starting
+    // at the BLAS type they instance.
+    materials.ClearInstanceMaterials();
+    if (cloud.material != SceneFile::NoMaterial) {
+        UINT firstInstance = triangleInstancing ? BottomLevelASType::Triangle : BottomLevelASType::AABB;
+        materials.SetInstanceMaterials(firstInstance, NUM_BLAS - 1, cloud.material);
+    }
+    return true;
+}
 
+// Places each primitive record's grid of instances. Offsets are in units of the old one AABB
+// per type layout: AABBs c_aabbWidth wide, c_aabbDistance apart, with the first centred on
+// the origin.
+void Scene::BuildProceduralInstances()
+{
+    const float stride = c_aabbWidth + c_aabbDistance;
+    const float base = -c_aabbWidth / 2.0f;
+
+    instances.Reset(IntersectionShaderType::TotalPrimitiveCount);
+    const SceneFile::Primitive* primitives = description.Primitives();
+    for (UINT i = 0; i < description.Count(SceneFile::Section::Primitives); i++) {
+        const SceneFile::Primitive& p = primitives[i];
+        ProceduralInstance instance = { PrimitiveSlot(p), p.material, i, {}, {}, { p.scale[0], p.scale[1], p.scale[2] }, p.spin };
+        for (int axis = 0; axis < 3; axis++) {
+            instance.extent[axis] = p.size[axis] / 2.0f;
+        }
+        for (UINT z = 0; z < p.grid[2]; z++) {
+            for (UINT y = 0; y < p.grid[1]; y++) {
+                for (UINT x = 0; x < p.grid[0]; x++) {
+                    UINT cell[3] = { x, y, z };
+                    for (int axis = 0; axis < 3; axis++) {
+                        instance.position[axis] = base + p.offset[axis] * stride + instance.extent[axis] + cell[axis] * p.spacing[axis];
+                    }
+                    instances.Add(instance);
+                }
+            }
+        }
+    }
+    instances.Build();
 }
 
+// Material ids of the instances, for the intersection shaders to hand on to the hit shaders.
+void Scene::UpdateInstanceMaterials()
+{
+    for (UINT i = 0; i < instances.Count(); i++) {
+        m_aabbPrimitiveAttributeBuffer[i].materialIndex = instances.IsPlaceholder(i) ? 0 : materials.Id(instances[i].material);
+    }
+}
 
 void Scene::UpdateAABBPrimitiveAttributes(float animationTime, bool animate, std::unique_ptr<DX::DeviceResources>& m_deviceResources)
 {
@@ -322,94 +306,10 @@ void Scene::UpdateAABBPrimitiveAttributes(float animationTime, bool animate, std
    else {
        previousRot = animationTime;
    }
-    XMMATRIX mIdentity = XMMatrixIdentity();
-
-    XMMATRIX mScale15y = XMMatrixScaling(1, 1.5, 1);
-    XMMATRIX mScale15 = XMMatrixScaling(1.5, 1.5, 1.5);
-    XMMATRIX mScaleHalf = XMMatrixScaling(0.2, 0.2, 0.2);
-    XMMATRIX mScaleTiny = XMMatrixScaling(0.05, 0.05, 0.05);
-
-    XMMATRIX mScale2 = XMMatrixScaling(2, 2, 2);
-    XMMATRIX mScale3 = XMMatrixScaling(3, 3, 3);
-    XMMATRIX massive = XMMatrixScaling(10, 10, 10);
-
-   
-    XMMATRIX mRotation = XMMatrixRotationY(-2 * animationTime);
-    XMMATRIX hypRot = XMMatrixRotationY(-0.5*animationTime);
-    XMMATRIX cup = XMMatrixRotationY(0);
-
-    // Apply scale, rotation and translation transforms.
-    // The intersection shader tests in this sample work with local space, so here
-    // we apply the BLAS object space translation that was passed to geometry descs.
-    auto SetTransformForAABB = [&](UINT primitiveIndex, XMMATRIX& mScale, XMMATRIX& mRotation)
-    {
-        XMVECTOR vTranslation =
-            0.5f * (XMLoadFloat3(reinterpret_cast<XMFLOAT3*>(&m_aabbs[primitiveIndex].MinX))
-                + XMLoadFloat3(reinterpret_cast<XMFLOAT3*>(&m_aabbs[primitiveIndex].MaxX)));
-        XMMATRIX mTranslation = XMMatrixTranslationFromVector(vTranslation);
-
-        XMMATRIX mTransform = mScale * mRotation * mTranslation;
-        m_aabbPrimitiveAttributeBuffer[primitiveIndex].localSpaceToBottomLevelAS = mTransform;
-        m_aabbPrimitiveAttributeBuffer[primitiveIndex].bottomLevelASToLocalSpace = XMMatrixInverse(nullptr, mTransform);
-    };
-
-    UINT offset = 0;
-    // Analytic primitives.
-    {
-        using namespace AnalyticPrimitive;
-        
-        for (Primitive& p : analyticalObjects) {
-            //SetTransformForAABB(offset + p.getType(), mScale15, mRotation);
-            if (!instancing) {
-                if (p.getType() != AnalyticPrimitive::Ellipsoid) {
-                    if (p.getType() == AnalyticPrimitive::AABB) {
-                        SetTransformForAABB(offset + p.getType(), mScale15, mRotation);
-                    }
-                    else if (p.getType() == AnalyticPrimitive::Hyperboloid) {
-                        SetTransformForAABB(offset + p.getType(), mScale15, hypRot);
-
-                    }
-                    else {
-                        SetTransformForAABB(offset + p.getType(), mIdentity, mRotation);
-                    }
-                    //  offset++; 
-                }
-                else {
-                    SetTransformForAABB(offset + p.getType(), mIdentity, mRotation);
-                }
-            }
-            else {
-                SetTransformForAABB(offset + p.getType(), mScale15, mRotation);
-            }
-        }
-       
-        offset += AnalyticPrimitive::Count + 1;
-    }
-
-
-    {
-        using namespace SignedDistancePrimitive;
-
-        if (quatJulia) {
-            SetTransformForAABB(offset + SignedDistancePrimitive::QuaternionJulia, mScale3, hypRot);
-        }
-
-        if (bloobs) {
-            SetTransformForAABB(offset + SignedDistancePrimitive::MetaBalls, mScale15, mRotation);
-
-        }
-        offset += SignedDistancePrimitive::Count;
-
-    }
-    
-    {
-
-        if (CSG) {
-            using namespace CSGPrimitive;
-            SetTransformForAABB(offset + CSGPrimitive::CSG, mScale15, cup);
-        }
+    // Static instances were written when the buffer was created; only spinning ones change.
+    for (UINT index : instances.Animated()) {
+        WriteInstanceTransform(m_aabbPrimitiveAttributeBuffer[index], instances[index], animationTime);
     }
-
 }
 
 void Scene::BuildMeshes(std::unique_ptr<DX::DeviceResources>& m_deviceResources) {
@@ -447,77 +347,8 @@ void Scene::BuildProceduralGeometryAABBs(std::unique_ptr<DX::DeviceResources> &m
 {
     auto device = m_deviceResources->GetD3DDevice();
 
-    // Set up AABBs on a grid.
-    {
-        XMINT3 aabbGrid = XMINT3(1, 1, 1);
-        const XMFLOAT3 basePosition =
-        {
-            -(aabbGrid.x * c_aabbWidth + (aabbGrid.x - 1) * c_aabbDistance) / 2.0f,
-            -(aabbGrid.y * c_aabbWidth + (aabbGrid.y - 1) * c_aabbDistance) / 2.0f,
-            -(aabbGrid.z * c_aabbWidth + (aabbGrid.z - 1) * c_aabbDistance) / 2.0f,
-        };
-
-        XMFLOAT3 stride = XMFLOAT3(c_aabbWidth + c_aabbDistance, c_aabbWidth + c_aabbDistance, c_aabbWidth + c_aabbDistance);
-        auto InitializeAABB = [&](auto& offsetIndex, auto& size)
-        {
-            return D3D12_RAYTRACING_AABB{
-                basePosition.x + offsetIndex.x * stride.x,
-                basePosition.y + offsetIndex.y * stride.y,
-                basePosition.z + offsetIndex.z * stride.z,
-                basePosition.x + offsetIndex.x * stride.x + size.x,
-                basePosition.y + offsetIndex.y * stride.y + size.y,
-                basePosition.z + offsetIndex.z * stride.z + size.z,
-            };
-        };
-        //resize to number of actual geometry in the bottom level acceleration structure
-        m_aabbs.resize(IntersectionShaderType::TotalPrimitiveCount);
-        UINT offset = 0;
-
-        // Analytic primitives.
-        {
-            using namespace AnalyticPrimitive;
-            for (Primitive& p : analyticalObjects) {
-                //m_aabbs[offset + Spheres] = InitializeAABB(XMFLOAT3(rand() % 2, 1, rand() % 2), XMFLOAT3(6, 6, 6));
-                //offset++;
-                m_aabbs[p.getType()] = InitializeAABB(p.getIndex(), p.getSize());
-
-               // m_aabbs[offset + p.getType()] = InitializeAABB(p.getIndex(), p.getSize());
-             
-            }
-            offset += AnalyticPrimitive::Count + 1;
-        }
-        
-
-        {
-
-         
-        {
-
-                using namespace SignedDistancePrimitive;
-
-            if (quatJulia) {
-
-                m_aabbs[offset + QuaternionJulia] = InitializeAABB(XMFLOAT3(-1 ,-0.1, -1), XMFLOAT3(9, 9, 9));
-            }
-            if (bloobs) {
-
-                m_aabbs[offset + SignedDistancePrimitive::MetaBalls] = InitializeAABB(XMFLOAT3(1.5f, -0.3, 0), XMFLOAT3(6, 6, 6));
-            }
-
-            }
-            offset += SignedDistancePrimitive::Count;
-
-        }
-
-        {
-            if (CSG) {
-                using namespace CSGPrimitive;
-                m_aabbs[offset + CSGPrimitive::CSG] = InitializeAABB(XMFLOAT3(-0.4f, -0.7, 0), XMFLOAT3(9, 9, 9));
-            }
-
-        }
-        AllocateUploadBuffer(device, m_aabbs.data(), m_aabbs.size() * sizeof(m_aabbs[0]), &m_aabbBuffer.resource);
-    }
+    // One AABB per instance, in slot order, as generated by the instance table.
+    AllocateUploadBuffer(device, instances.Aabbs(), instances.Count() * sizeof(D3D12_RAYTRACING_AABB), &m_aabbBuffer.resource, L"ProceduralAABBs");
 }
 
 void Scene::sceneUpdates(float animationTime, std::unique_ptr<DX::DeviceResources>& m_deviceResources, ConstantBuffer<RasterSceneCB> &m_rasterConstantBuffer, bool m_animateLights, float time)
@@ -569,21 +400,102 @@ void Scene::sceneUpdates(float animationTime, std::unique_ptr<DX::DeviceResource
 
 
 void Scene::CreateCSGTree(std::unique_ptr<DX::DeviceResources>  &m_deviceResources) {
-    auto device = m_deviceResources->GetD3DDevice();
-    auto frameCount = m_deviceResources->GetBackBufferCount();
-    csgTree.Create(device, 7, frameCount, L"CSG Tree");
+    csgTree.CreateStaging((std::max)(1u, description.Count(SceneFile::Section::CsgNodes)));
 }
 
 void Scene::CreateAABBPrimitiveAttributesBuffers(std::unique_ptr<DX::DeviceResources>& m_deviceResources)
 {
-    auto device = m_deviceResources->GetD3DDevice();
-    auto frameCount = m_deviceResources->GetBackBufferCount();
-    m_aabbPrimitiveAttributeBuffer.Create(device, IntersectionShaderType::TotalPrimitiveCount, frameCount, L"AABB primitive attributes");
+    m_aabbPrimitiveAttributeBuffer.CreateStaging(instances.Count());
+    for (UINT i = 0; i < instances.Count(); i++) {
+        WriteInstanceTransform(m_aabbPrimitiveAttributeBuffer[i], instances[i], previousRot);
+    }
+    UpdateInstanceMaterials();
 }
 
 
+// The table lives in an upload heap buffer: it's written at load and on the rare hot reload,
+// and records hold its address, so it's kept in one place rather than per frame.
+void Scene::CreateMaterialTable(std::unique_ptr<DX::DeviceResources>& m_deviceResources)
+{
+    AllocateUploadBuffer(m_deviceResources->GetD3DDevice(), materials.Data(), materials.Bytes(), &m_materialBuffer.resource, L"MaterialTable");
+}
+
+// Picks up material edits while running. The scene file is checked for a newer write time,
+// recompiled, and only its materials are applied; other changes need a restart. Values are
+// rewritten in place, while a change of ids reallocates the table, so the caller has to
+// rebuild the shader tables and instance descs. Either way the GPU is idle on return.
+MaterialTableChange::Enum Scene::ReloadMaterials(std::unique_ptr<DX::DeviceResources>& m_deviceResources)
+{
+    int64_t time = 0;
+    if (!SceneFile::ModifiedTime(m_sceneSource, time) || time == m_sceneTime) {
+        return MaterialTableChange::None;
+    }
+    m_sceneTime = time;
+
+    SceneFile::CompiledScene reloaded;
+    std::string error;
+    if (!SceneFile::LoadOrCompile(m_sceneSource, m_sceneImage, reloaded, &error)) {
+        OutputDebugStringA(("Scene reload failed: " + error + "\n").c_str());
+        return MaterialTableChange::None;
+    }
+    if (reloaded.Count(SceneFile::Section::Primitives) != description.Count(SceneFile::Section::Primitives) ||
+        reloaded.Count(SceneFile::Section::Meshes) != description.Count(SceneFile::Section::Meshes) ||
+        reloaded.Count(SceneFile::Section::PointClouds) != description.Count(SceneFile::Section::PointClouds)) {
+        OutputDebugStringA("Scene reload: geometry changed, only materials are applied until restart\n");
+        return MaterialTableChange::None;
+    }
+
+    MaterialTableChange::Enum change = materials.Assign(reloaded.Materials(), reloaded.Count(SceneFile::Section::Materials));
+
+    // Geometry may also have been pointed at a different material, which records bake in.
+    bool referencesChanged = reloaded.Meshes()[0].material != m_planeMaterial;
+    for (UINT i = 0; i < reloaded.Count(SceneFile::Section::Primitives); i++) {
+        const SceneFile::Primitive& p = reloaded.Primitives()[i];
+        referencesChanged = referencesChanged || description.Primitives()[i].material != p.material;
+        m_aabbMaterial[PrimitiveSlot(p)] = p.material;
+    }
+    for (UINT i = 0; i < instances.Count(); i++) {
+        if (!instances.IsPlaceholder(i)) {
+            instances.SetMaterial(i, reloaded.Primitives()[instances[i].primitive].material);
+        }
+    }
+    m_planeMaterial = reloaded.Meshes()[0].material;
+    if (reloaded.Count(SceneFile::Section::PointClouds) > 0) {
+        UINT source = reloaded.PointClouds()[0].material;
+        referencesChanged = referencesChanged || source != description.PointClouds()[0].material;
+        materials.ClearInstanceMaterials();
+        if (source != SceneFile::NoMaterial) {
+            UINT firstInstance = triangleInstancing ? BottomLevelASType::Triangle : BottomLevelASType::AABB;
+            materials.SetInstanceMaterials(firstInstance, NUM_BLAS - 1, source);
+        }
+    }
+    if (referencesChanged) {
+        change = MaterialTableChange::Ids;
+    }
+    if (change == MaterialTableChange::None) {
+        return change;
+    }
+    description = std::move(reloaded);
+    UpdateInstanceMaterials();
+
+    m_deviceResources->WaitForGpu();
+    if (change == MaterialTableChange::Values) {
+        void* mapped;
+        CD3DX12_RANGE readRange(0, 0);
+        ThrowIfFailed(m_materialBuffer.resource->Map(0, &readRange, &mapped));
+        memcpy(mapped, materials.Data(), materials.Bytes());
+        m_materialBuffer.resource->Unmap(0, nullptr);
+    }
+    else {
+        m_materialBuffer.resource.Reset();
+        CreateMaterialTable(m_deviceResources);
+    }
+    return change;
+}
+
 void Scene::releaseResources() {
    m_sceneCB.Release();
+   m_materialBuffer.resource.Reset();
    csgTree.Release();
    m_aabbPrimitiveAttributeBuffer.Release();
    m_indexBuffer.resource.Reset();
@@ -598,6 +510,18 @@ XMVECTOR Scene::getCameraDirection() {
 XMVECTOR Scene::getCameraPosition() {
     return camera->getPosition();
 }
+
+CameraPath::State Scene::getCameraState() {
+    return camera->getPathState();
+}
+
+void Scene::setCameraState(const CameraPath::State& state) {
+    camera->setPathState(state);
+}
+
+float Scene::getCameraFovY() {
+    return camera->getFovY();
+}
 ConstantBuffer<SceneConstantBuffer>* Scene::getSceneBuffer()
 {
     return &m_sceneCB;
@@ -617,67 +541,11 @@ StructuredBuffer<CSGNode>* Scene::getCSGTree()
     return &csgTree;
 }
 
-
-void Scene::CreateSpheres() {
-    float X = 1.0f;
-    for (int i = 0; i < 3; i++) {
-        float x = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));
-        float y = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));
-        float z = static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / X));
-        PrimitiveConstantBuffer sphere_b = { XMFLOAT4(0.9 , 0.1, 0.1, 0), 0, 0, 1, 0.4f, 50, 1 };
-
-        Primitive sphere(AnalyticPrimitive::Enum::Spheres, sphere_b, XMFLOAT3(0, 0, 0), XMFLOAT3(6
-            , 6
-            , 6
-        ));
-        analyticalObjects.push_back(sphere);
-    }
+D3D12_GPU_VIRTUAL_ADDRESS Scene::getMaterialTable()
+{
+    return m_materialBuffer.resource->GetGPUVirtualAddress();
 }
 
-void Scene::CreateGeometry() {
-    // XMFLOAT4(0.8, 0.64, 0.12, 0)
-
-
-    PrimitiveConstantBuffer sphere_b = { XMFLOAT4(0.8, 0.0, 0, 0), 0.0f, 1.7f, 0, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer aa = { XMFLOAT4(0.1, 0.9f, 0.0f, 0), 1, 2.4f, 1, 0.4f, 50, 1 };
-    PrimitiveConstantBuffer c = { XMFLOAT4(0.8f, 0.8f, 0.8f, 0), 0, 0, 1, 0.4f, 50, 1 };
-
-    Primitive sphere(AnalyticPrimitive::Enum::Spheres, sphere_b, XMFLOAT3(0, -0.45f,0), XMFLOAT3(6, 6, 6));
-    PrimitiveConstantBuffer hy_b = { XMFLOAT4(0.01, 0.8, 0.8, 0), 0, 1.7f, 0, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer ellipse_b = { XMFLOAT4(0, 0.3, 0.7, 0), 0, 0.0f, 0.3f, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer AABB_b = { XMFLOAT4(0.8, 0.8, 0.8, 0), 1, 0, 0, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer cylin_b = { XMFLOAT4(0.8, 0.64, 0.12, 0), 1, 0, 0.2f, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer parab_b = { XMFLOAT4(0.4f, 0.0f, 0.6f, 0), 0.0F, 0.0f, 0.0f, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer cone_b = { XMFLOAT4(0.1, 0.7f, 0.1, 0), 0, 1.7f, 0, 1.0f, 50, 1 };
-    PrimitiveConstantBuffer CSG = { XMFLOAT4(0.0, 0.0, 0.0, 0), 2, 1, 1, 0.4f, 50, 1 };
-    PrimitiveConstantBuffer pointLightSphere = { XMFLOAT4(1, 1, 1, 0) , 0, 0, 1, 0.4f, 50, 1 };
-
-    PrimitiveConstantBuffer e = { ChromiumReflectance, 0, 0, 1, 0.4f, 50, 1 };
-    //Primitive ellipsoid(AnalyticPrimitive::Enum::Ellipsoid, ellipse_b, XMFLOAT3(-3.0f, 0.0f, 1.0f), XMFLOAT3(9, 9, 9));
-
-    Primitive hyperboloid(AnalyticPrimitive::Enum::Hyperboloid, hy_b, XMFLOAT3(0.0f, -0.1, 0.0f), XMFLOAT3(9, 9, 9));
-    Primitive ellipsoid(AnalyticPrimitive::Enum::Ellipsoid, ellipse_b, XMFLOAT3(0.3f, -0.8f, 0.1f ), XMFLOAT3(9, 9, 9));
-    Primitive specialAABB(AnalyticPrimitive::AABB, AABB_b, XMFLOAT3(-20, -20, -20 ), XMFLOAT3(200, 200, 200));
-    Primitive Sphere(AnalyticPrimitive::Sphere, sphere_b, XMFLOAT3(0.2f, -0.1f, 0.0f), XMFLOAT3(3, 3, 3));
-    Primitive pointLight(AnalyticPrimitive::PointLightSphere, pointLightSphere, XMFLOAT3(10, 18, -0.0f), XMFLOAT3(6, 6, 6));
-
-    Primitive Cone(AnalyticPrimitive::Cone, cone_b, XMFLOAT3(-1.0f, 0.0f, 2.5f), XMFLOAT3(6, 6, 6));
-    Primitive Square(AnalyticPrimitive::AABB, c, XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(3, 3, 3));
-     //Primitive Square(AnalyticPrimitive::AABB, aa, XMFLOAT3(2.0f, 0.0f, -4.0f), XMFLOAT3(10, 10, 10));
-
-    Primitive Paraboloid(AnalyticPrimitive::Paraboloid, parab_b, XMFLOAT3(1, -0.6f, -1.0f), XMFLOAT3(6, 6, 6));
-    Primitive Cylinder(AnalyticPrimitive::Cylinder, cylin_b, XMFLOAT3(0.0f, -0.16, -0.0f), XMFLOAT3(10, 2, 10));
-    Primitive difference(AnalyticPrimitive::Enum::CSG_Difference, CSG, XMFLOAT3(0.0f, 0.0f, -2.0f), XMFLOAT3(2, 2, 2));
-    Primitive csg_union(AnalyticPrimitive::Enum::CSG_Union, CSG, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(6, 6, 6));
-    Primitive intersection(AnalyticPrimitive::Enum::CSG_Intersection, CSG, XMFLOAT3(0, 0.0f, 0), XMFLOAT3(10, 10, 10));
-    Primitive plane(AnalyticPrimitive::Plane, parab_b, XMFLOAT3(-1.0f, 0.0f, 0.0f), XMFLOAT3(6, 6, 6));
-    Primitive plane2(AnalyticPrimitive::Plane, AABB_b, XMFLOAT3(1, 3.0f, 0.0f), XMFLOAT3(6, 6, 6));
-    Primitive cornellInner(AnalyticPrimitive::CornellBack, cone_b, XMFLOAT3(0, 0, 0.0f), XMFLOAT3(3, 3, 3));
-    Primitive otherBox(AnalyticPrimitive::AABB, ellipse_b, XMFLOAT3(4.0f, 0, 3.0f), XMFLOAT3(3, 3, 3));
-   // analyticalObjects = {};
-    analyticalObjects = { sphere };
-
-}
 
 //this should be contained in the Descriptor Heap object
 
@@ -7,15 +7,23 @@
 #include "DirectXRaytracingHelper.h"
 #include "PlyFile.h"
 #include "Geometry.h"
+#include "SceneFile.h"
+#include "MaterialTable.h"
+#include "ProceduralInstances.h"
+#include "PointCloudLod.h"
 class Scene
 {
 private:
 
 		ConstantBuffer<SceneConstantBuffer> m_sceneCB;
 		StructuredBuffer<PrimitiveInstancePerFrameBuffer> m_aabbPrimitiveAttributeBuffer;
-		std::vector<D3D12_RAYTRACING_AABB> m_aabbs;
 		
 		StructuredBuffer<CSGNode> csgTree;
+		D3DBuffer m_materialBuffer;
+
+		std::string m_sceneSource;
+		std::string m_sceneImage;
+		int64_t m_sceneTime = 0;
 
 		std::vector<Geometry> meshes;
 		Camera* camera;
@@ -33,7 +41,7 @@ public:
 	std::vector<uint32_t> totalIndices;
 
 
-	std::vector<Primitive> analyticalObjects;
+	SceneFile::CompiledScene description;
 	bool instancing = false;
 	bool albany = false;
 	bool CSG = false;
@@ -45,18 +53,28 @@ public:
 	const float c_aabbWidth = 2;      // AABB width.
 	const float c_aabbDistance = 2;   // Distance between AABBs.
 	uint32_t NUM_BLAS = 10;
+	float pointCloudSpacing = 10;     // Point cloud coordinates to world units.
+	float pointCloudScale = 1;        // Scale of each instance placed on a point.
 	PlyFile* coordinates;
-	PrimitiveConstantBuffer m_aabbMaterialCB[IntersectionShaderType::TotalPrimitiveCount];
-	PrimitiveConstantBuffer m_planeMaterialCB;
+	PointCloudLod pointCloudLod;
+	std::vector<PointCloudLodInstance> pointCloudInstances;	// Selected from pointCloudLod, in Morton order.
+	MaterialTable materials;
+	ProceduralInstanceTable instances;
+	UINT m_aabbMaterial[IntersectionShaderType::TotalPrimitiveCount];	// Source material of each AABB slot's record, for hits without an instance.
+	UINT m_planeMaterial;												// Source material of the triangle geometry.
 
 
 	virtual void keyPress(UINT8 key);
 	virtual void mouseMove(float dx, float dy);
 	Scene(std::unique_ptr<DX::DeviceResources> &m_deviceResources);
 	XMMATRIX GetMVP();
+	void Load(const std::string& sceneSource);
 	void Init(float m_aspectRatio);
 	void convertCSGToArray(int numberOfNodes, std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 	void UploadCompute(ComputeConstantBuffer& computeBuffer);
+	bool SelectPointCloudInstances(UINT viewportHeight);
+	void BuildProceduralInstances();
+	void UpdateInstanceMaterials();
 	void UpdateAABBPrimitiveAttributes(float animationTime, bool animate, std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 	void BuildMeshes(std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 	void Scene::BuildProceduralGeometryAABBs(std::unique_ptr<DX::DeviceResources> &m_deviceResources);
@@ -65,6 +83,8 @@ public:
 	void sceneUpdates(float animationTime, std::unique_ptr<DX::DeviceResources>& m_deviceResources, ConstantBuffer<RasterSceneCB> &m_rasterConstantBuffer,  bool m_animateLights = false, float time = 0);
 	void CreateCSGTree(std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 	void CreateAABBPrimitiveAttributesBuffers(std::unique_ptr<DX::DeviceResources>& m_deviceResources);
+	void CreateMaterialTable(std::unique_ptr<DX::DeviceResources>& m_deviceResources);
+	MaterialTableChange::Enum ReloadMaterials(std::unique_ptr<DX::DeviceResources>& m_deviceResources);
 
 
 	void releaseResources();
@@ -73,12 +93,15 @@ public:
 
 	XMVECTOR getCameraPosition();
 
+	CameraPath::State getCameraState();
+	void setCameraState(const CameraPath::State& state);
+	float getCameraFovY();
+
 	ConstantBuffer<SceneConstantBuffer>* getSceneBuffer();
 	D3DBuffer* getAABB();
 	StructuredBuffer<PrimitiveInstancePerFrameBuffer>* getPrimitiveAttributes();
 	StructuredBuffer<CSGNode>* getCSGTree();
-	void CreateSpheres();
-	void CreateGeometry();
+	D3D12_GPU_VIRTUAL_ADDRESS getMaterialTable();
 	UINT CreateBufferSRV(std::unique_ptr<DX::DeviceResources> m_deviceResources, D3DBuffer* buffer, uint32_t numElements, UINT elementSize);
 };
 
@@ -0,0 +1,735 @@
+#include "SceneFile.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace SceneFile {
+
+    namespace {
+        // In the order of the enums in RayTracingHlslCompat.h; Scene static_asserts the counts.
+        const char* const analyticNames[] = {
+            "aabb", "plane", "spheres", "sphere", "cone", "ellipsoid", "hyperboloid", "cylinder",
+            "paraboloid", "cornell_back", "cornell_top", "cornell_bottom", "cornell_left",
+            "cornell_right", "csg_difference", "csg_intersection", "csg_union", "big_cylinder",
+            "small_cylinder", "point_light_sphere", "blobs", "smallest_cylinder",
+        };
+        const char* const signedDistanceNames[] = {
+            "mini_spheres", "intersected_round_cube", "square_torus", "twisted_torus", "cog",
+            "metaballs", "quaternion_julia", "cylinder",
+        };
+        const char* const csgNames[] = { "csg" };
+        const char* const kindNames[PrimitiveKind::Count] = { "analytic", "sdf", "csg" };
+        const char* const* const typeNames[PrimitiveKind::Count] = { analyticNames, signedDistanceNames, csgNames };
+        const uint32_t typeCounts[PrimitiveKind::Count] = {
+            sizeof(analyticNames) / sizeof(analyticNames[0]),
+            sizeof(signedDistanceNames) / sizeof(signedDistanceNames[0]),
+            sizeof(csgNames) / sizeof(csgNames[0]),
+        };
+
+        const uint32_t recordSizes[Section::Count] = {
+            sizeof(Settings), sizeof(Material), sizeof(Primitive), sizeof(CsgNode),
+            sizeof(Light), sizeof(Mesh), sizeof(PointCloud), 1,
+        };
+
+        bool Fail(std::string* error, const std::string& message)
+        {
+            if (error) {
+                *error = message;
+            }
+            return false;
+        }
+
+        int FindName(const char* const* names, uint32_t count, const std::string& name)
+        {
+            for (uint32_t i = 0; i < count; i++) {
+                if (name == names[i]) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+
+        bool IsNumber(const std::string& token)
+        {
+            if (token.empty()) {
+                return false;
+            }
+            char* end = nullptr;
+            std::strtod(token.c_str(), &end);
+            return *end == '\0';
+        }
+
+        // Whitespace separated, '#' to the end of the line, "quotes" for paths with spaces.
+        std::vector<std::string> Tokenize(const std::string& line)
+        {
+            std::vector<std::string> tokens;
+            size_t i = 0;
+            while (i < line.size()) {
+                char c = line[i];
+                if (c == '#') {
+                    break;
+                }
+                if (c == ' ' || c == '\t' || c == '\r') {
+                    i++;
+                }
+                else if (c == '"') {
+                    size_t end = line.find('"', i + 1);
+                    end = end == std::string::npos ? line.size() : end;
+                    tokens.push_back(line.substr(i + 1, end - i - 1));
+                    i = end + 1;
+                }
+                else {
+                    size_t end = line.find_first_of(" \t\r#", i);
+                    end = end == std::string::npos ? line.size() : end;
+                    tokens.push_back(line.substr(i, end - i));
+                    i = end;
+                }
+            }
+            return tokens;
+        }
+
+        struct Description {
+            Settings settings = {};
+            std::vector<Material> materials;
+            std::vector<std::string> materialNames;
+            std::vector<Primitive> primitives;
+            std::vector<CsgNode> csgNodes;
+            std::vector<uint32_t> csgLines;
+            std::vector<Light> lights;
+            std::vector<Mesh> meshes;
+            std::vector<PointCloud> pointClouds;
+            uint32_t pointCloudLine = 0;
+            uint64_t instanceCount = 0;
+            std::string strings;
+
+            uint32_t AddString(const std::string& s)
+            {
+                uint32_t offset = static_cast<uint32_t>(strings.size());
+                strings += s;
+                strings.push_back('\0');
+                return offset;
+            }
+        };
+
+        class LineParser
+        {
+        public:
+            LineParser(const std::vector<std::string>& tokens, uint32_t line, std::string* error)
+                : m_tokens(tokens), m_line(line), m_error(error), m_next(1) {}
+
+            bool Failed(const std::string& message) const
+            {
+                return Fail(m_error, "line " + std::to_string(m_line) + ": " + message);
+            }
+            bool Done() const { return m_next >= m_tokens.size(); }
+            bool PeekNumber() const { return !Done() && IsNumber(m_tokens[m_next]); }
+
+            bool Word(std::string& out, const char* what)
+            {
+                if (Done()) {
+                    return Failed(std::string("expected ") + what + " after '" + m_tokens[m_next - 1] + "'");
+                }
+                out = m_tokens[m_next++];
+                return true;
+            }
+
+            bool Floats(float* out, uint32_t count, const std::string& key)
+            {
+                for (uint32_t i = 0; i < count; i++) {
+                    if (!PeekNumber()) {
+                        return Failed("'" + key + "' takes " + std::to_string(count) + " number" + (count > 1 ? "s" : ""));
+                    }
+                    out[i] = static_cast<float>(std::strtod(m_tokens[m_next++].c_str(), nullptr));
+                }
+                return true;
+            }
+
+            bool Int(int32_t& out, const std::string& key)
+            {
+                float value;
+                if (!Floats(&value, 1, key)) {
+                    return false;
+                }
+                out = static_cast<int32_t>(value);
+                if (static_cast<float>(out) != value) {
+                    return Failed("'" + key + "' takes an integer");
+                }
+                return true;
+            }
+
+            bool MaterialRef(const Description& d, uint32_t& out)
+            {
+                std::string name;
+                if (!Word(name, "a material name")) {
+                    return false;
+                }
+                int index = FindName(d.materialNames, name);
+                if (index < 0) {
+                    return Failed("material '" + name + "' is not defined (materials must come before their first use)");
+                }
+                out = static_cast<uint32_t>(index);
+                return true;
+            }
+
+            uint32_t Line() const { return m_line; }
+
+        private:
+            const std::vector<std::string>& m_tokens;
+            uint32_t m_line;
+            std::string* m_error;
+            size_t m_next;
+
+            static int FindName(const std::vector<std::string>& names, const std::string& name)
+            {
+                for (size_t i = 0; i < names.size(); i++) {
+                    if (names[i] == name) {
+                        return static_cast<int>(i);
+                    }
+                }
+                return -1;
+            }
+        };
+
+        bool ParseMaterial(LineParser& p, Description& d)
+        {
+            std::string name;
+            if (!p.Word(name, "a material name")) {
+                return false;
+            }
+            for (const std::string& existing : d.materialNames) {
+                if (existing == name) {
+                    return p.Failed("material '" + name + "' is defined twice");
+                }
+            }
+            // Same defaults as the SetAttributes helper this replaces.
+            Material m = { { 1.0f, 1.0f, 1.0f, 0.0f }, 0.0f, 0.0f, 0.9f, 0.7f, 50.0f, 1.0f };
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "albedo") ok = p.Floats(m.albedo, 4, key);
+                else if (key == "reflectance") ok = p.Floats(&m.reflectanceCoef, 1, key);
+                else if (key == "refraction") ok = p.Floats(&m.refractiveCoef, 1, key);
+                else if (key == "diffuse") ok = p.Floats(&m.diffuseCoef, 1, key);
+                else if (key == "specular") ok = p.Floats(&m.specularCoef, 1, key);
+                else if (key == "power") ok = p.Floats(&m.specularPower, 1, key);
+                else if (key == "step") ok = p.Floats(&m.stepScale, 1, key);
+                else ok = p.Failed("unknown material option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            d.materials.push_back(m);
+            d.materialNames.push_back(name);
+            return true;
+        }
+
+        bool ParsePrimitive(LineParser& p, Description& d)
+        {
+            std::string kindName, typeName;
+            if (!p.Word(kindName, "a primitive kind") || !p.Word(typeName, "a primitive type")) {
+                return false;
+            }
+            int kind = FindName(kindNames, PrimitiveKind::Count, kindName);
+            if (kind < 0) {
+                return p.Failed("unknown primitive kind '" + kindName + "' (analytic, sdf or csg)");
+            }
+            int type = FindName(typeNames[kind], typeCounts[kind], typeName);
+            if (type < 0) {
+                return p.Failed("unknown " + kindName + " primitive '" + typeName + "'");
+            }
+            Primitive prim = { static_cast<uint32_t>(kind), static_cast<uint32_t>(type), UINT32_MAX,
+                { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, 0.0f,
+                { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f } };
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "material") ok = p.MaterialRef(d, prim.material);
+                else if (key == "offset") ok = p.Floats(prim.offset, 3, key);
+                else if (key == "size") ok = p.Floats(prim.size, 3, key);
+                else if (key == "spin") ok = p.Floats(&prim.spin, 1, key);
+                else if (key == "spacing") ok = p.Floats(prim.spacing, 3, key);
+                else if (key == "grid") {
+                    int32_t counts[3] = {};
+                    ok = p.Int(counts[0], key) && p.Int(counts[1], key) && p.Int(counts[2], key);
+                    if (ok && (counts[0] <= 0 || counts[1] <= 0 || counts[2] <= 0)) {
+                        ok = p.Failed("grid counts must be positive");
+                    }
+                    for (int i = 0; ok && i < 3; i++) {
+                        prim.grid[i] = static_cast<uint32_t>(counts[i]);
+                    }
+                }
+                else if (key == "scale") {
+                    // One uniform factor or three.
+                    ok = p.Floats(prim.scale, 1, key);
+                    if (ok && p.PeekNumber()) {
+                        ok = p.Floats(prim.scale + 1, 2, key);
+                    }
+                    else {
+                        prim.scale[1] = prim.scale[2] = prim.scale[0];
+                    }
+                }
+                else ok = p.Failed("unknown primitive option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            if (prim.material == UINT32_MAX) {
+                return p.Failed("primitive needs a material");
+            }
+            if (prim.size[0] <= 0.0f || prim.size[1] <= 0.0f || prim.size[2] <= 0.0f) {
+                return p.Failed("primitive size must be positive");
+            }
+            d.instanceCount += InstanceCount(prim);
+            if (d.instanceCount > MaxInstances) {
+                return p.Failed("more than " + std::to_string(MaxInstances) + " procedural instances");
+            }
+            d.primitives.push_back(prim);
+            return true;
+        }
+
+        bool ParseCsgNode(LineParser& p, Description& d)
+        {
+            static const char* const ops[CsgOp::Count] = { "union", "intersection", "difference" };
+            std::string opName;
+            if (!p.Word(opName, "leaf, union, intersection or difference")) {
+                return false;
+            }
+            CsgNode node = { CsgOp::Leaf, -1, -1, -1, -1, { 0.0f, 0.0f, 0.0f } };
+            if (opName != "leaf") {
+                int op = FindName(ops, CsgOp::Count, opName);
+                if (op < 0) {
+                    return p.Failed("unknown csg operation '" + opName + "'");
+                }
+                node.op = op;
+            }
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "geometry") {
+                    std::string name;
+                    ok = p.Word(name, "an analytic primitive type");
+                    if (ok) {
+                        node.geometry = FindName(analyticNames, typeCounts[PrimitiveKind::Analytic], name);
+                        ok = node.geometry >= 0 || p.Failed("unknown analytic primitive '" + name + "'");
+                    }
+                }
+                else if (key == "parent") ok = p.Int(node.parent, key);
+                else if (key == "left") ok = p.Int(node.left, key);
+                else if (key == "right") ok = p.Int(node.right, key);
+                else if (key == "translate") ok = p.Floats(node.translation, 3, key);
+                else ok = p.Failed("unknown csg option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            if ((node.op == CsgOp::Leaf) != (node.geometry >= 0)) {
+                return p.Failed(node.op == CsgOp::Leaf ? "a csg leaf needs a geometry" : "only csg leaves have a geometry");
+            }
+            d.csgNodes.push_back(node);
+            d.csgLines.push_back(p.Line());
+            return true;
+        }
+
+        bool ParseLight(LineParser& p, Description& d)
+        {
+            if (!d.lights.empty()) {
+                return p.Failed("the renderer supports a single light");
+            }
+            Light light = { { 0.0f, 10.0f, 0.0f }, { 0.0f, 10.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, 1.0f };
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "position") ok = p.Floats(light.position, 3, key);
+                else if (key == "sphere") ok = p.Floats(light.sphere, 4, key);
+                else if (key == "ambient") ok = p.Floats(light.ambient, 4, key);
+                else if (key == "diffuse") ok = p.Floats(light.diffuse, 4, key);
+                else if (key == "power") ok = p.Floats(&light.power, 1, key);
+                else ok = p.Failed("unknown light option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            d.lights.push_back(light);
+            return true;
+        }
+
+        bool ParseMesh(LineParser& p, Description& d)
+        {
+            std::string kindName;
+            if (!p.Word(kindName, "plane or obj")) {
+                return false;
+            }
+            Mesh mesh = { MeshKind::Plane, NoString, UINT32_MAX };
+            if (kindName == "obj") {
+                std::string path;
+                if (!p.Word(path, "a path")) {
+                    return false;
+                }
+                mesh.kind = MeshKind::Obj;
+                mesh.path = d.AddString(path);
+            }
+            else if (kindName != "plane") {
+                return p.Failed("unknown mesh '" + kindName + "' (plane or obj)");
+            }
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "material") ok = p.MaterialRef(d, mesh.material);
+                else ok = p.Failed("unknown mesh option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            if (mesh.material == UINT32_MAX) {
+                return p.Failed("mesh needs a material");
+            }
+            d.meshes.push_back(mesh);
+            return true;
+        }
+
+        bool ParsePointCloud(LineParser& p, Description& d)
+        {
+            if (!d.pointClouds.empty()) {
+                return p.Failed("only one point cloud per scene");
+            }
+            std::string path;
+            if (!p.Word(path, "a .ply path")) {
+                return false;
+            }
+            PointCloud cloud = { d.AddString(path), PointCloudInstance::Procedural, 10.0f, 1.0f, NoMaterial, 0.0f };
+            while (!p.Done()) {
+                std::string key;
+                p.Word(key, "");
+                bool ok;
+                if (key == "instance") {
+                    std::string what;
+                    ok = p.Word(what, "procedural or mesh");
+                    if (ok) {
+                        if (what == "procedural") cloud.instance = PointCloudInstance::Procedural;
+                        else if (what == "mesh") cloud.instance = PointCloudInstance::Mesh;
+                        else ok = p.Failed("point clouds instance procedural or mesh, not '" + what + "'");
+                    }
+                }
+                else if (key == "spacing") ok = p.Floats(&cloud.spacing, 1, key);
+                else if (key == "scale") ok = p.Floats(&cloud.scale, 1, key);
+                else if (key == "material") ok = p.MaterialRef(d, cloud.material);
+                else if (key == "lod") {
+                    ok = p.Floats(&cloud.lodPixels, 1, key);
+                    if (ok && !(cloud.lodPixels >= 0.0f)) {
+                        ok = p.Failed("lod is a size in pixels, 0 or more");
+                    }
+                }
+                else ok = p.Failed("unknown pointcloud option '" + key + "'");
+                if (!ok) {
+                    return false;
+                }
+            }
+            d.pointClouds.push_back(cloud);
+            d.pointCloudLine = p.Line();
+            return true;
+        }
+
+        bool ParseScatter(LineParser& p, Description& d)
+        {
+            int32_t count;
+            if (!p.Int(count, "scatter")) {
+                return false;
+            }
+            if (count <= 0 || !p.Done()) {
+                return p.Failed("scatter takes a single positive instance count");
+            }
+            d.settings.scatterCount = static_cast<uint32_t>(count);
+            return true;
+        }
+
+        // Checks that need the whole file.
+        bool Validate(const Description& d, std::string* error)
+        {
+            bool hasCsgPrimitive = false;
+            for (const Primitive& prim : d.primitives) {
+                hasCsgPrimitive = hasCsgPrimitive || prim.kind == PrimitiveKind::Csg;
+            }
+            if (hasCsgPrimitive && d.csgNodes.empty()) {
+                return Fail(error, "the csg primitive needs at least one csg node");
+            }
+            if (!hasCsgPrimitive && !d.csgNodes.empty()) {
+                return Fail(error, "line " + std::to_string(d.csgLines[0]) + ": csg nodes without a csg primitive");
+            }
+            int32_t nodeCount = static_cast<int32_t>(d.csgNodes.size());
+            for (size_t i = 0; i < d.csgNodes.size(); i++) {
+                const CsgNode& node = d.csgNodes[i];
+                const int32_t links[3] = { node.parent, node.left, node.right };
+                for (int32_t link : links) {
+                    if (link < -1 || link >= nodeCount) {
+                        return Fail(error, "line " + std::to_string(d.csgLines[i]) + ": csg node " + std::to_string(link) +
+                            " does not exist (there are " + std::to_string(nodeCount) + ")");
+                    }
+                }
+            }
+            if (d.meshes.empty()) {
+                return Fail(error, "a scene needs at least one mesh for the triangle BLAS (e.g. 'mesh plane material ...')");
+            }
+            if (!d.pointClouds.empty()) {
+                std::string where = "line " + std::to_string(d.pointCloudLine) + ": ";
+                if (d.settings.scatterCount > 0) {
+                    return Fail(error, where + "a scene can use a point cloud or scatter, not both");
+                }
+                if (d.pointClouds[0].instance == PointCloudInstance::Mesh && d.meshes[0].kind != MeshKind::Obj) {
+                    return Fail(error, where + "instancing meshes needs an obj mesh first");
+                }
+            }
+            return true;
+        }
+
+        template <typename T>
+        void AppendSection(std::vector<uint8_t>& image, Header& header, Section::Enum section, const T* records, size_t count)
+        {
+            image.resize((image.size() + 3) & ~static_cast<size_t>(3), 0);
+            header.sections[section].offset = static_cast<uint32_t>(image.size());
+            header.sections[section].count = static_cast<uint32_t>(count);
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(records);
+            image.insert(image.end(), bytes, bytes + count * sizeof(T));
+        }
+
+        bool ReadFile(const std::string& path, std::vector<uint8_t>& bytes)
+        {
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in) {
+                return false;
+            }
+            std::streamoff size = in.tellg();
+            in.seekg(0);
+            bytes.resize(static_cast<size_t>(size));
+            return size == 0 || static_cast<bool>(in.read(reinterpret_cast<char*>(bytes.data()), size));
+        }
+    }
+
+    uint32_t TypeCount(PrimitiveKind::Enum kind)
+    {
+        return typeCounts[kind];
+    }
+
+    const char* TypeName(PrimitiveKind::Enum kind, uint32_t type)
+    {
+        return type < typeCounts[kind] ? typeNames[kind][type] : "unknown";
+    }
+
+    bool Compile(const std::string& text, std::vector<uint8_t>& image, std::string* error)
+    {
+        Description d;
+        std::istringstream in(text);
+        std::string line;
+        uint32_t lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            std::vector<std::string> tokens = Tokenize(line);
+            if (tokens.empty()) {
+                continue;
+            }
+            LineParser p(tokens, lineNumber, error);
+            const std::string& keyword = tokens[0];
+            bool ok;
+            if (keyword == "material") ok = ParseMaterial(p, d);
+            else if (keyword == "primitive") ok = ParsePrimitive(p, d);
+            else if (keyword == "csg") ok = ParseCsgNode(p, d);
+            else if (keyword == "light") ok = ParseLight(p, d);
+            else if (keyword == "mesh") ok = ParseMesh(p, d);
+            else if (keyword == "pointcloud") ok = ParsePointCloud(p, d);
+            else if (keyword == "scatter") ok = ParseScatter(p, d);
+            else ok = p.Failed("unknown keyword '" + keyword + "'");
+            if (!ok) {
+                return false;
+            }
+        }
+        if (!Validate(d, error)) {
+            return false;
+        }
+
+        Header header = {};
+        header.magic = Magic;
+        header.version = Version;
+        image.assign(sizeof(Header), 0);
+        AppendSection(image, header, Section::Settings, &d.settings, 1);
+        AppendSection(image, header, Section::Materials, d.materials.data(), d.materials.size());
+        AppendSection(image, header, Section::Primitives, d.primitives.data(), d.primitives.size());
+        AppendSection(image, header, Section::CsgNodes, d.csgNodes.data(), d.csgNodes.size());
+        AppendSection(image, header, Section::Lights, d.lights.data(), d.lights.size());
+        AppendSection(image, header, Section::Meshes, d.meshes.data(), d.meshes.size());
+        AppendSection(image, header, Section::PointClouds, d.pointClouds.data(), d.pointClouds.size());
+        AppendSection(image, header, Section::Strings, d.strings.data(), d.strings.size());
+        header.size = static_cast<uint32_t>(image.size());
+        std::memcpy(image.data(), &header, sizeof(Header));
+        return true;
+    }
+
+    bool CompileFile(const std::string& sourcePath, const std::string& imagePath, std::string* error)
+    {
+        std::vector<uint8_t> source;
+        if (!ReadFile(sourcePath, source)) {
+            return Fail(error, "can't read " + sourcePath);
+        }
+        std::vector<uint8_t> image;
+        if (!Compile(std::string(source.begin(), source.end()), image, error)) {
+            if (error) {
+                *error = sourcePath + ", " + *error;
+            }
+            return false;
+        }
+        std::ofstream out(imagePath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(image.data()), image.size());
+        return static_cast<bool>(out) || Fail(error, "can't write " + imagePath);
+    }
+
+    bool CompiledScene::Load(const std::string& imagePath, std::string* error)
+    {
+        std::vector<uint8_t> image;
+        if (!ReadFile(imagePath, image)) {
+            return Fail(error, "can't read " + imagePath);
+        }
+        return Attach(std::move(image), error);
+    }
+
+    bool CompiledScene::Attach(std::vector<uint8_t>&& image, std::string* error)
+    {
+        m_image.clear();
+        if (image.size() < sizeof(Header)) {
+            return Fail(error, "scene image is truncated");
+        }
+        Header header;
+        std::memcpy(&header, image.data(), sizeof(Header));
+        if (header.magic != Magic) {
+            return Fail(error, "not a compiled scene");
+        }
+        if (header.version != Version) {
+            return Fail(error, "compiled scene is version " + std::to_string(header.version) + ", expected " + std::to_string(Version));
+        }
+        if (header.size != image.size()) {
+            return Fail(error, "scene image is truncated");
+        }
+        for (uint32_t s = 0; s < Section::Count; s++) {
+            const SectionEntry& section = header.sections[s];
+            if (section.offset % 4 != 0 || section.offset < sizeof(Header) ||
+                section.offset + static_cast<uint64_t>(section.count) * recordSizes[s] > image.size()) {
+                return Fail(error, "scene image has a bad section table");
+            }
+        }
+        if (header.sections[Section::Settings].count != 1) {
+            return Fail(error, "scene image has no settings");
+        }
+        const SectionEntry& strings = header.sections[Section::Strings];
+        if (strings.count > 0 && image[strings.offset + strings.count - 1] != 0) {
+            return Fail(error, "scene image has an unterminated string table");
+        }
+
+        // References are checked once here so the renderer can index without checks.
+        m_image = std::move(image);
+        uint32_t materials = Count(Section::Materials);
+        auto validString = [&](uint32_t offset) { return offset < strings.count; };
+        uint64_t instances = 0;
+        for (uint32_t i = 0; i < Count(Section::Primitives); i++) {
+            const Primitive& prim = Primitives()[i];
+            instances += InstanceCount(prim);
+            if (prim.kind >= PrimitiveKind::Count || prim.type >= typeCounts[prim.kind] || prim.material >= materials ||
+                InstanceCount(prim) == 0 || instances > MaxInstances) {
+                m_image.clear();
+                return Fail(error, "scene image has a bad primitive");
+            }
+        }
+        int32_t nodes = static_cast<int32_t>(Count(Section::CsgNodes));
+        for (int32_t i = 0; i < nodes; i++) {
+            const CsgNode& node = CsgNodes()[i];
+            bool ok = node.op >= CsgOp::Leaf && node.op < CsgOp::Count &&
+                node.geometry < static_cast<int32_t>(typeCounts[PrimitiveKind::Analytic]) &&
+                node.parent >= -1 && node.parent < nodes && node.left >= -1 && node.left < nodes &&
+                node.right >= -1 && node.right < nodes;
+            if (!ok) {
+                m_image.clear();
+                return Fail(error, "scene image has a bad csg node");
+            }
+        }
+        for (uint32_t i = 0; i < Count(Section::Meshes); i++) {
+            const Mesh& mesh = Meshes()[i];
+            if (mesh.kind >= MeshKind::Count || mesh.material >= materials || (mesh.kind == MeshKind::Obj && !validString(mesh.path))) {
+                m_image.clear();
+                return Fail(error, "scene image has a bad mesh");
+            }
+        }
+        for (uint32_t i = 0; i < Count(Section::PointClouds); i++) {
+            const PointCloud& cloud = PointClouds()[i];
+            if (cloud.instance >= PointCloudInstance::Count || !validString(cloud.path) || !(cloud.lodPixels >= 0.0f) ||
+                (cloud.material != NoMaterial && cloud.material >= materials)) {
+                m_image.clear();
+                return Fail(error, "scene image has a bad point cloud");
+            }
+        }
+        return true;
+    }
+
+    const char* CompiledScene::String(uint32_t offset) const
+    {
+        const SectionEntry& strings = GetHeader().sections[Section::Strings];
+        return offset < strings.count ? reinterpret_cast<const char*>(m_image.data() + strings.offset + offset) : "";
+    }
+
+    bool ModifiedTime(const std::string& path, int64_t& time)
+    {
+#ifdef _WIN32
+        struct _stat64 s;
+        if (_stat64(path.c_str(), &s) != 0) {
+            return false;
+        }
+#else
+        struct stat s;
+        if (stat(path.c_str(), &s) != 0) {
+            return false;
+        }
+#endif
+        time = static_cast<int64_t>(s.st_mtime);
+        return true;
+    }
+
+    bool LoadOrCompile(const std::string& sourcePath, const std::string& imagePath, CompiledScene& scene, std::string* error)
+    {
+        int64_t sourceTime = 0, imageTime = 0;
+        bool haveSource = ModifiedTime(sourcePath, sourceTime);
+        bool haveImage = ModifiedTime(imagePath, imageTime);
+        if (haveImage && (!haveSource || imageTime >= sourceTime)) {
+            std::string loadError;
+            if (scene.Load(imagePath, &loadError)) {
+                return true;
+            }
+            if (!haveSource) {
+                return Fail(error, imagePath + ": " + loadError);
+            }
+            // Stale format: fall through and rebuild it from the source.
+        }
+        if (!haveSource) {
+            return Fail(error, "neither " + sourcePath + " nor " + imagePath + " exists");
+        }
+
+        std::vector<uint8_t> source;
+        std::vector<uint8_t> image;
+        if (!ReadFile(sourcePath, source)) {
+            return Fail(error, "can't read " + sourcePath);
+        }
+        if (!Compile(std::string(source.begin(), source.end()), image, error)) {
+            if (error) {
+                *error = sourcePath + ", " + *error;
+            }
+            return false;
+        }
+        // Cache the image for the next start; failing to write it isn't fatal.
+        std::ofstream out(imagePath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(image.data()), image.size());
+        return scene.Attach(std::move(image), error);
+    }
+}
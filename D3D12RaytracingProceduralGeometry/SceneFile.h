@@ -0,0 +1,204 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// SceneFile.h
+//
+// Scene descriptions. A scene is written as text (see Scenes/default.scene for the format)
+// and compiled into a flat binary image: a header with a table of sections, each an array of
+// fixed-size records, and a string table for paths. Compile() validates the text and reports
+// the first error with its line number. A CompiledScene is the image read in one go; records
+// are used in place, without any parsing. Nothing here depends on D3D12 - Scene translates
+// the records into materials, AABBs, transforms and CSG nodes.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SceneFile {
+
+    static const uint32_t Magic = 0x4e435348;   // "HSCN"
+    static const uint32_t Version = 4;
+
+    namespace Section {
+        enum Enum {
+            Settings = 0,
+            Materials,
+            Primitives,
+            CsgNodes,
+            Lights,
+            Meshes,
+            PointClouds,
+            Strings,
+            Count
+        };
+    }
+
+    // Which intersection shader family a primitive uses; the type indexes the matching enum
+    // in RayTracingHlslCompat.h (AnalyticPrimitive, SignedDistancePrimitive, CSGPrimitive).
+    namespace PrimitiveKind {
+        enum Enum {
+            Analytic = 0,
+            SignedDistance,
+            Csg,
+            Count
+        };
+    }
+
+    // The values CSGCombine in Raytracing.hlsl switches on.
+    namespace CsgOp {
+        enum Enum {
+            Leaf = -1,
+            Union = 0,
+            Intersection,
+            Difference,         // Left minus right.
+            Count
+        };
+    }
+
+    namespace MeshKind {
+        enum Enum {
+            Plane = 0,
+            Obj,
+            Count
+        };
+    }
+
+    namespace PointCloudInstance {
+        enum Enum {
+            Procedural = 0,     // Each point instances the procedural geometry BLAS.
+            Mesh,               // Each point instances the triangle BLAS.
+            Count
+        };
+    }
+
+    static const uint32_t NoString = UINT32_MAX;
+    static const uint32_t NoMaterial = UINT32_MAX;
+    static const uint32_t MaxInstances = 1 << 20;   // Procedural instances over all primitive lines.
+
+    struct SectionEntry {
+        uint32_t offset;        // From the start of the image.
+        uint32_t count;         // Records, or bytes for the string table.
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        SectionEntry sections[Section::Count];
+    };
+
+    struct Settings {
+        uint32_t scatterCount;  // Randomly placed instances of the procedural BLAS, 0 for none.
+    };
+
+    // Same fields and order as PrimitiveConstantBuffer.
+    struct Material {
+        float albedo[4];
+        float reflectanceCoef;
+        float refractiveCoef;
+        float diffuseCoef;
+        float specularCoef;
+        float specularPower;
+        float stepScale;
+    };
+
+    // A primitive line places grid[0] * grid[1] * grid[2] instances, spacing apart, starting
+    // at offset. Any number of lines can use the same type.
+    struct Primitive {
+        uint32_t kind;
+        uint32_t type;
+        uint32_t material;
+        float offset[3];        // AABB grid position, in units of the AABB stride.
+        float size[3];          // AABB size when not spinning.
+        float scale[3];
+        float spin;             // Radians about Y per unit of animation time.
+        uint32_t grid[3];
+        float spacing[3];       // Between grid instances, in world units.
+    };
+
+    // Instances placed by a primitive record.
+    inline uint64_t InstanceCount(const Primitive& primitive)
+    {
+        return static_cast<uint64_t>(primitive.grid[0]) * primitive.grid[1] * primitive.grid[2];
+    }
+
+    // Same fields as CSGNode; the node's index is its position in the section.
+    struct CsgNode {
+        int32_t op;
+        int32_t geometry;       // AnalyticPrimitive type of a leaf, -1 otherwise.
+        int32_t parent;
+        int32_t left;
+        int32_t right;
+        float translation[3];
+    };
+
+    struct Light {
+        float position[3];
+        float sphere[4];        // Centre and radius of the area light.
+        float ambient[4];
+        float diffuse[4];
+        float power;
+    };
+
+    struct Mesh {
+        uint32_t kind;
+        uint32_t path;          // String offset, NoString for built-in meshes.
+        uint32_t material;
+    };
+
+    struct PointCloud {
+        uint32_t path;
+        uint32_t instance;
+        float spacing;          // Point positions are scaled by this to place instances.
+        float scale;
+        uint32_t material;      // Given to every instance in place of the geometry's own, or NoMaterial.
+        float lodPixels;        // Octree cells smaller than this on screen merge into one instance; 0 keeps every point.
+    };
+
+    uint32_t TypeCount(PrimitiveKind::Enum kind);
+    const char* TypeName(PrimitiveKind::Enum kind, uint32_t type);
+
+    // Text to binary image. Returns false and sets error ("line N: ...") on the first problem.
+    bool Compile(const std::string& text, std::vector<uint8_t>& image, std::string* error = nullptr);
+    bool CompileFile(const std::string& sourcePath, const std::string& imagePath, std::string* error = nullptr);
+
+    class CompiledScene
+    {
+    public:
+        // One read of the whole file. Fails on a bad header or out-of-range references.
+        bool Load(const std::string& imagePath, std::string* error = nullptr);
+        // Takes ownership of an image already in memory, with the same checks as Load.
+        bool Attach(std::vector<uint8_t>&& image, std::string* error = nullptr);
+        bool IsLoaded() const { return !m_image.empty(); }
+
+        const Settings& GetSettings() const { return *Records<Settings>(Section::Settings); }
+        const Material* Materials() const { return Records<Material>(Section::Materials); }
+        const Primitive* Primitives() const { return Records<Primitive>(Section::Primitives); }
+        const CsgNode* CsgNodes() const { return Records<CsgNode>(Section::CsgNodes); }
+        const Light* Lights() const { return Records<Light>(Section::Lights); }
+        const Mesh* Meshes() const { return Records<Mesh>(Section::Meshes); }
+        const PointCloud* PointClouds() const { return Records<PointCloud>(Section::PointClouds); }
+        uint32_t Count(Section::Enum section) const { return GetHeader().sections[section].count; }
+        const char* String(uint32_t offset) const;
+
+    private:
+        std::vector<uint8_t> m_image;
+
+        const Header& GetHeader() const { return *reinterpret_cast<const Header*>(m_image.data()); }
+        template <typename T>
+        const T* Records(Section::Enum section) const
+        {
+            return reinterpret_cast<const T*>(m_image.data() + GetHeader().sections[section].offset);
+        }
+    };
+
+    // Seconds since the epoch of the file's last write; false if it doesn't exist.
+    bool ModifiedTime(const std::string& path, int64_t& time);
+
+    // Loads imagePath, recompiling it first if sourcePath is newer or the image is missing
+    // or out of date. With an up-to-date image this is a single read.
+    bool LoadOrCompile(const std::string& sourcePath, const std::string& imagePath, CompiledScene& scene, std::string* error = nullptr);
+}
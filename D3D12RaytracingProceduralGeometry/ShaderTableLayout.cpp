@@ -0,0 +1,145 @@
+#include "ShaderTableLayout.h"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+    uint64_t AlignUp(uint64_t size, uint64_t alignment)
+    {
+        return (size + (alignment - 1)) & ~(alignment - 1);
+    }
+
+    struct PendingRecord {
+        const std::wstring* exportName;
+        const std::vector<uint8_t>* rootArguments;
+    };
+
+    std::string Narrow(const std::wstring& s)
+    {
+        std::string out;
+        for (wchar_t c : s) {
+            out.push_back(c < 128 ? static_cast<char>(c) : '?');
+        }
+        return out;
+    }
+
+    bool Fail(std::string* error, const std::string& message)
+    {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+}
+
+const void* StubShaderIdentifierProvider::GetShaderIdentifier(const wchar_t* exportName)
+{
+    std::wstring name(exportName);
+    if (!m_exports.empty()) {
+        bool known = false;
+        for (const std::wstring& e : m_exports) {
+            known = known || e == name;
+        }
+        if (!known) {
+            return nullptr;
+        }
+    }
+
+    std::vector<uint8_t>& id = m_identifiers[name];
+    if (id.empty()) {
+        // FNV-1a over the name, stretched to the identifier size with a second round per word.
+        uint32_t hash = 2166136261u;
+        for (wchar_t c : name) {
+            hash = (hash ^ static_cast<uint32_t>(c)) * 16777619u;
+        }
+        id.resize(ShaderIdentifierSize);
+        for (uint32_t i = 0; i < ShaderIdentifierSize; i += 4) {
+            hash = (hash ^ i) * 16777619u;
+            std::memcpy(&id[i], &hash, 4);
+        }
+    }
+    return id.data();
+}
+
+bool ShaderTableLayout::Build(const ShaderTableLayoutDesc& desc, ShaderIdentifierProvider& identifiers, std::string* error)
+{
+    static const std::vector<uint8_t> noArguments;
+    std::vector<PendingRecord> pending[ShaderTableType::Count];
+
+    // Gather the records of each table in order.
+    PendingRecord rayGen = { &desc.rayGen, &desc.rayGenRootArguments };
+    pending[ShaderTableType::RayGen].push_back(rayGen);
+
+    if (!desc.missRootArguments.empty() && desc.missRootArguments.size() != desc.missShaders.size()) {
+        return Fail(error, "missRootArguments must be empty or match missShaders");
+    }
+    for (size_t i = 0; i < desc.missShaders.size(); i++) {
+        PendingRecord miss = { &desc.missShaders[i], desc.missRootArguments.empty() ? &noArguments : &desc.missRootArguments[i] };
+        pending[ShaderTableType::Miss].push_back(miss);
+    }
+
+    geometryFirstRecord.clear();
+    for (const HitGroupGeometryDesc& geometry : desc.geometries) {
+        if (geometry.hitGroups.size() != desc.missShaders.size()) {
+            return Fail(error, "every geometry needs one hit group per ray type (miss shader)");
+        }
+        geometryFirstRecord.push_back(static_cast<uint32_t>(pending[ShaderTableType::HitGroup].size()));
+        for (const std::vector<uint8_t>& rootArguments : geometry.primitiveRootArguments) {
+            for (const std::wstring& hitGroup : geometry.hitGroups) {
+                PendingRecord record = { &hitGroup, &rootArguments };
+                pending[ShaderTableType::HitGroup].push_back(record);
+            }
+        }
+    }
+
+    // Each table gets the smallest stride that fits its own largest record.
+    uint64_t offset = 0;
+    for (uint32_t t = 0; t < ShaderTableType::Count; t++) {
+        size_t maxArguments = 0;
+        for (const PendingRecord& record : pending[t]) {
+            maxArguments = (std::max)(maxArguments, record.rootArguments->size());
+        }
+        ShaderTableRange& range = tables[t];
+        range.offset = offset;
+        range.count = static_cast<uint32_t>(pending[t].size());
+        range.stride = static_cast<uint32_t>(AlignUp(ShaderIdentifierSize + maxArguments, ShaderRecordAlignment));
+        range.size = static_cast<uint64_t>(range.stride) * range.count;
+        offset = AlignUp(offset + range.size, ShaderTableAlignment);
+    }
+
+    image.assign(static_cast<size_t>(tables[ShaderTableType::HitGroup].offset + tables[ShaderTableType::HitGroup].size), 0);
+    for (uint32_t t = 0; t < ShaderTableType::Count; t++) {
+        m_records[t].clear();
+        for (uint32_t i = 0; i < pending[t].size(); i++) {
+            const PendingRecord& record = pending[t][i];
+            const void* id = identifiers.GetShaderIdentifier(record.exportName->c_str());
+            if (!id) {
+                return Fail(error, "unknown shader export " + Narrow(*record.exportName));
+            }
+            uint8_t* dest = image.data() + tables[t].offset + static_cast<uint64_t>(i) * tables[t].stride;
+            std::memcpy(dest, id, ShaderIdentifierSize);
+            if (!record.rootArguments->empty()) {
+                std::memcpy(dest + ShaderIdentifierSize, record.rootArguments->data(), record.rootArguments->size());
+            }
+            RecordInfo info = { *record.exportName, static_cast<uint32_t>(record.rootArguments->size()) };
+            m_records[t].push_back(info);
+        }
+    }
+    return true;
+}
+
+std::wstring ShaderTableLayout::Describe() const
+{
+    static const wchar_t* names[ShaderTableType::Count] = { L"RayGen", L"Miss", L"HitGroup" };
+    std::wstringstream wstr;
+    for (uint32_t t = 0; t < ShaderTableType::Count; t++) {
+        wstr << L"|--------------------------------------------------------------------\n";
+        wstr << L"|Shader table - " << names[t] << L" @ " << tables[t].offset << L": "
+             << tables[t].stride << L" | " << tables[t].size << L" bytes\n";
+        for (uint32_t i = 0; i < m_records[t].size(); i++) {
+            wstr << L"| [" << i << L"]: " << m_records[t][i].exportName << L", "
+                 << ShaderIdentifierSize << L" + " << m_records[t][i].rootArgumentsSize << L" bytes \n";
+        }
+    }
+    wstr << L"|--------------------------------------------------------------------\n";
+    return wstr.str();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// ShaderTableLayout.h
+//
+// Builds the ray gen, miss and hit group shader tables from a declarative description and
+// packs them into one aligned byte image. Nothing here depends on D3D12: shader identifiers
+// come from a ShaderIdentifierProvider, so a layout can be built and checked against the stub
+// provider on any platform. CreateShaderTables in DirectXRaytracingHelper.h uploads
+// the result.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Keep in step with D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES and the D3D12_RAYTRACING_*_BYTE_ALIGNMENT values.
+static const uint32_t ShaderIdentifierSize = 32;
+static const uint32_t ShaderRecordAlignment = 32;
+static const uint32_t ShaderTableAlignment = 64;
+
+class ShaderIdentifierProvider
+{
+public:
+    virtual ~ShaderIdentifierProvider() {}
+
+    // ShaderIdentifierSize bytes that stay valid as long as the provider, or nullptr if the
+    // export is unknown.
+    virtual const void* GetShaderIdentifier(const wchar_t* exportName) = 0;
+};
+
+// Identifiers derived from a hash of the export name. If a list of exports is given, any
+// other name is treated as unknown.
+class StubShaderIdentifierProvider : public ShaderIdentifierProvider
+{
+public:
+    StubShaderIdentifierProvider() {}
+    explicit StubShaderIdentifierProvider(const std::vector<std::wstring>& exports) : m_exports(exports) {}
+
+    const void* GetShaderIdentifier(const wchar_t* exportName) override;
+
+private:
+    std::vector<std::wstring> m_exports;
+    std::map<std::wstring, std::vector<uint8_t>> m_identifiers;
+};
+
+namespace ShaderTableType {
+    enum Enum {
+        RayGen = 0,
+        Miss,
+        HitGroup,
+        Count
+    };
+}
+
+template <typename T>
+std::vector<uint8_t> RootArgumentBytes(const T& rootArguments)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&rootArguments);
+    return std::vector<uint8_t>(bytes, bytes + sizeof(T));
+}
+
+// One geometry type (e.g. triangles, or the AABBs of one intersection shader): a hit group per
+// ray type, and the local root arguments of every primitive that uses it. Records are laid
+// out primitive by primitive, with the ray types of a primitive next to each other, which is
+// what MultiplierForGeometryContributionToHitGroupIndex = ray type count expects.
+struct HitGroupGeometryDesc {
+    std::vector<std::wstring> hitGroups;
+    std::vector<std::vector<uint8_t>> primitiveRootArguments;
+
+    template <typename T>
+    void AddPrimitive(const T& rootArguments) { primitiveRootArguments.push_back(RootArgumentBytes(rootArguments)); }
+};
+
+struct ShaderTableLayoutDesc {
+    std::wstring rayGen;
+    std::vector<uint8_t> rayGenRootArguments;
+    std::vector<std::wstring> missShaders;              // One per ray type.
+    std::vector<std::vector<uint8_t>> missRootArguments; // Empty, or one per miss shader.
+    std::vector<HitGroupGeometryDesc> geometries;
+};
+
+struct ShaderTableRange {
+    uint64_t offset;        // From the start of the image; ShaderTableAlignment aligned.
+    uint64_t size;
+    uint32_t stride;
+    uint32_t count;
+};
+
+class ShaderTableLayout
+{
+public:
+    std::vector<uint8_t> image;
+    ShaderTableRange tables[ShaderTableType::Count];
+
+    // Hit group record of each geometry's first primitive, i.e. the
+    // InstanceContributionToHitGroupIndex of an instance using that geometry.
+    std::vector<uint32_t> geometryFirstRecord;
+
+    // Returns false and sets error if an export is unknown or the ray type counts disagree.
+    bool Build(const ShaderTableLayoutDesc& desc, ShaderIdentifierProvider& identifiers, std::string* error = nullptr);
+
+    const uint8_t* Record(ShaderTableType::Enum table, uint32_t index) const
+    {
+        return image.data() + tables[table].offset + static_cast<uint64_t>(index) * tables[table].stride;
+    }
+
+    // Export name and sizes of every record, in the style of ShaderTable::DebugPrint.
+    std::wstring Describe() const;
+
+private:
+    struct RecordInfo {
+        std::wstring exportName;
+        uint32_t rootArgumentsSize;
+    };
+    std::vector<RecordInfo> m_records[ShaderTableType::Count];
+};
@@ -0,0 +1,111 @@
+#include "UploadRing.h"
+#include <algorithm>
+
+namespace {
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + (alignment - 1)) & ~(alignment - 1);
+    }
+}
+
+void FakeFrameFence::Wait(uint64_t value)
+{
+    waits++;
+    Complete(value);
+}
+
+void FakeFrameFence::Complete(uint64_t value)
+{
+    completed = (std::max)(completed, value);
+}
+
+uint64_t UploadFrameLayout::Add(uint64_t size, uint64_t alignment)
+{
+    uint64_t offset = AlignUp(m_size, alignment);
+    m_size = offset + size;
+    m_alignment = (std::max)(m_alignment, alignment);
+    return offset;
+}
+
+void UploadRingAllocator::Init(uint64_t capacity)
+{
+    m_capacity = capacity;
+    m_head = 0;
+    m_tail = 0;
+    m_frames.clear();
+    m_frameAllocations = 0;
+    m_frameBytes = 0;
+    m_stalls = 0;
+}
+
+uint64_t UploadRingAllocator::TryAllocate(uint64_t size, uint64_t alignment)
+{
+    if (IsEmpty()) {
+        m_head = m_tail = 0;
+    }
+
+    uint64_t offset = AlignUp(m_head, alignment);
+    if (m_head < m_tail) {
+        // Live data wraps: the free space is the gap up to the tail.
+        if (offset + size > m_tail) {
+            return InvalidOffset;
+        }
+    }
+    else if (m_head == m_tail && !IsEmpty()) {
+        return InvalidOffset;
+    }
+    else if (offset + size > m_capacity) {
+        // No room before the end; skip the rest and start again at zero.
+        if (size > m_tail) {
+            return InvalidOffset;
+        }
+        offset = 0;
+    }
+
+    m_frameBytes += offset + size - m_head + (offset < m_head ? m_capacity : 0);
+    m_head = offset + size;
+    m_frameAllocations++;
+    return offset;
+}
+
+uint64_t UploadRingAllocator::Allocate(uint64_t size, uint64_t alignment, FrameFence& fence)
+{
+    if (size > m_capacity) {
+        return InvalidOffset;
+    }
+    Reclaim(fence.CompletedValue());
+    uint64_t offset = TryAllocate(size, alignment);
+    while (offset == InvalidOffset && !m_frames.empty()) {
+        m_stalls++;
+        fence.Wait(m_frames.front().fenceValue);
+        Reclaim(fence.CompletedValue());
+        offset = TryAllocate(size, alignment);
+    }
+    return offset;
+}
+
+void UploadRingAllocator::EndFrame(uint64_t fenceValue)
+{
+    if (m_frameAllocations > 0) {
+        PendingFrame frame = { m_head, fenceValue };
+        m_frames.push_back(frame);
+    }
+    m_frameAllocations = 0;
+    m_frameBytes = 0;
+}
+
+void UploadRingAllocator::Reclaim(uint64_t completedFenceValue)
+{
+    while (!m_frames.empty() && m_frames.front().fenceValue <= completedFenceValue) {
+        m_tail = m_frames.front().end;
+        m_frames.pop_front();
+    }
+}
+
+uint64_t UploadRingAllocator::UsedBytes() const
+{
+    if (IsEmpty()) {
+        return 0;
+    }
+    return m_head > m_tail ? m_head - m_tail : m_capacity - m_tail + m_head;
+}
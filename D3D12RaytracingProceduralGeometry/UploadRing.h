@@ -0,0 +1,96 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// UploadRing.h
+//
+// CPU bookkeeping for one persistently mapped upload buffer used as a linear ring. Every
+// allocation made between two EndFrame() calls belongs to that frame, and the space is handed
+// back once the fence value passed to EndFrame() has completed. Nothing here touches D3D12:
+// the fence is an interface, so the ring can be driven by FakeFrameFence off-GPU. UploadRing
+// in DirectXRaytracingHelper.h owns the buffer and a real fence.
+//
+//**********************************************************************************************
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class FrameFence
+{
+public:
+    virtual ~FrameFence() {}
+
+    virtual uint64_t CompletedValue() const = 0;
+    // Blocks until value has completed.
+    virtual void Wait(uint64_t value) = 0;
+};
+
+// Completes values only when told to. Wait() completes the value at once and counts the
+// stall, standing in for the GPU catching up.
+class FakeFrameFence : public FrameFence
+{
+public:
+    uint64_t completed = 0;
+    uint32_t waits = 0;
+
+    uint64_t CompletedValue() const override { return completed; }
+    void Wait(uint64_t value) override;
+    void Complete(uint64_t value);
+};
+
+// Offsets of several uploads packed into a single ring allocation.
+class UploadFrameLayout
+{
+public:
+    // Returns the offset of the item from the start of the block.
+    uint64_t Add(uint64_t size, uint64_t alignment);
+    uint64_t Size() const { return m_size; }
+    uint64_t Alignment() const { return m_alignment; }
+
+private:
+    uint64_t m_size = 0;
+    uint64_t m_alignment = 1;
+};
+
+class UploadRingAllocator
+{
+public:
+    static const uint64_t InvalidOffset = UINT64_MAX;
+
+    void Init(uint64_t capacity);
+    uint64_t Capacity() const { return m_capacity; }
+
+    // Reclaims finished frames, then waits on the oldest pending ones until size fits.
+    // InvalidOffset only if size can never fit.
+    uint64_t Allocate(uint64_t size, uint64_t alignment, FrameFence& fence);
+    // Never waits: InvalidOffset if there is no room right now.
+    uint64_t TryAllocate(uint64_t size, uint64_t alignment);
+
+    // Closes the current frame. Its allocations stay live until fenceValue completes.
+    void EndFrame(uint64_t fenceValue);
+    void Reclaim(uint64_t completedFenceValue);
+
+    // Bytes from the oldest live allocation to the head, including padding skipped on wrap.
+    uint64_t UsedBytes() const;
+    uint32_t PendingFrames() const { return static_cast<uint32_t>(m_frames.size()); }
+    uint32_t FrameAllocations() const { return m_frameAllocations; }
+    uint64_t FrameBytes() const { return m_frameBytes; }
+    uint32_t Stalls() const { return m_stalls; }
+
+private:
+    struct PendingFrame {
+        uint64_t end;           // Head once the frame closed; the tail moves here when it completes.
+        uint64_t fenceValue;
+    };
+
+    uint64_t m_capacity = 0;
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+    std::deque<PendingFrame> m_frames;
+    uint32_t m_frameAllocations = 0;
+    uint64_t m_frameBytes = 0;
+    uint32_t m_stalls = 0;
+
+    bool IsEmpty() const { return m_frames.empty() && m_frameAllocations == 0; }
+};
@@ -1,10 +1,13 @@
-
-
+#define HLSL
+#include "PackedGBuffer.h"
 
 cbuffer MVP : register(b0)
 {
     float4x4 view;
     float4x4 proj;
+    float4x4 projectionToWorld;
+    float4 cameraPosition;
+    float photonRadiusScale;
 };
 //ConstantBuffer<float4x4> mvp : register(b0);
 
@@ -33,9 +36,8 @@ struct Photon {
 };
 
 RWStructuredBuffer<Photon> photons : register(u2);
-RWTexture2D<float4> GBufferBRDF : register(u4);
-RWTexture2D<float4> GBufferPosition : register(u5);
-RWTexture2D<float4> GBufferNormal : register(u6);
+RWByteAddressBuffer photonCounter : register(u3);
+RWTexture2D<uint4> GBuffer : register(u4);
 RWTexture2D<float4> rasterTarget : register(u8);
 //RWTexture1D<float4> photons : register(u0);
 
@@ -50,8 +52,15 @@ PSInput VSMain(float4 position : POSITION, uint instanceID : SV_InstanceID, floa
 
         PSInput result;
         
+        // One instance per slot of the photon buffer; the ones the photon pass did not fill
+        // this frame are collapsed to a point so they rasterise nothing.
+        uint capacity, stride;
+        photons.GetDimensions(capacity, stride);
+        if (instanceID >= min(photonCounter.Load(0), capacity)) {
+            result = (PSInput)0;
+            return result;
+        }
         Photon photon = photons[instanceID];
-        uint decr = photons.DecrementCounter();
         //photons[instanceID] = { float4(0,0,0,0), float4(0,0,0,0), float4(0,0,0,0), float4(0,0,0,0) };
         float raySize = photon.position.w;
         float scale = min(raySize / lMax, 1);
@@ -69,7 +78,7 @@ PSInput VSMain(float4 position : POSITION, uint instanceID : SV_InstanceID, floa
         
        float r = minMajKernelRadius + (maxMajorKernelRadius - minMajKernelRadius) * sqrt(1 - pathDensity);
        float majKernelRadius = lerp(maxMajorKernelRadius, minMajKernelRadius, pathDensity);
-       majKernelRadius = r;
+       majKernelRadius = r * photonRadiusScale;
        float kSquash = 1 - length(photon.normal) / majKernelRadius;
         kSquash = 1;
 
@@ -127,12 +136,26 @@ PSInput VSMain(float4 position : POSITION, uint instanceID : SV_InstanceID, floa
 
 }
 
+// The direction GenerateCameraRay gave the primary ray through this pixel, so the G-buffer's
+// distance along it lands back on the surface the ray tracer hit.
+float3 PrimaryRayDirection(float2 pixelCentre)
+{
+    uint width, height;
+    GBuffer.GetDimensions(width, height);
+    float2 screenPos = pixelCentre / float2(width, height) * 2.0 - 1.0;
+    screenPos.y = -screenPos.y;
+    float4 world = mul(float4(screenPos, 0, 1), projectionToWorld);
+    world.xyz /= world.w;
+    return normalize(world.xyz - cameraPosition.xyz);
+}
+
 float4 PSMain(PSInput input) : SV_TARGET
 {
  
      float pi = 3.1415926535897932384626422832795028841971f;
 
-     float4 pos = GBufferPosition[input.position.xy];
+     PackedGBufferTexel texel = GBuffer[input.position.xy];
+     float4 pos = float4(ReconstructGBufferPosition(cameraPosition.xyz, PrimaryRayDirection(input.position.xy), texel), 0);
      //max distance between photon and position
      float3x3 eInverse = input.eInverse;
 
@@ -150,7 +173,7 @@ float4 PSMain(PSInput input) : SV_TARGET
      float r_3 = input.t_radius;
      float r_2 = 1;
      //float r = 1;
-        float r = 1 / probability;//1/probability;
+        float r = photonRadiusScale / probability;//1/probability;
      // float r = input.kernelMinor + (sqrt(input.majKernelRadius) - )
      // r = input.majKernelRadiusSquared;
 
@@ -169,7 +192,7 @@ float4 PSMain(PSInput input) : SV_TARGET
      // float4 pos = GBufferPosition[input.position.xy];
       //float dist = sqrt(dot(pos - original)) 
 
-     float4 normal = GBufferNormal[input.position.xy];
+     float4 normal = float4(DecodeGBufferNormal(texel.y), 0);
 
 
      float k_L = dot(normal, -input.direction);
@@ -185,7 +208,7 @@ float4 PSMain(PSInput input) : SV_TARGET
      float wp = 1 - sqrt(distance2) / (k * r);
      //wp = min(1 / 5, wp);
 
-     float4 BRDF = GBufferBRDF[input.position.xy];
+     float4 BRDF = float4(DecodeGBufferColour(texel), 0);
 
      float nor = (1 - (2 / 3 * k))*pi*r*r;
      // float4 color = BRDF * kernel
@@ -333,6 +333,12 @@ public:
         m_mappedBuffers = reinterpret_cast<T*>(MapCpuWriteOnly());
     }
 
+    // CPU copy only, for contents uploaded through an UploadRing instead.
+    void CreateStaging(UINT numElements)
+    {
+        m_staging.resize(numElements);
+    }
+
     void CopyStagingToGpu(UINT instanceIndex = 0)
     {
         memcpy(m_mappedBuffers + instanceIndex * NumElementsPerInstance(), &m_staging[0], InstanceSize());
@@ -340,6 +346,7 @@ public:
 
     // Accessors
     T& operator[](UINT elementIndex) { return m_staging[elementIndex]; }
+    const T* StagingData() const { return m_staging.data(); }
     size_t NumElementsPerInstance() { return m_staging.size(); }
     UINT NumInstances() { return m_staging.size(); }
     size_t InstanceSize() { return NumElementsPerInstance() * sizeof(T); }
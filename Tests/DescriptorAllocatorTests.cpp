@@ -0,0 +1,160 @@
+#include "DescriptorAllocator.h"
+#include "TestHarness.h"
+
+TEST(RangesAreLaidOutInOrderBeforeTheRing)
+{
+    DescriptorAllocator allocator;
+    uint32_t first = allocator.AddRange(8);
+    uint32_t second = allocator.AddRange(4);
+    allocator.SetTransientRing(3, 2);
+
+    CHECK_EQUAL(0u, allocator.RangeOffset(first));
+    CHECK_EQUAL(8u, allocator.RangeOffset(second));
+    CHECK_EQUAL(18u, allocator.Capacity());
+    CHECK_EQUAL(8u, allocator.Allocate(second).index);
+}
+
+TEST(FreedNeighboursCoalesce)
+{
+    DescriptorAllocator allocator;
+    uint32_t range = allocator.AddRange(6);
+    DescriptorHandle a = allocator.Allocate(range, 2);
+    DescriptorHandle b = allocator.Allocate(range, 2);
+    DescriptorHandle c = allocator.Allocate(range, 2);
+    CHECK_EQUAL(0u, a.index);
+    CHECK_EQUAL(2u, b.index);
+    CHECK_EQUAL(4u, c.index);
+    CHECK(allocator.Allocate(range).IsNull());
+
+    // Two separate holes of two fit neither a block of three nor four.
+    allocator.Free(a);
+    allocator.Free(c);
+    CHECK(allocator.Allocate(range, 3).IsNull());
+
+    // Freeing the middle merges all three into one block of six.
+    allocator.Free(b);
+    CHECK_EQUAL(0u, allocator.AllocatedCount(range));
+    DescriptorHandle all = allocator.Allocate(range, 6);
+    CHECK_EQUAL(0u, all.index);
+    CHECK_EQUAL(6u, all.count);
+}
+
+TEST(AllocateFindsTheFirstHoleThatFits)
+{
+    DescriptorAllocator allocator;
+    uint32_t range = allocator.AddRange(8);
+    DescriptorHandle a = allocator.Allocate(range, 1);
+    allocator.Allocate(range, 1);
+    DescriptorHandle c = allocator.Allocate(range, 3);
+    allocator.Allocate(range, 1);
+    allocator.Free(a);
+    allocator.Free(c);
+
+    CHECK_EQUAL(2u, allocator.Allocate(range, 2).index);
+    CHECK_EQUAL(0u, allocator.Allocate(range, 1).index);
+    CHECK_EQUAL(4u, allocator.Allocate(range, 1).index);
+}
+
+TEST(AllocateAtClaimsFreeSlotsOnly)
+{
+    DescriptorAllocator allocator;
+    uint32_t first = allocator.AddRange(4);
+    uint32_t second = allocator.AddRange(4);
+
+    DescriptorHandle middle = allocator.AllocateAt(first, 1, 2);
+    CHECK_EQUAL(1u, middle.index);
+    CHECK_EQUAL(2u, middle.count);
+    CHECK(allocator.IsAllocated(1) && allocator.IsAllocated(2));
+    CHECK(!allocator.IsAllocated(0) && !allocator.IsAllocated(3));
+
+    // Overlapping a taken slot, crossing the end of the range, or naming another range's slot.
+    CHECK(allocator.AllocateAt(first, 2).IsNull());
+    CHECK(allocator.AllocateAt(first, 3, 2).IsNull());
+    CHECK(allocator.AllocateAt(first, 5).IsNull());
+    CHECK_EQUAL(5u, allocator.AllocateAt(second, 5).index);
+
+    // The slots either side of it are still handed out.
+    CHECK_EQUAL(0u, allocator.Allocate(first).index);
+    CHECK_EQUAL(3u, allocator.Allocate(first).index);
+    CHECK(allocator.Allocate(first).IsNull());
+}
+
+TEST(FreedHandlesGoStale)
+{
+    DescriptorAllocator allocator;
+    uint32_t range = allocator.AddRange(4);
+    DescriptorHandle handle = allocator.Allocate(range, 2);
+    CHECK(allocator.IsValid(handle));
+
+    allocator.Free(handle);
+    CHECK(!allocator.IsValid(handle));
+
+    // The slot comes back with a new generation; the old handle neither matches nor frees it.
+    DescriptorHandle reused = allocator.Allocate(range, 2);
+    CHECK_EQUAL(handle.index, reused.index);
+    CHECK(reused.generation != handle.generation);
+    CHECK(!allocator.IsValid(handle));
+    allocator.Free(handle);
+    CHECK(allocator.IsValid(reused));
+    CHECK_EQUAL(2u, allocator.AllocatedCount(range));
+
+    // A handle that names the right slot with the wrong size is stale too.
+    DescriptorHandle resized = reused;
+    resized.count = 1;
+    CHECK(!allocator.IsValid(resized));
+    CHECK(!allocator.IsValid(DescriptorHandle()));
+}
+
+TEST(ResetRangeStalesEveryHandleInIt)
+{
+    DescriptorAllocator allocator;
+    uint32_t first = allocator.AddRange(4);
+    uint32_t second = allocator.AddRange(4);
+    DescriptorHandle a = allocator.Allocate(first, 1);
+    DescriptorHandle b = allocator.Allocate(first, 3);
+    DescriptorHandle kept = allocator.Allocate(second, 2);
+
+    allocator.ResetRange(first);
+    CHECK(!allocator.IsValid(a));
+    CHECK(!allocator.IsValid(b));
+    CHECK(allocator.IsValid(kept));
+    CHECK_EQUAL(0u, allocator.AllocatedCount(first));
+    CHECK(allocator.HandleAt(1).IsNull());
+    CHECK_EQUAL(4u, allocator.Allocate(first, 4).count);
+}
+
+TEST(HandleAtRebuildsTheAllocation)
+{
+    DescriptorAllocator allocator;
+    uint32_t range = allocator.AddRange(4);
+    DescriptorHandle handle = allocator.Allocate(range, 3);
+
+    DescriptorHandle found = allocator.HandleAt(handle.index);
+    CHECK_EQUAL(handle.index, found.index);
+    CHECK_EQUAL(handle.count, found.count);
+    CHECK_EQUAL(handle.generation, found.generation);
+    // Only the first slot of an allocation names it.
+    CHECK(allocator.HandleAt(handle.index + 1).IsNull());
+}
+
+TEST(TransientRingWrapsPerFrame)
+{
+    DescriptorAllocator allocator;
+    allocator.AddRange(5);
+    allocator.SetTransientRing(4, 3);
+
+    // Segment n of the ring starts at 5 + 4n, and frame f uses segment f % 3.
+    const uint32_t expected[] = { 5, 9, 13, 5, 9 };
+    for (uint64_t frame = 0; frame < 5; frame++) {
+        allocator.BeginFrame(frame);
+        CHECK_EQUAL(0u, allocator.TransientUsed());
+        CHECK_EQUAL(expected[frame], allocator.AllocateTransient(3));
+        CHECK_EQUAL(expected[frame] + 3, allocator.AllocateTransient(1));
+        CHECK_EQUAL(4u, allocator.TransientUsed());
+        // The segment is full until the frame comes around again.
+        CHECK_EQUAL(DescriptorHandle::InvalidIndex, allocator.AllocateTransient(1));
+    }
+    CHECK_EQUAL(DescriptorHandle::InvalidIndex, allocator.AllocateTransient(0));
+}
+
+TEST_MAIN()
@@ -0,0 +1,138 @@
+#include "PointCloudFilters.h"
+#include "TestHarness.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+    Vertex_Ply Point(double x, double y, double z)
+    {
+        Vertex_Ply point;
+        point.location = Eigen::Vector3d(x, y, z);
+        point.colour = Eigen::Vector3i(100, 150, 200);
+        point.normal = Eigen::Vector3d(0.0, 1.0, 0.0);
+        point.curvature = 0.0;
+        return point;
+    }
+
+    bool Near(const Eigen::Vector3d& a, const Eigen::Vector3d& b)
+    {
+        return (a - b).norm() < 1e-9;
+    }
+
+    // A lattice of side points spacing apart, centred on the origin.
+    std::vector<Vertex_Ply> Cluster(int side, double spacing)
+    {
+        std::vector<Vertex_Ply> points;
+        double offset = (side - 1) * spacing / 2.0;
+        for (int z = 0; z < side; z++) {
+            for (int y = 0; y < side; y++) {
+                for (int x = 0; x < side; x++) {
+                    points.push_back(Point(x * spacing - offset, y * spacing - offset, z * spacing - offset));
+                }
+            }
+        }
+        return points;
+    }
+}
+
+TEST(VoxelDownsampleAveragesEachCell)
+{
+    std::vector<Vertex_Ply> points;
+    points.push_back(Point(0.1, 0.1, 0.1));
+    points.push_back(Point(1.2, 0.2, 0.2));
+    points.push_back(Point(0.3, 0.5, 0.5));
+    points.push_back(Point(1.6, 0.6, 0.6));
+    points.push_back(Point(0.5, 1.5, 0.5));
+    points.push_back(Point(1.4, 0.4, 0.4));
+    points[1].colour = Eigen::Vector3i(0, 0, 0);
+    points[3].colour = Eigen::Vector3i(30, 30, 30);
+    points[5].normal = Eigen::Vector3d(1.0, 0.0, 0.0);
+
+    // Cells come out in key order, x fastest.
+    std::vector<Vertex_Ply> voxels = PointCloudFilters::VoxelDownsample(points, 1.0, 1);
+    CHECK_EQUAL(size_t(3), voxels.size());
+    CHECK(Near(Eigen::Vector3d(0.2, 0.3, 0.3), voxels[0].location));
+    CHECK(Near(Eigen::Vector3d(1.4, 0.4, 0.4), voxels[1].location));
+    CHECK(Near(Eigen::Vector3d(0.5, 1.5, 0.5), voxels[2].location));
+    CHECK(voxels[1].colour == Eigen::Vector3i(43, 60, 77));
+    CHECK(Near(Eigen::Vector3d(1.0, 2.0, 0.0).normalized(), voxels[1].normal));
+}
+
+TEST(VoxelCentroidsFallOnAKnownGrid)
+{
+    // Eight points around the centre of each cell of a 4x4x4 grid, so every centroid is a
+    // cell centre whatever order the workers summed them in.
+    std::vector<Vertex_Ply> points;
+    for (int z = 0; z < 4; z++) {
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                for (int corner = 0; corner < 8; corner++) {
+                    points.push_back(Point(0.5 * x + 0.25 + ((corner & 1) ? 0.1 : -0.1),
+                        0.5 * y + 0.25 + ((corner & 2) ? 0.1 : -0.1),
+                        0.5 * z + 0.25 + ((corner & 4) ? 0.1 : -0.1)));
+                }
+            }
+        }
+    }
+
+    std::vector<Vertex_Ply> voxels = PointCloudFilters::VoxelDownsample(points, 0.5, 4);
+    CHECK_EQUAL(size_t(64), voxels.size());
+    for (size_t i = 0; i < voxels.size() && voxels.size() == 64; i++) {
+        Eigen::Vector3d centre(0.5 * (i % 4) + 0.25, 0.5 * (i / 4 % 4) + 0.25, 0.5 * (i / 16) + 0.25);
+        CHECK(Near(centre, voxels[i].location));
+    }
+}
+
+TEST(PipelineChunksMatchOneDownsample)
+{
+    std::vector<Vertex_Ply> points = Cluster(12, 0.07);
+    std::vector<Vertex_Ply> whole = PointCloudFilters::VoxelDownsample(points, 0.2, 2);
+
+    PointCloudFilterPipeline pipeline(2);
+    pipeline.SetVoxelSize(0.2);
+    for (size_t begin = 0; begin < points.size(); begin += 500) {
+        size_t end = (std::min)(begin + 500, points.size());
+        pipeline.Push(std::vector<Vertex_Ply>(points.begin() + begin, points.begin() + end));
+    }
+    CHECK_EQUAL(uint64_t(points.size()), pipeline.PointsIn());
+    std::vector<Vertex_Ply> chunked = pipeline.Finish();
+    CHECK_EQUAL(whole.size(), chunked.size());
+    for (size_t i = 0; i < whole.size() && i < chunked.size(); i++) {
+        CHECK(Near(whole[i].location, chunked[i].location));
+    }
+}
+
+TEST(OutliersAreRemovedFromADenseCluster)
+{
+    std::vector<Vertex_Ply> points = Cluster(10, 0.1);
+    points.insert(points.begin() + 500, Point(5.0, 5.0, 5.0));
+
+    std::vector<Vertex_Ply> radius = PointCloudFilters::RemoveRadiusOutliers(points, 0.25, 3, 4);
+    CHECK_EQUAL(size_t(1000), radius.size());
+
+    std::vector<Vertex_Ply> statistical = PointCloudFilters::RemoveStatisticalOutliers(points, 8, 2.0, 4);
+    CHECK_EQUAL(size_t(1000), statistical.size());
+
+    // Both keep the cluster in its original order.
+    std::vector<Vertex_Ply> cluster = Cluster(10, 0.1);
+    for (size_t i = 0; i < cluster.size() && radius.size() == 1000 && statistical.size() == 1000; i++) {
+        CHECK(Near(cluster[i].location, radius[i].location));
+        CHECK(Near(cluster[i].location, statistical[i].location));
+    }
+}
+
+TEST(OutliersAreRemovedFromAScanLine)
+{
+    // Collinear points give the grid no face to size its cells by.
+    std::vector<Vertex_Ply> points;
+    for (int i = 0; i < 200; i++) {
+        points.push_back(Point(0.01 * i, 1.0, -2.0));
+    }
+    points.push_back(Point(10.0, 1.0, -2.0));
+
+    std::vector<Vertex_Ply> kept = PointCloudFilters::RemoveStatisticalOutliers(points, 4, 2.0, 2);
+    CHECK_EQUAL(size_t(200), kept.size());
+    CHECK(kept.back().location.x() < 2.0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,111 @@
+#include "PointCloudNormals.h"
+#include "TestHarness.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+    Vertex_Ply Point(const Eigen::Vector3d& location)
+    {
+        Vertex_Ply point;
+        point.location = location;
+        point.colour = Eigen::Vector3i::Zero();
+        point.normal = Eigen::Vector3d::Zero();
+        point.curvature = -1.0;
+        return point;
+    }
+
+    // A 20x20 grid on the plane z = 2, spacing 0.1.
+    std::vector<Vertex_Ply> Plane()
+    {
+        std::vector<Vertex_Ply> points;
+        for (int y = 0; y < 20; y++) {
+            for (int x = 0; x < 20; x++) {
+                points.push_back(Point(Eigen::Vector3d(0.1 * x, 0.1 * y, 2.0)));
+            }
+        }
+        return points;
+    }
+
+    // Evenly spread over the unit sphere around centre by the golden angle.
+    std::vector<Vertex_Ply> Sphere(uint32_t count, const Eigen::Vector3d& centre)
+    {
+        const double goldenAngle = M_PI * (3.0 - std::sqrt(5.0));
+        std::vector<Vertex_Ply> points;
+        for (uint32_t i = 0; i < count; i++) {
+            double z = 1.0 - 2.0 * (i + 0.5) / count;
+            double r = std::sqrt(1.0 - z * z);
+            double phi = goldenAngle * i;
+            points.push_back(Point(centre + Eigen::Vector3d(r * std::cos(phi), r * std::sin(phi), z)));
+        }
+        return points;
+    }
+}
+
+TEST(PlaneNormalsFaceTheViewpoint)
+{
+    PointCloudNormalSettings settings;
+    settings.orientation = NormalOrientation::Viewpoint;
+    settings.viewpoint = Eigen::Vector3d(1.0, 1.0, -5.0);
+
+    std::vector<Vertex_Ply> points = Plane();
+    PointCloudNormals::Estimate(points, settings, 4);
+    uint32_t wrong = 0;
+    for (const Vertex_Ply& point : points) {
+        wrong += point.normal.z() < -0.999999 && point.curvature < 1e-9 ? 0 : 1;
+    }
+    CHECK_EQUAL(0u, wrong);
+
+    // From the other side of the plane every normal flips.
+    settings.viewpoint = Eigen::Vector3d(1.0, 1.0, 9.0);
+    PointCloudNormals::Estimate(points, settings, 4);
+    wrong = 0;
+    for (const Vertex_Ply& point : points) {
+        wrong += point.normal.z() > 0.999999 ? 0 : 1;
+    }
+    CHECK_EQUAL(0u, wrong);
+}
+
+TEST(SphereNormalsArePropagatedOutwards)
+{
+    const Eigen::Vector3d centre(3.0, -1.0, 0.5);
+    std::vector<Vertex_Ply> points = Sphere(2000, centre);
+    PointCloudNormals::Estimate(points, PointCloudNormalSettings(), 4);
+
+    // Radial to within two degrees, the worst being at the poles where the spiral bunches up,
+    // and all facing out; a 16-point patch of the sphere is nearly flat.
+    uint32_t wrong = 0;
+    for (const Vertex_Ply& point : points) {
+        Eigen::Vector3d radial = (point.location - centre).normalized();
+        wrong += point.normal.dot(radial) > 0.9994 && point.curvature < 0.01 ? 0 : 1;
+    }
+    CHECK_EQUAL(0u, wrong);
+}
+
+TEST(ViewpointInsideTheSphereTurnsNormalsInwards)
+{
+    PointCloudNormalSettings settings;
+    settings.orientation = NormalOrientation::Viewpoint;
+    settings.viewpoint = Eigen::Vector3d::Zero();
+
+    std::vector<Vertex_Ply> points = Sphere(500, Eigen::Vector3d::Zero());
+    PointCloudNormals::Estimate(points, settings, 1);
+    uint32_t wrong = 0;
+    for (const Vertex_Ply& point : points) {
+        wrong += point.normal.dot(point.location) < -0.999 ? 0 : 1;
+    }
+    CHECK_EQUAL(0u, wrong);
+}
+
+TEST(TooFewNeighboursLeaveAZeroNormal)
+{
+    std::vector<Vertex_Ply> points;
+    points.push_back(Point(Eigen::Vector3d(0.0, 0.0, 0.0)));
+    points.push_back(Point(Eigen::Vector3d(1.0, 0.0, 0.0)));
+    PointCloudNormals::Estimate(points);
+    for (const Vertex_Ply& point : points) {
+        CHECK(point.normal.isZero());
+        CHECK_EQUAL(0.0, point.curvature);
+    }
+}
+
+TEST_MAIN()
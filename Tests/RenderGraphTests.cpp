@@ -0,0 +1,248 @@
+#include "RenderGraph.h"
+#include "TestHarness.h"
+#include <vector>
+
+namespace {
+    const RenderGraphState::Enum UAV = RenderGraphState::UnorderedAccess;
+    const RenderGraphState::Enum SRV = RenderGraphState::ShaderResource;
+    const RenderGraphState::Enum RTV = RenderGraphState::RenderTarget;
+
+    // Compiles and executes the graph on the mock and returns its log as one line per call.
+    std::string Schedule(RenderGraph& graph)
+    {
+        std::string error;
+        CHECK(graph.Compile(&error));
+        CHECK_EQUAL(std::string(), error);
+        MockRenderGraphBackend backend;
+        graph.Execute(backend);
+        CHECK_EQUAL(1u, backend.submits);
+        std::string text;
+        for (const std::string& line : backend.log) {
+            text += line + "\n";
+        }
+        return text;
+    }
+}
+
+TEST(PassesNothingUsesAreCulled)
+{
+    RenderGraph graph;
+    RenderGraphResource output = graph.Import("Output", UAV, UAV);
+    RenderGraphResource lighting = graph.CreateTransient("Lighting", 1024, 256);
+    RenderGraphResource debug = graph.CreateTransient("Debug", 1024, 256);
+    RenderGraphResource unused = graph.CreateTransient("Unused", 1024, 256);
+    RenderGraphResource unusedInput = graph.CreateTransient("UnusedInput", 1024, 256);
+    std::vector<std::string> ran;
+    auto record = [&](const char* name) { return [&ran, name] { ran.push_back(name); }; };
+
+    // A chain whose end nothing reads goes, including the pass that only feeds it.
+    uint32_t pass = graph.AddPass("FeedsUnused", record("FeedsUnused"));
+    graph.Write(pass, unusedInput, UAV);
+    pass = graph.AddPass("WritesUnused", record("WritesUnused"));
+    graph.Read(pass, unusedInput, UAV);
+    graph.Write(pass, unused, UAV);
+
+    pass = graph.AddPass("Lighting", record("Lighting"));
+    graph.Write(pass, lighting, RTV);
+    pass = graph.AddPass("DebugCapture", record("DebugCapture"), true);
+    graph.Write(pass, debug, UAV);
+    pass = graph.AddPass("Shade", record("Shade"));
+    graph.Read(pass, lighting, SRV);
+    graph.Write(pass, output, UAV);
+
+    // Lighting is live across DebugCapture, so the two cannot share memory.
+    std::string expected =
+        "place Lighting 0\n"
+        "place Debug 1024\n"
+        "pass Lighting\n"
+        "pass DebugCapture\n"
+        "transition Lighting RenderTarget ShaderResource\n"
+        "pass Shade\n"
+        "transition Lighting ShaderResource RenderTarget\n"
+        "submit\n";
+    CHECK_EQUAL(expected, Schedule(graph));
+    CHECK_EQUAL(2u, graph.Plan().culledPasses);
+    CHECK_EQUAL(size_t(3), ran.size());
+    CHECK(ran.size() == 3 && ran[0] == "Lighting" && ran[1] == "DebugCapture" && ran[2] == "Shade");
+}
+
+TEST(RepeatedStatesNeedNoTransition)
+{
+    RenderGraph graph;
+    RenderGraphResource texture = graph.Import("Texture", SRV, SRV);
+    RenderGraphResource target = graph.Import("Target", RTV, RenderGraphState::Present);
+
+    uint32_t pass = graph.AddPass("Blur", nullptr);
+    graph.Read(pass, texture, SRV);
+    graph.Read(pass, texture, SRV);
+    graph.Write(pass, target, RTV);
+    pass = graph.AddPass("Sharpen", nullptr);
+    graph.Read(pass, texture, SRV);
+    graph.Write(pass, target, RTV);
+    pass = graph.AddPass("Bake", nullptr);
+    graph.Write(pass, texture, RTV);
+    pass = graph.AddPass("Composite", nullptr);
+    graph.Read(pass, texture, SRV);
+    graph.Write(pass, target, RTV);
+
+    std::string expected =
+        "pass Blur\n"
+        "pass Sharpen\n"
+        "transition Texture ShaderResource RenderTarget\n"
+        "pass Bake\n"
+        "transition Texture RenderTarget ShaderResource\n"
+        "pass Composite\n"
+        "transition Target RenderTarget Present\n"
+        "submit\n";
+    CHECK_EQUAL(expected, Schedule(graph));
+}
+
+TEST(UnorderedAccessHazardsGetUavBarriers)
+{
+    RenderGraph graph;
+    RenderGraphResource buffer = graph.Import("Buffer", UAV, UAV);
+    RenderGraphResource count = graph.Import("Count", UAV, UAV);
+
+    // The first write needs none: the previous frame is ordered by its submission. After that,
+    // a read or write following a write, and a write following a read, each need one; a read
+    // following a read does not.
+    uint32_t pass = graph.AddPass("Emit", nullptr);
+    graph.Write(pass, buffer, UAV);
+    pass = graph.AddPass("Gather", nullptr);
+    graph.Read(pass, buffer, UAV);
+    graph.Write(pass, count, UAV);
+    pass = graph.AddPass("Filter", nullptr);
+    graph.Read(pass, buffer, UAV);
+    graph.Write(pass, count, UAV);
+    pass = graph.AddPass("Overwrite", nullptr);
+    graph.Write(pass, buffer, UAV);
+    pass = graph.AddPass("CopyOut", nullptr, true);
+    graph.Read(pass, buffer, RenderGraphState::CopySource);
+
+    std::string expected =
+        "pass Emit\n"
+        "uav Buffer\n"
+        "pass Gather\n"
+        "uav Count\n"
+        "pass Filter\n"
+        "uav Buffer\n"
+        "pass Overwrite\n"
+        "transition Buffer UnorderedAccess CopySource\n"
+        "pass CopyOut\n"
+        "transition Buffer CopySource UnorderedAccess\n"
+        "submit\n";
+    CHECK_EQUAL(expected, Schedule(graph));
+}
+
+TEST(TransientsWithDisjointLifetimesShareMemory)
+{
+    RenderGraph graph;
+    RenderGraphResource output = graph.Import("Output", UAV, UAV);
+    RenderGraphResource shadows = graph.CreateTransient("Shadows", 2048, 256);
+    RenderGraphResource bloom = graph.CreateTransient("Bloom", 1024, 256);
+
+    uint32_t pass = graph.AddPass("ShadowMap", nullptr);
+    graph.Write(pass, shadows, RTV);
+    pass = graph.AddPass("Lighting", nullptr);
+    graph.Read(pass, shadows, SRV);
+    graph.Write(pass, output, UAV);
+    pass = graph.AddPass("BloomDown", nullptr);
+    graph.Write(pass, bloom, UAV);
+    graph.Read(pass, output, SRV);
+    pass = graph.AddPass("BloomUp", nullptr);
+    graph.Read(pass, bloom, UAV);
+    graph.Write(pass, output, UAV);
+
+    // Shadows goes back to the state it was created in while the memory is still its own,
+    // then Bloom takes the memory over.
+    std::string expected =
+        "place Shadows 0\n"
+        "place Bloom 0\n"
+        "pass ShadowMap\n"
+        "transition Shadows RenderTarget ShaderResource\n"
+        "pass Lighting\n"
+        "transition Shadows ShaderResource RenderTarget\n"
+        "alias Shadows Bloom\n"
+        "transition Output UnorderedAccess ShaderResource\n"
+        "pass BloomDown\n"
+        "uav Bloom\n"
+        "transition Output ShaderResource UnorderedAccess\n"
+        "pass BloomUp\n"
+        "submit\n";
+    CHECK_EQUAL(expected, Schedule(graph));
+    CHECK_EQUAL(2048u, graph.Plan().heapBytes);
+    CHECK_EQUAL(3072u, graph.Plan().unaliasedBytes);
+}
+
+TEST(TransientsWithOverlappingLifetimesAreKeptApart)
+{
+    RenderGraph graph;
+    RenderGraphResource output = graph.Import("Output", UAV, UAV);
+    RenderGraphResource depth = graph.CreateTransient("Depth", 1000, 256);
+    RenderGraphResource normals = graph.CreateTransient("Normals", 600, 512);
+    RenderGraphResource scratch = graph.CreateTransient("Scratch", 400, 256);
+
+    uint32_t pass = graph.AddPass("GBuffer", nullptr);
+    graph.Write(pass, depth, RTV);
+    graph.Write(pass, normals, RTV);
+    pass = graph.AddPass("Resolve", nullptr);
+    graph.Read(pass, depth, SRV);
+    graph.Read(pass, normals, SRV);
+    graph.Write(pass, output, UAV);
+    pass = graph.AddPass("Post", nullptr);
+    graph.Write(pass, scratch, UAV);
+    pass = graph.AddPass("Final", nullptr);
+    graph.Read(pass, scratch, UAV);
+    graph.Write(pass, output, UAV);
+
+    // Normals is placed after Depth, aligned up to 1024; Scratch only overlaps the GBuffer
+    // targets in memory, not in time, so it reuses Depth's.
+    std::string expected =
+        "place Depth 0\n"
+        "place Normals 1024\n"
+        "place Scratch 0\n"
+        "pass GBuffer\n"
+        "transition Depth RenderTarget ShaderResource\n"
+        "transition Normals RenderTarget ShaderResource\n"
+        "pass Resolve\n"
+        "transition Depth ShaderResource RenderTarget\n"
+        "transition Normals ShaderResource RenderTarget\n"
+        "alias Depth Scratch\n"
+        "pass Post\n"
+        "uav Scratch\n"
+        "uav Output\n"
+        "pass Final\n"
+        "submit\n";
+    CHECK_EQUAL(expected, Schedule(graph));
+    CHECK_EQUAL(1624u, graph.Plan().heapBytes);
+    CHECK_EQUAL(2000u, graph.Plan().unaliasedBytes);
+}
+
+TEST(InvalidGraphsFailToCompile)
+{
+    RenderGraph graph;
+    RenderGraphResource output = graph.Import("Output", UAV, UAV);
+    RenderGraphResource scratch = graph.CreateTransient("Scratch", 256, 256);
+    uint32_t pass = graph.AddPass("ReadsFirst", nullptr);
+    graph.Read(pass, scratch, SRV);
+    graph.Write(pass, output, UAV);
+    std::string error;
+    CHECK(!graph.Compile(&error));
+    CHECK_EQUAL(std::string("pass ReadsFirst reads transient Scratch before anything writes it"), error);
+
+    graph.Reset();
+    output = graph.Import("Output", UAV, UAV);
+    pass = graph.AddPass("TwoStates", nullptr);
+    graph.Read(pass, output, SRV);
+    graph.Write(pass, output, UAV);
+    CHECK(!graph.Compile(&error));
+    CHECK_EQUAL(std::string("pass TwoStates uses Output in two states"), error);
+
+    graph.Reset();
+    pass = graph.AddPass("Unknown", nullptr, true);
+    graph.Write(pass, 7, UAV);
+    CHECK(!graph.Compile(&error));
+    CHECK_EQUAL(std::string("pass Unknown uses an unknown resource"), error);
+}
+
+TEST_MAIN()
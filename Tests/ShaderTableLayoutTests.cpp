@@ -0,0 +1,176 @@
+#include "ShaderTableLayout.h"
+#include "TestHarness.h"
+
+namespace {
+    struct RayGenArguments {
+        float viewport[2];
+    };
+
+    struct TriangleArguments {
+        float albedo[4];
+    };
+
+    struct ProceduralArguments {
+        float albedo[4];
+        uint32_t primitiveType;
+        uint32_t instanceIndex;
+        float padding[4];
+    };
+
+    const wchar_t* const exports[] = {
+        L"MyRaygenShader", L"MyMissShader", L"MyMissShader_ShadowRay",
+        L"MyHitGroup_Triangle", L"MyHitGroup_Triangle_ShadowRay",
+        L"MyHitGroup_AABB_AnalyticPrimitive", L"MyHitGroup_AABB_AnalyticPrimitive_ShadowRay",
+    };
+
+    // Ray gen with 8 bytes of arguments, two ray types, one triangle primitive with 16 bytes
+    // and three procedural primitives with 40 bytes each.
+    ShaderTableLayoutDesc SampleDesc()
+    {
+        ShaderTableLayoutDesc desc;
+        desc.rayGen = L"MyRaygenShader";
+        RayGenArguments rayGen = { { 1.0f, 0.5f } };
+        desc.rayGenRootArguments = RootArgumentBytes(rayGen);
+        desc.missShaders.push_back(L"MyMissShader");
+        desc.missShaders.push_back(L"MyMissShader_ShadowRay");
+
+        HitGroupGeometryDesc triangles;
+        triangles.hitGroups.push_back(L"MyHitGroup_Triangle");
+        triangles.hitGroups.push_back(L"MyHitGroup_Triangle_ShadowRay");
+        TriangleArguments plane = { { 0.9f, 0.9f, 0.9f, 1.0f } };
+        triangles.AddPrimitive(plane);
+        desc.geometries.push_back(triangles);
+
+        HitGroupGeometryDesc aabbs;
+        aabbs.hitGroups.push_back(L"MyHitGroup_AABB_AnalyticPrimitive");
+        aabbs.hitGroups.push_back(L"MyHitGroup_AABB_AnalyticPrimitive_ShadowRay");
+        for (uint32_t i = 0; i < 3; i++) {
+            ProceduralArguments arguments = { { 0.1f * i, 0.2f, 0.3f, 1.0f }, i, 100 + i, { 0, 0, 0, 0 } };
+            aabbs.AddPrimitive(arguments);
+        }
+        desc.geometries.push_back(aabbs);
+        return desc;
+    }
+
+    StubShaderIdentifierProvider SampleProvider()
+    {
+        return StubShaderIdentifierProvider(std::vector<std::wstring>(exports, exports + sizeof(exports) / sizeof(exports[0])));
+    }
+
+    bool SameBytes(const void* a, const void* b, size_t size)
+    {
+        return std::memcmp(a, b, size) == 0;
+    }
+}
+
+TEST(TablesAndRecordsAreAligned)
+{
+    StubShaderIdentifierProvider provider = SampleProvider();
+    ShaderTableLayout layout;
+    std::string error;
+    CHECK(layout.Build(SampleDesc(), provider, &error));
+    CHECK_EQUAL(std::string(), error);
+
+    for (uint32_t t = 0; t < ShaderTableType::Count; t++) {
+        const ShaderTableRange& range = layout.tables[t];
+        CHECK_EQUAL(0u, range.offset % ShaderTableAlignment);
+        CHECK_EQUAL(0u, range.stride % ShaderRecordAlignment);
+        CHECK_EQUAL(static_cast<uint64_t>(range.stride) * range.count, range.size);
+        for (uint32_t i = 0; i < range.count; i++) {
+            CHECK_EQUAL(0u, static_cast<uint64_t>(layout.Record(static_cast<ShaderTableType::Enum>(t), i) - layout.image.data()) % ShaderRecordAlignment);
+        }
+        if (t > 0) {
+            const ShaderTableRange& previous = layout.tables[t - 1];
+            CHECK(range.offset >= previous.offset + previous.size);
+        }
+    }
+    const ShaderTableRange& last = layout.tables[ShaderTableType::HitGroup];
+    CHECK_EQUAL(last.offset + last.size, static_cast<uint64_t>(layout.image.size()));
+}
+
+TEST(EachTableHasItsOwnStride)
+{
+    StubShaderIdentifierProvider provider = SampleProvider();
+    ShaderTableLayout layout;
+    CHECK(layout.Build(SampleDesc(), provider));
+
+    // 32 + 8 rounds up to 64; identifiers alone fit 32; 32 + 40 rounds up to 96.
+    CHECK_EQUAL(64u, layout.tables[ShaderTableType::RayGen].stride);
+    CHECK_EQUAL(1u, layout.tables[ShaderTableType::RayGen].count);
+    CHECK_EQUAL(32u, layout.tables[ShaderTableType::Miss].stride);
+    CHECK_EQUAL(2u, layout.tables[ShaderTableType::Miss].count);
+    CHECK_EQUAL(96u, layout.tables[ShaderTableType::HitGroup].stride);
+    CHECK_EQUAL(8u, layout.tables[ShaderTableType::HitGroup].count);
+    CHECK_EQUAL(0u, layout.tables[ShaderTableType::RayGen].offset);
+    CHECK_EQUAL(64u, layout.tables[ShaderTableType::Miss].offset);
+    CHECK_EQUAL(128u, layout.tables[ShaderTableType::HitGroup].offset);
+}
+
+TEST(HitGroupRecordsArePerGeometryThenPrimitiveThenRayType)
+{
+    StubShaderIdentifierProvider provider = SampleProvider();
+    ShaderTableLayoutDesc desc = SampleDesc();
+    ShaderTableLayout layout;
+    CHECK(layout.Build(desc, provider));
+
+    uint32_t rayTypes = static_cast<uint32_t>(desc.missShaders.size());
+    CHECK_EQUAL(size_t(2), layout.geometryFirstRecord.size());
+    CHECK_EQUAL(0u, layout.geometryFirstRecord[0]);
+    CHECK_EQUAL(2u, layout.geometryFirstRecord[1]);
+
+    for (size_t g = 0; g < desc.geometries.size(); g++) {
+        const HitGroupGeometryDesc& geometry = desc.geometries[g];
+        for (uint32_t p = 0; p < geometry.primitiveRootArguments.size(); p++) {
+            for (uint32_t r = 0; r < rayTypes; r++) {
+                // The index TraceRay computes: instance contribution + geometry index * ray types + ray type.
+                uint32_t index = layout.geometryFirstRecord[g] + p * rayTypes + r;
+                const uint8_t* record = layout.Record(ShaderTableType::HitGroup, index);
+                const std::vector<uint8_t>& arguments = geometry.primitiveRootArguments[p];
+                CHECK(SameBytes(record, provider.GetShaderIdentifier(geometry.hitGroups[r].c_str()), ShaderIdentifierSize));
+                CHECK(SameBytes(record + ShaderIdentifierSize, arguments.data(), arguments.size()));
+            }
+        }
+    }
+
+    const uint8_t* rayGen = layout.Record(ShaderTableType::RayGen, 0);
+    CHECK(SameBytes(rayGen, provider.GetShaderIdentifier(L"MyRaygenShader"), ShaderIdentifierSize));
+    CHECK(SameBytes(rayGen + ShaderIdentifierSize, desc.rayGenRootArguments.data(), desc.rayGenRootArguments.size()));
+    CHECK(SameBytes(layout.Record(ShaderTableType::Miss, 1), provider.GetShaderIdentifier(L"MyMissShader_ShadowRay"), ShaderIdentifierSize));
+}
+
+TEST(StubIdentifiersAreStablePerExport)
+{
+    StubShaderIdentifierProvider provider;
+    const void* a = provider.GetShaderIdentifier(L"MyMissShader");
+    const void* b = provider.GetShaderIdentifier(L"MyMissShader_ShadowRay");
+    CHECK(a != nullptr && b != nullptr);
+    CHECK(!SameBytes(a, b, ShaderIdentifierSize));
+    CHECK(a == provider.GetShaderIdentifier(L"MyMissShader"));
+    CHECK(SampleProvider().GetShaderIdentifier(L"NotExported") == nullptr);
+}
+
+TEST(UnknownExportsAndRayTypeMismatchesFail)
+{
+    StubShaderIdentifierProvider provider = SampleProvider();
+    ShaderTableLayout layout;
+    std::string error;
+
+    ShaderTableLayoutDesc unknown = SampleDesc();
+    unknown.missShaders[1] = L"MyMissShader_Missing";
+    CHECK(!layout.Build(unknown, provider, &error));
+    CHECK_EQUAL(std::string("unknown shader export MyMissShader_Missing"), error);
+
+    ShaderTableLayoutDesc mismatched = SampleDesc();
+    mismatched.geometries[1].hitGroups.pop_back();
+    error.clear();
+    CHECK(!layout.Build(mismatched, provider, &error));
+    CHECK(!error.empty());
+
+    ShaderTableLayoutDesc missArguments = SampleDesc();
+    missArguments.missRootArguments.resize(1);
+    error.clear();
+    CHECK(!layout.Build(missArguments, provider, &error));
+    CHECK(!error.empty());
+}
+
+TEST_MAIN()
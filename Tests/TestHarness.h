@@ -0,0 +1,91 @@
+#pragma once
+
+//**********************************************************************************************
+//
+// TestHarness.h
+//
+// The few macros the portable unit tests need, so they build without a test framework. A
+// test file declares cases with TEST(name), checks with CHECK and CHECK_EQUAL, and ends with
+// TEST_MAIN(). Failed checks are printed with their file and line, and the process exits
+// non-zero if any failed, which is all CTest looks at.
+//
+//**********************************************************************************************
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace TestHarness {
+
+    struct Case {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<Case>& Cases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    inline int& Failures()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    struct Registration {
+        Registration(const char* name, void (*run)())
+        {
+            Case c = { name, run };
+            Cases().push_back(c);
+        }
+    };
+
+    inline void Fail(const char* file, int line, const std::string& message)
+    {
+        std::printf("%s(%d): %s\n", file, line, message.c_str());
+        Failures()++;
+    }
+
+    inline int Run()
+    {
+        for (const Case& c : Cases()) {
+            int before = Failures();
+            c.run();
+            std::printf("%s %s\n", Failures() == before ? "[pass]" : "[FAIL]", c.name);
+        }
+        std::printf("%zu cases, %d failed checks\n", Cases().size(), Failures());
+        return Failures() == 0 ? 0 : 1;
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static TestHarness::Registration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            TestHarness::Fail(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        const auto& expectedValue = (expected); \
+        const auto& actualValue = (actual); \
+        if (!(expectedValue == actualValue)) { \
+            std::ostringstream message; \
+            message << "CHECK_EQUAL(" #expected ", " #actual "): expected " << expectedValue << ", got " << actualValue; \
+            TestHarness::Fail(__FILE__, __LINE__, message.str()); \
+        } \
+    } while (0)
+
+#define TEST_MAIN() \
+    int main() \
+    { \
+        return TestHarness::Run(); \
+    }
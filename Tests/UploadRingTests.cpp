@@ -0,0 +1,107 @@
+#include "UploadRing.h"
+#include "TestHarness.h"
+
+TEST(FrameLayoutAlignsEachItem)
+{
+    UploadFrameLayout layout;
+    CHECK_EQUAL(0u, layout.Add(12, 4));
+    CHECK_EQUAL(16u, layout.Add(64, 16));
+    CHECK_EQUAL(80u, layout.Add(4, 4));
+    CHECK_EQUAL(84u, layout.Size());
+    CHECK_EQUAL(16u, layout.Alignment());
+}
+
+TEST(AllocationsAreAlignedWithinAFrame)
+{
+    UploadRingAllocator ring;
+    ring.Init(256);
+    CHECK_EQUAL(0u, ring.TryAllocate(10, 1));
+    CHECK_EQUAL(16u, ring.TryAllocate(8, 16));
+    CHECK_EQUAL(2u, ring.FrameAllocations());
+    CHECK_EQUAL(24u, ring.FrameBytes());
+    CHECK_EQUAL(24u, ring.UsedBytes());
+}
+
+TEST(AllocationWrapsToTheStartPastTheTail)
+{
+    FakeFrameFence fence;
+    UploadRingAllocator ring;
+    ring.Init(256);
+
+    CHECK_EQUAL(0u, ring.Allocate(100, 1, fence));
+    ring.EndFrame(1);
+    CHECK_EQUAL(100u, ring.Allocate(100, 1, fence));
+    ring.EndFrame(2);
+
+    // Frame 1 is done, so [0, 100) is free; 100 bytes no longer fit after 200 and the
+    // allocation starts again at zero, skipping the last 56 bytes.
+    fence.Complete(1);
+    CHECK_EQUAL(0u, ring.Allocate(100, 1, fence));
+    CHECK_EQUAL(156u, ring.FrameBytes());
+    CHECK_EQUAL(256u, ring.UsedBytes());
+    CHECK_EQUAL(0u, ring.Stalls());
+
+    // The ring is full up to the tail until frame 2 completes.
+    CHECK_EQUAL(UploadRingAllocator::InvalidOffset, ring.TryAllocate(1, 1));
+    ring.EndFrame(3);
+    ring.Reclaim(2);
+    CHECK_EQUAL(100u, ring.TryAllocate(100, 1));
+}
+
+TEST(SpaceIsReclaimedOnceItsFenceCompletes)
+{
+    FakeFrameFence fence;
+    UploadRingAllocator ring;
+    ring.Init(256);
+
+    CHECK_EQUAL(0u, ring.Allocate(200, 1, fence));
+    ring.EndFrame(1);
+    CHECK_EQUAL(1u, ring.PendingFrames());
+    CHECK_EQUAL(UploadRingAllocator::InvalidOffset, ring.TryAllocate(100, 1));
+
+    // An older value leaves the frame live.
+    ring.Reclaim(0);
+    CHECK_EQUAL(1u, ring.PendingFrames());
+    CHECK_EQUAL(200u, ring.UsedBytes());
+
+    fence.Complete(1);
+    CHECK_EQUAL(0u, ring.Allocate(100, 1, fence));
+    CHECK_EQUAL(0u, ring.PendingFrames());
+    CHECK_EQUAL(0u, ring.Stalls());
+    CHECK_EQUAL(0u, fence.waits);
+}
+
+TEST(FullRingWaitsForTheOldestFrames)
+{
+    FakeFrameFence fence;
+    UploadRingAllocator ring;
+    ring.Init(256);
+
+    for (uint64_t frame = 1; frame <= 3; frame++) {
+        CHECK_EQUAL((frame - 1) * 80, ring.Allocate(80, 1, fence));
+        ring.EndFrame(frame);
+    }
+
+    // 100 bytes fit neither after 240 nor before a tail at 80, so frames 1 and 2 are waited on.
+    CHECK_EQUAL(UploadRingAllocator::InvalidOffset, ring.TryAllocate(100, 1));
+    CHECK_EQUAL(0u, ring.Allocate(100, 1, fence));
+    CHECK_EQUAL(2u, ring.Stalls());
+    CHECK_EQUAL(2u, fence.waits);
+    CHECK_EQUAL(2u, fence.completed);
+    CHECK_EQUAL(1u, ring.PendingFrames());
+}
+
+TEST(OversizedAllocationsFailWithoutWaiting)
+{
+    FakeFrameFence fence;
+    UploadRingAllocator ring;
+    ring.Init(256);
+    CHECK_EQUAL(0u, ring.Allocate(64, 1, fence));
+    ring.EndFrame(1);
+
+    CHECK_EQUAL(UploadRingAllocator::InvalidOffset, ring.Allocate(257, 1, fence));
+    CHECK_EQUAL(0u, fence.waits);
+    CHECK_EQUAL(1u, ring.PendingFrames());
+}
+
+TEST_MAIN()